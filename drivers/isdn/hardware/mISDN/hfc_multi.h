@@ -56,8 +56,11 @@ struct hfc_chan {
 					/* the FIFO 0=no, 1=yes, 2=splloop */
 	int		Zfill;	/* rx-fifo level on last hfcmulti_tx */
 	int		rx_off; /* set to turn fifo receive off */
+	int		poll;	/* samples per fifo irq, 0 = timer irq */
+	int		lowlat;	/* fifo irq is programmed for poll */
 	int		coeff_count; /* curren coeff block */
 	s32		*coeff; /* memory pointer to 8 coeff blocks */
+	int		echocan; /* set if VPM echo canceller is on */
 };
 
 
@@ -115,6 +118,11 @@ struct hfcm_hw {
 #define	HFC_CHIP_PLXSD		14 /* whether we have a Speech-Design PLX */
 #define	HFC_CHIP_EMBSD          15 /* whether we have a SD Embedded board */
 
+/* resync jobs (bit numbers in e1_resync), done by the timer interrupt */
+#define	E1_RESYNC_SYNC_I	0 /* get SYNC_I */
+#define	E1_RESYNC_JATT		1 /* switch to jatt PLL */
+#define	E1_RESYNC_QUARTZ	2 /* switch to quartz */
+
 #define HFC_IO_MODE_PCIMEM	0x00 /* normal memory mapped IO */
 #define HFC_IO_MODE_REGIO	0x01 /* PCI io access */
 #define HFC_IO_MODE_PLXSD	0x02 /* access HFC via PLX9030 */
@@ -224,7 +232,7 @@ struct hfc_multi {
 	int		e1_state; /* keep track of last state */
 	int		e1_getclock; /* if sync is retrieved from interface */
 	int		syncronized; /* keep track of existing sync interface */
-	int		e1_resync; /* resync jobs */
+	u_long		e1_resync; /* resync jobs (E1_RESYNC_*) */
 
 	spinlock_t	lock;	/* the lock */
 
@@ -237,7 +245,9 @@ struct hfc_multi {
 	 * the bch->channel is equvalent to the hfc-channel
 	 */
 	struct hfc_chan	chan[32];
+	u_long		timer_ch; /* channels serviced by the timer irq */
 	signed char	slot_owner[256]; /* owner channel of slot */
+	int		vpm_used; /* channels using the VPM echo canceller */
 };
 
 /* PLX GPIOs */
@@ -89,6 +89,8 @@
  *	By default 128 is used. Decrease to reduce delay, increase to
  *	reduce cpu load. If unsure, don't mess with it!
  *	Valid is 8, 16, 32, 64, 128, 256.
+ *	Single transparent B-channels may use a lower value, they get
+ *	a fifo interrupt instead (MISDN_CTRL_HFC_POLL).
  *
  * pcm:
  *	NOTE: only one pcm value must be given for every card.
@@ -155,6 +157,33 @@
  * hwid:
  *	NOTE: only one hwid value must be given once
  *	Enable special embedded devices with XHFC controllers.
+ *
+ * vpmslots:
+ *	NOTE: only one vpmslots value must be given for all cards
+ *	Limit the number of channels of each card that use the echo canceller
+ *	of the VPM module (B410P). Further requests are rejected, so the DSP
+ *	uses a software echo canceller instead.
+ *	By default (0), all channels may use the VPM echo canceller.
+ *
+ * irqthread:
+ *	NOTE: only one irqthread value must be given for all cards
+ *	If set, the interrupt work of all cards is done in an irq thread
+ *	instead of the interrupt handler, so other devices are not delayed
+ *	by it. The interrupt line must not be shared with other devices
+ *	that do not allow a threaded handler, else the card uses its
+ *	interrupt handler.
+ *
+ * irqcpu:
+ *	NOTE: one irqcpu value may be given for every card.
+ *	The cpu that handles the interrupt (and the irq thread) of the card.
+ *	By default (-1), the affinity of the interrupt is not changed.
+ *
+ * asyncinit:
+ *	NOTE: only one asyncinit value must be given for all cards
+ *	If set (default), the hardware of each PCI card is initialized in
+ *	parallel to the other cards after the probe, and the ports are
+ *	registered when the card is ready. Speech Design cards (PLXSD) share
+ *	their PCM bus and are always initialized in order during the probe.
  */
 
 /*
@@ -169,8 +198,11 @@
 #include <linux/slab.h>
 #include <linux/pci.h>
 #include <linux/delay.h>
+#include <linux/log2.h>
+#include <linux/async.h>
 #include <linux/mISDNhw.h>
 #include <linux/mISDNdsp.h>
+#include <trace/events/misdn.h>
 
 /*
   #define IRQCOUNT_DEBUG
@@ -237,6 +269,11 @@ static uint	clockdelay_nt = CLKDEL_NT;
 #define HWID_MINIP8	2
 #define HWID_MINIP16	3
 static uint	hwid = HWID_NONE;
+static uint	vpmslots;
+static bool	irqthread;
+static int	irqcpu[MAX_CARDS] = {[0 ... (MAX_CARDS - 1)] = -1};
+static bool	asyncinit = 1;
+static ASYNC_DOMAIN_EXCLUSIVE(hfcmulti_async);
 
 static int	HFC_cnt, E1_cnt, bmask_cnt, Port_cnt, PCM_cnt = 99;
 
@@ -256,6 +293,10 @@ module_param_array(bmask, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(iomode, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(port, uint, NULL, S_IRUGO | S_IWUSR);
 module_param(hwid, uint, S_IRUGO | S_IWUSR); /* The hardware ID */
+module_param(vpmslots, uint, S_IRUGO | S_IWUSR);
+module_param(irqthread, bool, S_IRUGO);
+module_param_array(irqcpu, int, NULL, S_IRUGO);
+module_param(asyncinit, bool, S_IRUGO);
 
 #ifdef HFC_REGISTER_DEBUG
 #define HFC_outb(hc, reg, val)					\
@@ -463,15 +504,20 @@ HFC_wait_debug(struct hfc_multi *hc, const char *function, int line)
 }
 #endif
 
+/*
+ * fifo data is moved with 32 bit string io, the bytes keep the order of the
+ * fifo on any cpu. the remaining bytes are moved by 16 and 8 bit accesses.
+ */
+
 /* write fifo data (REGIO) */
 static void
 write_fifo_regio(struct hfc_multi *hc, u_char *data, int len)
 {
 	outb(A_FIFO_DATA0, (hc->pci_iobase) + 4);
-	while (len >> 2) {
-		outl(cpu_to_le32(*(u32 *)data), hc->pci_iobase);
-		data += 4;
-		len -= 4;
+	if (len >> 2) {
+		outsl(hc->pci_iobase, data, len >> 2);
+		data += len & ~3;
+		len &= 3;
 	}
 	while (len >> 1) {
 		outw(cpu_to_le16(*(u16 *)data), hc->pci_iobase);
@@ -488,11 +534,10 @@ write_fifo_regio(struct hfc_multi *hc, u_char *data, int len)
 static void
 write_fifo_pcimem(struct hfc_multi *hc, u_char *data, int len)
 {
-	while (len >> 2) {
-		writel(cpu_to_le32(*(u32 *)data),
-		       hc->pci_membase + A_FIFO_DATA0);
-		data += 4;
-		len -= 4;
+	if (len >> 2) {
+		iowrite32_rep(hc->pci_membase + A_FIFO_DATA0, data, len >> 2);
+		data += len & ~3;
+		len &= 3;
 	}
 	while (len >> 1) {
 		writew(cpu_to_le16(*(u16 *)data),
@@ -512,10 +557,10 @@ static void
 read_fifo_regio(struct hfc_multi *hc, u_char *data, int len)
 {
 	outb(A_FIFO_DATA0, (hc->pci_iobase) + 4);
-	while (len >> 2) {
-		*(u32 *)data = le32_to_cpu(inl(hc->pci_iobase));
-		data += 4;
-		len -= 4;
+	if (len >> 2) {
+		insl(hc->pci_iobase, data, len >> 2);
+		data += len & ~3;
+		len &= 3;
 	}
 	while (len >> 1) {
 		*(u16 *)data = le16_to_cpu(inw(hc->pci_iobase));
@@ -533,11 +578,10 @@ read_fifo_regio(struct hfc_multi *hc, u_char *data, int len)
 static void
 read_fifo_pcimem(struct hfc_multi *hc, u_char *data, int len)
 {
-	while (len >> 2) {
-		*(u32 *)data =
-			le32_to_cpu(readl(hc->pci_membase + A_FIFO_DATA0));
-		data += 4;
-		len -= 4;
+	if (len >> 2) {
+		ioread32_rep(hc->pci_membase + A_FIFO_DATA0, data, len >> 2);
+		data += len & ~3;
+		len &= 3;
 	}
 	while (len >> 1) {
 		*(u16 *)data =
@@ -856,7 +900,7 @@ vpm_check(struct hfc_multi *hctmp)
  *
  */
 
-static void
+static int
 vpm_echocan_on(struct hfc_multi *hc, int ch, int taps)
 {
 	unsigned int timeslot;
@@ -867,10 +911,22 @@ vpm_echocan_on(struct hfc_multi *hc, int ch, int taps)
 	struct sk_buff *skb;
 #endif
 	if (hc->chan[ch].protocol != ISDN_P_B_RAW)
-		return;
+		return -EINVAL;
 
 	if (!bch)
-		return;
+		return -EINVAL;
+
+	if (!hc->chan[ch].echocan) {
+		if (vpmslots && hc->vpm_used >= vpmslots) {
+			if (debug & DEBUG_HFCMULTI_MSG)
+				printk(KERN_DEBUG "%s: all %d VPM echo "
+				       "cancellers in use\n", __func__,
+				       hc->vpm_used);
+			return -EBUSY;
+		}
+		hc->chan[ch].echocan = 1;
+		hc->vpm_used++;
+	}
 
 #ifdef TXADJ
 	skb = _alloc_mISDN_skb(PH_CONTROL_IND, HFC_VOL_CHANGE_TX,
@@ -886,9 +942,10 @@ vpm_echocan_on(struct hfc_multi *hc, int ch, int taps)
 	       taps, timeslot);
 
 	vpm_out(hc, unit, timeslot, 0x7e);
+	return 0;
 }
 
-static void
+static int
 vpm_echocan_off(struct hfc_multi *hc, int ch)
 {
 	unsigned int timeslot;
@@ -899,11 +956,16 @@ vpm_echocan_off(struct hfc_multi *hc, int ch)
 	struct sk_buff *skb;
 #endif
 
+	if (hc->chan[ch].echocan) {
+		hc->chan[ch].echocan = 0;
+		hc->vpm_used--;
+	}
+
 	if (hc->chan[ch].protocol != ISDN_P_B_RAW)
-		return;
+		return -EINVAL;
 
 	if (!bch)
-		return;
+		return -EINVAL;
 
 #ifdef TXADJ
 	skb = _alloc_mISDN_skb(PH_CONTROL_IND, HFC_VOL_CHANGE_TX,
@@ -919,59 +981,78 @@ vpm_echocan_off(struct hfc_multi *hc, int ch)
 	       timeslot);
 	/* FILLME */
 	vpm_out(hc, unit, timeslot, 0x01);
+	return 0;
 }
 
 
 /*
  * Speech Design resync feature
  * NOTE: This is called sometimes outside interrupt handler.
- * We must lock irqsave, so no other interrupt (other card) will occur!
- * Also multiple interrupts may nest, so must lock each access (lists, card)!
+ * The sync master is elected lockless (see plxsd_checksync), so a sync
+ * change of one card does not block the interrupts of the other cards.
+ * The list of cards is walked under RCU, register access of each card is
+ * done under plx_lock only.
+ * A resync that is requested while another one is running, is done by the
+ * running one, so the register writes of the cards are never mixed.
  */
-static inline void
-hfcmulti_resync(struct hfc_multi *locked, struct hfc_multi *newmaster, int rm)
+static atomic_t plxsd_resync_req = ATOMIC_INIT(0);
+
+static void
+hfcmulti_resync(int rm)
 {
-	struct hfc_multi *hc, *next, *pcmmaster = NULL;
+	struct hfc_multi *hc, *newmaster, *pcmmaster;
 	void __iomem *plx_acc_32;
 	u_int pv;
 	u_long flags;
 
-	spin_lock_irqsave(&HFClock, flags);
-	spin_lock(&plx_lock); /* must be locked inside other locks */
+	if (atomic_inc_return(&plxsd_resync_req) > 1)
+		return;
+
+	rcu_read_lock();
+again:
+	pcmmaster = NULL;
+	newmaster = READ_ONCE(syncmaster);
 
 	if (debug & DEBUG_HFCMULTI_PLXSD)
 		printk(KERN_DEBUG "%s: RESYNC(syncmaster=0x%p)\n",
-		       __func__, syncmaster);
+		       __func__, newmaster);
 
 	/* select new master */
 	if (newmaster) {
 		if (debug & DEBUG_HFCMULTI_PLXSD)
 			printk(KERN_DEBUG "using provided controller\n");
 	} else {
-		list_for_each_entry_safe(hc, next, &HFClist, list) {
-			if (test_bit(HFC_CHIP_PLXSD, &hc->chip)) {
-				if (hc->syncronized) {
-					newmaster = hc;
-					break;
-				}
+		list_for_each_entry_rcu(hc, &HFClist, list) {
+			if (test_bit(HFC_CHIP_PLXSD, &hc->chip) &&
+			    READ_ONCE(hc->syncronized) &&
+			    !cmpxchg(&syncmaster, NULL, hc)) {
+				newmaster = hc;
+				break;
 			}
 		}
+		/* another card got sync meanwhile */
+		if (!newmaster)
+			newmaster = READ_ONCE(syncmaster);
 	}
 
 	/* Disable sync of all cards */
-	list_for_each_entry_safe(hc, next, &HFClist, list) {
+	list_for_each_entry_rcu(hc, &HFClist, list) {
 		if (test_bit(HFC_CHIP_PLXSD, &hc->chip)) {
+			spin_lock_irqsave(&plx_lock, flags);
 			plx_acc_32 = hc->plx_membase + PLX_GPIOC;
 			pv = readl(plx_acc_32);
 			pv &= ~PLX_SYNC_O_EN;
 			writel(pv, plx_acc_32);
+			spin_unlock_irqrestore(&plx_lock, flags);
 			if (test_bit(HFC_CHIP_PCM_MASTER, &hc->chip)) {
 				pcmmaster = hc;
 				if (hc->ctype == HFC_TYPE_E1) {
 					if (debug & DEBUG_HFCMULTI_PLXSD)
 						printk(KERN_DEBUG
 						       "Schedule SYNC_I\n");
-					hc->e1_resync |= 1; /* get SYNC_I */
+					/* get SYNC_I */
+					set_bit(E1_RESYNC_SYNC_I,
+						&hc->e1_resync);
 				}
 			}
 		}
@@ -983,16 +1064,19 @@ hfcmulti_resync(struct hfc_multi *locked, struct hfc_multi *newmaster, int rm)
 			printk(KERN_DEBUG "id=%d (0x%p) = syncronized with "
 			       "interface.\n", hc->id, hc);
 		/* Enable new sync master */
+		spin_lock_irqsave(&plx_lock, flags);
 		plx_acc_32 = hc->plx_membase + PLX_GPIOC;
 		pv = readl(plx_acc_32);
 		pv |= PLX_SYNC_O_EN;
 		writel(pv, plx_acc_32);
+		spin_unlock_irqrestore(&plx_lock, flags);
 		/* switch to jatt PLL, if not disabled by RX_SYNC */
 		if (hc->ctype == HFC_TYPE_E1
 		    && !test_bit(HFC_CHIP_RX_SYNC, &hc->chip)) {
 			if (debug & DEBUG_HFCMULTI_PLXSD)
 				printk(KERN_DEBUG "Schedule jatt PLL\n");
-			hc->e1_resync |= 2; /* switch to jatt */
+			/* switch to jatt */
+			set_bit(E1_RESYNC_JATT, &hc->e1_resync);
 		}
 	} else {
 		if (pcmmaster) {
@@ -1007,47 +1091,55 @@ hfcmulti_resync(struct hfc_multi *locked, struct hfc_multi *newmaster, int rm)
 				if (debug & DEBUG_HFCMULTI_PLXSD)
 					printk(KERN_DEBUG
 					       "Schedule QUARTZ for HFC-E1\n");
-				hc->e1_resync |= 4; /* switch quartz */
+				/* switch quartz */
+				set_bit(E1_RESYNC_QUARTZ, &hc->e1_resync);
 			} else {
 				if (debug & DEBUG_HFCMULTI_PLXSD)
 					printk(KERN_DEBUG
 					       "QUARTZ is automatically "
 					       "enabled by HFC-%dS\n", hc->ctype);
 			}
+			spin_lock_irqsave(&plx_lock, flags);
 			plx_acc_32 = hc->plx_membase + PLX_GPIOC;
 			pv = readl(plx_acc_32);
 			pv |= PLX_SYNC_O_EN;
 			writel(pv, plx_acc_32);
+			spin_unlock_irqrestore(&plx_lock, flags);
 		} else
 			if (!rm)
 				printk(KERN_ERR "%s no pcm master, this MUST "
 				       "not happen!\n", __func__);
 	}
-	syncmaster = newmaster;
 
-	spin_unlock(&plx_lock);
-	spin_unlock_irqrestore(&HFClock, flags);
+	/* requested again while running, so do it again */
+	if (atomic_dec_return(&plxsd_resync_req))
+		goto again;
+	rcu_read_unlock();
 }
 
-/* This must be called AND hc must be locked irqsave!!! */
+/*
+ * This must be called AND hc must be locked irqsave!!!
+ * only the card that wins the election (or gives up being sync master)
+ * does the resync of all cards.
+ */
 static inline void
 plxsd_checksync(struct hfc_multi *hc, int rm)
 {
 	if (hc->syncronized) {
-		if (syncmaster == NULL) {
+		if (!cmpxchg(&syncmaster, NULL, hc)) {
 			if (debug & DEBUG_HFCMULTI_PLXSD)
 				printk(KERN_DEBUG "%s: GOT sync on card %d"
 				       " (id=%d)\n", __func__, hc->id + 1,
 				       hc->id);
-			hfcmulti_resync(hc, hc, rm);
+			hfcmulti_resync(rm);
 		}
 	} else {
-		if (syncmaster == hc) {
+		if (cmpxchg(&syncmaster, hc, NULL) == hc) {
 			if (debug & DEBUG_HFCMULTI_PLXSD)
 				printk(KERN_DEBUG "%s: LOST sync on card %d"
 				       " (id=%d)\n", __func__, hc->id + 1,
 				       hc->id);
-			hfcmulti_resync(hc, NULL, rm);
+			hfcmulti_resync(rm);
 		}
 	}
 }
@@ -1954,6 +2046,7 @@ hfcmulti_tx(struct hfc_multi *hc, int ch)
 	int i, ii, temp, len = 0;
 	int Zspace, z1, z2; /* must be int for calculation */
 	int Fspace, f1, f2;
+	int zknown = 0; /* z1/z2 still valid from the last frame */
 	u_char *d;
 	int *txpending, slot_tx;
 	struct	bchannel *bch;
@@ -2036,13 +2129,22 @@ next_frame:
 		if (Fspace == 0)
 			return;
 	}
-	z1 = HFC_inw_nodebug(hc, A_Z1) - hc->Zmin;
-	z2 = HFC_inw_nodebug(hc, A_Z2) - hc->Zmin;
-	while (z2 != (temp = (HFC_inw_nodebug(hc, A_Z2) - hc->Zmin))) {
-		if (debug & DEBUG_HFCMULTI_FIFO)
-			printk(KERN_DEBUG "%s(card %d): reread z2 because "
-			       "%d!=%d\n", __func__, hc->id + 1, temp, z2);
-		z2 = temp; /* repeat unti Z2 is equal */
+	/*
+	 * on transparent data we only move z1 ourself, so z1 and z2 of the
+	 * last frame of this call are used again. the old z2 is behind the
+	 * real one, so the space is never overestimated.
+	 */
+	if (!zknown) {
+		z1 = HFC_inw_nodebug(hc, A_Z1) - hc->Zmin;
+		z2 = HFC_inw_nodebug(hc, A_Z2) - hc->Zmin;
+		while (z2 != (temp = (HFC_inw_nodebug(hc, A_Z2) -
+				      hc->Zmin))) {
+			if (debug & DEBUG_HFCMULTI_FIFO)
+				printk(KERN_DEBUG "%s(card %d): reread z2 "
+				       "because %d!=%d\n", __func__,
+				       hc->id + 1, temp, z2);
+			z2 = temp; /* repeat unti Z2 is equal */
+		}
 	}
 	hc->chan[ch].Zfill = z1 - z2;
 	if (hc->chan[ch].Zfill < 0)
@@ -2053,7 +2155,8 @@ next_frame:
 	Zspace -= 4; /* keep not too full, so pointers will not overrun */
 	/* fill transparent data only to maxinum transparent load (minus 4) */
 	if (bch && test_bit(FLG_TRANSPARENT, &bch->Flags))
-		Zspace = Zspace - hc->Zlen + hc->max_trans;
+		Zspace = Zspace - hc->Zlen + (hc->chan[ch].lowlat ?
+				(hc->chan[ch].poll << 1) : hc->max_trans);
 	if (Zspace <= 0) /* no space of 4 bytes */
 		return;
 
@@ -2103,6 +2206,9 @@ next_frame:
 		/* fill buffer, to prevent future underrun */
 		hc->write_fifo(hc, hc->silence_data, poll >> 1);
 		Zspace -= (poll >> 1);
+		z1 += poll >> 1;
+		if (z1 >= hc->Zlen)
+			z1 -= hc->Zlen;
 	}
 
 	/* if audio data and connected slot */
@@ -2157,7 +2263,13 @@ next_frame:
 	/* Have to prep the audio data */
 	hc->write_fifo(hc, d, ii - i);
 	hc->chan[ch].Zfill += ii - i;
+	if (bch)
+		trace_misdn_fifo_tx(&bch->ch, bch->nr, ii - i,
+				    hc->chan[ch].Zfill);
 	*idxp = ii;
+	z1 += ii - i;
+	if (z1 >= hc->Zlen)
+		z1 -= hc->Zlen;
 
 	/* if not all data has been written */
 	if (ii != len) {
@@ -2172,10 +2284,12 @@ next_frame:
 		HFC_wait_nodebug(hc);
 	}
 
-	dev_kfree_skb(*sp);
+	mI_free_audio_skb(*sp);
 	/* check for next frame */
 	if (bch && get_next_bframe(bch)) {
 		len = (*sp)->len;
+		if (!temp)
+			zknown = 1;
 		goto next_frame;
 	}
 	if (dch && get_next_dframe(dch)) {
@@ -2266,6 +2380,8 @@ next_frame:
 		return;
 
 	if (bch) {
+		trace_misdn_fifo_rx(&bch->ch, bch->nr, Zsize,
+				    hc->chan[ch].Zfill);
 		maxlen = bchannel_get_rxbuf(bch, Zsize);
 		if (maxlen < 0) {
 			pr_warning("card%d.B%d: No bufferspace for %d bytes\n",
@@ -2406,13 +2522,12 @@ handle_timer_irq(struct hfc_multi *hc)
 {
 	int		ch, temp;
 	struct dchannel	*dch;
-	u_long		flags;
+	u_long		flags, active, resync;
 
-	/* process queued resync jobs */
-	if (hc->e1_resync) {
-		/* lock, so e1_resync gets not changed */
-		spin_lock_irqsave(&HFClock, flags);
-		if (hc->e1_resync & 1) {
+	/* process queued resync jobs, they are set by hfcmulti_resync */
+	resync = xchg(&hc->e1_resync, 0);
+	if (resync) {
+		if (resync & (1 << E1_RESYNC_SYNC_I)) {
 			if (debug & DEBUG_HFCMULTI_PLXSD)
 				printk(KERN_DEBUG "Enable SYNC_I\n");
 			HFC_outb(hc, R_SYNC_CTRL, V_EXT_CLK_SYNC);
@@ -2420,12 +2535,12 @@ handle_timer_irq(struct hfc_multi *hc)
 			if (test_bit(HFC_CHIP_RX_SYNC, &hc->chip))
 				HFC_outb(hc, R_SYNC_OUT, V_SYNC_E1_RX);
 		}
-		if (hc->e1_resync & 2) {
+		if (resync & (1 << E1_RESYNC_JATT)) {
 			if (debug & DEBUG_HFCMULTI_PLXSD)
 				printk(KERN_DEBUG "Enable jatt PLL\n");
 			HFC_outb(hc, R_SYNC_CTRL, V_SYNC_OFFS);
 		}
-		if (hc->e1_resync & 4) {
+		if (resync & (1 << E1_RESYNC_QUARTZ)) {
 			if (debug & DEBUG_HFCMULTI_PLXSD)
 				printk(KERN_DEBUG
 				       "Enable QUARTZ for HFC-E1\n");
@@ -2435,12 +2550,12 @@ handle_timer_irq(struct hfc_multi *hc)
 			/* switch to JATT, in case it is not already */
 			HFC_outb(hc, R_SYNC_OUT, 0);
 		}
-		hc->e1_resync = 0;
-		spin_unlock_irqrestore(&HFClock, flags);
 	}
 
+	/* only channels with a protocol, see mode_hfcmulti */
+	active = hc->timer_ch;
 	if (hc->ctype != HFC_TYPE_E1 || hc->e1_state == 1)
-		for (ch = 0; ch <= 31; ch++) {
+		for_each_set_bit(ch, &active, 32) {
 			if (hc->created[hc->chan[ch].port]) {
 				hfcmulti_tx(hc, ch);
 				/* fifo is started when switching to rx-fifo */
@@ -2670,12 +2785,17 @@ fifo_irq(struct hfc_multi *hc, int block)
 			HFC_outb_nodebug(hc, R_FIFO, 0);
 			HFC_wait_nodebug(hc);
 		}
-		if (bch && (r_irq_fifo_bl & (1 << j)) &&
+		/* low latency channels fill tx on their rx irq */
+		if (bch && ((r_irq_fifo_bl & (1 << j)) ||
+			    (hc->chan[ch].lowlat &&
+			     (r_irq_fifo_bl & (1 << (j + 1))))) &&
 		    test_bit(FLG_ACTIVE, &bch->Flags)) {
 			hfcmulti_tx(hc, ch);
-			/* start fifo */
-			HFC_outb_nodebug(hc, R_FIFO, 0);
-			HFC_wait_nodebug(hc);
+			/* start fifo, unless rx below selects the next fifo */
+			if (!(r_irq_fifo_bl & (1 << (j + 1)))) {
+				HFC_outb_nodebug(hc, R_FIFO, 0);
+				HFC_wait_nodebug(hc);
+			}
 		}
 		j++;
 		if (dch && (r_irq_fifo_bl & (1 << j)) &&
@@ -2693,14 +2813,17 @@ fifo_irq(struct hfc_multi *hc, int block)
 #ifdef IRQ_DEBUG
 int irqsem;
 #endif
+/*
+ * all interrupt work of the card, called with hc->lock held
+ * either from the interrupt handler or from the irq thread (irqthread)
+ */
 static irqreturn_t
-hfcmulti_interrupt(int intno, void *dev_id)
+hfcmulti_handle_irq(struct hfc_multi *hc)
 {
 #ifdef IRQCOUNT_DEBUG
 	static int iq1 = 0, iq2 = 0, iq3 = 0, iq4 = 0,
 		iq5 = 0, iq6 = 0, iqcnt = 0;
 #endif
-	struct hfc_multi	*hc = dev_id;
 	struct dchannel		*dch;
 	u_char			r_irq_statech, status, r_irq_misc, r_irq_oview;
 	int			i;
@@ -2709,13 +2832,6 @@ hfcmulti_interrupt(int intno, void *dev_id)
 	u_char			e1_syncsta, temp, temp2;
 	u_long			flags;
 
-	if (!hc) {
-		printk(KERN_ERR "HFC-multi: Spurious interrupt!\n");
-		return IRQ_NONE;
-	}
-
-	spin_lock(&hc->lock);
-
 #ifdef IRQ_DEBUG
 	if (irqsem)
 		printk(KERN_ERR "irq for card %d during irq from "
@@ -2844,17 +2960,49 @@ hfcmulti_interrupt(int intno, void *dev_id)
 #ifdef IRQ_DEBUG
 	irqsem = 0;
 #endif
-	spin_unlock(&hc->lock);
 	return IRQ_HANDLED;
 
 irq_notforus:
 #ifdef IRQ_DEBUG
 	irqsem = 0;
 #endif
-	spin_unlock(&hc->lock);
 	return IRQ_NONE;
 }
 
+static irqreturn_t
+hfcmulti_interrupt(int intno, void *dev_id)
+{
+	struct hfc_multi	*hc = dev_id;
+	irqreturn_t		ret;
+
+	if (!hc) {
+		printk(KERN_ERR "HFC-multi: Spurious interrupt!\n");
+		return IRQ_NONE;
+	}
+
+	spin_lock(&hc->lock);
+	ret = hfcmulti_handle_irq(hc);
+	spin_unlock(&hc->lock);
+	return ret;
+}
+
+/*
+ * irq thread (irqthread)
+ * the line stays masked until the thread is done, so the lock is never
+ * taken in hard irq context and local interrupts stay enabled.
+ */
+static irqreturn_t
+hfcmulti_irq_thread(int intno, void *dev_id)
+{
+	struct hfc_multi	*hc = dev_id;
+	irqreturn_t		ret;
+
+	spin_lock_bh(&hc->lock);
+	ret = hfcmulti_handle_irq(hc);
+	spin_unlock_bh(&hc->lock);
+	return ret;
+}
+
 
 /*
  * timer callback for D-chan busy resolution. Currently no function
@@ -2866,6 +3014,16 @@ hfcmulti_dbusy_timer(struct hfc_multi *hc)
 }
 
 
+/*
+ * V_TRP_IRQ of A_CON_HDLC: a transparent fifo interrupts every
+ * 2^(V_TRP_IRQ + 2) bytes, so 1 is 8 and 6 is 256 samples.
+ */
+static inline int
+hfcmulti_trp_irq(int samples)
+{
+	return (ilog2(samples) - 2) << 2;
+}
+
 /*
  * activate/deactivate hardware for selected channels and mode
  *
@@ -2888,6 +3046,7 @@ mode_hfcmulti(struct hfc_multi *hc, int ch, int protocol, int slot_tx,
 	oslot_tx = hc->chan[ch].slot_tx;
 	oslot_rx = hc->chan[ch].slot_rx;
 	conf = hc->chan[ch].conf;
+	hc->chan[ch].lowlat = 0;
 
 	if (debug & DEBUG_HFCMULTI_MODE)
 		printk(KERN_DEBUG
@@ -3111,12 +3270,20 @@ mode_hfcmulti(struct hfc_multi *hc, int ch, int protocol, int slot_tx,
 			if (hc->ctype == HFC_TYPE_XHFC)
 				HFC_outb(hc, A_CON_HDLC, flow_rx | 0x07 << 2 |
 					 V_HDLC_TRP);
+			/* Enable FIFO, interrupt every poll bytes */
+			else if (hc->chan[ch].poll) {
+				HFC_outb(hc, A_CON_HDLC, flow_rx |
+					 hfcmulti_trp_irq(hc->chan[ch].poll) |
+					 V_HDLC_TRP);
+				hc->chan[ch].lowlat = 1;
+			}
 			/* Enable FIFO, no interrupt*/
 			else
 				HFC_outb(hc, A_CON_HDLC, flow_rx | 0x00 |
 					 V_HDLC_TRP);
 			HFC_outb(hc, A_SUBCH_CFG, 0);
-			HFC_outb(hc, A_IRQ_MSK, 0);
+			HFC_outb(hc, A_IRQ_MSK,
+				 hc->chan[ch].lowlat ? V_IRQ : 0);
 			if (hc->chan[ch].protocol != protocol) {
 				HFC_outb(hc, R_INC_RES_FIFO, V_RES_F);
 				HFC_wait(hc);
@@ -3183,9 +3350,20 @@ mode_hfcmulti(struct hfc_multi *hc, int ch, int protocol, int slot_tx,
 		printk(KERN_DEBUG "%s: protocol not known %x\n",
 		       __func__, protocol);
 		hc->chan[ch].protocol = ISDN_P_NONE;
+		__clear_bit(ch, &hc->timer_ch);
 		return -ENOPROTOOPT;
 	}
+	/* a channel that is not transparent does not use the VPM anymore */
+	if (protocol != ISDN_P_B_RAW && hc->chan[ch].echocan) {
+		hc->chan[ch].echocan = 0;
+		hc->vpm_used--;
+	}
 	hc->chan[ch].protocol = protocol;
+	/* low latency channels have their fifo irq */
+	if (protocol != ISDN_P_NONE && !hc->chan[ch].lowlat)
+		__set_bit(ch, &hc->timer_ch);
+	else
+		__clear_bit(ch, &hc->timer_ch);
 	return 0;
 }
 
@@ -3466,6 +3644,7 @@ deactivate_bchannel(struct bchannel *bch)
 	hc->chan[bch->slot].coeff_count = 0;
 	hc->chan[bch->slot].rx_off = 0;
 	hc->chan[bch->slot].conf = -1;
+	hc->chan[bch->slot].poll = 0;
 	mode_hfcmulti(hc, bch->slot, ISDN_P_NONE, -1, 0, -1, 0);
 	spin_unlock_irqrestore(&hc->lock, flags);
 }
@@ -3676,7 +3855,7 @@ channel_bctrl(struct bchannel *bch, struct mISDN_ctrl_req *cq)
 		if (debug & DEBUG_HFCMULTI_MSG)
 			printk(KERN_DEBUG "%s: HFC_ECHOCAN_ON\n", __func__);
 		if (test_bit(HFC_CHIP_B410P, &hc->chip))
-			vpm_echocan_on(hc, bch->slot, cq->p1);
+			ret = vpm_echocan_on(hc, bch->slot, cq->p1);
 		else
 			ret = -EINVAL;
 		break;
@@ -3686,10 +3865,31 @@ channel_bctrl(struct bchannel *bch, struct mISDN_ctrl_req *cq)
 			printk(KERN_DEBUG "%s: HFC_ECHOCAN_OFF\n",
 			       __func__);
 		if (test_bit(HFC_CHIP_B410P, &hc->chip))
-			vpm_echocan_off(hc, bch->slot);
+			ret = vpm_echocan_off(hc, bch->slot);
 		else
 			ret = -EINVAL;
 		break;
+	case MISDN_CTRL_HFC_POLL: /* samples per fifo irq (8..poll/2, 0) */
+		num = cq->p1;
+		if (debug & DEBUG_HFCMULTI_MSG)
+			printk(KERN_DEBUG "%s: HFC_POLL %d\n", __func__, num);
+		if (num && (hc->ctype == HFC_TYPE_XHFC ||
+			    !is_power_of_2(num) || num < 8 || num >= poll)) {
+			ret = -EINVAL;
+			break;
+		}
+		/* we return the old value */
+		cq->p1 = hc->chan[bch->slot].poll;
+		hc->chan[bch->slot].poll = num;
+		bch->next_minlen = num ? num >> 1 : bch->init_minlen;
+		if (test_bit(FLG_TRANSPARENT, &bch->Flags))
+			mode_hfcmulti(hc, bch->slot,
+				      hc->chan[bch->slot].protocol,
+				      hc->chan[bch->slot].slot_tx,
+				      hc->chan[bch->slot].bank_tx,
+				      hc->chan[bch->slot].slot_rx,
+				      hc->chan[bch->slot].bank_rx);
+		break;
 	default:
 		ret = mISDN_ctrl_bchannel(bch, cq);
 		break;
@@ -4279,13 +4479,25 @@ init_card(struct hfc_multi *hc)
 	disable_hwirq(hc);
 	spin_unlock_irqrestore(&hc->lock, flags);
 
-	if (request_irq(hc->irq, hfcmulti_interrupt, IRQF_SHARED,
-			"HFC-multi", hc)) {
+	if (irqthread && !request_threaded_irq(hc->irq, NULL,
+					       hfcmulti_irq_thread,
+					       IRQF_SHARED | IRQF_ONESHOT,
+					       "HFC-multi", hc)) {
+		if (debug & DEBUG_HFCMULTI_INIT)
+			printk(KERN_DEBUG "%s: irq %d is threaded\n",
+			       __func__, hc->irq);
+	} else if (request_irq(hc->irq, hfcmulti_interrupt, IRQF_SHARED,
+			       "HFC-multi", hc)) {
 		printk(KERN_WARNING "mISDN: Could not get interrupt %d.\n",
 		       hc->irq);
 		hc->irq = 0;
 		return -EIO;
-	}
+	} else if (irqthread)
+		printk(KERN_WARNING "%s: irq %d is shared, no irq thread\n",
+		       __func__, hc->irq);
+	if (hc->id < MAX_CARDS && irqcpu[hc->id] >= 0 &&
+	    irqcpu[hc->id] < nr_cpu_ids && cpu_online(irqcpu[hc->id]))
+		irq_set_affinity_hint(hc->irq, cpumask_of(irqcpu[hc->id]));
 
 	if (test_bit(HFC_CHIP_PLXSD, &hc->chip)) {
 		spin_lock_irqsave(&plx_lock, plx_flags);
@@ -4346,6 +4558,7 @@ error:
 	if (debug & DEBUG_HFCMULTI_INIT)
 		printk(KERN_DEBUG "%s: free irq %d\n", __func__, hc->irq);
 	if (hc->irq) {
+		irq_set_affinity_hint(hc->irq, NULL);
 		free_irq(hc->irq, hc);
 		hc->irq = 0;
 	}
@@ -4668,6 +4881,7 @@ release_card(struct hfc_multi *hc)
 		if (debug & DEBUG_HFCMULTI_INIT)
 			printk(KERN_DEBUG "%s: free irq %d (hc=%p)\n",
 			    __func__, hc->irq, hc);
+		irq_set_affinity_hint(hc->irq, NULL);
 		free_irq(hc->irq, hc);
 		hc->irq = 0;
 
@@ -4686,18 +4900,21 @@ release_card(struct hfc_multi *hc)
 	if (hc->leds)
 		hfcmulti_leds(hc);
 
-	/* release hardware */
-	release_io_hfcmulti(hc);
-
+	/* the card must not be seen by hfcmulti_resync anymore */
 	if (debug & DEBUG_HFCMULTI_INIT)
 		printk(KERN_DEBUG "%s: remove instance from list\n",
 		       __func__);
-	list_del(&hc->list);
+	spin_lock_irqsave(&HFClock, flags);
+	list_del_rcu(&hc->list);
+	spin_unlock_irqrestore(&HFClock, flags);
+	cmpxchg(&syncmaster, hc, NULL);
+	synchronize_rcu();
+
+	/* release hardware */
+	release_io_hfcmulti(hc);
 
 	if (debug & DEBUG_HFCMULTI_INIT)
 		printk(KERN_DEBUG "%s: delete instance\n", __func__);
-	if (hc == syncmaster)
-		syncmaster = NULL;
 	kfree(hc);
 	if (debug & DEBUG_HFCMULTI_INIT)
 		printk(KERN_DEBUG "%s: card successfully removed\n",
@@ -4813,16 +5030,22 @@ init_e1_port_hw(struct hfc_multi *hc, struct hm_map *m)
 		hc->chan[hc->dnum[0]].jitter = 2; /* default */
 }
 
+/* the channels are allocated on the node of the card */
+static inline int
+hfc_node(struct hfc_multi *hc)
+{
+	return hc->pci_dev ? dev_to_node(&hc->pci_dev->dev) : NUMA_NO_NODE;
+}
+
 static int
 init_e1_port(struct hfc_multi *hc, struct hm_map *m, int pt)
 {
 	struct dchannel	*dch;
 	struct bchannel	*bch;
 	int		ch, ret = 0;
-	char		name[MISDN_MAX_IDLEN];
 	int		bcount = 0;
 
-	dch = kzalloc(sizeof(struct dchannel), GFP_KERNEL);
+	dch = kzalloc_node(sizeof(struct dchannel), GFP_KERNEL, hfc_node(hc));
 	if (!dch)
 		return -ENOMEM;
 	dch->debug = debug;
@@ -4840,14 +5063,16 @@ init_e1_port(struct hfc_multi *hc, struct hm_map *m, int pt)
 	for (ch = 1; ch <= 31; ch++) {
 		if (!((1 << ch) & hc->bmask[pt])) /* skip unused channel */
 			continue;
-		bch = kzalloc(sizeof(struct bchannel), GFP_KERNEL);
+		bch = kzalloc_node(sizeof(struct bchannel), GFP_KERNEL,
+				   hfc_node(hc));
 		if (!bch) {
 			printk(KERN_ERR "%s: no memory for bchannel\n",
 			    __func__);
 			ret = -ENOMEM;
 			goto free_chan;
 		}
-		hc->chan[ch].coeff = kzalloc(512, GFP_KERNEL);
+		hc->chan[ch].coeff = kzalloc_node(512, GFP_KERNEL,
+						  hfc_node(hc));
 		if (!hc->chan[ch].coeff) {
 			printk(KERN_ERR "%s: no memory for coeffs\n",
 			    __func__);
@@ -4872,16 +5097,8 @@ init_e1_port(struct hfc_multi *hc, struct hm_map *m, int pt)
 	dch->dev.nrbchan = bcount;
 	if (pt == 0)
 		init_e1_port_hw(hc, m);
-	if (hc->ports > 1)
-		snprintf(name, MISDN_MAX_IDLEN - 1, "hfc-e1.%d-%d",
-				HFC_cnt + 1, pt+1);
-	else
-		snprintf(name, MISDN_MAX_IDLEN - 1, "hfc-e1.%d", HFC_cnt + 1);
-	ret = mISDN_register_device(&dch->dev, &hc->pci_dev->dev, name);
-	if (ret)
-		goto free_chan;
-	hc->created[pt] = 1;
-	return ret;
+	/* registered by register_ports, when the card is ready */
+	return 0;
 free_chan:
 	release_port(hc, dch);
 	return ret;
@@ -4893,9 +5110,8 @@ init_multi_port(struct hfc_multi *hc, int pt)
 	struct dchannel	*dch;
 	struct bchannel	*bch;
 	int		ch, i, ret = 0;
-	char		name[MISDN_MAX_IDLEN];
 
-	dch = kzalloc(sizeof(struct dchannel), GFP_KERNEL);
+	dch = kzalloc_node(sizeof(struct dchannel), GFP_KERNEL, hfc_node(hc));
 	if (!dch)
 		return -ENOMEM;
 	dch->debug = debug;
@@ -4913,14 +5129,16 @@ init_multi_port(struct hfc_multi *hc, int pt)
 	hc->chan[i + 2].port = pt;
 	hc->chan[i + 2].nt_timer = -1;
 	for (ch = 0; ch < dch->dev.nrbchan; ch++) {
-		bch = kzalloc(sizeof(struct bchannel), GFP_KERNEL);
+		bch = kzalloc_node(sizeof(struct bchannel), GFP_KERNEL,
+				   hfc_node(hc));
 		if (!bch) {
 			printk(KERN_ERR "%s: no memory for bchannel\n",
 			       __func__);
 			ret = -ENOMEM;
 			goto free_chan;
 		}
-		hc->chan[i + ch].coeff = kzalloc(512, GFP_KERNEL);
+		hc->chan[i + ch].coeff = kzalloc_node(512, GFP_KERNEL,
+						      hfc_node(hc));
 		if (!hc->chan[i + ch].coeff) {
 			printk(KERN_ERR "%s: no memory for coeffs\n",
 			       __func__);
@@ -4986,24 +5204,87 @@ init_multi_port(struct hfc_multi *hc, int pt)
 		test_and_set_bit(HFC_CFG_DIS_ECHANNEL,
 				 &hc->chan[i + 2].cfg);
 	}
-	if (hc->ctype == HFC_TYPE_XHFC) {
-		snprintf(name, MISDN_MAX_IDLEN - 1, "xhfc.%d-%d",
-			 HFC_cnt + 1, pt + 1);
-		ret = mISDN_register_device(&dch->dev, NULL, name);
-	} else {
-		snprintf(name, MISDN_MAX_IDLEN - 1, "hfc-%ds.%d-%d",
-			 hc->ctype, HFC_cnt + 1, pt + 1);
-		ret = mISDN_register_device(&dch->dev, &hc->pci_dev->dev, name);
-	}
-	if (ret)
-		goto free_chan;
-	hc->created[pt] = 1;
-	return ret;
+	/* registered by register_ports, when the card is ready */
+	return 0;
 free_chan:
 	release_port(hc, dch);
 	return ret;
 }
 
+/* register the ports of a card, which is ready */
+static int
+register_ports(struct hfc_multi *hc)
+{
+	struct dchannel	*dch;
+	struct device	*parent = &hc->pci_dev->dev;
+	char		name[MISDN_MAX_IDLEN];
+	int		pt, ret;
+
+	for (pt = 0; pt < hc->ports; pt++) {
+		if (hc->ctype == HFC_TYPE_E1) {
+			dch = hc->chan[hc->dnum[pt]].dch;
+			if (hc->ports > 1)
+				snprintf(name, MISDN_MAX_IDLEN - 1,
+					 "hfc-e1.%d-%d", hc->id + 1, pt + 1);
+			else
+				snprintf(name, MISDN_MAX_IDLEN - 1,
+					 "hfc-e1.%d", hc->id + 1);
+		} else {
+			dch = hc->chan[(pt << 2) + 2].dch;
+			if (hc->ctype == HFC_TYPE_XHFC) {
+				snprintf(name, MISDN_MAX_IDLEN - 1,
+					 "xhfc.%d-%d", hc->id + 1, pt + 1);
+				parent = NULL;
+			} else
+				snprintf(name, MISDN_MAX_IDLEN - 1,
+					 "hfc-%ds.%d-%d", hc->ctype,
+					 hc->id + 1, pt + 1);
+		}
+		ret = mISDN_register_device(&dch->dev, parent, name);
+		if (ret)
+			return ret;
+		hc->created[pt] = 1;
+	}
+	return 0;
+}
+
+/* initialize the hardware, register the ports and start the IRQ */
+static int
+hfcmulti_start(struct hfc_multi *hc)
+{
+	u_long	flags;
+	int	err;
+
+	err = init_card(hc);
+	if (err) {
+		printk(KERN_ERR "init card returns %d\n", err);
+		return err;
+	}
+	err = register_ports(hc);
+	if (err) {
+		printk(KERN_ERR "%s: card(%d) registering ports failed %d\n",
+		       __func__, hc->id + 1, err);
+		return err;
+	}
+	spin_lock_irqsave(&hc->lock, flags);
+	enable_hwirq(hc);
+	spin_unlock_irqrestore(&hc->lock, flags);
+	return 0;
+}
+
+/* see asyncinit, the probe of the card has already succeeded */
+static void
+hfcmulti_start_async(void *data, async_cookie_t cookie)
+{
+	struct hfc_multi	*hc = data;
+
+	if (hfcmulti_start(hc))
+		release_card(hc);
+	else if (debug & DEBUG_HFCMULTI_INIT)
+		printk(KERN_DEBUG "%s: card(%d) is ready\n",
+		       __func__, hc->id + 1);
+}
+
 static int
 hfcmulti_init(struct hm_map *m, struct pci_dev *pdev,
 	      const struct pci_device_id *ent)
@@ -5036,7 +5317,8 @@ hfcmulti_init(struct hm_map *m, struct pci_dev *pdev,
 		       type[HFC_cnt]);
 
 	/* allocate card+fifo structure */
-	hc = kzalloc(sizeof(struct hfc_multi), GFP_KERNEL);
+	hc = kzalloc_node(sizeof(struct hfc_multi), GFP_KERNEL,
+			  pdev ? dev_to_node(&pdev->dev) : NUMA_NO_NODE);
 	if (!hc) {
 		printk(KERN_ERR "No kmem for HFC-Multi card\n");
 		return -ENOMEM;
@@ -5248,7 +5530,7 @@ hfcmulti_init(struct hm_map *m, struct pci_dev *pdev,
 
 	/* add to list */
 	spin_lock_irqsave(&HFClock, flags);
-	list_add_tail(&hc->list, &HFClist);
+	list_add_tail_rcu(&hc->list, &HFClist);
 	spin_unlock_irqrestore(&HFClock, flags);
 
 	/* use as clock source */
@@ -5257,17 +5539,16 @@ hfcmulti_init(struct hm_map *m, struct pci_dev *pdev,
 
 	/* initialize hardware */
 	hc->irq = (m->irq) ? : hc->pci_dev->irq;
-	ret_err = init_card(hc);
+	if (asyncinit && pdev && !test_bit(HFC_CHIP_PLXSD, &hc->chip)) {
+		async_schedule_domain(hfcmulti_start_async, hc,
+				      &hfcmulti_async);
+		return 0;
+	}
+	ret_err = hfcmulti_start(hc);
 	if (ret_err) {
-		printk(KERN_ERR "init card returns %d\n", ret_err);
 		release_card(hc);
 		return ret_err;
 	}
-
-	/* start IRQ and return */
-	spin_lock_irqsave(&hc->lock, flags);
-	enable_hwirq(hc);
-	spin_unlock_irqrestore(&hc->lock, flags);
 	return 0;
 
 free_card:
@@ -5280,9 +5561,11 @@ free_card:
 
 static void hfc_remove_pci(struct pci_dev *pdev)
 {
-	struct hfc_multi	*card = pci_get_drvdata(pdev);
-	u_long			flags;
+	struct hfc_multi	*card;
 
+	/* a failed initialization removes the drvdata */
+	async_synchronize_full_domain(&hfcmulti_async);
+	card = pci_get_drvdata(pdev);
 	if (debug)
 		printk(KERN_INFO "removing hfc_multi card vendor:%x "
 		       "device:%x subvendor:%x subdevice:%x\n",
@@ -5290,9 +5573,7 @@ static void hfc_remove_pci(struct pci_dev *pdev)
 		       pdev->subsystem_vendor, pdev->subsystem_device);
 
 	if (card) {
-		spin_lock_irqsave(&HFClock, flags);
 		release_card(card);
-		spin_unlock_irqrestore(&HFClock, flags);
 	}  else {
 		if (debug)
 			printk(KERN_DEBUG "%s: drvdata already removed\n",
@@ -5486,6 +5767,7 @@ HFCmulti_cleanup(void)
 	struct hfc_multi *card, *next;
 
 	/* get rid of all devices of this driver */
+	async_synchronize_full_domain(&hfcmulti_async);
 	list_for_each_entry_safe(card, next, &HFClist, list)
 		release_card(card);
 	pci_unregister_driver(&hfcmultipci_driver);
@@ -42,6 +42,11 @@
  *	If the kernel uses 100 Hz, steps of 80 samples are possible.
  *	If the kernel uses 300 Hz, steps of about 26 samples are possible.
  *
+ * irqpoll:
+ *	If a card gets more than this number of interrupts within a jiffy,
+ *	it is polled once per jiffy instead, until it is idle again.
+ *	By default 0 is used, the card is never polled.
+ *
  */
 
 #include <linux/interrupt.h>
@@ -58,6 +63,7 @@ static const char *hfcpci_revision = "2.0";
 static int HFC_cnt;
 static uint debug;
 static uint poll, tics;
+static uint irqpoll;
 static struct timer_list hfc_tl;
 static unsigned long hfc_jiffies;
 
@@ -65,6 +71,7 @@ MODULE_AUTHOR("Karsten Keil");
 MODULE_LICENSE("GPL");
 module_param(debug, uint, S_IRUGO | S_IWUSR);
 module_param(poll, uint, S_IRUGO | S_IWUSR);
+module_param(irqpoll, uint, S_IRUGO);
 
 enum {
 	HFC_CCD_2BD0,
@@ -144,6 +151,7 @@ struct hfc_pci {
 	struct pci_dev		*pdev;
 	struct hfcPCI_hw	hw;
 	spinlock_t		lock;	/* card lock */
+	struct mISDN_irqpoll	irqpoll;
 	struct dchannel		dch;
 	struct bchannel		bch[2];
 };
@@ -577,6 +585,19 @@ hfcpci_empty_fifo_trans(struct bchannel *bch, struct bzfifo *rxbz,
 		*z2r = cpu_to_le16(new_z2);
 		return;
 	}
+	if (test_bit(FLG_RX_RING, &bch->Flags)) {
+		/* straight from the fifo to the ring, in two parts on wrap */
+		if (le16_to_cpu(*z2r) + fcnt_rx <= B_FIFO_SIZE + B_SUB_VAL)
+			maxlen = fcnt_rx;
+		else
+			maxlen = B_FIFO_SIZE + B_SUB_VAL - le16_to_cpu(*z2r);
+		recv_Bchannel_ring(bch, bdata + (le16_to_cpu(*z2r) - B_SUB_VAL),
+				   maxlen);
+		if (fcnt_rx > maxlen)
+			recv_Bchannel_ring(bch, bdata, fcnt_rx - maxlen);
+		*z2r = cpu_to_le16(new_z2);
+		return;
+	}
 	maxlen = bchannel_get_rxbuf(bch, fcnt_rx);
 	if (maxlen < 0) {
 		pr_warning("B%d: No bufferspace for %d bytes\n",
@@ -753,11 +774,11 @@ hfcpci_fill_fifo(struct bchannel *bch)
 {
 	struct hfc_pci	*hc = bch->hw;
 	int		maxlen, fcnt;
-	int		count, new_z1;
+	int		count, new_z1, sidx;
 	int		fillempty = 0;
 	struct bzfifo	*bz;
 	u_char		*bdata;
-	u_char		new_f1, *src, *dst;
+	u_char		new_f1, *dst;
 	__le16 *z1t, *z2t;
 
 	if ((bch->debug & DEBUG_HW_BCHANNEL) && !(bch->debug & DEBUG_HW_BFIFO))
@@ -831,8 +852,7 @@ hfcpci_fill_fifo(struct bchannel *bch)
 		/* new buffer Position */
 		if (new_z1 >= (B_FIFO_SIZE + B_SUB_VAL))
 			new_z1 -= B_FIFO_SIZE;	/* buffer wrap */
-		src = bch->tx_skb->data + bch->tx_idx;
-		/* source pointer */
+		sidx = bch->tx_idx;	/* source index */
 		dst = bdata + (le16_to_cpu(*z1t) - B_SUB_VAL);
 		maxlen = (B_FIFO_SIZE + B_SUB_VAL) - le16_to_cpu(*z1t);
 		/* end of fifo */
@@ -844,17 +864,17 @@ hfcpci_fill_fifo(struct bchannel *bch)
 		bch->tx_idx += count;
 		if (maxlen > count)
 			maxlen = count;		/* limit size */
-		memcpy(dst, src, maxlen);	/* first copy */
+		/* the frame may have page frags (OPTION_TX_SG) */
+		skb_copy_bits(bch->tx_skb, sidx, dst, maxlen); /* first copy */
 		count -= maxlen;	/* remaining bytes */
 		if (count) {
 			dst = bdata;	/* start of buffer */
-			src += maxlen;	/* new position */
-			memcpy(dst, src, count);
+			skb_copy_bits(bch->tx_skb, sidx + maxlen, dst, count);
 		}
 		*z1t = cpu_to_le16(new_z1);	/* now send data */
 		if (bch->tx_idx < bch->tx_skb->len)
 			return;
-		dev_kfree_skb(bch->tx_skb);
+		mI_free_audio_skb(bch->tx_skb);
 		if (get_next_bframe(bch))
 			goto next_t_frame;
 		return;
@@ -894,23 +914,22 @@ hfcpci_fill_fifo(struct bchannel *bch)
 		new_z1 -= B_FIFO_SIZE;	/* buffer wrap */
 
 	new_f1 = ((bz->f1 + 1) & MAX_B_FRAMES);
-	src = bch->tx_skb->data + bch->tx_idx;	/* source pointer */
+	sidx = bch->tx_idx;	/* source index */
 	dst = bdata + (le16_to_cpu(bz->za[bz->f1].z1) - B_SUB_VAL);
 	maxlen = (B_FIFO_SIZE + B_SUB_VAL) - le16_to_cpu(bz->za[bz->f1].z1);
 	/* end fifo */
 	if (maxlen > count)
 		maxlen = count;	/* limit size */
-	memcpy(dst, src, maxlen);	/* first copy */
+	skb_copy_bits(bch->tx_skb, sidx, dst, maxlen);	/* first copy */
 
 	count -= maxlen;	/* remaining bytes */
 	if (count) {
 		dst = bdata;	/* start of buffer */
-		src += maxlen;	/* new position */
-		memcpy(dst, src, count);
+		skb_copy_bits(bch->tx_skb, sidx + maxlen, dst, count);
 	}
 	bz->za[new_f1].z1 = cpu_to_le16(new_z1);	/* for next buffer */
 	bz->f1 = new_f1;	/* next frame */
-	dev_kfree_skb(bch->tx_skb);
+	mI_free_audio_skb(bch->tx_skb);
 	get_next_bframe(bch);
 }
 
@@ -1135,7 +1154,7 @@ tx_birq(struct bchannel *bch)
 		hfcpci_fill_fifo(bch);
 	else {
 		if (bch->tx_skb)
-			dev_kfree_skb(bch->tx_skb);
+			mI_free_audio_skb(bch->tx_skb);
 		if (get_next_bframe(bch))
 			hfcpci_fill_fifo(bch);
 	}
@@ -1154,31 +1173,12 @@ tx_dirq(struct dchannel *dch)
 	}
 }
 
-static irqreturn_t
-hfcpci_int(int intno, void *dev_id)
+/* handle the events of INT_S1, called with the card lock held */
+static void
+hfcpci_events(struct hfc_pci *hc, u_char val)
 {
-	struct hfc_pci	*hc = dev_id;
 	u_char		exval;
 	struct bchannel	*bch;
-	u_char		val, stat;
-
-	spin_lock(&hc->lock);
-	if (!(hc->hw.int_m2 & 0x08)) {
-		spin_unlock(&hc->lock);
-		return IRQ_NONE; /* not initialised */
-	}
-	stat = Read_hfc(hc, HFCPCI_STATUS);
-	if (HFCPCI_ANYINT & stat) {
-		val = Read_hfc(hc, HFCPCI_INT_S1);
-		if (hc->dch.debug & DEBUG_HW_DCHANNEL)
-			printk(KERN_DEBUG
-			       "HFC-PCI: stat(%02x) s1(%02x)\n", stat, val);
-	} else {
-		/* shared */
-		spin_unlock(&hc->lock);
-		return IRQ_NONE;
-	}
-	hc->irqcnt++;
 
 	if (hc->dch.debug & DEBUG_HW_DCHANNEL)
 		printk(KERN_DEBUG "HFC-PCI irq %x\n", val);
@@ -1235,10 +1235,67 @@ hfcpci_int(int intno, void *dev_id)
 			del_timer(&hc->dch.timer);
 		tx_dirq(&hc->dch);
 	}
+}
+
+static irqreturn_t
+hfcpci_int(int intno, void *dev_id)
+{
+	struct hfc_pci	*hc = dev_id;
+	u_char		val, stat;
+
+	spin_lock(&hc->lock);
+	if (!(hc->hw.int_m2 & 0x08)) {
+		spin_unlock(&hc->lock);
+		return IRQ_NONE; /* not initialised or polled */
+	}
+	stat = Read_hfc(hc, HFCPCI_STATUS);
+	if (HFCPCI_ANYINT & stat) {
+		val = Read_hfc(hc, HFCPCI_INT_S1);
+		if (hc->dch.debug & DEBUG_HW_DCHANNEL)
+			printk(KERN_DEBUG
+			       "HFC-PCI: stat(%02x) s1(%02x)\n", stat, val);
+	} else {
+		/* shared */
+		spin_unlock(&hc->lock);
+		return IRQ_NONE;
+	}
+	hc->irqcnt++;
+	if (mISDN_irqpoll_irq(&hc->irqpoll))
+		disable_hwirq(hc);
+	hfcpci_events(hc, val);
 	spin_unlock(&hc->lock);
 	return IRQ_HANDLED;
 }
 
+/* poll the card while its interrupt is masked (irqpoll) */
+static int
+hfcpci_irqpoll(struct mISDN_irqpoll *ip, int budget)
+{
+	struct hfc_pci	*hc = container_of(ip, struct hfc_pci, irqpoll);
+	u_long		flags;
+	int		done = 0;
+
+	spin_lock_irqsave(&hc->lock, flags);
+	while (done < budget &&
+	       (Read_hfc(hc, HFCPCI_STATUS) & HFCPCI_ANYINT)) {
+		hfcpci_events(hc, Read_hfc(hc, HFCPCI_INT_S1));
+		done++;
+	}
+	spin_unlock_irqrestore(&hc->lock, flags);
+	return done;
+}
+
+static void
+hfcpci_irqpoll_rearm(struct mISDN_irqpoll *ip)
+{
+	struct hfc_pci	*hc = container_of(ip, struct hfc_pci, irqpoll);
+	u_long		flags;
+
+	spin_lock_irqsave(&hc->lock, flags);
+	enable_hwirq(hc);
+	spin_unlock_irqrestore(&hc->lock, flags);
+}
+
 /*
  * timer callback for D-chan busy resolution. Currently no function
  */
@@ -2046,6 +2103,8 @@ setup_hw(struct hfc_pci *hc)
 	/* At this point the needed PCI config is done */
 	/* fifos are still not enabled */
 	setup_timer(&hc->hw.timer, (void *)hfcpci_Timer, (long)hc);
+	mISDN_irqpoll_init(&hc->irqpoll, hfcpci_irqpoll, hfcpci_irqpoll_rearm,
+			   irqpoll, 8);
 	/* default PCM master */
 	test_and_set_bit(HFC_CFG_MASTER, &hc->cfg);
 	return 0;
@@ -2055,6 +2114,7 @@ static void
 release_card(struct hfc_pci *hc) {
 	u_long	flags;
 
+	mISDN_irqpoll_kill(&hc->irqpoll);
 	spin_lock_irqsave(&hc->lock, flags);
 	hc->hw.int_m2 = 0; /* interrupt output off ! */
 	disable_hwirq(hc);
@@ -2105,6 +2165,8 @@ setup_card(struct hfc_pci *card)
 		card->bch[i].ch.send = hfcpci_l2l1B;
 		card->bch[i].ch.ctrl = hfc_bctrl;
 		card->bch[i].ch.nr = i + 1;
+		test_and_set_bit(OPTION_TX_SG, &card->bch[i].ch.opt);
+		test_and_set_bit(OPTION_RX_RING, &card->bch[i].ch.opt);
 		list_add(&card->bch[i].ch.list, &card->dch.dev.bchannels);
 	}
 	err = setup_hw(card);
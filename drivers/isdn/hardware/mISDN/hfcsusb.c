@@ -39,6 +39,8 @@
 
 static unsigned int debug;
 static int poll = DEFAULT_TRANSP_BURST_SZ;
+static int isoc_packets = ISOC_PACKETS_B;
+static int isoc_urbs = ISOC_URBS;
 
 static LIST_HEAD(HFClist);
 static DEFINE_RWLOCK(HFClock);
@@ -48,6 +50,10 @@ MODULE_AUTHOR("Martin Bachem");
 MODULE_LICENSE("GPL");
 module_param(debug, uint, S_IRUGO | S_IWUSR);
 module_param(poll, int, 0);
+/* iso packets (1ms) per URB of HDLC B-channels and the maximum otherwise */
+module_param(isoc_packets, int, S_IRUGO);
+/* URBs per ISO fifo, 2 (double buffered) or 3 (triple buffered) */
+module_param(isoc_urbs, int, S_IRUGO);
 
 static int hfcsusb_cnt;
 
@@ -967,6 +973,35 @@ fill_isoc_urb(struct urb *urb, struct usb_device *dev, unsigned int pipe,
 	}
 }
 
+/*
+ * number of iso packets (1ms) for the next URB of the fifo
+ *
+ * D- and E-channel fifos always use ISOC_PACKETS_D, the NT activation
+ * timer counts D tx URBs. HDLC B-channels use isoc_packets, so there are
+ * less completions. transparent B-channels follow the frame size the
+ * upper layer wants (minlen), so every URB completes about one frame.
+ */
+static int
+hfcsusb_iso_packets(struct usb_fifo *fifo)
+{
+	struct bchannel *bch = fifo->bch;
+	int n, max = isoc_packets;
+
+	if (max < 1 || max > ISOC_PACKETS_MAX)
+		max = ISOC_PACKETS_B;
+	if (!bch)
+		return ISOC_PACKETS_D;
+	if (!test_bit(FLG_TRANSPARENT, &bch->Flags))
+		return max;
+	/* 8 bytes per packet */
+	n = bch->minlen >> 3;
+	if (n < 1)
+		n = 1;
+	if (n > max)
+		n = max;
+	return n;
+}
+
 /* receive completion routine for all ISO tx fifos   */
 static void
 rx_iso_complete(struct urb *urb)
@@ -1008,7 +1043,8 @@ rx_iso_complete(struct urb *urb)
 
 	s0_state = 0;
 	if (fifo->active && !status) {
-		num_isoc_packets = iso_packets[fifon];
+		/* the packets of this urb, the next one may have more */
+		num_isoc_packets = urb->number_of_packets;
 		maxlen = fifo->usb_packet_maxlen;
 
 		for (k = 0; k < num_isoc_packets; ++k) {
@@ -1068,8 +1104,9 @@ rx_iso_complete(struct urb *urb)
 			schedule_event(&hw->dch, FLG_PHCHANGE);
 		}
 
+		fifo->num_packets = hfcsusb_iso_packets(fifo);
 		fill_isoc_urb(urb, fifo->hw->dev, fifo->pipe,
-			      context_iso_urb->buffer, num_isoc_packets,
+			      context_iso_urb->buffer, fifo->num_packets,
 			      fifo->usb_packet_maxlen, fifo->intervall,
 			      (usb_complete_t)rx_iso_complete, urb->context);
 		errcode = usb_submit_urb(urb, GFP_ATOMIC);
@@ -1221,7 +1258,8 @@ tx_iso_complete(struct urb *urb)
 	if (fifo->active && !status) {
 		/* is FifoFull-threshold set for our channel? */
 		threshbit = (hw->threshold_mask & (1 << fifon));
-		num_isoc_packets = iso_packets[fifon];
+		num_isoc_packets = hfcsusb_iso_packets(fifo);
+		fifo->num_packets = num_isoc_packets;
 
 		/* predict dataflow to avoid fifo overflow */
 		if (fifon >= HFCUSB_D_TX)
@@ -1379,25 +1417,35 @@ tx_iso_complete(struct urb *urb)
 }
 
 /*
- * allocs urbs and start isoc transfer with two pending urbs to avoid
- * gaps in the transfer chain
+ * allocs urbs and start isoc transfer with two or three (isoc_urbs)
+ * pending urbs to avoid gaps in the transfer chain
  */
 static int
-start_isoc_chain(struct usb_fifo *fifo, int num_packets_per_urb,
-		 usb_complete_t complete, int packet_size)
+start_isoc_chain(struct usb_fifo *fifo, usb_complete_t complete,
+		 int packet_size)
 {
 	struct hfcsusb *hw = fifo->hw;
-	int i, k, errcode;
+	int i, k, errcode, num_packets_per_urb;
+
+	if (!fifo->num_urbs) {
+		fifo->num_urbs = isoc_urbs;
+		if (fifo->num_urbs < 2 || fifo->num_urbs > ISOC_URBS_MAX)
+			fifo->num_urbs = ISOC_URBS;
+	}
+	num_packets_per_urb = hfcsusb_iso_packets(fifo);
+	fifo->num_packets = num_packets_per_urb;
 
 	if (debug)
-		printk(KERN_DEBUG "%s: %s: fifo %i\n",
-		       hw->name, __func__, fifo->fifonum);
+		printk(KERN_DEBUG "%s: %s: fifo %i, %d urbs of %d packets\n",
+		       hw->name, __func__, fifo->fifonum, fifo->num_urbs,
+		       num_packets_per_urb);
 
 	/* allocate Memory for Iso out Urbs */
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < fifo->num_urbs; i++) {
 		if (!(fifo->iso[i].urb)) {
+			/* room for the packets of any later urb */
 			fifo->iso[i].urb =
-				usb_alloc_urb(num_packets_per_urb, GFP_KERNEL);
+				usb_alloc_urb(ISOC_PACKETS_MAX, GFP_KERNEL);
 			if (!(fifo->iso[i].urb)) {
 				printk(KERN_DEBUG
 				       "%s: %s: alloc urb for fifo %i failed",
@@ -1455,7 +1503,7 @@ stop_iso_gracefull(struct usb_fifo *fifo)
 	int i, timeout;
 	u_long flags;
 
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < fifo->num_urbs; i++) {
 		spin_lock_irqsave(&hw->lock, flags);
 		if (debug)
 			printk(KERN_DEBUG "%s: %s for fifo %i.%i\n",
@@ -1464,7 +1512,7 @@ stop_iso_gracefull(struct usb_fifo *fifo)
 		spin_unlock_irqrestore(&hw->lock, flags);
 	}
 
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < fifo->num_urbs; i++) {
 		timeout = 3;
 		while (fifo->stop_gracefull && timeout--)
 			schedule_timeout_interruptible((HZ / 1000) * 16);
@@ -1623,25 +1671,21 @@ hfcsusb_start_endpoint(struct hfcsusb *hw, int channel)
 		switch (channel) {
 		case HFC_CHAN_D:
 			start_isoc_chain(hw->fifos + HFCUSB_D_RX,
-					 ISOC_PACKETS_D,
 					 (usb_complete_t)rx_iso_complete,
 					 16);
 			break;
 		case HFC_CHAN_E:
 			start_isoc_chain(hw->fifos + HFCUSB_PCM_RX,
-					 ISOC_PACKETS_D,
 					 (usb_complete_t)rx_iso_complete,
 					 16);
 			break;
 		case HFC_CHAN_B1:
 			start_isoc_chain(hw->fifos + HFCUSB_B1_RX,
-					 ISOC_PACKETS_B,
 					 (usb_complete_t)rx_iso_complete,
 					 16);
 			break;
 		case HFC_CHAN_B2:
 			start_isoc_chain(hw->fifos + HFCUSB_B2_RX,
-					 ISOC_PACKETS_B,
 					 (usb_complete_t)rx_iso_complete,
 					 16);
 			break;
@@ -1652,17 +1696,14 @@ hfcsusb_start_endpoint(struct hfcsusb *hw, int channel)
 	switch (channel) {
 	case HFC_CHAN_D:
 		start_isoc_chain(hw->fifos + HFCUSB_D_TX,
-				 ISOC_PACKETS_B,
 				 (usb_complete_t)tx_iso_complete, 1);
 		break;
 	case HFC_CHAN_B1:
 		start_isoc_chain(hw->fifos + HFCUSB_B1_TX,
-				 ISOC_PACKETS_D,
 				 (usb_complete_t)tx_iso_complete, 1);
 		break;
 	case HFC_CHAN_B2:
 		start_isoc_chain(hw->fifos + HFCUSB_B2_TX,
-				 ISOC_PACKETS_B,
 				 (usb_complete_t)tx_iso_complete, 1);
 		break;
 	}
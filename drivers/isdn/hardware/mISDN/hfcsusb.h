@@ -84,15 +84,15 @@
 #define USB_BULK	1
 #define USB_ISOC	2
 
+/* defines how much ISO packets are handled in one URB */
 #define ISOC_PACKETS_D	8
-#define ISOC_PACKETS_B	8
-#define ISO_BUFFER_SIZE	128
+#define ISOC_PACKETS_B	8	/* default of isoc_packets */
+#define ISOC_PACKETS_MAX 32	/* limit of isoc_packets */
+#define ISO_BUFFER_SIZE	(ISOC_PACKETS_MAX * 16)
 
-/* defines how much ISO packets are handled in one URB */
-static int iso_packets[8] =
-{ ISOC_PACKETS_B, ISOC_PACKETS_B, ISOC_PACKETS_B, ISOC_PACKETS_B,
-  ISOC_PACKETS_D, ISOC_PACKETS_D, ISOC_PACKETS_D, ISOC_PACKETS_D
-};
+/* number of URBs pending per ISO fifo, default of isoc_urbs */
+#define ISOC_URBS	2
+#define ISOC_URBS_MAX	3
 
 
 /* Fifo flow Control for TX ISO */
@@ -237,7 +237,7 @@ struct iso_urb {
 	struct urb *urb;
 	__u8 buffer[ISO_BUFFER_SIZE];	/* buffer rx/tx USB URB data */
 	struct usb_fifo *owner_fifo;	/* pointer to owner fifo */
-	__u8 indx; /* Fifos's ISO double buffer 0 or 1 ? */
+	__u8 indx; /* Fifos's ISO buffer 0, 1 or 2 ? */
 #ifdef ISO_FRAME_START_DEBUG
 	int start_frames[ISO_FRAME_START_RING_COUNT];
 	__u8 iso_frm_strt_pos; /* index in start_frame[] */
@@ -257,8 +257,10 @@ struct usb_fifo {
 	int bit_line;		/* how much bits are in the fifo? */
 
 	__u8 usb_transfer_mode; /* switched between ISO and INT */
-	struct iso_urb	iso[2]; /* two urbs to have one always
-				   one pending */
+	struct iso_urb	iso[ISOC_URBS_MAX]; /* urbs to have always
+					       one pending */
+	int num_urbs;		/* urbs in use of iso[] */
+	int num_packets;	/* iso packets of the next urb */
 
 	struct dchannel *dch;	/* link to hfcsusb_t->dch */
 	struct bchannel *bch;	/* link to hfcsusb_t->bch */
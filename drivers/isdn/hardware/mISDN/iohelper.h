@@ -26,6 +26,9 @@
 #ifndef _IOHELPER_H
 #define _IOHELPER_H
 
+#include <linux/io.h>
+#include <linux/log2.h>
+
 typedef	u8	(read_reg_func)(void *hwp, u8 offset);
 			       typedef	void	(write_reg_func)(void *hwp, u8 offset, u8 value);
 			       typedef	void	(fifo_func)(void *hwp, u8 offset, u8 *datap, int size);
@@ -106,4 +109,113 @@ typedef	u8	(read_reg_func)(void *hwp, u8 offset);
 		ASSIGN_FUNC(typ, IPAC, target);		\
 	} while (0)
 
+/*
+ * direct register access for the shared chip cores (ISAC/IPAC/ISAR)
+ * the card driver sets the bus at probe time, then the cores access the
+ * chip inline, without an indirect call for every register. with
+ * IOACC_FUNC (the default of a zeroed struct) the read_reg/write_reg/
+ * read_fifo/write_fifo functions of the card are used, e.g. for cards
+ * with a special access sequence.
+ */
+#define IOACC_FUNC	0
+#define IOACC_IO	1
+#define IOACC_IND	2
+#define IOACC_MIO	3
+
+struct _ioacc {
+	u8		type;
+	u8		shift;	/* MIO: register n is at p + (n << shift) */
+	u32		port;	/* IO: base, IND: data port */
+	u32		ale;	/* IND: address port */
+	void __iomem	*p;	/* MIO: base */
+};
+
+#define ASSIGN_IOACC_IO(dest, ioport)	do {		\
+		(dest).type = IOACC_IO;			\
+		(dest).port = (ioport).port;		\
+	} while (0)
+#define ASSIGN_IOACC_IND(dest, ioport)	do {		\
+		(dest).type = IOACC_IND;		\
+		(dest).port = (ioport).port;		\
+		(dest).ale = (ioport).ale;		\
+	} while (0)
+#define ASSIGN_IOACC_MIO(dest, typ, adr)	do {	\
+		(dest).type = IOACC_MIO;		\
+		(dest).shift = ilog2(sizeof(typ));	\
+		(dest).p = (adr);			\
+	} while (0)
+
+static inline u8
+ioacc_read_reg(const struct _ioacc *a, read_reg_func *f, void *hw, u8 off)
+{
+	switch (a->type) {
+	case IOACC_IO:
+		return inb(a->port + off);
+	case IOACC_IND:
+		outb(off, a->ale);
+		return inb(a->port);
+	case IOACC_MIO:
+		return readb(a->p + (off << a->shift));
+	}
+	return f(hw, off);
+}
+
+static inline void
+ioacc_write_reg(const struct _ioacc *a, write_reg_func *f, void *hw, u8 off,
+		u8 val)
+{
+	switch (a->type) {
+	case IOACC_IO:
+		outb(val, a->port + off);
+		return;
+	case IOACC_IND:
+		outb(off, a->ale);
+		outb(val, a->port);
+		return;
+	case IOACC_MIO:
+		writeb(val, a->p + (off << a->shift));
+		return;
+	}
+	f(hw, off, val);
+}
+
+/* the fifo is read from one register, a string or burst read if possible */
+static inline void
+ioacc_read_fifo(const struct _ioacc *a, fifo_func *f, void *hw, u8 off,
+		u8 *dp, int size)
+{
+	switch (a->type) {
+	case IOACC_IO:
+		insb(a->port + off, dp, size);
+		return;
+	case IOACC_IND:
+		outb(off, a->ale);
+		insb(a->port, dp, size);
+		return;
+	case IOACC_MIO:
+		ioread8_rep(a->p + (off << a->shift), dp, size);
+		return;
+	}
+	f(hw, off, dp, size);
+}
+
+static inline void
+ioacc_write_fifo(const struct _ioacc *a, fifo_func *f, void *hw, u8 off,
+		 u8 *dp, int size)
+{
+	switch (a->type) {
+	case IOACC_IO:
+		outsb(a->port + off, dp, size);
+		return;
+	case IOACC_IND:
+		outb(off, a->ale);
+		outsb(a->port, dp, size);
+		return;
+	case IOACC_MIO:
+		iowrite8_rep(a->p + (off << a->shift), dp, size);
+		return;
+	}
+	f(hw, off, dp, size);
+}
+
 #endif
@@ -34,6 +34,7 @@ struct isac_hw {
 	write_reg_func		*write_reg;
 	fifo_func		*read_fifo;
 	fifo_func		*write_fifo;
+	struct _ioacc		io;	/* direct access, if set */
 	int			(*monitor)(void *, u32, u8 *, int);
 	void			(*release)(struct isac_hw *);
 	int			(*init)(struct isac_hw *);
@@ -77,6 +78,7 @@ struct ipac_hw {
 	write_reg_func		*write_reg;
 	fifo_func		*read_fifo;
 	fifo_func		*write_fifo;
+	struct _ioacc		io;	/* direct access, if set */
 	void			(*release)(struct ipac_hw *);
 	int			(*init)(struct ipac_hw *);
 	int			(*ctrl)(struct ipac_hw *, u32, u_long);
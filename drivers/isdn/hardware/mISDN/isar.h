@@ -21,6 +21,7 @@
  *
  */
 
+#include <linux/completion.h>
 #include "iohelper.h"
 
 struct isar_hw;
@@ -51,12 +52,14 @@ struct isar_hw {
 	write_reg_func	*write_reg;
 	fifo_func	*read_fifo;
 	fifo_func	*write_fifo;
+	struct _ioacc	io;	/* direct access, if set */
 	int		(*ctrl)(void *, u32, u_long);
 	void		(*release)(struct isar_hw *);
 	int		(*init)(struct isar_hw *);
 	int		(*open)(struct isar_hw *, struct channel_req *);
 	int		(*firmware)(struct isar_hw *, const u8 *, int);
 	unsigned long	Flags;
+	struct completion	mbox_done;	/* firmware load answers */
 	int		version;
 	u8		bstat;
 	u8		iis;
@@ -66,6 +69,9 @@ struct isar_hw {
 	u8		log[256];
 };
 
+/* isar_hw Flags */
+#define ISAR_FLG_FWIRQ	0	/* load_firmware waits for the irq */
+
 #define ISAR_IRQMSK	0x04
 #define ISAR_IRQSTA	0x04
 #define ISAR_IRQBIT	0x75
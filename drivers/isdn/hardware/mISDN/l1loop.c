@@ -41,12 +41,43 @@
  * - debug=<n>, default=0, with n=0xHHHHGGGG
  *      H - l1 driver flags described in hfcs_usb.h
  *      G - common mISDN debug flags described at mISDNhw.h
+ * - bench_rate=<n>, default 0 (off)
+ *      benchmark: n frames per second are received on every active
+ *      B-channel. each frame starts with a header with a sequence number
+ *      and the time it was generated. when the frame comes back to any
+ *      B-channel as PH_DATA_REQ (echoed by the application, crossconnected
+ *      by the DSP, ...) the latency is measured.
+ * - bench_len=<n>, default 160
+ *      length of the benchmark frames
+ * - bench_report=<n>, default 10
+ *      print the benchmark statistics every n seconds (0: only on unload)
+ *
+ * - clock=<n>, n=[0,1] default 0
+ *      1: B-channel data is sent at 8000 samples/s instead of immediately,
+ *         and the virtual line registers as mISDN clock source
+ * - clock_pri=<n>, default 0
+ *      priority of the clock source
+ * - clock_poll=<n>, n=[8..256] default 64
+ *      samples per clock tick
+ * - clock_drift=<n>, default 0
+ *      the virtual line runs n ppm too slow (n < 0: too fast)
+ * - clock_jitter=<n>, default 0
+ *      each tick fires up to n us early or late
+ *
+ *   e.g. interfaces=4 pri=1 nchannel=30 vline=0 bench_rate=50 simulates
+ *   4 PRIs with 120 channels of telephony data in 20ms chunks. features
+ *   which modify the data (volume, echo canceller, conference mixing)
+ *   destroy the header, frames are not found then.
  *
  */
 
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/mISDNhw.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/random.h>
+#include <asm/unaligned.h>
 #include "l1loop.h"
 
 const char *l1loop_rev = "v0.2, 2011-09-30";
@@ -64,6 +95,14 @@ static unsigned int vline = 1;
 static unsigned int nchannel[32] = {2};
 static unsigned int pri;
 static unsigned int debug;
+static unsigned int bench_rate;
+static unsigned int bench_len = 160;
+static unsigned int bench_report = 10;
+static unsigned int clock;
+static int clock_pri;
+static unsigned int clock_poll = 64;
+static int clock_drift;
+static unsigned int clock_jitter;
 
 MODULE_AUTHOR("Martin Bachem");
 MODULE_LICENSE("GPL");
@@ -72,6 +111,14 @@ module_param(vline, uint, S_IRUGO | S_IWUSR);
 module_param_array(nchannel, uint, NULL, S_IRUGO | S_IWUSR);
 module_param(pri, uint, S_IRUGO | S_IWUSR);
 module_param(debug, uint, S_IRUGO | S_IWUSR);
+module_param(bench_rate, uint, S_IRUGO);
+module_param(bench_len, uint, S_IRUGO);
+module_param(bench_report, uint, S_IRUGO | S_IWUSR);
+module_param(clock, uint, S_IRUGO);
+module_param(clock_pri, int, S_IRUGO);
+module_param(clock_poll, uint, S_IRUGO);
+module_param(clock_drift, int, S_IRUGO);
+module_param(clock_jitter, uint, S_IRUGO);
 
 /*
  * send full D/B channel status information
@@ -153,13 +200,13 @@ deactivate_bchannel(struct bchannel *bch)
 		printk(KERN_DEBUG "%s: %s: bch->nr(%i)\n",
 		       p->name, __func__, bch->nr);
 
-	spin_lock(&p->lock);
+	spin_lock_bh(&p->lock);
 	if (test_and_clear_bit(FLG_TX_NEXT, &bch->Flags)) {
 		dev_kfree_skb(bch->next_skb);
 		bch->next_skb = NULL;
 	}
 	if (bch->tx_skb) {
-		dev_kfree_skb(bch->tx_skb);
+		mI_free_audio_skb(bch->tx_skb);
 		bch->tx_skb = NULL;
 	}
 	bch->tx_idx = 0;
@@ -169,7 +216,7 @@ deactivate_bchannel(struct bchannel *bch)
 	}
 	clear_bit(FLG_ACTIVE, &bch->Flags);
 	clear_bit(FLG_TX_BUSY, &bch->Flags);
-	spin_unlock(&p->lock);
+	spin_unlock_bh(&p->lock);
 
 	l1loop_setup_bch(bch, ISDN_P_NONE);
 }
@@ -241,6 +288,320 @@ static void bch_vlink(struct bchannel *bch, struct sk_buff *skb)
 	get_next_bframe(bch);
 }
 
+/*
+ * benchmark: print and reset the statistics
+ */
+static void
+bench_print(struct l1loop *l1, const char *why)
+{
+	struct bench_stat st;
+	unsigned int ms;
+
+	spin_lock_bh(&l1->bench_lock);
+	st = l1->bstat;
+	memset(&l1->bstat, 0, sizeof(l1->bstat));
+	ms = jiffies_to_msecs(jiffies - l1->bench_last);
+	l1->bench_last = jiffies;
+	spin_unlock_bh(&l1->bench_lock);
+
+	if (!ms)
+		ms = 1;
+	printk(KERN_INFO "%s: bench %s %u ms: generated %llu frames "
+		"(%llu bytes/s), back %llu frames (%llu bytes/s)\n",
+		DRIVER_NAME, why, ms, st.gen_frames,
+		div_u64(st.gen_bytes * 1000, ms), st.back_frames,
+		div_u64(st.back_bytes * 1000, ms));
+	if (st.back_frames)
+		printk(KERN_INFO "%s: bench latency min/avg/max "
+			"%llu/%llu/%llu us\n", DRIVER_NAME,
+			div_u64(st.lat_min, 1000),
+			div_u64(div64_u64(st.lat_sum, st.back_frames), 1000),
+			div_u64(st.lat_max, 1000));
+}
+
+/*
+ * benchmark: receive one stamped frame on bch
+ */
+static void
+bench_inject(struct l1loop *l1, struct bchannel *bch)
+{
+	struct sk_buff *skb;
+	struct mISDNhead *hh;
+	u8 *d;
+
+	skb = mI_alloc_skb(bench_len, GFP_ATOMIC);
+	if (!skb)
+		return;
+	d = skb_put(skb, bench_len);
+	memset(d + BENCH_HDR_LEN, 0x55, bench_len - BENCH_HDR_LEN);
+	spin_lock(&l1->bench_lock);
+	put_unaligned_le32(BENCH_MAGIC, d);
+	__clear_bit(l1->bench_seq & (BENCH_SEEN - 1), l1->bench_seen);
+	put_unaligned_le32(l1->bench_seq++, d + 4);
+	l1->bstat.gen_frames++;
+	l1->bstat.gen_bytes += bench_len;
+	spin_unlock(&l1->bench_lock);
+	put_unaligned_le64(ktime_get_ns(), d + 8);
+	hh = mISDN_HEAD_P(skb);
+	hh->prim = PH_DATA_IND;
+	hh->id = MISDN_ID_ANY;
+	recv_Bchannel_skb(bch, skb);
+}
+
+/*
+ * benchmark timer, generates the frames which are due since the start
+ */
+static void
+bench_generate(unsigned long data)
+{
+	struct l1loop *l1 = (struct l1loop *)data;
+	struct bchannel *bch;
+	struct port *p;
+	u64 due;
+	int i, b, n = 0;
+
+	due = div_u64((u64)bench_rate * (jiffies - l1->bench_start), HZ);
+	while (l1->bench_rounds < due && n++ < BENCH_MAX_ROUNDS) {
+		l1->bench_rounds++;
+		for (i = 0; i < interfaces; i++) {
+			p = l1->ports + i;
+			for (b = 0; b < p->nrbchan; b++) {
+				bch = &p->bch[b];
+				if (test_bit(FLG_OPEN, &bch->Flags) &&
+				    test_bit(FLG_ACTIVE, &bch->Flags))
+					bench_inject(l1, bch);
+			}
+		}
+	}
+	/* not able to follow, do not try to catch up later */
+	if (l1->bench_rounds < due)
+		l1->bench_rounds = due;
+	if (bench_report &&
+	    time_after_eq(jiffies, l1->bench_last + bench_report * HZ))
+		bench_print(l1, "interval");
+	mod_timer(&l1->bench_timer,
+		  jiffies + max_t(unsigned long, 1, HZ / bench_rate));
+}
+
+/*
+ * benchmark: look for a generated frame in data sent by the upper layers
+ * the data is only read, it may be shared with other frames (clones of
+ * silence or tones). a frame looped back again is not counted twice, its
+ * seq is marked in bench_seen until BENCH_SEEN newer frames are generated.
+ */
+static void
+bench_check(struct l1loop *l1, struct sk_buff *skb)
+{
+	const u8 *d = skb->data;
+	u64 lat, t;
+	u32 seq;
+	int i;
+
+	for (i = 0; i + BENCH_HDR_LEN <= skb->len; i++) {
+		if (d[i] != (BENCH_MAGIC & 0xff) ||
+		    get_unaligned_le32(d + i) != BENCH_MAGIC)
+			continue;
+		seq = get_unaligned_le32(d + i + 4);
+		t = get_unaligned_le64(d + i + 8);
+		lat = ktime_get_ns() - t;
+		spin_lock_bh(&l1->bench_lock);
+		if (!__test_and_set_bit(seq & (BENCH_SEEN - 1),
+					l1->bench_seen)) {
+			l1->bstat.back_frames++;
+			l1->bstat.back_bytes += skb->len;
+			l1->bstat.lat_sum += lat;
+			if (!l1->bstat.lat_min || lat < l1->bstat.lat_min)
+				l1->bstat.lat_min = lat;
+			if (lat > l1->bstat.lat_max)
+				l1->bstat.lat_max = lat;
+		}
+		spin_unlock_bh(&l1->bench_lock);
+		i += BENCH_HDR_LEN - 1;
+	}
+}
+
+/*
+ * virtual line clock: data of the line arrives at the receiver
+ * the frames are collected in rxq while the port of the sender is locked,
+ * and delivered by paced_deliver after it is unlocked. the cb of a frame
+ * holds its receiver behind the mISDN header.
+ */
+struct paced_cb {
+	struct mISDNhead	hh;
+	struct bchannel		*target;
+};
+
+#define PACED_CB(skb)	((struct paced_cb *)(skb)->cb)
+
+static void
+bch_paced_recv(struct bchannel *target, const u8 *data, int len,
+	       struct sk_buff_head *rxq)
+{
+	struct sk_buff *skb;
+	struct mISDNhead *hh;
+
+	if (!test_bit(FLG_ACTIVE, &target->Flags))
+		return;
+	if (recv_Bchannel_ring(target, data, len))
+		return;
+	skb = mI_alloc_audio_skb(len, GFP_ATOMIC);
+	if (!skb)
+		return;
+	skb_put_data(skb, data, len);
+	hh = mISDN_HEAD_P(skb);
+	hh->prim = PH_DATA_IND;
+	hh->id = MISDN_ID_ANY;
+	PACED_CB(skb)->target = target;
+	__skb_queue_tail(rxq, skb);
+}
+
+static void
+paced_deliver(struct sk_buff_head *rxq)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(rxq)))
+		recv_Bchannel_skb(PACED_CB(skb)->target, skb);
+}
+
+static void
+bch_paced_rx(struct bchannel *bch, const u8 *data, int len,
+	     struct sk_buff_head *rxq)
+{
+	struct port *me = bch->hw;
+	struct port *party;
+	int i, b;
+
+	b = bch->nr - 1 - (bch->nr > 16);
+	switch (vline) {
+	case VLINE_BUS:
+		for (i = 0; i < interfaces; i++) {
+			party = hw->ports + i;
+			if (party != me)
+				bch_paced_recv(&party->bch[b], data, len,
+					       rxq);
+		}
+		break;
+	case VLINE_LOOP:
+		bch_paced_recv(bch, data, len, rxq);
+		break;
+	case VLINE_LINK:
+		party = &hw->ports[me->instance ^ 1];
+		bch_paced_recv(&party->bch[b], data, len, rxq);
+		break;
+	case VLINE_NONE:
+	default:
+		break;
+	}
+}
+
+/*
+ * virtual line clock: send the samples of one tick, called with p->lock
+ */
+static void
+bch_paced_tx(struct bchannel *bch, int samples, struct sk_buff_head *rxq)
+{
+	u8 buf[CLOCK_MAX_POLL];
+	int n, len = 0;
+
+	if (!test_bit(FLG_ACTIVE, &bch->Flags))
+		return;
+	if (test_bit(FLG_HDLC, &bch->Flags)) {
+		/* the frame is received, when its last byte was sent */
+		while (bch->tx_skb && samples > 0) {
+			n = min_t(int, samples,
+				  bch->tx_skb->len - bch->tx_idx);
+			bch->tx_idx += n;
+			samples -= n;
+			if (bch->tx_idx < bch->tx_skb->len)
+				break;
+			bch_paced_rx(bch, bch->tx_skb->data, bch->tx_skb->len,
+				     rxq);
+			dev_kfree_skb_any(bch->tx_skb);
+			get_next_bframe(bch);
+		}
+		return;
+	}
+	if (!test_bit(FLG_TRANSPARENT, &bch->Flags))
+		return;
+	while (bch->tx_skb && len < samples) {
+		n = min_t(int, samples - len, bch->tx_skb->len - bch->tx_idx);
+		memcpy(buf + len, bch->tx_skb->data + bch->tx_idx, n);
+		len += n;
+		bch->tx_idx += n;
+		if (bch->tx_idx >= bch->tx_skb->len) {
+			mI_free_audio_skb(bch->tx_skb);
+			get_next_bframe(bch);
+		}
+	}
+	/* the line does not stop, if there is no data, it is idle */
+	memset(buf + len, 0xff, samples - len);
+	bch_paced_rx(bch, buf, samples, rxq);
+}
+
+static void
+clock_tasklet(unsigned long data)
+{
+	struct l1loop *l1 = (struct l1loop *)data;
+	struct sk_buff_head rxq;
+	struct port *p;
+	ktime_t stamp = l1->clock_stamp;
+	int i, b, t, ticks;
+
+	ticks = atomic_xchg(&l1->clock_ticks, 0);
+	if (!ticks)
+		return;
+	__skb_queue_head_init(&rxq);
+	for (i = 0; i < interfaces; i++) {
+		p = l1->ports + i;
+		spin_lock(&p->lock);
+		for (t = 0; t < ticks; t++)
+			for (b = 0; b < p->nrbchan; b++)
+				bch_paced_tx(&p->bch[b], clock_poll, &rxq);
+		spin_unlock(&p->lock);
+		/* not under the lock, the receivers may send back at once */
+		paced_deliver(&rxq);
+	}
+	if (l1->iclock_on)
+		mISDN_clock_update(l1->iclock, ticks * clock_poll, &stamp);
+}
+
+/*
+ * the hrtimer fires in hard irq context, it only takes the time stamp,
+ * the data is sent by the tasklet.
+ */
+static enum hrtimer_restart
+clock_hrtimer(struct hrtimer *timer)
+{
+	struct l1loop *l1 = container_of(timer, struct l1loop, clock_timer);
+	ktime_t now = ktime_get();
+	s64 j = 0;
+
+	l1->clock_stamp = now;
+	atomic_inc(&l1->clock_ticks);
+	tasklet_schedule(&l1->clock_tasklet);
+
+	l1->clock_ideal = ktime_add_ns(l1->clock_ideal, l1->clock_period);
+	/* after a long stall start again, do not fire a burst of ticks */
+	if (ktime_to_ns(ktime_sub(now, l1->clock_ideal)) > CLOCK_RESYNC_NS)
+		l1->clock_ideal = ktime_add_ns(now, l1->clock_period);
+	if (clock_jitter)
+		j = ((s64)prandom_u32_max(2 * clock_jitter + 1) -
+		     clock_jitter) * NSEC_PER_USEC;
+	hrtimer_set_expires(timer, ktime_add(l1->clock_ideal,
+					     ns_to_ktime(j)));
+	return HRTIMER_RESTART;
+}
+
+static int
+l1loop_clockctl(void *priv, int enable)
+{
+	struct l1loop *l1 = priv;
+
+	l1->iclock_on = enable;
+	return 0;
+}
+
 /*
  * layer2 -> layer1 callback B-channel
  */
@@ -253,11 +614,16 @@ l1loop_l2l1B(struct mISDNchannel *ch, struct sk_buff *skb) {
 
 	switch (hh->prim) {
 	case PH_DATA_REQ:
-		spin_lock(&p->lock);
+		if (bench_rate)
+			bench_check(hw, skb);
+		spin_lock_bh(&p->lock);
 		ret = bchannel_senddata(bch, skb);
-		spin_unlock(&p->lock);
+		spin_unlock_bh(&p->lock);
 		if (ret > 0) {
 			ret = 0;
+			/* the clock tasklet sends it */
+			if (clock)
+				return ret;
 			switch (vline) {
 			case VLINE_BUS:
 				bch_vbus(bch, skb);
@@ -270,6 +636,11 @@ l1loop_l2l1B(struct mISDNchannel *ch, struct sk_buff *skb) {
 				break;
 			case VLINE_NONE:
 			default:
+				/* benchmark sink, the data goes nowhere */
+				if (bench_rate) {
+					dev_kfree_skb(skb);
+					get_next_bframe(bch);
+				}
 				break;
 			}
 		}
@@ -604,9 +975,9 @@ l1loop_l2l1D(struct mISDNchannel *ch, struct sk_buff *skb) {
 
 	switch (hh->prim) {
 	case PH_DATA_REQ:
-		spin_lock(&p->lock);
+		spin_lock_bh(&p->lock);
 		ret = dchannel_senddata(dch, skb);
-		spin_unlock(&p->lock);
+		spin_unlock_bh(&p->lock);
 		if (ret > 0) {
 			ret = 0;
 			queue_ch_frame(ch, PH_DATA_CNF, hh->id, NULL);
@@ -659,7 +1030,7 @@ l1loop_l2l1D(struct mISDNchannel *ch, struct sk_buff *skb) {
 		if (IS_ISDN_P_NT(p->protocol))
 			ph_command(p, L1_DEACTIVATE_NT);
 
-		spin_lock(&p->lock);
+		spin_lock_bh(&p->lock);
 		skb_queue_purge(&dch->squeue);
 		if (dch->tx_skb) {
 			dev_kfree_skb(dch->tx_skb);
@@ -670,7 +1041,7 @@ l1loop_l2l1D(struct mISDNchannel *ch, struct sk_buff *skb) {
 			dev_kfree_skb(dch->rx_skb);
 			dch->rx_skb = NULL;
 		}
-		spin_unlock(&p->lock);
+		spin_unlock_bh(&p->lock);
 		ret = 0;
 		break;
 	case MPH_INFORMATION_REQ:
@@ -1016,7 +1387,7 @@ release_instance(struct l1loop *hw) {
 static int __init
 l1loop_init(void)
 {
-	int i;
+	int i, err;
 
 	if (vline == 3 && (interfaces & 1)) {
 		printk(KERN_ERR "%s: %s: an even number of interfaces are "
@@ -1038,6 +1409,16 @@ l1loop_init(void)
 		interfaces = 2;
 	if (vline > MAX_VLINE_OPTION)
 		return -ENODEV;
+	if (bench_len < BENCH_HDR_LEN)
+		bench_len = BENCH_HDR_LEN;
+	if (bench_len > MAX_DATA_SIZE)
+		bench_len = MAX_DATA_SIZE;
+	clock_poll = clamp_t(unsigned int, clock_poll, 8, CLOCK_MAX_POLL);
+	clock_drift = clamp_t(int, clock_drift, -CLOCK_MAX_DRIFT,
+			      CLOCK_MAX_DRIFT);
+	/* one tick is clock_poll * 125 us */
+	if (clock_jitter > clock_poll * 125 / 2)
+		clock_jitter = clock_poll * 125 / 2;
 
 	printk(KERN_INFO DRIVER_NAME " driver Rev. %s "
 		"debug(0x%x) interfaces(%i) nchannel[0](%i) vline(%s)\n",
@@ -1057,7 +1438,39 @@ l1loop_init(void)
 		return -ENOMEM;
 	}
 
-	return setup_instance(hw);
+	err = setup_instance(hw);
+	if (err)
+		return err;
+
+	if (clock) {
+		printk(KERN_INFO "%s: clock %u samples/tick drift %d ppm "
+			"jitter %u us\n", DRIVER_NAME, clock_poll,
+			clock_drift, clock_jitter);
+		hw->clock_period = div_s64((s64)clock_poll * 125000 *
+					   (1000000 + clock_drift), 1000000);
+		atomic_set(&hw->clock_ticks, 0);
+		tasklet_init(&hw->clock_tasklet, clock_tasklet,
+			     (unsigned long)hw);
+		hrtimer_init(&hw->clock_timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_ABS);
+		hw->clock_timer.function = clock_hrtimer;
+		hw->clock_ideal = ktime_add_ns(ktime_get(), hw->clock_period);
+		hrtimer_start(&hw->clock_timer, hw->clock_ideal,
+			      HRTIMER_MODE_ABS);
+		hw->iclock = mISDN_register_clock(DRIVER_NAME, clock_pri,
+						  l1loop_clockctl, hw);
+	}
+	if (!bench_rate)
+		return 0;
+
+	printk(KERN_INFO "%s: benchmark %u frames/s with %u bytes\n",
+		DRIVER_NAME, bench_rate, bench_len);
+	spin_lock_init(&hw->bench_lock);
+	setup_timer(&hw->bench_timer, bench_generate, (unsigned long)hw);
+	hw->bench_start = jiffies;
+	hw->bench_last = jiffies;
+	mod_timer(&hw->bench_timer, jiffies + 1);
+	return 0;
 }
 
 static void __exit
@@ -1066,6 +1479,16 @@ l1loop_cleanup(void)
 	if (debug)
 		printk(KERN_DEBUG DRIVER_NAME ": %s\n", __func__);
 
+	if (bench_rate) {
+		del_timer_sync(&hw->bench_timer);
+		bench_print(hw, "last");
+	}
+	if (clock) {
+		if (hw->iclock)
+			mISDN_unregister_clock(hw->iclock);
+		hrtimer_cancel(&hw->clock_timer);
+		tasklet_kill(&hw->clock_tasklet);
+	}
 	release_instance(hw);
 }
 
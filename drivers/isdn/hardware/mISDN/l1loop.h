@@ -56,9 +56,48 @@ struct port {
 	struct hwskel	*hw;
 };
 
+/* benchmark frame, the header is at the start of each generated frame */
+#define BENCH_MAGIC		0x7462496d	/* "mIbt" */
+#define BENCH_HDR_LEN		16	/* magic, seq, 64 bit ns stamp */
+#define BENCH_MAX_ROUNDS	16	/* catch up at most this per tick */
+#define BENCH_SEEN		1024	/* seqs remembered as counted, 2^n */
+
+/* virtual line clock */
+#define CLOCK_MAX_POLL		256	/* samples per tick */
+#define CLOCK_MAX_DRIFT		10000	/* ppm */
+#define CLOCK_RESYNC_NS		(50 * NSEC_PER_MSEC)
+
+struct bench_stat {
+	u64	gen_frames;
+	u64	gen_bytes;
+	u64	back_frames;
+	u64	back_bytes;
+	u64	lat_sum;	/* ns */
+	u64	lat_min;
+	u64	lat_max;
+};
+
 struct l1loop {
 	struct list_head	list;
 	struct port		*ports;
+	/* benchmark generator (bench_rate != 0) */
+	struct timer_list	bench_timer;
+	spinlock_t		bench_lock;
+	unsigned long		bench_start;	/* jiffies */
+	unsigned long		bench_last;	/* jiffies of last report */
+	u64			bench_rounds;
+	u32			bench_seq;
+	DECLARE_BITMAP(bench_seen, BENCH_SEEN); /* frames counted back */
+	struct bench_stat	bstat;
+	/* virtual line clock (clock != 0) */
+	struct hrtimer		clock_timer;
+	struct tasklet_struct	clock_tasklet;
+	struct mISDNclock	*iclock;
+	int			iclock_on;
+	ktime_t			clock_ideal;	/* expiry without jitter */
+	s64			clock_period;	/* ns, with drift */
+	ktime_t			clock_stamp;	/* time of the last tick */
+	atomic_t		clock_ticks;	/* left for the tasklet */
 };
 
 #endif /* __L1LOOP_H__ */
@@ -848,12 +848,18 @@ setup_io(struct inf_hw *hw)
 	switch (hw->isac.mode) {
 	case AM_MEMIO:
 		ASSIGN_FUNC_IPAC(MIO, hw->ipac);
+		ASSIGN_IOACC_MIO(hw->ipac.isac.io, u32, hw->isac.a.p);
+		ASSIGN_IOACC_MIO(hw->ipac.io, u32, hw->hscx.a.p);
 		break;
 	case AM_IND_IO:
 		ASSIGN_FUNC_IPAC(IND, hw->ipac);
+		ASSIGN_IOACC_IND(hw->ipac.isac.io, hw->isac.a.io);
+		ASSIGN_IOACC_IND(hw->ipac.io, hw->hscx.a.io);
 		break;
 	case AM_IO:
 		ASSIGN_FUNC_IPAC(IO, hw->ipac);
+		ASSIGN_IOACC_IO(hw->ipac.isac.io, hw->isac.a.io);
+		ASSIGN_IOACC_IO(hw->ipac.io, hw->hscx.a.io);
 		break;
 	default:
 		return -EINVAL;
@@ -36,12 +36,26 @@ MODULE_AUTHOR("Karsten Keil");
 MODULE_VERSION(ISAC_REV);
 MODULE_LICENSE("GPL v2");
 
-#define ReadISAC(is, o)		(is->read_reg(is->dch.hw, o + is->off))
-#define	WriteISAC(is, o, v)	(is->write_reg(is->dch.hw, o + is->off, v))
-#define ReadHSCX(h, o)		(h->ip->read_reg(h->ip->hw, h->off + o))
-#define WriteHSCX(h, o, v)	(h->ip->write_reg(h->ip->hw, h->off + o, v))
-#define ReadIPAC(ip, o)		(ip->read_reg(ip->hw, o))
-#define WriteIPAC(ip, o, v)	(ip->write_reg(ip->hw, o, v))
+#define ReadISAC(is, o)		\
+	ioacc_read_reg(&is->io, is->read_reg, is->dch.hw, o + is->off)
+#define	WriteISAC(is, o, v)	\
+	ioacc_write_reg(&is->io, is->write_reg, is->dch.hw, o + is->off, v)
+#define ReadFiFoISAC(is, p, c)	\
+	ioacc_read_fifo(&is->io, is->read_fifo, is->dch.hw, is->off, p, c)
+#define WriteFiFoISAC(is, p, c)	\
+	ioacc_write_fifo(&is->io, is->write_fifo, is->dch.hw, is->off, p, c)
+#define ReadHSCX(h, o)		\
+	ioacc_read_reg(&h->ip->io, h->ip->read_reg, h->ip->hw, h->off + o)
+#define WriteHSCX(h, o, v)	\
+	ioacc_write_reg(&h->ip->io, h->ip->write_reg, h->ip->hw, h->off + o, v)
+#define ReadFiFoHSCX(h, o, p, c)	\
+	ioacc_read_fifo(&h->ip->io, h->ip->read_fifo, h->ip->hw, o, p, c)
+#define WriteFiFoHSCX(h, o, p, c)	\
+	ioacc_write_fifo(&h->ip->io, h->ip->write_fifo, h->ip->hw, o, p, c)
+#define ReadIPAC(ip, o)		\
+	ioacc_read_reg(&ip->io, ip->read_reg, ip->hw, o)
+#define WriteIPAC(ip, o, v)	\
+	ioacc_write_reg(&ip->io, ip->write_reg, ip->hw, o, v)
 
 static inline void
 ph_command(struct isac_hw *isac, u8 command)
@@ -135,7 +149,7 @@ isac_empty_fifo(struct isac_hw *isac, int count)
 		return;
 	}
 	ptr = skb_put(isac->dch.rx_skb, count);
-	isac->read_fifo(isac->dch.hw, isac->off, ptr, count);
+	ReadFiFoISAC(isac, ptr, count);
 	WriteISAC(isac, ISAC_CMDR, 0x80);
 	if (isac->dch.debug & DEBUG_HW_DFIFO) {
 		char	pfx[MISDN_MAX_IDLEN + 16];
@@ -166,7 +180,7 @@ isac_fill_fifo(struct isac_hw *isac)
 	pr_debug("%s: %s  %d\n", isac->name, __func__, count);
 	ptr = isac->dch.tx_skb->data + isac->dch.tx_idx;
 	isac->dch.tx_idx += count;
-	isac->write_fifo(isac->dch.hw, isac->off, ptr, count);
+	WriteFiFoISAC(isac, ptr, count);
 	WriteISAC(isac, ISAC_CMDR, more ? 0x8 : 0xa);
 	if (test_and_set_bit(FLG_BUSY_TIMER, &isac->dch.Flags)) {
 		pr_debug("%s: %s dbusytimer running\n", isac->name, __func__);
@@ -193,6 +207,7 @@ isac_rme_irq(struct isac_hw *isac)
 	if ((val & 0x70) != 0x20) {
 		if (val & 0x40) {
 			pr_debug("%s: ISAC RDO\n", isac->name);
+			mISDN_stat_inc(&isac->dch.dev.D, fifo_overrun);
 #ifdef ERROR_STATISTIC
 			isac->dch.err_rx++;
 #endif
@@ -509,6 +524,7 @@ mISDNisac_irq(struct isac_hw *isac, u8 val)
 			pr_debug("%s: ISTAD %02x\n", isac->name, val);
 			if (val & ISACX_D_XDU) {
 				pr_debug("%s: ISAC XDU\n", isac->name);
+				mISDN_stat_inc(&isac->dch.dev.D, fifo_underrun);
 #ifdef ERROR_STATISTIC
 				isac->dch.err_tx++;
 #endif
@@ -525,6 +541,7 @@ mISDNisac_irq(struct isac_hw *isac, u8 val)
 				isac_xpr_irq(isac);
 			if (val & ISACX_D_RFO) {
 				pr_debug("%s: ISAC RFO\n", isac->name);
+				mISDN_stat_inc(&isac->dch.dev.D, fifo_overrun);
 				WriteISAC(isac, ISACX_CMDRD, ISACX_CMDRD_RMC);
 			}
 			if (val & ISACX_D_RME)
@@ -552,6 +569,7 @@ mISDNisac_irq(struct isac_hw *isac, u8 val)
 				pr_debug("%s: ISAC XMR\n", isac->name);
 			if (val & 0x40) { /* XDU */
 				pr_debug("%s: ISAC XDU\n", isac->name);
+				mISDN_stat_inc(&isac->dch.dev.D, fifo_underrun);
 #ifdef ERROR_STATISTIC
 				isac->dch.err_tx++;
 #endif
@@ -960,11 +978,9 @@ hscx_empty_fifo(struct hscx_hw *hscx, u8 count)
 	p = skb_put(hscx->bch.rx_skb, count);
 
 	if (hscx->ip->type & IPAC_TYPE_IPACX)
-		hscx->ip->read_fifo(hscx->ip->hw,
-				    hscx->off + IPACX_RFIFOB, p, count);
+		ReadFiFoHSCX(hscx, hscx->off + IPACX_RFIFOB, p, count);
 	else
-		hscx->ip->read_fifo(hscx->ip->hw,
-				    hscx->off, p, count);
+		ReadFiFoHSCX(hscx, hscx->off, p, count);
 
 	hscx_cmdr(hscx, 0x80); /* RMC */
 
@@ -1004,12 +1020,10 @@ hscx_fill_fifo(struct hscx_hw *hscx)
 		hscx->bch.tx_idx += count;
 	}
 	if (hscx->ip->type & IPAC_TYPE_IPACX)
-		hscx->ip->write_fifo(hscx->ip->hw,
-				     hscx->off + IPACX_XFIFOB, p, count);
+		WriteFiFoHSCX(hscx, hscx->off + IPACX_XFIFOB, p, count);
 	else {
 		waitforXFW(hscx);
-		hscx->ip->write_fifo(hscx->ip->hw,
-				     hscx->off, p, count);
+		WriteFiFoHSCX(hscx, hscx->off, p, count);
 	}
 	hscx_cmdr(hscx, more ? 0x08 : 0x0a);
 
@@ -1027,7 +1041,7 @@ hscx_xpr(struct hscx_hw *hx)
 		hscx_fill_fifo(hx);
 	} else {
 		if (hx->bch.tx_skb)
-			dev_kfree_skb(hx->bch.tx_skb);
+			mI_free_audio_skb(hx->bch.tx_skb);
 		if (get_next_bframe(&hx->bch)) {
 			hscx_fill_fifo(hx);
 			test_and_clear_bit(FLG_TX_EMPTY, &hx->bch.Flags);
@@ -1056,6 +1070,7 @@ ipac_rme(struct hscx_hw *hx)
 					  hx->ip->name, hx->bch.nr);
 		}
 		if (rstab & 0x40) {
+			mISDN_stat_inc(&hx->bch.ch, fifo_overrun);
 			if (hx->bch.debug & DEBUG_HW_BCHANNEL)
 				pr_notice("%s: B%1d RDO proto=%x\n",
 					  hx->ip->name, hx->bch.nr,
@@ -1142,6 +1157,7 @@ ipac_irq(struct hscx_hw *hx, u8 ista)
 
 	if (istab & IPACX_B_RFO) {
 		pr_debug("%s: B%1d RFO error\n", hx->ip->name, hx->bch.nr);
+		mISDN_stat_inc(&hx->bch.ch, fifo_overrun);
 		hscx_cmdr(hx, 0x40);	/* RRES */
 	}
 
@@ -1157,6 +1173,7 @@ ipac_irq(struct hscx_hw *hx, u8 ista)
 		}
 		pr_debug("%s: B%1d XDU error at len %d\n", hx->ip->name,
 			 hx->bch.nr, hx->bch.tx_idx);
+		mISDN_stat_inc(&hx->bch.ch, fifo_underrun);
 		hx->bch.tx_idx = 0;
 		hscx_cmdr(hx, 0x01);	/* XRES */
 	}
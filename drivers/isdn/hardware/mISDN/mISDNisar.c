@@ -40,6 +40,15 @@ MODULE_VERSION(ISAR_REV);
 
 #define DEBUG_HW_FIRMWARE_FIFO	0x10000
 
+#define ReadISAR(is, o)		\
+	ioacc_read_reg(&(is)->io, (is)->read_reg, (is)->hw, o)
+#define WriteISAR(is, o, v)	\
+	ioacc_write_reg(&(is)->io, (is)->write_reg, (is)->hw, o, v)
+#define ReadFiFoISAR(is, o, p, c)	\
+	ioacc_read_fifo(&(is)->io, (is)->read_fifo, (is)->hw, o, p, c)
+#define WriteFiFoISAR(is, o, p, c)	\
+	ioacc_write_fifo(&(is)->io, (is)->write_fifo, (is)->hw, o, p, c)
+
 static const u8 faxmodulation_s[] = "3,24,48,72,73,74,96,97,98,121,122,145,146";
 static const u8 faxmodulation[] = {3, 24, 48, 72, 73, 74, 96, 97, 98, 121,
 				   122, 145, 146};
@@ -51,20 +60,22 @@ static inline int
 waitforHIA(struct isar_hw *isar, int timeout)
 {
 	int t = timeout;
-	u8 val = isar->read_reg(isar->hw, ISAR_HIA);
+	u8 val = ReadISAR(isar, ISAR_HIA);
 
 	while ((val & 1) && t) {
 		udelay(1);
 		t--;
-		val = isar->read_reg(isar->hw, ISAR_HIA);
+		val = ReadISAR(isar, ISAR_HIA);
 	}
 	pr_debug("%s: HIA after %dus\n", isar->name, timeout - t);
-	return timeout;
+	return t;
 }
 
 /*
  * send msg to ISAR mailbox
  * if msg is NULL use isar->buf
+ * the ISAR takes the message later, only the next message has to wait
+ * for HIA, so pump commands do not busy wait after each message
  */
 static int
 send_mbox(struct isar_hw *isar, u8 his, u8 creg, u8 len, u8 *msg)
@@ -72,13 +83,13 @@ send_mbox(struct isar_hw *isar, u8 his, u8 creg, u8 len, u8 *msg)
 	if (!waitforHIA(isar, 1000))
 		return 0;
 	pr_debug("send_mbox(%02x,%02x,%d)\n", his, creg, len);
-	isar->write_reg(isar->hw, ISAR_CTRL_H, creg);
-	isar->write_reg(isar->hw, ISAR_CTRL_L, len);
-	isar->write_reg(isar->hw, ISAR_WADR, 0);
+	WriteISAR(isar, ISAR_CTRL_H, creg);
+	WriteISAR(isar, ISAR_CTRL_L, len);
+	WriteISAR(isar, ISAR_WADR, 0);
 	if (!msg)
 		msg = isar->buf;
 	if (msg && len) {
-		isar->write_fifo(isar->hw, ISAR_MBOX, msg, len);
+		WriteFiFoISAR(isar, ISAR_MBOX, msg, len);
 		if (isar->ch[0].bch.debug & DEBUG_HW_BFIFO) {
 			int l = 0;
 
@@ -91,8 +102,7 @@ send_mbox(struct isar_hw *isar, u8 his, u8 creg, u8 len, u8 *msg)
 			}
 		}
 	}
-	isar->write_reg(isar->hw, ISAR_HIS, his);
-	waitforHIA(isar, 1000);
+	WriteISAR(isar, ISAR_HIS, his);
 	return 1;
 }
 
@@ -105,9 +115,9 @@ rcv_mbox(struct isar_hw *isar, u8 *msg)
 {
 	if (!msg)
 		msg = isar->buf;
-	isar->write_reg(isar->hw, ISAR_RADR, 0);
+	WriteISAR(isar, ISAR_RADR, 0);
 	if (msg && isar->clsb) {
-		isar->read_fifo(isar->hw, ISAR_MBOX, msg, isar->clsb);
+		ReadFiFoISAR(isar, ISAR_MBOX, msg, isar->clsb);
 		if (isar->ch[0].bch.debug & DEBUG_HW_BFIFO) {
 			int l = 0;
 
@@ -120,15 +130,15 @@ rcv_mbox(struct isar_hw *isar, u8 *msg)
 			}
 		}
 	}
-	isar->write_reg(isar->hw, ISAR_IIA, 0);
+	WriteISAR(isar, ISAR_IIA, 0);
 }
 
 static inline void
 get_irq_infos(struct isar_hw *isar)
 {
-	isar->iis = isar->read_reg(isar->hw, ISAR_IIS);
-	isar->cmsb = isar->read_reg(isar->hw, ISAR_CTRL_H);
-	isar->clsb = isar->read_reg(isar->hw, ISAR_CTRL_L);
+	isar->iis = ReadISAR(isar, ISAR_IIS);
+	isar->cmsb = ReadISAR(isar, ISAR_CTRL_H);
+	isar->clsb = ReadISAR(isar, ISAR_CTRL_L);
 	pr_debug("%s: rcv_mbox(%02x,%02x,%d)\n", isar->name,
 		 isar->iis, isar->cmsb, isar->clsb);
 }
@@ -144,10 +154,11 @@ poll_mbox(struct isar_hw *isar, int maxdelay)
 	int t = maxdelay;
 	u8 irq;
 
-	irq = isar->read_reg(isar->hw, ISAR_IRQBIT);
+	irq = ReadISAR(isar, ISAR_IRQBIT);
 	while (t && !(irq & ISAR_IRQSTA)) {
 		udelay(1);
 		t--;
+		irq = ReadISAR(isar, ISAR_IRQBIT);
 	}
 	if (t)	{
 		get_irq_infos(isar);
@@ -164,7 +175,7 @@ ISARVersion(struct isar_hw *isar)
 	int ver;
 
 	/* disable ISAR IRQ */
-	isar->write_reg(isar->hw, ISAR_IRQBIT, 0);
+	WriteISAR(isar, ISAR_IRQBIT, 0);
 	isar->buf[0] = ISAR_MSG_HWVER;
 	isar->buf[1] = 0;
 	isar->buf[2] = 1;
@@ -182,6 +193,44 @@ ISARVersion(struct isar_hw *isar)
 	return -4;
 }
 
+/*
+ * send a message while the firmware is loaded and wait for the answer
+ * the answer is taken by mISDNisar_irq, so the cpu is free meanwhile;
+ * if the card does not deliver the interrupt, the mailbox is polled
+ */
+static int
+fw_mbox(struct isar_hw *isar, u8 his, u8 creg, u8 len)
+{
+	u_long	flags;
+	int	ret = 0;
+
+	reinit_completion(&isar->mbox_done);
+	spin_lock_irqsave(isar->hwlock, flags);
+	if (!send_mbox(isar, his, creg, len, NULL))
+		ret = -ETIME;
+	spin_unlock_irqrestore(isar->hwlock, flags);
+	if (ret)
+		return ret;
+	if (test_bit(ISAR_FLG_FWIRQ, &isar->Flags) &&
+	    wait_for_completion_timeout(&isar->mbox_done,
+					msecs_to_jiffies(20)))
+		return 0;
+	spin_lock_irqsave(isar->hwlock, flags);
+	if (test_bit(ISAR_FLG_FWIRQ, &isar->Flags) &&
+	    completion_done(&isar->mbox_done)) {
+		/* the irq came just now */
+	} else if (poll_mbox(isar, 1000)) {
+		if (test_and_clear_bit(ISAR_FLG_FWIRQ, &isar->Flags)) {
+			pr_notice("%s: no ISAR irq, firmware load polls\n",
+				  isar->name);
+			WriteISAR(isar, ISAR_IRQBIT, 0);
+		}
+	} else
+		ret = -ETIME;
+	spin_unlock_irqrestore(isar->hwlock, flags);
+	return ret;
+}
+
 static int
 load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 {
@@ -209,9 +258,10 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 		 isar->name, size / 2, size);
 	cnt = 0;
 	size /= 2;
-	/* disable ISAR IRQ */
+	/* the answers come with the ISAR IRQ */
 	spin_lock_irqsave(isar->hwlock, flags);
-	isar->write_reg(isar->hw, ISAR_IRQBIT, 0);
+	set_bit(ISAR_FLG_FWIRQ, &isar->Flags);
+	WriteISAR(isar, ISAR_IRQBIT, ISAR_IRQSTA);
 	spin_unlock_irqrestore(isar->hwlock, flags);
 	while (cnt < size) {
 		blk_head.sadr = le16_to_cpu(*sp++);
@@ -227,19 +277,11 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 			ret = -EINVAL;
 			goto reterrflg;
 		}
-		spin_lock_irqsave(isar->hwlock, flags);
-		if (!send_mbox(isar, ISAR_HIS_DKEY, blk_head.d_key & 0xff,
-			       0, NULL)) {
-			pr_info("ISAR send_mbox dkey failed\n");
-			ret = -ETIME;
-			goto reterror;
-		}
-		if (!poll_mbox(isar, 1000)) {
-			pr_warning("ISAR poll_mbox dkey failed\n");
-			ret = -ETIME;
-			goto reterror;
+		ret = fw_mbox(isar, ISAR_HIS_DKEY, blk_head.d_key & 0xff, 0);
+		if (ret) {
+			pr_info("ISAR mailbox dkey failed\n");
+			goto reterrflg;
 		}
-		spin_unlock_irqrestore(isar->hwlock, flags);
 		if ((isar->iis != ISAR_IIS_DKEY) || isar->cmsb || isar->clsb) {
 			pr_info("ISAR wrong dkey response (%x,%x,%x)\n",
 				isar->iis, isar->cmsb, isar->clsb);
@@ -268,18 +310,11 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 				*mp++ = val & 0xFF;
 				noc--;
 			}
-			spin_lock_irqsave(isar->hwlock, flags);
-			if (!send_mbox(isar, ISAR_HIS_FIRM, 0, nom, NULL)) {
-				pr_info("ISAR send_mbox prog failed\n");
-				ret = -ETIME;
-				goto reterror;
-			}
-			if (!poll_mbox(isar, 1000)) {
-				pr_info("ISAR poll_mbox prog failed\n");
-				ret = -ETIME;
-				goto reterror;
+			ret = fw_mbox(isar, ISAR_HIS_FIRM, 0, nom);
+			if (ret) {
+				pr_info("ISAR mailbox prog failed\n");
+				goto reterrflg;
 			}
-			spin_unlock_irqrestore(isar->hwlock, flags);
 			if ((isar->iis != ISAR_IIS_FIRM) ||
 			    isar->cmsb || isar->clsb) {
 				pr_info("ISAR wrong prog response (%x,%x,%x)\n",
@@ -293,23 +328,18 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 	}
 	isar->ch[0].bch.debug = saved_debug;
 	/* 10ms delay */
-	cnt = 10;
-	while (cnt--)
-		mdelay(1);
+	msleep(10);
 	isar->buf[0] = 0xff;
 	isar->buf[1] = 0xfe;
 	isar->bstat = 0;
-	spin_lock_irqsave(isar->hwlock, flags);
-	if (!send_mbox(isar, ISAR_HIS_STDSP, 0, 2, NULL)) {
-		pr_info("ISAR send_mbox start dsp failed\n");
-		ret = -ETIME;
-		goto reterror;
-	}
-	if (!poll_mbox(isar, 1000)) {
-		pr_info("ISAR poll_mbox start dsp failed\n");
-		ret = -ETIME;
-		goto reterror;
+	ret = fw_mbox(isar, ISAR_HIS_STDSP, 0, 2);
+	if (ret) {
+		pr_info("ISAR mailbox start dsp failed\n");
+		goto reterrflg;
 	}
+	spin_lock_irqsave(isar->hwlock, flags);
+	/* from now on the ISAR IRQ is handled as usual */
+	clear_bit(ISAR_FLG_FWIRQ, &isar->Flags);
 	if ((isar->iis != ISAR_IIS_STDSP) || isar->cmsb || isar->clsb) {
 		pr_info("ISAR wrong start dsp response (%x,%x,%x)\n",
 			isar->iis, isar->cmsb, isar->clsb);
@@ -320,11 +350,11 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 
 	/* NORMAL mode entered */
 	/* Enable IRQs of ISAR */
-	isar->write_reg(isar->hw, ISAR_IRQBIT, ISAR_IRQSTA);
+	WriteISAR(isar, ISAR_IRQBIT, ISAR_IRQSTA);
 	spin_unlock_irqrestore(isar->hwlock, flags);
 	cnt = 1000; /* max 1s */
 	while ((!isar->bstat) && cnt) {
-		mdelay(1);
+		usleep_range(1000, 2000);
 		cnt--;
 	}
 	if (!cnt) {
@@ -335,9 +365,7 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 		pr_debug("%s: ISAR general status event %x\n",
 			 isar->name, isar->bstat);
 	/* 10ms delay */
-	cnt = 10;
-	while (cnt--)
-		mdelay(1);
+	msleep(10);
 	isar->iis = 0;
 	spin_lock_irqsave(isar->hwlock, flags);
 	if (!send_mbox(isar, ISAR_HIS_DIAG, ISAR_CTRL_STST, 0, NULL)) {
@@ -346,12 +374,12 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 		goto reterror;
 	}
 	spin_unlock_irqrestore(isar->hwlock, flags);
-	cnt = 10000; /* max 100 ms */
+	cnt = 1000; /* max 100 ms */
 	while ((isar->iis != ISAR_IIS_DIAG) && cnt) {
-		udelay(10);
+		usleep_range(100, 200);
 		cnt--;
 	}
-	mdelay(1);
+	usleep_range(1000, 2000);
 	if (!cnt) {
 		pr_info("ISAR no self tst response\n");
 		ret = -ETIME;
@@ -374,12 +402,12 @@ load_firmware(struct isar_hw *isar, const u8 *buf, int size)
 		goto reterror;
 	}
 	spin_unlock_irqrestore(isar->hwlock, flags);
-	cnt = 30000; /* max 300 ms */
+	cnt = 3000; /* max 300 ms */
 	while ((isar->iis != ISAR_IIS_DIAG) && cnt) {
-		udelay(10);
+		usleep_range(100, 200);
 		cnt--;
 	}
-	mdelay(1);
+	usleep_range(1000, 2000);
 	if (!cnt) {
 		pr_info("ISAR no SVN response\n");
 		ret = -ETIME;
@@ -404,9 +432,10 @@ reterrflg:
 	spin_lock_irqsave(isar->hwlock, flags);
 reterror:
 	isar->ch[0].bch.debug = saved_debug;
+	clear_bit(ISAR_FLG_FWIRQ, &isar->Flags);
 	if (ret)
 		/* disable ISAR IRQ */
-		isar->write_reg(isar->hw, ISAR_IRQBIT, 0);
+		WriteISAR(isar, ISAR_IRQBIT, 0);
 	spin_unlock_irqrestore(isar->hwlock, flags);
 	return ret;
 }
@@ -426,19 +455,19 @@ isar_rcv_frame(struct isar_ch *ch)
 
 	if (!ch->is->clsb) {
 		pr_debug("%s; ISAR zero len frame\n", ch->is->name);
-		ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+		WriteISAR(ch->is, ISAR_IIA, 0);
 		return;
 	}
 	if (test_bit(FLG_RX_OFF, &ch->bch.Flags)) {
 		ch->bch.dropcnt += ch->is->clsb;
-		ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+		WriteISAR(ch->is, ISAR_IIA, 0);
 		return;
 	}
 	switch (ch->bch.state) {
 	case ISDN_P_NONE:
 		pr_debug("%s: ISAR protocol 0 spurious IIS_RDATA %x/%x/%x\n",
 			 ch->is->name, ch->is->iis, ch->is->cmsb, ch->is->clsb);
-		ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+		WriteISAR(ch->is, ISAR_IIA, 0);
 		break;
 	case ISDN_P_B_RAW:
 	case ISDN_P_B_L2DTMF:
@@ -447,7 +476,7 @@ isar_rcv_frame(struct isar_ch *ch)
 		if (maxlen < 0) {
 			pr_warning("%s.B%d: No bufferspace for %d bytes\n",
 				   ch->is->name, ch->bch.nr, ch->is->clsb);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			break;
 		}
 		rcv_mbox(ch->is, skb_put(ch->bch.rx_skb, ch->is->clsb));
@@ -458,7 +487,7 @@ isar_rcv_frame(struct isar_ch *ch)
 		if (maxlen < 0) {
 			pr_warning("%s.B%d: No bufferspace for %d bytes\n",
 				   ch->is->name, ch->bch.nr, ch->is->clsb);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			break;
 		}
 		if (ch->is->cmsb & HDLC_ERROR) {
@@ -471,7 +500,7 @@ isar_rcv_frame(struct isar_ch *ch)
 				ch->bch.err_crc++;
 #endif
 			skb_trim(ch->bch.rx_skb, 0);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			break;
 		}
 		if (ch->is->cmsb & HDLC_FSD)
@@ -493,7 +522,7 @@ isar_rcv_frame(struct isar_ch *ch)
 		if (ch->state != STFAX_ACTIV) {
 			pr_debug("%s: isar_rcv_frame: not ACTIV\n",
 				 ch->is->name);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			if (ch->bch.rx_skb)
 				skb_trim(ch->bch.rx_skb, 0);
 			break;
@@ -504,7 +533,7 @@ isar_rcv_frame(struct isar_ch *ch)
 			if (unlikely(!ch->bch.rx_skb)) {
 				pr_info("%s: B receive out of memory\n",
 					__func__);
-				ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+				WriteISAR(ch->is, ISAR_IIA, 0);
 				break;
 			}
 		}
@@ -515,7 +544,7 @@ isar_rcv_frame(struct isar_ch *ch)
 			if (ch->is->cmsb & SART_NMD) { /* ABORT */
 				pr_debug("%s: isar_rcv_frame: no more data\n",
 					 ch->is->name);
-				ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+				WriteISAR(ch->is, ISAR_IIA, 0);
 				send_mbox(ch->is, SET_DPS(ch->dpath) |
 					  ISAR_HIS_PUMPCTRL, PCTRL_CMD_ESC,
 					  0, NULL);
@@ -530,7 +559,7 @@ isar_rcv_frame(struct isar_ch *ch)
 		if (ch->cmd != PCTRL_CMD_FRH) {
 			pr_debug("%s: isar_rcv_frame: unknown fax mode %x\n",
 				 ch->is->name, ch->cmd);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			if (ch->bch.rx_skb)
 				skb_trim(ch->bch.rx_skb, 0);
 			break;
@@ -540,14 +569,14 @@ isar_rcv_frame(struct isar_ch *ch)
 		    (ch->bch.maxlen + 2)) {
 			pr_info("%s: %s incoming packet too large\n",
 				ch->is->name, __func__);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			skb_trim(ch->bch.rx_skb, 0);
 			break;
 		}  else if (ch->is->cmsb & HDLC_ERROR) {
 			pr_info("%s: ISAR frame error %x len %d\n",
 				ch->is->name, ch->is->cmsb, ch->is->clsb);
 			skb_trim(ch->bch.rx_skb, 0);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			break;
 		}
 		if (ch->is->cmsb & HDLC_FSD)
@@ -567,7 +596,7 @@ isar_rcv_frame(struct isar_ch *ch)
 		if (ch->is->cmsb & SART_NMD) { /* ABORT */
 			pr_debug("%s: isar_rcv_frame: no more data\n",
 				 ch->is->name);
-			ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+			WriteISAR(ch->is, ISAR_IIA, 0);
 			if (ch->bch.rx_skb)
 				skb_trim(ch->bch.rx_skb, 0);
 			send_mbox(ch->is, SET_DPS(ch->dpath) |
@@ -578,7 +607,7 @@ isar_rcv_frame(struct isar_ch *ch)
 		break;
 	default:
 		pr_info("isar_rcv_frame protocol (%x)error\n", ch->bch.state);
-		ch->is->write_reg(ch->is->hw, ISAR_IIA, 0);
+		WriteISAR(ch->is, ISAR_IIA, 0);
 		break;
 	}
 }
@@ -704,7 +733,7 @@ send_next(struct isar_ch *ch)
 		}
 	}
 	if (ch->bch.tx_skb)
-		dev_kfree_skb(ch->bch.tx_skb);
+		mI_free_audio_skb(ch->bch.tx_skb);
 	if (get_next_bframe(&ch->bch)) {
 		isar_fill_fifo(ch);
 		test_and_clear_bit(FLG_TX_EMPTY, &ch->bch.Flags);
@@ -1052,6 +1081,12 @@ mISDNisar_irq(struct isar_hw *isar)
 	struct isar_ch *ch;
 
 	get_irq_infos(isar);
+	if (test_bit(ISAR_FLG_FWIRQ, &isar->Flags)) {
+		/* answer to a message of load_firmware */
+		rcv_mbox(isar, NULL);
+		complete(&isar->mbox_done);
+		return;
+	}
 	switch (isar->iis & ISAR_IIS_MSCMSD) {
 	case ISAR_IIS_RDATA:
 		ch = sel_bch_isar(isar, isar->iis >> 6);
@@ -1061,11 +1096,11 @@ mISDNisar_irq(struct isar_hw *isar)
 			pr_debug("%s: ISAR spurious IIS_RDATA %x/%x/%x\n",
 				 isar->name, isar->iis, isar->cmsb,
 				 isar->clsb);
-			isar->write_reg(isar->hw, ISAR_IIA, 0);
+			WriteISAR(isar, ISAR_IIA, 0);
 		}
 		break;
 	case ISAR_IIS_GSTEV:
-		isar->write_reg(isar->hw, ISAR_IIA, 0);
+		WriteISAR(isar, ISAR_IIA, 0);
 		isar->bstat |= isar->cmsb;
 		check_send(isar, isar->cmsb);
 		break;
@@ -1081,7 +1116,7 @@ mISDNisar_irq(struct isar_hw *isar)
 #endif
 		pr_debug("%s: Buffer STEV dpath%d msb(%x)\n",
 			 isar->name, isar->iis >> 6, isar->cmsb);
-		isar->write_reg(isar->hw, ISAR_IIA, 0);
+		WriteISAR(isar, ISAR_IIA, 0);
 		break;
 	case ISAR_IIS_PSTEV:
 		ch = sel_bch_isar(isar, isar->iis >> 6);
@@ -1112,7 +1147,7 @@ mISDNisar_irq(struct isar_hw *isar)
 			pr_debug("%s: ISAR spurious IIS_PSTEV %x/%x/%x\n",
 				 isar->name, isar->iis, isar->cmsb,
 				 isar->clsb);
-			isar->write_reg(isar->hw, ISAR_IIA, 0);
+			WriteISAR(isar, ISAR_IIA, 0);
 		}
 		break;
 	case ISAR_IIS_PSTRSP:
@@ -1124,7 +1159,7 @@ mISDNisar_irq(struct isar_hw *isar)
 			pr_debug("%s: ISAR spurious IIS_PSTRSP %x/%x/%x\n",
 				 isar->name, isar->iis, isar->cmsb,
 				 isar->clsb);
-			isar->write_reg(isar->hw, ISAR_IIA, 0);
+			WriteISAR(isar, ISAR_IIA, 0);
 		}
 		break;
 	case ISAR_IIS_DIAG:
@@ -1667,6 +1702,7 @@ mISDNisar_init(struct isar_hw *isar, void *hw)
 	u32 ret, i;
 
 	isar->hw = hw;
+	init_completion(&isar->mbox_done);
 	for (i = 0; i < 2; i++) {
 		isar->ch[i].bch.nr = i + 1;
 		mISDN_initbchannel(&isar->ch[i].bch, MAX_DATA_MEM, 32);
@@ -29,7 +29,6 @@
 #include "ipac.h"
 #include "iohelper.h"
 #include "netjet.h"
-#include <linux/isdn/hdlc.h>
 
 #define NETJET_REV	"2.0"
 
@@ -59,8 +58,8 @@ struct tiger_ch {
 	int			lastrx;
 	u16			rxstate;
 	u16			txstate;
-	struct isdnhdlc_vars	hsend;
-	struct isdnhdlc_vars	hrecv;
+	struct mISDN_hdlc_tx	hsend;
+	struct mISDN_hdlc_rx	hrecv;
 	u8			*hsbuf;
 	u8			*hrbuf;
 };
@@ -184,27 +183,88 @@ WriteFiFoISAC_nj(void *p, u8 offset, u8 *data, int size)
 	outsb(card->base + NJ_ISAC_OFF, data, size);
 }
 
+/*
+ * The DMA buffers have one 32 bit word per sample, B1 uses bits 0-7 and
+ * B2 bits 8-15 of it. The lanes are copied in linear segments up to the
+ * end of the ring, so the inner loops have no wrap check.
+ */
+#define NJ_LANE_SHIFT(bc)	(((bc)->bch.nr & 2) ? 8 : 0)
+
+/* write count bytes from p, or fill if p is NULL, into the lane at idx */
+static u32
+write_lane(struct tiger_hw *card, int shift, u32 idx, const u8 *p, u32 fill,
+	   int count)
+{
+	u32 *d, m;
+	int i, n;
+
+	m = ~(0xffU << shift);
+	fill = (fill & 0xff) << shift;
+	while (count > 0) {
+		if (idx >= card->send.size)
+			idx = 0;
+		n = card->send.size - idx;
+		if (n > count)
+			n = count;
+		d = card->send.start + idx;
+		if (p) {
+			for (i = 0; i < n; i++)
+				d[i] = (d[i] & m) | ((u32)p[i] << shift);
+			p += n;
+		} else {
+			for (i = 0; i < n; i++)
+				d[i] = (d[i] & m) | fill;
+		}
+		idx += n;
+		count -= n;
+	}
+	return idx;
+}
+
+/* read cnt samples at idx into the lanes of B1 and B2, NULL skips one */
+static void
+read_lanes(struct tiger_hw *card, u32 idx, int cnt, u8 *b1, u8 *b2)
+{
+	u32 *s, v;
+	int i, n;
+
+	while (cnt > 0) {
+		if (idx >= card->recv.size)
+			idx = 0;
+		n = card->recv.size - idx;
+		if (n > cnt)
+			n = cnt;
+		s = card->recv.start + idx;
+		if (b1 && b2) {
+			for (i = 0; i < n; i++) {
+				v = s[i];
+				b1[i] = v & 0xff;
+				b2[i] = (v >> 8) & 0xff;
+			}
+		} else if (b1) {
+			for (i = 0; i < n; i++)
+				b1[i] = s[i] & 0xff;
+		} else {
+			for (i = 0; i < n; i++)
+				b2[i] = (s[i] >> 8) & 0xff;
+		}
+		if (b1)
+			b1 += n;
+		if (b2)
+			b2 += n;
+		idx += n;
+		cnt -= n;
+	}
+}
+
 static void
 fill_mem(struct tiger_ch *bc, u32 idx, u32 cnt, u32 fill)
 {
 	struct tiger_hw *card = bc->bch.hw;
-	u32 mask = 0xff, val;
 
 	pr_debug("%s: B%1d fill %02x len %d idx %d/%d\n", card->name,
 		 bc->bch.nr, fill, cnt, idx, card->send.idx);
-	if (bc->bch.nr & 2) {
-		fill  <<= 8;
-		mask <<= 8;
-	}
-	mask ^= 0xffffffff;
-	while (cnt--) {
-		val = card->send.start[idx];
-		val &= mask;
-		val |= fill;
-		card->send.start[idx++] = val;
-		if (idx >= card->send.size)
-			idx = 0;
-	}
+	write_lane(card, NJ_LANE_SHIFT(bc), idx, NULL, fill, cnt);
 }
 
 static int
@@ -229,12 +289,15 @@ mode_tiger(struct tiger_ch *bc, u32 protocol)
 		}
 		test_and_clear_bit(FLG_HDLC, &bc->bch.Flags);
 		test_and_clear_bit(FLG_TRANSPARENT, &bc->bch.Flags);
+		test_and_clear_bit(OPTION_TX_SG, &bc->bch.ch.opt);
 		bc->txstate = 0;
 		bc->rxstate = 0;
 		bc->lastrx = -1;
 		break;
 	case ISDN_P_B_RAW:
 		test_and_set_bit(FLG_TRANSPARENT, &bc->bch.Flags);
+		/* fill_dma reads the frags of transparent frames */
+		test_and_set_bit(OPTION_TX_SG, &bc->bch.ch.opt);
 		bc->bch.state = protocol;
 		bc->idx = 0;
 		bc->free = card->send.size / 2;
@@ -254,8 +317,8 @@ mode_tiger(struct tiger_ch *bc, u32 protocol)
 		bc->free = card->send.size / 2;
 		bc->rxstate = 0;
 		bc->txstate = TX_INIT | TX_IDLE;
-		isdnhdlc_rcv_init(&bc->hrecv, 0);
-		isdnhdlc_out_init(&bc->hsend, 0);
+		mISDN_hdlc_rx_init(&bc->hrecv);
+		mISDN_hdlc_tx_init(&bc->hsend);
 		bc->lastrx = -1;
 		if (!card->dmactrl) {
 			card->dmactrl = 1;
@@ -372,13 +435,12 @@ inittiger(struct tiger_hw *card)
 	return 0;
 }
 
-static void
-read_dma(struct tiger_ch *bc, u32 idx, int cnt)
+/* get the buffer for cnt received bytes, NULL if they are dropped */
+static u8 *
+read_dma_buf(struct tiger_ch *bc, u32 idx, int cnt)
 {
 	struct tiger_hw *card = bc->bch.hw;
-	int i, stat;
-	u32 val;
-	u8 *p, *pn;
+	int stat;
 
 	if (bc->lastrx == idx) {
 		bc->rxstate |= RX_OVERRUN;
@@ -388,28 +450,27 @@ read_dma(struct tiger_ch *bc, u32 idx, int cnt)
 	bc->lastrx = idx;
 	if (test_bit(FLG_RX_OFF, &bc->bch.Flags)) {
 		bc->bch.dropcnt += cnt;
-		return;
+		return NULL;
 	}
 	stat = bchannel_get_rxbuf(&bc->bch, cnt);
 	/* only transparent use the count here, HDLC overun is detected later */
 	if (stat == -ENOMEM) {
 		pr_warning("%s.B%d: No memory for %d bytes\n",
 			   card->name, bc->bch.nr, cnt);
-		return;
+		return NULL;
 	}
 	if (test_bit(FLG_TRANSPARENT, &bc->bch.Flags))
-		p = skb_put(bc->bch.rx_skb, cnt);
-	else
-		p = bc->hrbuf;
+		return skb_put(bc->bch.rx_skb, cnt);
+	return bc->hrbuf;
+}
 
-	for (i = 0; i < cnt; i++) {
-		val = card->recv.start[idx++];
-		if (bc->bch.nr & 2)
-			val >>= 8;
-		if (idx >= card->recv.size)
-			idx = 0;
-		p[i] = val & 0xff;
-	}
+/* deliver the received bytes, HDLC is decoded for all of them at once */
+static void
+read_dma_done(struct tiger_ch *bc, int cnt)
+{
+	struct tiger_hw *card = bc->bch.hw;
+	int i, stat;
+	u8 *p, *pn;
 
 	if (test_bit(FLG_TRANSPARENT, &bc->bch.Flags)) {
 		recv_Bchannel(&bc->bch, 0, false);
@@ -418,8 +479,8 @@ read_dma(struct tiger_ch *bc, u32 idx, int cnt)
 
 	pn = bc->hrbuf;
 	while (cnt > 0) {
-		stat = isdnhdlc_decode(&bc->hrecv, pn, cnt, &i,
-				       bc->bch.rx_skb->data, bc->bch.maxlen);
+		stat = mISDN_hdlc_decode(&bc->hrecv, pn, cnt, &i,
+					 bc->bch.rx_skb->data, bc->bch.maxlen);
 		if (stat > 0) { /* valid frame received */
 			p = skb_put(bc->bch.rx_skb, stat);
 			if (debug & DEBUG_HW_BFIFO) {
@@ -437,13 +498,13 @@ read_dma(struct tiger_ch *bc, u32 idx, int cnt)
 					   card->name, bc->bch.nr, cnt);
 				return;
 			}
-		} else if (stat == -HDLC_CRC_ERROR) {
+		} else if (stat == -MISDN_HDLC_CRC_ERROR) {
 			pr_info("%s: B%1d receive frame CRC error\n",
 				card->name, bc->bch.nr);
-		} else if (stat == -HDLC_FRAMING_ERROR) {
+		} else if (stat == -MISDN_HDLC_FRAMING_ERROR) {
 			pr_info("%s: B%1d receive framing error\n",
 				card->name, bc->bch.nr);
-		} else if (stat == -HDLC_LENGTH_ERROR) {
+		} else if (stat == -MISDN_HDLC_LENGTH_ERROR) {
 			pr_info("%s: B%1d receive frame too long (> %d)\n",
 				card->name, bc->bch.nr, bc->bch.maxlen);
 		}
@@ -456,7 +517,8 @@ static void
 recv_tiger(struct tiger_hw *card, u8 irq_stat)
 {
 	u32 idx;
-	int cnt = card->recv.size / 2;
+	int i, cnt = card->recv.size / 2;
+	u8 *p[2] = {NULL, NULL};
 
 	/* Note receive is via the WRITE DMA channel */
 	card->last_is0 &= ~NJ_IRQM0_WR_MASK;
@@ -467,10 +529,15 @@ recv_tiger(struct tiger_hw *card, u8 irq_stat)
 	else
 		idx = card->recv.size - 1;
 
-	if (test_bit(FLG_ACTIVE, &card->bc[0].bch.Flags))
-		read_dma(&card->bc[0], idx, cnt);
-	if (test_bit(FLG_ACTIVE, &card->bc[1].bch.Flags))
-		read_dma(&card->bc[1], idx, cnt);
+	for (i = 0; i < 2; i++)
+		if (test_bit(FLG_ACTIVE, &card->bc[i].bch.Flags))
+			p[i] = read_dma_buf(&card->bc[i], idx, cnt);
+	/* both lanes in one pass over the DMA buffer */
+	if (p[0] || p[1])
+		read_lanes(card, idx, cnt, p[0], p[1]);
+	for (i = 0; i < 2; i++)
+		if (p[i])
+			read_dma_done(&card->bc[i], cnt);
 }
 
 /* sync with current DMA address at start or after exception */
@@ -501,7 +568,6 @@ fill_hdlc_flag(struct tiger_ch *bc)
 {
 	struct tiger_hw *card = bc->bch.hw;
 	int count, i;
-	u32 m, v;
 	u8  *p;
 
 	if (bc->free == 0)
@@ -511,21 +577,13 @@ fill_hdlc_flag(struct tiger_ch *bc)
 		 bc->idx, card->send.idx);
 	if (bc->txstate & (TX_IDLE | TX_INIT | TX_UNDERRUN))
 		resync(bc, card);
-	count = isdnhdlc_encode(&bc->hsend, NULL, 0, &i,
-				bc->hsbuf, bc->free);
+	count = mISDN_hdlc_encode(&bc->hsend, NULL, 0, &i,
+				  bc->hsbuf, bc->free);
 	pr_debug("%s: B%1d hdlc encoded %d flags\n", card->name,
 		 bc->bch.nr, count);
 	bc->free -= count;
 	p = bc->hsbuf;
-	m = (bc->bch.nr & 1) ? 0xffffff00 : 0xffff00ff;
-	for (i = 0; i < count; i++) {
-		if (bc->idx >= card->send.size)
-			bc->idx = 0;
-		v = card->send.start[bc->idx];
-		v &= m;
-		v |= (bc->bch.nr & 1) ? (u32)(p[i]) : ((u32)(p[i])) << 8;
-		card->send.start[bc->idx++] = v;
-	}
+	bc->idx = write_lane(card, NJ_LANE_SHIFT(bc), bc->idx, p, 0, count);
 	if (debug & DEBUG_HW_BFIFO) {
 		snprintf(card->log, LOG_SIZE, "B%1d-send %s %d ",
 			 bc->bch.nr, card->name, count);
@@ -538,7 +596,6 @@ fill_dma(struct tiger_ch *bc)
 {
 	struct tiger_hw *card = bc->bch.hw;
 	int count, i, fillempty = 0;
-	u32 m, v, n = 0;
 	u8  *p;
 
 	if (bc->free == 0)
@@ -562,8 +619,8 @@ fill_dma(struct tiger_ch *bc)
 	if (bc->txstate & (TX_IDLE | TX_INIT | TX_UNDERRUN))
 		resync(bc, card);
 	if (test_bit(FLG_HDLC, &bc->bch.Flags) && !fillempty) {
-		count = isdnhdlc_encode(&bc->hsend, p, count, &i,
-					bc->hsbuf, bc->free);
+		count = mISDN_hdlc_encode(&bc->hsend, p, count, &i,
+					  bc->hsbuf, bc->free);
 		pr_debug("%s: B%1d hdlc encoded %d in %d\n", card->name,
 			 bc->bch.nr, i, count);
 		bc->bch.tx_idx += i;
@@ -572,41 +629,25 @@ fill_dma(struct tiger_ch *bc)
 	} else {
 		if (count > bc->free)
 			count = bc->free;
-		if (!fillempty)
+		if (!fillempty) {
+			/* frames with page frags are gathered in hsbuf */
+			p = skb_header_pointer(bc->bch.tx_skb, bc->bch.tx_idx,
+					       count, bc->hsbuf);
 			bc->bch.tx_idx += count;
-		bc->free -= count;
-	}
-	m = (bc->bch.nr & 1) ? 0xffffff00 : 0xffff00ff;
-	if (fillempty) {
-		n = p[0];
-		if (!(bc->bch.nr & 1))
-			n <<= 8;
-		for (i = 0; i < count; i++) {
-			if (bc->idx >= card->send.size)
-				bc->idx = 0;
-			v = card->send.start[bc->idx];
-			v &= m;
-			v |= n;
-			card->send.start[bc->idx++] = v;
-		}
-	} else {
-		for (i = 0; i < count; i++) {
-			if (bc->idx >= card->send.size)
-				bc->idx = 0;
-			v = card->send.start[bc->idx];
-			v &= m;
-			n = p[i];
-			v |= (bc->bch.nr & 1) ? n : n << 8;
-			card->send.start[bc->idx++] = v;
 		}
+		bc->free -= count;
 	}
+	bc->idx = write_lane(card, NJ_LANE_SHIFT(bc), bc->idx,
+			     fillempty ? NULL : p, p[0], count);
 	if (debug & DEBUG_HW_BFIFO) {
 		snprintf(card->log, LOG_SIZE, "B%1d-send %s %d ",
 			 bc->bch.nr, card->name, count);
 		print_hex_dump_bytes(card->log, DUMP_PREFIX_OFFSET, p, count);
 	}
-	if (bc->free)
-		bc_next_frame(bc);
+	/* the encoder stops after the closing flag, the next frame follows */
+	if (bc->free && !bc_next_frame(bc) &&
+	    test_bit(FLG_HDLC, &bc->bch.Flags))
+		fill_hdlc_flag(bc);
 }
 
 
@@ -619,7 +660,7 @@ bc_next_frame(struct tiger_ch *bc)
 		fill_dma(bc);
 	} else {
 		if (bc->bch.tx_skb)
-			dev_kfree_skb(bc->bch.tx_skb);
+			mI_free_audio_skb(bc->bch.tx_skb);
 		if (get_next_bframe(&bc->bch)) {
 			fill_dma(bc);
 			test_and_clear_bit(FLG_TX_EMPTY, &bc->bch.Flags);
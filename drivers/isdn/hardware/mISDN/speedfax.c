@@ -29,6 +29,7 @@
 #include <linux/delay.h>
 #include <linux/mISDNhw.h>
 #include <linux/firmware.h>
+#include <linux/async.h>
 #include "ipac.h"
 #include "isar.h"
 
@@ -66,6 +67,9 @@
 static int sfax_cnt;
 static u32 debug;
 static u32 irqloops = 4;
+static bool irqthread;
+static bool asyncinit = 1;
+static ASYNC_DOMAIN_EXCLUSIVE(sfax_async);
 
 struct sfax_hw {
 	struct list_head	list;
@@ -117,23 +121,25 @@ module_param_call(debug, set_debug, param_get_uint, &debug, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(debug, "Speedfax debug mask");
 module_param(irqloops, uint, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(irqloops, "Speedfax maximal irqloops (default 4)");
+module_param(irqthread, bool, S_IRUGO);
+MODULE_PARM_DESC(irqthread, "Speedfax interrupt work in an irq thread, "
+		 "if the irq is not shared (default off)");
+module_param(asyncinit, bool, S_IRUGO);
+MODULE_PARM_DESC(asyncinit, "Speedfax load the firmware of the cards in "
+		 "parallel after the probe (default on)");
 
 IOFUNC_IND(ISAC, sfax_hw, p_isac)
 IOFUNC_IND(ISAR, sfax_hw, p_isar)
 
 static irqreturn_t
-speedfax_irq(int intno, void *dev_id)
+speedfax_handle_irq(struct sfax_hw *sf)
 {
-	struct sfax_hw	*sf = dev_id;
 	u8 val;
 	int cnt = irqloops;
 
-	spin_lock(&sf->lock);
 	val = inb(sf->cfg + TIGER_AUX_STATUS);
-	if (val & SFAX_TIGER_IRQ_BIT) { /* for us or shared ? */
-		spin_unlock(&sf->lock);
+	if (val & SFAX_TIGER_IRQ_BIT) /* for us or shared ? */
 		return IRQ_NONE; /* shared */
-	}
 	sf->irqcnt++;
 	val = ReadISAR_IND(sf, ISAR_IRQBIT);
 Start_ISAR:
@@ -151,10 +157,38 @@ Start_ISAR:
 	if (irqloops && !cnt)
 		pr_notice("%s: %d IRQ LOOP cpu%d\n", sf->name,
 			  irqloops, smp_processor_id());
-	spin_unlock(&sf->lock);
 	return IRQ_HANDLED;
 }
 
+static irqreturn_t
+speedfax_irq(int intno, void *dev_id)
+{
+	struct sfax_hw	*sf = dev_id;
+	irqreturn_t	ret;
+
+	spin_lock(&sf->lock);
+	ret = speedfax_handle_irq(sf);
+	spin_unlock(&sf->lock);
+	return ret;
+}
+
+/*
+ * irq thread (irqthread)
+ * the ISAR mailbox data of fax and modem calls is copied here, with local
+ * interrupts enabled; the line stays masked until the thread is done.
+ */
+static irqreturn_t
+speedfax_irq_thread(int intno, void *dev_id)
+{
+	struct sfax_hw	*sf = dev_id;
+	irqreturn_t	ret;
+
+	spin_lock_bh(&sf->lock);
+	ret = speedfax_handle_irq(sf);
+	spin_unlock_bh(&sf->lock);
+	return ret;
+}
+
 static void
 enable_hwirq(struct sfax_hw *sf)
 {
@@ -288,7 +322,17 @@ init_card(struct sfax_hw *sf)
 	int	ret, cnt = 3;
 	u_long	flags;
 
-	ret = request_irq(sf->irq, speedfax_irq, IRQF_SHARED, sf->name, sf);
+	ret = -EBUSY;
+	if (irqthread)
+		ret = request_threaded_irq(sf->irq, NULL, speedfax_irq_thread,
+					   IRQF_SHARED | IRQF_ONESHOT,
+					   sf->name, sf);
+	if (ret && irqthread)
+		pr_notice("%s: irq %d is shared, no irq thread\n",
+			  sf->name, sf->irq);
+	if (ret)
+		ret = request_irq(sf->irq, speedfax_irq, IRQF_SHARED,
+				  sf->name, sf);
 	if (ret) {
 		pr_info("%s: couldn't get interrupt %d\n", sf->name, sf->irq);
 		return ret;
@@ -343,6 +387,8 @@ setup_speedfax(struct sfax_hw *sf)
 	sf->p_isar.port = sf->cfg + SFAX_PCI_ISAR;
 	ASSIGN_FUNC(IND, ISAC, sf->isac);
 	ASSIGN_FUNC(IND, ISAR, sf->isar);
+	ASSIGN_IOACC_IND(sf->isac.io, sf->p_isac);
+	ASSIGN_IOACC_IND(sf->isar.io, sf->p_isar);
 	spin_lock_irqsave(&sf->lock, flags);
 	reset_speedfax(sf);
 	disable_hwirq(sf);
@@ -371,83 +417,117 @@ release_card(struct sfax_hw *card) {
 	sfax_cnt--;
 }
 
-static int
-setup_instance(struct sfax_hw *card)
+static void
+free_instance(struct sfax_hw *card)
 {
-	const struct firmware *firmware;
-	int i, err;
 	u_long flags;
 
-	snprintf(card->name, MISDN_MAX_IDLEN - 1, "Speedfax.%d", sfax_cnt + 1);
+	card->isac.release(&card->isac);
+	card->isar.release(&card->isar);
+	pci_disable_device(card->pdev);
 	write_lock_irqsave(&card_lock, flags);
-	list_add_tail(&card->list, &Cards);
+	list_del(&card->list);
+	sfax_cnt--; /* also a failed start in parallel to a probe */
 	write_unlock_irqrestore(&card_lock, flags);
-	_set_debug(card);
-	spin_lock_init(&card->lock);
-	card->isac.hwlock = &card->lock;
-	card->isar.hwlock = &card->lock;
-	card->isar.ctrl = (void *)&sfax_ctrl;
-	card->isac.name = card->name;
-	card->isar.name = card->name;
-	card->isar.owner = THIS_MODULE;
+	kfree(card);
+}
+
+/* load the firmware, initialize the hardware and register the card */
+static int
+start_instance(struct sfax_hw *card)
+{
+	const struct firmware *firmware;
+	int err;
 
 	err = request_firmware(&firmware, "isdn/ISAR.BIN", &card->pdev->dev);
 	if (err < 0) {
 		pr_info("%s: firmware request failed %d\n",
 			card->name, err);
-		goto error_fw;
+		return err;
 	}
 	if (debug & DEBUG_HW)
 		pr_notice("%s: got firmware %zu bytes\n",
 			  card->name, firmware->size);
 
-	mISDNisac_init(&card->isac, card);
-
-	card->isac.dch.dev.D.ctrl = sfax_dctrl;
-	card->isac.dch.dev.Bprotocols =
-		mISDNisar_init(&card->isar, card);
-	for (i = 0; i < 2; i++) {
-		set_channelmap(i + 1, card->isac.dch.dev.channelmap);
-		list_add(&card->isar.ch[i].bch.ch.list,
-			 &card->isac.dch.dev.bchannels);
-	}
-
 	err = setup_speedfax(card);
 	if (err)
 		goto error_setup;
 	err = card->isar.init(&card->isar);
 	if (err)
 		goto error;
-	err = mISDN_register_device(&card->isac.dch.dev,
-				    &card->pdev->dev, card->name);
+	err = init_card(card);
 	if (err)
 		goto error;
-	err = init_card(card);
+	err = card->isar.firmware(&card->isar, firmware->data, firmware->size);
 	if (err)
 		goto error_init;
-	err = card->isar.firmware(&card->isar, firmware->data, firmware->size);
-	if (!err)  {
-		release_firmware(firmware);
-		sfax_cnt++;
-		pr_notice("SpeedFax %d cards installed\n", sfax_cnt);
-		return 0;
-	}
+	err = mISDN_register_device(&card->isac.dch.dev,
+				    &card->pdev->dev, card->name);
+	if (err)
+		goto error_init;
+	release_firmware(firmware);
+	pr_notice("%s: card is ready\n", card->name);
+	return 0;
+error_init:
 	disable_hwirq(card);
 	free_irq(card->irq, card);
-error_init:
-	mISDN_unregister_device(&card->isac.dch.dev);
 error:
 	release_region(card->cfg, 256);
 error_setup:
-	card->isac.release(&card->isac);
-	card->isar.release(&card->isar);
 	release_firmware(firmware);
-error_fw:
-	pci_disable_device(card->pdev);
+	return err;
+}
+
+/* see asyncinit, the probe of the card has already succeeded */
+static void
+start_instance_async(void *data, async_cookie_t cookie)
+{
+	struct sfax_hw *card = data;
+
+	if (start_instance(card)) {
+		pci_set_drvdata(card->pdev, NULL);
+		free_instance(card);
+	}
+}
+
+static int
+setup_instance(struct sfax_hw *card)
+{
+	int i, err;
+	u_long flags;
+
 	write_lock_irqsave(&card_lock, flags);
-	list_del(&card->list);
+	snprintf(card->name, MISDN_MAX_IDLEN - 1, "Speedfax.%d", ++sfax_cnt);
+	list_add_tail(&card->list, &Cards);
 	write_unlock_irqrestore(&card_lock, flags);
-	kfree(card);
+	_set_debug(card);
+	spin_lock_init(&card->lock);
+	card->isac.hwlock = &card->lock;
+	card->isar.hwlock = &card->lock;
+	card->isar.ctrl = (void *)&sfax_ctrl;
+	card->isac.name = card->name;
+	card->isar.name = card->name;
+	card->isar.owner = THIS_MODULE;
+
+	mISDNisac_init(&card->isac, card);
+
+	card->isac.dch.dev.D.ctrl = sfax_dctrl;
+	card->isac.dch.dev.Bprotocols =
+		mISDNisar_init(&card->isar, card);
+	for (i = 0; i < 2; i++) {
+		set_channelmap(i + 1, card->isac.dch.dev.channelmap);
+		list_add(&card->isar.ch[i].bch.ch.list,
+			 &card->isac.dch.dev.bchannels);
+	}
+
+	if (asyncinit) {
+		async_schedule_domain(start_instance_async, card,
+				      &sfax_async);
+		return 0;
+	}
+	err = start_instance(card);
+	if (err)
+		free_instance(card);
 	return err;
 }
 
@@ -483,8 +563,11 @@ sfaxpci_probe(struct pci_dev *pdev, const struct pci_device_id *ent)
 static void
 sfax_remove_pci(struct pci_dev *pdev)
 {
-	struct sfax_hw	*card = pci_get_drvdata(pdev);
+	struct sfax_hw	*card;
 
+	/* a failed start removes the drvdata */
+	async_synchronize_full_domain(&sfax_async);
+	card = pci_get_drvdata(pdev);
 	if (card)
 		release_card(card);
 	else
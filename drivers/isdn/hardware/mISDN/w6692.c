@@ -74,6 +74,7 @@ struct w6692_hw {
 	u32			fmask;	/* feature mask - bit set per card nr */
 	int			subtype;
 	spinlock_t		lock;	/* hw lock */
+	struct mISDN_irqpoll	irqpoll;
 	u8			imask;
 	u8			pctl;
 	u8			xaddr;
@@ -91,6 +92,7 @@ static int w6692_cnt;
 static int debug;
 static u32 led;
 static u32 pots;
+static u32 irqpoll;
 
 static void
 _set_debug(struct w6692_hw *card)
@@ -125,6 +127,8 @@ module_param(led, uint, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(led, "W6692 LED support bitmask (one bit per card)");
 module_param(pots, uint, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(pots, "W6692 POTS support bitmask (one bit per card)");
+module_param(irqpoll, uint, S_IRUGO);
+MODULE_PARM_DESC(irqpoll, "W6692 poll card above irqs per jiffy (0 never)");
 
 static inline u8
 ReadW6692(struct w6692_hw *card, u8 offset)
@@ -357,6 +361,7 @@ handle_rxD(struct w6692_hw *card) {
 	if (stat & (W_D_RSTA_RDOV | W_D_RSTA_CRCE | W_D_RSTA_RMB)) {
 		if (stat & W_D_RSTA_RDOV) {
 			pr_debug("%s: D-channel RDOV\n", card->name);
+			mISDN_stat_inc(&card->dch.dev.D, fifo_overrun);
 #ifdef ERROR_STATISTIC
 			card->dch.err_rx++;
 #endif
@@ -412,6 +417,7 @@ handle_statusD(struct w6692_hw *card)
 	if (exval & (W_D_EXI_XDUN | W_D_EXI_XCOL)) {
 		/* Transmit underrun/collision */
 		pr_debug("%s: D-channel underrun/collision\n", card->name);
+		mISDN_stat_inc(&card->dch.dev.D, fifo_underrun);
 #ifdef ERROR_STATISTIC
 		dch->err_tx++;
 #endif
@@ -419,6 +425,7 @@ handle_statusD(struct w6692_hw *card)
 	}
 	if (exval & W_D_EXI_RDOV) {	/* RDOV */
 		pr_debug("%s: D-channel RDOV\n", card->name);
+		mISDN_stat_inc(&card->dch.dev.D, fifo_overrun);
 		WriteW6692(card, W_D_CMDR, W_D_CMDR_RRST);
 	}
 	if (exval & W_D_EXI_TIN2)	/* TIN2 - never */
@@ -654,7 +661,7 @@ send_next(struct w6692_ch *wch)
 		W6692_fill_Bfifo(wch);
 	} else {
 		if (wch->bch.tx_skb)
-			dev_kfree_skb(wch->bch.tx_skb);
+			mI_free_audio_skb(wch->bch.tx_skb);
 		if (get_next_bframe(&wch->bch)) {
 			W6692_fill_Bfifo(wch);
 			test_and_clear_bit(FLG_TX_EMPTY, &wch->bch.Flags);
@@ -680,6 +687,7 @@ W6692B_interrupt(struct w6692_hw *card, int ch)
 			    test_bit(FLG_ACTIVE, &wch->bch.Flags)) {
 				pr_debug("%s: B%d RDOV proto=%x\n", card->name,
 					 wch->bch.nr, wch->bch.state);
+				mISDN_stat_inc(&wch->bch.ch, fifo_overrun);
 #ifdef ERROR_STATISTIC
 				wch->bch.err_rdo++;
 #endif
@@ -719,6 +727,7 @@ W6692B_interrupt(struct w6692_hw *card, int ch)
 		if (star & W_B_STAR_RDOV) {
 			pr_debug("%s: B%d RDOV proto=%x\n", card->name,
 				 wch->bch.nr, wch->bch.state);
+			mISDN_stat_inc(&wch->bch.ch, fifo_overrun);
 #ifdef ERROR_STATISTIC
 			wch->bch.err_rdo++;
 #endif
@@ -769,6 +778,7 @@ W6692B_interrupt(struct w6692_hw *card, int ch)
 	if (stat & W_B_EXI_XDUN) {
 		pr_warning("%s: B%d XDUN proto=%x\n", card->name,
 			   wch->bch.nr, wch->bch.state);
+		mISDN_stat_inc(&wch->bch.ch, fifo_underrun);
 #ifdef ERROR_STATISTIC
 		wch->bch.err_xdu++;
 #endif
@@ -783,20 +793,10 @@ W6692B_interrupt(struct w6692_hw *card, int ch)
 	}
 }
 
-static irqreturn_t
-w6692_irq(int intno, void *dev_id)
+/* handle the events of ISTA, called with the card lock held */
+static void
+w6692_events(struct w6692_hw *card, u8 ista)
 {
-	struct w6692_hw	*card = dev_id;
-	u8		ista;
-
-	spin_lock(&card->lock);
-	ista = ReadW6692(card, W_ISTA);
-	if ((ista | card->imask) == card->imask) {
-		/* possible a shared  IRQ reqest */
-		spin_unlock(&card->lock);
-		return IRQ_NONE;
-	}
-	card->irqcnt++;
 	pr_debug("%s: ista %02x\n", card->name, ista);
 	ista &= ~card->imask;
 	if (ista & W_INT_B1_EXI)
@@ -813,11 +813,61 @@ w6692_irq(int intno, void *dev_id)
 		handle_statusD(card);
 	if (ista & (W_INT_XINT0 | W_INT_XINT1)) /* XINT0/1 - never */
 		pr_debug("%s: W6692 spurious XINT!\n", card->name);
-/* End IRQ Handler */
+}
+
+static irqreturn_t
+w6692_irq(int intno, void *dev_id)
+{
+	struct w6692_hw	*card = dev_id;
+	u8		ista;
+
+	spin_lock(&card->lock);
+	ista = ReadW6692(card, W_ISTA);
+	if ((ista | card->imask) == card->imask) {
+		/* possible a shared  IRQ reqest */
+		spin_unlock(&card->lock);
+		return IRQ_NONE;
+	}
+	card->irqcnt++;
+	if (mISDN_irqpoll_irq(&card->irqpoll))
+		disable_hwirq(card);
+	w6692_events(card, ista);
 	spin_unlock(&card->lock);
 	return IRQ_HANDLED;
 }
 
+/* poll the card while its interrupts are masked (irqpoll) */
+static int
+w6692_irqpoll(struct mISDN_irqpoll *ip, int budget)
+{
+	struct w6692_hw	*card = container_of(ip, struct w6692_hw, irqpoll);
+	u_long		flags;
+	int		done = 0;
+	u8		ista;
+
+	spin_lock_irqsave(&card->lock, flags);
+	while (done < budget) {
+		ista = ReadW6692(card, W_ISTA);
+		if ((ista | card->imask) == card->imask)
+			break;
+		w6692_events(card, ista);
+		done++;
+	}
+	spin_unlock_irqrestore(&card->lock, flags);
+	return done;
+}
+
+static void
+w6692_irqpoll_rearm(struct mISDN_irqpoll *ip)
+{
+	struct w6692_hw	*card = container_of(ip, struct w6692_hw, irqpoll);
+	u_long		flags;
+
+	spin_lock_irqsave(&card->lock, flags);
+	enable_hwirq(card);
+	spin_unlock_irqrestore(&card->lock, flags);
+}
+
 static void
 dbusy_timer_handler(struct dchannel *dch)
 {
@@ -1265,6 +1315,7 @@ release_card(struct w6692_hw *card)
 {
 	u_long	flags;
 
+	mISDN_irqpoll_kill(&card->irqpoll);
 	spin_lock_irqsave(&card->lock, flags);
 	disable_hwirq(card);
 	w6692_mode(&card->bc[0], ISDN_P_NONE);
@@ -1302,6 +1353,8 @@ setup_instance(struct w6692_hw *card)
 	card->fmask = (1 << w6692_cnt);
 	_set_debug(card);
 	spin_lock_init(&card->lock);
+	mISDN_irqpoll_init(&card->irqpoll, w6692_irqpoll, w6692_irqpoll_rearm,
+			   irqpoll, 8);
 	mISDN_initdchannel(&card->dch, MAX_DFRAME_LEN_L1, W6692_ph_bh);
 	card->dch.dev.Dprotocols = (1 << ISDN_P_TE_S0);
 	card->dch.dev.D.send = w6692_l2l1D;
@@ -1338,6 +1391,7 @@ setup_instance(struct w6692_hw *card)
 		return 0;
 	}
 
+	mISDN_irqpoll_kill(&card->irqpoll);
 	free_irq(card->irq, card);
 error_init:
 	mISDN_unregister_device(&card->dch.dev);
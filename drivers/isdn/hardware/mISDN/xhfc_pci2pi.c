@@ -24,6 +24,7 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/pci.h>
+#include <asm/unaligned.h>
 #include "xhfc_su.h"
 #include "xhfc_pci2pi.h"
 
@@ -808,3 +809,39 @@ write_xhfcregptr(struct xhfc *xhfc, __u8 reg_addr)
 }
 
 #endif /* PI_MODE == PI_SPI */
+
+
+/*****************************************************************************/
+
+/*
+ * read or write len bytes of one register (A_FIFO_DATA)
+ * with SPI a multiple access transfers four bytes at once, the other
+ * bus interface modes have no burst access and use single accesses.
+ */
+void
+read_fifo_xhfc(struct xhfc *xhfc, __u8 reg_addr, __u8 *data, int len)
+{
+	int i = 0;
+
+#if PI_MODE == PI_SPI
+	for (; len - i >= 4; i += 4)
+		put_unaligned(read32_xhfc(xhfc, reg_addr),
+			      (__u32 *) (data + i));
+#endif
+	for (; i < len; i++)
+		data[i] = read_xhfc(xhfc, reg_addr);
+}
+
+void
+write_fifo_xhfc(struct xhfc *xhfc, __u8 reg_addr, __u8 *data, int len)
+{
+	int i = 0;
+
+#if PI_MODE == PI_SPI
+	for (; len - i >= 4; i += 4)
+		write32_xhfc(xhfc, reg_addr,
+			     get_unaligned((__u32 *) (data + i)));
+#endif
+	for (; i < len; i++)
+		write_xhfc(xhfc, reg_addr, data[i]);
+}
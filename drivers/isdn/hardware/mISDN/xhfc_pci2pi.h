@@ -325,5 +325,7 @@ void write32_xhfc(struct xhfc *, __u8 reg_addr, __u32 value);
 __u8 sread_xhfc(struct xhfc *, __u8 reg_addr);
 void write_xhfcregptr(struct xhfc *, __u8 reg_addr);
 __u8 read_xhfcregptr(struct xhfc *);
+void read_fifo_xhfc(struct xhfc *, __u8 reg_addr, __u8 *data, int len);
+void write_fifo_xhfc(struct xhfc *, __u8 reg_addr, __u8 *data, int len);
 
 #endif /* _XHFC_PCI2PI_H_ */
@@ -28,6 +28,7 @@
 #include <linux/module.h>
 #include <linux/delay.h>
 #include <linux/mISDNhw.h>
+#include <linux/mISDNdsp.h>
 #include "xhfc_su.h"
 
 #if BRIDGE == BRIDGE_PCI2PI
@@ -37,11 +38,25 @@
 
 const char *xhfc_rev = "Revision: 0.2.0 2016-06-10";
 
+#define MAX_CHIPS	8
+
 /* modules params */
 static unsigned int debug = 0;
+/*
+ * pcm=<id> with an id > 0 puts the chip as PCM slave on the PCM bus <id>,
+ * the id hfcmulti reports for it (100 for the first master, if not given
+ * there with pcm=), so calls are crossconnected in hardware between the
+ * cards. slots=32|64|128 must match the other cards of the bus.
+ * With pcm=0 (default) or a negative value, the bus is not shared: the chip
+ * clocks its PCM interface as master, but no PCM id is reported to the
+ * DSP and no crossconnects are offered.
+ */
+static int pcm[MAX_CHIPS];
+static int slots[MAX_CHIPS];
 
 /* driver globbls */
 static int xhfc_cnt;
+static int chip_cnt;
 
 #ifdef MODULE
 MODULE_AUTHOR("Martin Bachem");
@@ -49,6 +64,8 @@ MODULE_AUTHOR("Martin Bachem");
 MODULE_LICENSE("GPL");
 #endif
 module_param(debug, uint, S_IRUGO | S_IWUSR);
+module_param_array(pcm, int, NULL, S_IRUGO | S_IWUSR);
+module_param_array(slots, int, NULL, S_IRUGO | S_IWUSR);
 #endif
 
 /* prototypes for static functions */
@@ -278,6 +295,7 @@ xhfc_setup_bch(struct bchannel *bch, int protocol)
 	struct port *port = bch->hw;
 	struct xhfc *xhfc = port->xhfc;
 	__u8 channel = (port->idx * 4) + (bch->nr - 1);
+	__u8 flow_tx, flow_rx;
 
 	if (debug & DEBUG_HW)
 		printk(KERN_INFO "channel(%i) protocol %x-->%x\n",
@@ -299,8 +317,12 @@ xhfc_setup_bch(struct bchannel *bch, int protocol)
 			clear_bit(FLG_TRANSPARENT, &bch->Flags);
 			break;
 		case (ISDN_P_B_RAW):
-			setup_fifo(xhfc, (channel << 1), 6, 0, 0, 1);
-			setup_fifo(xhfc, (channel << 1) + 1, 6, 0, 0, 1);
+			/* PCM->SU and SU->(FIFO,PCM) if on a PCM slot */
+			flow_tx = (port->slot_tx[bch->nr - 1] < 0) ? 0 : 0xC0;
+			flow_rx = (port->slot_rx[bch->nr - 1] < 0) ? 0 : 0xC0;
+			setup_fifo(xhfc, (channel << 1), flow_tx | 6, 0, 0, 1);
+			setup_fifo(xhfc, (channel << 1) + 1, flow_rx | 6, 0, 0,
+				   1);
 			setup_su(xhfc, port->idx, (channel % 4) ? 1 : 0,
 				 1);
 			bch->state = protocol;
@@ -321,6 +343,80 @@ xhfc_setup_bch(struct bchannel *bch, int protocol)
 	return (0);
 }
 
+/*
+ * PCM routing of a bank, bank 2 loops the slot back inside the chip
+ */
+static __u8
+xhfc_pcm_route(int bank, int rx)
+{
+	if (bank > 1)
+		return 0x40;
+	/* same as hfcmulti, the rx routing is reversed */
+	return (!bank == !rx) ? 0x80 : 0xC0;
+}
+
+/*
+ * connect B-channel to PCM slots, disconnect if slot < 0,
+ * xhfc->lock must be held
+ */
+static void
+xhfc_pcm(struct bchannel *bch, int slot_tx, int bank_tx, int slot_rx,
+	 int bank_rx)
+{
+	struct port *port = bch->hw;
+	struct xhfc *xhfc = port->xhfc;
+	int bc = bch->nr - 1;
+	int ch = (port->idx * 4) + bc;
+	int oslot;
+
+	if (slot_tx < 0 || slot_rx < 0 || bank_tx < 0 || bank_rx < 0) {
+		slot_tx = -1;
+		slot_rx = -1;
+	}
+
+	/* remove from old slots, if not taken by an other channel meanwhile */
+	oslot = port->slot_tx[bc];
+	if (oslot >= 0 && oslot != slot_tx &&
+	    xhfc->slot_owner[oslot << 1] == ch) {
+		write_xhfc(xhfc, R_SLOT, oslot << 1);
+		write_xhfc(xhfc, A_SL_CFG, 0);
+		xhfc->slot_owner[oslot << 1] = -1;
+	}
+	oslot = port->slot_rx[bc];
+	if (oslot >= 0 && oslot != slot_rx &&
+	    xhfc->slot_owner[(oslot << 1) | 1] == ch) {
+		write_xhfc(xhfc, R_SLOT, (oslot << 1) | M_SL_DIR);
+		write_xhfc(xhfc, A_SL_CFG, 0);
+		xhfc->slot_owner[(oslot << 1) | 1] = -1;
+	}
+
+	if (debug & DEBUG_HW)
+		printk(KERN_INFO "%s %s: channel(%i) slot %d bank %d (TX) "
+		       "slot %d bank %d (RX)\n", xhfc->name, __func__, ch,
+		       slot_tx, bank_tx, slot_rx, bank_rx);
+
+	if (slot_tx >= 0) {
+		write_xhfc(xhfc, R_SLOT, slot_tx << 1);
+		write_xhfc(xhfc, A_SL_CFG,
+			   (ch << 1) | xhfc_pcm_route(bank_tx, 0));
+		xhfc->slot_owner[slot_tx << 1] = ch;
+	}
+	if (slot_rx >= 0) {
+		write_xhfc(xhfc, R_SLOT, (slot_rx << 1) | M_SL_DIR);
+		write_xhfc(xhfc, A_SL_CFG,
+			   (ch << 1) | M_CH_SDIR | xhfc_pcm_route(bank_rx, 1));
+		xhfc->slot_owner[(slot_rx << 1) | 1] = ch;
+	}
+	port->slot_tx[bc] = slot_tx;
+	port->bank_tx[bc] = bank_tx;
+	port->slot_rx[bc] = slot_rx;
+	port->bank_rx[bc] = bank_rx;
+
+	/* switch the data flow of the fifos */
+	if (bch->state == ISDN_P_B_RAW)
+		xhfc_setup_bch(bch, ISDN_P_B_RAW);
+}
+
 /*
  * init DChannel TX/RX fifos
  */
@@ -522,13 +618,24 @@ init_pcm(struct xhfc *xhfc)
                 return (-ENODEV);
         }
 
-        /* set PCM master mode */
-        SET_V_PCM_MD(xhfc->pcm_md0, 1);
+	xhfc->pcm = -1;
+	xhfc->slots = 32;
+	if (xhfc->param_idx < MAX_CHIPS && pcm[xhfc->param_idx] > 0) {
+		xhfc->pcm = pcm[xhfc->param_idx];
+		if (slots[xhfc->param_idx] == 64 ||
+		    slots[xhfc->param_idx] == 128)
+			xhfc->slots = slots[xhfc->param_idx];
+	}
+
+        /* set PCM master mode, slave if the bus is shared */
+        SET_V_PCM_MD(xhfc->pcm_md0, (xhfc->pcm < 0) ? 1 : 0);
         write_xhfc(xhfc, R_PCM_MD0, xhfc->pcm_md0);
 
         /* set pll adjust */
         SET_V_PCM_IDX(xhfc->pcm_md0, 0x09);
         SET_V_PLL_ADJ(xhfc->pcm_md1, 3);
+	/* 32, 64 or 128 slots at 2, 4 or 8 MBit/s */
+	SET_V_PCM_DR(xhfc->pcm_md1, xhfc->slots >> 6);
         write_xhfc(xhfc, R_PCM_MD0, xhfc->pcm_md0);
 	write_xhfc(xhfc, R_PCM_MD1, xhfc->pcm_md1);
 
@@ -638,7 +745,7 @@ init_xhfc(struct xhfc *xhfc)
 	/* perfom short irq test */
 	xhfc->testirq = 1;
 	enable_interrupts(xhfc);
-	mdelay(1 << GET_V_EV_TS(xhfc->ti_wd));
+	msleep(1 << GET_V_EV_TS(xhfc->ti_wd)); /* probe may sleep */
 	disable_interrupts(xhfc);
 
 	if (xhfc->irq_cnt > 2) {
@@ -668,6 +775,10 @@ setup_instance(struct xhfc *xhfc, struct device *parent)
 	tasklet_init(&xhfc->tasklet, xhfc_bh_handler,
 		     (unsigned long) xhfc);
 
+	xhfc->chipnum = chip_cnt++;
+	xhfc->param_idx = xhfc->chipnum;
+	memset(xhfc->slot_owner, -1, sizeof(xhfc->slot_owner));
+
 	err = init_xhfc(xhfc);
 	if (err)
 		goto out;
@@ -707,6 +818,8 @@ setup_instance(struct xhfc *xhfc, struct device *parent)
 		p->dch.dev.nrbchan = 2;
 		for (j = 0; j < 2; j++) {
 			p->bch[j].nr = j + 1;
+			p->slot_tx[j] = -1;
+			p->slot_rx[j] = -1;
 			set_channelmap(j + 1, p->dch.dev.channelmap);
 			p->bch[j].debug = debug;
 			mISDN_initbchannel(&p->bch[j], MAX_DATA_MEM, 0);
@@ -854,6 +967,7 @@ deactivate_bchannel(struct bchannel *bch)
 	spin_unlock_bh(&p->lock);
 
 	spin_lock_bh(&p->xhfc->lock);
+	xhfc_pcm(bch, -1, 0, -1, 0);
 	xhfc_setup_bch(bch, ISDN_P_NONE);
 	spin_unlock_bh(&p->xhfc->lock);
 }
@@ -1009,11 +1123,53 @@ xhfc_l2l1D(struct mISDNchannel *ch, struct sk_buff *skb)
 static int
 channel_bctrl(struct bchannel *bch, struct mISDN_ctrl_req *cq)
 {
+	struct dsp_features *features =
+		(struct dsp_features *)(*((u_long *)&cq->p1));
+	struct port *p = bch->hw;
+	struct xhfc *xhfc = p->xhfc;
+	int slot_tx, bank_tx, slot_rx, bank_rx;
 	int ret = 0;
 
 	switch (cq->op) {
 		case MISDN_CTRL_GETOP:
-			cq->op = MISDN_CTRL_FILL_EMPTY;
+			cq->op = MISDN_CTRL_FILL_EMPTY |
+				MISDN_CTRL_HW_FEATURES_OP;
+			if (xhfc->pcm >= 0)
+				cq->op |= MISDN_CTRL_HFC_OP;
+			break;
+		case MISDN_CTRL_HW_FEATURES:
+			/* no conference unit, only PCM crossconnects */
+			features->hfc_id = -1;
+			features->pcm_id = xhfc->pcm;
+			if (xhfc->pcm >= 0) {
+				features->pcm_slots = xhfc->slots;
+				features->pcm_banks = 2;
+			}
+			break;
+		case MISDN_CTRL_HFC_PCM_CONN:
+			slot_tx = cq->p1 & 0xff;
+			bank_tx = cq->p1 >> 8;
+			slot_rx = cq->p2 & 0xff;
+			bank_rx = cq->p2 >> 8;
+			if (xhfc->pcm < 0 || slot_tx >= xhfc->slots ||
+			    bank_tx > 2 || slot_rx >= xhfc->slots ||
+			    bank_rx > 2) {
+				printk(KERN_WARNING
+				       "%s: HFC_PCM_CONN slot %d bank %d (TX) "
+				       "slot %d bank %d (RX) out of range\n",
+				       __func__, slot_tx, bank_tx,
+				       slot_rx, bank_rx);
+				ret = -EINVAL;
+				break;
+			}
+			spin_lock_bh(&xhfc->lock);
+			xhfc_pcm(bch, slot_tx, bank_tx, slot_rx, bank_rx);
+			spin_unlock_bh(&xhfc->lock);
+			break;
+		case MISDN_CTRL_HFC_PCM_DISC:
+			spin_lock_bh(&xhfc->lock);
+			xhfc_pcm(bch, -1, 0, -1, 0);
+			spin_unlock_bh(&xhfc->lock);
 			break;
 		case MISDN_CTRL_FILL_EMPTY:
 			test_and_set_bit(FLG_FILLEMPTY, &bch->Flags);
@@ -1487,22 +1643,7 @@ xhfc_write_fifo(struct xhfc *xhfc, __u8 channel)
 		}
 
 		/* write data to FIFO */
-		i = 0;
-		while (i < tcnt) {
-                        write_xhfc(xhfc, A_FIFO_DATA, *(data + i));
-                        i++;
-		        /*
-		        // optimized bulk writes
-			if ((tcnt - i) >= 4) {
-				write32_xhfc(xhfc, A_FIFO_DATA,
-					     *((__u32 *) (data + i)));
-				i += 4;
-			} else {
-				write_xhfc(xhfc, A_FIFO_DATA, *(data + i));
-				i++;
-			}
-			*/
-		}
+		write_fifo_xhfc(xhfc, A_FIFO_DATA, data, tcnt);
 
 		/* skb data complete */
 		if (*tx_idx == (*tx_skb)->len) {
@@ -1676,22 +1817,7 @@ xhfc_read_fifo(struct xhfc *xhfc, __u8 channel)
 		data = skb_put(*rx_skb, rcnt);
 
 		/* read data from FIFO */
-		i = 0;
-		while (i < rcnt) {
-		        *(data + i) = read_xhfc(xhfc, A_FIFO_DATA);
-		        i++;
-        		/*
-        		// optimized bulk reads:
-			if ((rcnt - i) >= 4) {
-				*((__u32 *) (data + i)) =
-				    read32_xhfc(xhfc, A_FIFO_DATA);
-				i += 4;
-			} else {
-				*(data + i) = read_xhfc(xhfc, A_FIFO_DATA);
-				i++;
-			}
-                        */
-		}
+		read_fifo_xhfc(xhfc, A_FIFO_DATA, data, rcnt);
 	} else {
 		spin_unlock(&port->lock);
 		return;
@@ -1818,9 +1944,11 @@ xhfc_bh_handler(unsigned long ul_hw)
 		}
 	}
 
-	/* set fifo_irq when RX data over treshold */
+	/* set fifo_irq when RX data over treshold,
+	 * only the fill registers of ports with enabled RX fifos are read */
 	for (i = 0; i < xhfc->num_ports; i++)
-		fifo_irq |= read_xhfc(xhfc, R_FILL_BL0 + i) << (i * 8);
+		if ((xhfc->fifo_irqmsk >> (i * 8)) & FIFO_MASK_RX & 0xff)
+			fifo_irq |= read_xhfc(xhfc, R_FILL_BL0 + i) << (i * 8);
 
 	/* Handle rx Fifos */
 	if ((fifo_irq & xhfc->fifo_irqmsk) & FIFO_MASK_RX) {
@@ -1869,8 +1997,10 @@ xhfc_interrupt(int intno, void *dev_id)
 	xhfc_irqs = 0;
 	for (i = 0; i < pi->driver_data.num_xhfcs; i++) {
 		xhfc = &pi->xhfc[i];
-		if (GET_V_GLOB_IRQ_EN(xhfc->irq_ctrl)
-		    && (read_xhfc(xhfc, R_IRQ_OVIEW)))
+		xhfc->irq_oview = 0;
+		if (GET_V_GLOB_IRQ_EN(xhfc->irq_ctrl))
+			xhfc->irq_oview = read_xhfc(xhfc, R_IRQ_OVIEW);
+		if (xhfc->irq_oview)
 			/* mark this xhfc possibly had irq */
 			xhfc_irqs |= (1 << i);
 	}
@@ -1891,11 +2021,13 @@ xhfc_interrupt(int intno, void *dev_id)
 		xhfc->misc_irq |= read_xhfc(xhfc, R_MISC_IRQ);
 		xhfc->su_irq |= read_xhfc(xhfc, R_SU_IRQ);
 
-		/* get fifo IRQ states in bundle */
+		/* get fifo IRQ states in bundle, only of the fifo blocks
+		 * marked in R_IRQ_OVIEW */
 		for (j = 0; j < 4; j++)
-			xhfc->fifo_irq |=
-			    (read_xhfc(xhfc, R_FIFO_BL0_IRQ + j) <<
-			     (j * 8));
+			if (xhfc->irq_oview & (M_FIFO_BL0_IRQ << j))
+				xhfc->fifo_irq |=
+				    (read_xhfc(xhfc, R_FIFO_BL0_IRQ + j) <<
+				     (j * 8));
 
 		sched_bh = (xhfc->misc_irq & xhfc->misc_irqmsk)
 		            || (xhfc->su_irq & xhfc->su_irqmsk)
@@ -136,6 +136,12 @@ struct port {
 	struct dchannel ech;
 	struct bchannel bch[2];
 
+	/* PCM slots and banks of the B-channels, slot -1 if not connected */
+	int slot_tx[2];
+	int bank_tx[2];
+	int slot_rx[2];
+	int bank_rx[2];
+
 	__u8 dpid;	/* D-channel Protocoll ID */
 	__u16 mode;	/* NT/TE + ST/U */
 	__u8 timers;
@@ -179,6 +185,7 @@ struct xhfc {
 
 	/* chip registers */
 	__u8 irq_ctrl;
+	__u8 irq_oview;		/* R_IRQ_OVIEW of the current interrupt */
 	__u8 misc_irqmsk;	/* mask of enabled interrupt sources */
 	__u8 misc_irq;		/* collect interrupt status bits */
 
@@ -188,6 +195,10 @@ struct xhfc {
 	__u8 pcm_md0;
 	__u8 pcm_md1;
 
+	int pcm;		/* id of the PCM bus, -1 if not shared */
+	int slots;		/* number of slots on the PCM bus */
+	signed char slot_owner[256];	/* channel on each slot and direction */
+
 	__u32 fifo_irq;		/* fifo bl irq */
 	__u32 fifo_irqmsk;	/* fifo bl irq */
 };
@@ -26,10 +26,22 @@
  * enabled. If function call is delayed, tv must be set with the timestamp
  * of the actual event.
  *
+ * All clock sources are enabled, so the drift and jitter of each source is
+ * measured against the system clock. Only the current source increments the
+ * counter. Sources of the highest priority that are alive compete by their
+ * measured quality. If the current source stops delivering or becomes much
+ * worse, the next update of a better source takes over. The counter then
+ * continues with the time elapsed since the last update, so it does not
+ * jump.
+ *
  * A clock source unregisters using mISDN_unregister_clock.
  *
  * To get current clock, call mISDN_clock_get. The signed short value
  * counts the number of samples since. Time since last clock event is added.
+ * mISDN_clock_get64 returns the same counter with 64 bits, so it does not
+ * wrap.
+ *
+ * Readers do not lock, they retry if the clock was updated while reading.
  *
  */
 
@@ -37,19 +49,25 @@
 #include <linux/types.h>
 #include <linux/stddef.h>
 #include <linux/spinlock.h>
+#include <linux/seqlock.h>
 #include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/mISDNif.h>
 #include <linux/export.h>
 #include "core.h"
 
 static u_int *debug;
 static LIST_HEAD(iclock_list);
-static DEFINE_RWLOCK(iclock_lock);
-static u16 iclock_count;		/* counter of last clock */
+static DEFINE_SEQLOCK(iclock_lock);
+static u64 iclock_count;		/* counter of last clock */
 static ktime_t iclock_timestamp;	/* time stamp of last clock */
 static int iclock_timestamp_valid;	/* already received one timestamp */
 static struct mISDNclock *iclock_current;
 
+#define CLOCK_TIMEOUT_NS	(50 * NSEC_PER_MSEC) /* source is lost */
+#define CLOCK_SETTLE		16	/* updates before quality is known */
+#define CLOCK_DRIFT_WEIGHT	100	/* 1 ppm drift counts as 100 ns jitter */
+
 void
 mISDN_init_clock(u_int *dp)
 {
@@ -57,35 +75,90 @@ mISDN_init_clock(u_int *dp)
 	iclock_timestamp = ktime_get();
 }
 
+/*
+ * measure drift (ppm) and jitter (ns) of an update against the system clock
+ */
+static void
+measure_iclock(struct mISDNclock *iclock, int samples, ktime_t now)
+{
+	s64	elapsed, expected, error;
+
+	elapsed = ktime_to_ns(ktime_sub(now, iclock->last));
+	iclock->last = now;
+	if (!iclock->updates || elapsed > CLOCK_TIMEOUT_NS || samples <= 0) {
+		/* first update or source was lost, measure again */
+		iclock->updates = 1;
+		iclock->drift = 0;
+		iclock->jitter = 0;
+		return;
+	}
+	expected = (s64)samples * (NSEC_PER_SEC / 8000);
+	error = elapsed - expected;
+	iclock->drift += (div64_s64(error * 1000000, expected) -
+			  iclock->drift) / 16;
+	iclock->jitter += (abs(error) - iclock->jitter) / 16;
+	if (iclock->updates < CLOCK_SETTLE)
+		iclock->updates++;
+}
+
+static int
+alive_iclock(struct mISDNclock *iclock, ktime_t now)
+{
+	return iclock->updates >= CLOCK_SETTLE &&
+		ktime_to_ns(ktime_sub(now, iclock->last)) <= CLOCK_TIMEOUT_NS;
+}
+
+static s64
+score_iclock(struct mISDNclock *iclock)
+{
+	return iclock->jitter + abs(iclock->drift) * CLOCK_DRIFT_WEIGHT;
+}
+
+/*
+ * tell if the given clock should replace the current one
+ */
+static int
+better_iclock(struct mISDNclock *iclock, ktime_t now)
+{
+	struct mISDNclock *cur = iclock_current;
+
+	if (!alive_iclock(iclock, now))
+		return 0;
+	if (!cur || !alive_iclock(cur, now))
+		return 1;
+	if (iclock->pri != cur->pri)
+		return iclock->pri > cur->pri;
+	/* only switch, if much better, to avoid flapping */
+	return score_iclock(iclock) * 2 < score_iclock(cur);
+}
+
 static void
 select_iclock(void)
 {
-	struct mISDNclock *iclock, *bestclock = NULL, *lastclock = NULL;
+	struct mISDNclock *iclock, *bestclock = NULL;
+	ktime_t now = ktime_get();
 	int pri = -128;
 
+	/* take best source that is alive, or the one with highest priority */
 	list_for_each_entry(iclock, &iclock_list, list) {
 		if (iclock->pri > pri) {
 			pri = iclock->pri;
 			bestclock = iclock;
 		}
-		if (iclock_current == iclock)
-			lastclock = iclock;
 	}
-	if (lastclock && bestclock != lastclock) {
-		/* last used clock source still exists but changes, disable */
-		if (*debug & DEBUG_CLOCK)
-			printk(KERN_DEBUG "Old clock source '%s' disable.\n",
-			       lastclock->name);
-		lastclock->ctl(lastclock->priv, 0);
-	}
-	if (bestclock && bestclock != iclock_current) {
-		/* new clock source selected, enable */
-		if (*debug & DEBUG_CLOCK)
-			printk(KERN_DEBUG "New clock source '%s' enable.\n",
-			       bestclock->name);
-		bestclock->ctl(bestclock->priv, 1);
+	list_for_each_entry(iclock, &iclock_list, list) {
+		if (!alive_iclock(iclock, now))
+			continue;
+		if (!bestclock || !alive_iclock(bestclock, now) ||
+		    iclock->pri > bestclock->pri ||
+		    (iclock->pri == bestclock->pri &&
+		     score_iclock(iclock) < score_iclock(bestclock)))
+			bestclock = iclock;
 	}
 	if (bestclock != iclock_current) {
+		if (*debug & DEBUG_CLOCK)
+			printk(KERN_DEBUG "New clock source '%s' selected.\n",
+			       bestclock ? bestclock->name : "nothing");
 		/* no clock received yet */
 		iclock_timestamp_valid = 0;
 	}
@@ -109,10 +182,12 @@ struct mISDNclock
 	iclock->pri = pri;
 	iclock->priv = priv;
 	iclock->ctl = ctl;
-	write_lock_irqsave(&iclock_lock, flags);
+	write_seqlock_irqsave(&iclock_lock, flags);
 	list_add_tail(&iclock->list, &iclock_list);
 	select_iclock();
-	write_unlock_irqrestore(&iclock_lock, flags);
+	/* every source is measured, so enable it */
+	iclock->ctl(iclock->priv, 1);
+	write_sequnlock_irqrestore(&iclock_lock, flags);
 	return iclock;
 }
 EXPORT_SYMBOL(mISDN_register_clock);
@@ -125,17 +200,17 @@ mISDN_unregister_clock(struct mISDNclock *iclock)
 	if (*debug & (DEBUG_CORE | DEBUG_CLOCK))
 		printk(KERN_DEBUG "%s: %s %d\n", __func__, iclock->name,
 		       iclock->pri);
-	write_lock_irqsave(&iclock_lock, flags);
+	write_seqlock_irqsave(&iclock_lock, flags);
 	if (iclock_current == iclock) {
 		if (*debug & DEBUG_CLOCK)
 			printk(KERN_DEBUG
 			       "Current clock source '%s' unregisters.\n",
 			       iclock->name);
-		iclock->ctl(iclock->priv, 0);
 	}
+	iclock->ctl(iclock->priv, 0);
 	list_del(&iclock->list);
 	select_iclock();
-	write_unlock_irqrestore(&iclock_lock, flags);
+	write_sequnlock_irqrestore(&iclock_lock, flags);
 }
 EXPORT_SYMBOL(mISDN_unregister_clock);
 
@@ -144,33 +219,35 @@ mISDN_clock_update(struct mISDNclock *iclock, int samples, ktime_t *timestamp)
 {
 	u_long		flags;
 	ktime_t		timestamp_now;
-	u16		delta;
+	u64		delta;
+
+	/* timestamp must be set, if function call is delayed */
+	if (timestamp)
+		timestamp_now = *timestamp;
+	else
+		timestamp_now = ktime_get();
 
-	write_lock_irqsave(&iclock_lock, flags);
+	write_seqlock_irqsave(&iclock_lock, flags);
+	measure_iclock(iclock, samples, timestamp_now);
 	if (iclock_current != iclock) {
-		printk(KERN_ERR "%s: '%s' sends us clock updates, but we do "
-		       "listen to '%s'. This is a bug!\n", __func__,
-		       iclock->name,
-		       iclock_current ? iclock_current->name : "nothing");
-		iclock->ctl(iclock->priv, 0);
-		write_unlock_irqrestore(&iclock_lock, flags);
-		return;
+		if (!better_iclock(iclock, timestamp_now)) {
+			write_sequnlock_irqrestore(&iclock_lock, flags);
+			return;
+		}
+		if (*debug & DEBUG_CLOCK)
+			printk(KERN_DEBUG "Clock source '%s' takes over from "
+			       "'%s'.\n", iclock->name,
+			       iclock_current ? iclock_current->name :
+			       "nothing");
+		iclock_current = iclock;
+		iclock_timestamp_valid = 0;
 	}
 	if (iclock_timestamp_valid) {
 		/* increment sample counter by given samples */
 		iclock_count += samples;
-		if (timestamp) { /* timestamp must be set, if function call is delayed */
-			iclock_timestamp = *timestamp;
-		} else	{
-			iclock_timestamp = ktime_get();
-		}
+		iclock_timestamp = timestamp_now;
 	} else {
 		/* calc elapsed time by system clock */
-		if (timestamp) { /* timestamp must be set, if function call is delayed */
-			timestamp_now = *timestamp;
-		} else {
-			timestamp_now = ktime_get();
-		}
 		delta = ktime_divns(ktime_sub(timestamp_now, iclock_timestamp),
 				(NSEC_PER_SEC / 8000));
 		/* add elapsed time to counter and set new timestamp */
@@ -181,26 +258,46 @@ mISDN_clock_update(struct mISDNclock *iclock, int samples, ktime_t *timestamp)
 			printk("Received first clock from source '%s'.\n",
 			       iclock_current ? iclock_current->name : "nothing");
 	}
-	write_unlock_irqrestore(&iclock_lock, flags);
+	write_sequnlock_irqrestore(&iclock_lock, flags);
 }
 EXPORT_SYMBOL(mISDN_clock_update);
 
-unsigned short
-mISDN_clock_get(void)
+DEFINE_STATIC_KEY_FALSE(mISDN_rxstamp_key);
+EXPORT_SYMBOL(mISDN_rxstamp_key);
+
+/* stamp a received frame, called by the driver when it read the FIFO */
+void
+__mISDN_rx_stamp(struct sk_buff *skb)
 {
-	u_long		flags;
-	ktime_t		timestamp_now;
-	u16		delta;
-	u16		count;
+	struct mISDN_rxstamp	*st = mISDN_RXSTAMP_P(skb);
 
-	read_lock_irqsave(&iclock_lock, flags);
-	/* calc elapsed time by system clock */
+	st->time = ktime_get_ns();
+	st->clock = mISDN_clock_get64();
+}
+EXPORT_SYMBOL(__mISDN_rx_stamp);
+
+u64
+mISDN_clock_get64(void)
+{
+	ktime_t		timestamp_now, timestamp;
+	u64		count;
+	u_int		seq;
+
+	do {
+		seq = read_seqbegin(&iclock_lock);
+		count = iclock_count;
+		timestamp = iclock_timestamp;
+	} while (read_seqretry(&iclock_lock, seq));
+	/* calc elapsed time by system clock and add it to counter */
 	timestamp_now = ktime_get();
-	delta = ktime_divns(ktime_sub(timestamp_now, iclock_timestamp),
-			(NSEC_PER_SEC / 8000));
-	/* add elapsed time to counter */
-	count =	iclock_count + delta;
-	read_unlock_irqrestore(&iclock_lock, flags);
-	return count;
+	return count + ktime_divns(ktime_sub(timestamp_now, timestamp),
+				   (NSEC_PER_SEC / 8000));
+}
+EXPORT_SYMBOL(mISDN_clock_get64);
+
+unsigned short
+mISDN_clock_get(void)
+{
+	return (u16)mISDN_clock_get64();
 }
 EXPORT_SYMBOL(mISDN_clock_get);
@@ -17,9 +17,19 @@
 #include <linux/stddef.h>
 #include <linux/module.h>
 #include <linux/spinlock.h>
+#include <linux/rcupdate.h>
 #include <linux/mISDNif.h>
 #include "core.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/misdn.h>
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(misdn_fifo_rx);
+EXPORT_TRACEPOINT_SYMBOL_GPL(misdn_fifo_tx);
+EXPORT_TRACEPOINT_SYMBOL_GPL(misdn_dsp_rx);
+EXPORT_TRACEPOINT_SYMBOL_GPL(misdn_cmx_rx);
+EXPORT_TRACEPOINT_SYMBOL_GPL(misdn_cmx_tx);
+
 static u_int debug;
 
 MODULE_AUTHOR("Karsten Keil");
@@ -29,8 +39,13 @@ module_param(debug, uint, S_IRUGO | S_IWUSR);
 static u64		device_ids;
 #define MAX_DEVICE_ID	63
 
-static LIST_HEAD(Bprotocols);
-static DEFINE_RWLOCK(bp_lock);
+/*
+ * the registered Bprotocols by the bit of their protocol id, read under RCU
+ * at each B-channel open, bp_lock only serializes the (un)registration
+ */
+static struct Bprotocol __rcu	*Bprotocols[ISDN_P_B_MASK + 1];
+static u_int			Bprotocol_mask;
+static DEFINE_SPINLOCK(bp_lock);
 
 static void mISDN_dev_release(struct device *dev)
 {
@@ -136,6 +151,51 @@ static ssize_t channelmap_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(channelmap);
 
+static ssize_t stack_workers_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct mISDNstack *st = dev_to_mISDN(dev)->D.st;
+
+	return sprintf(buf, "%d\n",
+		       test_bit(mISDN_STACK_WORKERS, &st->status) ? 1 : 0);
+}
+
+static ssize_t stack_workers_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct mISDNstack *st = dev_to_mISDN(dev)->D.st;
+	int err, val;
+
+	err = kstrtoint(buf, 0, &val);
+	if (err)
+		return err;
+	err = mISDN_stack_set_workers(st, val != 0);
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(stack_workers);
+
+static ssize_t stack_cpu_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", READ_ONCE(dev_to_mISDN(dev)->D.st->cpu));
+}
+
+static ssize_t stack_cpu_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct mISDNstack *st = dev_to_mISDN(dev)->D.st;
+	int err, val;
+
+	err = kstrtoint(buf, 0, &val);
+	if (err)
+		return err;
+	err = mISDN_stack_set_cpu(st, val);
+	return err ? err : count;
+}
+static DEVICE_ATTR_RW(stack_cpu);
+
 static struct attribute *mISDN_attrs[] = {
 	&dev_attr_id.attr,
 	&dev_attr_d_protocols.attr,
@@ -144,9 +204,110 @@ static struct attribute *mISDN_attrs[] = {
 	&dev_attr_channelmap.attr,
 	&dev_attr_nrbchan.attr,
 	&dev_attr_name.attr,
+	&dev_attr_stack_workers.attr,
+	&dev_attr_stack_cpu.attr,
+	NULL,
+};
+
+/*
+ * statistics in the stats directory of the device, they are counted per
+ * cpu and added up here
+ */
+#define MISDN_STACK_STAT(name, field)					\
+static ssize_t stack_##name##_show(struct device *dev,			\
+				   struct device_attribute *attr,	\
+				   char *buf)				\
+{									\
+	struct mISDNstack_stats st;					\
+									\
+	mISDN_stack_get_stats(dev_to_mISDN(dev)->D.st, &st);		\
+	return sprintf(buf, "%llu\n", (unsigned long long)st.field);	\
+}									\
+static struct device_attribute dev_attr_stack_##name =			\
+	__ATTR(name, S_IRUGO, stack_##name##_show, NULL)
+
+MISDN_STACK_STAT(messages, msgs);
+MISDN_STACK_STAT(bursts, bursts);
+MISDN_STACK_STAT(direct, direct);
+MISDN_STACK_STAT(errors, errors);
+MISDN_STACK_STAT(wakeups, sleeps);
+MISDN_STACK_STAT(stopped, stopped);
+MISDN_STACK_STAT(queue_max, max_burst);
+
+static ssize_t burst_time_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct mISDNstack_stats st;
+	int i, len = 0;
+
+	mISDN_stack_get_stats(dev_to_mISDN(dev)->D.st, &st);
+	len += sprintf(buf, "<1us:%llu", st.burst_time[0]);
+	for (i = 1; i < MISDN_STACK_TIME_BUCKETS; i++)
+		len += sprintf(buf + len, " %uus%s:%llu", 1 << (i - 1),
+			       (i == MISDN_STACK_TIME_BUCKETS - 1) ? "+" : "",
+			       st.burst_time[i]);
+	buf[len++] = '\n';
+	return len;
+}
+static DEVICE_ATTR_RO(burst_time);
+
+static int
+channel_stats_line(struct mISDNchannel *ch, char *buf, int size)
+{
+	struct mISDNchannel_stats cs;
+
+	mISDN_channel_get_stats(ch, &cs);
+	return scnprintf(buf, size, "%u %llu %llu %llu %llu %llu %llu %llu %llu\n",
+			 ch->nr, cs.rx_frames, cs.rx_bytes, cs.tx_frames,
+			 cs.tx_bytes, cs.rx_dropped, cs.tx_dropped,
+			 cs.fifo_overrun, cs.fifo_underrun);
+}
+
+/* one line per channel, the D-channel is channel 0 */
+static ssize_t channels_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct mISDNdevice *mdev = dev_to_mISDN(dev);
+	struct mISDNchannel *ch;
+	int len;
+
+	len = scnprintf(buf, PAGE_SIZE, "ch rx_frames rx_bytes tx_frames "
+			"tx_bytes rx_dropped tx_dropped fifo_overrun "
+			"fifo_underrun\n");
+	len += channel_stats_line(&mdev->D, buf + len, PAGE_SIZE - len);
+	list_for_each_entry(ch, &mdev->bchannels, list)
+		len += channel_stats_line(ch, buf + len, PAGE_SIZE - len);
+	return len;
+}
+static DEVICE_ATTR_RO(channels);
+
+static struct attribute *mISDN_stats_attrs[] = {
+	&dev_attr_stack_messages.attr,
+	&dev_attr_stack_bursts.attr,
+	&dev_attr_stack_direct.attr,
+	&dev_attr_stack_errors.attr,
+	&dev_attr_stack_wakeups.attr,
+	&dev_attr_stack_stopped.attr,
+	&dev_attr_stack_queue_max.attr,
+	&dev_attr_burst_time.attr,
+	&dev_attr_channels.attr,
+	NULL,
+};
+
+static const struct attribute_group mISDN_group = {
+	.attrs = mISDN_attrs,
+};
+
+static const struct attribute_group mISDN_stats_group = {
+	.name = "stats",
+	.attrs = mISDN_stats_attrs,
+};
+
+static const struct attribute_group *mISDN_groups[] = {
+	&mISDN_group,
+	&mISDN_stats_group,
 	NULL,
 };
-ATTRIBUTE_GROUPS(mISDN);
 
 static int mISDN_uevent(struct device *dev, struct kobj_uevent_env *env)
 {
@@ -235,6 +396,10 @@ mISDN_register_device(struct mISDNdevice *dev,
 	dev->id = err;
 
 	device_initialize(&dev->dev);
+	/* the stack is created on the node of the card */
+	dev->dev.parent = parent;
+	if (parent)
+		set_dev_node(&dev->dev, dev_to_node(parent));
 	if (name && name[0])
 		dev_set_name(&dev->dev, "%s", name);
 	else
@@ -248,7 +413,6 @@ mISDN_register_device(struct mISDNdevice *dev,
 
 	dev->dev.class = &mISDN_class;
 	dev->dev.platform_data = dev;
-	dev->dev.parent = parent;
 	dev_set_drvdata(&dev->dev, dev);
 
 	err = device_add(&dev->dev);
@@ -283,29 +447,33 @@ EXPORT_SYMBOL(mISDN_unregister_device);
 u_int
 get_all_Bprotocols(void)
 {
-	struct Bprotocol	*bp;
-	u_int	m = 0;
-
-	read_lock(&bp_lock);
-	list_for_each_entry(bp, &Bprotocols, list)
-		m |= bp->Bprotocols;
-	read_unlock(&bp_lock);
-	return m;
+	return READ_ONCE(Bprotocol_mask);
 }
 
+/*
+ * the Bprotocol of the lowest bit of m, which is registered.
+ * its module is held, the caller drops it with put_Bprotocol().
+ */
 struct Bprotocol *
 get_Bprotocol4mask(u_int m)
 {
-	struct Bprotocol	*bp;
+	struct Bprotocol	*bp = NULL;
+
+	m &= READ_ONCE(Bprotocol_mask);
+	if (m) {
+		rcu_read_lock();
+		bp = rcu_dereference(Bprotocols[__ffs(m)]);
+		if (bp && !try_module_get(bp->owner))
+			bp = NULL;
+		rcu_read_unlock();
+	}
+	return bp;
+}
 
-	read_lock(&bp_lock);
-	list_for_each_entry(bp, &Bprotocols, list)
-		if (bp->Bprotocols & m) {
-			read_unlock(&bp_lock);
-			return bp;
-		}
-	read_unlock(&bp_lock);
-	return NULL;
+void
+put_Bprotocol(struct Bprotocol *bp)
+{
+	module_put(bp->owner);
 }
 
 struct Bprotocol *
@@ -325,22 +493,27 @@ get_Bprotocol4id(u_int id)
 int
 mISDN_register_Bprotocol(struct Bprotocol *bp)
 {
-	u_long			flags;
 	struct Bprotocol	*old;
+	u_int			m;
 
 	if (debug & DEBUG_CORE)
 		printk(KERN_DEBUG "%s: %s/%x\n", __func__,
 		       bp->name, bp->Bprotocols);
-	old = get_Bprotocol4mask(bp->Bprotocols);
-	if (old) {
+	spin_lock(&bp_lock);
+	m = bp->Bprotocols & Bprotocol_mask;
+	if (m) {
+		old = rcu_dereference_protected(Bprotocols[__ffs(m)],
+						lockdep_is_held(&bp_lock));
+		spin_unlock(&bp_lock);
 		printk(KERN_WARNING
 		       "register duplicate protocol old %s/%x new %s/%x\n",
 		       old->name, old->Bprotocols, bp->name, bp->Bprotocols);
 		return -EBUSY;
 	}
-	write_lock_irqsave(&bp_lock, flags);
-	list_add_tail(&bp->list, &Bprotocols);
-	write_unlock_irqrestore(&bp_lock, flags);
+	for (m = bp->Bprotocols; m; m &= m - 1)
+		rcu_assign_pointer(Bprotocols[__ffs(m)], bp);
+	WRITE_ONCE(Bprotocol_mask, Bprotocol_mask | bp->Bprotocols);
+	spin_unlock(&bp_lock);
 	return 0;
 }
 EXPORT_SYMBOL(mISDN_register_Bprotocol);
@@ -348,14 +521,24 @@ EXPORT_SYMBOL(mISDN_register_Bprotocol);
 void
 mISDN_unregister_Bprotocol(struct Bprotocol *bp)
 {
-	u_long	flags;
+	u_int	m;
 
 	if (debug & DEBUG_CORE)
 		printk(KERN_DEBUG "%s: %s/%x\n", __func__, bp->name,
 		       bp->Bprotocols);
-	write_lock_irqsave(&bp_lock, flags);
-	list_del(&bp->list);
-	write_unlock_irqrestore(&bp_lock, flags);
+	spin_lock(&bp_lock);
+	for (m = bp->Bprotocols; m; m &= m - 1) {
+		if (rcu_access_pointer(Bprotocols[__ffs(m)]) != bp)
+			continue;
+		RCU_INIT_POINTER(Bprotocols[__ffs(m)], NULL);
+		WRITE_ONCE(Bprotocol_mask, Bprotocol_mask & ~BIT(__ffs(m)));
+	}
+	spin_unlock(&bp_lock);
+	/*
+	 * a lookup that still found bp has taken the module, or failed to,
+	 * once this returns. channels created by bp hold the module themselves.
+	 */
+	synchronize_rcu();
 }
 EXPORT_SYMBOL(mISDN_unregister_Bprotocol);
 
@@ -383,7 +566,10 @@ mISDNInit(void)
 	printk(KERN_INFO "Modular ISDN core version %d.%d.%d (git.misdn.eu)\n",
 	       MISDN_MAJOR_VERSION, MISDN_MINOR_VERSION, MISDN_RELEASE);
 	mISDN_init_clock(&debug);
-	mISDN_initstack(&debug);
+	err = mISDN_initstack(&debug);
+	if (err)
+		return err;
+	mISDN_audio_pool_init();
 	err = class_register(&mISDN_class);
 	if (err)
 		goto error1;
@@ -410,6 +596,7 @@ error3:
 error2:
 	class_unregister(&mISDN_class);
 error1:
+	mISDN_stack_cleanup();
 	return err;
 }
 
@@ -420,6 +607,8 @@ static void mISDN_cleanup(void)
 	l1_cleanup();
 	mISDN_timer_cleanup();
 	class_unregister(&mISDN_class);
+	mISDN_audio_pool_cleanup();
+	mISDN_stack_cleanup();
 
 	printk(KERN_DEBUG "mISDNcore unloaded\n");
 }
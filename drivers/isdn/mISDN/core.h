@@ -28,13 +28,17 @@ extern int			get_mdevice_count(void);
 #define mISDN_STACK_CLEARING	2
 #define mISDN_STACK_RESTART	3
 #define mISDN_STACK_WAKEUP	4
+#define mISDN_STACK_TIMER	5
 #define mISDN_STACK_ABORT	15
 /* command bits 16-19 */
 #define mISDN_STACK_STOPPED	16
 #define mISDN_STACK_INIT	17
 #define mISDN_STACK_THREADSTART	18
+#define mISDN_STACK_SWITCH	19
 /* status bits 20-31 */
 #define mISDN_STACK_BCHANNEL	20
+#define mISDN_STACK_WORKERS	21
+#define mISDN_STACK_DISPATCH	22
 #define mISDN_STACK_ACTIVE      29
 #define mISDN_STACK_RUNNING     30
 #define mISDN_STACK_KILLED      31
@@ -56,15 +60,26 @@ extern int	create_teimanager(struct mISDNdevice *);
 extern void	delete_teimanager(struct mISDNchannel *);
 extern void	delete_channel(struct mISDNchannel *);
 extern void	delete_stack(struct mISDNdevice *);
-extern void	mISDN_initstack(u_int *);
+extern int	mISDN_initstack(u_int *);
+extern void	mISDN_stack_cleanup(void);
+extern int	mISDN_stack_set_workers(struct mISDNstack *, int);
+extern int	mISDN_stack_set_cpu(struct mISDNstack *, int);
+extern void	mISDN_stack_get_stats(struct mISDNstack *,
+				      struct mISDNstack_stats *);
+extern void	mISDN_channel_get_stats(struct mISDNchannel *,
+					struct mISDNchannel_stats *);
 extern int      misdn_sock_init(u_int *);
 extern void     misdn_sock_cleanup(void);
 extern void	add_layer2(struct mISDNchannel *, struct mISDNstack *);
 extern void	__add_layer2(struct mISDNchannel *, struct mISDNstack *);
+extern void	__del_layer2(struct mISDNchannel *, struct mISDNstack *);
+extern void	del_layer2(struct mISDNchannel *, struct mISDNstack *);
+extern void	free_layer2_rcu(struct rcu_head *, rcu_callback_t);
 
 extern u_int		get_all_Bprotocols(void);
 struct Bprotocol	*get_Bprotocol4mask(u_int);
 struct Bprotocol	*get_Bprotocol4id(u_int);
+void			put_Bprotocol(struct Bprotocol *);
 
 extern int	mISDN_inittimer(u_int *);
 extern void	mISDN_timer_cleanup(void);
@@ -76,4 +91,13 @@ extern void	Isdnl2_cleanup(void);
 
 extern void	mISDN_init_clock(u_int *);
 
+extern void	mISDN_audio_pool_init(void);
+extern void	mISDN_audio_pool_cleanup(void);
+
+/* generated by hdlc_mktables (hdlc_tables.c) */
+/* bit r is set, if r ones followed by the byte do not give 5 ones in a row */
+extern const u8	mISDN_hdlc_fast[256];
+/* number of ones at the end (MSB) of the byte */
+extern const u8	mISDN_hdlc_tail[256];
+
 #endif
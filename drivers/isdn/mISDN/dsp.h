@@ -22,13 +22,21 @@
  *
  * bit 0 = use ulaw instead of alaw
  * bit 1 = enable hfc hardware acceleration for all channels
+ * bit 2 = use adaptive jitter buffer (smaller rings, faster adaption)
+ * bit 3 = unused (compact law encoder, now CONFIG_MISDN_DSP_COMPACT)
+ * bit 4 = receive transparent data by the rx ring of the card, if it has one
+ * bit 5 = forward frames of software bridges directly (cards share a clock)
  *
  */
 #define DSP_OPT_ULAW		(1 << 0)
 #define DSP_OPT_NOHARDWARE	(1 << 1)
+#define DSP_OPT_ADAPTIVE	(1 << 2)
+#define DSP_OPT_RX_RING		(1 << 4)
+#define DSP_OPT_FORWARD		(1 << 5)
 
 #include <linux/timer.h>
 #include <linux/workqueue.h>
+#include <linux/rcupdate.h>
 
 #include "dsp_ecdis.h"
 
@@ -44,21 +52,93 @@ extern u32 dsp_poll_diff; /* calculated fix-comma corrected poll value */
  * audio stuff *
  ***************/
 
-extern s32 dsp_audio_alaw_to_s32[256];
-extern s32 dsp_audio_ulaw_to_s32[256];
-extern s32 *dsp_audio_law_to_s32;
-extern u8 dsp_audio_s16_to_law[65536];
-extern u8 dsp_audio_alaw_to_ulaw[256];
-extern u8 dsp_audio_mix_law[65536];
-extern u8 dsp_audio_seven2law[128];
-extern u8 dsp_audio_law2seven[256];
-extern void dsp_audio_generate_law_tables(void);
-extern void dsp_audio_generate_s2law_table(void);
-extern void dsp_audio_generate_seven(void);
-extern void dsp_audio_generate_mix_table(void);
-extern void dsp_audio_generate_ulaw_samples(void);
-extern void dsp_audio_generate_volume_changes(void);
+/*
+ * compact encoder: the law value only depends on the magnitude of the
+ * sample shifted by dsp_audio_mag_shift, the sign is one bit of the law.
+ * (the size is also defined in dsp_mktables.c)
+ * with CONFIG_MISDN_DSP_COMPACT it is the only encoder, and the 64KB
+ * tables of encoder and mixer are not built in.
+ */
+#define DSP_MAG_TABLE_SIZE	4097
+#define DSP_LAW_SIGN		0x01	/* sign bit of bit reversed law */
+
+/* tables of both laws, generated by dsp_mktables */
+extern const s32 dsp_audio_alaw_to_s32[256];
+extern const s32 dsp_audio_ulaw_to_s32[256];
+extern const u8 dsp_audio_alaw_to_ulaw[256];
+extern const u8 dsp_audio_ulaw_to_alaw[256];
+#ifndef CONFIG_MISDN_DSP_COMPACT
+extern const u8 dsp_audio_s16_to_alaw[65536];
+extern const u8 dsp_audio_s16_to_ulaw[65536];
+extern const u8 dsp_audio_mix_alaw[65536];
+extern const u8 dsp_audio_mix_ulaw[65536];
+#endif
+extern const u8 dsp_audio_mag_to_alaw[DSP_MAG_TABLE_SIZE];
+extern const u8 dsp_audio_mag_to_ulaw[DSP_MAG_TABLE_SIZE];
+extern const u8 dsp_audio_seven2alaw[128];
+extern const u8 dsp_audio_seven2ulaw[128];
+extern const u8 dsp_audio_alaw2seven[256];
+extern const u8 dsp_audio_ulaw2seven[256];
+extern const u8 dsp_audio_volume_alaw[16][256];
+extern const u8 dsp_audio_volume_ulaw[16][256];
+
+/* tables of the law in use, see dsp_audio_select_law() */
+extern const s32 *dsp_audio_law_to_s32;
+#ifndef CONFIG_MISDN_DSP_COMPACT
+extern const u8 *dsp_audio_s16_to_law;
+extern const u8 *dsp_audio_mix_law;
+#endif
+extern const u8 *dsp_audio_mag_to_law;
+extern int dsp_audio_mag_round, dsp_audio_mag_shift;
+extern const u8 *dsp_audio_seven2law;
+extern const u8 *dsp_audio_law2seven;
 extern u8 dsp_silence;
+extern void dsp_audio_select_law(int ulaw);
+extern void dsp_audio_generate_ulaw_samples(void);
+
+/* encode a sample, that is already clipped to s16 */
+static inline u8
+dsp_audio_s16_law_compact(s32 sample)
+{
+	if (sample >= 0)
+		return dsp_audio_mag_to_law[(sample + dsp_audio_mag_round)
+					    >> dsp_audio_mag_shift];
+	if (sample < -32767)
+		sample = -32767;
+	return dsp_audio_mag_to_law[(dsp_audio_mag_round - sample)
+				    >> dsp_audio_mag_shift] ^ DSP_LAW_SIGN;
+}
+
+/* mix two law samples */
+static inline u8
+dsp_audio_mix_compact(u8 a, u8 b)
+{
+	s32 sample;
+
+	sample = dsp_audio_law_to_s32[a] + dsp_audio_law_to_s32[b];
+	if (sample < -32768)
+		sample = -32768;
+	else if (sample > 32767)
+		sample = 32767;
+	return dsp_audio_s16_law_compact(sample);
+}
+
+#ifdef CONFIG_MISDN_DSP_COMPACT
+#define dsp_audio_s16_law	dsp_audio_s16_law_compact
+#define dsp_audio_mix		dsp_audio_mix_compact
+#else
+static inline u8
+dsp_audio_s16_law(s32 sample)
+{
+	return dsp_audio_s16_to_law[sample & 0xffff];
+}
+
+static inline u8
+dsp_audio_mix(u8 a, u8 b)
+{
+	return dsp_audio_mix_law[(a << 8) | b];
+}
+#endif
 
 
 /*************
@@ -67,13 +147,22 @@ extern u8 dsp_silence;
 
 #define MAX_POLL	256	/* maximum number of send-chunks */
 
-#define CMX_BUFF_SIZE	0x8000	/* must be 2**n (0x1000 about 1/2 second) */
-#define CMX_BUFF_HALF	0x4000	/* CMX_BUFF_SIZE / 2 */
-#define CMX_BUFF_MASK	0x7fff	/* CMX_BUFF_SIZE - 1 */
+/* size of rx/tx rings, set at load time (must be 2**n) */
+#define CMX_BUFF_MIN	0x0800	/* about 1/4 second */
+#define CMX_BUFF_MAX	0x8000	/* about 4 seconds */
+#define CMX_BUFF_ADAPTIVE 0x2000 /* default size in adaptive mode */
+extern int dsp_buff_size;
 
-/* how many seconds will we check the lowest delay until the jitter buffer
-   is reduced by that delay */
+#define CMX_BUFF_SIZE	dsp_buff_size	/* (0x1000 about 1/2 second) */
+#define CMX_BUFF_HALF	(dsp_buff_size >> 1)	/* CMX_BUFF_SIZE / 2 */
+#define CMX_BUFF_MASK	(dsp_buff_size - 1)	/* CMX_BUFF_SIZE - 1 */
+
+/* how many intervals will we check the lowest delay until the jitter buffer
+   is reduced by that delay (an interval is one second, or 1/8 second in
+   adaptive mode) */
 #define MAX_SECONDS_JITTER_CHECK 5
+#define CMX_JITTER_INTERVAL	8000
+#define CMX_JITTER_ADAPTIVE	1000
 
 extern struct timer_list dsp_spl_tl;
 
@@ -86,10 +175,15 @@ extern unsigned long dsp_spl_jiffies;
  * the conferences are linked in a chain.
  * each conference has members linked in a chain.
  * each dsplayer points to a member, each member points to a dsplayer.
+ *
+ * the chain of conferences is changed under dsp_lock and walked by the
+ * mixing tick using rcu. the member chain is protected by the lock of the
+ * conference, which also protects the data path of all members.
  */
 
 /* all members within a conference (this is linked 1:1 with the dsp) */
 struct dsp;
+struct dsp_record;
 struct dsp_conf_member {
 	struct list_head	list;
 	struct dsp		*dsp;
@@ -98,6 +192,7 @@ struct dsp_conf_member {
 /* the list of all conferences */
 struct dsp_conf {
 	struct list_head	list;
+	struct hlist_node	node; /* entry in conf hash, keyed by id */
 	u32			id;
 	/* all cmx stacks with the same ID are
 	   connected */
@@ -105,6 +200,10 @@ struct dsp_conf {
 	int			software; /* conf is processed by software */
 	int			hardware; /* conf is processed by hardware */
 	/* note: if both unset, has only one member */
+	int			members; /* number of entries in mlist */
+	int			mustmix; /* software && enough members to mix */
+	spinlock_t		lock; /* member chain and member buffers */
+	struct rcu_head		rcu;
 };
 
 
@@ -123,21 +222,38 @@ struct dsp_dtmf {
 	int		software; /* dtmf uses software decoding */
 	int		hardware; /* dtmf uses hardware decoding */
 	int		size; /* number of bytes in buffer */
-	signed short	buffer[DSP_DTMF_NPOINTS];
+	s32		buffer[DSP_DTMF_NPOINTS];
 	/* buffers one full dtmf frame */
 	u8		lastwhat, lastdigit;
 	int		count;
 	u8		digits[16]; /* dtmf result */
+	u_long		blocks; /* frames decoded by software */
+	u_long		gated; /* frames rejected by energy gate */
 };
 
 
 /******************
  * pipeline stuff *
  ******************/
+/* the built pipeline is compiled into flat arrays of the process functions */
+struct dsp_pipeline_tx {
+	void	(*process_tx)(void *p, unsigned char *data, int len);
+	void	*p;
+};
+
+struct dsp_pipeline_rx {
+	void	(*process_rx)(void *p, unsigned char *data, int len,
+			      unsigned int txlen);
+	void	*p;
+};
+
 struct dsp_pipeline {
 	rwlock_t  lock;
 	struct list_head list;
 	int inuse;
+	int num_tx, num_rx;
+	struct dsp_pipeline_tx *tx; /* in order of the list */
+	struct dsp_pipeline_rx *rx; /* in reverse order of the list */
 };
 
 /***************
@@ -151,7 +267,6 @@ struct dsp_tone {
 	void		*pattern;
 	int		count;
 	int		index;
-	struct timer_list tl;
 };
 
 /***************
@@ -169,21 +284,29 @@ struct dsp_echo {
 
 struct dsp {
 	struct list_head list;
+	spinlock_t	lock; /* data path, if not member of a conf */
 	struct mISDNchannel	ch;
 	struct mISDNchannel	*up;
 	unsigned char	name[64];
 	int		b_active;
 	struct dsp_echo	echo;
 	int		rx_disabled; /* what the user wants */
+	int		rx_congested; /* the queue of the user is full */
 	int		rx_is_off; /* what the card is */
 	int		tx_mix;
 	struct dsp_tone	tone;
 	struct dsp_dtmf	dtmf;
 	int		tx_volume, rx_volume;
+	int		tx_gain, rx_gain; /* in 0.5 dB steps, 0 = off */
+	u8		tx_gain_table[256], rx_gain_table[256];
+	/* volume and gain in one table, see dsp_change_tables */
+	const u8	*tx_change, *rx_change;
+	u8		tx_change_table[256], rx_change_table[256];
 
 	/* queue for sending frames */
 	struct work_struct	workq;
 	struct sk_buff_head	sendq;
+	int		cpu;	/* of the last received frame, -1 if none */
 	int		hdlc;	/* if mode is hdlc */
 	int		data_pending;	/* currently an unconfirmed frame */
 
@@ -197,27 +320,43 @@ struct dsp {
 	int		rx_W; /* current write pos for data without timestamp */
 	int		rx_R; /* current read pos for transmit clock */
 	int		rx_init; /* if set, pointers will be adjusted first */
+	u_int		rx_reset; /* counts when rx_begin moves rx_R */
+	u_int		rx_seen; /* rx_reset when the tick read the ring */
+	u_int		rx_seen_tick; /* tick that set rx_seen */
 	int		tx_W; /* current write pos for transmit data */
 	int		tx_R; /* current read pos for transmit clock */
 	int		rx_delay[MAX_SECONDS_JITTER_CHECK];
 	int		tx_delay[MAX_SECONDS_JITTER_CHECK];
-	u8		tx_buff[CMX_BUFF_SIZE];
-	u8		rx_buff[CMX_BUFF_SIZE];
+	u8		*tx_buff; /* CMX_BUFF_SIZE, see dsp_cmx_buff_get */
+	u8		*rx_buff; /* CMX_BUFF_SIZE, see dsp_cmx_buff_get */
+	/* jitter buffer statistics */
+	u_long		rx_underrun; /* rx buffer ran empty */
+	u_long		rx_overrun; /* rx buffer exceeded twice the delay */
+	u_long		tx_overflow; /* tx data did not fit into buffer */
+	int		rx_cur_delay; /* rx delay at last clock */
+	int		tx_cur_delay; /* tx delay at last clock */
 	int		last_tx; /* if set, we transmitted last poll interval */
 	int		cmx_delay; /* initial delay of buffers,
 				      or 0 for dynamic jitter buffer */
 	int		tx_dejitter; /* if set, dejitter tx buffer */
 	int		tx_data; /* enables tx-data of CMX to upper layer */
+	int		record_id; /* DSP_RECORD_ON, 0 if not recording */
+	struct dsp_record *record; /* ring of the recorder, if attached */
 
 	/* hardware stuff */
 	struct dsp_features features;
 	int		features_rx_off; /* set if rx_off is featured */
 	int		features_fill_empty; /* set if fill_empty is featured */
+	int		features_rx_ring; /* set if rx_ring is featured */
+	struct mISDN_rx_ring *rx_ring; /* read by the tick, if set */
+	struct sk_buff	*rx_ring_skb; /* frame of the tick for rx_ring */
 	int		pcm_slot_rx; /* current PCM slot (or -1) */
 	int		pcm_bank_rx;
 	int		pcm_slot_tx;
 	int		pcm_bank_tx;
 	int		hfc_conf; /* unique id of current conference (or -1) */
+	/* last PCM and conference message to the card, op 0 if unknown */
+	struct mISDN_ctrl_req hw_pcm, hw_conf;
 
 	/* encryption stuff */
 	int		bf_enable;
@@ -236,18 +375,69 @@ struct dsp {
 	pipeline;
 };
 
+/* number of the B-channel below, the channel of the tracepoints */
+#define dsp_chnr(dsp)	((dsp)->ch.peer ? (dsp)->ch.peer->nr : 0)
+
+/*
+ * lock the data path (buffers, tones, crypt, pipeline) of a dsp instance.
+ * members of a conference share the lock of their conference, so the
+ * conference can be mixed while holding one lock only. dsp->conf changes
+ * only while both the old and the new lock are held, so it is checked again
+ * after locking. returns the lock that must be released.
+ */
+static inline spinlock_t *
+dsp_lock_data(struct dsp *dsp, u_long *flags)
+{
+	struct dsp_conf	*conf;
+	spinlock_t	*lock;
+
+	rcu_read_lock();
+	for (;;) {
+		conf = READ_ONCE(dsp->conf);
+		lock = conf ? &conf->lock : &dsp->lock;
+		spin_lock_irqsave(lock, *flags);
+		if (READ_ONCE(dsp->conf) == conf)
+			break;
+		spin_unlock_irqrestore(lock, *flags);
+	}
+	rcu_read_unlock();
+	return lock;
+}
+
 /* functions */
 
 extern void dsp_change_volume(struct sk_buff *skb, int volume);
+#define DSP_GAIN_MAX	48	/* +-24 dB */
+extern void dsp_audio_generate_gain(u8 *table, int gain);
+extern void dsp_change_gain(struct sk_buff *skb, const u8 *table);
+extern const u8 *dsp_audio_change_table(u8 *table, int volume, int gain,
+					u8 *gain_table);
 
 extern struct list_head dsp_ilist;
 extern struct list_head conf_ilist;
+extern struct sk_buff *dsp_rx_audio(struct dsp *dsp, struct sk_buff *skb);
+extern void dsp_schedule_tx(struct dsp *dsp);
+
 extern void dsp_cmx_debug(struct dsp *dsp);
 extern void dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp);
 extern int dsp_cmx_conf(struct dsp *dsp, u32 conf_id);
-extern void dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb);
+extern int dsp_cmx_rx_begin(struct dsp *dsp, struct sk_buff *skb);
+extern void dsp_cmx_rx_end(struct dsp *dsp, int len);
+extern struct dsp *dsp_cmx_forward_peer(struct dsp *dsp);
+extern void dsp_cmx_forward(struct dsp *to, struct sk_buff *skb);
 extern void dsp_cmx_hdlc(struct dsp *dsp, struct sk_buff *skb);
 extern void dsp_cmx_send(void *arg);
+extern void dsp_cmx_clock_start(int period_us);
+extern void dsp_cmx_clock_stop(void);
+extern int dsp_cmx_silence_init(void);
+extern void dsp_cmx_silence_exit(void);
+extern int dsp_cmx_buff_init(void);
+extern void dsp_cmx_buff_exit(void);
+extern int dsp_cmx_buff_get(struct dsp *dsp);
+extern int dsp_cmx_buff_prepare(struct dsp *dsp);
+extern void dsp_cmx_buff_put(struct dsp *dsp);
+extern int dsp_cmx_parallel_init(int cpus);
+extern void dsp_cmx_parallel_exit(void);
 extern void dsp_cmx_transmit(struct dsp *dsp, struct sk_buff *skb);
 extern int dsp_cmx_del_conf_member(struct dsp *dsp);
 extern int dsp_cmx_del_conf(struct dsp_conf *conf);
@@ -256,10 +446,28 @@ extern void dsp_dtmf_goertzel_init(struct dsp *dsp);
 extern void dsp_dtmf_hardware(struct dsp *dsp);
 extern u8 *dsp_dtmf_goertzel_decode(struct dsp *dsp, u8 *data, int len,
 				    int fmt);
+extern void dsp_dtmf_goertzel_block(struct dsp *dsp);
 
 extern int dsp_tone(struct dsp *dsp, int tone);
 extern void dsp_tone_copy(struct dsp *dsp, u8 *data, int len);
-extern void dsp_tone_timeout(void *arg);
+extern struct sk_buff *dsp_tone_clone(struct dsp *dsp, int len);
+extern void dsp_tone_clock(struct dsp *dsp, int len);
+extern void dsp_tone_stream_init(void);
+extern void dsp_tone_stream_exit(void);
+
+extern int dsp_record_init(void);
+extern void dsp_record_exit(void);
+extern void dsp_record_off(struct dsp *dsp);
+extern void dsp_record_frame(struct dsp *dsp, u_int prim, const u8 *data,
+			     int len);
+
+/* copy a frame into the ring of the recorder, the data lock is held */
+static inline void
+dsp_record(struct dsp *dsp, u_int prim, const u8 *data, int len)
+{
+	if (unlikely(dsp->record))
+		dsp_record_frame(dsp, prim, data, len);
+}
 
 extern void dsp_bf_encrypt(struct dsp *dsp, u8 *data, int len);
 extern void dsp_bf_decrypt(struct dsp *dsp, u8 *data, int len);
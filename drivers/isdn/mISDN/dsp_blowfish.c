@@ -361,9 +361,131 @@ static const u32 bf_sbox[256 * 4] = {
 #define DROUND(a, b, n)  do { a ^= bf_F(b); b ^= P[n]; } while (0)
 
 
+/* two blocks at once, so the lookups of both blocks can overlap */
+#define EROUND2(a, b, c, d, n)  do { b ^= P[n]; d ^= P[n];	\
+		a ^= bf_F(b); c ^= bf_F(d); } while (0)
+
+/* transcode 9 samples xlaw to 8 bytes */
+static inline void
+bf_pack9(const u8 *in, u32 *l, u32 *r)
+{
+	u32 yl, yr;
+	u8 nibble;
+
+	yl = dsp_audio_law2seven[in[0]];
+	yl = (yl << 7) | dsp_audio_law2seven[in[1]];
+	yl = (yl << 7) | dsp_audio_law2seven[in[2]];
+	yl = (yl << 7) | dsp_audio_law2seven[in[3]];
+	nibble = dsp_audio_law2seven[in[4]];
+	yr = nibble;
+	yl = (yl << 4) | (nibble >> 3);
+	yr = (yr << 7) | dsp_audio_law2seven[in[5]];
+	yr = (yr << 7) | dsp_audio_law2seven[in[6]];
+	yr = (yr << 7) | dsp_audio_law2seven[in[7]];
+	yr = (yr << 7) | dsp_audio_law2seven[in[8]];
+	/* fill unused bit with random noise of audio input */
+	yr = (yr << 1) | (in[0] & 1);
+	*l = yl;
+	*r = yr;
+}
+
+/*
+ * transcode 8 crypted bytes to 9 data bytes with sync
+ * and checksum information
+ */
+static inline void
+bf_unpack9(u32 yl, u32 yr, u8 *out)
+{
+	u32 cs;
+
+	/* calculate 3-bit checksumme */
+	cs = yl ^ (yl >> 3) ^ (yl >> 6) ^ (yl >> 9) ^ (yl >> 12) ^ (yl >> 15)
+		^ (yl >> 18) ^ (yl >> 21) ^ (yl >> 24) ^ (yl >> 27) ^ (yl >> 30)
+		^ (yr << 2) ^ (yr >> 1) ^ (yr >> 4) ^ (yr >> 7) ^ (yr >> 10)
+		^ (yr >> 13) ^ (yr >> 16) ^ (yr >> 19) ^ (yr >> 22) ^ (yr >> 25)
+		^ (yr >> 28) ^ (yr >> 31);
+
+	out[0] = (yl >> 25) | 0x80;
+	out[1] = (yl >> 18) & 0x7f;
+	out[2] = (yl >> 11) & 0x7f;
+	out[3] = (yl >> 4) & 0x7f;
+	out[4] = ((yl << 3) & 0x78) | ((yr >> 29) & 0x07);
+	out[5] = ((yr >> 22) & 0x7f) | ((cs << 5) & 0x80);
+	out[6] = ((yr >> 15) & 0x7f) | ((cs << 6) & 0x80);
+	out[7] = ((yr >> 8) & 0x7f) | (cs << 7);
+	out[8] = yr;
+}
+
+/* encrypt a block of 9 samples */
+static void
+bf_encrypt9(const u32 *P, const u32 *S, const u8 *in, u8 *out)
+{
+	u32 yl, yr;
+
+	bf_pack9(in, &yl, &yr);
+	EROUND(yr, yl, 0);
+	EROUND(yl, yr, 1);
+	EROUND(yr, yl, 2);
+	EROUND(yl, yr, 3);
+	EROUND(yr, yl, 4);
+	EROUND(yl, yr, 5);
+	EROUND(yr, yl, 6);
+	EROUND(yl, yr, 7);
+	EROUND(yr, yl, 8);
+	EROUND(yl, yr, 9);
+	EROUND(yr, yl, 10);
+	EROUND(yl, yr, 11);
+	EROUND(yr, yl, 12);
+	EROUND(yl, yr, 13);
+	EROUND(yr, yl, 14);
+	EROUND(yl, yr, 15);
+	yl ^= P[16];
+	yr ^= P[17];
+	bf_unpack9(yl, yr, out);
+}
+
+/* encrypt two blocks of 9 samples interleaved */
+static void
+bf_encrypt9x2(const u32 *P, const u32 *S, const u8 *in_a, u8 *out_a,
+	      const u8 *in_b, u8 *out_b)
+{
+	u32 al, ar, bl, br;
+
+	bf_pack9(in_a, &al, &ar);
+	bf_pack9(in_b, &bl, &br);
+	EROUND2(ar, al, br, bl, 0);
+	EROUND2(al, ar, bl, br, 1);
+	EROUND2(ar, al, br, bl, 2);
+	EROUND2(al, ar, bl, br, 3);
+	EROUND2(ar, al, br, bl, 4);
+	EROUND2(al, ar, bl, br, 5);
+	EROUND2(ar, al, br, bl, 6);
+	EROUND2(al, ar, bl, br, 7);
+	EROUND2(ar, al, br, bl, 8);
+	EROUND2(al, ar, bl, br, 9);
+	EROUND2(ar, al, br, bl, 10);
+	EROUND2(al, ar, bl, br, 11);
+	EROUND2(ar, al, br, bl, 12);
+	EROUND2(al, ar, bl, br, 13);
+	EROUND2(ar, al, br, bl, 14);
+	EROUND2(al, ar, bl, br, 15);
+	al ^= P[16];
+	ar ^= P[17];
+	bl ^= P[16];
+	br ^= P[17];
+	bf_unpack9(al, ar, out_a);
+	bf_unpack9(bl, br, out_b);
+}
+
 /*
  * encrypt isdn data frame
  * every block with 9 samples is encrypted
+ *
+ * the crypted block is sent while the next block is collected, so the
+ * output of a block is the encrypted input of the block before. if the
+ * frame holds whole blocks, they are encrypted in bulk: the last block is
+ * kept for the next frame, and the others are encrypted from the end of
+ * the frame backwards, so no input is overwritten before it is encrypted.
  */
 void
 dsp_bf_encrypt(struct dsp *dsp, u8 *data, int len)
@@ -373,75 +495,37 @@ dsp_bf_encrypt(struct dsp *dsp, u8 *data, int len)
 	u8 *bf_crypt_out = dsp->bf_crypt_out;
 	u32 *P = dsp->bf_p;
 	u32 *S = dsp->bf_s;
-	u32 yl, yr;
-	u32 cs;
-	u8 nibble;
+	int n, g;
 
 	while (i < len) {
-		/* collect a block of 9 samples */
-		if (j < 9) {
-			bf_data_in[j] = *data;
-			*data++ = bf_crypt_out[j++];
-			i++;
+		if (j == 9) {
+			bf_encrypt9(P, S, bf_data_in, bf_crypt_out);
+			j = 0;
+		}
+		n = (len - i) / 9;
+		if (!j && n) {
+			/* BULK: n whole blocks */
+			memcpy(bf_data_in, data + 9 * (n - 1), 9);
+			g = n - 1;
+			while (g >= 2) {
+				bf_encrypt9x2(P, S, data + 9 * (g - 1),
+					      data + 9 * g,
+					      data + 9 * (g - 2),
+					      data + 9 * (g - 1));
+				g -= 2;
+			}
+			if (g)
+				bf_encrypt9(P, S, data, data + 9);
+			memcpy(data, bf_crypt_out, 9);
+			data += 9 * n;
+			i += 9 * n;
+			j = 9;
 			continue;
 		}
-		j = 0;
-		/* transcode 9 samples xlaw to 8 bytes */
-		yl = dsp_audio_law2seven[bf_data_in[0]];
-		yl = (yl << 7) | dsp_audio_law2seven[bf_data_in[1]];
-		yl = (yl << 7) | dsp_audio_law2seven[bf_data_in[2]];
-		yl = (yl << 7) | dsp_audio_law2seven[bf_data_in[3]];
-		nibble = dsp_audio_law2seven[bf_data_in[4]];
-		yr = nibble;
-		yl = (yl << 4) | (nibble >> 3);
-		yr = (yr << 7) | dsp_audio_law2seven[bf_data_in[5]];
-		yr = (yr << 7) | dsp_audio_law2seven[bf_data_in[6]];
-		yr = (yr << 7) | dsp_audio_law2seven[bf_data_in[7]];
-		yr = (yr << 7) | dsp_audio_law2seven[bf_data_in[8]];
-		yr = (yr << 1) | (bf_data_in[0] & 1);
-
-		/* fill unused bit with random noise of audio input */
-		/* encrypt */
-
-		EROUND(yr, yl, 0);
-		EROUND(yl, yr, 1);
-		EROUND(yr, yl, 2);
-		EROUND(yl, yr, 3);
-		EROUND(yr, yl, 4);
-		EROUND(yl, yr, 5);
-		EROUND(yr, yl, 6);
-		EROUND(yl, yr, 7);
-		EROUND(yr, yl, 8);
-		EROUND(yl, yr, 9);
-		EROUND(yr, yl, 10);
-		EROUND(yl, yr, 11);
-		EROUND(yr, yl, 12);
-		EROUND(yl, yr, 13);
-		EROUND(yr, yl, 14);
-		EROUND(yl, yr, 15);
-		yl ^= P[16];
-		yr ^= P[17];
-
-		/* calculate 3-bit checksumme */
-		cs = yl ^ (yl >> 3) ^ (yl >> 6) ^ (yl >> 9) ^ (yl >> 12) ^ (yl >> 15)
-			^ (yl >> 18) ^ (yl >> 21) ^ (yl >> 24) ^ (yl >> 27) ^ (yl >> 30)
-			^ (yr << 2) ^ (yr >> 1) ^ (yr >> 4) ^ (yr >> 7) ^ (yr >> 10)
-			^ (yr >> 13) ^ (yr >> 16) ^ (yr >> 19) ^ (yr >> 22) ^ (yr >> 25)
-			^ (yr >> 28) ^ (yr >> 31);
-
-		/*
-		 * transcode 8 crypted bytes to 9 data bytes with sync
-		 * and checksum information
-		 */
-		bf_crypt_out[0] = (yl >> 25) | 0x80;
-		bf_crypt_out[1] = (yl >> 18) & 0x7f;
-		bf_crypt_out[2] = (yl >> 11) & 0x7f;
-		bf_crypt_out[3] = (yl >> 4) & 0x7f;
-		bf_crypt_out[4] = ((yl << 3) & 0x78) | ((yr >> 29) & 0x07);
-		bf_crypt_out[5] = ((yr >> 22) & 0x7f) | ((cs << 5) & 0x80);
-		bf_crypt_out[6] = ((yr >> 15) & 0x7f) | ((cs << 6) & 0x80);
-		bf_crypt_out[7] = ((yr >> 8) & 0x7f) | (cs << 7);
-		bf_crypt_out[8] = yr;
+		/* collect a block of 9 samples */
+		bf_data_in[j] = *data;
+		*data++ = bf_crypt_out[j++];
+		i++;
 	}
 
 	/* write current count */
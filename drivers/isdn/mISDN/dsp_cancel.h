@@ -26,6 +26,8 @@
  *
  */
 
+#include <linux/percpu.h>
+
 #ifdef ARCH_I386
 #include <asm/i387.h>
 #else
@@ -34,6 +36,9 @@
 #endif
 
 #define EC_TIMER 2000
+#define ECHOCAN_BLOCK 160 /* max. samples per call of echo_can_update_block */
+#define ECHOCAN_SLEEP_TX 32 /* mean tx level below this is silence (-60 dB) */
+#define ECHOCAN_SLEEP_ERL 32 /* tx/rx level above this is no echo (30 dB) */
 
 #define __ECHO_STATE_MUTE		(1 << 8)
 #define ECHO_STATE_IDLE			(0)
@@ -45,6 +50,7 @@
 #define AMI_MASK			0x55
 
 struct ec_prv {
+	struct list_head list; /* entry of the pool while idle */
 	struct echo_can_state *ec;
 	uint16_t echotimer;
 	uint16_t echostate;
@@ -53,18 +59,244 @@ struct ec_prv {
 	int  tx_W;
 	int  underrun;
 	int  overflow;
+	int  taps; /* length of the echo tail */
+	int  quiet; /* samples without need for cancellation */
+};
+
+/*
+ * sleep mode
+ *
+ * while the tx signal is silent or the received signal is far below the
+ * tx signal (no echo path, e.g. digital calls) for the whole echo tail, the
+ * canceller is bypassed and rx data is passed unchanged. each frame is
+ * checked before it is processed, so the canceller wakes up with the first
+ * frame that needs it.
+ */
+static int dsp_cancel_sleep = 1;
+module_param_named(sleep, dsp_cancel_sleep, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sleep, "bypass the canceller while no echo is expected");
+
+/* counted per cpu, so the cancellers do not share a cacheline */
+static DEFINE_PER_CPU(u_long, dsp_cancel_samples);
+static DEFINE_PER_CPU(u_long, dsp_cancel_asleep);
+
+static int
+dsp_cancel_get_counter(char *buffer, const struct kernel_param *kp)
+{
+	u_long __percpu	*counter = (u_long __percpu *)kp->arg;
+	u_long		sum = 0;
+	int		cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *per_cpu_ptr(counter, cpu);
+	return sprintf(buffer, "%lu\n", sum);
+}
+
+static const struct kernel_param_ops dsp_cancel_counter_ops = {
+	.get = dsp_cancel_get_counter,
 };
+module_param_cb(samples, &dsp_cancel_counter_ops, &dsp_cancel_samples,
+		S_IRUGO);
+MODULE_PARM_DESC(samples, "samples received by all cancellers");
+module_param_cb(asleep, &dsp_cancel_counter_ops, &dsp_cancel_asleep,
+		S_IRUGO);
+MODULE_PARM_DESC(asleep, "samples passed while the canceller was asleep");
+
+/*
+ * instance pool
+ *
+ * freed instances are kept in a pool and reused by the next call, so call
+ * setup does not allocate the state of the canceller, if an instance with
+ * the same number of taps is idle. if the canceller provides echo_can_reset,
+ * its state is kept with the instance, otherwise only the instance itself is
+ * reused. the pool is filled with instances of the default length at load
+ * time.
+ */
+static int dsp_cancel_pool_size = 16;
+module_param_named(pool, dsp_cancel_pool_size, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(pool, "number of idle canceller instances kept for reuse");
+
+static LIST_HEAD(dsp_cancel_pool);
+static int dsp_cancel_pool_count;
+static DEFINE_SPINLOCK(dsp_cancel_pool_lock);
+
+/* get an idle instance, preferably one with the given number of taps */
+static inline struct ec_prv *
+dsp_cancel_pool_get(int taps)
+{
+	struct ec_prv *p, *found = NULL;
+	u_long flags;
+
+	spin_lock_irqsave(&dsp_cancel_pool_lock, flags);
+	list_for_each_entry(p, &dsp_cancel_pool, list) {
+		if (!found)
+			found = p;
+		if (p->ec && p->taps == taps) {
+			found = p;
+			break;
+		}
+	}
+	if (found) {
+		list_del(&found->list);
+		dsp_cancel_pool_count--;
+	}
+	spin_unlock_irqrestore(&dsp_cancel_pool_lock, flags);
+
+	if (found && found->ec && found->taps != taps) {
+		echo_can_free(found->ec);
+		found->ec = NULL;
+	}
+	return found;
+}
+
+/* put an instance into the pool, returns 0, if the pool is full */
+static inline int
+dsp_cancel_pool_put(struct ec_prv *p)
+{
+	u_long flags;
+	int ret = 0;
+
+#ifndef echo_can_reset
+	if (p->ec) {
+		echo_can_free(p->ec);
+		p->ec = NULL;
+	}
+#endif
+	spin_lock_irqsave(&dsp_cancel_pool_lock, flags);
+	if (dsp_cancel_pool_count < dsp_cancel_pool_size) {
+		list_add(&p->list, &dsp_cancel_pool);
+		dsp_cancel_pool_count++;
+		ret = 1;
+	}
+	spin_unlock_irqrestore(&dsp_cancel_pool_lock, flags);
+	return ret;
+}
+
+static inline void
+dsp_cancel_pool_init(void)
+{
+	struct ec_prv *p;
+	int i;
+
+	for (i = 0; i < dsp_cancel_pool_size; i++) {
+		p = kzalloc(sizeof(struct ec_prv), GFP_KERNEL);
+		if (!p)
+			break;
+		p->taps = 128;
+#ifdef echo_can_reset
+		p->ec = echo_can_create(p->taps, 0);
+#endif
+		if (!dsp_cancel_pool_put(p)) {
+			if (p->ec)
+				echo_can_free(p->ec);
+			kfree(p);
+			break;
+		}
+	}
+}
+
+static inline void
+dsp_cancel_pool_exit(void)
+{
+	struct ec_prv *p, *next;
+
+	list_for_each_entry_safe(p, next, &dsp_cancel_pool, list) {
+		list_del(&p->list);
+		if (p->ec)
+			echo_can_free(p->ec);
+		kfree(p);
+	}
+	dsp_cancel_pool_count = 0;
+}
+
+/* returns 1, if the frame does not need cancellation */
+static inline int
+dsp_cancel_idle(struct ec_prv *p, const short *tx, const short *rx, int len)
+{
+	int txsum = 0, rxsum = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		txsum += abs(tx[i]);
+		rxsum += abs(rx[i]);
+	}
+	if (txsum < ECHOCAN_SLEEP_TX * len ||
+	    txsum > ECHOCAN_SLEEP_ERL * rxsum) {
+		p->quiet += len;
+		if (p->quiet > p->taps)
+			p->quiet = p->taps;
+	} else
+		p->quiet = 0;
+
+	return dsp_cancel_sleep && p->quiet >= p->taps;
+}
+
+/*
+ * frame entry of the canceller, cancellers that only provide
+ * echo_can_update get a loop over it, which is inlined with the update.
+ */
+#ifndef echo_can_update_block
+static inline void
+dsp_cancel_update_block(struct echo_can_state *ec, const short *tx, short *rx,
+			int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		rx[i] = echo_can_update(ec, tx[i], rx[i]);
+}
+#define echo_can_update_block dsp_cancel_update_block
+#endif
+
+/* conversion of frames between law and s16, shared by all cancellers */
+static inline void
+dsp_cancel_law_to_s16(short *lin, const u8 *data, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		lin[i] = dsp_audio_law_to_s32[data[i]];
+}
+
+static inline int
+dsp_cancel_ring_to_s16(short *lin, const u8 *ring, int r, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		lin[i] = dsp_audio_law_to_s32[ring[r]];
+		r = (r + 1) & ECHOCAN_BUFF_MASK;
+	}
+	return r;
+}
+
+static inline void
+dsp_cancel_s16_to_law(u8 *data, const short *lin, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		data[i] = dsp_audio_s16_law(lin[i]);
+}
 
 static inline void *
 dsp_cancel_new(int deftaps, int training)
 {
 	struct ec_prv *p;
+	int taps = deftaps > 0 ? deftaps : 128;
 
-	p = kzalloc(sizeof(struct ec_prv), GFP_ATOMIC);
+	p = dsp_cancel_pool_get(taps);
+	if (!p)
+		p = kzalloc(sizeof(struct ec_prv), GFP_ATOMIC);
 	if (!p)
 		goto err1;
 
-	p->ec = echo_can_create(deftaps > 0 ? deftaps : 128, 0);
+#ifdef echo_can_reset
+	if (p->ec)
+		echo_can_reset(p->ec);
+#endif
+	if (!p->ec)
+		p->ec = echo_can_create(taps, 0);
 	if (!p->ec)
 		goto err2;
 
@@ -75,6 +307,8 @@ dsp_cancel_new(int deftaps, int training)
 	p->tx_W = 0;
 	p->underrun = 0;
 	p->overflow = 0;
+	p->taps = taps;
+	p->quiet = 0;
 
 	return p;
 
@@ -89,7 +323,10 @@ dsp_cancel_free(struct ec_prv *p)
 {
 	if (!p)
 		return;
-	echo_can_free(p->ec);
+	if (dsp_cancel_pool_put(p))
+		return;
+	if (p->ec)
+		echo_can_free(p->ec);
 	kfree(p);
 }
 
@@ -150,16 +387,28 @@ static inline void dsp_cancel_rx(struct ec_prv *p, u8 *data, int len, unsigned i
 				}
 			}
 			rxlin = 0;
-			*data++ = dsp_audio_s16_to_law[rxlin & 0xffff];
+			*data++ = dsp_audio_s16_law(rxlin);
 			r = (r + 1) & ECHOCAN_BUFF_MASK;
 		}
 	} else {
-		while (len--) {
-			rxlin = dsp_audio_law_to_s32[*data];
-			txlin = dsp_audio_law_to_s32[s[r]];
-			rxlin = echo_can_update(p->ec, txlin, rxlin);
-			*data++ = dsp_audio_s16_to_law[rxlin & 0xffff];
-			r = (r + 1) & ECHOCAN_BUFF_MASK;
+		/* the canceller processes a whole frame of s16 per call */
+		short	txblk[ECHOCAN_BLOCK], rxblk[ECHOCAN_BLOCK];
+		int	n;
+
+		while (len) {
+			n = (len > ECHOCAN_BLOCK) ? ECHOCAN_BLOCK : len;
+			dsp_cancel_law_to_s16(rxblk, data, n);
+			r = dsp_cancel_ring_to_s16(txblk, s, r, n);
+			this_cpu_add(dsp_cancel_samples, n);
+			if (dsp_cancel_idle(p, txblk, rxblk, n)) {
+				/* asleep: pass rx unchanged */
+				this_cpu_add(dsp_cancel_asleep, n);
+			} else {
+				echo_can_update_block(p->ec, txblk, rxblk, n);
+				dsp_cancel_s16_to_law(data, rxblk, n);
+			}
+			data += n;
+			len -= n;
 		}
 	}
 	kernel_fpu_end();
@@ -76,13 +76,20 @@
  * Clock:
  *
  * A Clock is not required, if the data source has exactly one clock. In this
- * case the data source is forwarded to the destination.
+ * case the data source is forwarded to the destination. With DSP_OPT_FORWARD,
+ * this is done for a conference of two members in software: as long as the
+ * frames of a member are sent to the other one as they are, each received
+ * frame is queued to the other member right away, without the rx-buffer and
+ * without waiting for the clock. The option asserts that the cards share
+ * one clock, so no samples are lost or inserted.
  *
  * A Clock is required, because the data source
  *  - has multiple clocks.
  *  - has no usable clock due to jitter or packet loss (VoIP).
  * In this case the system's clock is used. The clock resolution depends on
- * the jiffie resolution.
+ * the jiffie resolution, unless the high resolution timer is used (hrperiod
+ * parameter). Then the period is given in microseconds and the poll size
+ * follows from it, independent of HZ.
  *
  * If a member joins a conference:
  *
@@ -105,9 +112,11 @@
  *
  * Tones:
  * If a tone is enabled, it will be processed whenever data is transmitted to
- * the card. It will replace the tx-data from the user space.
+ * the card. It will replace the tx-data from the user space. If the tone is
+ * not altered (volume, pipeline, crypt), a clone of the shared stream of the
+ * tone is sent, so instances playing the same tone do not copy any samples.
  * If tones are generated by hardware, this conference member is removed for
- * this time.
+ * this time. The hardware patterns are switched by the tick.
  *
  * Disable rx-data:
  * If cmx is realized in hardware, rx data will be disabled if requested by
@@ -125,11 +134,20 @@
 /* delay.h is required for hw_lock.h */
 
 #include <linux/slab.h>
+#include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/delay.h>
+#include <linux/hash.h>
+#include <linux/hashtable.h>
+#include <linux/cpumask.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 #include <linux/mISDNif.h>
 #include <linux/mISDNdsp.h>
+#include <trace/events/misdn.h>
 #include "core.h"
 #include "dsp.h"
+#include "dsp_cmx_mix.h"
 /*
  * debugging of multi party conference,
  * by using conference even with two members
@@ -141,15 +159,20 @@
 /*#define CMX_DELAY_DEBUG * gives rx-buffer delay overview */
 /*#define CMX_TX_DEBUG * massive read/write on tx-buffer with content */
 
-static inline int
-count_list_member(struct list_head *head)
+/*
+ * update the flag that tells the tick to mix the conference in software.
+ * it depends on the member count and the software flag, so it is updated
+ * when members are added or removed and when dsp_cmx_hardware() has
+ * evaluated the conference.
+ */
+static inline void
+dsp_cmx_update_mustmix(struct dsp_conf *conf)
 {
-	int			cnt = 0;
-	struct list_head	*m;
-
-	list_for_each(m, head)
-		cnt++;
-	return cnt;
+#ifdef CMX_CONF_DEBUG
+	WRITE_ONCE(conf->mustmix, conf->software && conf->members > 1);
+#else
+	WRITE_ONCE(conf->mustmix, conf->software && conf->members > 2);
+#endif
 }
 
 /*
@@ -172,6 +195,13 @@ dsp_cmx_debug(struct dsp *dsp)
 		if (dsp == odsp)
 			printk(" *this*");
 		printk("\n");
+		printk(KERN_DEBUG "  jitter rx_delay=%d tx_delay=%d "
+		       "underrun=%lu overrun=%lu tx_overflow=%lu\n",
+		       odsp->rx_cur_delay, odsp->tx_cur_delay,
+		       odsp->rx_underrun, odsp->rx_overrun, odsp->tx_overflow);
+		if (odsp->dtmf.software)
+			printk(KERN_DEBUG "  dtmf blocks=%lu gated=%lu\n",
+			       odsp->dtmf.blocks, odsp->dtmf.gated);
 	}
 	printk(KERN_DEBUG "-----Current Conf:\n");
 	list_for_each_entry(conf, &conf_ilist, list) {
@@ -191,6 +221,12 @@ dsp_cmx_debug(struct dsp *dsp)
 	printk(KERN_DEBUG "-----end\n");
 }
 
+/*
+ * conferences hashed by id, changed and searched under dsp_lock
+ */
+#define CMX_CONF_HASH_BITS	8
+static DEFINE_HASHTABLE(conf_hash, CMX_CONF_HASH_BITS);
+
 /*
  * search conference
  */
@@ -205,7 +241,7 @@ dsp_cmx_search_conf(u32 id)
 	}
 
 	/* search conference */
-	list_for_each_entry(conf, &conf_ilist, list)
+	hash_for_each_possible(conf_hash, conf, node, id)
 		if (conf->id == id)
 			return conf;
 
@@ -243,16 +279,32 @@ dsp_cmx_add_conf_member(struct dsp *dsp, struct dsp_conf *conf)
 		return -ENOMEM;
 	}
 	member->dsp = dsp;
+
+	/* irq is already disabled by dsp_lock */
+	spin_lock(&conf->lock);
+	spin_lock(&dsp->lock);
+	/* members are mixed by their rings, so they must have them */
+	if (!dsp->hdlc && dsp_cmx_buff_get(dsp)) {
+		spin_unlock(&dsp->lock);
+		spin_unlock(&conf->lock);
+		kfree(member);
+		return -ENOMEM;
+	}
 	/* clear rx buffer */
-	memset(dsp->rx_buff, dsp_silence, sizeof(dsp->rx_buff));
+	if (dsp->rx_buff)
+		memset(dsp->rx_buff, dsp_silence, CMX_BUFF_SIZE);
 	dsp->rx_init = 1; /* rx_W and rx_R will be adjusted on first frame */
 	dsp->rx_W = 0;
 	dsp->rx_R = 0;
 
 	list_add_tail(&member->list, &conf->mlist);
+	conf->members++;
+	dsp_cmx_update_mustmix(conf);
 
-	dsp->conf = conf;
+	WRITE_ONCE(dsp->conf, conf);
 	dsp->member = member;
+	spin_unlock(&dsp->lock);
+	spin_unlock(&conf->lock);
 
 	return 0;
 }
@@ -265,6 +317,7 @@ int
 dsp_cmx_del_conf_member(struct dsp *dsp)
 {
 	struct dsp_conf_member *member;
+	struct dsp_conf *conf;
 
 	if (!dsp) {
 		printk(KERN_WARNING "%s: dsp is 0.\n",
@@ -285,11 +338,21 @@ dsp_cmx_del_conf_member(struct dsp *dsp)
 	}
 
 	/* find us in conf */
-	list_for_each_entry(member, &dsp->conf->mlist, list) {
+	conf = dsp->conf;
+	list_for_each_entry(member, &conf->mlist, list) {
 		if (member->dsp == dsp) {
+			/* irq is already disabled by dsp_lock */
+			spin_lock(&conf->lock);
+			spin_lock(&dsp->lock);
 			list_del(&member->list);
-			dsp->conf = NULL;
+			conf->members--;
+			dsp_cmx_update_mustmix(conf);
+			WRITE_ONCE(dsp->conf, NULL);
 			dsp->member = NULL;
+			if (!dsp->b_active)
+				dsp_cmx_buff_put(dsp);
+			spin_unlock(&dsp->lock);
+			spin_unlock(&conf->lock);
 			kfree(member);
 			return 0;
 		}
@@ -322,9 +385,11 @@ static struct dsp_conf
 		return NULL;
 	}
 	INIT_LIST_HEAD(&conf->mlist);
+	spin_lock_init(&conf->lock);
 	conf->id = id;
 
-	list_add_tail(&conf->list, &conf_ilist);
+	list_add_tail_rcu(&conf->list, &conf_ilist);
+	hash_add(conf_hash, &conf->node, id);
 
 	return conf;
 }
@@ -347,28 +412,138 @@ dsp_cmx_del_conf(struct dsp_conf *conf)
 		       __func__);
 		return -EINVAL;
 	}
-	list_del(&conf->list);
-	kfree(conf);
+	/* the mixing tick may still walk over it */
+	list_del_rcu(&conf->list);
+	hash_del(&conf->node);
+	kfree_rcu(conf, rcu);
 
 	return 0;
 }
 
 
+/*
+ * PCM slot allocation
+ *
+ * a slot is free, if no dsp on the PCM bus uses it. the slots of skip and
+ * of the members of conf are not counted, except for the members that stay
+ * in the HW conference keep_conf (-1 for none), because they get assigned
+ * again. returns the number of free slots, freeslots[] is set for each.
+ */
+#define CMX_PCM_SLOTS	256
+
+/* set when slots or conference units are released, see dsp_cmx_hardware */
+static int dsp_cmx_released;
+
+static int
+dsp_cmx_free_slots(int pcm_id, int slots, struct dsp *skip,
+		   struct dsp_conf *conf, int keep_conf, u_char *freeslots)
+{
+	struct dsp	*dsp;
+	int		i, n = 0;
+
+	memset(freeslots, 1, CMX_PCM_SLOTS);
+	list_for_each_entry(dsp, &dsp_ilist, list) {
+		if (dsp->features.pcm_id != pcm_id || dsp == skip)
+			continue;
+		if (conf && dsp->conf == conf && dsp->hfc_conf != keep_conf)
+			continue;
+		if (dsp->pcm_slot_rx >= 0 && dsp->pcm_slot_rx < CMX_PCM_SLOTS)
+			freeslots[dsp->pcm_slot_rx] = 0;
+		if (dsp->pcm_slot_tx >= 0 && dsp->pcm_slot_tx < CMX_PCM_SLOTS)
+			freeslots[dsp->pcm_slot_tx] = 0;
+	}
+	if (slots > CMX_PCM_SLOTS)
+		slots = CMX_PCM_SLOTS;
+	for (i = 0; i < slots; i++)
+		n += freeslots[i];
+	return n;
+}
+
+/* take the lowest free slot, so the slots stay packed */
+static int
+dsp_cmx_get_slot(u_char *freeslots, int slots)
+{
+	int i;
+
+	if (slots > CMX_PCM_SLOTS)
+		slots = CMX_PCM_SLOTS;
+	for (i = 0; i < slots; i++) {
+		if (freeslots[i]) {
+			freeslots[i] = 0;
+			return i;
+		}
+	}
+	return -1;
+}
+
+
 /*
  * send HW message to hfc card
+ *
+ * a PCM or conference message, which repeats the last one of its kind, is
+ * not sent again. the card may forget them when the bchannel is
+ * deactivated, so they are sent again after activation.
  */
 static void
 dsp_cmx_hw_message(struct dsp *dsp, u32 message, u32 param1, u32 param2,
 		   u32 param3, u32 param4)
 {
-	struct mISDN_ctrl_req cq;
+	struct mISDN_ctrl_req cq, *last;
 
 	memset(&cq, 0, sizeof(cq));
 	cq.op = message;
 	cq.p1 = param1 | (param2 << 8);
 	cq.p2 = param3 | (param4 << 8);
-	if (dsp->ch.peer)
-		dsp->ch.peer->ctrl(dsp->ch.peer, CONTROL_CHANNEL, &cq);
+	if (!dsp->ch.peer)
+		return;
+	switch (message) {
+	case MISDN_CTRL_HFC_PCM_CONN:
+	case MISDN_CTRL_HFC_PCM_DISC:
+		last = &dsp->hw_pcm;
+		break;
+	case MISDN_CTRL_HFC_CONF_JOIN:
+	case MISDN_CTRL_HFC_CONF_SPLIT:
+		last = &dsp->hw_conf;
+		break;
+	default:
+		last = NULL;
+	}
+	if (last && last->op == cq.op && last->p1 == cq.p1 &&
+	    last->p2 == cq.p2) {
+		if (dsp_debug & DEBUG_DSP_CMX)
+			printk(KERN_DEBUG "%s %s: %x already sent\n",
+			       __func__, dsp->name, message);
+		return;
+	}
+	dsp->ch.peer->ctrl(dsp->ch.peer, CONTROL_CHANNEL, &cq);
+	if (last)
+		*last = cq;
+}
+
+/*
+ * what prevents a dsp from being mixed by hardware in a conference of two
+ * or more, as far as it depends on the dsp alone, or NULL
+ */
+static const char *
+dsp_cmx_hw_unable(struct dsp *dsp)
+{
+	if (dsp->tx_mix)
+		return "tx_mix is turned on";
+	if (dsp->echo.hardware || dsp->echo.software)
+		return "echo is turned on";
+	if (dsp->tx_volume || dsp->tx_gain)
+		return "tx_volume is changed";
+	if (dsp->rx_volume || dsp->rx_gain)
+		return "rx_volume is changed";
+	if (dsp->pipeline.inuse)
+		return "pipeline exists";
+	if (dsp->bf_enable)
+		return "encryption is enabled";
+	if (dsp->record_id)
+		return "recording is on";
+	if (dsp->features.pcm_id < 0)
+		return "dsp has no PCM bus";
+	return NULL;
 }
 
 
@@ -380,14 +555,14 @@ dsp_cmx_hw_message(struct dsp *dsp, u32 message, u32 param1, u32 param2,
  * and therefore removed. if a conference is given, the dsp is expected to
  * be member of that conference.
  */
-void
-dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
+static void
+dsp_cmx_hardware_update(struct dsp_conf *conf, struct dsp *dsp)
 {
 	struct dsp_conf_member	*member, *nextm;
-	struct dsp		*finddsp;
+	const char	*unable;
 	int		memb = 0, i, ii, i1, i2;
 	int		freeunits[8];
-	u_char		freeslots[256];
+	u_char		freeslots[CMX_PCM_SLOTS];
 	int		same_hfc = -1, same_pcm = -1, current_conf = -1,
 		all_conf = 1, tx_data = 0;
 
@@ -409,6 +584,7 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 			dsp_cmx_hw_message(dsp, MISDN_CTRL_HFC_CONF_SPLIT,
 					   0, 0, 0, 0);
 			dsp->hfc_conf = -1;
+			dsp_cmx_released = 1;
 		}
 		/* process hw echo */
 		if (dsp->features.pcm_banks < 1)
@@ -428,6 +604,7 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 				dsp->pcm_bank_tx = -1;
 				dsp->pcm_slot_rx = -1;
 				dsp->pcm_bank_rx = -1;
+				dsp_cmx_released = 1;
 			}
 			return;
 		}
@@ -458,25 +635,11 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 		/* ECHO: find slot */
 		dsp->pcm_slot_tx = -1;
 		dsp->pcm_slot_rx = -1;
-		memset(freeslots, 1, sizeof(freeslots));
-		list_for_each_entry(finddsp, &dsp_ilist, list) {
-			if (finddsp->features.pcm_id == dsp->features.pcm_id) {
-				if (finddsp->pcm_slot_rx >= 0 &&
-				    finddsp->pcm_slot_rx < sizeof(freeslots))
-					freeslots[finddsp->pcm_slot_rx] = 0;
-				if (finddsp->pcm_slot_tx >= 0 &&
-				    finddsp->pcm_slot_tx < sizeof(freeslots))
-					freeslots[finddsp->pcm_slot_tx] = 0;
-			}
-		}
-		i = 0;
-		ii = dsp->features.pcm_slots;
-		while (i < ii) {
-			if (freeslots[i])
-				break;
-			i++;
-		}
-		if (i == ii) {
+		dsp_cmx_free_slots(dsp->features.pcm_id,
+				   dsp->features.pcm_slots, NULL, NULL, -1,
+				   freeslots);
+		i = dsp_cmx_get_slot(freeslots, dsp->features.pcm_slots);
+		if (i < 0) {
 			if (dsp_debug & DEBUG_DSP_CMX)
 				printk(KERN_DEBUG
 				       "%s no slot available for echo\n",
@@ -515,13 +678,13 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 	same_pcm = member->dsp->features.pcm_id;
 	/* check all members in our conference */
 	list_for_each_entry(member, &conf->mlist, list) {
-		/* check if member uses mixing */
-		if (member->dsp->tx_mix) {
+		unable = dsp_cmx_hw_unable(member->dsp);
+		if (unable) {
 			if (dsp_debug & DEBUG_DSP_CMX)
 				printk(KERN_DEBUG
 				       "%s dsp %s cannot form a conf, because "
-				       "tx_mix is turned on\n", __func__,
-				       member->dsp->name);
+				       "%s\n", __func__, member->dsp->name,
+				       unable);
 		conf_software:
 			list_for_each_entry(member, &conf->mlist, list) {
 				dsp = member->dsp;
@@ -539,6 +702,7 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 							   MISDN_CTRL_HFC_CONF_SPLIT,
 							   0, 0, 0, 0);
 					dsp->hfc_conf = -1;
+					dsp_cmx_released = 1;
 				}
 				/* remove PCM slot if assigned */
 				if (dsp->pcm_slot_tx >= 0 ||
@@ -559,47 +723,13 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 					dsp->pcm_bank_tx = -1;
 					dsp->pcm_slot_rx = -1;
 					dsp->pcm_bank_rx = -1;
+					dsp_cmx_released = 1;
 				}
 			}
 			conf->hardware = 0;
 			conf->software = 1;
 			return;
 		}
-		/* check if member has echo turned on */
-		if (member->dsp->echo.hardware || member->dsp->echo.software) {
-			if (dsp_debug & DEBUG_DSP_CMX)
-				printk(KERN_DEBUG
-				       "%s dsp %s cannot form a conf, because "
-				       "echo is turned on\n", __func__,
-				       member->dsp->name);
-			goto conf_software;
-		}
-		/* check if member has tx_mix turned on */
-		if (member->dsp->tx_mix) {
-			if (dsp_debug & DEBUG_DSP_CMX)
-				printk(KERN_DEBUG
-				       "%s dsp %s cannot form a conf, because "
-				       "tx_mix is turned on\n",
-				       __func__, member->dsp->name);
-			goto conf_software;
-		}
-		/* check if member changes volume at an not suppoted level */
-		if (member->dsp->tx_volume) {
-			if (dsp_debug & DEBUG_DSP_CMX)
-				printk(KERN_DEBUG
-				       "%s dsp %s cannot form a conf, because "
-				       "tx_volume is changed\n",
-				       __func__, member->dsp->name);
-			goto conf_software;
-		}
-		if (member->dsp->rx_volume) {
-			if (dsp_debug & DEBUG_DSP_CMX)
-				printk(KERN_DEBUG
-				       "%s dsp %s cannot form a conf, because "
-				       "rx_volume is changed\n",
-				       __func__, member->dsp->name);
-			goto conf_software;
-		}
 		/* check if tx-data turned on */
 		if (member->dsp->tx_data) {
 			if (dsp_debug & DEBUG_DSP_CMX)
@@ -608,32 +738,6 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 				       __func__, member->dsp->name);
 			tx_data = 1;
 		}
-		/* check if pipeline exists */
-		if (member->dsp->pipeline.inuse) {
-			if (dsp_debug & DEBUG_DSP_CMX)
-				printk(KERN_DEBUG
-				       "%s dsp %s cannot form a conf, because "
-				       "pipeline exists\n", __func__,
-				       member->dsp->name);
-			goto conf_software;
-		}
-		/* check if encryption is enabled */
-		if (member->dsp->bf_enable) {
-			if (dsp_debug & DEBUG_DSP_CMX)
-				printk(KERN_DEBUG "%s dsp %s cannot form a "
-				       "conf, because encryption is enabled\n",
-				       __func__, member->dsp->name);
-			goto conf_software;
-		}
-		/* check if member is on a card with PCM support */
-		if (member->dsp->features.pcm_id < 0) {
-			if (dsp_debug & DEBUG_DSP_CMX)
-				printk(KERN_DEBUG
-				       "%s dsp %s cannot form a conf, because "
-				       "dsp has no PCM bus\n",
-				       __func__, member->dsp->name);
-			goto conf_software;
-		}
 		/* check if relations are on the same PCM bus */
 		if (member->dsp->features.pcm_id != same_pcm) {
 			if (dsp_debug & DEBUG_DSP_CMX)
@@ -698,6 +802,7 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 			dsp_cmx_hw_message(member->dsp,
 					   MISDN_CTRL_HFC_CONF_SPLIT, 0, 0, 0, 0);
 			member->dsp->hfc_conf = -1;
+			dsp_cmx_released = 1;
 		}
 		if (nextm->dsp->hfc_conf >= 0) {
 			if (dsp_debug & DEBUG_DSP_CMX)
@@ -709,6 +814,7 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 			dsp_cmx_hw_message(nextm->dsp,
 					   MISDN_CTRL_HFC_CONF_SPLIT, 0, 0, 0, 0);
 			nextm->dsp->hfc_conf = -1;
+			dsp_cmx_released = 1;
 		}
 		/* if members have two banks (and not on the same chip) */
 		if (member->dsp->features.pcm_banks > 1 &&
@@ -746,31 +852,12 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 				conf->software = tx_data;
 				return;
 			}
-			/* find a new slot */
-			memset(freeslots, 1, sizeof(freeslots));
-			list_for_each_entry(dsp, &dsp_ilist, list) {
-				if (dsp != member->dsp &&
-				    dsp != nextm->dsp &&
-				    member->dsp->features.pcm_id ==
-				    dsp->features.pcm_id) {
-					if (dsp->pcm_slot_rx >= 0 &&
-					    dsp->pcm_slot_rx <
-					    sizeof(freeslots))
-						freeslots[dsp->pcm_slot_rx] = 0;
-					if (dsp->pcm_slot_tx >= 0 &&
-					    dsp->pcm_slot_tx <
-					    sizeof(freeslots))
-						freeslots[dsp->pcm_slot_tx] = 0;
-				}
-			}
-			i = 0;
+			/* find a new slot, our own ones are free */
 			ii = member->dsp->features.pcm_slots;
-			while (i < ii) {
-				if (freeslots[i])
-					break;
-				i++;
-			}
-			if (i == ii) {
+			dsp_cmx_free_slots(member->dsp->features.pcm_id, ii,
+					   NULL, conf, -1, freeslots);
+			i = dsp_cmx_get_slot(freeslots, ii);
+			if (i < 0) {
 				if (dsp_debug & DEBUG_DSP_CMX)
 					printk(KERN_DEBUG
 					       "%s no slot available for "
@@ -838,31 +925,10 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 				conf->software = tx_data;
 				return;
 			}
-			/* find two new slot */
-			memset(freeslots, 1, sizeof(freeslots));
-			list_for_each_entry(dsp, &dsp_ilist, list) {
-				if (dsp != member->dsp &&
-				    dsp != nextm->dsp &&
-				    member->dsp->features.pcm_id ==
-				    dsp->features.pcm_id) {
-					if (dsp->pcm_slot_rx >= 0 &&
-					    dsp->pcm_slot_rx <
-					    sizeof(freeslots))
-						freeslots[dsp->pcm_slot_rx] = 0;
-					if (dsp->pcm_slot_tx >= 0 &&
-					    dsp->pcm_slot_tx <
-					    sizeof(freeslots))
-						freeslots[dsp->pcm_slot_tx] = 0;
-				}
-			}
-			i1 = 0;
+			/* find two new slots, our own ones are free */
 			ii = member->dsp->features.pcm_slots;
-			while (i1 < ii) {
-				if (freeslots[i1])
-					break;
-				i1++;
-			}
-			if (i1 == ii) {
+			if (dsp_cmx_free_slots(member->dsp->features.pcm_id, ii,
+					       NULL, conf, -1, freeslots) < 2) {
 				if (dsp_debug & DEBUG_DSP_CMX)
 					printk(KERN_DEBUG
 					       "%s no slot available "
@@ -872,13 +938,9 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 				/* no more slots available */
 				goto conf_software;
 			}
-			i2 = i1 + 1;
-			while (i2 < ii) {
-				if (freeslots[i2])
-					break;
-				i2++;
-			}
-			if (i2 == ii) {
+			i1 = dsp_cmx_get_slot(freeslots, ii);
+			i2 = dsp_cmx_get_slot(freeslots, ii);
+			if (i2 < 0) {
 				if (dsp_debug & DEBUG_DSP_CMX)
 					printk(KERN_DEBUG
 					       "%s no slot available "
@@ -950,6 +1012,11 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 	 */
 	if (current_conf >= 0) {
 	join_members:
+		/*
+		 * check all members and the slots first, so we do not give
+		 * up after some members have been joined already.
+		 */
+		i1 = 0;
 		list_for_each_entry(member, &conf->mlist, list) {
 			/* if no conference engine on our chip, change to
 			 * software */
@@ -958,48 +1025,36 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 			/* in case of hdlc, change to software */
 			if (member->dsp->hdlc)
 				goto conf_software;
+			if (member->dsp->hfc_conf != current_conf)
+				i1++;
+		}
+		/* the slots of the joining members will be overwritten */
+		member = list_entry(conf->mlist.next, struct dsp_conf_member,
+				    list);
+		ii = member->dsp->features.pcm_slots;
+		if (dsp_cmx_free_slots(member->dsp->features.pcm_id, ii, NULL,
+				       conf, current_conf, freeslots) < i1) {
+			/* no more slots available */
+			if (dsp_debug & DEBUG_DSP_CMX)
+				printk(KERN_DEBUG
+				       "%s conference %d cannot be formed,"
+				       " because no slot free\n",
+				       __func__, conf->id);
+			goto conf_software;
+		}
+		list_for_each_entry(member, &conf->mlist, list) {
 			/* join to current conference */
 			if (member->dsp->hfc_conf == current_conf)
 				continue;
-			/* get a free timeslot first */
-			memset(freeslots, 1, sizeof(freeslots));
-			list_for_each_entry(dsp, &dsp_ilist, list) {
-				/*
-				 * not checking current member, because
-				 * slot will be overwritten.
-				 */
-				if (
-					dsp != member->dsp &&
-					/* dsp must be on the same PCM */
-					member->dsp->features.pcm_id ==
-					dsp->features.pcm_id) {
-					/* dsp must be on a slot */
-					if (dsp->pcm_slot_tx >= 0 &&
-					    dsp->pcm_slot_tx <
-					    sizeof(freeslots))
-						freeslots[dsp->pcm_slot_tx] = 0;
-					if (dsp->pcm_slot_rx >= 0 &&
-					    dsp->pcm_slot_rx <
-					    sizeof(freeslots))
-						freeslots[dsp->pcm_slot_rx] = 0;
-				}
-			}
-			i = 0;
-			ii = member->dsp->features.pcm_slots;
-			while (i < ii) {
-				if (freeslots[i])
-					break;
-				i++;
-			}
-			if (i == ii) {
-				/* no more slots available */
-				if (dsp_debug & DEBUG_DSP_CMX)
-					printk(KERN_DEBUG
-					       "%s conference %d cannot be formed,"
-					       " because no slot free\n",
-					       __func__, conf->id);
+			/*
+			 * get a free timeslot first, not checking current
+			 * member, because slot will be overwritten.
+			 */
+			dsp_cmx_free_slots(member->dsp->features.pcm_id, ii,
+					   member->dsp, NULL, -1, freeslots);
+			i = dsp_cmx_get_slot(freeslots, ii);
+			if (i < 0)
 				goto conf_software;
-			}
 			if (dsp_debug & DEBUG_DSP_CMX)
 				printk(KERN_DEBUG
 				       "%s changing dsp %s to HW conference "
@@ -1056,6 +1111,54 @@ dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
 }
 
 
+/*
+ * conf and dsp: a setting of the member dsp has changed
+ * conf only: members have joined or left, all are checked
+ * dsp only: the dsp is not in a conference
+ */
+void
+dsp_cmx_hardware(struct dsp_conf *conf, struct dsp *dsp)
+{
+	struct dsp_conf_member	*member;
+	struct dsp_conf	*retry;
+	int		bkt;
+
+	/*
+	 * a member of a hardware conference, which can still be mixed by
+	 * hardware, changes nothing on the card. only tx_data of a member
+	 * requires the software mixing in addition.
+	 */
+	if (conf && dsp && conf->hardware && !dsp_cmx_hw_unable(dsp)) {
+		conf->software = 0;
+		list_for_each_entry(member, &conf->mlist, list)
+			if (member->dsp->tx_data)
+				conf->software = 1;
+		dsp_cmx_update_mustmix(conf);
+		return;
+	}
+
+	dsp_cmx_released = 0;
+	dsp_cmx_hardware_update(conf, dsp);
+	if (conf)
+		dsp_cmx_update_mustmix(conf);
+
+	/*
+	 * slots or conference units were released, so conferences that
+	 * are mixed by software because of missing resources may now be
+	 * moved to the hardware.
+	 */
+	if (!dsp_cmx_released)
+		return;
+	hash_for_each(conf_hash, bkt, retry, node) {
+		if (retry == conf || retry->hardware || !retry->software ||
+		    list_empty(&retry->mlist))
+			continue;
+		dsp_cmx_hardware_update(retry, NULL);
+		dsp_cmx_update_mustmix(retry);
+	}
+}
+
+
 /*
  * conf_id != 0: join or change conference
  * conf_id == 0: split from conference if not already
@@ -1177,18 +1280,21 @@ showdelay(struct dsp *dsp, int samples, int delay)
 
 /*
  * audio data is received from card
+ *
+ * the pointers of the rx buffer are adjusted for the frame, and the
+ * position is returned, where it is written to. the caller writes the
+ * samples while it processes them (see dsp_rx_audio) and then calls
+ * dsp_cmx_rx_end. returns -1, if the frame is not stored.
  */
-void
-dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
+int
+dsp_cmx_rx_begin(struct dsp *dsp, struct sk_buff *skb)
 {
-	u8 *d, *p;
 	int len = skb->len;
 	struct mISDNhead *hh = mISDN_HEAD_P(skb);
-	int w, i, ii;
 
 	/* check if we have sompen */
-	if (len < 1)
-		return;
+	if (len < 1 || !dsp->rx_buff)
+		return -1;
 
 	/* half of the buffer should be larger than maximum packet size */
 	if (len >= CMX_BUFF_HALF) {
@@ -1196,7 +1302,7 @@ dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
 		       "%s line %d: packet from card is too large (%d bytes). "
 		       "please make card send smaller packets OR increase "
 		       "CMX_BUFF_SIZE\n", __FILE__, __LINE__, len);
-		return;
+		return -1;
 	}
 
 	/*
@@ -1205,6 +1311,7 @@ dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
 	 */
 	if (dsp->rx_init) {
 		dsp->rx_init = 0;
+		dsp->rx_reset++;
 		if (dsp->features.unordered) {
 			dsp->rx_R = (hh->id & CMX_BUFF_MASK);
 			if (dsp->cmx_delay)
@@ -1236,6 +1343,8 @@ dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
 			       "cmx_receive(dsp=%lx): UNDERRUN (or overrun the "
 			       "maximum delay), adjusting read pointer! "
 			       "(inst %s)\n", (u_long)dsp, dsp->name);
+		dsp->rx_underrun++;
+		dsp->rx_reset++;
 		/* flush rx buffer and set delay to dsp_poll / 2 */
 		if (dsp->features.unordered) {
 			dsp->rx_R = (hh->id & CMX_BUFF_MASK);
@@ -1252,7 +1361,7 @@ dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
 			else
 				dsp->rx_W = dsp_poll >> 1;
 		}
-		memset(dsp->rx_buff, dsp_silence, sizeof(dsp->rx_buff));
+		memset(dsp->rx_buff, dsp_silence, CMX_BUFF_SIZE);
 	}
 	/* if we have reached double delay, jump back to middle */
 	if (dsp->cmx_delay)
@@ -1264,6 +1373,8 @@ dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
 				       "twice the delay is reached), adjusting "
 				       "read pointer! (inst %s)\n",
 				       (u_long)dsp, dsp->name);
+			dsp->rx_overrun++;
+			dsp->rx_reset++;
 			/* flush buffer */
 			if (dsp->features.unordered) {
 				dsp->rx_R = (hh->id & CMX_BUFF_MASK);
@@ -1273,7 +1384,7 @@ dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
 				dsp->rx_R = 0;
 				dsp->rx_W = dsp->cmx_delay;
 			}
-			memset(dsp->rx_buff, dsp_silence, sizeof(dsp->rx_buff));
+			memset(dsp->rx_buff, dsp_silence, CMX_BUFF_SIZE);
 		}
 
 	/* show where to write */
@@ -1283,25 +1394,344 @@ dsp_cmx_receive(struct dsp *dsp, struct sk_buff *skb)
 	       (u_long)dsp, dsp->rx_R, dsp->rx_W, len, dsp->name);
 #endif
 
-	/* write data into rx_buffer */
-	p = skb->data;
-	d = dsp->rx_buff;
-	w = dsp->rx_W;
-	i = 0;
-	ii = len;
-	while (i < ii) {
-		d[w++ & CMX_BUFF_MASK] = *p++;
-		i++;
-	}
+	return dsp->rx_W;
+}
 
-	/* increase write-pointer */
+/* the frame of len samples is written, increase write-pointer */
+void
+dsp_cmx_rx_end(struct dsp *dsp, int len)
+{
 	dsp->rx_W = ((dsp->rx_W + len) & CMX_BUFF_MASK);
+	trace_misdn_cmx_rx(&dsp->ch, dsp_chnr(dsp), len,
+			   (dsp->rx_W - dsp->rx_R) & CMX_BUFF_MASK);
 #ifdef CMX_DELAY_DEBUG
 	showdelay(dsp, len, (dsp->rx_W-dsp->rx_R) & CMX_BUFF_MASK);
 #endif
 }
 
 
+/*
+ * direct forwarding of a bridge of two members (DSP_OPT_FORWARD)
+ *
+ * the frames of from may be queued to to as they are, if both are clocked,
+ * nothing is mixed into the frames of to and they are not altered, except
+ * for the volume. the data lock of the conference is held.
+ */
+static int
+dsp_cmx_can_forward(struct dsp *from, struct dsp *to)
+{
+	return !from->features.unclocked && !from->features.unordered &&
+		!to->features.unclocked && !to->features.unordered &&
+		!from->echo.software && !from->cmx_delay &&
+		to->b_active && to->tx_buff && !to->hdlc &&
+		to->tx_R == to->tx_W && /* no tx-data */
+		!(to->tone.tone && to->tone.software) &&
+		!to->echo.software && !to->tx_data &&
+		!to->pipeline.inuse && !to->bf_enable;
+}
+
+/* the other member of a conference of two members in software, or NULL */
+static struct dsp *
+dsp_cmx_other(struct dsp *dsp)
+{
+	struct dsp_conf *conf = dsp->conf;
+	struct dsp *other;
+
+	if (!(dsp_options & DSP_OPT_FORWARD) || !conf || !conf->software ||
+	    conf->hardware || conf->members != 2)
+		return NULL;
+	other = list_first_entry(&conf->mlist, struct dsp_conf_member,
+				 list)->dsp;
+	if (other == dsp)
+		other = list_last_entry(&conf->mlist, struct dsp_conf_member,
+					list)->dsp;
+	return other;
+}
+
+/*
+ * returns the member, the received frames of dsp are forwarded to, or NULL
+ * if they are written to the rx-buffer. the rx-buffer is initialized again,
+ * when it is used after forwarding.
+ */
+struct dsp *
+dsp_cmx_forward_peer(struct dsp *dsp)
+{
+	struct dsp *other = dsp_cmx_other(dsp);
+
+	if (!other || !dsp_cmx_can_forward(dsp, other))
+		return NULL;
+	dsp->rx_init = 1;
+	return other;
+}
+
+/* queue the received frame (already processed) to the other member */
+void
+dsp_cmx_forward(struct dsp *to, struct sk_buff *skb)
+{
+	struct sk_buff *nskb;
+	struct mISDNhead *hh;
+
+	nskb = mI_alloc_audio_skb(skb->len, GFP_ATOMIC);
+	if (!nskb) {
+		printk(KERN_ERR "%s: cannot alloc %d bytes\n", __func__,
+		       skb->len);
+		return;
+	}
+	hh = mISDN_HEAD_P(nskb);
+	hh->prim = PH_DATA_REQ;
+	hh->id = 0;
+	skb_put_data(nskb, skb->data, skb->len);
+	to->last_tx = 1;
+	dsp_record(to, PH_DATA_REQ, nskb->data, nskb->len);
+	if (to->tx_change)
+		dsp_change_gain(nskb, to->tx_change);
+	skb_queue_tail(&to->sendq, nskb);
+	dsp_schedule_tx(to);
+}
+
+/*
+ * shared frame of silence for idle members, it is never changed after init,
+ * so clones of it can be sent to the card.
+ */
+static struct sk_buff	*dsp_silence_skb;
+
+int
+dsp_cmx_silence_init(void)
+{
+	dsp_silence_skb = mI_alloc_skb(MAX_POLL + 100, GFP_KERNEL);
+	if (!dsp_silence_skb) {
+		printk(KERN_ERR "%s: cannot alloc silence frame\n", __func__);
+		return -ENOMEM;
+	}
+	memset(skb_put(dsp_silence_skb, MAX_POLL + 100), dsp_silence,
+	       MAX_POLL + 100);
+	return 0;
+}
+
+void
+dsp_cmx_silence_exit(void)
+{
+	dev_kfree_skb(dsp_silence_skb);
+	dsp_silence_skb = NULL;
+}
+
+/*
+ * the rings of a dsp are only there while its channel is active or it is
+ * member of a conference, so idle and hdlc channels do not hold them. they
+ * come from a cache of the size set by the jitter buffer policy, and are
+ * attached and detached with the data lock of the dsp held.
+ * dsp_cmx_buff_prepare allocates them in process context, when the upper
+ * layer requests the activation. dsp_cmx_buff_get only allocates, if the
+ * channel became active or joined a conference without them.
+ */
+static struct kmem_cache	*dsp_buff_cache;
+
+int
+dsp_cmx_buff_init(void)
+{
+	dsp_buff_cache = kmem_cache_create("mISDN_dsp_cmx", CMX_BUFF_SIZE, 0,
+					   0, NULL);
+	if (!dsp_buff_cache) {
+		printk(KERN_ERR "%s: cannot create cache\n", __func__);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void
+dsp_cmx_buff_exit(void)
+{
+	kmem_cache_destroy(dsp_buff_cache);
+}
+
+int
+dsp_cmx_buff_get(struct dsp *dsp)
+{
+	if (dsp->rx_buff)
+		return 0;
+	dsp->tx_buff = kmem_cache_alloc(dsp_buff_cache, GFP_ATOMIC);
+	dsp->rx_buff = kmem_cache_alloc(dsp_buff_cache, GFP_ATOMIC);
+	if (!dsp->tx_buff || !dsp->rx_buff) {
+		printk(KERN_ERR "%s: no rings for %s\n", __func__, dsp->name);
+		dsp_cmx_buff_put(dsp);
+		return -ENOMEM;
+	}
+	memset(dsp->tx_buff, dsp_silence, CMX_BUFF_SIZE);
+	memset(dsp->rx_buff, dsp_silence, CMX_BUFF_SIZE);
+	dsp->tx_R = 0;
+	dsp->tx_W = 0;
+	return 0;
+}
+
+int
+dsp_cmx_buff_prepare(struct dsp *dsp)
+{
+	u_long	flags;
+	spinlock_t *lock;
+	u8	*tx, *rx;
+
+	might_sleep();
+	if (dsp->hdlc || READ_ONCE(dsp->rx_buff))
+		return 0;
+	tx = kmem_cache_alloc(dsp_buff_cache, GFP_KERNEL);
+	rx = kmem_cache_alloc(dsp_buff_cache, GFP_KERNEL);
+	if (!tx || !rx) {
+		printk(KERN_ERR "%s: no rings for %s\n", __func__, dsp->name);
+		goto out;
+	}
+	memset(tx, dsp_silence, CMX_BUFF_SIZE);
+	memset(rx, dsp_silence, CMX_BUFF_SIZE);
+	lock = dsp_lock_data(dsp, &flags);
+	if (!dsp->rx_buff) {
+		dsp->tx_buff = tx;
+		dsp->rx_buff = rx;
+		dsp->tx_R = 0;
+		dsp->tx_W = 0;
+		tx = NULL;
+		rx = NULL;
+	}
+	spin_unlock_irqrestore(lock, flags);
+out:
+	if (tx)
+		kmem_cache_free(dsp_buff_cache, tx);
+	if (rx)
+		kmem_cache_free(dsp_buff_cache, rx);
+	return dsp->rx_buff ? 0 : -ENOMEM;
+}
+
+void
+dsp_cmx_buff_put(struct dsp *dsp)
+{
+	if (dsp->tx_buff)
+		kmem_cache_free(dsp_buff_cache, dsp->tx_buff);
+	if (dsp->rx_buff)
+		kmem_cache_free(dsp_buff_cache, dsp->rx_buff);
+	dsp->tx_buff = NULL;
+	dsp->rx_buff = NULL;
+	dsp->tx_R = 0;
+	dsp->tx_W = 0;
+}
+
+/*
+ * cycle budget of the tick
+ *
+ * the duration of every tick is kept as a histogram, together with the
+ * ticks that came late (more than 1.5 periods after the last one) or took
+ * longer than a period, and the members mixed in software and in hardware.
+ * skbs are counted per cpu, because conferences may be sent by the mix
+ * workers. writing tick_stats clears all of them.
+ */
+#define DSP_TICK_BUCKETS	16
+
+struct dsp_tick_stat {
+	u64	ticks;
+	u64	late;
+	u64	overrun;
+	u64	time_max;		/* ns */
+	u64	time[DSP_TICK_BUCKETS];	/* <1us, then 1us, 2us, 4us... */
+	u64	sw_members;
+	u64	hw_members;
+	u_int	sw_peak;
+	u_int	hw_peak;
+};
+
+static struct dsp_tick_stat	dsp_tick_stat;
+static DEFINE_PER_CPU(u_long, dsp_tick_skbs);
+
+static void
+dsp_cmx_tick_account(u64 ns, int length, u_int sw, u_int hw)
+{
+	struct dsp_tick_stat *st = &dsp_tick_stat;
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+
+	st->ticks++;
+	if (length > dsp_poll + (dsp_poll >> 1))
+		st->late++;
+	if (ns > (u64)dsp_poll * (NSEC_PER_SEC / 8000))
+		st->overrun++;
+	if (ns > st->time_max)
+		st->time_max = ns;
+	st->time[us ? min_t(int, fls64(us), DSP_TICK_BUCKETS - 1) : 0]++;
+	st->sw_members += sw;
+	if (sw > st->sw_peak)
+		st->sw_peak = sw;
+	st->hw_members += hw;
+	if (hw > st->hw_peak)
+		st->hw_peak = hw;
+}
+
+static int
+dsp_tick_get_stats(char *buffer, const struct kernel_param *kp)
+{
+	struct dsp_tick_stat *st = &dsp_tick_stat;
+	u_long skbs = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		skbs += per_cpu(dsp_tick_skbs, cpu);
+	return sprintf(buffer, "ticks:%llu late:%llu overrun:%llu max:%lluns "
+		       "sw_members:%llu sw_peak:%u hw_members:%llu hw_peak:%u "
+		       "skbs:%lu\n", st->ticks, st->late, st->overrun,
+		       st->time_max, st->sw_members, st->sw_peak,
+		       st->hw_members, st->hw_peak, skbs);
+}
+
+static int
+dsp_tick_clear_stats(const char *val, const struct kernel_param *kp)
+{
+	int cpu;
+
+	memset(&dsp_tick_stat, 0, sizeof(dsp_tick_stat));
+	for_each_possible_cpu(cpu)
+		per_cpu(dsp_tick_skbs, cpu) = 0;
+	return 0;
+}
+
+static const struct kernel_param_ops dsp_tick_stats_ops = {
+	.set = dsp_tick_clear_stats,
+	.get = dsp_tick_get_stats,
+};
+module_param_cb(tick_stats, &dsp_tick_stats_ops, NULL, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tick_stats, "load of the cmx tick, write to clear");
+
+static int
+dsp_tick_get_time(char *buffer, const struct kernel_param *kp)
+{
+	u64 *time = dsp_tick_stat.time;
+	int i, len;
+
+	len = sprintf(buffer, "<1us:%llu", time[0]);
+	for (i = 1; i < DSP_TICK_BUCKETS; i++)
+		len += sprintf(buffer + len, " %uus%s:%llu", 1 << (i - 1),
+			       (i == DSP_TICK_BUCKETS - 1) ? "+" : "",
+			       time[i]);
+	buffer[len++] = '\n';
+	return len;
+}
+
+static const struct kernel_param_ops dsp_tick_time_ops = {
+	.get = dsp_tick_get_time,
+};
+module_param_cb(tick_time, &dsp_tick_time_ops, NULL, S_IRUGO);
+MODULE_PARM_DESC(tick_time, "histogram of the duration of the cmx tick");
+
+/*
+ * the tick reads the rx ring of a dsp and advances rx_R later, each with the
+ * data lock held. if rx_begin resets rx_R in between, the new frame must not
+ * be deleted by the advance. so the tick notes which reset it has seen, when
+ * it reads the ring first.
+ */
+static u_int	dsp_tick_seq; /* incremented by each tick */
+
+static inline void
+dsp_cmx_rx_seen(struct dsp *dsp)
+{
+	if (dsp->rx_seen_tick != dsp_tick_seq) {
+		dsp->rx_seen_tick = dsp_tick_seq;
+		dsp->rx_seen = dsp->rx_reset;
+	}
+}
+
 /*
  * send (mixed) audio data to card and control jitter
  */
@@ -1319,7 +1749,7 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 	int tx_data_only = 0;
 
 	/* don't process if: */
-	if (!dsp->b_active) { /* if not active */
+	if (!dsp->b_active || !dsp->tx_buff) { /* if not active */
 		dsp->last_tx = 0;
 		return;
 	}
@@ -1336,12 +1766,20 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 		if (dsp->echo.software && dsp->echo.hardware)
 			tx_data_only = 1;
 	}
+	/* the other member forwards its frames, see dsp_cmx_forward() */
+	if (members == 2) {
+		other = dsp_cmx_other(dsp);
+		if (other && dsp_cmx_can_forward(other, dsp))
+			return;
+	}
 
 #ifdef CMX_DEBUG
 	printk(KERN_DEBUG
 	       "SEND members=%d dsp=%s, conf=%p, rx_R=%05x rx_W=%05x\n",
 	       members, dsp->name, conf, dsp->rx_R, dsp->rx_W);
 #endif
+	trace_misdn_cmx_tx(&dsp->ch, dsp_chnr(dsp), len,
+			   (dsp->rx_W - dsp->rx_R) & CMX_BUFF_MASK);
 
 	/* preload if we have delay set */
 	if (dsp->cmx_delay && !dsp->last_tx) {
@@ -1350,14 +1788,65 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 			preload = 128;
 	}
 
+	/*
+	 * IDLE: if there is nothing but silence to send, clone the shared
+	 * silence frame instead of allocating and filling a new one.
+	 * without echo and conference, rx-data is not sent back.
+	 */
+	if (!preload && dsp_silence_skb && len <= dsp_silence_skb->len &&
+	    (!conf || members <= 1) && /* no conf */
+	    dsp->tx_R == dsp->tx_W && /* AND no tx-data */
+	    !(dsp->tone.tone && dsp->tone.software) && /* AND no soft tones */
+	    !dsp->echo.software && !dsp->tx_data && !dsp->tx_volume &&
+	    !dsp->tx_gain &&
+	    !dsp->pipeline.inuse && !dsp->bf_enable) {
+		nskb = skb_clone(dsp_silence_skb, GFP_ATOMIC);
+		if (nskb) {
+			this_cpu_inc(dsp_tick_skbs);
+			skb_trim(nskb, len);
+			hh = mISDN_HEAD_P(nskb);
+			hh->prim = PH_DATA_REQ;
+			hh->id = 0;
+			dsp->last_tx = 1;
+			dsp_record(dsp, PH_DATA_REQ, nskb->data, len);
+			skb_queue_tail(&dsp->sendq, nskb);
+			dsp_schedule_tx(dsp);
+			return;
+		}
+	}
+
+	/*
+	 * TONE: clone the shared stream of the tone, if the samples are sent
+	 * as they are. the stream must not be altered.
+	 */
+	if (!preload && dsp->tone.tone && dsp->tone.software &&
+	    !dsp->tx_data && !dsp->tx_volume && !dsp->tx_gain &&
+	    !dsp->pipeline.inuse && !dsp->bf_enable) {
+		nskb = dsp_tone_clone(dsp, len);
+		if (nskb) {
+			this_cpu_inc(dsp_tick_skbs);
+			hh = mISDN_HEAD_P(nskb);
+			hh->prim = PH_DATA_REQ;
+			hh->id = 0;
+			dsp->last_tx = 1;
+			dsp->tx_R = 0; /* clear tx buffer */
+			dsp->tx_W = 0;
+			dsp_record(dsp, PH_DATA_REQ, nskb->data, nskb->len);
+			skb_queue_tail(&dsp->sendq, nskb);
+			dsp_schedule_tx(dsp);
+			return;
+		}
+	}
+
 	/* PREPARE RESULT */
-	nskb = mI_alloc_skb(len + preload, GFP_ATOMIC);
+	nskb = mI_alloc_audio_skb(len + preload, GFP_ATOMIC);
 	if (!nskb) {
 		printk(KERN_ERR
 		       "FATAL ERROR in mISDN_dsp.o: cannot alloc %d bytes\n",
 		       len + preload);
 		return;
 	}
+	this_cpu_inc(dsp_tick_skbs);
 	hh = mISDN_HEAD_P(nskb);
 	hh->prim = PH_DATA_REQ;
 	hh->id = 0;
@@ -1370,6 +1859,7 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 	d = skb_put(nskb, preload + len); /* result */
 	t = dsp->tx_R; /* tx-pointers */
 	tt = dsp->tx_W;
+	dsp_cmx_rx_seen(dsp);
 	r = dsp->rx_R; /* rx-pointers */
 	rr = (r + len) & CMX_BUFF_MASK;
 
@@ -1438,7 +1928,7 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 			 * or use echo only
 			 */
 			while (r != rr && t != tt) {
-				*d++ = dsp_audio_mix_law[(p[t] << 8) | q[r]];
+				*d++ = dsp_audio_mix(p[t], q[r]);
 				t = (t + 1) & CMX_BUFF_MASK;
 				r = (r + 1) & CMX_BUFF_MASK;
 			}
@@ -1462,6 +1952,7 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 		if (other == member)
 			other = (list_entry(conf->mlist.prev,
 				    struct dsp_conf_member, list))->dsp;
+		dsp_cmx_rx_seen(other);
 		o_q = other->rx_buff; /* received data */
 		o_rr = (other->rx_R + len) & CMX_BUFF_MASK;
 		/* end of rx-pointer */
@@ -1474,14 +1965,11 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 			 * if tx-data is available, mix
 			 */
 			while (o_r != o_rr && t != tt) {
-				*d++ = dsp_audio_mix_law[(p[t] << 8) | o_q[o_r]];
+				*d++ = dsp_audio_mix(p[t], o_q[o_r]);
 				t = (t + 1) & CMX_BUFF_MASK;
 				o_r = (o_r + 1) & CMX_BUFF_MASK;
 			}
-			while (o_r != o_rr) {
-				*d++ = o_q[o_r];
-				o_r = (o_r + 1) & CMX_BUFF_MASK;
-			}
+			dsp_cmx_copy(d, o_q, o_r, (o_rr - o_r) & CMX_BUFF_MASK);
 			/* -> if echo is enabled */
 		} else {
 			/*
@@ -1496,14 +1984,14 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 					sample = -32768;
 				else if (sample > 32767)
 					sample = 32767;
-				*d++ = dsp_audio_s16_to_law[sample & 0xffff];
+				*d++ = dsp_audio_s16_law(sample);
 				/* tx-data + rx_data + echo */
 				t = (t + 1) & CMX_BUFF_MASK;
 				r = (r + 1) & CMX_BUFF_MASK;
 				o_r = (o_r + 1) & CMX_BUFF_MASK;
 			}
 			while (r != rr) {
-				*d++ = dsp_audio_mix_law[(q[r] << 8) | o_q[o_r]];
+				*d++ = dsp_audio_mix(q[r], o_q[o_r]);
 				r = (r + 1) & CMX_BUFF_MASK;
 				o_r = (o_r + 1) & CMX_BUFF_MASK;
 			}
@@ -1525,21 +2013,13 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 				sample = -32768;
 			else if (sample > 32767)
 				sample = 32767;
-			*d++ = dsp_audio_s16_to_law[sample & 0xffff];
+			*d++ = dsp_audio_s16_law(sample);
 			/* conf-rx+tx */
 			r = (r + 1) & CMX_BUFF_MASK;
 			t = (t + 1) & CMX_BUFF_MASK;
 		}
-		while (r != rr) {
-			sample = *c++ - dsp_audio_law_to_s32[q[r]];
-			if (sample < -32768)
-				sample = -32768;
-			else if (sample > 32767)
-				sample = 32767;
-			*d++ = dsp_audio_s16_to_law[sample & 0xffff];
-			/* conf-rx */
-			r = (r + 1) & CMX_BUFF_MASK;
-		}
+		/* conf-rx */
+		dsp_cmx_mix_sub(d, c, q, r, (rr - r) & CMX_BUFF_MASK);
 		/* -> if echo is enabled */
 	} else {
 		/*
@@ -1552,26 +2032,20 @@ dsp_cmx_send_member(struct dsp *dsp, int len, s32 *c, int members)
 				sample = -32768;
 			else if (sample > 32767)
 				sample = 32767;
-			*d++ = dsp_audio_s16_to_law[sample & 0xffff];
+			*d++ = dsp_audio_s16_law(sample);
 			/* conf(echo)+tx */
 			t = (t + 1) & CMX_BUFF_MASK;
 			r = (r + 1) & CMX_BUFF_MASK;
 		}
-		while (r != rr) {
-			sample = *c++;
-			if (sample < -32768)
-				sample = -32768;
-			else if (sample > 32767)
-				sample = 32767;
-			*d++ = dsp_audio_s16_to_law[sample & 0xffff];
-			/* conf(echo) */
-			r = (r + 1) & CMX_BUFF_MASK;
-		}
+		/* conf(echo) */
+		dsp_cmx_mix_encode(d, c, (rr - r) & CMX_BUFF_MASK);
 	}
 	dsp->tx_R = t;
 	goto send_packet;
 
 send_packet:
+	/* record what we send, like tx-data */
+	dsp_record(dsp, PH_DATA_REQ, nskb->data + preload, len);
 	/*
 	 * send tx-data if enabled - don't filter,
 	 * because we want what we send, not what we filtered
@@ -1582,16 +2056,17 @@ send_packet:
 			hh->id = 0;
 			/* queue and trigger */
 			skb_queue_tail(&dsp->sendq, nskb);
-			schedule_work(&dsp->workq);
+			dsp_schedule_tx(dsp);
 			/* exit because only tx_data is used */
 			return;
 		} else {
-			txskb = mI_alloc_skb(len, GFP_ATOMIC);
+			txskb = mI_alloc_audio_skb(len, GFP_ATOMIC);
 			if (!txskb) {
 				printk(KERN_ERR
 				       "FATAL ERROR in mISDN_dsp.o: "
 				       "cannot alloc %d bytes\n", len);
 			} else {
+				this_cpu_inc(dsp_tick_skbs);
 				thh = mISDN_HEAD_P(txskb);
 				thh->prim = DL_DATA_REQ;
 				thh->id = 0;
@@ -1603,9 +2078,9 @@ send_packet:
 	}
 
 	/* send data only to card, if we don't just calculated tx_data */
-	/* adjust volume */
-	if (dsp->tx_volume)
-		dsp_change_volume(nskb, dsp->tx_volume);
+	/* adjust volume and gain in one pass */
+	if (dsp->tx_change)
+		dsp_change_gain(nskb, dsp->tx_change);
 	/* pipeline */
 	if (dsp->pipeline.inuse)
 		dsp_pipeline_process_tx(&dsp->pipeline, nskb->data,
@@ -1615,70 +2090,232 @@ send_packet:
 		dsp_bf_encrypt(dsp, nskb->data, nskb->len);
 	/* queue and trigger */
 	skb_queue_tail(&dsp->sendq, nskb);
-	schedule_work(&dsp->workq);
+	dsp_schedule_tx(dsp);
 }
 
 static u32	jittercount; /* counter for jitter check */
 struct timer_list dsp_spl_tl;
 unsigned long	dsp_spl_jiffies; /* calculate the next time to fire */
-static u16	dsp_count; /* last sample count */
+static struct hrtimer	dsp_spl_hrt;
+static struct tasklet_struct dsp_spl_tasklet;
+static ktime_t	dsp_spl_period; /* period of hrtimer, 0 if jiffies timer */
+static u64	dsp_count; /* last sample count */
 static int	dsp_count_valid; /* if we have last sample count */
 
-void
-dsp_cmx_send(void *arg)
+/*
+ * mix all members of a conference that requires software mixing
+ * returns the number of members mixed
+ */
+static int
+dsp_cmx_mix_conf(struct dsp_conf *conf, int length, s32 *mixbuffer)
 {
-	struct dsp_conf *conf;
 	struct dsp_conf_member *member;
 	struct dsp *dsp;
+	int members = 0;
+	u_long flags;
+
+	spin_lock_irqsave(&conf->lock, flags);
+	if (!READ_ONCE(conf->mustmix))
+		goto out;
+	/* check for hdlc conf */
+	member = list_entry(conf->mlist.next, struct dsp_conf_member, list);
+	if (member->dsp->hdlc)
+		goto out;
+	members = conf->members;
+	/* mix all data */
+	memset(mixbuffer, 0, length * sizeof(s32));
+	list_for_each_entry(member, &conf->mlist, list) {
+		dsp = member->dsp;
+		/* add member's data */
+		dsp_cmx_rx_seen(dsp);
+		dsp_cmx_mix_add(mixbuffer, dsp->rx_buff, dsp->rx_R, length);
+	}
+
+	/* process each member */
+	list_for_each_entry(member, &conf->mlist, list) {
+		/* transmission */
+		dsp_cmx_send_member(member->dsp, length, mixbuffer, members);
+	}
+out:
+	spin_unlock_irqrestore(&conf->lock, flags);
+	return members;
+}
+
+/*
+ * parallel mixing
+ *
+ * if more than one mixing cpu is configured, the tick is processed by a
+ * work item instead of the timer itself. conferences are spread over the
+ * workers by their id, each worker has its own mix buffer and is bound to
+ * its own cpu. the tick waits for all workers before the rx buffers are
+ * advanced and the timer is started again.
+ */
+struct dsp_mix_worker {
+	struct work_struct	work;
+	int			index;
+	int			cpu;
+	u_int			mixed;	/* members in this tick */
+	s32			mixbuffer[MAX_POLL + 100];
+};
+
+static struct dsp_mix_worker	*dsp_mix_workers;
+static int			dsp_mix_count; /* number of workers, 0 if off */
+static struct workqueue_struct	*dsp_mix_wq;
+static struct work_struct	dsp_tick_work;
+static atomic_t			dsp_mix_pending;
+static struct completion	dsp_mix_done;
+static int			dsp_mix_length;
+
+static void
+dsp_cmx_mix_worker(struct work_struct *work)
+{
+	struct dsp_mix_worker *w = container_of(work, struct dsp_mix_worker,
+						work);
+	struct dsp_conf *conf;
+
+	w->mixed = 0;
+	rcu_read_lock();
+	list_for_each_entry_rcu(conf, &conf_ilist, list) {
+		if (hash_32(conf->id, 16) % dsp_mix_count == w->index)
+			w->mixed += dsp_cmx_mix_conf(conf, dsp_mix_length,
+						     w->mixbuffer);
+	}
+	rcu_read_unlock();
+
+	if (atomic_dec_and_test(&dsp_mix_pending))
+		complete(&dsp_mix_done);
+}
+
+/*
+ * must not be called from atomic context
+ * returns the number of members mixed
+ */
+static u_int
+dsp_cmx_mix_parallel(int length)
+{
+	struct dsp_mix_worker *w;
+	u_int mixed = 0;
+	int i;
+
+	reinit_completion(&dsp_mix_done);
+	atomic_set(&dsp_mix_pending, dsp_mix_count);
+	dsp_mix_length = length;
+	for (i = 1; i < dsp_mix_count; i++) {
+		w = &dsp_mix_workers[i];
+		if (cpu_online(w->cpu))
+			queue_work_on(w->cpu, dsp_mix_wq, &w->work);
+		else
+			queue_work(dsp_mix_wq, &w->work);
+	}
+	/* the first share is done by us */
+	dsp_cmx_mix_worker(&dsp_mix_workers[0].work);
+	wait_for_completion(&dsp_mix_done);
+	for (i = 0; i < dsp_mix_count; i++)
+		mixed += dsp_mix_workers[i].mixed;
+	return mixed;
+}
+
+/*
+ * receive the samples of the rx ring of the card (DSP_OPT_RX_RING), once per
+ * tick. the frame is kept for the next tick, unless it was sent up.
+ */
+static void
+dsp_cmx_rx_ring(struct dsp *dsp, struct mISDN_rx_ring *ring)
+{
+	struct sk_buff *skb = dsp->rx_ring_skb;
+	struct mISDNhead *hh;
+	int len;
+
+	if (!skb) {
+		skb = mI_alloc_audio_skb(MISDN_AUDIO_SKB_LEN, GFP_ATOMIC);
+		if (!skb)
+			return;
+	}
+	len = min_t(int, skb_tailroom(skb), CMX_BUFF_HALF - 1);
+	len = mISDN_rx_ring_get(ring, skb_tail_pointer(skb), len);
+	if (len) {
+		skb_put(skb, len);
+		hh = mISDN_HEAD_P(skb);
+		hh->prim = PH_DATA_IND;
+		hh->id = 0;
+		skb = dsp_rx_audio(dsp, skb);
+		if (skb)
+			skb_trim(skb, 0);
+	}
+	dsp->rx_ring_skb = skb;
+}
+
+static void
+dsp_cmx_tick(void)
+{
+	struct dsp_conf *conf;
+	struct dsp *dsp;
+	struct mISDN_rx_ring *ring;
 	int mustmix, members;
 	static s32 mixbuffer[MAX_POLL + 100];
-	s32 *c;
 	u8 *p, *q;
 	int r, rr;
 	int jittercheck = 0, delay, i;
+	u32 jitterinterval;
 	u_long flags;
-	u16 length, count;
-
-	/* lock */
-	spin_lock_irqsave(&dsp_lock, flags);
+	spinlock_t *lock;
+	u16 length;
+	u64 count, start = ktime_get_ns();
+	u_int sw = 0, hw = 0;
 
+	/*
+	 * the sample count, the jitter counter and the mixbuffer are only used
+	 * by the tick, so dsp_lock is not required. each dsp and conf is
+	 * locked on its own, so receive on one span does not stall the tick.
+	 */
 	if (!dsp_count_valid) {
-		dsp_count = mISDN_clock_get();
+		dsp_count = mISDN_clock_get64();
 		length = dsp_poll;
 		dsp_count_valid = 1;
 	} else {
-		count = mISDN_clock_get();
-		length = count - dsp_count;
+		count = mISDN_clock_get64();
+		length = min_t(u64, count - dsp_count, MAX_POLL + 100);
 		dsp_count = count;
 	}
 	if (length > MAX_POLL + 100)
 		length = MAX_POLL + 100;
-	/* printk(KERN_DEBUG "len=%d dsp_count=0x%x\n", length, dsp_count); */
+	/* printk(KERN_DEBUG "len=%d dsp_count=0x%llx\n", length, dsp_count); */
+	dsp_tick_seq++;
 
 	/*
-	 * check if jitter needs to be checked (this is every second)
+	 * check if jitter needs to be checked (this is every second, or
+	 * every 1/8 second with adaptive jitter buffer)
 	 */
 	jittercount += length;
-	if (jittercount >= 8000) {
-		jittercount -= 8000;
+	jitterinterval = (dsp_options & DSP_OPT_ADAPTIVE) ?
+		CMX_JITTER_ADAPTIVE : CMX_JITTER_INTERVAL;
+	if (jittercount >= jitterinterval) {
+		jittercount -= jitterinterval;
 		jittercheck = 1;
 	}
 
+	rcu_read_lock();
+
+	/* read the rx rings first, so their samples are sent in this tick */
+	list_for_each_entry_rcu(dsp, &dsp_ilist, list) {
+		ring = READ_ONCE(dsp->rx_ring);
+		if (ring)
+			dsp_cmx_rx_ring(dsp, ring);
+	}
+
 	/* loop all members that do not require conference mixing */
-	list_for_each_entry(dsp, &dsp_ilist, list) {
+	list_for_each_entry_rcu(dsp, &dsp_ilist, list) {
 		if (dsp->hdlc)
 			continue;
+		lock = dsp_lock_data(dsp, &flags);
 		conf = dsp->conf;
 		mustmix = 0;
 		members = 0;
 		if (conf) {
-			members = count_list_member(&conf->mlist);
-#ifdef CMX_CONF_DEBUG
-			if (conf->software && members > 1)
-#else
-				if (conf->software && members > 2)
-#endif
-					mustmix = 1;
+			members = conf->members;
+			mustmix = READ_ONCE(conf->mustmix);
+			if (conf->hardware)
+				hw++;
 		}
 
 		/* transmission required */
@@ -1690,168 +2327,304 @@ dsp_cmx_send(void *arg)
 			 * potential null-pointer-bug
 			 */
 		}
+		spin_unlock_irqrestore(lock, flags);
 	}
 
 	/* loop all members that require conference mixing */
-	list_for_each_entry(conf, &conf_ilist, list) {
-		/* count members and check hardware */
-		members = count_list_member(&conf->mlist);
-#ifdef CMX_CONF_DEBUG
-		if (conf->software && members > 1) {
-#else
-			if (conf->software && members > 2) {
-#endif
-				/* check for hdlc conf */
-				member = list_entry(conf->mlist.next,
-						    struct dsp_conf_member, list);
-				if (member->dsp->hdlc)
-					continue;
-				/* mix all data */
-				memset(mixbuffer, 0, length * sizeof(s32));
-				list_for_each_entry(member, &conf->mlist, list) {
-					dsp = member->dsp;
-					/* get range of data to mix */
-					c = mixbuffer;
-					q = dsp->rx_buff;
-					r = dsp->rx_R;
-					rr = (r + length) & CMX_BUFF_MASK;
-					/* add member's data */
-					while (r != rr) {
-						*c++ += dsp_audio_law_to_s32[q[r]];
-						r = (r + 1) & CMX_BUFF_MASK;
-					}
-				}
+	if (dsp_mix_count) {
+		rcu_read_unlock();
+		sw = dsp_cmx_mix_parallel(length);
+		rcu_read_lock();
+	} else {
+		list_for_each_entry_rcu(conf, &conf_ilist, list)
+			sw += dsp_cmx_mix_conf(conf, length, mixbuffer);
+	}
 
-				/* process each member */
-				list_for_each_entry(member, &conf->mlist, list) {
-					/* transmission */
-					dsp_cmx_send_member(member->dsp, length,
-							    mixbuffer, members);
-				}
+	/* delete rx-data, increment buffers, change pointers */
+	list_for_each_entry_rcu(dsp, &dsp_ilist, list) {
+		if (dsp->hdlc)
+			continue;
+		lock = dsp_lock_data(dsp, &flags);
+		/* switch hardware tone patterns */
+		if (dsp->tone.hardware)
+			dsp_tone_clock(dsp, length);
+		if (!dsp->rx_buff) {
+			spin_unlock_irqrestore(lock, flags);
+			continue;
+		}
+		p = dsp->rx_buff;
+		q = dsp->tx_buff;
+		r = dsp->rx_R;
+		/*
+		 * move receive pointer when receiving, unless rx_begin has
+		 * reset it since this tick read the ring
+		 */
+		if (!dsp->rx_is_off && (dsp->rx_seen_tick != dsp_tick_seq ||
+					dsp->rx_seen == dsp->rx_reset)) {
+			rr = (r + length) & CMX_BUFF_MASK;
+			/* delete rx-data */
+			while (r != rr) {
+				p[r] = dsp_silence;
+				r = (r + 1) & CMX_BUFF_MASK;
 			}
+			/* increment rx-buffer pointer */
+			dsp->rx_R = r; /* write incremented read pointer */
 		}
 
-		/* delete rx-data, increment buffers, change pointers */
-		list_for_each_entry(dsp, &dsp_ilist, list) {
-			if (dsp->hdlc)
-				continue;
-			p = dsp->rx_buff;
-			q = dsp->tx_buff;
-			r = dsp->rx_R;
-			/* move receive pointer when receiving */
-			if (!dsp->rx_is_off) {
-				rr = (r + length) & CMX_BUFF_MASK;
+		/* check current rx_delay */
+		delay = (dsp->rx_W-dsp->rx_R) & CMX_BUFF_MASK;
+		if (delay >= CMX_BUFF_HALF)
+			delay = 0; /* will be the delay before next write */
+		dsp->rx_cur_delay = delay;
+		/* check for lower delay */
+		if (delay < dsp->rx_delay[0])
+			dsp->rx_delay[0] = delay;
+		/* check current tx_delay */
+		delay = (dsp->tx_W-dsp->tx_R) & CMX_BUFF_MASK;
+		if (delay >= CMX_BUFF_HALF)
+			delay = 0; /* will be the delay before next write */
+		dsp->tx_cur_delay = delay;
+		/* check for lower delay */
+		if (delay < dsp->tx_delay[0])
+			dsp->tx_delay[0] = delay;
+		if (jittercheck) {
+			/* find the lowest of all rx_delays */
+			delay = dsp->rx_delay[0];
+			i = 1;
+			while (i < MAX_SECONDS_JITTER_CHECK) {
+				if (delay > dsp->rx_delay[i])
+					delay = dsp->rx_delay[i];
+				i++;
+			}
+			/*
+			 * remove rx_delay only if we have delay AND we
+			 * have not preset cmx_delay AND
+			 * the delay is greater dsp_poll
+			 */
+			if (delay > dsp_poll && !dsp->cmx_delay) {
+				if (dsp_debug & DEBUG_DSP_CLOCK)
+					printk(KERN_DEBUG
+					       "%s lowest rx_delay of %d bytes for"
+					       " dsp %s are now removed.\n",
+					       __func__, delay,
+					       dsp->name);
+				r = dsp->rx_R;
+				rr = (r + delay - (dsp_poll >> 1))
+					& CMX_BUFF_MASK;
 				/* delete rx-data */
 				while (r != rr) {
 					p[r] = dsp_silence;
 					r = (r + 1) & CMX_BUFF_MASK;
 				}
 				/* increment rx-buffer pointer */
-				dsp->rx_R = r; /* write incremented read pointer */
+				dsp->rx_R = r;
+				/* write incremented read pointer */
 			}
-
-			/* check current rx_delay */
-			delay = (dsp->rx_W-dsp->rx_R) & CMX_BUFF_MASK;
-			if (delay >= CMX_BUFF_HALF)
-				delay = 0; /* will be the delay before next write */
-			/* check for lower delay */
-			if (delay < dsp->rx_delay[0])
-				dsp->rx_delay[0] = delay;
-			/* check current tx_delay */
-			delay = (dsp->tx_W-dsp->tx_R) & CMX_BUFF_MASK;
-			if (delay >= CMX_BUFF_HALF)
-				delay = 0; /* will be the delay before next write */
-			/* check for lower delay */
-			if (delay < dsp->tx_delay[0])
-				dsp->tx_delay[0] = delay;
-			if (jittercheck) {
-				/* find the lowest of all rx_delays */
-				delay = dsp->rx_delay[0];
-				i = 1;
-				while (i < MAX_SECONDS_JITTER_CHECK) {
-					if (delay > dsp->rx_delay[i])
-						delay = dsp->rx_delay[i];
-					i++;
-				}
-				/*
-				 * remove rx_delay only if we have delay AND we
-				 * have not preset cmx_delay AND
-				 * the delay is greater dsp_poll
-				 */
-				if (delay > dsp_poll && !dsp->cmx_delay) {
-					if (dsp_debug & DEBUG_DSP_CLOCK)
-						printk(KERN_DEBUG
-						       "%s lowest rx_delay of %d bytes for"
-						       " dsp %s are now removed.\n",
-						       __func__, delay,
-						       dsp->name);
-					r = dsp->rx_R;
-					rr = (r + delay - (dsp_poll >> 1))
-						& CMX_BUFF_MASK;
-					/* delete rx-data */
-					while (r != rr) {
-						p[r] = dsp_silence;
-						r = (r + 1) & CMX_BUFF_MASK;
-					}
-					/* increment rx-buffer pointer */
-					dsp->rx_R = r;
-					/* write incremented read pointer */
-				}
-				/* find the lowest of all tx_delays */
-				delay = dsp->tx_delay[0];
-				i = 1;
-				while (i < MAX_SECONDS_JITTER_CHECK) {
-					if (delay > dsp->tx_delay[i])
-						delay = dsp->tx_delay[i];
-					i++;
-				}
-				/*
-				 * remove delay only if we have delay AND we
-				 * have enabled tx_dejitter
-				 */
-				if (delay > dsp_poll && dsp->tx_dejitter) {
-					if (dsp_debug & DEBUG_DSP_CLOCK)
-						printk(KERN_DEBUG
-						       "%s lowest tx_delay of %d bytes for"
-						       " dsp %s are now removed.\n",
-						       __func__, delay,
-						       dsp->name);
-					r = dsp->tx_R;
-					rr = (r + delay - (dsp_poll >> 1))
-						& CMX_BUFF_MASK;
-					/* delete tx-data */
-					while (r != rr) {
-						q[r] = dsp_silence;
-						r = (r + 1) & CMX_BUFF_MASK;
-					}
-					/* increment rx-buffer pointer */
-					dsp->tx_R = r;
-					/* write incremented read pointer */
-				}
-				/* scroll up delays */
-				i = MAX_SECONDS_JITTER_CHECK - 1;
-				while (i) {
-					dsp->rx_delay[i] = dsp->rx_delay[i - 1];
-					dsp->tx_delay[i] = dsp->tx_delay[i - 1];
-					i--;
+			/* find the lowest of all tx_delays */
+			delay = dsp->tx_delay[0];
+			i = 1;
+			while (i < MAX_SECONDS_JITTER_CHECK) {
+				if (delay > dsp->tx_delay[i])
+					delay = dsp->tx_delay[i];
+				i++;
+			}
+			/*
+			 * remove delay only if we have delay AND we
+			 * have enabled tx_dejitter
+			 */
+			if (delay > dsp_poll && dsp->tx_dejitter) {
+				if (dsp_debug & DEBUG_DSP_CLOCK)
+					printk(KERN_DEBUG
+					       "%s lowest tx_delay of %d bytes for"
+					       " dsp %s are now removed.\n",
+					       __func__, delay,
+					       dsp->name);
+				r = dsp->tx_R;
+				rr = (r + delay - (dsp_poll >> 1))
+					& CMX_BUFF_MASK;
+				/* delete tx-data */
+				while (r != rr) {
+					q[r] = dsp_silence;
+					r = (r + 1) & CMX_BUFF_MASK;
 				}
-				dsp->tx_delay[0] = CMX_BUFF_HALF; /* (infinite) delay */
-				dsp->rx_delay[0] = CMX_BUFF_HALF; /* (infinite) delay */
+				/* increment rx-buffer pointer */
+				dsp->tx_R = r;
+				/* write incremented read pointer */
 			}
+			/* scroll up delays */
+			i = MAX_SECONDS_JITTER_CHECK - 1;
+			while (i) {
+				dsp->rx_delay[i] = dsp->rx_delay[i - 1];
+				dsp->tx_delay[i] = dsp->tx_delay[i - 1];
+				i--;
+			}
+			dsp->tx_delay[0] = CMX_BUFF_HALF; /* (infinite) delay */
+			dsp->rx_delay[0] = CMX_BUFF_HALF; /* (infinite) delay */
 		}
+		spin_unlock_irqrestore(lock, flags);
+	}
 
-		/* if next event would be in the past ... */
-		if ((s32)(dsp_spl_jiffies + dsp_tics-jiffies) <= 0)
-			dsp_spl_jiffies = jiffies + 1;
-		else
-			dsp_spl_jiffies += dsp_tics;
+	rcu_read_unlock();
 
-		dsp_spl_tl.expires = dsp_spl_jiffies;
-		add_timer(&dsp_spl_tl);
+	dsp_cmx_tick_account(ktime_get_ns() - start, length, sw, hw);
+}
 
-		/* unlock */
-		spin_unlock_irqrestore(&dsp_lock, flags);
+static void
+dsp_cmx_tick_work(struct work_struct *work)
+{
+	dsp_cmx_tick();
+}
+
+void
+dsp_cmx_send(void *arg)
+{
+	if (!dsp_mix_count) {
+		dsp_cmx_tick();
+		return;
 	}
+	queue_work(dsp_mix_wq, &dsp_tick_work);
+}
+
+/*
+ * only the timers rearm themselves, the tick never does. so the clock runs
+ * one way: timer -> tasklet (hrtimer only) -> tick work (parallel mixing
+ * only) -> tick, and dsp_cmx_clock_stop() can stop it in that order.
+ */
+static void
+dsp_cmx_timer(unsigned long data)
+{
+	/* if next event would be in the past ... */
+	if ((s32)(dsp_spl_jiffies + dsp_tics-jiffies) <= 0)
+		dsp_spl_jiffies = jiffies + 1;
+	else
+		dsp_spl_jiffies += dsp_tics;
+
+	dsp_spl_tl.expires = dsp_spl_jiffies;
+	add_timer(&dsp_spl_tl);
+
+	dsp_cmx_send(NULL);
+}
+
+/*
+ * the hrtimer fires in hard irq context, so the tick is run from a tasklet,
+ * just like it is run from the softirq of the jiffies timer.
+ */
+static enum hrtimer_restart
+dsp_cmx_hrtimer(struct hrtimer *timer)
+{
+	hrtimer_forward_now(timer, dsp_spl_period);
+	tasklet_schedule(&dsp_spl_tasklet);
+	return HRTIMER_RESTART;
+}
+
+static void
+dsp_cmx_tasklet(unsigned long data)
+{
+	dsp_cmx_send(NULL);
+}
+
+/*
+ * start the sample clock. if period_us is set, a high resolution timer
+ * fires every period_us microseconds, otherwise the jiffies timer fires
+ * every dsp_tics.
+ */
+void
+dsp_cmx_clock_start(int period_us)
+{
+	if (period_us) {
+		dsp_spl_period = ktime_set(0, period_us * NSEC_PER_USEC);
+		tasklet_init(&dsp_spl_tasklet, dsp_cmx_tasklet, 0);
+		hrtimer_init(&dsp_spl_hrt, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		dsp_spl_hrt.function = dsp_cmx_hrtimer;
+		hrtimer_start(&dsp_spl_hrt, dsp_spl_period, HRTIMER_MODE_REL);
+		return;
+	}
+
+	dsp_spl_tl.function = dsp_cmx_timer;
+	dsp_spl_tl.data = 0;
+	init_timer(&dsp_spl_tl);
+	dsp_spl_tl.expires = jiffies + dsp_tics;
+	dsp_spl_jiffies = dsp_spl_tl.expires;
+	add_timer(&dsp_spl_tl);
+}
+
+/*
+ * stop the sample clock, in the order the tick is started:
+ * 1. cancel the timer, the sync variants wait for a handler that rearms it
+ * 2. kill the tasklet, nothing schedules it anymore
+ * 3. wait for the tick work, nothing queues it anymore. the tick waits for
+ *    its mixing workers, so none of them is left running.
+ * this is called once, when the module is unloaded.
+ */
+void
+dsp_cmx_clock_stop(void)
+{
+	if (dsp_spl_period) {
+		hrtimer_cancel(&dsp_spl_hrt);
+		tasklet_kill(&dsp_spl_tasklet);
+	} else
+		del_timer_sync(&dsp_spl_tl);
+	if (dsp_mix_count)
+		cancel_work_sync(&dsp_tick_work);
+}
+
+/*
+ * enable parallel mixing on the given number of cpus.
+ * on failure the tick stays on a single cpu.
+ */
+int
+dsp_cmx_parallel_init(int cpus)
+{
+	int i, cpu;
+
+	if (cpus > num_online_cpus())
+		cpus = num_online_cpus();
+	if (cpus <= 1)
+		return 0;
+
+	dsp_mix_workers = kcalloc(cpus, sizeof(struct dsp_mix_worker),
+				  GFP_KERNEL);
+	if (!dsp_mix_workers) {
+		printk(KERN_ERR "kcalloc struct dsp_mix_worker failed\n");
+		return -ENOMEM;
+	}
+	dsp_mix_wq = alloc_workqueue("mISDN_dsp_mix", WQ_HIGHPRI, 0);
+	if (!dsp_mix_wq) {
+		printk(KERN_ERR "%s: cannot create workqueue\n", __func__);
+		kfree(dsp_mix_workers);
+		dsp_mix_workers = NULL;
+		return -ENOMEM;
+	}
+	i = 0;
+	for_each_online_cpu(cpu) {
+		if (i == cpus)
+			break;
+		INIT_WORK(&dsp_mix_workers[i].work, dsp_cmx_mix_worker);
+		dsp_mix_workers[i].index = i;
+		dsp_mix_workers[i].cpu = cpu;
+		i++;
+	}
+	INIT_WORK(&dsp_tick_work, dsp_cmx_tick_work);
+	init_completion(&dsp_mix_done);
+	dsp_mix_count = i;
+
+	printk(KERN_INFO "mISDN_dsp: conferences are mixed on %d cpus.\n",
+	       dsp_mix_count);
+	return 0;
+}
+
+/* must be called after the sample clock is stopped */
+void
+dsp_cmx_parallel_exit(void)
+{
+	if (!dsp_mix_count)
+		return;
+
+	destroy_workqueue(dsp_mix_wq);
+	kfree(dsp_mix_workers);
+	dsp_mix_workers = NULL;
+	dsp_mix_count = 0;
+}
 
 /*
  * audio data is transmitted from upper layer to the dsp
@@ -1866,6 +2639,10 @@ dsp_cmx_send(void *arg)
 		char debugbuf[256] = "";
 #endif
 
+		/* no rings, if the channel is not active */
+		if (!dsp->tx_buff)
+			return;
+
 		/* check if there is enough space, and then copy */
 		w = dsp->tx_W;
 		ww = dsp->tx_R;
@@ -1876,6 +2653,7 @@ dsp_cmx_send(void *arg)
 		if (space < skb->len) {
 			/* write to the space we have left */
 			ww = (ww - 1) & CMX_BUFF_MASK; /* end one byte prior tx_R */
+			dsp->tx_overflow++;
 			if (dsp_debug & DEBUG_DSP_CLOCK)
 				printk(KERN_DEBUG "%s: TX overflow space=%d skb->len="
 				       "%d, w=0x%04x, ww=0x%04x\n", __func__, space,
@@ -1938,7 +2716,7 @@ dsp_cmx_send(void *arg)
 					hh->prim = PH_DATA_REQ;
 					hh->id = 0;
 					skb_queue_tail(&dsp->sendq, nskb);
-					schedule_work(&dsp->workq);
+					dsp_schedule_tx(dsp);
 				}
 			}
 			return;
@@ -0,0 +1,110 @@
+/*
+ * dsp_cmx_mix.h
+ *
+ * mixing kernels of dsp_cmx.c, in a header of their own, so dspbench can
+ * measure them in user space.
+ *
+ * This software may be used and distributed according to the terms
+ * of the GNU General Public License, incorporated herein by reference.
+ *
+ */
+
+#ifndef _DSP_CMX_MIX_H
+#define _DSP_CMX_MIX_H
+
+/*
+ * mixing kernels
+ *
+ * the ring buffers are processed in linear segments, split where the ring
+ * wraps, so the inner loops run without masking the index and can be
+ * unrolled by the compiler. they stay scalar: each sample is converted
+ * twice by table lookups, from law and back through the 64k table, and
+ * vector code could only replace them by gathers, which are not faster
+ * than the loads they replace. a two party frame takes 270..470 cycles
+ * (dspbench mix2), about two fpu sections (see oslec_simd.c).
+ * the loops that mix tx-data are kept sample by sample, because tx-data and
+ * rx-data may end at different positions.
+ */
+static inline int
+dsp_cmx_segment(int r, int len)
+{
+	int n = CMX_BUFF_SIZE - r;
+
+	return (len < n) ? len : n;
+}
+
+static inline u8
+dsp_cmx_encode(s32 sample)
+{
+	if (sample < -32768)
+		sample = -32768;
+	else if (sample > 32767)
+		sample = 32767;
+	return dsp_audio_s16_law(sample);
+}
+
+/* add len samples of a member's ring, starting at r, to the conf-data */
+static inline void
+dsp_cmx_mix_add(s32 *c, const u8 *q, int r, int len)
+{
+	const s32 *law = dsp_audio_law_to_s32;
+	const u8 *s;
+	int n, i;
+
+	while (len) {
+		n = dsp_cmx_segment(r, len);
+		s = q + r;
+		for (i = 0; i < n; i++)
+			c[i] += law[s[i]];
+		c += n;
+		len -= n;
+		r = (r + n) & CMX_BUFF_MASK;
+	}
+}
+
+/* encode conf-data without a member's own rx-data (starting at r) */
+static inline void
+dsp_cmx_mix_sub(u8 *d, const s32 *c, const u8 *q, int r, int len)
+{
+	const s32 *law = dsp_audio_law_to_s32;
+	const u8 *s;
+	int n, i;
+
+	while (len) {
+		n = dsp_cmx_segment(r, len);
+		s = q + r;
+		for (i = 0; i < n; i++)
+			d[i] = dsp_cmx_encode(c[i] - law[s[i]]);
+		d += n;
+		c += n;
+		len -= n;
+		r = (r + n) & CMX_BUFF_MASK;
+	}
+}
+
+/* encode conf-data */
+static inline void
+dsp_cmx_mix_encode(u8 *d, const s32 *c, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		d[i] = dsp_cmx_encode(c[i]);
+}
+
+/* copy len samples of a ring, starting at r */
+static inline void
+dsp_cmx_copy(u8 *d, const u8 *q, int r, int len)
+{
+	int n;
+
+	while (len) {
+		n = dsp_cmx_segment(r, len);
+		memcpy(d, q + r, n);
+		d += n;
+		len -= n;
+		r = (r + n) & CMX_BUFF_MASK;
+	}
+}
+
+#endif
@@ -136,13 +136,21 @@
  *
  * LOCKING:
  *
- * When data is received from upper or lower layer (card), the complete dsp
- * module is locked by a global lock.  This lock MUST lock irq, because it
- * must lock timer events by DSP poll timer.
+ * Configuration (PH_CONTROL, activation, creation and release of instances,
+ * joining and splitting conferences) is locked by the global dsp_lock.
+ * The lists of instances and conferences are only changed while holding it.
+ * When data is received from upper or lower layer (card), only the data path
+ * of the instance is locked: each dsp has its own lock, and members of a
+ * conference share the lock of their conference (see dsp_lock_data()).
+ * The DSP poll timer walks the lists using rcu and takes the same locks for
+ * each instance and each conference it processes, so data of one span does
+ * not block an unrelated conference. All these locks MUST lock irq.
+ * The lock order is: dsp_lock, conf->lock, dsp->lock.
  * When data is ready to be transmitted down, the data is queued and sent
  * outside lock and timer event.
- * PH_CONTROL must not change any settings, join or split conference members
- * during process of data.
+ * PH_CONTROL holds the data lock while changing settings used by the data
+ * path, except when joining or splitting conferences, which takes the locks
+ * itself.
  *
  * HDLC:
  *
@@ -159,6 +167,7 @@
 #include <linux/mISDNdsp.h>
 #include <linux/module.h>
 #include <linux/vmalloc.h>
+#include <trace/events/misdn.h>
 #include "core.h"
 #include "dsp.h"
 
@@ -168,12 +177,21 @@ static int debug;
 static int options;
 static int poll;
 static int dtmfthreshold = 100;
+static int mixcpus;
+static int buffsize;
+static int hrperiod;
+static int dsp_irqcpu = 1;
 
 MODULE_AUTHOR("Andreas Eversberg");
 module_param(debug, uint, S_IRUGO | S_IWUSR);
 module_param(options, uint, S_IRUGO | S_IWUSR);
 module_param(poll, uint, S_IRUGO | S_IWUSR);
 module_param(dtmfthreshold, uint, S_IRUGO | S_IWUSR);
+module_param(mixcpus, uint, S_IRUGO);
+module_param(buffsize, uint, S_IRUGO);
+module_param(hrperiod, uint, S_IRUGO);
+module_param_named(irqcpu, dsp_irqcpu, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(irqcpu, "send on the cpu of the interrupt of the card");
 MODULE_LICENSE("GPL");
 
 /*int spinnest = 0;*/
@@ -184,6 +202,23 @@ struct list_head conf_ilist;
 int dsp_debug;
 int dsp_options;
 int dsp_poll, dsp_tics;
+int dsp_buff_size = CMX_BUFF_MAX;
+
+/*
+ * the queued frames are sent by the work of the dsp on the cpu, where the
+ * card delivered the last received frame, so the data of the channel stays
+ * on the cpus local to the interrupt of the card
+ */
+void
+dsp_schedule_tx(struct dsp *dsp)
+{
+	int	cpu = READ_ONCE(dsp->cpu);
+
+	if (dsp_irqcpu && cpu >= 0 && cpu_online(cpu))
+		queue_work_on(cpu, system_wq, &dsp->workq);
+	else
+		schedule_work(&dsp->workq);
+}
 
 /* check if rx may be turned off or must be turned on */
 static void
@@ -198,7 +233,7 @@ dsp_rx_off_member(struct dsp *dsp)
 		return;
 
 	/* not disabled */
-	if (!dsp->rx_disabled)
+	if (!dsp->rx_disabled && !dsp->rx_congested)
 		rx_off = 0;
 	/* software dtmf */
 	else if (dsp->dtmf.software)
@@ -209,6 +244,9 @@ dsp_rx_off_member(struct dsp *dsp)
 	/* bridge in software */
 	else if (dsp->conf && dsp->conf->software)
 		rx_off = 0;
+	/* recording */
+	else if (dsp->record_id)
+		rx_off = 0;
 	/* data is not required by user space and not required
 	 * for echo dtmf detection, soft-echo, soft-bridging */
 
@@ -279,6 +317,45 @@ dsp_fill_empty(struct dsp *dsp)
 		       __func__, dsp->name);
 }
 
+/* after a change of volume or gain, see dsp_audio_change_table */
+static void
+dsp_change_tables(struct dsp *dsp)
+{
+	dsp->tx_change = dsp_audio_change_table(dsp->tx_change_table,
+						dsp->tx_volume, dsp->tx_gain,
+						dsp->tx_gain_table);
+	dsp->rx_change = dsp_audio_change_table(dsp->rx_change_table,
+						dsp->rx_volume, dsp->rx_gain,
+						dsp->rx_gain_table);
+}
+
+/* set the duration of the receive frames of the card (DSP_RX_FRAME) */
+static int
+dsp_rx_frame(struct dsp *dsp, int ms)
+{
+	struct mISDN_ctrl_req	cq;
+
+	if (!dsp->ch.peer) {
+		if (dsp_debug & DEBUG_DSP_CORE)
+			printk(KERN_DEBUG "%s: no peer, no rx_frame\n",
+			       __func__);
+		return -EINVAL;
+	}
+	memset(&cq, 0, sizeof(cq));
+	cq.op = MISDN_CTRL_RX_COALESCE;
+	cq.p1 = ms;
+	cq.p2 = MISDN_CTRL_RX_SIZE_IGNORE;
+	if (dsp->ch.peer->ctrl(dsp->ch.peer, CONTROL_CHANNEL, &cq)) {
+		printk(KERN_DEBUG "%s: CONTROL_CHANNEL failed\n",
+		       __func__);
+		return -EINVAL;
+	}
+	if (dsp_debug & DEBUG_DSP_CORE)
+		printk(KERN_DEBUG "%s: %s set rx frame = %d ms\n",
+		       __func__, dsp->name, ms);
+	return 0;
+}
+
 static int
 dsp_control_req(struct dsp *dsp, struct mISDNhead *hh, struct sk_buff *skb)
 {
@@ -287,6 +364,8 @@ dsp_control_req(struct dsp *dsp, struct mISDNhead *hh, struct sk_buff *skb)
 	int cont;
 	u8 *data;
 	int len;
+	spinlock_t *lock = NULL;
+	u_long flags;
 
 	if (skb->len < sizeof(int)) {
 		printk(KERN_ERR "%s: PH_CONTROL message too short\n", __func__);
@@ -296,6 +375,10 @@ dsp_control_req(struct dsp *dsp, struct mISDNhead *hh, struct sk_buff *skb)
 	len = skb->len - sizeof(int);
 	data = skb->data + sizeof(int);
 
+	/* joining and splitting conferences takes the data locks itself */
+	if (cont != DSP_CONF_JOIN && cont != DSP_CONF_SPLIT)
+		lock = dsp_lock_data(dsp, &flags);
+
 	switch (cont) {
 	case DTMF_TONE_START: /* turn on DTMF */
 		if (dsp->hdlc) {
@@ -396,6 +479,7 @@ dsp_control_req(struct dsp *dsp, struct mISDNhead *hh, struct sk_buff *skb)
 			break;
 		}
 		dsp->tx_volume = *((int *)data);
+		dsp_change_tables(dsp);
 		if (dsp_debug & DEBUG_DSP_CORE)
 			printk(KERN_DEBUG "%s: change tx vol to %d\n",
 			       __func__, dsp->tx_volume);
@@ -413,6 +497,7 @@ dsp_control_req(struct dsp *dsp, struct mISDNhead *hh, struct sk_buff *skb)
 			break;
 		}
 		dsp->rx_volume = *((int *)data);
+		dsp_change_tables(dsp);
 		if (dsp_debug & DEBUG_DSP_CORE)
 			printk(KERN_DEBUG "%s: change rx vol to %d\n",
 			       __func__, dsp->tx_volume);
@@ -420,6 +505,85 @@ dsp_control_req(struct dsp *dsp, struct mISDNhead *hh, struct sk_buff *skb)
 		dsp_dtmf_hardware(dsp);
 		dsp_rx_off(dsp);
 		break;
+	case DSP_GAIN_TX: /* change gain in 0.5 dB steps */
+		if (dsp->hdlc) {
+			ret = -EINVAL;
+			break;
+		}
+		if (len < sizeof(int)) {
+			ret = -EINVAL;
+			break;
+		}
+		if (*((int *)data) > DSP_GAIN_MAX ||
+		    *((int *)data) < -DSP_GAIN_MAX) {
+			ret = -EINVAL;
+			break;
+		}
+		dsp_audio_generate_gain(dsp->tx_gain_table, *((int *)data));
+		dsp->tx_gain = *((int *)data);
+		dsp_change_tables(dsp);
+		if (dsp_debug & DEBUG_DSP_CORE)
+			printk(KERN_DEBUG "%s: change tx gain to %d/2 dB\n",
+			       __func__, dsp->tx_gain);
+		dsp_cmx_hardware(dsp->conf, dsp);
+		dsp_dtmf_hardware(dsp);
+		dsp_rx_off(dsp);
+		break;
+	case DSP_GAIN_RX: /* change gain in 0.5 dB steps */
+		if (dsp->hdlc) {
+			ret = -EINVAL;
+			break;
+		}
+		if (len < sizeof(int)) {
+			ret = -EINVAL;
+			break;
+		}
+		if (*((int *)data) > DSP_GAIN_MAX ||
+		    *((int *)data) < -DSP_GAIN_MAX) {
+			ret = -EINVAL;
+			break;
+		}
+		dsp_audio_generate_gain(dsp->rx_gain_table, *((int *)data));
+		dsp->rx_gain = *((int *)data);
+		dsp_change_tables(dsp);
+		if (dsp_debug & DEBUG_DSP_CORE)
+			printk(KERN_DEBUG "%s: change rx gain to %d/2 dB\n",
+			       __func__, dsp->rx_gain);
+		dsp_cmx_hardware(dsp->conf, dsp);
+		dsp_dtmf_hardware(dsp);
+		dsp_rx_off(dsp);
+		break;
+	case DSP_RX_FRAME: /* duration of rx frames in ms, 0 = default */
+		if (dsp->hdlc) {
+			ret = -EINVAL;
+			break;
+		}
+		if (len < sizeof(int) || *((int *)data) < 0) {
+			ret = -EINVAL;
+			break;
+		}
+		ret = dsp_rx_frame(dsp, *((int *)data));
+		break;
+	case DSP_RECORD_ON: /* tap the audio for a recorder (IMDSPRECORD) */
+		if (dsp->hdlc || len < sizeof(int) || *((int *)data) <= 0) {
+			ret = -EINVAL;
+			break;
+		}
+		dsp_record_off(dsp);
+		dsp->record_id = *((int *)data);
+		if (dsp_debug & DEBUG_DSP_CORE)
+			printk(KERN_DEBUG "%s: record id %d\n", __func__,
+			       dsp->record_id);
+		dsp_cmx_hardware(dsp->conf, dsp);
+		dsp_rx_off(dsp);
+		break;
+	case DSP_RECORD_OFF:
+		dsp_record_off(dsp);
+		if (dsp_debug & DEBUG_DSP_CORE)
+			printk(KERN_DEBUG "%s: record off\n", __func__);
+		dsp_cmx_hardware(dsp->conf, dsp);
+		dsp_rx_off(dsp);
+		break;
 	case DSP_ECHO_ON: /* enable echo */
 		dsp->echo.software = 1; /* soft echo */
 		if (dsp_debug & DEBUG_DSP_CORE)
@@ -621,6 +785,8 @@ dsp_control_req(struct dsp *dsp, struct mISDNhead *hh, struct sk_buff *skb)
 			       __func__, cont);
 		ret = -EINVAL;
 	}
+	if (lock)
+		spin_unlock_irqrestore(lock, flags);
 	return ret;
 }
 
@@ -647,6 +813,8 @@ get_features(struct mISDNchannel *ch)
 		dsp->features_rx_off = 1;
 	if (cq.op & MISDN_CTRL_FILL_EMPTY)
 		dsp->features_fill_empty = 1;
+	if (test_bit(OPTION_RX_RING, &ch->peer->opt))
+		dsp->features_rx_ring = 1;
 	if (dsp_options & DSP_OPT_NOHARDWARE)
 		return;
 	if ((cq.op & MISDN_CTRL_HW_FEATURES_OP)) {
@@ -662,6 +830,143 @@ get_features(struct mISDNchannel *ch)
 			       __func__, dsp->name);
 }
 
+/*
+ * turn the rx ring of the card on or off (DSP_OPT_RX_RING)
+ * while it is on, the card sends no PH_DATA_IND, the tick reads the ring.
+ * frames with time stamps (features.unordered) cannot use it.
+ */
+static void
+dsp_rx_ring(struct dsp *dsp, int on)
+{
+	struct mISDN_rx_ring	*ring;
+
+	if (!dsp->features_rx_ring || dsp->hdlc || !dsp->ch.peer)
+		return;
+	if (on && (!(dsp_options & DSP_OPT_RX_RING) || dsp->features.unordered))
+		return;
+	if (!on && !dsp->rx_ring)
+		return;
+	ring = mISDN_bchannel_rx_ring(dsp->ch.peer, on);
+	if (on && !ring)
+		printk(KERN_DEBUG "%s: no rx ring for %s\n", __func__,
+		       dsp->name);
+	WRITE_ONCE(dsp->rx_ring, ring);
+	if (dsp_debug & DEBUG_DSP_CORE)
+		printk(KERN_DEBUG "%s: rx ring %s for %s\n", __func__,
+		       ring ? "on" : "off", dsp->name);
+}
+
+/*
+ * the rx volume and gain, the samples of the software dtmf decoder and the
+ * copy into the rx buffer of the cmx are done in one pass over the frame.
+ * w is the position in the rx buffer, or -1 if the frame is not stored.
+ */
+static void
+dsp_rx_samples(struct dsp *dsp, u8 *p, int len, int w)
+{
+	const u8	*change = dsp->rx_change;
+	u8	*rx_buff = dsp->rx_buff;
+	s32	*buf = dsp->dtmf.buffer;
+	int	dtmf = dsp->dtmf.software;
+	int	size = dsp->dtmf.size;
+	int	i;
+	u8	b;
+
+	for (i = 0; i < len; i++) {
+		b = p[i];
+		if (change)
+			p[i] = b = change[b];
+		if (w >= 0)
+			rx_buff[(w + i) & CMX_BUFF_MASK] = b;
+		if (!dtmf)
+			continue;
+		buf[size++] = dsp_audio_law_to_s32[b];
+		if (size == DSP_DTMF_NPOINTS) {
+			dsp_dtmf_goertzel_block(dsp);
+			size = 0;
+		}
+	}
+	dsp->dtmf.size = size;
+}
+
+/*
+ * transparent data from the card, by PH_DATA_IND or by the rx ring
+ * returns NULL if the frame was sent up, else it still belongs to the caller.
+ */
+struct sk_buff *
+dsp_rx_audio(struct dsp *dsp, struct sk_buff *skb)
+{
+	struct mISDNhead	*hh = mISDN_HEAD_P(skb);
+	struct dsp		*other = NULL;
+	u8			*digits = NULL;
+	u_long			dflags;
+	spinlock_t		*lock;
+	int			w = -1;
+
+	lock = dsp_lock_data(dsp, &dflags);
+
+	/* decrypt if enabled */
+	if (dsp->bf_enable)
+		dsp_bf_decrypt(dsp, skb->data, skb->len);
+	/* pipeline */
+	if (dsp->pipeline.inuse)
+		dsp_pipeline_process_rx(&dsp->pipeline, skb->data,
+					skb->len, hh->id);
+	/* check if dtmf soft decoding is turned on */
+	if (dsp->dtmf.software) {
+		dsp->dtmf.digits[0] = '\0';
+		digits = dsp->dtmf.digits;
+	}
+	/* we need to process receive data if software */
+	if (dsp->conf && dsp->conf->software) {
+		other = dsp_cmx_forward_peer(dsp);
+		if (!other)
+			w = dsp_cmx_rx_begin(dsp, skb);
+	}
+	if (dsp->rx_change || digits || w >= 0)
+		dsp_rx_samples(dsp, skb->data, skb->len, w);
+	if (w >= 0)
+		dsp_cmx_rx_end(dsp, skb->len);
+	if (other)
+		dsp_cmx_forward(other, skb);
+	dsp_record(dsp, PH_DATA_IND, skb->data, skb->len);
+
+	spin_unlock_irqrestore(lock, dflags);
+
+	/* send dtmf result, if any */
+	if (digits) {
+		while (*digits) {
+			int k;
+			struct sk_buff *nskb;
+			if (dsp_debug & DEBUG_DSP_DTMF)
+				printk(KERN_DEBUG "%s: digit"
+				       "(%c) to layer %s\n",
+				       __func__, *digits, dsp->name);
+			k = *digits | DTMF_TONE_VAL;
+			nskb = _alloc_mISDN_skb(PH_CONTROL_IND,
+						MISDN_ID_ANY, sizeof(int), &k,
+						GFP_ATOMIC);
+			if (nskb) {
+				if (dsp->up) {
+					if (dsp->up->send(
+						    dsp->up, nskb))
+						dev_kfree_skb(nskb);
+				} else
+					dev_kfree_skb(nskb);
+			}
+			digits++;
+		}
+	}
+	if (dsp->rx_disabled || dsp->rx_congested) {
+		/* if receive is not allowed or cannot be queued */
+		return skb;
+	}
+	hh->prim = DL_DATA_IND;
+	if (dsp->up && !dsp->up->send(dsp->up, skb))
+		return NULL;
+	return skb;
+}
+
 static int
 dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 {
@@ -669,7 +974,8 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 	struct mISDNhead	*hh;
 	int			ret = 0;
 	u8			*digits = NULL;
-	u_long			flags;
+	u_long			flags, dflags;
+	spinlock_t		*lock;
 
 	hh = mISDN_HEAD_P(skb);
 	switch (hh->prim) {
@@ -678,10 +984,10 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 		dsp->data_pending = 0;
 		/* trigger next hdlc frame, if any */
 		if (dsp->hdlc) {
-			spin_lock_irqsave(&dsp_lock, flags);
+			lock = dsp_lock_data(dsp, &dflags);
 			if (dsp->b_active)
-				schedule_work(&dsp->workq);
-			spin_unlock_irqrestore(&dsp_lock, flags);
+				dsp_schedule_tx(dsp);
+			spin_unlock_irqrestore(lock, dflags);
 		}
 		break;
 	case (PH_DATA_IND):
@@ -690,6 +996,9 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 			ret = -EINVAL;
 			break;
 		}
+		trace_misdn_dsp_rx(ch, dsp_chnr(dsp), skb->len, hh->id);
+		if (unlikely(dsp->cpu != raw_smp_processor_id()))
+			WRITE_ONCE(dsp->cpu, raw_smp_processor_id());
 		if (dsp->rx_is_off) {
 			if (dsp_debug & DEBUG_DSP_CORE)
 				printk(KERN_DEBUG "%s: rx-data during rx_off"
@@ -698,10 +1007,10 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 		}
 		if (dsp->hdlc) {
 			/* hdlc */
-			spin_lock_irqsave(&dsp_lock, flags);
+			lock = dsp_lock_data(dsp, &dflags);
 			dsp_cmx_hdlc(dsp, skb);
-			spin_unlock_irqrestore(&dsp_lock, flags);
-			if (dsp->rx_disabled) {
+			spin_unlock_irqrestore(lock, dflags);
+			if (dsp->rx_disabled || dsp->rx_congested) {
 				/* if receive is not allowed */
 				break;
 			}
@@ -711,62 +1020,9 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 			break;
 		}
 
-		spin_lock_irqsave(&dsp_lock, flags);
-
-		/* decrypt if enabled */
-		if (dsp->bf_enable)
-			dsp_bf_decrypt(dsp, skb->data, skb->len);
-		/* pipeline */
-		if (dsp->pipeline.inuse)
-			dsp_pipeline_process_rx(&dsp->pipeline, skb->data,
-						skb->len, hh->id);
-		/* change volume if requested */
-		if (dsp->rx_volume)
-			dsp_change_volume(skb, dsp->rx_volume);
-		/* check if dtmf soft decoding is turned on */
-		if (dsp->dtmf.software) {
-			digits = dsp_dtmf_goertzel_decode(dsp, skb->data,
-							  skb->len, (dsp_options & DSP_OPT_ULAW) ? 1 : 0);
-		}
-		/* we need to process receive data if software */
-		if (dsp->conf && dsp->conf->software) {
-			/* process data from card at cmx */
-			dsp_cmx_receive(dsp, skb);
-		}
-
-		spin_unlock_irqrestore(&dsp_lock, flags);
-
-		/* send dtmf result, if any */
-		if (digits) {
-			while (*digits) {
-				int k;
-				struct sk_buff *nskb;
-				if (dsp_debug & DEBUG_DSP_DTMF)
-					printk(KERN_DEBUG "%s: digit"
-					       "(%c) to layer %s\n",
-					       __func__, *digits, dsp->name);
-				k = *digits | DTMF_TONE_VAL;
-				nskb = _alloc_mISDN_skb(PH_CONTROL_IND,
-							MISDN_ID_ANY, sizeof(int), &k,
-							GFP_ATOMIC);
-				if (nskb) {
-					if (dsp->up) {
-						if (dsp->up->send(
-							    dsp->up, nskb))
-							dev_kfree_skb(nskb);
-					} else
-						dev_kfree_skb(nskb);
-				}
-				digits++;
-			}
-		}
-		if (dsp->rx_disabled) {
-			/* if receive is not allowed */
-			break;
-		}
-		hh->prim = DL_DATA_IND;
-		if (dsp->up)
-			return dsp->up->send(dsp->up, skb);
+		skb = dsp_rx_audio(dsp, skb);
+		if (!skb)
+			return 0;
 		break;
 	case (PH_CONTROL_IND):
 		if (dsp_debug & DEBUG_DSP_DTMFCOEFF)
@@ -813,6 +1069,7 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 			}
 			spin_lock_irqsave(&dsp_lock, flags);
 			dsp->tx_volume = *((int *)skb->data);
+			dsp_change_tables(dsp);
 			if (dsp_debug & DEBUG_DSP_CORE)
 				printk(KERN_DEBUG "%s: change tx volume to "
 				       "%d\n", __func__, dsp->tx_volume);
@@ -835,16 +1092,29 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 			       __func__, dsp->name);
 		/* bchannel now active */
 		spin_lock_irqsave(&dsp_lock, flags);
+		lock = dsp_lock_data(dsp, &dflags);
 		dsp->b_active = 1;
 		dsp->data_pending = 0;
 		dsp->rx_init = 1;
 		/* rx_W and rx_R will be adjusted on first frame */
 		dsp->rx_W = 0;
 		dsp->rx_R = 0;
-		memset(dsp->rx_buff, 0, sizeof(dsp->rx_buff));
+		if (dsp->rx_buff)
+			memset(dsp->rx_buff, 0, CMX_BUFF_SIZE);
+		else if (!dsp->hdlc && dsp_cmx_buff_get(dsp))
+			printk(KERN_ERR "%s: %s is active without audio\n",
+			       __func__, dsp->name);
+		dsp->rx_underrun = 0;
+		dsp->rx_overrun = 0;
+		dsp->tx_overflow = 0;
+		spin_unlock_irqrestore(lock, dflags);
+		/* the card may have lost the PCM and conference settings */
+		dsp->hw_pcm.op = 0;
+		dsp->hw_conf.op = 0;
 		dsp_cmx_hardware(dsp->conf, dsp);
 		dsp_dtmf_hardware(dsp);
 		dsp_rx_off(dsp);
+		dsp_rx_ring(dsp, 1);
 		spin_unlock_irqrestore(&dsp_lock, flags);
 		if (dsp_debug & DEBUG_DSP_CORE)
 			printk(KERN_DEBUG "%s: done with activation, sending "
@@ -862,10 +1132,15 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 			       __func__, dsp->name);
 		/* bchannel now inactive */
 		spin_lock_irqsave(&dsp_lock, flags);
+		lock = dsp_lock_data(dsp, &dflags);
 		dsp->b_active = 0;
 		dsp->data_pending = 0;
+		if (!dsp->conf)
+			dsp_cmx_buff_put(dsp);
+		spin_unlock_irqrestore(lock, dflags);
 		dsp_cmx_hardware(dsp->conf, dsp);
 		dsp_rx_off(dsp);
+		dsp_rx_ring(dsp, 0);
 		spin_unlock_irqrestore(&dsp_lock, flags);
 		hh->prim = DL_RELEASE_CNF;
 		if (dsp->up)
@@ -885,17 +1160,17 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 				break;
 			}
 			hh->prim = PH_DATA_REQ;
-			spin_lock_irqsave(&dsp_lock, flags);
+			lock = dsp_lock_data(dsp, &dflags);
 			skb_queue_tail(&dsp->sendq, skb);
-			schedule_work(&dsp->workq);
-			spin_unlock_irqrestore(&dsp_lock, flags);
+			dsp_schedule_tx(dsp);
+			spin_unlock_irqrestore(lock, dflags);
 			return 0;
 		}
 		/* send data to tx-buffer (if no tone is played) */
 		if (!dsp->tone.tone) {
-			spin_lock_irqsave(&dsp_lock, flags);
+			lock = dsp_lock_data(dsp, &dflags);
 			dsp_cmx_transmit(dsp, skb);
-			spin_unlock_irqrestore(&dsp_lock, flags);
+			spin_unlock_irqrestore(lock, dflags);
 		}
 		break;
 	case (PH_CONTROL_REQ):
@@ -908,6 +1183,10 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 		if (dsp_debug & DEBUG_DSP_CORE)
 			printk(KERN_DEBUG "%s: activating b_channel %s\n",
 			       __func__, dsp->name);
+		/* the rings are needed as soon as the channel is active */
+		ret = dsp_cmx_buff_prepare(dsp);
+		if (ret)
+			break;
 		if (dsp->dtmf.hardware || dsp->dtmf.software)
 			dsp_dtmf_goertzel_init(dsp);
 		get_features(ch);
@@ -925,11 +1204,11 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 			printk(KERN_DEBUG "%s: releasing b_channel %s\n",
 			       __func__, dsp->name);
 		spin_lock_irqsave(&dsp_lock, flags);
+		lock = dsp_lock_data(dsp, &dflags);
 		dsp->tone.tone = 0;
 		dsp->tone.hardware = 0;
 		dsp->tone.software = 0;
-		if (timer_pending(&dsp->tone.tl))
-			del_timer(&dsp->tone.tl);
+		spin_unlock_irqrestore(lock, dflags);
 		if (dsp->conf)
 			dsp_cmx_conf(dsp, 0); /* dsp_cmx_hardware will also be
 						 called here */
@@ -946,7 +1225,7 @@ dsp_function(struct mISDNchannel *ch,  struct sk_buff *skb)
 		ret = -EINVAL;
 	}
 	if (!ret)
-		dev_kfree_skb(skb);
+		mI_free_audio_skb(skb);
 	return ret;
 }
 
@@ -954,7 +1233,9 @@ static int
 dsp_ctrl(struct mISDNchannel *ch, u_int cmd, void *arg)
 {
 	struct dsp		*dsp = container_of(ch, struct dsp, ch);
-	u_long		flags;
+	struct mISDN_ctrl_req	*cq;
+	u_long		flags, dflags;
+	spinlock_t	*lock;
 	int		err = 0;
 
 	if (debug & DEBUG_DSP_CTRL)
@@ -963,6 +1244,21 @@ dsp_ctrl(struct mISDNchannel *ch, u_int cmd, void *arg)
 	switch (cmd) {
 	case OPEN_CHANNEL:
 		break;
+	case CONTROL_CHANNEL:
+		/* backpressure of the socket, see mISDN_sock_rx_work */
+		cq = arg;
+		if (cq->op != MISDN_CTRL_RX_OFF) {
+			err = -EINVAL;
+			break;
+		}
+		spin_lock_irqsave(&dsp_lock, flags);
+		dsp->rx_congested = !!cq->p1;
+		dsp_rx_off(dsp);
+		spin_unlock_irqrestore(&dsp_lock, flags);
+		if (dsp_debug & DEBUG_DSP_CTRL)
+			printk(KERN_DEBUG "%s: %s rx congested %d\n",
+			       __func__, dsp->name, dsp->rx_congested);
+		break;
 	case CLOSE_CHANNEL:
 		if (dsp->ch.peer)
 			dsp->ch.peer->ctrl(dsp->ch.peer, CLOSE_CHANNEL, NULL);
@@ -971,13 +1267,13 @@ dsp_ctrl(struct mISDNchannel *ch, u_int cmd, void *arg)
 		 * must lock here, or we may hit send-process currently
 		 * queueing. */
 		spin_lock_irqsave(&dsp_lock, flags);
+		lock = dsp_lock_data(dsp, &dflags);
 		dsp->b_active = 0;
+		spin_unlock_irqrestore(lock, dflags);
 		spin_unlock_irqrestore(&dsp_lock, flags);
 		/* MUST not be locked, because it waits until queue is done. */
 		cancel_work_sync(&dsp->workq);
 		spin_lock_irqsave(&dsp_lock, flags);
-		if (timer_pending(&dsp->tone.tl))
-			del_timer(&dsp->tone.tl);
 		skb_queue_purge(&dsp->sendq);
 		if (dsp_debug & DEBUG_DSP_CTRL)
 			printk(KERN_DEBUG "%s: releasing member %s\n",
@@ -985,17 +1281,27 @@ dsp_ctrl(struct mISDNchannel *ch, u_int cmd, void *arg)
 		dsp->b_active = 0;
 		dsp_cmx_conf(dsp, 0); /* dsp_cmx_hardware will also be called
 					 here */
+		dsp_rx_ring(dsp, 0);
+		/* we are not member of a conf anymore */
+		spin_lock(&dsp->lock);
+		dsp_record_off(dsp);
 		dsp_pipeline_destroy(&dsp->pipeline);
+		spin_unlock(&dsp->lock);
 
 		if (dsp_debug & DEBUG_DSP_CTRL)
 			printk(KERN_DEBUG "%s: remove & destroy object %s\n",
 			       __func__, dsp->name);
-		list_del(&dsp->list);
+		list_del_rcu(&dsp->list);
 		spin_unlock_irqrestore(&dsp_lock, flags);
 
+		/* wait until the poll timer cannot walk over us anymore */
+		synchronize_rcu();
+
 		if (dsp_debug & DEBUG_DSP_CTRL)
 			printk(KERN_DEBUG "%s: dsp instance released\n",
 			       __func__);
+		mI_free_audio_skb(dsp->rx_ring_skb);
+		dsp_cmx_buff_put(dsp);
 		vfree(dsp);
 		module_put(THIS_MODULE);
 		break;
@@ -1007,14 +1313,30 @@ static void
 dsp_send_bh(struct work_struct *work)
 {
 	struct dsp *dsp = container_of(work, struct dsp, workq);
-	struct sk_buff *skb;
+	struct sk_buff *skb, *next;
 	struct mISDNhead	*hh;
+	struct sk_buff_head	queue;
+	u_long			flags;
 
 	if (dsp->hdlc && dsp->data_pending)
 		return; /* wait until data has been acknowledged */
 
+	/* take all queued data at once */
+	__skb_queue_head_init(&queue);
+	spin_lock_irqsave(&dsp->sendq.lock, flags);
+	skb_queue_splice_init(&dsp->sendq, &queue);
+	spin_unlock_irqrestore(&dsp->sendq.lock, flags);
+
 	/* send queued data */
-	while ((skb = skb_dequeue(&dsp->sendq))) {
+	while ((skb = __skb_dequeue(&queue))) {
+		/* hdlc frames must wait for the acknowledge, so put back */
+		if (dsp->hdlc && dsp->data_pending) {
+			__skb_queue_head(&queue, skb);
+			spin_lock_irqsave(&dsp->sendq.lock, flags);
+			skb_queue_splice(&queue, &dsp->sendq);
+			spin_unlock_irqrestore(&dsp->sendq.lock, flags);
+			return;
+		}
 		/* in locked date, we must have still data in queue */
 		if (dsp->data_pending) {
 			if (dsp_debug & DEBUG_DSP_CORE)
@@ -1033,6 +1355,18 @@ dsp_send_bh(struct work_struct *work)
 			} else
 				dev_kfree_skb(skb);
 		} else {
+			/*
+			 * append following transparent frames, so they are
+			 * sent with one call and not flushed while pending
+			 */
+			while (!dsp->hdlc && !skb_cloned(skb) &&
+			       (next = skb_peek(&queue)) &&
+			       mISDN_HEAD_PRIM(next) == PH_DATA_REQ &&
+			       next->len <= skb_tailroom(skb)) {
+				__skb_unlink(next, &queue);
+				skb_put_data(skb, next->data, next->len);
+				mI_free_audio_skb(next);
+			}
 			/* send packet down */
 			if (dsp->ch.peer) {
 				dsp->data_pending = 1;
@@ -1055,7 +1389,8 @@ dspcreate(struct channel_req *crq)
 	if (crq->protocol != ISDN_P_B_L2DSP
 	    && crq->protocol != ISDN_P_B_L2DSPHDLC)
 		return -EPROTONOSUPPORT;
-	ndsp = vzalloc(sizeof(struct dsp));
+	ndsp = vzalloc_node(sizeof(struct dsp),
+			    dev_to_node(&crq->ch->st->dev->dev));
 	if (!ndsp) {
 		printk(KERN_ERR "%s: vmalloc struct dsp failed\n", __func__);
 		return -ENOMEM;
@@ -1066,6 +1401,8 @@ dspcreate(struct channel_req *crq)
 	/* default enabled */
 	INIT_WORK(&ndsp->workq, (void *)dsp_send_bh);
 	skb_queue_head_init(&ndsp->sendq);
+	ndsp->cpu = -1;
+	spin_lock_init(&ndsp->lock);
 	ndsp->ch.send = dsp_function;
 	ndsp->ch.ctrl = dsp_ctrl;
 	ndsp->up = crq->ch;
@@ -1091,8 +1428,6 @@ dspcreate(struct channel_req *crq)
 	ndsp->pcm_bank_rx = -1;
 	ndsp->pcm_bank_tx = -1;
 	ndsp->hfc_conf = -1; /* current conference number */
-	/* set tone timer */
-	setup_timer(&ndsp->tone.tl, (void *)dsp_tone_timeout, (long)ndsp);
 
 	if (dtmfthreshold < 20 || dtmfthreshold > 500)
 		dtmfthreshold = 200;
@@ -1101,7 +1436,7 @@ dspcreate(struct channel_req *crq)
 	/* init pipeline append to list */
 	spin_lock_irqsave(&dsp_lock, flags);
 	dsp_pipeline_init(&ndsp->pipeline);
-	list_add_tail(&ndsp->list, &dsp_ilist);
+	list_add_tail_rcu(&ndsp->list, &dsp_ilist);
 	spin_unlock_irqrestore(&dsp_lock, flags);
 
 	return 0;
@@ -1112,7 +1447,8 @@ static struct Bprotocol DSP = {
 	.Bprotocols = (1 << (ISDN_P_B_L2DSP & ISDN_P_B_MASK))
 	| (1 << (ISDN_P_B_L2DSPHDLC & ISDN_P_B_MASK)),
 	.name = "dsp",
-	.create = dspcreate
+	.create = dspcreate,
+	.owner = THIS_MODULE
 };
 
 static int __init dsp_init(void)
@@ -1127,7 +1463,30 @@ static int __init dsp_init(void)
 
 	/* set packet size */
 	dsp_poll = poll;
-	if (dsp_poll) {
+	if (hrperiod) {
+		/* high resolution clock, one sample every 125 us */
+		if (hrperiod % 125) {
+			printk(KERN_ERR "%s: Wrong hrperiod value (%d), must "
+			       "be a multiple of 125 us.\n", __func__, hrperiod);
+			err = -EINVAL;
+			return err;
+		}
+		dsp_poll = hrperiod / 125;
+		if (dsp_poll < 8 || dsp_poll > MAX_POLL) {
+			printk(KERN_ERR "%s: Wrong hrperiod value (%d), use "
+			       "%d to %d us.\n", __func__, hrperiod, 8 * 125,
+			       MAX_POLL * 125);
+			err = -EINVAL;
+			return err;
+		}
+		if (poll && poll != dsp_poll) {
+			printk(KERN_ERR "%s: poll value (%d) does not match "
+			       "hrperiod (%d samples).\n", __func__, poll,
+			       dsp_poll);
+			err = -EINVAL;
+			return err;
+		}
+	} else if (dsp_poll) {
 		if (dsp_poll > MAX_POLL) {
 			printk(KERN_ERR "%s: Wrong poll value (%d), use %d "
 			       "maximum.\n", __func__, poll, MAX_POLL);
@@ -1169,47 +1528,85 @@ static int __init dsp_init(void)
 		err = -EINVAL;
 		return err;
 	}
-	printk(KERN_INFO "mISDN_dsp: DSP clocks every %d samples. This equals "
-	       "%d jiffies.\n", dsp_poll, dsp_tics);
+	if (hrperiod)
+		printk(KERN_INFO "mISDN_dsp: DSP clocks every %d samples. This "
+		       "equals %d us (high resolution timer).\n", dsp_poll,
+		       hrperiod);
+	else
+		printk(KERN_INFO "mISDN_dsp: DSP clocks every %d samples. This "
+		       "equals %d jiffies.\n", dsp_poll, dsp_tics);
+
+	/* set jitter buffer size */
+	if (buffsize) {
+		if (buffsize < CMX_BUFF_MIN || buffsize > CMX_BUFF_MAX
+		    || (buffsize & (buffsize - 1))) {
+			printk(KERN_ERR "%s: Wrong buffsize value (%d), use "
+			       "a power of 2 from %d to %d.\n", __func__,
+			       buffsize, CMX_BUFF_MIN, CMX_BUFF_MAX);
+			err = -EINVAL;
+			return err;
+		}
+		dsp_buff_size = buffsize;
+	} else if (dsp_options & DSP_OPT_ADAPTIVE)
+		dsp_buff_size = CMX_BUFF_ADAPTIVE;
+	printk(KERN_INFO "mISDN_dsp: Jitter buffer has %d samples%s.\n",
+	       dsp_buff_size,
+	       (dsp_options & DSP_OPT_ADAPTIVE) ? " (adaptive)" : "");
+	err = dsp_cmx_buff_init();
+	if (err)
+		return err;
 
 	spin_lock_init(&dsp_lock);
 	INIT_LIST_HEAD(&dsp_ilist);
 	INIT_LIST_HEAD(&conf_ilist);
 
 	/* init conversion tables */
-	dsp_audio_generate_law_tables();
-	dsp_silence = (dsp_options & DSP_OPT_ULAW) ? 0xff : 0x2a;
-	dsp_audio_law_to_s32 = (dsp_options & DSP_OPT_ULAW) ?
-		dsp_audio_ulaw_to_s32 : dsp_audio_alaw_to_s32;
-	dsp_audio_generate_s2law_table();
-	dsp_audio_generate_seven();
-	dsp_audio_generate_mix_table();
+	dsp_audio_select_law(dsp_options & DSP_OPT_ULAW);
 	if (dsp_options & DSP_OPT_ULAW)
 		dsp_audio_generate_ulaw_samples();
-	dsp_audio_generate_volume_changes();
+
+	/* shared silence frame for idle channels */
+	if (dsp_cmx_silence_init())
+		printk(KERN_WARNING "mISDN_dsp: no silence frame, idle "
+		       "channels are processed as usual.\n");
+
+	/* shared tone streams for software tones */
+	dsp_tone_stream_init();
 
 	err = dsp_pipeline_module_init();
 	if (err) {
 		printk(KERN_ERR "mISDN_dsp: Can't initialize pipeline, "
 		       "error(%d)\n", err);
-		return err;
+		goto error1;
 	}
 
+	if (dsp_record_init())
+		printk(KERN_WARNING "mISDN_dsp: no recording device.\n");
+
 	err = mISDN_register_Bprotocol(&DSP);
 	if (err) {
 		printk(KERN_ERR "Can't register %s error(%d)\n", DSP.name, err);
-		return err;
+		goto error2;
 	}
 
+	/* more than one cpu for mixing conferences */
+	if (mixcpus > 1 && dsp_cmx_parallel_init(mixcpus))
+		printk(KERN_WARNING "mISDN_dsp: parallel mixing not "
+		       "available, using one cpu.\n");
+
 	/* set sample timer */
-	dsp_spl_tl.function = (void *)dsp_cmx_send;
-	dsp_spl_tl.data = 0;
-	init_timer(&dsp_spl_tl);
-	dsp_spl_tl.expires = jiffies + dsp_tics;
-	dsp_spl_jiffies = dsp_spl_tl.expires;
-	add_timer(&dsp_spl_tl);
+	dsp_cmx_clock_start(hrperiod);
 
 	return 0;
+
+error2:
+	dsp_record_exit();
+	dsp_pipeline_module_exit();
+error1:
+	dsp_tone_stream_exit();
+	dsp_cmx_silence_exit();
+	dsp_cmx_buff_exit();
+	return err;
 }
 
 
@@ -1217,7 +1614,10 @@ static void __exit dsp_cleanup(void)
 {
 	mISDN_unregister_Bprotocol(&DSP);
 
-	del_timer_sync(&dsp_spl_tl);
+	dsp_cmx_clock_stop();
+	dsp_cmx_parallel_exit();
+	dsp_cmx_silence_exit();
+	dsp_tone_stream_exit();
 
 	if (!list_empty(&dsp_ilist)) {
 		printk(KERN_ERR "mISDN_dsp: Audio DSP object inst list not "
@@ -1228,7 +1628,9 @@ static void __exit dsp_cleanup(void)
 		       "all memory freed.\n");
 	}
 
+	dsp_record_exit();
 	dsp_pipeline_module_exit();
+	dsp_cmx_buff_exit();
 }
 
 module_init(dsp_init);
@@ -13,13 +13,14 @@
 #include <linux/mISDNdsp.h>
 #include "core.h"
 #include "dsp.h"
+#include "dsp_goertzel.h"
 
-#define NCOEFF            8     /* number of frequencies to be analyzed */
+#define NCOEFF		GOERTZEL_NCOEFF
 
 /* For DTMF recognition:
  * 2 * cos(2 * PI * k / N) precalculated for all k
  */
-static u64 cos2pik[NCOEFF] =
+static s32 cos2pik[NCOEFF] =
 {
 	/* k << 15 (source: hfc-4s/8s documentation (www.colognechip.de)) */
 	55960, 53912, 51402, 48438, 38146, 32650, 26170, 18630
@@ -43,9 +44,18 @@ void dsp_dtmf_goertzel_init(struct dsp *dsp)
 	dsp->dtmf.lastwhat = '\0';
 	dsp->dtmf.lastdigit = '\0';
 	dsp->dtmf.count = 0;
+	dsp->dtmf.blocks = 0;
+	dsp->dtmf.gated = 0;
 }
 
 /* check for hardware or software features
+ *
+ * the hardware gets its coefficients from the data as received from the
+ * line, before any processing of the dsp. the tx volume does not change
+ * this data, the rx volume only changes the level of it after detection.
+ * so hardware DTMF is kept with volume changes, the threshold applies to
+ * the level on the line then. encrypted data and the pipeline (echo
+ * canceller) change what is received, so software must be used there.
  */
 void dsp_dtmf_hardware(struct dsp *dsp)
 {
@@ -57,21 +67,6 @@ void dsp_dtmf_hardware(struct dsp *dsp)
 	if (!dsp->features.hfc_dtmf)
 		hardware = 0;
 
-	/* check for volume change */
-	if (dsp->tx_volume) {
-		if (dsp_debug & DEBUG_DSP_DTMF)
-			printk(KERN_DEBUG "%s dsp %s cannot do hardware DTMF, "
-			       "because tx_volume is changed\n",
-			       __func__, dsp->name);
-		hardware = 0;
-	}
-	if (dsp->rx_volume) {
-		if (dsp_debug & DEBUG_DSP_DTMF)
-			printk(KERN_DEBUG "%s dsp %s cannot do hardware DTMF, "
-			       "because rx_volume is changed\n",
-			       __func__, dsp->name);
-		hardware = 0;
-	}
 	/* check if encryption is enabled */
 	if (dsp->bf_enable) {
 		if (dsp_debug & DEBUG_DSP_DTMF)
@@ -98,115 +93,14 @@ void dsp_dtmf_hardware(struct dsp *dsp)
  * calculate the coefficients of the given sample and decode *
  *************************************************************/
 
-/* the given sample is decoded. if the sample is not long enough for a
- * complete frame, the decoding is finished and continued with the next
- * call of this function.
- *
- * the algorithm is very good for detection with a minimum of errors. i
- * tested it allot. it even works with very short tones (40ms). the only
- * disadvantage is, that it doesn't work good with different volumes of both
- * tones. this will happen, if accoustically coupled dialers are used.
- * it sometimes detects tones during speech, which is normal for decoders.
- * use sequences to given commands during calls.
- *
- * dtmf - points to a structure of the current dtmf state
- * spl and len - the sample
- * fmt - 0 = alaw, 1 = ulaw, 2 = coefficients from HFC DTMF hw-decoder
- */
-
-u8
-*dsp_dtmf_goertzel_decode(struct dsp *dsp, u8 *data, int len, int fmt)
+/* the digit of the squared coefficients, or 0 */
+static u8
+dtmf_digit(struct dsp *dsp, s32 *result)
 {
-	u8 what;
-	int size;
-	signed short *buf;
-	s32 sk, sk1, sk2;
-	int k, n, i;
-	s32 *hfccoeff;
-	s32 result[NCOEFF], tresh, treshl;
+	s32 tresh, treshl;
 	int lowgroup, highgroup;
-	s64 cos2pik_;
+	int i;
 
-	dsp->dtmf.digits[0] = '\0';
-
-	/* Note: The function will loop until the buffer has not enough samples
-	 * left to decode a full frame.
-	 */
-again:
-	/* convert samples */
-	size = dsp->dtmf.size;
-	buf = dsp->dtmf.buffer;
-	switch (fmt) {
-	case 0: /* alaw */
-	case 1: /* ulaw */
-		while (size < DSP_DTMF_NPOINTS && len) {
-			buf[size++] = dsp_audio_law_to_s32[*data++];
-			len--;
-		}
-		break;
-
-	case 2: /* HFC coefficients */
-	default:
-		if (len < 64) {
-			if (len > 0)
-				printk(KERN_ERR "%s: coefficients have invalid "
-				       "size. (is=%d < must=%d)\n",
-				       __func__, len, 64);
-			return dsp->dtmf.digits;
-		}
-		hfccoeff = (s32 *)data;
-		for (k = 0; k < NCOEFF; k++) {
-			sk2 = (*hfccoeff++) >> 4;
-			sk = (*hfccoeff++) >> 4;
-			if (sk > 32767 || sk < -32767 || sk2 > 32767
-			    || sk2 < -32767)
-				printk(KERN_WARNING
-				       "DTMF-Detection overflow\n");
-			/* compute |X(k)|**2 */
-			result[k] =
-				(sk * sk) -
-				(((cos2pik[k] * sk) >> 15) * sk2) +
-				(sk2 * sk2);
-		}
-		data += 64;
-		len -= 64;
-		goto coefficients;
-		break;
-	}
-	dsp->dtmf.size = size;
-
-	if (size < DSP_DTMF_NPOINTS)
-		return dsp->dtmf.digits;
-
-	dsp->dtmf.size = 0;
-
-	/* now we have a full buffer of signed long samples - we do goertzel */
-	for (k = 0; k < NCOEFF; k++) {
-		sk = 0;
-		sk1 = 0;
-		sk2 = 0;
-		buf = dsp->dtmf.buffer;
-		cos2pik_ = cos2pik[k];
-		for (n = 0; n < DSP_DTMF_NPOINTS; n++) {
-			sk = ((cos2pik_ * sk1) >> 15) - sk2 + (*buf++);
-			sk2 = sk1;
-			sk1 = sk;
-		}
-		sk >>= 8;
-		sk2 >>= 8;
-		if (sk > 32767 || sk < -32767 || sk2 > 32767 || sk2 < -32767)
-			printk(KERN_WARNING "DTMF-Detection overflow\n");
-		/* compute |X(k)|**2 */
-		result[k] =
-			(sk * sk) -
-			(((cos2pik[k] * sk) >> 15) * sk2) +
-			(sk2 * sk2);
-	}
-
-	/* our (squared) coefficients have been calculated, we need to process
-	 * them.
-	 */
-coefficients:
 	tresh = 0;
 	for (i = 0; i < NCOEFF; i++) {
 		if (result[i] < 0)
@@ -217,10 +111,8 @@ coefficients:
 		}
 	}
 
-	if (tresh == 0) {
-		what = 0;
-		goto storedigit;
-	}
+	if (tresh == 0)
+		return 0;
 
 	if (dsp_debug & DEBUG_DSP_DTMFCOEFF) {
 		s32 tresh_100 = tresh/100;
@@ -276,11 +168,15 @@ coefficients:
 	}
 
 	/* get digit or null */
-	what = 0;
 	if (lowgroup >= 0 && highgroup >= 0)
-		what = dtmf_matrix[lowgroup][highgroup];
+		return dtmf_matrix[lowgroup][highgroup];
+	return 0;
+}
 
-storedigit:
+/* the digit (or no digit) of one frame, added to dsp->dtmf.digits */
+static void
+dtmf_store(struct dsp *dsp, u8 what)
+{
 	if (what && (dsp_debug & DEBUG_DSP_DTMF))
 		printk(KERN_DEBUG "DTMF what: %c\n", what);
 
@@ -308,6 +204,123 @@ storedigit:
 		dsp->dtmf.count++;
 
 	dsp->dtmf.lastwhat = what;
+}
+
+/*
+ * decode the full buffer of DSP_DTMF_NPOINTS samples. the caller fills
+ * dsp->dtmf.buffer, this is also used by the rx path of dsp_core.c, which
+ * converts the samples while it processes them anyway.
+ */
+void
+dsp_dtmf_goertzel_block(struct dsp *dsp)
+{
+	s32 sk, sk2;
+	s32 skn[NCOEFF], sk2n[NCOEFF];
+	s32 result[NCOEFF];
+	s32 *buf;
+	s64 energy;
+	int k, n;
+
+	dsp->dtmf.size = 0;
+
+	/*
+	 * energy gate: |X(k)|**2 of any filter cannot exceed the number of
+	 * samples times the energy of the frame. the result is scaled by
+	 * 2**-16, so if twice of this bound does not reach the treshold, no
+	 * coefficient can reach it and the filter bank is skipped.
+	 */
+	dsp->dtmf.blocks++;
+	energy = 0;
+	buf = dsp->dtmf.buffer;
+	for (n = 0; n < DSP_DTMF_NPOINTS; n++)
+		energy += (s64)buf[n] * buf[n];
+	if (((energy * DSP_DTMF_NPOINTS) >> 15) <= dsp->dtmf.treshold) {
+		dsp->dtmf.gated++;
+		dtmf_store(dsp, 0);
+		return;
+	}
+
+	/* now we have a full buffer of signed long samples - we do goertzel */
+	goertzel_bank(cos2pik, dsp->dtmf.buffer, DSP_DTMF_NPOINTS, skn, sk2n);
+	for (k = 0; k < NCOEFF; k++) {
+		sk = skn[k] >> 8;
+		sk2 = sk2n[k] >> 8;
+		if (sk > 32767 || sk < -32767 || sk2 > 32767 || sk2 < -32767)
+			printk(KERN_WARNING "DTMF-Detection overflow\n");
+		/* compute |X(k)|**2 */
+		result[k] =
+			(sk * sk) -
+			((s32)(((s64)cos2pik[k] * sk) >> 15) * sk2) +
+			(sk2 * sk2);
+	}
+	dtmf_store(dsp, dtmf_digit(dsp, result));
+}
+
+/* the given sample is decoded. if the sample is not long enough for a
+ * complete frame, the decoding is finished and continued with the next
+ * call of this function.
+ *
+ * the algorithm is very good for detection with a minimum of errors. i
+ * tested it allot. it even works with very short tones (40ms). the only
+ * disadvantage is, that it doesn't work good with different volumes of both
+ * tones. this will happen, if accoustically coupled dialers are used.
+ * it sometimes detects tones during speech, which is normal for decoders.
+ * use sequences to given commands during calls.
+ *
+ * dtmf - points to a structure of the current dtmf state
+ * spl and len - the sample
+ * fmt - 0 = alaw, 1 = ulaw, 2 = coefficients from HFC DTMF hw-decoder
+ */
+
+u8
+*dsp_dtmf_goertzel_decode(struct dsp *dsp, u8 *data, int len, int fmt)
+{
+	s32 sk, sk2;
+	s32 *hfccoeff;
+	s32 result[NCOEFF];
+	int size, k;
+	s32 *buf;
+
+	dsp->dtmf.digits[0] = '\0';
+
+	if (fmt == 0 || fmt == 1) { /* alaw or ulaw */
+		buf = dsp->dtmf.buffer;
+		size = dsp->dtmf.size;
+		while (len) {
+			buf[size++] = dsp_audio_law_to_s32[*data++];
+			len--;
+			if (size == DSP_DTMF_NPOINTS) {
+				dsp_dtmf_goertzel_block(dsp);
+				size = 0;
+			}
+		}
+		dsp->dtmf.size = size;
+		return dsp->dtmf.digits;
+	}
 
-	goto again;
+	/* HFC coefficients */
+	while (len >= 64) {
+		hfccoeff = (s32 *)data;
+		for (k = 0; k < NCOEFF; k++) {
+			sk2 = (*hfccoeff++) >> 4;
+			sk = (*hfccoeff++) >> 4;
+			if (sk > 32767 || sk < -32767 || sk2 > 32767
+			    || sk2 < -32767)
+				printk(KERN_WARNING
+				       "DTMF-Detection overflow\n");
+			/* compute |X(k)|**2 */
+			result[k] =
+				(sk * sk) -
+				((s32)(((s64)cos2pik[k] * sk) >> 15) * sk2) +
+				(sk2 * sk2);
+		}
+		data += 64;
+		len -= 64;
+		dtmf_store(dsp, dtmf_digit(dsp, result));
+	}
+	if (len > 0)
+		printk(KERN_ERR "%s: coefficients have invalid "
+		       "size. (is=%d < must=%d)\n",
+		       __func__, len, 64);
+	return dsp->dtmf.digits;
 }
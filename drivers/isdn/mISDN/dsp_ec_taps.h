@@ -0,0 +1,74 @@
+/*
+ * dsp_ec_taps.h: line echo cancellers with a fixed number of taps
+ *
+ * A canceller implements its update as __echo_can_update(ec, ref, sig, N),
+ * N is the number of taps. Included behind it, this file generates a frame
+ * function for each common tail length, where N is a constant, so the loops
+ * over the taps can be unrolled by the compiler, and one for all other
+ * lengths. echo_can_select_block() picks one of them when the
+ * canceller is created, it is stored in ec->update_block.
+ * the fixed functions run x1.35 to x2.6 faster (dspbench mg2ec, kb1ec and
+ * mec2 at -t 128 to 1024). the kernel is built without sse, so the loops
+ * are unrolled, not vectorized; hand written vector kernels exist only for
+ * oslec (see oslec_simd.c).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#define ECHOCAN_BLOCK_TAPS(taps)					\
+static void								\
+echo_can_block_##taps(struct echo_can_state *ec, const short *ref,	\
+		      short *sig, int len)				\
+{									\
+	int i;								\
+									\
+	for (i = 0; i < len; i++)					\
+		sig[i] = __echo_can_update(ec, ref[i], sig[i], taps);	\
+}
+
+ECHOCAN_BLOCK_TAPS(128)
+ECHOCAN_BLOCK_TAPS(256)
+ECHOCAN_BLOCK_TAPS(512)
+ECHOCAN_BLOCK_TAPS(1024)
+
+/* any other length */
+static void
+echo_can_block_any(struct echo_can_state *ec, const short *ref, short *sig,
+		   int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		sig[i] = __echo_can_update(ec, ref[i], sig[i], ec->N_d);
+}
+
+static inline void
+(*echo_can_select_block(int taps))(struct echo_can_state *, const short *,
+				   short *, int)
+{
+	switch (taps) {
+	case 128:
+		return echo_can_block_128;
+	case 256:
+		return echo_can_block_256;
+	case 512:
+		return echo_can_block_512;
+	case 1024:
+		return echo_can_block_1024;
+	}
+	return echo_can_block_any;
+}
+
+#define echo_can_update_block(ec, ref, sig, len) \
+	((ec)->update_block((ec), (ref), (sig), (len)))
+
+/* a single sample, e.g. while training */
+static inline short
+echo_can_update(struct echo_can_state *ec, short iref, short isig)
+{
+	return __echo_can_update(ec, iref, isig, ec->N_d);
+}
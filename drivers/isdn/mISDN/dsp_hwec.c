@@ -26,6 +26,7 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/module.h>
 #include <linux/string.h>
 #include <linux/mISDNdsp.h>
 #include <linux/mISDNif.h>
@@ -48,16 +49,45 @@ static struct mISDN_dsp_element dsp_hwec_p = {
 };
 struct mISDN_dsp_element *dsp_hwec = &dsp_hwec_p;
 
-void dsp_hwec_enable(struct dsp *dsp, const char *arg)
+/*
+ * software echo cancellers of a pipeline are replaced by the hardware echo
+ * canceller, if the card has one and it accepts the channel. if the card
+ * runs out of echo cancellers, the software element is used.
+ */
+static int hwec_auto = 1;
+module_param(hwec_auto, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(hwec_auto, "prefer the hardware echo canceller");
+
+static atomic_t dsp_hwec_active = ATOMIC_INIT(0);
+static atomic_t dsp_hwec_fallback = ATOMIC_INIT(0);
+
+static int
+dsp_hwec_get_counter(char *buffer, const struct kernel_param *kp)
+{
+	return sprintf(buffer, "%d\n", atomic_read((atomic_t *)kp->arg));
+}
+
+static const struct kernel_param_ops dsp_hwec_counter_ops = {
+	.get = dsp_hwec_get_counter,
+};
+module_param_cb(hwec_active, &dsp_hwec_counter_ops, &dsp_hwec_active,
+		S_IRUGO);
+MODULE_PARM_DESC(hwec_active, "channels using a hardware echo canceller");
+module_param_cb(hwec_fallback, &dsp_hwec_counter_ops, &dsp_hwec_fallback,
+		S_IRUGO);
+MODULE_PARM_DESC(hwec_fallback,
+		 "software echo cancellers used, because the hardware was busy");
+
+int dsp_hwec_enable(struct dsp *dsp, const char *arg)
 {
 	int deftaps = 128,
-		len;
+		len, ret;
 	struct mISDN_ctrl_req	cq;
 
 	if (!dsp) {
 		printk(KERN_ERR "%s: failed to enable hwec: dsp is NULL\n",
 		       __func__);
-		return;
+		return -EINVAL;
 	}
 
 	if (!arg)
@@ -94,14 +124,36 @@ void dsp_hwec_enable(struct dsp *dsp, const char *arg)
 _do:
 	printk(KERN_DEBUG "%s: enabling hwec with deftaps=%d\n",
 	       __func__, deftaps);
+	if (!dsp->ch.peer)
+		return -ENODEV;
 	memset(&cq, 0, sizeof(cq));
 	cq.op = MISDN_CTRL_HFC_ECHOCAN_ON;
 	cq.p1 = deftaps;
-	if (!dsp->ch.peer->ctrl(&dsp->ch, CONTROL_CHANNEL, &cq)) {
+	ret = dsp->ch.peer->ctrl(&dsp->ch, CONTROL_CHANNEL, &cq);
+	if (ret) {
 		printk(KERN_DEBUG "%s: CONTROL_CHANNEL failed\n",
 		       __func__);
-		return;
+		return ret;
 	}
+	atomic_inc(&dsp_hwec_active);
+	return 0;
+}
+
+/*
+ * called for a software echo canceller of the pipeline.
+ * returns 0, if the hardware cancels the echo instead.
+ */
+int dsp_hwec_auto(struct dsp *dsp, const char *arg)
+{
+	int ret;
+
+	if (!hwec_auto || !dsp->features.hfc_echocanhw)
+		return -EOPNOTSUPP;
+
+	ret = dsp_hwec_enable(dsp, arg);
+	if (ret)
+		atomic_inc(&dsp_hwec_fallback);
+	return ret;
 }
 
 void dsp_hwec_disable(struct dsp *dsp)
@@ -115,9 +167,12 @@ void dsp_hwec_disable(struct dsp *dsp)
 	}
 
 	printk(KERN_DEBUG "%s: disabling hwec\n", __func__);
+	atomic_dec(&dsp_hwec_active);
+	if (!dsp->ch.peer)
+		return;
 	memset(&cq, 0, sizeof(cq));
 	cq.op = MISDN_CTRL_HFC_ECHOCAN_OFF;
-	if (!dsp->ch.peer->ctrl(&dsp->ch, CONTROL_CHANNEL, &cq)) {
+	if (dsp->ch.peer->ctrl(&dsp->ch, CONTROL_CHANNEL, &cq)) {
 		printk(KERN_DEBUG "%s: CONTROL_CHANNEL failed\n",
 		       __func__);
 		return;
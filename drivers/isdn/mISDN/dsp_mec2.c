@@ -106,11 +106,13 @@ static struct mISDN_dsp_element dsp_mec2 = {
 	.process_rx = process_rx,
 	.num_args = sizeof(args) / sizeof(struct mISDN_dsp_element_arg),
 	.args = args,
+	.flags = MISDN_DSP_ELEM_ECHOCAN,
 };
 
 #ifdef MODULE
 static int __init dsp_mec2_init(void)
 {
+	dsp_cancel_pool_init();
 	mISDN_dsp_element_register(&dsp_mec2);
 
 	return 0;
@@ -119,6 +121,7 @@ static int __init dsp_mec2_init(void)
 static void __exit dsp_mec2_exit(void)
 {
 	mISDN_dsp_element_unregister(&dsp_mec2);
+	dsp_cancel_pool_exit();
 }
 
 module_init(dsp_mec2_init);
@@ -179,6 +179,9 @@ struct echo_can_state {
 	int dc_estimate;
 #endif
 
+	/* frame function for N_d taps, see dsp_ec_taps.h */
+	void (*update_block)(struct echo_can_state *ec, const short *ref,
+			     short *sig, int len);
 };
 
 static inline void init_cb_s(struct echo_can_cb_s *cb, int len, void *where)
@@ -296,8 +299,9 @@ static inline short dc_removal(int *dc_estimate, short samp)
 }
 #endif
 
-static inline short
-echo_can_update(struct echo_can_state *ec, short iref, short isig)
+static __always_inline short
+__echo_can_update(struct echo_can_state *ec, short iref, short isig,
+		  const int N)
 {
 
 	/* Declare local variables that are used more than once */
@@ -343,7 +347,7 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 	/* eq. (2): compute r in fixed-point */
 	rs = CONVOLVE2(ec->a_s,
 			ec->y_s.buf_d + ec->y_s.idx_d,
-			ec->N_d);
+			N);
 	rs >>= 15;
 
 	if (ec->lastsig == isig) {
@@ -393,8 +397,8 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 	if (!ec->backup) {
 		/* Backup coefficients periodically */
 		ec->backup = BACKUP;
-		memcpy(ec->c_i, ec->b_i, ec->N_d*sizeof(int));
-		memcpy(ec->b_i, ec->a_i, ec->N_d*sizeof(int));
+		memcpy(ec->c_i, ec->b_i, N*sizeof(int));
+		memcpy(ec->b_i, ec->a_i, N*sizeof(int));
 	} else
 		ec->backup--;
 
@@ -477,11 +481,11 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 	if (ec->y_tilde_i > ec->max_y_tilde) {
 		/* New highest y_tilde with full life */
 		ec->max_y_tilde = ec->y_tilde_i;
-		ec->max_y_tilde_pos = ec->N_d - 1;
+		ec->max_y_tilde_pos = N - 1;
 	} else if (--ec->max_y_tilde_pos < 0) {
 		/* Time to find new max y tilde... */
 		ec->max_y_tilde = MAX16(ec->y_tilde_s.buf_d
-			+ ec->y_tilde_s.idx_d, ec->N_d, &ec->max_y_tilde_pos);
+			+ ec->y_tilde_s.idx_d, N, &ec->max_y_tilde_pos);
 	}
 
 	/* Determine if near end speech was detected in this sample */
@@ -526,7 +530,7 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 			int max_coeffs[USED_COEFFS];
 			int *pos;
 
-			if (ec->N_d > USED_COEFFS)
+			if (N > USED_COEFFS)
 				memset(max_coeffs, 0, USED_COEFFS*sizeof(int));
 #endif
 #ifdef MEC2_STATS_DETAILED
@@ -537,7 +541,7 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 			ec->avg_Lu_i_ok = ec->avg_Lu_i_ok + ec->Lu_i;
 			++ec->cntr_coeff_updates;
 #endif
-			for (k = 0; k < ec->N_d; k++) {
+			for (k = 0; k < N; k++) {
 				/* eq. (7): compute an expectation over M_d
 				 * samples */
 				int grad2;
@@ -549,7 +553,7 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 				ec->a_s[k] = ec->a_i[k] >> 16;
 
 #ifdef USED_COEFFS
-				if (ec->N_d > USED_COEFFS) {
+				if (N > USED_COEFFS) {
 					if (abs(ec->a_i[k]) >
 						max_coeffs[USED_COEFFS-1]) {
 						/* More or less
@@ -573,8 +577,8 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 
 #ifdef USED_COEFFS
 			/* Filter out irrelevant coefficients */
-			if (ec->N_d > USED_COEFFS)
-				for (k = 0; k < ec->N_d; k++)
+			if (N > USED_COEFFS)
+				for (k = 0; k < N; k++)
 					if (abs(ec->a_i[k]) <
 						max_coeffs[USED_COEFFS-1]) {
 						ec->a_i[k] = 0;
@@ -699,34 +703,59 @@ echo_can_update(struct echo_can_state *ec, short iref, short isig)
 	return u;
 }
 
-static inline struct echo_can_state *echo_can_create(int len, int adaption_mode)
+#include "dsp_ec_taps.h"
+
+/* size of a canceller of len taps, including its buffers */
+static inline int echo_can_size(int len, int *maxy, int *maxu)
 {
-	struct echo_can_state *ec;
-	int maxy;
-	int maxu;
-	maxy = len + DEFAULT_M;
-	maxu = DEFAULT_M;
-	if (maxy < (1 << DEFAULT_ALPHA_YT_I))
-		maxy = (1 << DEFAULT_ALPHA_YT_I);
-	if (maxy < (1 << DEFAULT_SIGMA_LY_I))
-		maxy = (1 << DEFAULT_SIGMA_LY_I);
-	if (maxu < (1 << DEFAULT_SIGMA_LU_I))
-		maxu = (1 << DEFAULT_SIGMA_LU_I);
-	ec = (struct echo_can_state *)ZMALLOC(sizeof(struct echo_can_state) +
+	*maxy = len + DEFAULT_M;
+	*maxu = DEFAULT_M;
+	if (*maxy < (1 << DEFAULT_ALPHA_YT_I))
+		*maxy = (1 << DEFAULT_ALPHA_YT_I);
+	if (*maxy < (1 << DEFAULT_SIGMA_LY_I))
+		*maxy = (1 << DEFAULT_SIGMA_LY_I);
+	if (*maxu < (1 << DEFAULT_SIGMA_LU_I))
+		*maxu = (1 << DEFAULT_SIGMA_LU_I);
+	return sizeof(struct echo_can_state) +
 		4 +				/* align */
 		sizeof(int) * len +		/* a_i */
 		sizeof(short) * len +		/* a_s */
 		sizeof(int) * len +		/* b_i */
 		sizeof(int) * len +		/* c_i */
-		2 * sizeof(short) * (maxy) +	/* y_s */
+		2 * sizeof(short) * (*maxy) +	/* y_s */
 		2 * sizeof(short) * (1 << DEFAULT_ALPHA_ST_I) + /* s_s */
-		2 * sizeof(short) * (maxu) +	/* u_s */
-		2 * sizeof(short) * len);	/* y_tilde_s */
-	if (ec)
+		2 * sizeof(short) * (*maxu) +	/* u_s */
+		2 * sizeof(short) * len;	/* y_tilde_s */
+}
+
+static inline struct echo_can_state *echo_can_create(int len, int adaption_mode)
+{
+	struct echo_can_state *ec;
+	int maxy;
+	int maxu;
+
+	ec = (struct echo_can_state *)ZMALLOC(echo_can_size(len, &maxy,
+		&maxu));
+	if (ec) {
 		init_cc(ec, len, maxy, maxu);
+		ec->update_block = echo_can_select_block(len);
+	}
 	return ec;
 }
 
+/* reinitialise a canceller, so it can be reused by another call */
+static inline void echo_can_reset(struct echo_can_state *ec)
+{
+	int len = ec->N_d;
+	int maxy;
+	int maxu;
+
+	memset(ec, 0, echo_can_size(len, &maxy, &maxu));
+	init_cc(ec, len, maxy, maxu);
+	ec->update_block = echo_can_select_block(len);
+}
+#define echo_can_reset echo_can_reset
+
 static inline int
 echo_can_traintap(struct echo_can_state *ec, int pos, short val)
 {
@@ -0,0 +1,311 @@
+/*
+ * dsp_mktables.c
+ *
+ * Host program, which generates the conversion tables of mISDN_dsp for
+ * both laws at build time (dsp_tables.c). The tables are constant and
+ * dsp_audio_select_law() only picks the ones of the law in use, so
+ * nothing is generated or allocated when the module is loaded.
+ *
+ * Copyright 2002/2003 by Andreas Eversberg (jolly@eversberg.eu)
+ *
+ * This software may be used and distributed according to the terms
+ * of the GNU General Public License, incorporated herein by reference.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* must be the same as DSP_MAG_TABLE_SIZE of dsp.h */
+#define MAG_TABLE_SIZE	4097
+
+#define AMI_MASK 0x55
+
+static unsigned char linear2alaw(short int linear)
+{
+	int mask;
+	int seg;
+	int pcm_val;
+	static int seg_end[8] = {
+		0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF
+	};
+
+	pcm_val = linear;
+	if (pcm_val >= 0) {
+		/* Sign (7th) bit = 1 */
+		mask = AMI_MASK | 0x80;
+	} else {
+		/* Sign bit = 0 */
+		mask = AMI_MASK;
+		pcm_val = -pcm_val;
+	}
+
+	/* Convert the scaled magnitude to segment number. */
+	for (seg = 0; seg < 8; seg++) {
+		if (pcm_val <= seg_end[seg])
+			break;
+	}
+	/* Combine the sign, segment, and quantization bits. */
+	return  ((seg << 4) |
+		 ((pcm_val >> ((seg)  ?  (seg + 3)  :  4)) & 0x0F)) ^ mask;
+}
+
+static short int alaw2linear(unsigned char alaw)
+{
+	int i;
+	int seg;
+
+	alaw ^= AMI_MASK;
+	i = ((alaw & 0x0F) << 4) + 8 /* rounding error */;
+	seg = (((int) alaw & 0x70) >> 4);
+	if (seg)
+		i = (i + 0x100) << (seg - 1);
+	return (short int) ((alaw & 0x80)  ?  i  :  -i);
+}
+
+static short int ulaw2linear(unsigned char ulaw)
+{
+	short mu, e, f, y;
+	static short etab[] = {0, 132, 396, 924, 1980, 4092, 8316, 16764};
+
+	mu = 255 - ulaw;
+	e = (mu & 0x70) / 16;
+	f = mu & 0x0f;
+	y = f * (1 << (e + 3));
+	y += etab[e];
+	if (mu & 0x80)
+		y = -y;
+	return y;
+}
+
+#define BIAS 0x84   /*!< define the add-in bias for 16 bit samples */
+
+static unsigned char linear2ulaw(short sample)
+{
+	static const unsigned char exp_lut[256] = {
+		0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3,
+		4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4, 4,
+		5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+		5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+		6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+		6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+		6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+		6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+		7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7};
+	int sign, exponent, mantissa;
+	unsigned char ulawbyte;
+
+	/* Get the sample into sign-magnitude. */
+	sign = (sample >> 8) & 0x80;	  /* set aside the sign */
+	if (sign != 0)
+		sample = -sample;	      /* get magnitude */
+
+	/* Convert from 16 bit linear to ulaw. */
+	sample = sample + BIAS;
+	exponent = exp_lut[(sample >> 7) & 0xFF];
+	mantissa = (sample >> (exponent + 3)) & 0x0F;
+	ulawbyte = ~(sign | (exponent << 4) | mantissa);
+
+	return ulawbyte;
+}
+
+static uint8_t bitrev8(uint8_t b)
+{
+	b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+	b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+	return (b & 0xaa) >> 1 | (b & 0x55) << 1;
+}
+
+static int32_t alaw_to_s32[256], ulaw_to_s32[256];
+static uint8_t alaw_to_ulaw[256], ulaw_to_alaw[256];
+static uint8_t sorted_alaw[256];
+
+/* the tables of one law */
+static uint8_t s16_to_law[65536];
+static uint8_t mag_to_law[MAG_TABLE_SIZE];
+static uint8_t seven2law[128];
+static uint8_t law2seven[256];
+static uint8_t mix_law[65536];
+static uint8_t volume_change[16][256];
+
+static void print_s32(const char *name, const int32_t *t, int n)
+{
+	int i;
+
+	printf("\nconst s32 %s[%d] = {\n", name, n);
+	for (i = 0; i < n; i++)
+		printf("%s%d,%s", (i & 7) ? " " : "\t", t[i],
+		       ((i & 7) == 7 || i == n - 1) ? "\n" : "");
+	printf("};\n");
+}
+
+static void print_u8s(const char *indent, const uint8_t *t, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		printf("%s0x%02x,%s", (i & 7) ? " " : indent, t[i],
+		       ((i & 7) == 7 || i == n - 1) ? "\n" : "");
+}
+
+static void print_u8(const char *name, const char *size, const uint8_t *t,
+		     int n)
+{
+	printf("\nconst u8 %s[%s] = {\n", name, size);
+	print_u8s("\t", t, n);
+	printf("};\n");
+}
+
+static void gen_common(void)
+{
+	int i, j, k;
+
+	for (i = 0; i < 256; i++)
+		alaw_to_s32[i] = alaw2linear(bitrev8((uint8_t)i));
+
+	for (i = 0; i < 256; i++)
+		ulaw_to_s32[i] = ulaw2linear(bitrev8((uint8_t)i));
+
+	for (i = 0; i < 256; i++) {
+		alaw_to_ulaw[i] = linear2ulaw(alaw_to_s32[i]);
+		ulaw_to_alaw[i] = linear2alaw(ulaw_to_s32[i]);
+	}
+
+	/* alaw, sorted by the linear value */
+	for (i = 0; i < 256; i++) {
+		j = 0;
+		for (k = 0; k < 256; k++) {
+			if (alaw_to_s32[k] < alaw_to_s32[i])
+				j++;
+		}
+		sorted_alaw[j] = i;
+	}
+}
+
+static void gen_law(int ulaw)
+{
+	const int32_t *law_to_s32 = ulaw ? ulaw_to_s32 : alaw_to_s32;
+	static const int num[] = { 110, 125, 150, 175, 200, 300, 400, 500 };
+	int round, shift;
+	int32_t sample;
+	int i, j;
+	uint8_t spl;
+
+	/* s16 -> law */
+	for (i = -32768; i < 32768; i++)
+		s16_to_law[i & 0xffff] =
+			bitrev8(ulaw ? linear2ulaw(i) : linear2alaw(i));
+
+	/*
+	 * compact table from the smallest magnitude of each step,
+	 * ulaw steps by 8 and the bias moves the steps by 4, alaw steps by 16
+	 */
+	round = ulaw ? 4 : 0;
+	shift = ulaw ? 3 : 4;
+	for (i = 0; i < MAG_TABLE_SIZE; i++)
+		mag_to_law[i] = 0;
+	for (i = 32767; i >= 0; i--)
+		mag_to_law[(i + round) >> shift] = s16_to_law[i];
+
+	/* law from/to 7-bit alaw-like sample */
+	for (i = 0; i < 256; i++) {
+		/* spl is the source: the law-sample (converted to alaw) */
+		spl = ulaw ? ulaw_to_alaw[i] : i;
+		for (j = 0; j < 256; j++) {
+			if (sorted_alaw[j] == spl)
+				break;
+		}
+		law2seven[i] = j >> 1;
+	}
+	for (i = 0; i < 128; i++) {
+		spl = sorted_alaw[i << 1];
+		seven2law[i] = ulaw ? alaw_to_ulaw[spl] : spl;
+	}
+
+	/* mix 2*law -> law */
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 256; j++) {
+			sample = law_to_s32[i] + law_to_s32[j];
+			if (sample > 32767)
+				sample = 32767;
+			if (sample < -32768)
+				sample = -32768;
+			mix_law[(i << 8) | j] = s16_to_law[sample & 0xffff];
+		}
+	}
+
+	/* volume changes, reduce by 8 ... 1, then increase by 1 ... 8 */
+	for (i = 0; i < 256; i++) {
+		for (j = 0; j < 8; j++) {
+			volume_change[7 - j][i] = s16_to_law[
+				(law_to_s32[i] * 100 / num[j]) & 0xffff];
+			sample = law_to_s32[i] * num[j] / 100;
+			if (sample < -32768)
+				sample = -32768;
+			else if (sample > 32767)
+				sample = 32767;
+			volume_change[8 + j][i] = s16_to_law[sample & 0xffff];
+		}
+	}
+}
+
+static void print_law(const char *law)
+{
+	char name[64];
+	int i;
+
+	/* the 64KB tables are not built in with the compact encoder */
+	printf("\n#ifndef CONFIG_MISDN_DSP_COMPACT\n");
+	snprintf(name, sizeof(name), "dsp_audio_s16_to_%s", law);
+	print_u8(name, "65536", s16_to_law, 65536);
+	snprintf(name, sizeof(name), "dsp_audio_mix_%s", law);
+	print_u8(name, "65536", mix_law, 65536);
+	printf("#endif\n");
+	snprintf(name, sizeof(name), "dsp_audio_mag_to_%s", law);
+	print_u8(name, "DSP_MAG_TABLE_SIZE", mag_to_law, MAG_TABLE_SIZE);
+	snprintf(name, sizeof(name), "dsp_audio_seven2%s", law);
+	print_u8(name, "128", seven2law, 128);
+	snprintf(name, sizeof(name), "dsp_audio_%s2seven", law);
+	print_u8(name, "256", law2seven, 256);
+
+	printf("\nconst u8 dsp_audio_volume_%s[16][256] = {\n", law);
+	for (i = 0; i < 16; i++) {
+		printf("\t{\n");
+		print_u8s("\t\t", volume_change[i], 256);
+		printf("\t},\n");
+	}
+	printf("};\n");
+}
+
+int main(void)
+{
+	printf("/*\n"
+	       " * Conversion tables of mISDN_dsp for alaw and ulaw.\n"
+	       " *\n"
+	       " * Generated by dsp_mktables, do not edit.\n"
+	       " */\n\n"
+	       "#include <linux/mISDNif.h>\n"
+	       "#include <linux/mISDNdsp.h>\n"
+	       "#include \"core.h\"\n"
+	       "#include \"dsp.h\"\n");
+
+	gen_common();
+	print_s32("dsp_audio_alaw_to_s32", alaw_to_s32, 256);
+	print_s32("dsp_audio_ulaw_to_s32", ulaw_to_s32, 256);
+	print_u8("dsp_audio_alaw_to_ulaw", "256", alaw_to_ulaw, 256);
+	print_u8("dsp_audio_ulaw_to_alaw", "256", ulaw_to_alaw, 256);
+
+	gen_law(0);
+	print_law("alaw");
+	gen_law(1);
+	print_law("ulaw");
+
+	return 0;
+}
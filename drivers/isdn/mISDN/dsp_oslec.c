@@ -32,9 +32,12 @@
 #include "core.h"
 #include "dsp.h"
 #include "oslec.h"
+#include "oslec_simd.h"
 #define echo_can_create oslec_echo_can_create
 #define echo_can_free oslec_echo_can_free
+#define echo_can_reset oslec_echo_can_reset
 #define echo_can_update oslec_echo_can_update
+#define echo_can_update_block oslec_echo_can_update_block
 #define echo_can_traintap oslec_echo_can_traintap
 #include "dsp_cancel.h"
 
@@ -116,11 +119,14 @@ static struct mISDN_dsp_element dsp_oslec = {
 	.process_rx = process_rx,
 	.num_args = sizeof(args) / sizeof(struct mISDN_dsp_element_arg),
 	.args = args,
+	.flags = MISDN_DSP_ELEM_ECHOCAN,
 };
 
 #ifdef MODULE
 static int __init dsp_oslec_init(void)
 {
+	oslec_simd_init();
+	dsp_cancel_pool_init();
 	mISDN_dsp_element_register(&dsp_oslec);
 
 	return 0;
@@ -129,6 +135,7 @@ static int __init dsp_oslec_init(void)
 static void __exit dsp_oslec_exit(void)
 {
 	mISDN_dsp_element_unregister(&dsp_oslec);
+	dsp_cancel_pool_exit();
 }
 
 module_init(dsp_oslec_init);
@@ -197,6 +197,10 @@ int dsp_pipeline_init(struct dsp_pipeline *pipeline)
 		return -EINVAL;
 
 	INIT_LIST_HEAD(&pipeline->list);
+	pipeline->num_tx = 0;
+	pipeline->num_rx = 0;
+	pipeline->tx = NULL;
+	pipeline->rx = NULL;
 
 #ifdef PIPELINE_DEBUG
 	printk(KERN_DEBUG "%s: dsp pipeline ready\n", __func__);
@@ -209,6 +213,13 @@ static inline void _dsp_pipeline_destroy(struct dsp_pipeline *pipeline)
 {
 	struct dsp_pipeline_entry *entry, *n;
 
+	/* tx and rx share one allocation */
+	kfree(pipeline->tx);
+	pipeline->tx = NULL;
+	pipeline->rx = NULL;
+	pipeline->num_tx = 0;
+	pipeline->num_rx = 0;
+
 	list_for_each_entry_safe(entry, n, &pipeline->list, list) {
 		list_del(&entry->list);
 		if (entry->elem == dsp_hwec)
@@ -233,6 +244,48 @@ void dsp_pipeline_destroy(struct dsp_pipeline *pipeline)
 #endif
 }
 
+/*
+ * compile the list of entries into flat arrays, so processing a frame does
+ * not walk the list and does not check each element for its functions.
+ * returns 0 on success or if there is nothing to process.
+ */
+static int dsp_pipeline_compile(struct dsp_pipeline *pipeline)
+{
+	struct dsp_pipeline_entry *entry;
+	int num = 0;
+
+	list_for_each_entry(entry, &pipeline->list, list)
+		num++;
+	if (!num)
+		return 0;
+
+	pipeline->tx = kmalloc(num * (sizeof(struct dsp_pipeline_tx) +
+				      sizeof(struct dsp_pipeline_rx)),
+			       GFP_ATOMIC);
+	if (!pipeline->tx)
+		return -ENOMEM;
+	pipeline->rx = (struct dsp_pipeline_rx *)(pipeline->tx + num);
+
+	list_for_each_entry(entry, &pipeline->list, list) {
+		if (!entry->elem->process_tx)
+			continue;
+		pipeline->tx[pipeline->num_tx].process_tx =
+			entry->elem->process_tx;
+		pipeline->tx[pipeline->num_tx].p = entry->p;
+		pipeline->num_tx++;
+	}
+	list_for_each_entry_reverse(entry, &pipeline->list, list) {
+		if (!entry->elem->process_rx)
+			continue;
+		pipeline->rx[pipeline->num_rx].process_rx =
+			entry->elem->process_rx;
+		pipeline->rx[pipeline->num_rx].p = entry->p;
+		pipeline->num_rx++;
+	}
+
+	return 0;
+}
+
 int dsp_pipeline_build(struct dsp_pipeline *pipeline, const char *cfg)
 {
 	int incomplete = 0, found = 0;
@@ -276,8 +329,18 @@ int dsp_pipeline_build(struct dsp_pipeline *pipeline, const char *cfg)
 				if (elem == dsp_hwec) {
 					/* This is a hack to make the hwec
 					   available as a pipeline module */
-					dsp_hwec_enable(container_of(pipeline,
-								     struct dsp, pipeline), args);
+					if (dsp_hwec_enable(container_of(pipeline,
+								     struct dsp, pipeline), args)) {
+						kfree(pipeline_entry);
+						incomplete = 1;
+					} else
+						list_add_tail(&pipeline_entry->list,
+							      &pipeline->list);
+				} else if ((elem->flags & MISDN_DSP_ELEM_ECHOCAN) &&
+					   !dsp_hwec_auto(container_of(pipeline,
+								       struct dsp, pipeline), args)) {
+					/* the hardware cancels the echo */
+					pipeline_entry->elem = dsp_hwec;
 					list_add_tail(&pipeline_entry->list,
 						      &pipeline->list);
 				} else {
@@ -315,6 +378,12 @@ int dsp_pipeline_build(struct dsp_pipeline *pipeline, const char *cfg)
 	}
 
 _out:
+	if (dsp_pipeline_compile(pipeline)) {
+		printk(KERN_ERR "%s: failed to compile pipeline (out of "
+		       "memory)\n", __func__);
+		_dsp_pipeline_destroy(pipeline);
+		incomplete = 1;
+	}
 	if (!list_empty(&pipeline->list))
 		pipeline->inuse = 1;
 	else
@@ -330,25 +399,34 @@ _out:
 
 void dsp_pipeline_process_tx(struct dsp_pipeline *pipeline, u8 *data, int len)
 {
-	struct dsp_pipeline_entry *entry;
+	struct dsp_pipeline_tx *stage, *end;
 
 	if (!pipeline)
 		return;
 
-	list_for_each_entry(entry, &pipeline->list, list)
-		if (entry->elem->process_tx)
-			entry->elem->process_tx(entry->p, data, len);
+	stage = pipeline->tx;
+	/* the common case is a single element, e.g. an echo canceller */
+	if (pipeline->num_tx == 1) {
+		stage->process_tx(stage->p, data, len);
+		return;
+	}
+	for (end = stage + pipeline->num_tx; stage < end; stage++)
+		stage->process_tx(stage->p, data, len);
 }
 
 void dsp_pipeline_process_rx(struct dsp_pipeline *pipeline, u8 *data, int len,
 			     unsigned int txlen)
 {
-	struct dsp_pipeline_entry *entry;
+	struct dsp_pipeline_rx *stage, *end;
 
 	if (!pipeline)
 		return;
 
-	list_for_each_entry_reverse(entry, &pipeline->list, list)
-		if (entry->elem->process_rx)
-			entry->elem->process_rx(entry->p, data, len, txlen);
+	stage = pipeline->rx;
+	if (pipeline->num_rx == 1) {
+		stage->process_rx(stage->p, data, len, txlen);
+		return;
+	}
+	for (end = stage + pipeline->num_rx; stage < end; stage++)
+		stage->process_rx(stage->p, data, len, txlen);
 }
@@ -0,0 +1,277 @@
+/*
+ * dsp_record.c: recording tap of the audio of dsp instances
+ *
+ * DSP_RECORD_ON gives an instance a record id. The recorder opens
+ * /dev/mISDNrecord and attaches to that id with IMDSPRECORD, see mISDNif.h.
+ * From then on, each frame from the line and each frame to the line is
+ * copied once into the ring of the file, right where the dsp handles the
+ * frame anyway. No skb is allocated and nothing is queued, the recorder
+ * takes the frames in batches without a system call per frame.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/miscdevice.h>
+#include <linux/module.h>
+#include <linux/mISDNif.h>
+#include <linux/mISDNdsp.h>
+#include "core.h"
+#include "dsp.h"
+
+#define RECORD_MAX_FRAMES	4096
+#define RECORD_MAX_SIZE		(4 << 20)
+
+/*
+ * the ring of a file. dsp is set while attached, it changes only while
+ * dsp_lock and the data lock of the dsp are held. the user may write the
+ * mapped header, so the geometry of the ring is kept here.
+ */
+struct dsp_record {
+	struct dsp		*dsp;
+	struct mISDN_ring_hdr	*hdr;
+	u_int			frame_size;
+	u_int			frames;
+	u_int			offset;	/* of the first frame */
+	u_int			head;
+	u_int			block;	/* frames per wakeup */
+	u_int			cnt;	/* frames since the last wakeup */
+	wait_queue_head_t	wait;
+};
+
+static DEFINE_MUTEX(record_mutex);
+static int record_registered;
+
+/* give a frame to the recorder, the data lock of the dsp is held */
+void
+dsp_record_frame(struct dsp *dsp, u_int prim, const u8 *data, int len)
+{
+	struct dsp_record	*rec = dsp->record;
+	struct mISDN_ring_hdr	*hdr = rec->hdr;
+	struct mISDN_ring_frame	*f;
+
+	f = (void *)hdr + rec->offset + rec->head * rec->frame_size;
+	if (READ_ONCE(f->status) != MISDN_RING_KERNEL ||
+	    len > rec->frame_size - MISDN_RING_FRAME_HDR) {
+		hdr->rx_dropped++;
+		return;
+	}
+	/* the status is read before the frame is written */
+	smp_mb();
+	f->len = len;
+	f->prim = prim;
+	f->id = mISDN_clock_get();
+	f->tstamp = ktime_get_real_ns();
+	memcpy((void *)f + MISDN_RING_FRAME_HDR, data, len);
+	/* the frame is written before the user gets it */
+	smp_store_release(&f->status, MISDN_RING_USER);
+	if (++rec->head == rec->frames)
+		rec->head = 0;
+	if (++rec->cnt >= rec->block) {
+		rec->cnt = 0;
+		wake_up_interruptible(&rec->wait);
+	}
+}
+
+/* dsp_lock and the data lock of the dsp are held */
+static void
+record_detach(struct dsp_record *rec)
+{
+	rec->dsp->record = NULL;
+	WRITE_ONCE(rec->dsp, NULL);
+	wake_up_interruptible(&rec->wait);
+}
+
+/* stop recording (DSP_RECORD_OFF), dsp_lock and the data lock are held */
+void
+dsp_record_off(struct dsp *dsp)
+{
+	dsp->record_id = 0;
+	if (dsp->record)
+		record_detach(dsp->record);
+}
+
+static int
+record_attach(struct file *filep, struct mISDN_dsp_record *req)
+{
+	struct dsp_record	*rec;
+	struct mISDN_ring_hdr	*hdr;
+	struct dsp		*dsp;
+	spinlock_t		*lock;
+	size_t			size;
+	u_long			flags, dflags;
+
+	if (filep->private_data)
+		return -EBUSY;
+	if (!req->id || req->frame_size <= MISDN_RING_FRAME_HDR ||
+	    req->frame_size & 15 ||
+	    req->frame_size > MISDN_RING_FRAME_HDR + MAX_DATA_MEM ||
+	    !req->frames || req->frames > RECORD_MAX_FRAMES)
+		return -EINVAL;
+	size = ALIGN(sizeof(*hdr), 64) + (size_t)req->frames * req->frame_size;
+	if (size > RECORD_MAX_SIZE)
+		return -EINVAL;
+	rec = kzalloc(sizeof(*rec), GFP_KERNEL);
+	if (!rec)
+		return -ENOMEM;
+	/* zeroed, so all frames belong to the kernel */
+	hdr = vmalloc_user(size);
+	if (!hdr) {
+		kfree(rec);
+		return -ENOMEM;
+	}
+	hdr->frame_size = req->frame_size;
+	hdr->rx_frames = req->frames;
+	hdr->rx_offset = ALIGN(sizeof(*hdr), 64);
+	hdr->tx_offset = size;
+	rec->hdr = hdr;
+	rec->frame_size = hdr->frame_size;
+	rec->frames = hdr->rx_frames;
+	rec->offset = hdr->rx_offset;
+	rec->block = clamp_t(u_int, req->block, 1, req->frames);
+	init_waitqueue_head(&rec->wait);
+
+	spin_lock_irqsave(&dsp_lock, flags);
+	list_for_each_entry(dsp, &dsp_ilist, list) {
+		if (dsp->record_id == req->id && !dsp->record) {
+			lock = dsp_lock_data(dsp, &dflags);
+			dsp->record = rec;
+			rec->dsp = dsp;
+			spin_unlock_irqrestore(lock, dflags);
+			spin_unlock_irqrestore(&dsp_lock, flags);
+			filep->private_data = rec;
+			return 0;
+		}
+	}
+	spin_unlock_irqrestore(&dsp_lock, flags);
+	vfree(hdr);
+	kfree(rec);
+	return -ENOENT;
+}
+
+static long
+record_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+	struct mISDN_dsp_record	req;
+	int			ret;
+
+	switch (cmd) {
+	case IMDSPRECORD:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		mutex_lock(&record_mutex);
+		ret = record_attach(filep, &req);
+		mutex_unlock(&record_mutex);
+		return ret;
+	}
+	return -EINVAL;
+}
+
+static int
+record_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+	struct dsp_record	*rec;
+	int			err = -EINVAL;
+
+	mutex_lock(&record_mutex);
+	rec = filep->private_data;
+	if (rec && !vma->vm_pgoff)
+		err = remap_vmalloc_range(vma, rec->hdr, 0);
+	mutex_unlock(&record_mutex);
+	return err;
+}
+
+static unsigned int
+record_poll(struct file *filep, poll_table *wait)
+{
+	struct dsp_record	*rec = READ_ONCE(filep->private_data);
+	struct mISDN_ring_hdr	*hdr;
+	struct mISDN_ring_frame	*f;
+	unsigned int		mask = 0;
+	u_int			nr;
+
+	if (!rec)
+		return POLLERR;
+	poll_wait(filep, &rec->wait, wait);
+	hdr = rec->hdr;
+	/* the last frame given to the user is not back yet */
+	nr = READ_ONCE(rec->head);
+	nr = (nr ? nr : rec->frames) - 1;
+	f = (void *)hdr + rec->offset + nr * rec->frame_size;
+	if (READ_ONCE(f->status) == MISDN_RING_USER)
+		mask |= POLLIN | POLLRDNORM;
+	if (!READ_ONCE(rec->dsp))
+		mask |= POLLHUP;
+	return mask;
+}
+
+static int
+record_open(struct inode *ino, struct file *filep)
+{
+	filep->private_data = NULL;
+	return nonseekable_open(ino, filep);
+}
+
+static int
+record_close(struct inode *ino, struct file *filep)
+{
+	struct dsp_record	*rec = filep->private_data;
+	spinlock_t		*lock;
+	u_long			flags, dflags;
+
+	if (!rec)
+		return 0;
+	spin_lock_irqsave(&dsp_lock, flags);
+	if (rec->dsp) {
+		lock = dsp_lock_data(rec->dsp, &dflags);
+		record_detach(rec);
+		spin_unlock_irqrestore(lock, dflags);
+	}
+	spin_unlock_irqrestore(&dsp_lock, flags);
+	vfree(rec->hdr);
+	kfree(rec);
+	return 0;
+}
+
+static const struct file_operations record_fops = {
+	.owner		= THIS_MODULE,
+	.poll		= record_poll,
+	.unlocked_ioctl	= record_ioctl,
+	.mmap		= record_mmap,
+	.open		= record_open,
+	.release	= record_close,
+	.llseek		= no_llseek,
+};
+
+static struct miscdevice record_dev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "mISDNrecord",
+	.fops	= &record_fops,
+};
+
+int
+dsp_record_init(void)
+{
+	int	err;
+
+	err = misc_register(&record_dev);
+	record_registered = !err;
+	return err;
+}
+
+void
+dsp_record_exit(void)
+{
+	if (record_registered)
+		misc_deregister(&record_dev);
+}
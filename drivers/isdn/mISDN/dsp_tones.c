@@ -237,6 +237,8 @@ static struct pattern {
 	u8 *data[10];
 	u32 *siz[10];
 	u32 seq[10];
+	u32 start[10];		/* offset of each sequence in stream */
+	struct sk_buff *stream;	/* whole period, see dsp_tone_stream_init */
 } pattern[] = {
 	{TONE_GERMAN_DIALTONE,
 	 {DATA_GA, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL},
@@ -430,6 +432,124 @@ void dsp_tone_copy(struct dsp *dsp, u8 *data, int len)
 }
 
 
+/*******************
+ * clone tone data *
+ *******************/
+
+/*
+ * instead of copying the samples for each dsp instance, a clone of the
+ * precalculated stream of the pattern is returned. the stream holds the
+ * whole period, followed by the beginning of the period again, so any
+ * window of up to MAX_POLL + 100 samples is linear.
+ * the clone shares the data with all other instances playing the same
+ * tone, so it must not be altered.
+ *
+ * return - the sk_buff or NULL, if the tone must be copied
+ */
+struct sk_buff *
+dsp_tone_clone(struct dsp *dsp, int len)
+{
+	struct dsp_tone *tone = &dsp->tone;
+	struct pattern *pat = (struct pattern *)tone->pattern;
+	struct sk_buff *nskb;
+	int index, count;
+
+	if (!tone->tone || !pat->stream || len > MAX_POLL + 100)
+		return NULL;
+
+	index = tone->index;
+	count = tone->count;
+	/* find sample to start with, just like dsp_tone_copy */
+	while (42) {
+		if (!pat->seq[index]) {
+			count = 0;
+			index = 0;
+		}
+		if (count < pat->seq[index])
+			break;
+		count -= pat->seq[index];
+		index++;
+	}
+
+	nskb = skb_clone(pat->stream, GFP_ATOMIC);
+	if (!nskb)
+		return NULL;
+	skb_pull(nskb, pat->start[index] + count);
+	skb_trim(nskb, len);
+
+	/* advance pattern */
+	count += len;
+	while (count >= pat->seq[index]) {
+		if (dsp_debug & DEBUG_DSP_TONE)
+			printk(KERN_DEBUG "%s: reaching next sequence "
+			       "(index=%d)\n", __func__, index);
+		count -= pat->seq[index];
+		index++;
+		if (!pat->seq[index])
+			index = 0;
+	}
+	tone->index = index;
+	tone->count = count;
+
+	return nskb;
+}
+
+
+/*
+ * precalculate the stream of each pattern. this must be called after the
+ * samples have been converted to the law in use.
+ * if a stream cannot be allocated, the tone is copied for each instance.
+ */
+void
+dsp_tone_stream_init(void)
+{
+	struct pattern *pat;
+	struct sk_buff *skb;
+	u32 period;
+	int index;
+	u8 *d;
+
+	for (pat = pattern; pat->tone; pat++) {
+		period = 0;
+		for (index = 0; index < 10 && pat->seq[index]; index++) {
+			pat->start[index] = period;
+			period += pat->seq[index];
+		}
+		if (period < MAX_POLL + 100)
+			continue;
+		skb = alloc_skb(period + MAX_POLL + 100, GFP_KERNEL);
+		if (!skb) {
+			printk(KERN_WARNING "%s: no memory for stream of "
+			       "tone 0x%x, copying instead\n", __func__,
+			       pat->tone);
+			continue;
+		}
+		d = skb_put(skb, period + MAX_POLL + 100);
+		for (index = 0; index < 10 && pat->seq[index]; index++) {
+			u32 i, siz = *(pat->siz[index]);
+
+			for (i = 0; i < pat->seq[index]; i++)
+				*d++ = pat->data[index][i % siz];
+		}
+		/* repeat the beginning for windows that wrap around */
+		memcpy(d, skb->data, MAX_POLL + 100);
+		pat->stream = skb;
+	}
+}
+
+void
+dsp_tone_stream_exit(void)
+{
+	struct pattern *pat;
+
+	for (pat = pattern; pat->tone; pat++) {
+		if (pat->stream)
+			dev_kfree_skb(pat->stream);
+		pat->stream = NULL;
+	}
+}
+
+
 /*******************************
  * send HW message to hfc card *
  *******************************/
@@ -453,34 +573,40 @@ dsp_tone_hw_message(struct dsp *dsp, u8 *sample, int len)
 }
 
 
-/*****************
- * timer expires *
- *****************/
+/*********************
+ * clock the pattern *
+ *********************/
+
+/*
+ * hardware tones are switched from the cmx tick, so no timer is required for
+ * each dsp instance. the pattern follows the sample clock instead of jiffies.
+ * must be called with the data path of the dsp locked.
+ */
 void
-dsp_tone_timeout(void *arg)
+dsp_tone_clock(struct dsp *dsp, int len)
 {
-	struct dsp *dsp = arg;
 	struct dsp_tone *tone = &dsp->tone;
 	struct pattern *pat = (struct pattern *)tone->pattern;
 	int index = tone->index;
+	int count = tone->count + len;
 
-	if (!tone->tone)
+	if (!tone->tone || !tone->hardware)
 		return;
 
-	index++;
-	if (!pat->seq[index])
-		index = 0;
+	while (count >= pat->seq[index]) {
+		count -= pat->seq[index];
+		index++;
+		if (!pat->seq[index])
+			index = 0;
+		/* set next tone */
+		if (pat->data[index] == DATA_S)
+			dsp_tone_hw_message(dsp, NULL, 0);
+		else
+			dsp_tone_hw_message(dsp, pat->data[index],
+					    *(pat->siz[index]));
+	}
 	tone->index = index;
-
-	/* set next tone */
-	if (pat->data[index] == DATA_S)
-		dsp_tone_hw_message(dsp, NULL, 0);
-	else
-		dsp_tone_hw_message(dsp, pat->data[index], *(pat->siz[index]));
-	/* set timer */
-	init_timer(&tone->tl);
-	tone->tl.expires = jiffies + (pat->seq[index] * HZ) / 8000;
-	add_timer(&tone->tl);
+	tone->count = count;
 }
 
 
@@ -491,7 +617,7 @@ dsp_tone_timeout(void *arg)
 /*
  * tones are relaized by streaming or by special loop commands if supported
  * by hardware. when hardware is used, the patterns will be controlled by
- * timers.
+ * the cmx tick, see dsp_tone_clock.
  */
 int
 dsp_tone(struct dsp *dsp, int tone)
@@ -505,8 +631,6 @@ dsp_tone(struct dsp *dsp, int tone)
 
 	/* we turn off the tone */
 	if (!tone) {
-		if (dsp->features.hfc_loops && timer_pending(&tonet->tl))
-			del_timer(&tonet->tl);
 		if (dsp->features.hfc_loops)
 			dsp_tone_hw_message(dsp, NULL, 0);
 		tonet->tone = 0;
@@ -538,12 +662,6 @@ dsp_tone(struct dsp *dsp, int tone)
 		tonet->hardware = 1;
 		/* set first tone */
 		dsp_tone_hw_message(dsp, pat->data[0], *(pat->siz[0]));
-		/* set timer */
-		if (timer_pending(&tonet->tl))
-			del_timer(&tonet->tl);
-		init_timer(&tonet->tl);
-		tonet->tl.expires = jiffies + (pat->seq[0] * HZ) / 8000;
-		add_timer(&tonet->tl);
 	} else {
 		tonet->software = 1;
 	}
@@ -0,0 +1,428 @@
+/*
+ * dsp_uspace.c: mISDN dsp pipeline element for processing in user space
+ *
+ * The element "uspace" gives the audio of its instance to a user space
+ * worker through shared rings, see IMDSPATTACH in mISDNif.h. The worker may
+ * use SIMD and as many threads as it likes, one file per instance. The
+ * element is called in the tick, so it never waits: the processed audio is
+ * taken as far as it is back, the rest is passed unprocessed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/kref.h>
+#include <linux/miscdevice.h>
+#include <linux/module.h>
+#include <linux/mISDNif.h>
+#include <linux/mISDNdsp.h>
+
+#define USPACE_FIFO		1024	/* processed samples per direction */
+#define USPACE_MAX_FRAMES	1024
+#define USPACE_MAX_SIZE		(4 << 20)
+
+static u_int debug;
+module_param(debug, uint, S_IRUGO | S_IWUSR);
+
+/* processed audio of one direction, until the next frame takes it */
+struct uspace_fifo {
+	u_int	head;
+	u_int	cnt;
+	u8	data[USPACE_FIFO];
+};
+
+struct uspace_inst {
+	struct list_head	list;
+	struct kref		ref;	/* pipeline and file */
+	u_int			id;
+	int			dead;	/* removed from the pipeline */
+	spinlock_t		lock;	/* ring and fifos */
+	struct mISDN_ring_hdr	*hdr;	/* if attached */
+	/* the worker may write the mapped header, so this is the geometry */
+	u_int			frame_size;
+	u_int			frames;	/* per direction */
+	u_int			rx_offset;
+	u_int			tx_offset;
+	u_int			rx_head;
+	u_int			tx_head;
+	struct uspace_fifo	out[2];	/* PH_DATA_REQ, PH_DATA_IND */
+	u_long			underrun;
+	wait_queue_head_t	wait;
+};
+
+static LIST_HEAD(uspace_list);
+static DEFINE_SPINLOCK(uspace_lock);
+
+static void
+uspace_release(struct kref *ref)
+{
+	kfree(container_of(ref, struct uspace_inst, ref));
+}
+
+static inline struct mISDN_ring_frame *
+uspace_frame(struct uspace_inst *inst, u_int offset, u_int nr)
+{
+	return (void *)inst->hdr + offset + nr * inst->frame_size;
+}
+
+static void
+uspace_fifo_put(struct uspace_fifo *f, const u8 *data, int len)
+{
+	u_int	tail, n;
+
+	/* drop the oldest, if the worker is too far ahead */
+	if (len > USPACE_FIFO) {
+		data += len - USPACE_FIFO;
+		len = USPACE_FIFO;
+	}
+	if (f->cnt + len > USPACE_FIFO) {
+		n = f->cnt + len - USPACE_FIFO;
+		f->head = (f->head + n) % USPACE_FIFO;
+		f->cnt -= n;
+	}
+	tail = (f->head + f->cnt) % USPACE_FIFO;
+	n = min_t(u_int, len, USPACE_FIFO - tail);
+	memcpy(f->data + tail, data, n);
+	memcpy(f->data, data + n, len - n);
+	f->cnt += len;
+}
+
+static void
+uspace_fifo_get(struct uspace_fifo *f, u8 *data, int len)
+{
+	u_int	n = min_t(u_int, len, USPACE_FIFO - f->head);
+
+	memcpy(data, f->data + f->head, n);
+	memcpy(data + n, f->data, len - n);
+	f->head = (f->head + len) % USPACE_FIFO;
+	f->cnt -= len;
+}
+
+/* take the processed frames the worker gave back, one round at most */
+static void
+uspace_take(struct uspace_inst *inst)
+{
+	struct mISDN_ring_frame	*f;
+	u_int			len, prim, i;
+
+	for (i = 0; i < inst->frames; i++) {
+		f = uspace_frame(inst, inst->tx_offset, inst->tx_head);
+		if (smp_load_acquire(&f->status) != MISDN_RING_USER)
+			break;
+		len = READ_ONCE(f->len);
+		prim = READ_ONCE(f->prim);
+		if (len > inst->frame_size - MISDN_RING_FRAME_HDR ||
+		    (prim != PH_DATA_REQ && prim != PH_DATA_IND))
+			inst->hdr->tx_errors++;
+		else
+			uspace_fifo_put(&inst->out[prim == PH_DATA_IND],
+					(void *)f + MISDN_RING_FRAME_HDR, len);
+		/* the frame is read before the user gets it back */
+		smp_store_release(&f->status, MISDN_RING_KERNEL);
+		if (++inst->tx_head == inst->frames)
+			inst->tx_head = 0;
+	}
+}
+
+/* give a frame to the worker */
+static void
+uspace_give(struct uspace_inst *inst, u_int prim, const u8 *data, int len,
+	    u_int txlen)
+{
+	struct mISDN_ring_frame	*f;
+
+	f = uspace_frame(inst, inst->rx_offset, inst->rx_head);
+	if (READ_ONCE(f->status) != MISDN_RING_KERNEL ||
+	    len > inst->frame_size - MISDN_RING_FRAME_HDR) {
+		inst->hdr->rx_dropped++;
+		return;
+	}
+	/* the status is read before the frame is written */
+	smp_mb();
+	f->len = len;
+	f->prim = prim;
+	f->id = txlen;
+	f->tstamp = ktime_get_ns();
+	memcpy((void *)f + MISDN_RING_FRAME_HDR, data, len);
+	/* the frame is written before the user gets it */
+	smp_store_release(&f->status, MISDN_RING_USER);
+	if (++inst->rx_head == inst->frames)
+		inst->rx_head = 0;
+	wake_up_interruptible(&inst->wait);
+}
+
+static void
+uspace_process(struct uspace_inst *inst, u_int prim, u8 *data, int len,
+	       u_int txlen)
+{
+	struct uspace_fifo	*out = &inst->out[prim == PH_DATA_IND];
+	u_long			flags;
+
+	spin_lock_irqsave(&inst->lock, flags);
+	if (inst->hdr) {
+		uspace_give(inst, prim, data, len, txlen);
+		uspace_take(inst);
+	}
+	if (out->cnt >= len)
+		uspace_fifo_get(out, data, len);
+	else if (inst->hdr)
+		inst->underrun++;
+	spin_unlock_irqrestore(&inst->lock, flags);
+}
+
+static void *new(const char *arg)
+{
+	struct uspace_inst	*inst;
+	const char		*s;
+	u_int			id = 0;
+	u_long			flags;
+
+	s = arg ? strstr(arg, "id=") : NULL;
+	if (!s || sscanf(s + 3, "%u", &id) != 1) {
+		printk(KERN_WARNING "%s: uspace needs an id\n", __func__);
+		return NULL;
+	}
+	inst = kzalloc(sizeof(*inst), GFP_ATOMIC);
+	if (!inst)
+		return NULL;
+	inst->id = id;
+	kref_init(&inst->ref);
+	spin_lock_init(&inst->lock);
+	init_waitqueue_head(&inst->wait);
+	spin_lock_irqsave(&uspace_lock, flags);
+	list_add_tail(&inst->list, &uspace_list);
+	spin_unlock_irqrestore(&uspace_lock, flags);
+	if (debug)
+		printk(KERN_DEBUG "%s: instance %u\n", __func__, id);
+	return inst;
+}
+
+static void free(void *p)
+{
+	struct uspace_inst	*inst = p;
+	u_long			flags;
+
+	spin_lock_irqsave(&uspace_lock, flags);
+	list_del(&inst->list);
+	spin_unlock_irqrestore(&uspace_lock, flags);
+	spin_lock_irqsave(&inst->lock, flags);
+	inst->dead = 1;
+	spin_unlock_irqrestore(&inst->lock, flags);
+	wake_up_interruptible(&inst->wait);
+	if (debug)
+		printk(KERN_DEBUG "%s: instance %u, %lu underruns\n",
+		       __func__, inst->id, inst->underrun);
+	kref_put(&inst->ref, uspace_release);
+}
+
+static void process_tx(void *p, u8 *data, int len)
+{
+	uspace_process(p, PH_DATA_REQ, data, len, 0);
+}
+
+static void process_rx(void *p, u8 *data, int len, unsigned int txlen)
+{
+	uspace_process(p, PH_DATA_IND, data, len, txlen);
+}
+
+static struct mISDN_dsp_element_arg args[] = {
+	{ "id", NULL, "Id given to IMDSPATTACH by the worker." },
+};
+
+static struct mISDN_dsp_element dsp_uspace = {
+	.name = "uspace",
+	.new = new,
+	.free = free,
+	.process_tx = process_tx,
+	.process_rx = process_rx,
+	.num_args = ARRAY_SIZE(args),
+	.args = args,
+};
+
+/* the file of a worker, private_data is the instance once attached */
+static DEFINE_MUTEX(uspace_mutex);
+
+static int
+uspace_attach(struct file *filep, struct mISDN_dsp_attach *req)
+{
+	struct uspace_inst	*inst;
+	struct mISDN_ring_hdr	*hdr;
+	size_t			size;
+	u_long			flags;
+
+	if (filep->private_data)
+		return -EBUSY;
+	if (req->frame_size <= MISDN_RING_FRAME_HDR || req->frame_size & 15 ||
+	    req->frame_size > MISDN_RING_FRAME_HDR + MAX_DATA_MEM ||
+	    !req->frames || req->frames > USPACE_MAX_FRAMES)
+		return -EINVAL;
+	size = ALIGN(sizeof(*hdr), 64) + 2 * (size_t)req->frames *
+		req->frame_size;
+	if (size > USPACE_MAX_SIZE)
+		return -EINVAL;
+	/* zeroed, so all frames belong to the kernel */
+	hdr = vmalloc_user(size);
+	if (!hdr)
+		return -ENOMEM;
+	hdr->frame_size = req->frame_size;
+	hdr->rx_frames = req->frames;
+	hdr->tx_frames = req->frames;
+	hdr->rx_offset = ALIGN(sizeof(*hdr), 64);
+	hdr->tx_offset = hdr->rx_offset + req->frames * req->frame_size;
+
+	spin_lock_irqsave(&uspace_lock, flags);
+	list_for_each_entry(inst, &uspace_list, list) {
+		if (inst->id == req->id && !inst->hdr) {
+			kref_get(&inst->ref);
+			spin_lock(&inst->lock);
+			inst->hdr = hdr;
+			inst->frame_size = req->frame_size;
+			inst->frames = req->frames;
+			inst->rx_offset = hdr->rx_offset;
+			inst->tx_offset = hdr->tx_offset;
+			inst->rx_head = 0;
+			inst->tx_head = 0;
+			spin_unlock(&inst->lock);
+			spin_unlock_irqrestore(&uspace_lock, flags);
+			filep->private_data = inst;
+			return 0;
+		}
+	}
+	spin_unlock_irqrestore(&uspace_lock, flags);
+	vfree(hdr);
+	return -ENOENT;
+}
+
+static long
+uspace_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
+{
+	struct mISDN_dsp_attach	req;
+	int			ret;
+
+	switch (cmd) {
+	case IMDSPATTACH:
+		if (copy_from_user(&req, (void __user *)arg, sizeof(req)))
+			return -EFAULT;
+		mutex_lock(&uspace_mutex);
+		ret = uspace_attach(filep, &req);
+		mutex_unlock(&uspace_mutex);
+		return ret;
+	}
+	return -EINVAL;
+}
+
+static int
+uspace_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+	struct uspace_inst	*inst;
+	int			err = -EINVAL;
+
+	mutex_lock(&uspace_mutex);
+	inst = filep->private_data;
+	if (inst && !vma->vm_pgoff)
+		err = remap_vmalloc_range(vma, inst->hdr, 0);
+	mutex_unlock(&uspace_mutex);
+	return err;
+}
+
+static unsigned int
+uspace_poll(struct file *filep, poll_table *wait)
+{
+	struct uspace_inst	*inst = READ_ONCE(filep->private_data);
+	struct mISDN_ring_frame	*f;
+	unsigned int		mask = 0;
+	u_int			nr;
+
+	if (!inst)
+		return POLLERR;
+	poll_wait(filep, &inst->wait, wait);
+	/* the last frame given to the user is not back yet */
+	nr = READ_ONCE(inst->rx_head);
+	nr = (nr ? nr : inst->frames) - 1;
+	f = uspace_frame(inst, inst->rx_offset, nr);
+	if (READ_ONCE(f->status) == MISDN_RING_USER)
+		mask |= POLLIN | POLLRDNORM;
+	if (READ_ONCE(inst->dead))
+		mask |= POLLHUP;
+	return mask;
+}
+
+static int
+uspace_open(struct inode *ino, struct file *filep)
+{
+	filep->private_data = NULL;
+	return nonseekable_open(ino, filep);
+}
+
+static int
+uspace_close(struct inode *ino, struct file *filep)
+{
+	struct uspace_inst	*inst = filep->private_data;
+	struct mISDN_ring_hdr	*hdr;
+	u_long			flags;
+
+	if (!inst)
+		return 0;
+	spin_lock_irqsave(&inst->lock, flags);
+	hdr = inst->hdr;
+	inst->hdr = NULL;
+	spin_unlock_irqrestore(&inst->lock, flags);
+	vfree(hdr);
+	kref_put(&inst->ref, uspace_release);
+	return 0;
+}
+
+static const struct file_operations uspace_fops = {
+	.owner		= THIS_MODULE,
+	.poll		= uspace_poll,
+	.unlocked_ioctl	= uspace_ioctl,
+	.mmap		= uspace_mmap,
+	.open		= uspace_open,
+	.release	= uspace_close,
+	.llseek		= no_llseek,
+};
+
+static struct miscdevice uspace_dev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "mISDNdsp",
+	.fops	= &uspace_fops,
+};
+
+#ifdef MODULE
+static int __init dsp_uspace_init(void)
+{
+	int	err;
+
+	err = misc_register(&uspace_dev);
+	if (err) {
+		printk(KERN_WARNING "%s: Could not register dsp device\n",
+		       __func__);
+		return err;
+	}
+	err = mISDN_dsp_element_register(&dsp_uspace);
+	if (err)
+		misc_deregister(&uspace_dev);
+	return err;
+}
+
+static void __exit dsp_uspace_exit(void)
+{
+	mISDN_dsp_element_unregister(&dsp_uspace);
+	misc_deregister(&uspace_dev);
+}
+
+module_init(dsp_uspace_init);
+module_exit(dsp_uspace_exit);
+
+MODULE_LICENSE("GPL");
+#endif
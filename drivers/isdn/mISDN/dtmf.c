@@ -24,6 +24,7 @@
 #include <linux/module.h>
 #include <linux/mISDNif.h>
 #include "core.h"
+#include "dsp_goertzel.h"
 
 #define DTMF_VERSION	"2.0"
 
@@ -50,7 +51,9 @@ struct dtmf {
 	u_long 			Flags;
 	char			last;
 	int			idx;
-	int			buf[DTMF_NPOINTS];
+	u_long			blocks;	/* frames decoded */
+	u_long			gated;	/* frames rejected by energy gate */
+	s32			buf[DTMF_NPOINTS];
 };
 
 
@@ -132,7 +135,7 @@ static short isdn_audio_alaw_to_s16[] =
 	0x0cbc, 0xf344, 0x0094, 0xff6c, 0x327c, 0xcd84, 0x032c, 0xfcd4
 };
 
-#define NCOEFF            8     /* number of frequencies to be analyzed       */
+#define NCOEFF GOERTZEL_NCOEFF  /* number of frequencies to be analyzed       */
 #define DTMF_TRESH     4000     /* above this is dtmf                         */
 #define SILENCE_TRESH   200     /* below this is silence                      */
 #define AMP_BITS          9     /* bits per sample, reduced to avoid overflow */
@@ -142,7 +145,7 @@ static short isdn_audio_alaw_to_s16[] =
 /* For DTMF recognition:
  * 2 * cos(2 * PI * k / N) precalculated for all k
  */
-static int cos2pik[NCOEFF] =
+static s32 cos2pik[NCOEFF] =
 {
 	55813, 53604, 51193, 48591, 38114, 33057, 25889, 18332
 };
@@ -164,23 +167,30 @@ static char dtmf_matrix[4][4] =
 static void
 isdn_audio_goertzel(struct dtmf *dtmf)
 {
-	int		sk[NCOEFF], sk1[NCOEFF], sk2[NCOEFF];
-	register int	sample;
+	s32		sk[NCOEFF], sk1[NCOEFF], sk2[NCOEFF];
 	int		k, n;
 	int		thresh, silence;
 	int		lgrp, hgrp;
 	char		what;
-
-	memset(sk, 0, NCOEFF*sizeof(int));
-	memset(sk1, 0, NCOEFF*sizeof(int));
-	memset(sk2, 0, NCOEFF*sizeof(int));
-	for (n = 0; n < DTMF_NPOINTS; n++) {
-		sample = dtmf->buf[n];
-		for (k = 0; k < NCOEFF; k++)
-			sk[k] = sample + ((cos2pik[k] * sk1[k]) >> 15) - sk2[k];
-		memcpy(sk2, sk1, NCOEFF*sizeof(int));
-		memcpy(sk1, sk, NCOEFF*sizeof(int));
+	s64		energy;
+
+	/*
+	 * energy gate: |X(k)|**2 of any filter cannot exceed the number of
+	 * samples times the energy of the frame. the koefficients are scaled
+	 * by 2**-11, so if twice of this bound is below SILENCE_TRESH, all
+	 * filters report silence and the filter bank is skipped.
+	 */
+	dtmf->blocks++;
+	energy = 0;
+	for (n = 0; n < DTMF_NPOINTS; n++)
+		energy += (s64)dtmf->buf[n] * dtmf->buf[n];
+	if (((energy * DTMF_NPOINTS) >> 10) < SILENCE_TRESH) {
+		dtmf->gated++;
+		what = ' ';
+		goto gated;
 	}
+
+	goertzel_bank(cos2pik, dtmf->buf, DTMF_NPOINTS, sk, sk2);
 	thresh = 0;
 	silence = 0;
 	lgrp = -1;
@@ -250,6 +260,7 @@ isdn_audio_goertzel(struct dtmf *dtmf)
 		} else
 			what = '.';
 	}
+gated:
 	if (debug & DEBUG_DTMF_DETECT)
 		printk(KERN_DEBUG "DTMF: last(%c) what(%c)\n",
 			dtmf->last, what);
@@ -371,6 +382,9 @@ dtmf_ctrl(struct mISDNchannel *ch, u_int cmd, void *arg)
 	case OPEN_CHANNEL:
 		break;
 	case CLOSE_CHANNEL:
+		if (debug & DEBUG_DTMF_CTRL)
+			printk(KERN_DEBUG "DTMF: %lu frames, %lu gated\n",
+			    dtmf->blocks, dtmf->gated);
 		if (dtmf->ch.peer)
 			dtmf->ch.peer->ctrl(dtmf->ch.peer, CLOSE_CHANNEL, NULL);
 		kfree(dtmf);
@@ -409,7 +423,8 @@ dtmfcreate(struct channel_req *crq)
 static struct Bprotocol DTMF = {
 	.Bprotocols = (1 << (ISDN_P_B_L2DTMF & ISDN_P_B_MASK)),
 	.name = "dtmf",
-	.create = dtmfcreate
+	.create = dtmfcreate,
+	.owner = THIS_MODULE
 };
 
 static int dtmf_init(void)
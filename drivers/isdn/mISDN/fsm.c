@@ -22,10 +22,19 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/string.h>
+#include <linux/log2.h>
 #include "fsm.h"
 
 #define FSM_TIMER_DEBUG 0
 
+/* slots of the timer wheel are 1 << FSM_TICK_SHIFT jiffies, about 10ms */
+#define FSM_TICK_SHIFT	ilog2(HZ / 100 ? HZ / 100 : 1)
+#define FSM_TICK	(1UL << FSM_TICK_SHIFT)
+#define FSM_WHEEL_MASK	(FSM_WHEEL_SIZE - 1)
+
+#define FSM_TIMER_WHEEL		1
+#define FSM_TIMER_EXPIRED	2
+
 int
 mISDN_FsmNew(struct Fsm *fsm,
 	     struct FsmNode *fnlist, int fncount)
@@ -109,10 +118,150 @@ FsmExpireTimer(struct FsmTimer *ft)
 	mISDN_FsmEvent(ft->fi, ft->event, ft->arg);
 }
 
+/* lock must be held, the wheel must not be empty */
+static u_long
+FsmWheelDue(struct FsmTimerBase *b)
+{
+	struct FsmTimer	*ft;
+	u_long		due = b->next + FSM_WHEEL_SIZE * FSM_TICK;
+	int		i;
+
+	for (i = 0; i < FSM_WHEEL_SIZE; i++)
+		list_for_each_entry(ft, &b->slot[i], entry)
+			if (time_before(ft->expires, due))
+				due = ft->expires;
+	return due;
+}
+
+static void
+FsmTimerTick(struct FsmTimerBase *b)
+{
+	struct FsmTimer	*ft, *n;
+	struct list_head *slot;
+	u_long		flags;
+	bool		kick;
+
+	spin_lock_irqsave(&b->lock, flags);
+	/* the slots before the earliest timer are empty, skip them */
+	if (time_after(b->due, b->next))
+		b->next = time_before_eq(b->due, jiffies) ? b->due :
+			jiffies & ~(FSM_TICK - 1);
+	while (b->count && time_before_eq(b->next, jiffies)) {
+		slot = &b->slot[(b->next >> FSM_TICK_SHIFT) & FSM_WHEEL_MASK];
+		list_for_each_entry_safe(ft, n, slot, entry) {
+			/* later rounds stay on the slot */
+			if (ft->expires != b->next)
+				continue;
+			list_move_tail(&ft->entry, &b->expired);
+			ft->queued = FSM_TIMER_EXPIRED;
+			b->count--;
+		}
+		b->next += FSM_TICK;
+	}
+	if (b->count) {
+		b->due = FsmWheelDue(b);
+		mod_timer(&b->tick, b->due);
+	}
+	kick = !list_empty(&b->expired);
+	spin_unlock_irqrestore(&b->lock, flags);
+	if (kick)
+		b->kick(b->data);
+}
+
+/* lock must be held */
+static void
+FsmWheelAdd(struct FsmTimerBase *b, struct FsmTimer *ft, int millisec)
+{
+	u_long	expires;
+
+	if (!b->count)
+		b->next = jiffies & ~(FSM_TICK - 1);
+	/* never earlier than asked for */
+	expires = ALIGN(jiffies + (millisec * HZ) / 1000, FSM_TICK);
+	if (time_before(expires, b->next))
+		expires = b->next;
+	/* the tick is armed to the earliest timer only */
+	if (!b->count || time_before(expires, b->due)) {
+		b->due = expires;
+		mod_timer(&b->tick, expires);
+	}
+	ft->expires = expires;
+	ft->queued = FSM_TIMER_WHEEL;
+	list_add_tail(&ft->entry,
+		      &b->slot[(expires >> FSM_TICK_SHIFT) & FSM_WHEEL_MASK]);
+	b->count++;
+}
+
+/* lock must be held */
+static void
+FsmWheelDel(struct FsmTimerBase *b, struct FsmTimer *ft)
+{
+	/* b->due stays a lower bound, the tick finds the next one */
+	if (ft->queued == FSM_TIMER_WHEEL && !--b->count)
+		del_timer(&b->tick);
+	list_del_init(&ft->entry);
+	ft->queued = 0;
+}
+
+struct FsmTimerBase *
+mISDN_FsmNewTimerBase(void (*kick)(void *), void *data)
+{
+	struct FsmTimerBase	*b;
+	int			i;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return NULL;
+	spin_lock_init(&b->lock);
+	setup_timer(&b->tick, (void *)FsmTimerTick, (long)b);
+	for (i = 0; i < FSM_WHEEL_SIZE; i++)
+		INIT_LIST_HEAD(&b->slot[i]);
+	INIT_LIST_HEAD(&b->expired);
+	b->kick = kick;
+	b->data = data;
+	return b;
+}
+EXPORT_SYMBOL(mISDN_FsmNewTimerBase);
+
+/* all timers of the base must be deleted */
+void
+mISDN_FsmFreeTimerBase(struct FsmTimerBase *b)
+{
+	if (!b)
+		return;
+	del_timer_sync(&b->tick);
+	if (b->count || !list_empty(&b->expired))
+		printk(KERN_WARNING "%s: timers still active\n", __func__);
+	kfree(b);
+}
+EXPORT_SYMBOL(mISDN_FsmFreeTimerBase);
+
+/* run the expired timers, the lock is not held by the events */
+void
+mISDN_FsmRunTimers(struct FsmTimerBase *b)
+{
+	struct FsmTimer	*ft;
+	u_long		flags;
+
+	spin_lock_irqsave(&b->lock, flags);
+	while (!list_empty(&b->expired)) {
+		ft = list_first_entry(&b->expired, struct FsmTimer, entry);
+		FsmWheelDel(b, ft);
+		spin_unlock_irqrestore(&b->lock, flags);
+		FsmExpireTimer(ft);
+		spin_lock_irqsave(&b->lock, flags);
+	}
+	spin_unlock_irqrestore(&b->lock, flags);
+}
+EXPORT_SYMBOL(mISDN_FsmRunTimers);
+
 void
 mISDN_FsmInitTimer(struct FsmInst *fi, struct FsmTimer *ft)
 {
 	ft->fi = fi;
+	ft->base = fi->timers;
+	INIT_LIST_HEAD(&ft->entry);
+	ft->queued = 0;
 #if FSM_TIMER_DEBUG
 	if (ft->fi->debug)
 		ft->fi->printdebug(ft->fi, "mISDN_FsmInitTimer %lx", (long) ft);
@@ -124,11 +273,20 @@ EXPORT_SYMBOL(mISDN_FsmInitTimer);
 void
 mISDN_FsmDelTimer(struct FsmTimer *ft, int where)
 {
+	u_long	flags;
+
 #if FSM_TIMER_DEBUG
 	if (ft->fi->debug)
 		ft->fi->printdebug(ft->fi, "mISDN_FsmDelTimer %lx %d",
 				   (long) ft, where);
 #endif
+	if (ft->base) {
+		spin_lock_irqsave(&ft->base->lock, flags);
+		if (ft->queued)
+			FsmWheelDel(ft->base, ft);
+		spin_unlock_irqrestore(&ft->base->lock, flags);
+		return;
+	}
 	del_timer(&ft->tl);
 }
 EXPORT_SYMBOL(mISDN_FsmDelTimer);
@@ -137,6 +295,8 @@ int
 mISDN_FsmAddTimer(struct FsmTimer *ft,
 		  int millisec, int event, void *arg, int where)
 {
+	u_long	flags;
+	int	pending;
 
 #if FSM_TIMER_DEBUG
 	if (ft->fi->debug)
@@ -144,7 +304,18 @@ mISDN_FsmAddTimer(struct FsmTimer *ft,
 				   (long) ft, millisec, where);
 #endif
 
-	if (timer_pending(&ft->tl)) {
+	if (ft->base) {
+		spin_lock_irqsave(&ft->base->lock, flags);
+		pending = ft->queued;
+		if (!pending) {
+			ft->event = event;
+			ft->arg = arg;
+			FsmWheelAdd(ft->base, ft, millisec);
+		}
+		spin_unlock_irqrestore(&ft->base->lock, flags);
+	} else
+		pending = timer_pending(&ft->tl);
+	if (pending) {
 		if (ft->fi->debug) {
 			printk(KERN_WARNING
 			       "mISDN_FsmAddTimer: timer already active!\n");
@@ -153,6 +324,8 @@ mISDN_FsmAddTimer(struct FsmTimer *ft,
 		}
 		return -1;
 	}
+	if (ft->base)
+		return 0;
 	init_timer(&ft->tl);
 	ft->event = event;
 	ft->arg = arg;
@@ -166,6 +339,7 @@ void
 mISDN_FsmRestartTimer(struct FsmTimer *ft,
 		      int millisec, int event, void *arg, int where)
 {
+	u_long	flags;
 
 #if FSM_TIMER_DEBUG
 	if (ft->fi->debug)
@@ -173,6 +347,16 @@ mISDN_FsmRestartTimer(struct FsmTimer *ft,
 				   (long) ft, millisec, where);
 #endif
 
+	if (ft->base) {
+		spin_lock_irqsave(&ft->base->lock, flags);
+		if (ft->queued)
+			FsmWheelDel(ft->base, ft);
+		ft->event = event;
+		ft->arg = arg;
+		FsmWheelAdd(ft->base, ft, millisec);
+		spin_unlock_irqrestore(&ft->base->lock, flags);
+		return;
+	}
 	if (timer_pending(&ft->tl))
 		del_timer(&ft->tl);
 	init_timer(&ft->tl);
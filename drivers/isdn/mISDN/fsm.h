@@ -21,10 +21,13 @@
 #define _MISDN_FSM_H
 
 #include <linux/timer.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
 
 /* Statemachine */
 
 struct FsmInst;
+struct FsmTimerBase;
 
 typedef void (*FSMFNPTR)(struct FsmInst *, int, void *);
 
@@ -41,6 +44,7 @@ struct FsmInst {
 	void *userdata;
 	int userint;
 	void (*printdebug) (struct FsmInst *, char *, ...);
+	struct FsmTimerBase *timers;	/* NULL: own kernel timers */
 };
 
 struct FsmNode {
@@ -53,6 +57,32 @@ struct FsmTimer {
 	struct timer_list tl;
 	int event;
 	void *arg;
+	struct FsmTimerBase *base;	/* of fi when initialized */
+	struct list_head entry;		/* on a slot or the expired list */
+	u_long expires;
+	int queued;
+};
+
+/*
+ * A timer wheel for the FSM timers of one stack. Adding, restarting and
+ * deleting a timer only moves it between lists under the lock. A single
+ * kernel timer fires when the earliest timer on the wheel is due, not at
+ * every slot. Expired timers are collected and handed to kick(), the owner
+ * runs them in one batch with mISDN_FsmRunTimers.
+ */
+#define FSM_WHEEL_BITS	8
+#define FSM_WHEEL_SIZE	(1 << FSM_WHEEL_BITS)
+
+struct FsmTimerBase {
+	spinlock_t lock;
+	struct timer_list tick;
+	u_long next;		/* jiffies of the next slot to expire */
+	u_long due;		/* no timer on the slots expires earlier */
+	u_int count;		/* timers on the slots */
+	struct list_head slot[FSM_WHEEL_SIZE];
+	struct list_head expired;
+	void (*kick)(void *);
+	void *data;
 };
 
 extern int mISDN_FsmNew(struct Fsm *, struct FsmNode *, int);
@@ -63,5 +93,8 @@ extern void mISDN_FsmInitTimer(struct FsmInst *, struct FsmTimer *);
 extern int mISDN_FsmAddTimer(struct FsmTimer *, int, int, void *, int);
 extern void mISDN_FsmRestartTimer(struct FsmTimer *, int, int, void *, int);
 extern void mISDN_FsmDelTimer(struct FsmTimer *, int);
+extern struct FsmTimerBase *mISDN_FsmNewTimerBase(void (*)(void *), void *);
+extern void mISDN_FsmFreeTimerBase(struct FsmTimerBase *);
+extern void mISDN_FsmRunTimers(struct FsmTimerBase *);
 
 #endif
@@ -0,0 +1,332 @@
+/*
+ * hdlc.c
+ *
+ * HDLC framing in software, for cards without a HDLC controller.
+ *
+ * Bits are sent LSB first. Instead of walking every bit through a state
+ * machine, whole bytes are handled with two tables, as long as they cannot
+ * contain a stuffed zero, a flag or an abort. Only bytes with a run of five
+ * or more ones, which are rare in normal data, go through the bit by bit
+ * path. The tables are generated at build time by hdlc_mktables.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/crc-ccitt.h>
+#include <linux/mISDNhw.h>
+#include "core.h"
+
+#define HDLC_FLAG	0x7e
+#define HDLC_CRC_INIT	0xffff
+#define HDLC_CRC_GOOD	0xf0b8
+
+static inline int
+hdlc_is_fast(u8 ones, u8 b)
+{
+	return ones < 5 && (mISDN_hdlc_fast[b] & (1 << ones));
+}
+
+void
+mISDN_hdlc_rx_init(struct mISDN_hdlc_rx *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->hunt = 1;
+	h->crc = HDLC_CRC_INIT;
+}
+EXPORT_SYMBOL(mISDN_hdlc_rx_init);
+
+static inline void
+hdlc_rx_reset(struct mISDN_hdlc_rx *h)
+{
+	h->hunt = 0;
+	h->len = 0;
+	h->acc = 0;
+	h->nbits = 0;
+	h->crc = HDLC_CRC_INIT;
+}
+
+/* append k received data bits, complete bytes go to dst */
+static int
+hdlc_rx_bits(struct mISDN_hdlc_rx *h, u32 v, int k, u8 *dst, int dsize)
+{
+	u8 b;
+
+	h->acc |= v << h->nbits;
+	h->nbits += k;
+	while (h->nbits >= 8) {
+		if (h->len >= dsize) {
+			h->hunt = 1;
+			return -MISDN_HDLC_LENGTH_ERROR;
+		}
+		b = h->acc;
+		dst[h->len++] = b;
+		h->crc = crc_ccitt_byte(h->crc, b);
+		h->acc >>= 8;
+		h->nbits -= 8;
+	}
+	return 0;
+}
+
+/* a flag was received, the frame before it (if any) is complete */
+static int
+hdlc_rx_flag(struct mISDN_hdlc_rx *h)
+{
+	int ret = 0;
+
+	if (!h->hunt && h->len) {
+		/* the 0 of the flag is the only bit left */
+		if (h->nbits != 1 || h->len <= 2)
+			ret = -MISDN_HDLC_FRAMING_ERROR;
+		else if (h->crc != HDLC_CRC_GOOD)
+			ret = -MISDN_HDLC_CRC_ERROR;
+		else
+			ret = h->len - 2;
+	}
+	hdlc_rx_reset(h);
+	return ret;
+}
+
+/* 7 or more ones, the frame is aborted */
+static int
+hdlc_rx_abort(struct mISDN_hdlc_rx *h)
+{
+	int ret = 0;
+
+	if (!h->hunt && (h->len || h->nbits > 1))
+		ret = -MISDN_HDLC_FRAMING_ERROR;
+	h->hunt = 1;
+	h->ones = 7;
+	return ret;
+}
+
+static int
+hdlc_rx_bit(struct mISDN_hdlc_rx *h, int bit, u8 *dst, int dsize)
+{
+	u8 ones;
+
+	if (bit) {
+		if (h->ones >= 7)
+			return 0;
+		if (++h->ones == 7)
+			return hdlc_rx_abort(h);
+		return 0;
+	}
+	/* a 0 ends the run of ones */
+	ones = h->ones;
+	h->ones = 0;
+	if (ones == 6)
+		return hdlc_rx_flag(h);
+	if (h->hunt || ones > 6)
+		return 0;
+	if (ones == 5) /* stuffed 0, dropped */
+		return hdlc_rx_bits(h, 0x1f, 5, dst, dsize);
+	return hdlc_rx_bits(h, (1 << ones) - 1, ones + 1, dst, dsize);
+}
+
+/*
+ * decode the bytes of src.
+ *
+ * returns the length of a received frame (without the CRC), which is in dst,
+ * a negative MISDN_HDLC_* error or 0, if all bytes were used.
+ * count is set to the number of bytes used from src; if a frame ended in
+ * the middle of a byte, the rest of it is decoded with the next call.
+ */
+int
+mISDN_hdlc_decode(struct mISDN_hdlc_rx *h, const u8 *src, int slen,
+		  int *count, u8 *dst, int dsize)
+{
+	int i = 0, k, ret;
+	u8 b, tail;
+
+	while (h->cbits) {
+		b = h->cbin;
+		h->cbin >>= 1;
+		h->cbits--;
+		ret = hdlc_rx_bit(h, b & 1, dst, dsize);
+		if (ret) {
+			*count = 0;
+			return ret;
+		}
+	}
+	while (i < slen) {
+		b = src[i++];
+		if (hdlc_is_fast(h->ones, b)) {
+			tail = mISDN_hdlc_tail[b];
+			if (!h->hunt) {
+				ret = hdlc_rx_bits(h, ((1 << h->ones) - 1) |
+					((b & ((1 << (8 - tail)) - 1)) <<
+					 h->ones), h->ones + 8 - tail,
+					dst, dsize);
+				if (ret) {
+					h->ones = tail;
+					*count = i;
+					return ret;
+				}
+			}
+			h->ones = tail;
+			continue;
+		}
+		if (b == 0xff) { /* idle line */
+			if (h->ones < 7) {
+				ret = hdlc_rx_abort(h);
+				if (ret) {
+					*count = i;
+					return ret;
+				}
+			}
+			continue;
+		}
+		if (b == HDLC_FLAG && !h->ones &&
+		    (h->hunt || (!h->len && !h->nbits))) {
+			/* byte aligned flags between frames */
+			hdlc_rx_reset(h);
+			continue;
+		}
+		for (k = 0; k < 8; k++) {
+			ret = hdlc_rx_bit(h, (b >> k) & 1, dst, dsize);
+			if (ret) {
+				h->cbin = b >> (k + 1);
+				h->cbits = 7 - k;
+				*count = i;
+				return ret;
+			}
+		}
+	}
+	*count = i;
+	return 0;
+}
+EXPORT_SYMBOL(mISDN_hdlc_decode);
+
+#define HDLC_TX_IDLE	0
+#define HDLC_TX_DATA	1
+#define HDLC_TX_CRC1	2
+#define HDLC_TX_CRC2	3
+#define HDLC_TX_FLAG	4
+
+void
+mISDN_hdlc_tx_init(struct mISDN_hdlc_tx *h)
+{
+	memset(h, 0, sizeof(*h));
+	h->state = HDLC_TX_IDLE;
+}
+EXPORT_SYMBOL(mISDN_hdlc_tx_init);
+
+static inline void
+hdlc_tx_bits(struct mISDN_hdlc_tx *h, u32 v, int k)
+{
+	h->acc |= v << h->nbits;
+	h->nbits += k;
+}
+
+/* one byte of the frame, with bit stuffing */
+static void
+hdlc_tx_byte(struct mISDN_hdlc_tx *h, u8 b)
+{
+	int k;
+
+	if (hdlc_is_fast(h->ones, b)) {
+		hdlc_tx_bits(h, b, 8);
+		h->ones = mISDN_hdlc_tail[b];
+		return;
+	}
+	for (k = 0; k < 8; k++) {
+		if (b & (1 << k)) {
+			hdlc_tx_bits(h, 1, 1);
+			if (++h->ones == 5) {
+				hdlc_tx_bits(h, 0, 1);
+				h->ones = 0;
+			}
+		} else {
+			hdlc_tx_bits(h, 0, 1);
+			h->ones = 0;
+		}
+	}
+}
+
+static inline void
+hdlc_tx_flag(struct mISDN_hdlc_tx *h)
+{
+	hdlc_tx_bits(h, HDLC_FLAG, 8);
+	h->ones = 0;
+}
+
+/*
+ * encode src as one frame, the frame ends with the last byte of the call.
+ * if a call has to stop early because dst is full, the next call continues
+ * the frame with the rest of src.
+ *
+ * returns the number of bytes in dst, count is set to the number of bytes
+ * used from src. after the closing flag the call returns, so the next frame
+ * can follow directly; without data dst is filled with flags.
+ */
+int
+mISDN_hdlc_encode(struct mISDN_hdlc_tx *h, const u8 *src, int slen,
+		  int *count, u8 *dst, int dsize)
+{
+	int i = 0, len = 0;
+	u8 b;
+
+	while (len < dsize) {
+		if (h->nbits >= 8) {
+			dst[len++] = h->acc;
+			h->acc >>= 8;
+			h->nbits -= 8;
+			continue;
+		}
+		switch (h->state) {
+		case HDLC_TX_IDLE:
+			if (i < slen) {
+				/* opening flag */
+				h->crc = HDLC_CRC_INIT;
+				hdlc_tx_flag(h);
+				h->state = HDLC_TX_DATA;
+			} else if (slen) {
+				goto out;
+			} else if (h->nbits) {
+				/* rest of the last flag, fill up the byte */
+				hdlc_tx_bits(h, HDLC_FLAG, 8);
+			} else {
+				memset(dst + len, HDLC_FLAG, dsize - len);
+				len = dsize;
+			}
+			break;
+		case HDLC_TX_DATA:
+			if (i < slen) {
+				b = src[i++];
+				h->crc = crc_ccitt_byte(h->crc, b);
+				hdlc_tx_byte(h, b);
+				if (i < slen)
+					break;
+			}
+			h->crc ^= 0xffff;
+			h->state = HDLC_TX_CRC1;
+			break;
+		case HDLC_TX_CRC1:
+			hdlc_tx_byte(h, h->crc & 0xff);
+			h->state = HDLC_TX_CRC2;
+			break;
+		case HDLC_TX_CRC2:
+			hdlc_tx_byte(h, h->crc >> 8);
+			h->state = HDLC_TX_FLAG;
+			break;
+		default:
+			/* closing flag */
+			hdlc_tx_flag(h);
+			h->state = HDLC_TX_IDLE;
+			break;
+		}
+	}
+out:
+	*count = i;
+	return len;
+}
+EXPORT_SYMBOL(mISDN_hdlc_encode);
@@ -0,0 +1,68 @@
+/*
+ * hdlc_mktables.c
+ *
+ * Host program, which generates the byte tables of the software HDLC
+ * engine of mISDN_core at build time (hdlc_tables.c), like dsp_mktables
+ * does for the law tables of mISDN_dsp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* bit r is set, if r ones followed by the byte do not give 5 ones in a row */
+static uint8_t hdlc_fast[256];
+/* number of ones at the end (MSB) of the byte */
+static uint8_t hdlc_tail[256];
+
+static void gen_tables(void)
+{
+	int b, r, k, run;
+
+	for (b = 0; b < 256; b++) {
+		for (k = 7; k >= 0 && (b & (1 << k)); k--)
+			hdlc_tail[b]++;
+		for (r = 0; r < 5; r++) {
+			run = r;
+			for (k = 0; k < 8; k++) {
+				run = (b & (1 << k)) ? run + 1 : 0;
+				if (run >= 5)
+					break;
+			}
+			if (k == 8)
+				hdlc_fast[b] |= 1 << r;
+		}
+	}
+}
+
+static void print_u8(const char *name, const uint8_t *t, int n)
+{
+	int i;
+
+	printf("\nconst u8 %s[%d] = {\n", name, n);
+	for (i = 0; i < n; i++)
+		printf("%s0x%02x,%s", (i & 7) ? " " : "\t", t[i],
+		       ((i & 7) == 7 || i == n - 1) ? "\n" : "");
+	printf("};\n");
+}
+
+int main(void)
+{
+	printf("/*\n"
+	       " * Byte tables of the software HDLC engine of mISDN_core.\n"
+	       " *\n"
+	       " * Generated by hdlc_mktables, do not edit.\n"
+	       " */\n\n"
+	       "#include <linux/mISDNif.h>\n"
+	       "#include \"core.h\"\n");
+
+	gen_tables();
+	print_u8("mISDN_hdlc_fast", hdlc_fast, 256);
+	print_u8("mISDN_hdlc_tail", hdlc_tail, 256);
+
+	return 0;
+}
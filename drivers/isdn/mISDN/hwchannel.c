@@ -17,7 +17,183 @@
 
 #include <linux/gfp.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
 #include <linux/mISDNhw.h>
+#include <trace/events/misdn.h>
+#include "core.h"
+
+/*
+ * pool of audio frames
+ *
+ * transparent audio is sent and received in small frames every few ms,
+ * so frames are recycled in a per cpu pool instead of being allocated and
+ * freed each time. all frames of the pool have room for audio_skb_len bytes
+ * behind the mISDN header. it starts at MISDN_AUDIO_SKB_LEN and grows to the
+ * transparent rx frames of the B-channels, 2 * minlen up to maxlen (see
+ * bchannel_get_rxbuf), once a channel is set up with larger limits. smaller
+ * frames of the pool are freed instead of being reused then. a frame returns
+ * to the pool only if nobody else holds a reference to it or to its data.
+ */
+#define AUDIO_POOL_DEPTH	64	/* frames kept per cpu */
+
+static u_int	audio_skb_len = MISDN_AUDIO_SKB_LEN;
+module_param(audio_skb_len, uint, S_IRUGO);
+MODULE_PARM_DESC(audio_skb_len, "bytes of the frames of the audio pool");
+
+struct audio_pool {
+	struct sk_buff_head	list;
+	u_long			misses;
+};
+
+static DEFINE_PER_CPU(struct audio_pool, audio_pool);
+
+static int
+audio_pool_get_misses(char *buffer, const struct kernel_param *kp)
+{
+	u_long	misses = 0;
+	int	cpu;
+
+	for_each_possible_cpu(cpu)
+		misses += per_cpu(audio_pool, cpu).misses;
+	return sprintf(buffer, "%lu\n", misses);
+}
+
+static const struct kernel_param_ops audio_pool_misses_ops = {
+	.get = audio_pool_get_misses,
+};
+module_param_cb(audio_pool_misses, &audio_pool_misses_ops, NULL, S_IRUGO);
+
+/* let the frames of the pool hold the rx frames of a B-channel */
+static void
+audio_pool_fit(struct bchannel *ch)
+{
+	u_int	len, old;
+
+	len = min_t(u_int, 2 * ch->next_minlen, ch->next_maxlen);
+	if (len > MAX_DATA_SIZE)
+		len = MAX_DATA_SIZE;
+	do {
+		old = READ_ONCE(audio_skb_len);
+		if (len <= old)
+			return;
+	} while (cmpxchg(&audio_skb_len, old, len) != old);
+}
+
+/*
+ * coalescing of transparent receive data
+ *
+ * cards with small fifo thresholds deliver a few bytes each time, so the
+ * data is kept in rx_skb until it has minlen bytes. rx_frame_ms sets minlen
+ * by a duration (8 bytes per ms), rx_flush_ms delivers shorter frames once
+ * the first byte is older. both are the defaults of a channel when it is
+ * activated, MISDN_CTRL_RX_COALESCE changes them per channel.
+ * the age is checked when the card has new data, with jiffies resolution.
+ */
+static uint rx_frame_ms;
+static uint rx_flush_ms;
+module_param(rx_frame_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_frame_ms, "transparent rx frame in ms, 0 driver default");
+module_param(rx_flush_ms, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_flush_ms, "deliver shorter rx frames after ms, 0 never");
+
+static void
+bchannel_rx_coalesce(struct bchannel *ch, int frame_ms, int flush_ms)
+{
+	int	len;
+
+	if (frame_ms > MISDN_CTRL_RX_SIZE_IGNORE) {
+		len = frame_ms ? frame_ms * 8 : ch->init_minlen;
+		if (len > ch->next_maxlen)
+			len = ch->next_maxlen;
+		ch->next_minlen = len;
+		audio_pool_fit(ch);
+	}
+	if (flush_ms > MISDN_CTRL_RX_SIZE_IGNORE) {
+		if (flush_ms > 0xffff)
+			flush_ms = 0xffff;
+		ch->rx_flush_ms = flush_ms;
+		ch->rx_flush = msecs_to_jiffies(flush_ms);
+	}
+}
+
+struct sk_buff *
+mI_alloc_audio_skb(unsigned int len, gfp_t gfp_mask)
+{
+	struct audio_pool	*pool;
+	struct sk_buff		*skb;
+	u_int			size = READ_ONCE(audio_skb_len);
+	u_long			flags;
+
+	if (len > size)
+		return mI_alloc_skb(len, gfp_mask);
+	local_irq_save(flags);
+	pool = this_cpu_ptr(&audio_pool);
+	skb = __skb_dequeue(&pool->list);
+	if (!skb)
+		pool->misses++;
+	local_irq_restore(flags);
+	if (skb) {
+		/* the pool grew since it was freed */
+		if (likely(skb_tailroom(skb) >= len))
+			return skb;
+		dev_kfree_skb_any(skb);
+	}
+	return mI_alloc_skb(size, gfp_mask);
+}
+EXPORT_SYMBOL(mI_alloc_audio_skb);
+
+void
+mI_free_audio_skb(struct sk_buff *skb)
+{
+	struct audio_pool	*pool;
+	u_int			size = READ_ONCE(audio_skb_len);
+	u_long			flags;
+
+	if (!skb)
+		return;
+	if (skb_shared(skb) || skb_cloned(skb) || skb_is_nonlinear(skb) ||
+	    skb->destructor || skb->sk ||
+	    skb_end_offset(skb) < MISDN_HEADER_LEN + size ||
+	    skb_end_offset(skb) >= 2 * (MISDN_HEADER_LEN + size)) {
+		dev_kfree_skb_any(skb);
+		return;
+	}
+	/* reset to the state of a fresh mI_alloc_skb() */
+	skb->data = skb->head;
+	skb_reset_tail_pointer(skb);
+	skb->len = 0;
+	skb_reserve(skb, MISDN_HEADER_LEN);
+	memset(skb->cb, 0, sizeof(skb->cb));
+	local_irq_save(flags);
+	pool = this_cpu_ptr(&audio_pool);
+	if (skb_queue_len(&pool->list) < AUDIO_POOL_DEPTH) {
+		__skb_queue_head(&pool->list, skb);
+		skb = NULL;
+	}
+	local_irq_restore(flags);
+	if (skb)
+		dev_kfree_skb_any(skb);
+}
+EXPORT_SYMBOL(mI_free_audio_skb);
+
+void
+mISDN_audio_pool_init(void)
+{
+	int	cpu;
+
+	for_each_possible_cpu(cpu)
+		skb_queue_head_init(&per_cpu(audio_pool, cpu).list);
+}
+
+void
+mISDN_audio_pool_cleanup(void)
+{
+	int	cpu;
+
+	for_each_possible_cpu(cpu)
+		skb_queue_purge(&per_cpu(audio_pool, cpu).list);
+}
 
 static void
 dchannel_bh(struct work_struct *ws)
@@ -62,6 +238,47 @@ bchannel_bh(struct work_struct *ws)
 	}
 }
 
+void
+mISDN_channel_get_stats(struct mISDNchannel *ch, struct mISDNchannel_stats *sum)
+{
+	struct mISDNchannel_stats	*s;
+	int				cpu;
+
+	memset(sum, 0, sizeof(*sum));
+	if (!ch->stats)
+		return;
+	for_each_possible_cpu(cpu) {
+		s = per_cpu_ptr(ch->stats, cpu);
+		sum->rx_frames += s->rx_frames;
+		sum->rx_bytes += s->rx_bytes;
+		sum->tx_frames += s->tx_frames;
+		sum->tx_bytes += s->tx_bytes;
+		sum->rx_dropped += s->rx_dropped;
+		sum->tx_dropped += s->tx_dropped;
+		sum->fifo_overrun += s->fifo_overrun;
+		sum->fifo_underrun += s->fifo_underrun;
+	}
+}
+
+/* without statistics the channel still works, it is not counted */
+static void
+alloc_channel_stats(struct mISDNchannel *ch)
+{
+	if (ch->stats)
+		return;
+	ch->stats = alloc_percpu(struct mISDNchannel_stats);
+	if (!ch->stats)
+		printk(KERN_WARNING "%s: no memory for channel statistics\n",
+		       __func__);
+}
+
+static void
+free_channel_stats(struct mISDNchannel *ch)
+{
+	free_percpu(ch->stats);
+	ch->stats = NULL;
+}
+
 int
 mISDN_initdchannel(struct dchannel *ch, int maxlen, void *phf)
 {
@@ -76,6 +293,7 @@ mISDN_initdchannel(struct dchannel *ch, int maxlen, void *phf)
 	skb_queue_head_init(&ch->rqueue);
 	INIT_LIST_HEAD(&ch->dev.bchannels);
 	INIT_WORK(&ch->workq, dchannel_bh);
+	alloc_channel_stats(&ch->dev.D);
 	return 0;
 }
 EXPORT_SYMBOL(mISDN_initdchannel);
@@ -91,14 +309,21 @@ mISDN_initbchannel(struct bchannel *ch, unsigned short maxlen,
 	ch->maxlen = maxlen;
 	ch->next_maxlen = maxlen;
 	ch->init_maxlen = maxlen;
+	ch->rx_flush_ms = 0;
+	ch->rx_flush = 0;
+	ch->rx_first = 0;
+	bchannel_rx_coalesce(ch, rx_frame_ms, rx_flush_ms);
+	ch->minlen = ch->next_minlen;
 	ch->hw = NULL;
 	ch->rx_skb = NULL;
+	ch->rx_ring = NULL;
 	ch->tx_skb = NULL;
 	ch->tx_idx = 0;
 	skb_queue_head_init(&ch->rqueue);
 	ch->rcount = 0;
 	ch->next_skb = NULL;
 	INIT_WORK(&ch->workq, bchannel_bh);
+	alloc_channel_stats(&ch->ch);
 	return 0;
 }
 EXPORT_SYMBOL(mISDN_initbchannel);
@@ -117,6 +342,7 @@ mISDN_freedchannel(struct dchannel *ch)
 	skb_queue_purge(&ch->squeue);
 	skb_queue_purge(&ch->rqueue);
 	flush_work(&ch->workq);
+	free_channel_stats(&ch->dev.D);
 	return 0;
 }
 EXPORT_SYMBOL(mISDN_freedchannel);
@@ -143,11 +369,14 @@ mISDN_clear_bchannel(struct bchannel *ch)
 	test_and_clear_bit(FLG_FILLEMPTY, &ch->Flags);
 	test_and_clear_bit(FLG_TX_EMPTY, &ch->Flags);
 	test_and_clear_bit(FLG_RX_OFF, &ch->Flags);
+	test_and_clear_bit(FLG_RX_RING, &ch->Flags);
 	ch->dropcnt = 0;
 	ch->minlen = ch->init_minlen;
 	ch->next_minlen = ch->init_minlen;
 	ch->maxlen = ch->init_maxlen;
 	ch->next_maxlen = ch->init_maxlen;
+	bchannel_rx_coalesce(ch, rx_frame_ms, rx_flush_ms);
+	ch->minlen = ch->next_minlen;
 	skb_queue_purge(&ch->rqueue);
 	ch->rcount = 0;
 }
@@ -158,18 +387,56 @@ mISDN_freebchannel(struct bchannel *ch)
 {
 	cancel_work_sync(&ch->workq);
 	mISDN_clear_bchannel(ch);
+	kfree(ch->rx_ring);
+	ch->rx_ring = NULL;
+	free_channel_stats(&ch->ch);
 }
 EXPORT_SYMBOL(mISDN_freebchannel);
 
+/*
+ * turn the rx ring of a bchannel on or off, for the layer above it in the
+ * kernel (dsp). returns the ring, or NULL if it is off or cannot be used.
+ * the ring stays allocated until the channel is freed, so the driver and
+ * the consumer never see it go away.
+ * ch must be the channel of a bchannel, which sets OPTION_RX_RING.
+ */
+struct mISDN_rx_ring *
+mISDN_bchannel_rx_ring(struct mISDNchannel *ch, int on)
+{
+	struct bchannel *bch;
+
+	if (!test_bit(OPTION_RX_RING, &ch->opt))
+		return NULL;
+	bch = container_of(ch, struct bchannel, ch);
+	if (!on || !test_bit(FLG_TRANSPARENT, &bch->Flags)) {
+		test_and_clear_bit(FLG_RX_RING, &bch->Flags);
+		return NULL;
+	}
+	if (!bch->rx_ring) {
+		bch->rx_ring = kzalloc(sizeof(struct mISDN_rx_ring),
+				       GFP_ATOMIC);
+		if (!bch->rx_ring)
+			return NULL;
+	}
+	bch->rx_ring->head = 0;
+	bch->rx_ring->tail = 0;
+	bch->rx_ring->overrun = 0;
+	smp_wmb(); /* empty ring before it is used */
+	test_and_set_bit(FLG_RX_RING, &bch->Flags);
+	return bch->rx_ring;
+}
+EXPORT_SYMBOL(mISDN_bchannel_rx_ring);
+
 int
 mISDN_ctrl_bchannel(struct bchannel *bch, struct mISDN_ctrl_req *cq)
 {
+	int frame_ms, flush_ms;
 	int ret = 0;
 
 	switch (cq->op) {
 	case MISDN_CTRL_GETOP:
 		cq->op = MISDN_CTRL_RX_BUFFER | MISDN_CTRL_FILL_EMPTY |
-			 MISDN_CTRL_RX_OFF;
+			 MISDN_CTRL_RX_OFF | MISDN_CTRL_RX_COALESCE;
 		break;
 	case MISDN_CTRL_FILL_EMPTY:
 		if (cq->p1) {
@@ -193,10 +460,23 @@ mISDN_ctrl_bchannel(struct bchannel *bch, struct mISDN_ctrl_req *cq)
 			bch->next_maxlen = cq->p2;
 		if (cq->p1 > MISDN_CTRL_RX_SIZE_IGNORE)
 			bch->next_minlen = cq->p1;
+		audio_pool_fit(bch);
 		/* we return the old values */
 		cq->p1 = bch->minlen;
 		cq->p2 = bch->maxlen;
 		break;
+	case MISDN_CTRL_RX_COALESCE:
+		if (cq->p1 > 0xffff / 8) {
+			ret = -EINVAL;
+			break;
+		}
+		frame_ms = bch->minlen / 8;
+		flush_ms = bch->rx_flush_ms;
+		bchannel_rx_coalesce(bch, cq->p1, cq->p2);
+		/* we return the old values */
+		cq->p1 = frame_ms;
+		cq->p2 = flush_ms;
+		break;
 	default:
 		pr_info("mISDN unhandled control %x operation\n", cq->op);
 		ret = -EINVAL;
@@ -222,10 +502,14 @@ recv_Dchannel(struct dchannel *dch)
 	struct mISDNhead *hh;
 
 	if (dch->rx_skb->len < 2) { /* at least 2 for sapi / tei */
+		mISDN_stat_inc(&dch->dev.D, rx_dropped);
 		dev_kfree_skb(dch->rx_skb);
 		dch->rx_skb = NULL;
 		return;
 	}
+	mISDN_stat_inc(&dch->dev.D, rx_frames);
+	mISDN_stat_add(&dch->dev.D, rx_bytes, dch->rx_skb->len);
+	mISDN_rx_stamp(dch->rx_skb);
 	hh = mISDN_HEAD_P(dch->rx_skb);
 	hh->prim = PH_DATA_IND;
 	hh->id = get_sapi_tei(dch->rx_skb->data);
@@ -245,6 +529,7 @@ recv_Echannel(struct dchannel *ech, struct dchannel *dch)
 		ech->rx_skb = NULL;
 		return;
 	}
+	mISDN_rx_stamp(ech->rx_skb);
 	hh = mISDN_HEAD_P(ech->rx_skb);
 	hh->prim = PH_DATA_E_IND;
 	hh->id = get_sapi_tei(ech->rx_skb->data);
@@ -270,7 +555,9 @@ recv_Bchannel(struct bchannel *bch, unsigned int id, bool force)
 		bch->rx_skb = NULL;
 	} else {
 		if (test_bit(FLG_TRANSPARENT, &bch->Flags) &&
-		    (bch->rx_skb->len < bch->minlen) && !force)
+		    (bch->rx_skb->len < bch->minlen) && !force &&
+		    (!bch->rx_flush ||
+		     time_before(jiffies, bch->rx_first + bch->rx_flush)))
 				return;
 		hh = mISDN_HEAD_P(bch->rx_skb);
 		hh->prim = PH_DATA_IND;
@@ -279,8 +566,15 @@ recv_Bchannel(struct bchannel *bch, unsigned int id, bool force)
 			printk(KERN_WARNING
 			       "B%d receive queue overflow - flushing!\n",
 			       bch->nr);
+			mISDN_stat_add(&bch->ch, rx_dropped,
+				       skb_queue_len(&bch->rqueue));
 			skb_queue_purge(&bch->rqueue);
 		}
+		mISDN_stat_inc(&bch->ch, rx_frames);
+		mISDN_stat_add(&bch->ch, rx_bytes, bch->rx_skb->len);
+		mISDN_rx_stamp(bch->rx_skb);
+		trace_misdn_bch_rx(&bch->ch, bch->nr, bch->rx_skb->len,
+				   bch->rcount);
 		bch->rcount++;
 		skb_queue_tail(&bch->rqueue, bch->rx_skb);
 		bch->rx_skb = NULL;
@@ -292,6 +586,9 @@ EXPORT_SYMBOL(recv_Bchannel);
 void
 recv_Dchannel_skb(struct dchannel *dch, struct sk_buff *skb)
 {
+	mISDN_stat_inc(&dch->dev.D, rx_frames);
+	mISDN_stat_add(&dch->dev.D, rx_bytes, skb->len);
+	mISDN_rx_stamp(skb);
 	skb_queue_tail(&dch->rqueue, skb);
 	schedule_event(dch, FLG_RECVQUEUE);
 }
@@ -303,15 +600,43 @@ recv_Bchannel_skb(struct bchannel *bch, struct sk_buff *skb)
 	if (bch->rcount >= 64) {
 		printk(KERN_WARNING "B-channel %p receive queue overflow, "
 		       "flushing!\n", bch);
+		mISDN_stat_add(&bch->ch, rx_dropped,
+			       skb_queue_len(&bch->rqueue));
 		skb_queue_purge(&bch->rqueue);
 		bch->rcount = 0;
 	}
+	mISDN_stat_inc(&bch->ch, rx_frames);
+	mISDN_stat_add(&bch->ch, rx_bytes, skb->len);
+	mISDN_rx_stamp(skb);
+	trace_misdn_bch_rx(&bch->ch, bch->nr, skb->len, bch->rcount);
 	bch->rcount++;
 	skb_queue_tail(&bch->rqueue, skb);
 	schedule_event(bch, FLG_RECVQUEUE);
 }
 EXPORT_SYMBOL(recv_Bchannel_skb);
 
+/*
+ * transparent receive data goes to the ring of the consumer, if it has
+ * turned it on by mISDN_bchannel_rx_ring, no skb is allocated or queued then.
+ * returns 0, if the data must be received by rx_skb.
+ */
+int
+recv_Bchannel_ring(struct bchannel *bch, const u8 *data, int len)
+{
+	int	n;
+
+	if (!test_bit(FLG_RX_RING, &bch->Flags))
+		return 0;
+	n = mISDN_rx_ring_put(bch->rx_ring, data, len);
+	trace_misdn_bch_rx(&bch->ch, bch->nr, len, 0);
+	mISDN_stat_inc(&bch->ch, rx_frames);
+	mISDN_stat_add(&bch->ch, rx_bytes, n);
+	if (n < len)
+		mISDN_stat_inc(&bch->ch, rx_dropped);
+	return len;
+}
+EXPORT_SYMBOL(recv_Bchannel_ring);
+
 static void
 confirm_Dsend(struct dchannel *dch)
 {
@@ -415,13 +740,17 @@ dchannel_senddata(struct dchannel *ch, struct sk_buff *skb)
 	/* check oversize */
 	if (skb->len <= 0) {
 		printk(KERN_WARNING "%s: skb too small\n", __func__);
+		mISDN_stat_inc(&ch->dev.D, tx_dropped);
 		return -EINVAL;
 	}
 	if (skb->len > ch->maxlen) {
 		printk(KERN_WARNING "%s: skb too large(%d/%d)\n",
 		       __func__, skb->len, ch->maxlen);
+		mISDN_stat_inc(&ch->dev.D, tx_dropped);
 		return -EINVAL;
 	}
+	mISDN_stat_inc(&ch->dev.D, tx_frames);
+	mISDN_stat_add(&ch->dev.D, tx_bytes, skb->len);
 	/* HW lock must be obtained */
 	if (test_and_set_bit(FLG_TX_BUSY, &ch->Flags)) {
 		skb_queue_tail(&ch->squeue, skb);
@@ -442,11 +771,13 @@ bchannel_senddata(struct bchannel *ch, struct sk_buff *skb)
 	/* check oversize */
 	if (skb->len <= 0) {
 		printk(KERN_WARNING "%s: skb too small\n", __func__);
+		mISDN_stat_inc(&ch->ch, tx_dropped);
 		return -EINVAL;
 	}
 	if (skb->len > ch->maxlen) {
 		printk(KERN_WARNING "%s: skb too large(%d/%d)\n",
 		       __func__, skb->len, ch->maxlen);
+		mISDN_stat_inc(&ch->ch, tx_dropped);
 		return -EINVAL;
 	}
 	/* HW lock must be obtained */
@@ -455,8 +786,17 @@ bchannel_senddata(struct bchannel *ch, struct sk_buff *skb)
 		printk(KERN_WARNING
 		       "%s: next_skb exist ERROR (skb->len=%d next_skb->len=%d)\n",
 		       __func__, skb->len, ch->next_skb->len);
+		mISDN_stat_inc(&ch->ch, tx_dropped);
 		return -EBUSY;
 	}
+	/* page frags (MSG_ZEROCOPY) only for drivers which read them */
+	if (skb_is_nonlinear(skb) && !test_bit(OPTION_TX_SG, &ch->ch.opt) &&
+	    skb_linearize(skb)) {
+		mISDN_stat_inc(&ch->ch, tx_dropped);
+		return -ENOMEM;
+	}
+	mISDN_stat_inc(&ch->ch, tx_frames);
+	mISDN_stat_add(&ch->ch, tx_bytes, skb->len);
 	if (test_and_set_bit(FLG_TX_BUSY, &ch->Flags)) {
 		test_and_set_bit(FLG_TX_NEXT, &ch->Flags);
 		ch->next_skb = skb;
@@ -515,12 +855,97 @@ bchannel_get_rxbuf(struct bchannel *bch, int reqlen)
 		/* with HDLC we do not know the length yet */
 		len = bch->maxlen;
 	}
-	bch->rx_skb = mI_alloc_skb(len, GFP_ATOMIC);
+	if (test_bit(FLG_TRANSPARENT, &bch->Flags))
+		bch->rx_skb = mI_alloc_audio_skb(len, GFP_ATOMIC);
+	else
+		bch->rx_skb = mI_alloc_skb(len, GFP_ATOMIC);
 	if (!bch->rx_skb) {
 		pr_warning("B%d receive no memory for %d bytes\n",
 			   bch->nr, len);
 		len = -ENOMEM;
-	}
+	} else
+		bch->rx_first = jiffies;
 	return len;
 }
 EXPORT_SYMBOL(bchannel_get_rxbuf);
+
+/*
+ * interrupt mitigation
+ *
+ * a card calls mISDN_irqpoll_irq() from its interrupt handler. if it gets
+ * more than limit interrupts within a jiffy, the function returns true and
+ * the card has to mask its interrupts, after it handled the current events.
+ * the timer then calls poll() once per jiffy, until poll() did not find
+ * any event for MISDN_IRQPOLL_IDLE times. rearm() unmasks the interrupts
+ * of the card again. poll() and rearm() take the card lock themselves.
+ * while the card is idle nothing changes, every event has its interrupt.
+ */
+static void
+mISDN_irqpoll_timer(struct mISDN_irqpoll *ip)
+{
+	int	done;
+
+	if (test_bit(FLG_IRQPOLL_STOP, &ip->Flags))
+		return;
+	ip->polls++;
+	done = ip->poll(ip, ip->budget);
+	if (done) {
+		ip->idle = 0;
+	} else if (++ip->idle >= MISDN_IRQPOLL_IDLE) {
+		ip->count = 0;
+		ip->stamp = jiffies;
+		/* irqs may start the timer again after this */
+		clear_bit(FLG_IRQPOLL_ON, &ip->Flags);
+		if (!test_bit(FLG_IRQPOLL_STOP, &ip->Flags))
+			ip->rearm(ip);
+		return;
+	}
+	mod_timer(&ip->timer, jiffies + 1);
+}
+
+void
+mISDN_irqpoll_init(struct mISDN_irqpoll *ip,
+		   int (*poll)(struct mISDN_irqpoll *, int),
+		   void (*rearm)(struct mISDN_irqpoll *),
+		   u_int limit, int budget)
+{
+	memset(ip, 0, sizeof(*ip));
+	ip->poll = poll;
+	ip->rearm = rearm;
+	ip->limit = limit;
+	ip->budget = budget;
+	ip->stamp = jiffies;
+	setup_timer(&ip->timer, (void *)mISDN_irqpoll_timer, (u_long)ip);
+}
+EXPORT_SYMBOL(mISDN_irqpoll_init);
+
+/* called with the card lock held, returns true if irqs must be masked */
+bool
+mISDN_irqpoll_irq(struct mISDN_irqpoll *ip)
+{
+	if (!ip->limit || test_bit(FLG_IRQPOLL_STOP, &ip->Flags))
+		return false;
+	if (ip->stamp != jiffies) {
+		ip->stamp = jiffies;
+		ip->count = 0;
+	}
+	if (++ip->count <= ip->limit)
+		return false;
+	if (test_and_set_bit(FLG_IRQPOLL_ON, &ip->Flags))
+		return false;
+	ip->idle = 0;
+	ip->switches++;
+	mod_timer(&ip->timer, jiffies + 1);
+	return true;
+}
+EXPORT_SYMBOL(mISDN_irqpoll_irq);
+
+/* before the card masks its interrupts for the last time */
+void
+mISDN_irqpoll_kill(struct mISDN_irqpoll *ip)
+{
+	set_bit(FLG_IRQPOLL_STOP, &ip->Flags);
+	del_timer_sync(&ip->timer);
+	clear_bit(FLG_IRQPOLL_ON, &ip->Flags);
+}
+EXPORT_SYMBOL(mISDN_irqpoll_kill);
@@ -16,15 +16,68 @@
 /* frames */
 #define L1OIP_MAX_LEN		2048		/* max packet size form l2 */
 #define L1OIP_MAX_PERFRAME	1400		/* max data size in one frame */
+#define L1OIP_MAX_BLOCK		256		/* max data of a block in a
+						 * multi channel frame */
 
 
 /* timers */
 #define L1OIP_KEEPALIVE		15
 #define L1OIP_TIMEOUT		65
+#define L1OIP_SWEEP		HZ	/* checks them for all cards */
 
 
 /* socket */
 #define L1OIP_DEFAULTPORT	931
+#define L1OIP_PEER_BITS		6	/* hash of the cards of a socket */
+
+
+/* jitter buffer of a bchannel */
+#define L1OIP_JB_SIZE		2048	/* samples, power of 2 */
+#define L1OIP_JB_MASK		(L1OIP_JB_SIZE - 1)
+#define L1OIP_JB_PLC		80	/* a gap repeats the last 10ms */
+#define L1OIP_JB_PLC_MAX	320	/* then silence after 40ms */
+#define L1OIP_JB_MARGIN		40	/* depth around the target */
+
+/* counters for MISDN_CTRL_JB_STATS */
+#define L1OIP_JB_PACKETS	0
+#define L1OIP_JB_LOST		1	/* gaps concealed */
+#define L1OIP_JB_LATE		2	/* behind the playout */
+#define L1OIP_JB_REORDERED	3
+#define L1OIP_JB_CONCEALED	4	/* samples */
+#define L1OIP_JB_COUNTERS	5
+
+struct l1oip_jb {
+	u8			buf[L1OIP_JB_SIZE];
+	DECLARE_BITMAP(valid, L1OIP_JB_SIZE);	/* not yet played */
+	int			started;
+	int			primed;		/* real samples played */
+	u32			play;		/* timebase of next sample */
+	u32			high;		/* after the newest sample */
+	u32			out;		/* timebase sent up */
+	u32			jitter;		/* interarrival jitter << 4 */
+	u32			last_arrival;	/* samples of the card clock */
+	u32			last_ts;
+	u32			gap;		/* samples concealed in a row */
+	u32			stats[L1OIP_JB_COUNTERS];
+};
+
+
+/* address of a peer, in the family of the socket */
+union l1oip_addr {
+	struct sockaddr		sa;
+	struct sockaddr_in	sin;
+	struct sockaddr_in6	sin6;
+};
+
+/* socket, shared by all cards with the same local port */
+struct l1oip_sock {
+	struct list_head	list;
+	int			refcnt;		/* cards using it */
+	u16			port;
+	int			family;		/* AF_INET6 also gets IPv4 */
+	struct socket		*udp;
+	DECLARE_HASHTABLE(peers, L1OIP_PEER_BITS);	/* cards by id */
+};
 
 
 /* channel structure */
@@ -34,6 +87,7 @@ struct l1oip_chan {
 	u32			tx_counter;	/* counts xmit bytes/packets */
 	u32			rx_counter;	/* counts recv bytes/packets */
 	u32			codecstate;	/* used by codec to save data */
+	struct l1oip_jb		*jb;		/* if jitter is set */
 #ifdef REORDER_DEBUG
 	int			disorder_flag;
 	struct sk_buff		*disorder_skb;
@@ -58,25 +112,39 @@ struct l1oip {
 	int			bundle;		/* bundle channels in one frm */
 	int			codec;		/* codec to use for transmis. */
 	int			limit;		/* limit number of bchannels */
+	u32			jitter;		/* delay of the jitter buffers */
+
+	/* playout of the jitter buffers */
+	struct timer_list	jb_tl;
+	ktime_t			jb_start;
+	u64			jb_played;	/* samples since jb_start */
 
 	/* timer */
-	struct timer_list	keep_tl;
-	struct timer_list	timeout_tl;
+	unsigned long		last_tx;	/* jiffies of last frame sent */
+	unsigned long		last_rx;	/* jiffies of last valid frame */
 	int			timeout_on;
-	struct work_struct	workq;
 
 	/* socket */
 	struct socket		*socket;	/* if set, socket is created */
-	struct completion	socket_complete;/* completion of sock thread */
-	struct task_struct	*socket_thread;
-	spinlock_t		socket_lock;	/* access sock outside thread */
+	struct l1oip_sock	*sock;		/* attached, while it is open */
+	struct hlist_node	peer_node;	/* in the peers of sock */
+	spinlock_t		socket_lock;	/* seize sock for sending */
+	spinlock_t		rx_lock;	/* serializes the receive hook */
 	u32			remoteip;	/* if all set, ip is assigned */
+	struct in6_addr		remoteip6;	/* if set, used instead */
 	u16			localport;	/* must always be set */
 	u16			remoteport;	/* must always be set */
-	struct sockaddr_in	sin_local;	/* local socket name */
-	struct sockaddr_in	sin_remote;	/* remote socket name */
+	union l1oip_addr	remote;		/* remote socket name */
 	struct msghdr		sendmsg;	/* ip message to send */
-	struct kvec		sendiov;	/* iov for message */
+	u8			tx_buf[L1OIP_MAX_PERFRAME]; /* encoded data,
+						 * owned with the socket */
+
+	/* multi channel frame, the blocks of all bchannels */
+	spinlock_t		bundle_lock;
+	struct tasklet_struct	bundle_tasklet;	/* sends the frame */
+	u8			bundle_buf[L1OIP_MAX_PERFRAME];
+	int			bundle_len;
+	int			bundle_last;	/* offset of the last block */
 
 	/* frame */
 	struct l1oip_chan	chan[128];	/* channel instances */
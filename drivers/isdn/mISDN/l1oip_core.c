@@ -26,11 +26,12 @@
  * type:
  Value 1	= BRI
  Value 2	= PRI
- Value 3 = BRI (multi channel frame, not supported yet)
- Value 4 = PRI (multi channel frame, not supported yet)
+ Value 3 = BRI (multi channel frame)
+ Value 4 = PRI (multi channel frame)
  A multi channel frame reduces overhead to a single frame for all
  b-channels, but increases delay.
- (NOTE: Multi channel frames are not implemented yet.)
+ The b-channel data sent in one go, like one tick of the DSP, is collected
+ and sent as one frame, or a few frames, if it exceeds 1400 bytes.
 
  * codec:
  Value 0 = transparent (default)
@@ -55,10 +56,15 @@
  If not given or four 0, no remote address is set.
  For multiple interfaces, concat ip addresses. (127,0,0,1,127,0,0,1)
 
+ * ip6:
+ remote IPv6 address (2001:db8::1), used instead of ip, if given.
+ For multiple interfaces, separate them by comma.
+
  * port:
  port number (local interface)
  If not given or 0, port 931 is used for fist instance, 932 for next...
- For multiple interfaces, different ports must be given.
+ Multiple interfaces may use the same port, if they have different IDs.
+ Only one of them may have no ID.
 
  * remoteport:
  port number (remote interface)
@@ -71,6 +77,13 @@
  the default is 0
  NOTE: ID must also be set for on demand.
 
+ * jitter:
+ target delay of the jitter buffer of transparent b-channels in ms (1..128)
+ Received audio is put in order by the time base and played out by the
+ driver with this delay, which grows with the measured jitter. Gaps are
+ concealed by repeating the last 10ms, then by silence.
+ If not given or 0, the audio is sent up as received (default).
+
  * id:
  optional value to identify frames. This value must be equal on both
  peers and should be random. If omitted or 0, no ID is transmitted.
@@ -90,6 +103,10 @@
 
  op = MISDN_CTRL_UNSETPEER*
 
+ op = MISDN_CTRL_JB_STATS (bchannel)
+ p1 = counter of the jitter buffer (L1OIP_JB_PACKETS...)
+ p2 = returns the value
+
  * Use l1oipctrl for comfortable setting or removing ip address.
  (Layer 1 Over IP CTRL)
 
@@ -193,6 +210,10 @@
  When a valid packet is received, a timer 65 seconds is started. The interface
  become ACTIVE. If the timer expires, the interface becomes INACTIVE.
 
+ Both timers are only the time of the last packet sent and received. They are
+ checked once a second for all interfaces by l1oip_sweep(), so sending and
+ receiving never touch a timer.
+
 
  Dynamic IP handling:
 
@@ -209,15 +230,19 @@
  This feature only works with ID set, otherwhise it is highly unsecure.
 
 
- Socket and Thread
- -----------------
+ Socket
+ ------
 
- The complete socket opening and closing is done by a thread.
- When the thread opened a socket, the hc->socket descriptor is set. Whenever a
- packet shall be sent to the socket, the hc->socket must be checked wheter not
- NULL. To prevent change in socket descriptor, the hc->socket_lock must be used.
- To change the socket, a recall of l1oip_socket_open() will safely kill the
- socket process and create a new one.
+ The socket is opened by l1oip_socket_open(). All interfaces with the same
+ local port share one socket, which receives IPv4 and IPv6, if available.
+ Received datagrams are parsed by the receive hook of the UDP socket in
+ softirq, there is no thread to read the socket. The hook finds the interface
+ by the ID of the frame in the hash table of the socket.
+ When the socket is open, the hc->socket descriptor is set.
+ Whenever a packet shall be sent to the socket, the hc->socket must be checked
+ wheter not NULL. To prevent change in socket descriptor, the hc->socket_lock
+ must be used. To change the socket, a recall of l1oip_socket_open() will
+ safely close the socket and create a new one.
 
 */
 
@@ -232,11 +257,16 @@
 #include <linux/in.h>
 #include <linux/inet.h>
 #include <linux/workqueue.h>
-#include <linux/kthread.h>
 #include <linux/slab.h>
-#include <linux/sched/signal.h>
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/udp.h>
+#include <linux/hashtable.h>
+#include <linux/mutex.h>
 
 #include <net/sock.h>
+#include <net/ipv6.h>
+#include <net/udp_tunnel.h>
 #include "core.h"
 #include "l1oip.h"
 
@@ -245,16 +275,22 @@ static const char *l1oip_revision = "2.00";
 static int l1oip_cnt;
 static spinlock_t l1oip_lock;
 static struct list_head l1oip_ilist;
+static LIST_HEAD(l1oip_socks);
+static DEFINE_MUTEX(l1oip_socks_lock);	/* socket list and their peers */
+static void l1oip_sweep(struct work_struct *work);
+static DECLARE_DELAYED_WORK(l1oip_sweep_work, l1oip_sweep);
 
 #define MAX_CARDS	16
 static u_int type[MAX_CARDS];
 static u_int codec[MAX_CARDS];
 static u_int ip[MAX_CARDS * 4];
+static char *ip6[MAX_CARDS];
 static u_int port[MAX_CARDS];
 static u_int remoteport[MAX_CARDS];
 static u_int ondemand[MAX_CARDS];
 static u_int limit[MAX_CARDS];
 static u_int id[MAX_CARDS];
+static u_int jitter[MAX_CARDS];
 static int debug;
 static int ulaw;
 
@@ -263,49 +299,144 @@ MODULE_LICENSE("GPL");
 module_param_array(type, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(codec, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(ip, uint, NULL, S_IRUGO | S_IWUSR);
+module_param_array(ip6, charp, NULL, S_IRUGO);
 module_param_array(port, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(remoteport, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(ondemand, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(limit, uint, NULL, S_IRUGO | S_IWUSR);
 module_param_array(id, uint, NULL, S_IRUGO | S_IWUSR);
+module_param_array(jitter, uint, NULL, S_IRUGO | S_IWUSR);
 module_param(ulaw, uint, S_IRUGO | S_IWUSR);
 module_param(debug, uint, S_IRUGO | S_IWUSR);
 
 /*
- * send a frame via socket, if open and restart timer
+ * addresses, kept in the family of the socket
+ * An IPv6 socket gets IPv4 as mapped addresses.
  */
+static void
+l1oip_addr_set4(union l1oip_addr *a, int family, __be32 ip, __be16 port)
+{
+	memset(a, 0, sizeof(*a));
+	if (family == AF_INET6) {
+		a->sin6.sin6_family = AF_INET6;
+		a->sin6.sin6_port = port;
+		if (ip)
+			ipv6_addr_set_v4mapped(ip, &a->sin6.sin6_addr);
+	} else {
+		a->sin.sin_family = AF_INET;
+		a->sin.sin_port = port;
+		a->sin.sin_addr.s_addr = ip;
+	}
+}
+
+static void
+l1oip_addr_set6(union l1oip_addr *a, const struct in6_addr *ip, __be16 port)
+{
+	memset(a, 0, sizeof(*a));
+	a->sin6.sin6_family = AF_INET6;
+	a->sin6.sin6_port = port;
+	a->sin6.sin6_addr = *ip;
+}
+
+/* if address and port are set */
 static int
-l1oip_socket_send(struct l1oip *hc, u8 localcodec, u8 channel, u32 chanmask,
-		  u16 timebase, u8 *buf, int len)
+l1oip_addr_valid(const union l1oip_addr *a)
 {
-	u8 *p;
-	u8 frame[len + 32];
-	struct socket *socket = NULL;
+	if (a->sa.sa_family == AF_INET6)
+		return !ipv6_addr_any(&a->sin6.sin6_addr) && a->sin6.sin6_port;
+	return a->sin.sin_addr.s_addr && a->sin.sin_port;
+}
 
-	if (debug & DEBUG_L1OIP_MSG)
-		printk(KERN_DEBUG "%s: sending data to socket (len = %d)\n",
-		       __func__, len);
+static int
+l1oip_addr_equal(const union l1oip_addr *a, const union l1oip_addr *b)
+{
+	if (a->sa.sa_family != b->sa.sa_family)
+		return 0;
+	if (a->sa.sa_family == AF_INET6)
+		return ipv6_addr_equal(&a->sin6.sin6_addr, &b->sin6.sin6_addr)
+			&& a->sin6.sin6_port == b->sin6.sin6_port;
+	return a->sin.sin_addr.s_addr == b->sin.sin_addr.s_addr
+		&& a->sin.sin_port == b->sin.sin_port;
+}
 
-	p = frame;
+/*
+ * seize the socket for sending a frame and restart timer
+ * returns NULL, if the socket is not open, busy or we have no remote. While
+ * the socket is seized, tx_buf of the card may be used for the frame.
+ * the senders run in process context and in softirq (bundle tasklet), so
+ * the socket lock is taken with bh disabled.
+ */
+static struct socket *
+l1oip_tx_begin(struct l1oip *hc)
+{
+	struct socket *socket = NULL;
 
 	/* restart timer */
-	if (time_before(hc->keep_tl.expires, jiffies + 5 * HZ))
-		mod_timer(&hc->keep_tl, jiffies + L1OIP_KEEPALIVE * HZ);
-	else
-		hc->keep_tl.expires = jiffies + L1OIP_KEEPALIVE * HZ;
-
-	if (debug & DEBUG_L1OIP_MSG)
-		printk(KERN_DEBUG "%s: resetting timer\n", __func__);
+	if (hc->last_tx != jiffies)
+		WRITE_ONCE(hc->last_tx, jiffies);
 
 	/* drop if we have no remote ip or port */
-	if (!hc->sin_remote.sin_addr.s_addr || !hc->sin_remote.sin_port) {
+	if (!l1oip_addr_valid(&hc->remote)) {
 		if (debug & DEBUG_L1OIP_MSG)
 			printk(KERN_DEBUG "%s: dropping frame, because remote "
 			       "IP is not set.\n", __func__);
-		return len;
+		return NULL;
+	}
+
+	/* check for socket in safe condition */
+	spin_lock_bh(&hc->socket_lock);
+	if (!hc->socket) {
+		spin_unlock_bh(&hc->socket_lock);
+		return NULL;
 	}
+	/* seize socket */
+	socket = hc->socket;
+	hc->socket = NULL;
+	spin_unlock_bh(&hc->socket_lock);
+
+	return socket;
+}
+
+/* give the seized socket back */
+static void
+l1oip_tx_put(struct l1oip *hc, struct socket *socket)
+{
+	spin_lock_bh(&hc->socket_lock);
+	hc->socket = socket;
+	spin_unlock_bh(&hc->socket_lock);
+}
+
+/*
+ * send the frame of header and data, the data is not copied
+ * gives the socket back
+ */
+static int
+l1oip_tx_end(struct l1oip *hc, struct socket *socket, u8 *hdr, int hlen,
+	     u8 *data, int len)
+{
+	struct kvec iov[2];
+
+	/* send packet */
+	if (debug & DEBUG_L1OIP_MSG)
+		printk(KERN_DEBUG "%s: sending packet to socket (len "
+		       "= %d)\n", __func__, hlen + len);
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = hlen;
+	iov[1].iov_base = data;
+	iov[1].iov_len = len;
+	len = kernel_sendmsg(socket, &hc->sendmsg, iov, len ? 2 : 1,
+			     hlen + len);
+	l1oip_tx_put(hc, socket);
+
+	return len;
+}
+
+/* frame header, returns its length */
+static int
+l1oip_frame_header(struct l1oip *hc, u8 localcodec, u8 *p)
+{
+	u8 *start = p;
 
-	/* assemble frame */
 	*p++ = (L1OIP_VERSION << 6) /* version and coding */
 		| (hc->pri ? 0x20 : 0x00) /* type */
 		| (hc->id ? 0x10 : 0x00) /* id */
@@ -316,44 +447,332 @@ l1oip_socket_send(struct l1oip *hc, u8 localcodec, u8 channel, u32 chanmask,
 		*p++ = hc->id >> 8;
 		*p++ = hc->id;
 	}
+	return p - start;
+}
+
+/* if the data must be encoded, else it is sent as it is */
+static inline int
+l1oip_transcode(u8 localcodec)
+{
+	return (localcodec == 1 && ulaw) || (localcodec == 2 && !ulaw) ||
+		localcodec == 3;
+}
+
+/* encode channel data, returns the length of the result */
+static int
+l1oip_encode(struct l1oip *hc, u8 localcodec, u8 channel, u8 *buf, int len,
+	     u8 *p)
+{
+	if (localcodec == 1 && ulaw)
+		l1oip_ulaw_to_alaw(buf, len, p);
+	else if (localcodec == 2 && !ulaw)
+		l1oip_alaw_to_ulaw(buf, len, p);
+	else if (localcodec == 3)
+		len = l1oip_law_to_4bit(buf, len, p,
+					&hc->chan[channel].codecstate);
+	else
+		memcpy(p, buf, len);
+	return len;
+}
+
+/*
+ * send a frame of one channel via socket
+ */
+static int
+l1oip_socket_send(struct l1oip *hc, u8 localcodec, u8 channel, u32 chanmask,
+		  u16 timebase, u8 *buf, int len)
+{
+	struct socket *socket;
+	u8 hdr[8], *p;
+
+	if (debug & DEBUG_L1OIP_MSG)
+		printk(KERN_DEBUG "%s: sending data to socket (len = %d)\n",
+		       __func__, len);
+
+	socket = l1oip_tx_begin(hc);
+	if (!socket)
+		return 0;
+
+	/* assemble header */
+	p = hdr + l1oip_frame_header(hc, localcodec, hdr);
 	*p++ =  0x00 + channel; /* m-flag, channel */
 	*p++ = timebase >> 8; /* time base */
 	*p++ = timebase;
 
-	if (buf && len) { /* add data to frame */
-		if (localcodec == 1 && ulaw)
-			l1oip_ulaw_to_alaw(buf, len, p);
-		else if (localcodec == 2 && !ulaw)
-			l1oip_alaw_to_ulaw(buf, len, p);
-		else if (localcodec == 3)
-			len = l1oip_law_to_4bit(buf, len, p,
-						&hc->chan[channel].codecstate);
-		else
-			memcpy(p, buf, len);
+	/* the data is sent in place, unless it must be encoded */
+	if (!buf)
+		len = 0;
+	if (len && l1oip_transcode(localcodec)) {
+		len = l1oip_encode(hc, localcodec, channel, buf, len,
+				   hc->tx_buf);
+		buf = hc->tx_buf;
 	}
-	len += p - frame;
 
-	/* check for socket in safe condition */
-	spin_lock(&hc->socket_lock);
-	if (!hc->socket) {
-		spin_unlock(&hc->socket_lock);
+	return l1oip_tx_end(hc, socket, hdr, p - hdr, buf, len);
+}
+
+/*
+ * multi channel frame
+ *
+ * The blocks of the bchannels are collected in bundle_buf, each with M-flag
+ * and length. The tasklet sends them after the current run of the sender,
+ * so all channels of one DSP tick share a frame. The last block of a frame
+ * gets no M-flag and no length.
+ * While another sender has seized the socket, the frame is kept and
+ * -EBUSY is returned, so it is sent by the next run of the tasklet.
+ */
+static int
+l1oip_bundle_flush(struct l1oip *hc)
+{
+	struct socket *socket;
+	u8 hdr[8];
+	u8 *last = NULL;
+	u_long flags;
+	int len, hlen;
+
+	if (!hc->bundle_len)
+		return 0;
+
+	/* without socket or remote, the frame is dropped like a single one */
+	socket = l1oip_tx_begin(hc);
+	if (!socket && READ_ONCE(hc->sock) && l1oip_addr_valid(&hc->remote))
+		return -EBUSY;
+
+	spin_lock_irqsave(&hc->bundle_lock, flags);
+	len = hc->bundle_len;
+	if (len && socket) {
+		memcpy(hc->tx_buf, hc->bundle_buf, len);
+		last = hc->tx_buf + hc->bundle_last;
+	}
+	hc->bundle_len = 0;
+	spin_unlock_irqrestore(&hc->bundle_lock, flags);
+
+	if (!socket)
+		return 0;
+	if (!len) {
+		l1oip_tx_put(hc, socket);
 		return 0;
 	}
-	/* seize socket */
-	socket = hc->socket;
-	hc->socket = NULL;
-	spin_unlock(&hc->socket_lock);
-	/* send packet */
+
+	*last &= 0x7f;
+	memmove(last + 1, last + 2, hc->tx_buf + len - last - 2);
+	len--;
+
 	if (debug & DEBUG_L1OIP_MSG)
-		printk(KERN_DEBUG "%s: sending packet to socket (len "
-		       "= %d)\n", __func__, len);
-	hc->sendiov.iov_base = frame;
-	hc->sendiov.iov_len  = len;
-	len = kernel_sendmsg(socket, &hc->sendmsg, &hc->sendiov, 1, len);
-	/* give socket back */
-	hc->socket = socket; /* no locking required */
+		printk(KERN_DEBUG "%s: sending multi channel frame (len = "
+		       "%d)\n", __func__, len);
+	hlen = l1oip_frame_header(hc, hc->codec, hdr);
+	l1oip_tx_end(hc, socket, hdr, hlen, hc->tx_buf, len);
+	return 0;
+}
 
-	return len;
+static void
+l1oip_bundle_tasklet(unsigned long data)
+{
+	struct l1oip *hc = (struct l1oip *)data;
+
+	if (l1oip_bundle_flush(hc))
+		tasklet_schedule(&hc->bundle_tasklet);
+}
+
+/* add a block of a bchannel, up to L1OIP_MAX_BLOCK bytes */
+static void
+l1oip_bundle_add(struct l1oip *hc, u8 channel, u16 timebase, u8 *buf,
+		 int len)
+{
+	u_long flags;
+	int busy;
+	u8 *p;
+
+	spin_lock_irqsave(&hc->bundle_lock, flags);
+	while (hc->bundle_len + 4 + len > L1OIP_MAX_PERFRAME) {
+		spin_unlock_irqrestore(&hc->bundle_lock, flags);
+		busy = l1oip_bundle_flush(hc);
+		spin_lock_irqsave(&hc->bundle_lock, flags);
+		/*
+		 * the frame is full and the socket is still busy, waiting
+		 * here could block its holder, so the old frame is dropped
+		 */
+		if (busy && hc->bundle_len + 4 + len > L1OIP_MAX_PERFRAME)
+			hc->bundle_len = 0;
+	}
+	hc->bundle_last = hc->bundle_len;
+	p = hc->bundle_buf + hc->bundle_len;
+	len = l1oip_encode(hc, hc->codec, channel, buf, len, p + 4);
+	p[0] = 0x80 | channel; /* m-flag, channel */
+	p[1] = len; /* 256 is 0 */
+	p[2] = timebase >> 8; /* time base */
+	p[3] = timebase;
+	hc->bundle_len += 4 + len;
+	spin_unlock_irqrestore(&hc->bundle_lock, flags);
+	tasklet_schedule(&hc->bundle_tasklet);
+}
+
+
+/*
+ * jitter buffer
+ *
+ * The samples are stored at their time base and played out by l1oip_jb_tick
+ * with the card clock. The playout follows the newest samples with a target
+ * delay, which is the configured one or three times the measured jitter.
+ * A sample is dropped or repeated per tick to stay near the target.
+ * All of it runs in softirq under hc->rx_lock.
+ */
+#define L1OIP_JB_TICK	(HZ / 100 ? HZ / 100 : 1)
+
+static inline u32
+l1oip_jb_clock(struct l1oip *hc)
+{
+	return div_u64(ktime_to_ns(ktime_sub(ktime_get(), hc->jb_start)),
+		       NSEC_PER_SEC / 8000);
+}
+
+static u32
+l1oip_jb_target(struct l1oip *hc, struct l1oip_jb *jb)
+{
+	u32 target = 3 * (jb->jitter >> 4);
+
+	if (target < hc->jitter)
+		target = hc->jitter;
+	if (target > L1OIP_JB_SIZE / 2)
+		target = L1OIP_JB_SIZE / 2;
+	return target;
+}
+
+static void
+l1oip_jb_reset(struct l1oip_jb *jb)
+{
+	memset(jb->buf, ulaw ? 0xff : 0x2a, L1OIP_JB_SIZE);
+	bitmap_zero(jb->valid, L1OIP_JB_SIZE);
+	jb->started = 0;
+	jb->primed = 0;
+	jb->jitter = 0;
+	jb->gap = 0;
+}
+
+static void
+l1oip_jb_put(struct l1oip *hc, struct l1oip_jb *jb, u32 ts, u8 *buf, int len)
+{
+	u32 arrival = l1oip_jb_clock(hc);
+	s32 d;
+	int i;
+
+	jb->stats[L1OIP_JB_PACKETS]++;
+	/* start, or start again after a jump of the time base */
+	if (!jb->started || (s32)(ts - jb->play) < -L1OIP_JB_SIZE ||
+	    (s32)(ts + len - jb->play) > L1OIP_JB_SIZE) {
+		if (jb->started)
+			bitmap_zero(jb->valid, L1OIP_JB_SIZE);
+		else
+			jb->out = ts;
+		jb->play = ts - l1oip_jb_target(hc, jb);
+		jb->high = ts;
+		jb->last_ts = ts;
+		jb->last_arrival = arrival;
+		jb->started = 1;
+	}
+	if ((s32)(ts + len - jb->play) <= 0) {
+		jb->stats[L1OIP_JB_LATE]++;
+		return;
+	}
+	if ((s32)(ts - jb->high) < 0) {
+		jb->stats[L1OIP_JB_REORDERED]++;
+	} else {
+		/* RFC 3550 interarrival jitter, of packets in order */
+		d = (s32)(arrival - jb->last_arrival) - (s32)(ts - jb->last_ts);
+		jb->jitter += abs(d) - ((jb->jitter + 8) >> 4);
+		jb->last_arrival = arrival;
+		jb->last_ts = ts;
+		jb->high = ts + len;
+	}
+	for (i = 0; i < len; i++, ts++) {
+		/* the start may be behind the playout */
+		if ((s32)(ts - jb->play) < 0)
+			continue;
+		jb->buf[ts & L1OIP_JB_MASK] = buf[i];
+		set_bit(ts & L1OIP_JB_MASK, jb->valid);
+	}
+}
+
+static void
+l1oip_jb_play(struct l1oip *hc, struct bchannel *bch, struct l1oip_jb *jb,
+	      int n)
+{
+	struct sk_buff *skb;
+	s32 depth = jb->high - jb->play;
+	u32 target = l1oip_jb_target(hc, jb);
+	int i, pos, insert = 0;
+	u8 *p;
+
+	skb = mI_alloc_skb(n, GFP_ATOMIC);
+	if (!skb) {
+		jb->play += n;
+		return;
+	}
+	p = skb_put(skb, n);
+
+	/* one sample less or more per tick, to stay near the target */
+	if (depth > (s32)(target + L1OIP_JB_MARGIN)) {
+		clear_bit(jb->play & L1OIP_JB_MASK, jb->valid);
+		jb->play++;
+	} else if (depth > 0 && depth < (s32)target - L1OIP_JB_MARGIN && n > 1)
+		insert = n >> 1;
+
+	for (i = 0; i < n; i++) {
+		if (insert && i == insert) {
+			p[i] = p[i - 1];
+			insert = 0;
+			continue;
+		}
+		pos = jb->play & L1OIP_JB_MASK;
+		if (test_and_clear_bit(pos, jb->valid)) {
+			p[i] = jb->buf[pos];
+			jb->primed = 1;
+			jb->gap = 0;
+		} else {
+			/* conceal, a new gap after real samples is a loss */
+			if (!jb->gap && jb->primed)
+				jb->stats[L1OIP_JB_LOST]++;
+			if (jb->primed)
+				jb->stats[L1OIP_JB_CONCEALED]++;
+			if (++jb->gap <= L1OIP_JB_PLC_MAX)
+				p[i] = jb->buf[(pos - L1OIP_JB_PLC) &
+					       L1OIP_JB_MASK];
+			else
+				p[i] = ulaw ? 0xff : 0x2a;
+			/* so the repetition goes on with the concealed data */
+			jb->buf[pos] = p[i];
+		}
+		jb->play++;
+	}
+	/* the time base sent up has no gaps */
+	queue_ch_frame(&bch->ch, PH_DATA_IND, jb->out, skb);
+	jb->out += n;
+}
+
+static void
+l1oip_jb_tick(void *data)
+{
+	struct l1oip *hc = (struct l1oip *)data;
+	struct bchannel *bch;
+	u64 now;
+	int n, ch;
+
+	spin_lock(&hc->rx_lock);
+	now = l1oip_jb_clock(hc);
+	n = now - hc->jb_played;
+	hc->jb_played = now;
+	if (n > L1OIP_JB_SIZE / 2)
+		n = L1OIP_JB_SIZE / 2;
+	for (ch = 0; n > 0 && ch < 128; ch++) {
+		bch = hc->chan[ch].bch;
+		if (!bch || !hc->chan[ch].jb || !hc->chan[ch].jb->started ||
+		    !test_bit(FLG_ACTIVE, &bch->Flags))
+			continue;
+		l1oip_jb_play(hc, bch, hc->chan[ch].jb, n);
+	}
+	spin_unlock(&hc->rx_lock);
+	mod_timer(&hc->jb_tl, jiffies + L1OIP_JB_TICK);
 }
 
 
@@ -450,8 +869,15 @@ l1oip_socket_recv(struct l1oip *hc, u8 remotecodec, u8 channel, u16 timebase,
 			rx_counter = cnt;
 		}
 		hc->chan[channel].disorder_flag ^= 1;
-		if (nskb)
+		if (!nskb)
+			return;
 #endif
+		if (hc->chan[channel].jb && bch->ch.protocol == ISDN_P_B_RAW) {
+			/* hc->rx_lock is held by the receive hook */
+			l1oip_jb_put(hc, hc->chan[channel].jb, rx_counter,
+				     nskb->data, len);
+			dev_kfree_skb(nskb);
+		} else
 			queue_ch_frame(&bch->ch, PH_DATA_IND, rx_counter, nskb);
 	}
 }
@@ -461,7 +887,7 @@ l1oip_socket_recv(struct l1oip *hc, u8 remotecodec, u8 channel, u16 timebase,
  * parse frame and extract channel data
  */
 static void
-l1oip_socket_parse(struct l1oip *hc, struct sockaddr_in *sin, u8 *buf, int len)
+l1oip_socket_parse(struct l1oip *hc, union l1oip_addr *from, u8 *buf, int len)
 {
 	u32			packet_id;
 	u8			channel;
@@ -621,24 +1047,16 @@ multiframe:
 		goto multiframe;
 
 	/* restart timer */
-	if (time_before(hc->timeout_tl.expires, jiffies + 5 * HZ) || !hc->timeout_on) {
-		hc->timeout_on = 1;
-		mod_timer(&hc->timeout_tl, jiffies + L1OIP_TIMEOUT * HZ);
-	} else /* only adjust timer */
-		hc->timeout_tl.expires = jiffies + L1OIP_TIMEOUT * HZ;
+	hc->last_rx = jiffies;
+	hc->timeout_on = 1;
 
 	/* if ip or source port changes */
-	if ((hc->sin_remote.sin_addr.s_addr != sin->sin_addr.s_addr)
-	    || (hc->sin_remote.sin_port != sin->sin_port)) {
+	if (!l1oip_addr_equal(&hc->remote, from)) {
 		if (debug & DEBUG_L1OIP_SOCKET)
 			printk(KERN_DEBUG "%s: remote address changes from "
-			       "0x%08x to 0x%08x (port %d to %d)\n", __func__,
-			       ntohl(hc->sin_remote.sin_addr.s_addr),
-			       ntohl(sin->sin_addr.s_addr),
-			       ntohs(hc->sin_remote.sin_port),
-			       ntohs(sin->sin_port));
-		hc->sin_remote.sin_addr.s_addr = sin->sin_addr.s_addr;
-		hc->sin_remote.sin_port = sin->sin_port;
+			       "%pISpc to %pISpc\n", __func__,
+			       &hc->remote.sa, &from->sa);
+		hc->remote = *from;
 	}
 }
 
@@ -646,131 +1064,154 @@ multiframe:
 /*
  * socket stuff
  */
-static int
-l1oip_socket_thread(void *data)
-{
-	struct l1oip *hc = (struct l1oip *)data;
-	int ret = 0;
-	struct msghdr msg;
-	struct sockaddr_in sin_rx;
-	unsigned char *recvbuf;
-	size_t recvbuf_size = 1500;
-	int recvlen;
-	struct socket *socket = NULL;
-	DECLARE_COMPLETION_ONSTACK(wait);
-
-	/* allocate buffer memory */
-	recvbuf = kmalloc(recvbuf_size, GFP_KERNEL);
-	if (!recvbuf) {
-		printk(KERN_ERR "%s: Failed to alloc recvbuf.\n", __func__);
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	/* make daemon */
-	allow_signal(SIGTERM);
 
-	/* create socket */
-	if (sock_create(PF_INET, SOCK_DGRAM, IPPROTO_UDP, &socket)) {
-		printk(KERN_ERR "%s: Failed to create socket.\n", __func__);
-		ret = -EIO;
-		goto fail;
-	}
+/* the card with the id on the socket, called with RCU or the socket lock */
+static struct l1oip *
+l1oip_peer_lookup(struct l1oip_sock *ls, u32 id)
+{
+	struct l1oip *hc;
 
-	/* set incoming address */
-	hc->sin_local.sin_family = AF_INET;
-	hc->sin_local.sin_addr.s_addr = INADDR_ANY;
-	hc->sin_local.sin_port = htons((unsigned short)hc->localport);
+	hash_for_each_possible_rcu(ls->peers, hc, peer_node, id)
+		if (hc->id == id)
+			return hc;
+	return NULL;
+}
 
-	/* set outgoing address */
-	hc->sin_remote.sin_family = AF_INET;
-	hc->sin_remote.sin_addr.s_addr = htonl(hc->remoteip);
-	hc->sin_remote.sin_port = htons((unsigned short)hc->remoteport);
-
-	/* bind to incoming port */
-	if (socket->ops->bind(socket, (struct sockaddr *)&hc->sin_local,
-			      sizeof(hc->sin_local))) {
-		printk(KERN_ERR "%s: Failed to bind socket to port %d.\n",
-		       __func__, hc->localport);
-		ret = -EINVAL;
-		goto fail;
+/*
+ * receive hook of the UDP socket, called in softirq for each datagram with
+ * a valid checksum, so no thread is needed to read the socket.
+ */
+static int
+l1oip_udp_recv(struct sock *sk, struct sk_buff *skb)
+{
+	struct l1oip_sock *ls;
+	struct l1oip *hc;
+	union l1oip_addr from;
+	u32 packet_id = 0;
+	u8 *buf;
+	int len;
+
+	ls = rcu_dereference_sk_user_data(sk);
+	if (!ls)
+		goto drop;
+	len = skb->len - sizeof(struct udphdr);
+	if (len <= 0 || skb_linearize(skb)) {
+		if (debug & DEBUG_L1OIP_SOCKET)
+			printk(KERN_WARNING "%s: dropping datagram (len = %d)\n",
+			       __func__, len);
+		goto drop;
 	}
-
-	/* check sk */
-	if (socket->sk == NULL) {
-		printk(KERN_ERR "%s: socket->sk == NULL\n", __func__);
-		ret = -EIO;
-		goto fail;
+	buf = skb->data + sizeof(struct udphdr);
+
+	/* find the card, the rest of the header is checked by the parser */
+	if ((buf[0] & 0x10) && len >= 5)
+		packet_id = buf[1] << 24 | buf[2] << 16 | buf[3] << 8 | buf[4];
+	hc = l1oip_peer_lookup(ls, packet_id);
+	if (!hc) {
+		printk(KERN_WARNING "%s: packet error - no interface with ID "
+		       "0x%x on port %d\n", __func__, packet_id, ls->port);
+		goto drop;
 	}
 
-	/* build receive message */
-	msg.msg_name = &sin_rx;
-	msg.msg_namelen = sizeof(sin_rx);
-	msg.msg_control = NULL;
-	msg.msg_controllen = 0;
-
-	/* build send message */
-	hc->sendmsg.msg_name = &hc->sin_remote;
-	hc->sendmsg.msg_namelen = sizeof(hc->sin_remote);
-	hc->sendmsg.msg_control = NULL;
-	hc->sendmsg.msg_controllen = 0;
+#if IS_ENABLED(CONFIG_IPV6)
+	if (skb->protocol == htons(ETH_P_IPV6))
+		l1oip_addr_set6(&from, &ipv6_hdr(skb)->saddr,
+				udp_hdr(skb)->source);
+	else
+#endif
+		l1oip_addr_set4(&from, ls->family, ip_hdr(skb)->saddr,
+				udp_hdr(skb)->source);
+
+	/* datagrams may be received on several cpus */
+	spin_lock(&hc->rx_lock);
+	l1oip_socket_parse(hc, &from, buf, len);
+	spin_unlock(&hc->rx_lock);
+	consume_skb(skb);
+	return 0;
 
-	/* give away socket */
-	spin_lock(&hc->socket_lock);
-	hc->socket = socket;
-	spin_unlock(&hc->socket_lock);
+drop:
+	kfree_skb(skb);
+	return 0;
+}
 
-	/* read loop */
-	if (debug & DEBUG_L1OIP_SOCKET)
-		printk(KERN_DEBUG "%s: socket created and open\n",
-		       __func__);
-	while (!signal_pending(current)) {
-		struct kvec iov = {
-			.iov_base = recvbuf,
-			.iov_len = recvbuf_size,
-		};
-		recvlen = kernel_recvmsg(socket, &msg, &iov, 1,
-					 recvbuf_size, 0);
-		if (recvlen > 0) {
-			l1oip_socket_parse(hc, &sin_rx, recvbuf, recvlen);
-		} else {
-			if (debug & DEBUG_L1OIP_SOCKET)
-				printk(KERN_WARNING
-				       "%s: broken pipe on socket\n", __func__);
+/*
+ * get the socket of the port, it is created, if it is not used yet
+ * called with l1oip_socks_lock
+ */
+static struct l1oip_sock *
+l1oip_sock_get(u16 port)
+{
+	struct udp_port_cfg udp_conf;
+	struct udp_tunnel_sock_cfg tunnel_cfg;
+	struct l1oip_sock *ls;
+	int err = -EAFNOSUPPORT;
+
+	list_for_each_entry(ls, &l1oip_socks, list) {
+		if (ls->port == port) {
+			ls->refcnt++;
+			return ls;
 		}
 	}
 
-	/* get socket back, check first if in use, maybe by send function */
-	spin_lock(&hc->socket_lock);
-	/* if hc->socket is NULL, it is in use until it is given back */
-	while (!hc->socket) {
-		spin_unlock(&hc->socket_lock);
-		schedule_timeout(HZ / 10);
-		spin_lock(&hc->socket_lock);
+	ls = kzalloc(sizeof(struct l1oip_sock), GFP_KERNEL);
+	if (!ls)
+		return ERR_PTR(-ENOMEM);
+	ls->port = port;
+	hash_init(ls->peers);
+
+	/* create socket, bound to incoming port, IPv6 also receives IPv4 */
+#if IS_ENABLED(CONFIG_IPV6)
+	memset(&udp_conf, 0, sizeof(udp_conf));
+	udp_conf.family = AF_INET6;
+	udp_conf.local_ip6 = in6addr_any;
+	udp_conf.local_udp_port = htons(port);
+	udp_conf.ipv6_v6only = 0;
+	err = udp_sock_create(&init_net, &udp_conf, &ls->udp);
+#endif
+	if (err == -EAFNOSUPPORT) {
+		memset(&udp_conf, 0, sizeof(udp_conf));
+		udp_conf.family = AF_INET;
+		udp_conf.local_ip.s_addr = htonl(INADDR_ANY);
+		udp_conf.local_udp_port = htons(port);
+		err = udp_sock_create(&init_net, &udp_conf, &ls->udp);
 	}
-	hc->socket = NULL;
-	spin_unlock(&hc->socket_lock);
+	if (err) {
+		printk(KERN_ERR "%s: Failed (%d) to create socket on port "
+		       "%d.\n", __func__, err, port);
+		kfree(ls);
+		return ERR_PTR(err);
+	}
+	ls->family = udp_conf.family;
 
-	if (debug & DEBUG_L1OIP_SOCKET)
-		printk(KERN_DEBUG "%s: socket thread terminating\n",
-		       __func__);
+	/* receive by hook */
+	memset(&tunnel_cfg, 0, sizeof(tunnel_cfg));
+	tunnel_cfg.sk_user_data = ls;
+	tunnel_cfg.encap_type = 1;
+	tunnel_cfg.encap_rcv = l1oip_udp_recv;
+	setup_udp_tunnel_sock(&init_net, ls->udp, &tunnel_cfg);
 
-fail:
-	/* free recvbuf */
-	kfree(recvbuf);
+	ls->refcnt = 1;
+	list_add_tail(&ls->list, &l1oip_socks);
 
-	/* close socket */
-	if (socket)
-		sock_release(socket);
+	if (debug & DEBUG_L1OIP_SOCKET)
+		printk(KERN_DEBUG "%s: socket created on port %d (%s)\n",
+		       __func__, port, ls->family == AF_INET6 ? "IPv6" : "IPv4");
 
-	/* if we got killed, signal completion */
-	complete(&hc->socket_complete);
-	hc->socket_thread = NULL; /* show termination of thread */
+	return ls;
+}
 
-	if (debug & DEBUG_L1OIP_SOCKET)
-		printk(KERN_DEBUG "%s: socket thread terminated\n",
-		       __func__);
-	return ret;
+/* called with l1oip_socks_lock */
+static void
+l1oip_sock_put(struct l1oip_sock *ls)
+{
+	if (--ls->refcnt)
+		return;
+
+	list_del(&ls->list);
+	udp_tunnel_sock_release(ls->udp);
+	/* a running receive hook may still use ls */
+	synchronize_net();
+	kfree(ls);
 }
 
 static void
@@ -778,13 +1219,28 @@ l1oip_socket_close(struct l1oip *hc)
 {
 	struct dchannel *dch = hc->chan[hc->d_idx].dch;
 
-	/* kill thread */
-	if (hc->socket_thread) {
+	/* release socket */
+	if (hc->sock) {
 		if (debug & DEBUG_L1OIP_SOCKET)
-			printk(KERN_DEBUG "%s: socket thread exists, "
-			       "killing...\n", __func__);
-		send_sig(SIGTERM, hc->socket_thread, 0);
-		wait_for_completion(&hc->socket_complete);
+			printk(KERN_DEBUG "%s: socket exists, closing...\n",
+			       __func__);
+		/* if hc->socket is NULL, it is in use until it is given back */
+		spin_lock_bh(&hc->socket_lock);
+		while (!hc->socket) {
+			spin_unlock_bh(&hc->socket_lock);
+			schedule_timeout_uninterruptible(1);
+			spin_lock_bh(&hc->socket_lock);
+		}
+		hc->socket = NULL;
+		spin_unlock_bh(&hc->socket_lock);
+
+		mutex_lock(&l1oip_socks_lock);
+		hash_del_rcu(&hc->peer_node);
+		/* a running receive hook may still use hc */
+		synchronize_net();
+		l1oip_sock_put(hc->sock);
+		mutex_unlock(&l1oip_socks_lock);
+		hc->sock = NULL;
 	}
 
 	/* if active, we send up a PH_DEACTIVATE and deactivate */
@@ -801,58 +1257,87 @@ l1oip_socket_close(struct l1oip *hc)
 static int
 l1oip_socket_open(struct l1oip *hc)
 {
+	struct l1oip_sock *ls;
+	int err = 0;
+
 	/* in case of reopen, we need to close first */
 	l1oip_socket_close(hc);
 
-	init_completion(&hc->socket_complete);
+	mutex_lock(&l1oip_socks_lock);
+	ls = l1oip_sock_get(hc->localport);
+	if (IS_ERR(ls)) {
+		mutex_unlock(&l1oip_socks_lock);
+		return PTR_ERR(ls);
+	}
 
-	/* create receive process */
-	hc->socket_thread = kthread_run(l1oip_socket_thread, hc, "l1oip_%s",
-					hc->name);
-	if (IS_ERR(hc->socket_thread)) {
-		int err = PTR_ERR(hc->socket_thread);
-		printk(KERN_ERR "%s: Failed (%d) to create socket process.\n",
-		       __func__, err);
-		hc->socket_thread = NULL;
-		sock_release(hc->socket);
-		return err;
+	/* the id must be unique on the port */
+	if (l1oip_peer_lookup(ls, hc->id)) {
+		printk(KERN_ERR "%s: ID 0x%x is already used on port %d.\n",
+		       __func__, hc->id, hc->localport);
+		err = -EBUSY;
+		goto fail;
 	}
-	if (debug & DEBUG_L1OIP_SOCKET)
-		printk(KERN_DEBUG "%s: socket thread created\n", __func__);
 
-	return 0;
-}
+	/* set outgoing address */
+	if (!ipv6_addr_any(&hc->remoteip6)) {
+		if (ls->family != AF_INET6) {
+			printk(KERN_ERR "%s: IPv6 is not available for the "
+			       "remote address.\n", __func__);
+			err = -EAFNOSUPPORT;
+			goto fail;
+		}
+		l1oip_addr_set6(&hc->remote, &hc->remoteip6,
+				htons(hc->remoteport));
+	} else
+		l1oip_addr_set4(&hc->remote, ls->family, htonl(hc->remoteip),
+				htons(hc->remoteport));
 
+	/* build send message */
+	hc->sendmsg.msg_name = &hc->remote;
+	hc->sendmsg.msg_namelen = ls->family == AF_INET6 ?
+		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+	hc->sendmsg.msg_control = NULL;
+	hc->sendmsg.msg_controllen = 0;
 
-static void
-l1oip_send_bh(struct work_struct *work)
-{
-	struct l1oip *hc = container_of(work, struct l1oip, workq);
+	/* receive frames of our id */
+	hc->sock = ls;
+	hash_add_rcu(ls->peers, &hc->peer_node, hc->id);
+	mutex_unlock(&l1oip_socks_lock);
 
-	if (debug & (DEBUG_L1OIP_MSG | DEBUG_L1OIP_SOCKET))
-		printk(KERN_DEBUG "%s: keepalive timer expired, sending empty "
-		       "frame on dchannel\n", __func__);
+	/* give away socket */
+	spin_lock_bh(&hc->socket_lock);
+	hc->socket = ls->udp;
+	spin_unlock_bh(&hc->socket_lock);
 
-	/* send an empty l1oip frame at D-channel */
-	l1oip_socket_send(hc, 0, hc->d_idx, 0, 0, NULL, 0);
-}
+	if (debug & DEBUG_L1OIP_SOCKET)
+		printk(KERN_DEBUG "%s: socket open\n", __func__);
 
+	return 0;
+
+fail:
+	l1oip_sock_put(ls);
+	mutex_unlock(&l1oip_socks_lock);
+	return err;
+}
 
 /*
  * timer stuff
  */
 static void
-l1oip_keepalive(void *data)
+l1oip_keepalive(struct l1oip *hc)
 {
-	struct l1oip *hc = (struct l1oip *)data;
+	if (debug & (DEBUG_L1OIP_MSG | DEBUG_L1OIP_SOCKET))
+		printk(KERN_DEBUG "%s: keepalive timer expired, sending empty "
+		       "frame on dchannel\n", __func__);
 
-	schedule_work(&hc->workq);
+	/* send an empty l1oip frame at D-channel */
+	l1oip_socket_send(hc, 0, hc->d_idx, 0, 0, NULL, 0);
 }
 
+/* called with hc->rx_lock */
 static void
-l1oip_timeout(void *data)
+l1oip_timeout(struct l1oip *hc)
 {
-	struct l1oip			*hc = (struct l1oip *)data;
 	struct dchannel		*dch = hc->chan[hc->d_idx].dch;
 
 	if (debug & DEBUG_L1OIP_MSG)
@@ -876,8 +1361,35 @@ l1oip_timeout(void *data)
 		if (debug & DEBUG_L1OIP_MSG)
 			printk(KERN_DEBUG "%s: on demand causes ip address to "
 			       "be removed\n", __func__);
-		hc->sin_remote.sin_addr.s_addr = 0;
+		l1oip_addr_set4(&hc->remote, hc->remote.sa.sa_family, 0, 0);
+	}
+}
+
+/*
+ * check the timers of all cards, the list does not change while this runs,
+ * it is started after all cards are created and stopped before cleanup.
+ */
+static void
+l1oip_sweep(struct work_struct *work)
+{
+	struct l1oip *hc;
+
+	list_for_each_entry(hc, &l1oip_ilist, list) {
+		/* the socket lock is also taken by the senders in softirq */
+		local_bh_disable();
+		if (time_after_eq(jiffies, READ_ONCE(hc->last_tx) +
+				  L1OIP_KEEPALIVE * HZ))
+			l1oip_keepalive(hc);
+
+		spin_lock(&hc->rx_lock);
+		if (hc->timeout_on &&
+		    time_after_eq(jiffies, hc->last_rx + L1OIP_TIMEOUT * HZ))
+			l1oip_timeout(hc);
+		spin_unlock(&hc->rx_lock);
+		local_bh_enable();
 	}
+
+	schedule_delayed_work(&l1oip_sweep_work, L1OIP_SWEEP);
 }
 
 
@@ -960,6 +1472,7 @@ channel_dctrl(struct dchannel *dch, struct mISDN_ctrl_req *cq)
 		break;
 	case MISDN_CTRL_SETPEER:
 		hc->remoteip = (u32)cq->p1;
+		memset(&hc->remoteip6, 0, sizeof(hc->remoteip6));
 		hc->remoteport = cq->p2 & 0xffff;
 		hc->localport = cq->p2 >> 16;
 		if (!hc->remoteport)
@@ -974,6 +1487,7 @@ channel_dctrl(struct dchannel *dch, struct mISDN_ctrl_req *cq)
 			printk(KERN_DEBUG "%s: removing ip address.\n",
 			       __func__);
 		hc->remoteip = 0;
+		memset(&hc->remoteip6, 0, sizeof(hc->remoteip6));
 		l1oip_socket_open(hc);
 		break;
 	case MISDN_CTRL_GETPEER:
@@ -1148,6 +1662,14 @@ handle_bmsg(struct mISDNchannel *ch, struct sk_buff *skb)
 		/* send frame */
 		p = skb->data;
 		l = skb->len;
+		while (l && hc->bundle) {
+			ll = (l < L1OIP_MAX_BLOCK) ? l : L1OIP_MAX_BLOCK;
+			l1oip_bundle_add(hc, bch->slot,
+					 hc->chan[bch->slot].tx_counter, p, ll);
+			hc->chan[bch->slot].tx_counter += ll;
+			p += ll;
+			l -= ll;
+		}
 		while (l) {
 			ll = (l < L1OIP_MAX_PERFRAME) ? l : L1OIP_MAX_PERFRAME;
 			l1oip_socket_send(hc, hc->codec, bch->slot, 0,
@@ -1164,6 +1686,11 @@ handle_bmsg(struct mISDNchannel *ch, struct sk_buff *skb)
 			printk(KERN_DEBUG "%s: PH_ACTIVATE channel %d (1..%d)\n"
 			       , __func__, bch->slot, hc->b_num + 1);
 		hc->chan[bch->slot].codecstate = 0;
+		if (hc->chan[bch->slot].jb) {
+			spin_lock_bh(&hc->rx_lock);
+			l1oip_jb_reset(hc->chan[bch->slot].jb);
+			spin_unlock_bh(&hc->rx_lock);
+		}
 		test_and_set_bit(FLG_ACTIVE, &bch->Flags);
 		skb_trim(skb, 0);
 		queue_ch_frame(ch, PH_ACTIVATE_IND, hh->id, skb);
@@ -1186,6 +1713,8 @@ handle_bmsg(struct mISDNchannel *ch, struct sk_buff *skb)
 static int
 channel_bctrl(struct bchannel *bch, struct mISDN_ctrl_req *cq)
 {
+	struct l1oip		*hc = bch->hw;
+	struct l1oip_jb		*jb = hc->chan[bch->slot].jb;
 	int			ret = 0;
 	struct dsp_features	*features =
 		(struct dsp_features *)(*((u_long *)&cq->p1));
@@ -1193,6 +1722,15 @@ channel_bctrl(struct bchannel *bch, struct mISDN_ctrl_req *cq)
 	switch (cq->op) {
 	case MISDN_CTRL_GETOP:
 		cq->op = MISDN_CTRL_HW_FEATURES_OP;
+		if (jb)
+			cq->op |= MISDN_CTRL_JB_STATS;
+		break;
+	case MISDN_CTRL_JB_STATS:
+		if (!jb || cq->p1 < 0 || cq->p1 >= L1OIP_JB_COUNTERS) {
+			ret = -EINVAL;
+			break;
+		}
+		cq->p2 = jb->stats[cq->p1];
 		break;
 	case MISDN_CTRL_HW_FEATURES: /* fill features structure */
 		if (debug & DEBUG_L1OIP_MSG)
@@ -1248,15 +1786,11 @@ release_card(struct l1oip *hc)
 {
 	int	ch;
 
-	if (timer_pending(&hc->keep_tl))
-		del_timer(&hc->keep_tl);
-
-	if (timer_pending(&hc->timeout_tl))
-		del_timer(&hc->timeout_tl);
+	del_timer_sync(&hc->jb_tl);
 
-	cancel_work_sync(&hc->workq);
+	tasklet_kill(&hc->bundle_tasklet);
 
-	if (hc->socket_thread)
+	if (hc->sock)
 		l1oip_socket_close(hc);
 
 	if (hc->registered && hc->chan[hc->d_idx].dch)
@@ -1269,6 +1803,7 @@ release_card(struct l1oip *hc)
 		if (hc->chan[ch].bch) {
 			mISDN_freebchannel(hc->chan[ch].bch);
 			kfree(hc->chan[ch].bch);
+			kfree(hc->chan[ch].jb);
 #ifdef REORDER_DEBUG
 			if (hc->chan[ch].disorder_skb)
 				dev_kfree_skb(hc->chan[ch].disorder_skb);
@@ -1288,6 +1823,8 @@ l1oip_cleanup(void)
 {
 	struct l1oip *hc, *next;
 
+	cancel_delayed_work_sync(&l1oip_sweep_work);
+
 	list_for_each_entry_safe(hc, next, &l1oip_ilist, list)
 		release_card(hc);
 
@@ -1307,6 +1844,11 @@ init_card(struct l1oip *hc, int pri, int bundle)
 	int		i, ch;
 
 	spin_lock_init(&hc->socket_lock);
+	spin_lock_init(&hc->rx_lock);
+	setup_timer(&hc->jb_tl, (void *)l1oip_jb_tick, (ulong)hc);
+	spin_lock_init(&hc->bundle_lock);
+	tasklet_init(&hc->bundle_tasklet, l1oip_bundle_tasklet,
+		     (unsigned long)hc);
 	hc->idx = l1oip_cnt;
 	hc->pri = pri;
 	hc->d_idx = pri ? 16 : 3;
@@ -1368,6 +1910,15 @@ init_card(struct l1oip *hc, int pri, int bundle)
 		       "supported by application.\n", hc->limit);
 	}
 
+	if (jitter[l1oip_cnt] > 128) {
+		printk(KERN_ERR "Maximum jitter buffer delay is 128 ms.\n");
+		return -EINVAL;
+	}
+	hc->jitter = jitter[l1oip_cnt] * 8;
+	if (debug & DEBUG_L1OIP_INIT)
+		printk(KERN_DEBUG "%s: using jitter buffer delay %d ms\n",
+		       __func__, jitter[l1oip_cnt]);
+
 	hc->remoteip = ip[l1oip_cnt << 2] << 24
 		| ip[(l1oip_cnt << 2) + 1] << 16
 		| ip[(l1oip_cnt << 2) + 2] << 8
@@ -1384,6 +1935,17 @@ init_card(struct l1oip *hc, int pri, int bundle)
 		       (hc->remoteip >> 16) & 0xff,
 		       (hc->remoteip >> 8) & 0xff, hc->remoteip & 0xff,
 		       hc->remoteport, hc->ondemand);
+	if (ip6[l1oip_cnt] && *ip6[l1oip_cnt]) {
+		if (!in6_pton(ip6[l1oip_cnt], -1, hc->remoteip6.s6_addr, -1,
+			      NULL)) {
+			printk(KERN_ERR "%s: invalid IPv6 address '%s'\n",
+			       __func__, ip6[l1oip_cnt]);
+			return -EINVAL;
+		}
+		if (debug & DEBUG_L1OIP_INIT)
+			printk(KERN_DEBUG "%s: using remote ip %pI6c\n",
+			       __func__, &hc->remoteip6);
+	}
 
 	dch = kzalloc(sizeof(struct dchannel), GFP_KERNEL);
 	if (!dch)
@@ -1422,6 +1984,13 @@ init_card(struct l1oip *hc, int pri, int bundle)
 		bch->ch.nr = i + ch;
 		list_add(&bch->ch.list, &dch->dev.bchannels);
 		hc->chan[i + ch].bch = bch;
+		if (hc->jitter) {
+			hc->chan[i + ch].jb = kzalloc(sizeof(struct l1oip_jb),
+						      GFP_KERNEL);
+			if (!hc->chan[i + ch].jb)
+				return -ENOMEM;
+			l1oip_jb_reset(hc->chan[i + ch].jb);
+		}
 		set_channelmap(bch->nr, dch->dev.channelmap);
 	}
 	/* TODO: create a parent device for this driver */
@@ -1437,15 +2006,16 @@ init_card(struct l1oip *hc, int pri, int bundle)
 	if (ret)
 		return ret;
 
-	hc->keep_tl.function = (void *)l1oip_keepalive;
-	hc->keep_tl.data = (ulong)hc;
-	init_timer(&hc->keep_tl);
-	hc->keep_tl.expires = jiffies + 2 * HZ; /* two seconds first time */
-	add_timer(&hc->keep_tl);
-
-	setup_timer(&hc->timeout_tl, (void *)l1oip_timeout, (ulong)hc);
+	/* two seconds first time */
+	hc->last_tx = jiffies - (L1OIP_KEEPALIVE - 2) * HZ;
 	hc->timeout_on = 0; /* state that we have timer off */
 
+	if (hc->jitter) {
+		hc->jb_start = ktime_get();
+		hc->jb_played = 0;
+		mod_timer(&hc->jb_tl, jiffies + L1OIP_JB_TICK);
+	}
+
 	return 0;
 }
 
@@ -1503,8 +2073,6 @@ l1oip_init(void)
 			l1oip_cleanup();
 			return -ENOMEM;
 		}
-		INIT_WORK(&hc->workq, (void *)l1oip_send_bh);
-
 		spin_lock(&l1oip_lock);
 		list_add_tail(&hc->list, &l1oip_ilist);
 		spin_unlock(&l1oip_lock);
@@ -1517,6 +2085,8 @@ l1oip_init(void)
 
 		l1oip_cnt++;
 	}
+	schedule_delayed_work(&l1oip_sweep_work, L1OIP_SWEEP);
+
 	printk(KERN_INFO "%d virtual devices registered\n", l1oip_cnt);
 	return 0;
 }
@@ -16,6 +16,7 @@
  */
 
 #include <linux/mISDNif.h>
+#include <linux/module.h>
 #include <linux/slab.h>
 #include "core.h"
 #include "fsm.h"
@@ -23,6 +24,30 @@
 
 static u_int *debug;
 
+static u_int x75_window = MAX_WINDOW;
+module_param(x75_window, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(x75_window, "window size k of new X.75 links");
+static bool x75_mod128;
+module_param(x75_mod128, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(x75_mod128, "use modulo 128 (SABME) on new X.75 links");
+static bool x75_srej;
+module_param(x75_srej, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(x75_srej, "selective reject on new X.75 links, "
+		 "the peer must support it too");
+static bool t200_adapt;
+module_param(t200_adapt, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(t200_adapt, "T200 of new links from the I frame round trip");
+static u_int t200_min = 200;
+module_param(t200_min, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(t200_min, "lowest adaptive T200 in ms");
+static u_int t200_max = 10000;
+module_param(t200_max, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(t200_max, "highest adaptive T200 in ms");
+static u_int ack_delay;
+module_param(ack_delay, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(ack_delay, "delay the RR for I frames on new links up to "
+		 "this ms or half the window, 0 acknowledges each frame");
+
 static
 struct Fsm l2fsm = {NULL, 0, 0, NULL, NULL};
 
@@ -60,6 +85,8 @@ enum {
 	EV_L2_T203,
 	EV_L2_T200I,
 	EV_L2_T203I,
+	EV_L2_TACK,
+	EV_L2_TACKI,
 	EV_L2_SET_OWN_BUSY,
 	EV_L2_CLEAR_OWN_BUSY,
 	EV_L2_FRAME_ERROR,
@@ -90,6 +117,8 @@ static char *strL2Event[] =
 	"EV_L2_T203",
 	"EV_L2_T200I",
 	"EV_L2_T203I",
+	"EV_L2_TACK",
+	"EV_L2_TACKI",
 	"EV_L2_SET_OWN_BUSY",
 	"EV_L2_CLEAR_OWN_BUSY",
 	"EV_L2_FRAME_ERROR",
@@ -289,21 +318,33 @@ l2_timeout(struct FsmInst *fi, int event, void *arg)
 	struct layer2 *l2 = fi->userdata;
 	struct sk_buff *skb;
 	struct mISDNhead *hh;
+	char *name;
 
+	if (event == EV_L2_T200)
+		name = "T200";
+	else if (event == EV_L2_T203)
+		name = "T203";
+	else
+		name = "Tack";
 	skb = mI_alloc_skb(0, GFP_ATOMIC);
 	if (!skb) {
 		printk(KERN_WARNING "%s: L2(%d,%d) nr:%x timer %s no skb\n",
 		       mISDNDevName4ch(&l2->ch), l2->sapi, l2->tei,
-		       l2->ch.nr, event == EV_L2_T200 ? "T200" : "T203");
+		       l2->ch.nr, name);
 		return;
 	}
 	hh = mISDN_HEAD_P(skb);
-	hh->prim = event == EV_L2_T200 ? DL_TIMER200_IND : DL_TIMER203_IND;
+	if (event == EV_L2_T200)
+		hh->prim = DL_TIMER200_IND;
+	else if (event == EV_L2_T203)
+		hh->prim = DL_TIMER203_IND;
+	else
+		hh->prim = DL_TIMERACK_IND;
 	hh->id = l2->ch.nr;
 	if (*debug & DEBUG_TIMER)
 		printk(KERN_DEBUG "%s: L2(%d,%d) nr:%x timer %s expired\n",
 		       mISDNDevName4ch(&l2->ch), l2->sapi, l2->tei,
-		       l2->ch.nr, event == EV_L2_T200 ? "T200" : "T203");
+		       l2->ch.nr, name);
 	if (l2->ch.st)
 		l2->ch.st->own.recv(&l2->ch.st->own, skb);
 }
@@ -346,7 +387,7 @@ InitWin(struct layer2 *l2)
 {
 	int i;
 
-	for (i = 0; i < MAX_WINDOW; i++)
+	for (i = 0; i < l2->window; i++)
 		l2->windowar[i] = NULL;
 }
 
@@ -355,7 +396,7 @@ freewin(struct layer2 *l2)
 {
 	int i, cnt = 0;
 
-	for (i = 0; i < MAX_WINDOW; i++) {
+	for (i = 0; i < l2->window; i++) {
 		if (l2->windowar[i]) {
 			cnt++;
 			dev_kfree_skb(l2->windowar[i]);
@@ -387,13 +428,24 @@ cansend(struct layer2 *l2)
 	return (p1 < l2->window) && !test_bit(FLG_PEER_BUSY, &l2->flag);
 }
 
+/* the delayed RR is not needed anymore, N(R) was sent or the link is down */
+inline void
+stop_ack_delay(struct layer2 *l2, int i)
+{
+	if (test_and_clear_bit(FLG_ACK_DELAY, &l2->flag))
+		mISDN_FsmDelTimer(&l2->tack, i);
+}
+
 inline void
 clear_exception(struct layer2 *l2)
 {
 	test_and_clear_bit(FLG_ACK_PEND, &l2->flag);
 	test_and_clear_bit(FLG_REJEXC, &l2->flag);
+	test_and_clear_bit(FLG_SREJEXC, &l2->flag);
 	test_and_clear_bit(FLG_OWN_BUSY, &l2->flag);
+	stop_ack_delay(l2, 30);
 	clear_peer_busy(l2);
+	skb_queue_purge(&l2->srej_queue);
 }
 
 static int
@@ -475,7 +527,8 @@ IsSFrame(u_char *data, struct layer2 *l2)
 
 	if (!test_bit(FLG_MOD128, &l2->flag))
 		d &= 0xf;
-	return ((d & 0xf3) == 1) && ((d & 0x0c) != 0x0c);
+	return ((d & 0xf3) == 1) && (((d & 0x0c) != 0x0c) ||
+				     test_bit(FLG_SREJ, &l2->flag));
 }
 
 inline int
@@ -493,6 +546,13 @@ IsREJ(u_char *data, struct layer2 *l2)
 		data[0] == REJ : (data[0] & 0xf) == REJ;
 }
 
+inline int
+IsSREJ(u_char *data, struct layer2 *l2)
+{
+	return test_bit(FLG_MOD128, &l2->flag) ?
+		data[0] == SREJ : (data[0] & 0xf) == SREJ;
+}
+
 inline int
 IsFRMR(u_char *data)
 {
@@ -597,12 +657,59 @@ legalnr(struct layer2 *l2, unsigned int nr)
 		return ((nr - l2->va) % 8) <= ((l2->vs - l2->va) % 8);
 }
 
+/*
+ * adaptive T200, like the TCP retransmission timer (RFC 6298):
+ * T200 = SRTT + 4 * RTTVAR of the I frame acknowledgements.
+ */
+static void
+rtt_sample(struct layer2 *l2, int ms)
+{
+	if (!l2->srtt) {
+		l2->srtt = ms << 3;
+		l2->rttvar = ms << 1;
+	} else {
+		ms -= l2->srtt >> 3;
+		l2->srtt += ms;
+		if (ms < 0)
+			ms = -ms;
+		ms -= l2->rttvar >> 2;
+		l2->rttvar += ms;
+	}
+	l2->T200 = clamp_t(u_int, (l2->srtt >> 3) + l2->rttvar,
+			   t200_min, t200_max);
+}
+
+/* retransmitted frames give no samples (Karn), until V(A) passed them */
+static inline void
+rtt_hold(struct layer2 *l2)
+{
+	if (test_bit(FLG_T200_ADAPT, &l2->flag)) {
+		l2->rtt_hold = l2->vs;
+		test_and_set_bit(FLG_RTT_HOLD, &l2->flag);
+	}
+}
+
+static inline void
+t200_backoff(struct layer2 *l2)
+{
+	if (test_bit(FLG_T200_ADAPT, &l2->flag)) {
+		l2->T200 = min(l2->T200 << 1, t200_max);
+		rtt_hold(l2);
+	}
+}
+
 static void
 setva(struct layer2 *l2, unsigned int nr)
 {
 	struct sk_buff	*skb;
+	u_long		sent = 0;
 
 	while (l2->va != nr) {
+		if (l2->va == l2->rtt_hold)
+			test_and_clear_bit(FLG_RTT_HOLD, &l2->flag);
+		if (l2->windowar[l2->sow] &&
+		    !test_bit(FLG_RTT_HOLD, &l2->flag))
+			sent = l2->sent[l2->sow];
 		l2->va++;
 		if (test_bit(FLG_MOD128, &l2->flag))
 			l2->va %= 128;
@@ -615,6 +722,9 @@ setva(struct layer2 *l2, unsigned int nr)
 		}
 		l2->sow = (l2->sow + 1) % l2->window;
 	}
+	/* the newest frame, older ones may wait for a delayed ack */
+	if (sent && test_bit(FLG_T200_ADAPT, &l2->flag))
+		rtt_sample(l2, jiffies_to_msecs(jiffies - sent));
 	skb = skb_dequeue(&l2->tmp_queue);
 	while (skb) {
 		dev_kfree_skb(skb);
@@ -630,6 +740,11 @@ send_uframe(struct layer2 *l2, struct sk_buff *skb, u_char cmd, u_char cr)
 
 	i = sethdraddr(l2, tmp, cr);
 	tmp[i++] = cmd;
+	/* a monitor socket may still read the data of the received frame */
+	if (skb && skb_cloned(skb)) {
+		dev_kfree_skb(skb);
+		skb = NULL;
+	}
 	if (skb)
 		skb_trim(skb, 0);
 	else {
@@ -904,6 +1019,7 @@ l2_disconnect(struct FsmInst *fi, int event, void *arg)
 
 	skb_queue_purge(&l2->i_queue);
 	freewin(l2);
+	stop_ack_delay(l2, 35);
 	mISDN_FsmChangeState(fi, ST_L2_6);
 	l2->rc = 0;
 	send_uframe(l2, NULL, DISC | 0x10, CMD);
@@ -995,6 +1111,7 @@ l2_stop_multi(struct FsmInst *fi, int event, void *arg)
 	mISDN_FsmChangeState(fi, ST_L2_4);
 	mISDN_FsmDelTimer(&l2->t203, 3);
 	stop_t200(l2, 4);
+	stop_ack_delay(l2, 36);
 
 	send_uframe(l2, skb, UA | get_PollFlag(l2, skb), RSP);
 	skb_queue_purge(&l2->i_queue);
@@ -1147,6 +1264,7 @@ transmit_enquiry(struct layer2 *l2)
 	else
 		enquiry_cr(l2, RR, CMD, 1);
 	test_and_clear_bit(FLG_ACK_PEND, &l2->flag);
+	stop_ack_delay(l2, 34);
 	start_t200(l2, 9);
 }
 
@@ -1167,6 +1285,7 @@ invoke_retransmission(struct layer2 *l2, unsigned int nr)
 	u_int	p1;
 
 	if (l2->vs != nr) {
+		rtt_hold(l2);
 		while (l2->vs != nr) {
 			(l2->vs)--;
 			if (test_bit(FLG_MOD128, &l2->flag)) {
@@ -1189,6 +1308,92 @@ invoke_retransmission(struct layer2 *l2, unsigned int nr)
 	}
 }
 
+/* SREJ: send the frame at V(A) again, the later ones arrived */
+static void
+selective_retransmission(struct layer2 *l2)
+{
+	struct sk_buff	*skb = l2->windowar[l2->sow], *nskb;
+	u_char		header[MAX_L2HEADER_LEN];
+	int		i;
+
+	if (!skb) {
+		printk(KERN_WARNING "%s: windowar[%d] is NULL\n",
+		       mISDNDevName4ch(&l2->ch), l2->sow);
+		return;
+	}
+	i = sethdraddr(l2, header, CMD);
+	if (test_bit(FLG_MOD128, &l2->flag)) {
+		header[i++] = l2->va << 1;
+		header[i++] = l2->vr << 1;
+	} else
+		header[i++] = (l2->vr << 5) | (l2->va << 1);
+	/* without memory T200 recovers */
+	nskb = skb_realloc_headroom(skb, i);
+	if (!nskb)
+		return;
+	rtt_hold(l2);
+	memcpy(skb_push(nskb, i), header, i);
+	l2down(l2, PH_DATA_REQ, l2_newid(l2), nskb);
+	test_and_clear_bit(FLG_ACK_PEND, &l2->flag);
+	restart_t200(l2, 17);
+}
+
+/* keep an I frame following a lost one, if it is in the window */
+static int
+srej_store(struct layer2 *l2, struct sk_buff *skb, u_int ns)
+{
+	struct sk_buff	*s;
+	u_int		mod = test_bit(FLG_MOD128, &l2->flag) ? 128 : 8;
+
+	if (((ns - l2->vr) % mod) >= l2->window)
+		return 0;
+	skb_queue_walk(&l2->srej_queue, s) {
+		if (mISDN_HEAD_ID(s) == ns) {
+			dev_kfree_skb(skb);	/* duplicate */
+			return 1;
+		}
+	}
+	mISDN_HEAD_ID(skb) = ns;
+	skb_queue_tail(&l2->srej_queue, skb);
+	return 1;
+}
+
+/* the gap was filled, give the kept frames up in order */
+static void
+srej_deliver(struct layer2 *l2)
+{
+	struct sk_buff	*skb, *n;
+	u_int		mod = test_bit(FLG_MOD128, &l2->flag) ? 128 : 8;
+	int		found;
+
+	do {
+		found = 0;
+		skb_queue_walk_safe(&l2->srej_queue, skb, n) {
+			if (((mISDN_HEAD_ID(skb) - l2->vr) % mod) >=
+			    l2->window) {
+				/* got it again in sequence */
+				skb_unlink(skb, &l2->srej_queue);
+				dev_kfree_skb(skb);
+			} else if (mISDN_HEAD_ID(skb) == l2->vr) {
+				skb_unlink(skb, &l2->srej_queue);
+				l2->vr = (l2->vr + 1) % mod;
+				skb_pull(skb, l2headersize(l2, 0));
+				l2up(l2, DL_DATA_IND, skb);
+				found = 1;
+			}
+		}
+	} while (found);
+	if (!test_bit(FLG_SREJEXC, &l2->flag))
+		return;
+	if (skb_queue_empty(&l2->srej_queue)) {
+		test_and_clear_bit(FLG_SREJEXC, &l2->flag);
+	} else {
+		/* the next gap */
+		enquiry_cr(l2, SREJ, RSP, 0);
+		test_and_clear_bit(FLG_ACK_PEND, &l2->flag);
+	}
+}
+
 static void
 l2_st7_got_super(struct FsmInst *fi, int event, void *arg)
 {
@@ -1209,6 +1414,8 @@ l2_st7_got_super(struct FsmInst *fi, int event, void *arg)
 		clear_peer_busy(l2);
 	if (IsREJ(skb->data, l2))
 		typ = REJ;
+	else if (test_bit(FLG_SREJ, &l2->flag) && IsSREJ(skb->data, l2))
+		typ = SREJ;
 
 	if (test_bit(FLG_MOD128, &l2->flag)) {
 		PollFlag = (skb->data[1] & 0x1) == 0x1;
@@ -1226,7 +1433,14 @@ l2_st7_got_super(struct FsmInst *fi, int event, void *arg)
 			enquiry_response(l2);
 	}
 	if (legalnr(l2, nr)) {
-		if (typ == REJ) {
+		if (typ == SREJ) {
+			/* N(R) is the missing frame, all before it arrived */
+			setva(l2, nr);
+			if (nr != l2->vs)
+				selective_retransmission(l2);
+			else
+				stop_t200(l2, 18);
+		} else if (typ == REJ) {
 			setva(l2, nr);
 			invoke_retransmission(l2, nr);
 			stop_t200(l2, 10);
@@ -1281,6 +1495,25 @@ l2_feed_iqueue(struct FsmInst *fi, int event, void *arg)
 	skb_queue_tail(&l2->i_queue, skb);
 }
 
+/*
+ * acknowledge received I frames with RR. with a delay the RR waits for
+ * Tack or half the window, an I frame sent meanwhile carries N(R) and
+ * clears FLG_ACK_PEND, so no RR is needed at all.
+ */
+static void
+l2_ack(struct layer2 *l2)
+{
+	if (l2->Tack && l2->ack_cnt < (l2->window + 1) / 2) {
+		if (!test_and_set_bit(FLG_ACK_DELAY, &l2->flag))
+			mISDN_FsmAddTimer(&l2->tack, l2->Tack, EV_L2_TACK,
+					  NULL, 31);
+		return;
+	}
+	stop_ack_delay(l2, 32);
+	test_and_clear_bit(FLG_ACK_PEND, &l2->flag);
+	enquiry_cr(l2, RR, RSP, 0);
+}
+
 static void
 l2_got_iframe(struct FsmInst *fi, int event, void *arg)
 {
@@ -1313,10 +1546,22 @@ l2_got_iframe(struct FsmInst *fi, int event, void *arg)
 			test_and_clear_bit(FLG_REJEXC, &l2->flag);
 			if (PollFlag)
 				enquiry_response(l2);
+			else if (!test_and_set_bit(FLG_ACK_PEND, &l2->flag))
+				l2->ack_cnt = 1;
 			else
-				test_and_set_bit(FLG_ACK_PEND, &l2->flag);
+				l2->ack_cnt++;
 			skb_pull(skb, l2headersize(l2, 0));
 			l2up(l2, DL_DATA_IND, skb);
+			if (test_bit(FLG_SREJ, &l2->flag))
+				srej_deliver(l2);
+		} else if (test_bit(FLG_SREJ, &l2->flag) &&
+			   srej_store(l2, skb, ns)) {
+			/* only ask for the missing frame */
+			if (!test_and_set_bit(FLG_SREJEXC, &l2->flag)) {
+				enquiry_cr(l2, SREJ, RSP, PollFlag);
+				test_and_clear_bit(FLG_ACK_PEND, &l2->flag);
+			} else if (PollFlag)
+				enquiry_response(l2);
 		} else {
 			/* n(s)!=v(r) */
 			dev_kfree_skb(skb);
@@ -1346,6 +1591,16 @@ l2_got_iframe(struct FsmInst *fi, int event, void *arg)
 	}
 	if (skb_queue_len(&l2->i_queue) && (fi->state == ST_L2_7))
 		mISDN_FsmEvent(fi, EV_L2_ACK_PULL, NULL);
+	if (test_bit(FLG_ACK_PEND, &l2->flag))
+		l2_ack(l2);
+}
+
+static void
+l2_tout_ack(struct FsmInst *fi, int event, void *arg)
+{
+	struct layer2	*l2 = fi->userdata;
+
+	test_and_clear_bit(FLG_ACK_DELAY, &l2->flag);
 	if (test_and_clear_bit(FLG_ACK_PEND, &l2->flag))
 		enquiry_cr(l2, RR, RSP, 0);
 }
@@ -1430,6 +1685,7 @@ l2_st7_tout_200(struct FsmInst *fi, int event, void *arg)
 		return;
 	}
 	test_and_clear_bit(FLG_T200_RUN, &l2->flag);
+	t200_backoff(l2);
 	l2->rc = 0;
 	mISDN_FsmChangeState(fi, ST_L2_8);
 	transmit_enquiry(l2);
@@ -1447,6 +1703,7 @@ l2_st8_tout_200(struct FsmInst *fi, int event, void *arg)
 		return;
 	}
 	test_and_clear_bit(FLG_T200_RUN, &l2->flag);
+	t200_backoff(l2);
 	if (l2->rc == l2->N200) {
 		l2mgr(l2, MDL_ERROR_IND, (void *) 'I');
 		establishlink(fi);
@@ -1513,6 +1770,7 @@ l2_pull_iqueue(struct FsmInst *fi, int event, void *arg)
 		dev_kfree_skb(l2->windowar[p1]);
 	}
 	l2->windowar[p1] = skb;
+	l2->sent[p1] = jiffies;
 	memcpy(skb_push(nskb, i), header, i);
 	l2down(l2, PH_DATA_REQ, l2_newid(l2), nskb);
 	test_and_clear_bit(FLG_ACK_PEND, &l2->flag);
@@ -1651,6 +1909,7 @@ l2_tei_remove(struct FsmInst *fi, int event, void *arg)
 	l2->tei = GROUP_TEI;
 	stop_t200(l2, 17);
 	mISDN_FsmDelTimer(&l2->t203, 19);
+	stop_ack_delay(l2, 37);
 	l2up_create(l2, DL_RELEASE_IND, 0, NULL);
 /*	mISDN_queue_data(&l2->inst, l2->inst.id | MSG_BROADCAST,
  *		MGR_SHORTSTATUS_IND, SSTATUS_L2_RELEASED,
@@ -1715,6 +1974,7 @@ l2_persistent_da(struct FsmInst *fi, int event, void *arg)
 	freewin(l2);
 	stop_t200(l2, 19);
 	mISDN_FsmDelTimer(&l2->t203, 19);
+	stop_ack_delay(l2, 38);
 	l2up(l2, DL_RELEASE_IND, skb);
 	mISDN_FsmChangeState(fi, ST_L2_4);
 	if (l2->tm)
@@ -1839,11 +2099,15 @@ static struct FsmNode L2FnList[] =
 	{ST_L2_7, EV_L2_T200, l2_timeout},
 	{ST_L2_8, EV_L2_T200, l2_timeout},
 	{ST_L2_7, EV_L2_T203, l2_timeout},
+	{ST_L2_7, EV_L2_TACK, l2_timeout},
+	{ST_L2_8, EV_L2_TACK, l2_timeout},
 	{ST_L2_5, EV_L2_T200I, l2_st5_tout_200},
 	{ST_L2_6, EV_L2_T200I, l2_st6_tout_200},
 	{ST_L2_7, EV_L2_T200I, l2_st7_tout_200},
 	{ST_L2_8, EV_L2_T200I, l2_st8_tout_200},
 	{ST_L2_7, EV_L2_T203I, l2_st7_tout_203},
+	{ST_L2_7, EV_L2_TACKI, l2_tout_ack},
+	{ST_L2_8, EV_L2_TACKI, l2_tout_ack},
 	{ST_L2_7, EV_L2_ACK_PULL, l2_pull_iqueue},
 	{ST_L2_7, EV_L2_SET_OWN_BUSY, l2_set_own_busy},
 	{ST_L2_8, EV_L2_SET_OWN_BUSY, l2_set_own_busy},
@@ -2030,6 +2294,9 @@ l2_send(struct mISDNchannel *ch, struct sk_buff *skb)
 	case DL_TIMER203_IND:
 		mISDN_FsmEvent(&l2->l2m, EV_L2_T203I, NULL);
 		break;
+	case DL_TIMERACK_IND:
+		mISDN_FsmEvent(&l2->l2m, EV_L2_TACKI, NULL);
+		break;
 	default:
 		if (*debug & DEBUG_L2)
 			l2m_debug(&l2->l2m, "l2 unknown pr %04x",
@@ -2070,14 +2337,26 @@ tei_l2(struct layer2 *l2, u_int cmd, u_long arg)
 	return ret;
 }
 
+/* the stack may still send to a layer2, which was removed without waiting */
+static void
+free_l2(struct rcu_head *head)
+{
+	struct layer2	*l2 = container_of(head, struct layer2, rcu);
+
+	kfree(l2->windowar);
+	kfree(l2);
+}
+
 static void
 release_l2(struct layer2 *l2)
 {
 	mISDN_FsmDelTimer(&l2->t200, 21);
 	mISDN_FsmDelTimer(&l2->t203, 16);
+	mISDN_FsmDelTimer(&l2->tack, 33);
 	skb_queue_purge(&l2->i_queue);
 	skb_queue_purge(&l2->ui_queue);
 	skb_queue_purge(&l2->down_queue);
+	skb_queue_purge(&l2->srej_queue);
 	ReleaseWin(l2);
 	if (test_bit(FLG_LAPD, &l2->flag)) {
 		TEIrelease(l2);
@@ -2085,7 +2364,7 @@ release_l2(struct layer2 *l2)
 			l2->ch.st->dev->D.ctrl(&l2->ch.st->dev->D,
 					       CLOSE_CHANNEL, NULL);
 	}
-	kfree(l2);
+	free_layer2_rcu(&l2->rcu, free_l2);
 }
 
 static int
@@ -2122,6 +2401,7 @@ create_l2(struct mISDNchannel *ch, u_int protocol, u_long options, int tei,
 {
 	struct layer2		*l2;
 	struct channel_req	rq;
+	u_int			k, maxk;
 
 	l2 = kzalloc(sizeof(struct layer2), GFP_KERNEL);
 	if (!l2) {
@@ -2187,6 +2467,10 @@ create_l2(struct mISDNchannel *ch, u_int protocol, u_long options, int tei,
 		break;
 	case ISDN_P_B_X75SLP:
 		test_and_set_bit(FLG_LAPB, &l2->flag);
+		if (test_bit(OPTION_L2_MOD128, &options))
+			test_and_set_bit(FLG_MOD128, &l2->flag);
+		if (test_bit(OPTION_L2_SREJ, &options))
+			test_and_set_bit(FLG_SREJ, &l2->flag);
 		l2->window = 7;
 		l2->maxlen = MAX_DATA_SIZE;
 		l2->T200 = 1000;
@@ -2201,10 +2485,37 @@ create_l2(struct mISDNchannel *ch, u_int protocol, u_long options, int tei,
 		kfree(l2);
 		return NULL;
 	}
+	/* a bigger window keeps high delay links busy */
+	k = (options >> OPTION_L2_WINDOW_SHIFT) & OPTION_L2_WINDOW_MASK;
+	maxk = test_bit(FLG_MOD128, &l2->flag) ? MAX_WINDOW_EXT : MAX_WINDOW;
+	if (k > maxk) {
+		printk(KERN_WARNING "layer2 window %d too big, using %d\n",
+		       k, maxk);
+		k = maxk;
+	}
+	if (k)
+		l2->window = k;
+	/* the send times of the entries are behind the entries */
+	l2->windowar = kcalloc(l2->window, sizeof(struct sk_buff *) +
+			       sizeof(u_long), GFP_KERNEL);
+	if (!l2->windowar) {
+		printk(KERN_ERR "kcalloc layer2 window failed\n");
+		if (test_bit(FLG_LAPD, &l2->flag))
+			l2->ch.st->dev->D.ctrl(&l2->ch.st->dev->D,
+					       CLOSE_CHANNEL, NULL);
+		kfree(l2);
+		return NULL;
+	}
 	skb_queue_head_init(&l2->i_queue);
 	skb_queue_head_init(&l2->ui_queue);
 	skb_queue_head_init(&l2->down_queue);
 	skb_queue_head_init(&l2->tmp_queue);
+	skb_queue_head_init(&l2->srej_queue);
+	l2->sent = (u_long *)(l2->windowar + l2->window);
+	if (t200_adapt)
+		test_and_set_bit(FLG_T200_ADAPT, &l2->flag);
+	/* the peer must get the RR well before its T200 */
+	l2->Tack = min_t(u_int, ack_delay, l2->T200 / 2);
 	InitWin(l2);
 	l2->l2m.fsm = &l2fsm;
 	if (test_bit(FLG_LAPB, &l2->flag) ||
@@ -2217,9 +2528,12 @@ create_l2(struct mISDNchannel *ch, u_int protocol, u_long options, int tei,
 	l2->l2m.userdata = l2;
 	l2->l2m.userint = 0;
 	l2->l2m.printdebug = l2m_debug;
+	if (l2->ch.st)
+		l2->l2m.timers = l2->ch.st->timers;
 
 	mISDN_FsmInitTimer(&l2->l2m, &l2->t200);
 	mISDN_FsmInitTimer(&l2->l2m, &l2->t203);
+	mISDN_FsmInitTimer(&l2->l2m, &l2->tack);
 	return l2;
 }
 
@@ -2227,10 +2541,17 @@ static int
 x75create(struct channel_req *crq)
 {
 	struct layer2	*l2;
+	u_long		opt;
 
 	if (crq->protocol != ISDN_P_B_X75SLP)
 		return -EPROTONOSUPPORT;
-	l2 = create_l2(crq->ch, crq->protocol, 0, 0, 0);
+	opt = (u_long)(x75_window & OPTION_L2_WINDOW_MASK) <<
+		OPTION_L2_WINDOW_SHIFT;
+	if (x75_mod128)
+		test_and_set_bit(OPTION_L2_MOD128, &opt);
+	if (x75_srej)
+		test_and_set_bit(OPTION_L2_SREJ, &opt);
+	l2 = create_l2(crq->ch, crq->protocol, opt, 0, 0);
 	if (!l2)
 		return -ENOMEM;
 	crq->ch = &l2->ch;
@@ -2241,7 +2562,8 @@ x75create(struct channel_req *crq)
 static struct Bprotocol X75SLP = {
 	.Bprotocols = (1 << (ISDN_P_B_X75SLP & ISDN_P_B_MASK)),
 	.name = "X75SLP",
-	.create = x75create
+	.create = x75create,
+	.owner = THIS_MODULE
 };
 
 int
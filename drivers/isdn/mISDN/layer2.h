@@ -18,7 +18,9 @@
 #include <linux/skbuff.h>
 #include "fsm.h"
 
-#define MAX_WINDOW	8
+#define MAX_WINDOW	7	/* k modulo 8 */
+#define MAX_DYN_TEI	63	/* 64 - 126 */
+#define MAX_WINDOW_EXT	127	/* k modulo 128 */
 
 struct manager {
 	struct mISDNchannel	ch;
@@ -32,6 +34,9 @@ struct manager {
 	struct mISDNchannel	*up;
 	u_int			nextid;
 	u_int			lastid;
+	u_int			window;	/* k of new links, 0 default */
+	DECLARE_BITMAP(teimap, MAX_DYN_TEI);	/* dynamic TEIs in use */
+	struct layer2		*teicache[GROUP_TEI];	/* hint for findtei */
 };
 
 struct teimgr {
@@ -42,6 +47,7 @@ struct teimgr {
 	int			tval, nval;
 	struct layer2		*l2;
 	struct manager		*mgr;
+	int			dyn_tei;	/* from mgr->teimap, or 0 */
 };
 
 struct laddr {
@@ -65,15 +71,22 @@ struct layer2 {
 	u_int			window;
 	u_int			sow;
 	struct FsmInst		l2m;
-	struct FsmTimer		t200, t203;
+	struct FsmTimer		t200, t203, tack;
 	int			T200, N200, T203;
+	int			Tack;	/* delay of RR in ms, 0 none */
+	u_int			ack_cnt;	/* I frames to acknowledge */
 	u_int			next_id;
 	u_int			down_id;
-	struct sk_buff		*windowar[MAX_WINDOW];
+	struct sk_buff		**windowar;	/* window entries */
+	u_long			*sent;		/* jiffies of the entries */
+	int			srtt, rttvar;	/* ms << 3, ms << 2 */
+	u_int			rtt_hold;	/* V(A) of the first new frame */
+	struct sk_buff_head	srej_queue;	/* I frames behind a gap */
 	struct sk_buff_head	i_queue;
 	struct sk_buff_head	ui_queue;
 	struct sk_buff_head	down_queue;
 	struct sk_buff_head	tmp_queue;
+	struct rcu_head		rcu;	/* see free_l2 */
 };
 
 enum {
@@ -105,6 +118,7 @@ extern void		TEIFree(void);
 #define RR	0x01
 #define RNR	0x05
 #define REJ	0x09
+#define SREJ	0x0d
 #define SABME	0x6f
 #define SABM	0x2f
 #define DM	0x0f
@@ -138,3 +152,8 @@ extern void		TEIFree(void);
 #define FLG_L2BLOCK	16
 #define FLG_L1_NOTREADY	17
 #define FLG_LAPD_NET	18
+#define FLG_SREJ	19
+#define FLG_SREJEXC	20
+#define FLG_T200_ADAPT	21
+#define FLG_RTT_HOLD	22
+#define FLG_ACK_DELAY	23
@@ -43,4 +43,42 @@ $Octasic_Revision: 4 $
 #define OCTDEV_IOCTL_MAX_TIME_US _IOW(OCTDEV_IOCTL_MAGIC, 10, int)
 #define OCTDEV_IOCTL_MAXNR 10
 
+/*
+ * Shared memory ring, mapped with mmap() at offset 0 of a channel device.
+ *
+ * Once the ring is mapped, samples are exchanged through it instead of
+ * read() and write().  The kernel fills Xin frames (Rin and Sin), the
+ * service returns Sout frames.  The indices are free running counters,
+ * the frame of an index is (index % OCTDEV_RING_FRAMES).  Each side only
+ * writes its own indices:
+ *
+ *  ulXinHead  - kernel, frames filled with Rin/Sin
+ *  ulXinTail  - service, frames consumed
+ *  ulSoutHead - service, frames filled with Sout
+ *  ulSoutTail - kernel, frames consumed
+ *
+ * poll() reports POLLIN when at least ulXinBatch frames (minimum 1) are
+ * pending and POLLOUT when a Sout frame is free.
+ */
+#define OCTDEV_RING_SAMPLES (8 * 20) /* 20 ms. per frame */
+#define OCTDEV_RING_FRAMES 8 /* must be a power of 2 */
+
+typedef struct _OCTDEV_RING_XIN_ {
+	short asRin[OCTDEV_RING_SAMPLES];
+	short asSin[OCTDEV_RING_SAMPLES];
+} tOCTDEV_RING_XIN;
+
+typedef struct _OCTDEV_RING_ {
+	unsigned int ulXinHead;
+	unsigned int ulXinTail;
+	unsigned int ulSoutHead;
+	unsigned int ulSoutTail;
+	unsigned int ulXinBatch; /* written by the service */
+	unsigned int ulXinDropped; /* written by kernel, Xin samples lost */
+	unsigned int ulSoutMissed; /* written by kernel, Sout samples missing */
+	unsigned int ulReserved;
+	tOCTDEV_RING_XIN aXin[OCTDEV_RING_FRAMES];
+	short asSout[OCTDEV_RING_FRAMES][OCTDEV_RING_SAMPLES];
+} tOCTDEV_RING, *tPOCTDEV_RING;
+
 #endif /* __OCTVQE_IOCTL_H__ */
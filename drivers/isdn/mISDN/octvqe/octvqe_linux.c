@@ -46,6 +46,8 @@ $Octasic_Revision: 21 $
 #include <linux/sched/signal.h>
 #include <linux/wait.h>
 #include <linux/mutex.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
 
 /* user<-> kernel space access functions */
 #include <asm/uaccess.h>
@@ -170,6 +172,11 @@ typedef struct _OCTVQE_CHAN_INSTANCE_ {
 
     void                        *pvDefaultEchoCanContext;
 
+	/* Shared memory ring, if mapped by the service. */
+	tPOCTDEV_RING           pRing;
+	unsigned int            ulRingXinHead; /* Kernel copies of the indices */
+	unsigned int            ulRingSoutTail; /* owned by the kernel. */
+
     spinlock_t				Lock;
 
 } tOCTVQE_CHAN_INSTANCE, *tPOCTVQE_CHAN_INSTANCE;
@@ -386,6 +393,72 @@ int ZapOctVqeApiEcChannelTrainTap(void *f_pvEcChan, int f_iPos, short f_sVal)
     return 1;
 }
 
+/*
+ * Exchange one sample with the shared memory ring.  Called with the channel
+ * lock held.  The service's indices are only read, the kernel keeps its own
+ * indices in the channel and publishes them after the frame is complete.
+ */
+static short octdev_ring_process(tPOCTVQE_CHAN_INSTANCE pChan, short f_sRin,
+	short f_sSin, int *f_pfWakeUp)
+{
+	tPOCTDEV_RING pRing = pChan->pRing;
+	tOCTDEV_RING_XIN *pXin;
+	unsigned int ulPending;
+	unsigned int ulBatch;
+	short sSout = 0;
+
+	/* Rin/Sin to the service. */
+	ulPending = pChan->ulRingXinHead - READ_ONCE(pRing->ulXinTail);
+	if (ulPending < OCTDEV_RING_FRAMES) {
+		pXin = &pRing->aXin[pChan->ulRingXinHead & (OCTDEV_RING_FRAMES - 1)];
+		pXin->asRin[pChan->ulXinWritePtr] = f_sRin;
+		pXin->asSin[pChan->ulXinWritePtr] = f_sSin;
+		if (++pChan->ulXinWritePtr == OCTDEV_RING_SAMPLES) {
+			pChan->ulXinWritePtr = 0;
+			pChan->ulRingXinHead++;
+			ulPending++;
+
+			/* The samples must be visible before the index. */
+			smp_wmb();
+			WRITE_ONCE(pRing->ulXinHead, pChan->ulRingXinHead);
+
+			/* Only wake up the service when a batch is ready. */
+			ulBatch = READ_ONCE(pRing->ulXinBatch);
+			if (ulBatch < 1 || ulBatch > OCTDEV_RING_FRAMES)
+				ulBatch = 1;
+			if (ulPending >= ulBatch)
+				*f_pfWakeUp = 1;
+		}
+	} else {
+		/* The service does not keep up, wake it up. */
+		pRing->ulXinDropped++;
+		*f_pfWakeUp = 1;
+	}
+
+	/* Sout from the service. */
+	if (READ_ONCE(pRing->ulSoutHead) != pChan->ulRingSoutTail) {
+		/* Read the index before the samples. */
+		smp_rmb();
+
+		pChan->fChanReady = 1;
+		sSout = pRing->asSout[pChan->ulRingSoutTail & (OCTDEV_RING_FRAMES - 1)][pChan->ulSoutReadPtr];
+		if (++pChan->ulSoutReadPtr == OCTDEV_RING_SAMPLES) {
+			pChan->ulSoutReadPtr = 0;
+			pChan->ulRingSoutTail++;
+			pChan->ulProcessedBuf++;
+
+			/* The frame must be read before it is given back. */
+			smp_mb();
+			WRITE_ONCE(pRing->ulSoutTail, pChan->ulRingSoutTail);
+		}
+	} else if (pChan->fChanReady == 1) {
+		/* Underrun, send silence. */
+		pRing->ulSoutMissed++;
+	}
+
+	return sSout;
+}
+
 short ZapOctVqeApiEcChannelProcess(void *f_pvEcChan, short f_sRin, short f_sSin)
 {
     int                    i;
@@ -438,6 +511,18 @@ short ZapOctVqeApiEcChannelProcess(void *f_pvEcChan, short f_sRin, short f_sSin)
     if (pChan->fChanOk) {
 		spin_lock_irqsave(&pChan->Lock, ulFlags);
 
+		/* Shared memory ring, no copies and no system calls per frame. */
+		if (pChan->pRing != NULL) {
+			sSout = octdev_ring_process(pChan, f_sRin, f_sSin, &fWakeUpReader);
+
+			spin_unlock_irqrestore(&pChan->Lock, ulFlags);
+
+			if (fWakeUpReader == 1)
+				wake_up_interruptible(&pChan->SelectWaitQueue);
+			pChan->ulReceivedSamples++;
+			return sSout;
+		}
+
 		/* If space to receive samples. */
 		if (pChan->iXinWriteBuf > -1) {
 			/* Accumulate samples until enough for processing. */
@@ -625,6 +710,7 @@ static int octdev_release(struct inode *inode, struct file *file)
 {
     unsigned int iMinor;
 	unsigned long ulFlags;
+	tPOCTDEV_RING pRing;
 
 	/* Decrement module usage count. */
 #ifdef LINUX26
@@ -651,8 +737,15 @@ static int octdev_release(struct inode *inode, struct file *file)
     /* Reset read index pointer. */
     g_apEchoChanInst[iMinor]->fOpened = 0;
 
+	/* The ring is not mapped anymore, when the last file reference is gone. */
+	pRing = g_apEchoChanInst[iMinor]->pRing;
+	g_apEchoChanInst[iMinor]->pRing = NULL;
+
 	spin_unlock_irqrestore(&g_apEchoChanInst[iMinor]->Lock, ulFlags);
 
+	if (pRing != NULL)
+		vfree(pRing);
+
     return SUCCESS;
 }
 
@@ -687,6 +780,10 @@ static ssize_t octdev_read(
 	return -EINVAL;
     }
 
+	/* Samples are exchanged through the ring, once it is mapped. */
+	if (pChan->pRing != NULL)
+		return -EBUSY;
+
 	/* Check if we can at least fit buffer sample of both Rin+Sin. */
 	if (f_Length < (2*2*BUFFER_SIZE) /* Rin+Sin */) {
 	printk(KERN_WARNING "%s: Channel #%lu byte space provided less then %d bytes\n", DEV_NAME, pChan->ulChannelIndex+1, 2*2*BUFFER_SIZE);
@@ -812,6 +909,10 @@ static ssize_t octdev_write(
 	return -EINVAL;
     }
 
+	/* Samples are exchanged through the ring, once it is mapped. */
+	if (pChan->pRing != NULL)
+		return -EBUSY;
+
     /* Check passed length. */
     if (f_Length != BUFFER_SIZE * 2) {
 	printk(KERN_WARNING "%s: written data for chan #%lu must be the size of a buffer (%d)\n", DEV_NAME, pChan->ulChannelIndex+1, BUFFER_SIZE);
@@ -929,6 +1030,8 @@ static unsigned int octdev_poll(
 		       struct poll_table_struct *f_pPollStruct)
 {
     tPOCTVQE_CHAN_INSTANCE pChan;
+    tPOCTDEV_RING pRing;
+    unsigned int ulBatch;
     unsigned int iMask = 0;
     unsigned long ulFlags;
 
@@ -943,7 +1046,16 @@ static unsigned int octdev_poll(
 
 	spin_lock_irqsave(&pChan->Lock, ulFlags);
 
-	if (pChan->iXinReadBuf > -1)
+	pRing = pChan->pRing;
+	if (pRing != NULL) {
+		ulBatch = READ_ONCE(pRing->ulXinBatch);
+		if (ulBatch < 1 || ulBatch > OCTDEV_RING_FRAMES)
+			ulBatch = 1;
+		if (pChan->ulRingXinHead - READ_ONCE(pRing->ulXinTail) >= ulBatch)
+			iMask |= POLLIN | POLLRDNORM; /* frames pending */
+		if (READ_ONCE(pRing->ulSoutHead) - pChan->ulRingSoutTail < OCTDEV_RING_FRAMES)
+			iMask |= POLLOUT | POLLWRNORM; /* Sout frame free */
+	} else if (pChan->iXinReadBuf > -1)
 		iMask |= POLLIN | POLLRDNORM; /* readable */
 
 	spin_unlock_irqrestore(&pChan->Lock, ulFlags);
@@ -951,6 +1063,52 @@ static unsigned int octdev_poll(
 	return iMask;
 }
 
+/* Map the shared memory ring of the channel, it is allocated on first use. */
+static int octdev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	tPOCTVQE_CHAN_INSTANCE pChan;
+	tPOCTDEV_RING pRing, pNewRing = NULL;
+	unsigned long ulFlags;
+
+	pChan = (tPOCTVQE_CHAN_INSTANCE)filp->private_data;
+	if (pChan == NULL) {
+		printk(KERN_ERR "%s: Invalid private data channel (NULL)\n", DEV_NAME);
+		return -EINVAL;
+	}
+
+	if (vma->vm_pgoff != 0 ||
+	    vma->vm_end - vma->vm_start > PAGE_ALIGN(sizeof(tOCTDEV_RING)))
+		return -EINVAL;
+
+	if (pChan->pRing == NULL) {
+		pNewRing = vmalloc_user(sizeof(tOCTDEV_RING));
+		if (pNewRing == NULL)
+			return -ENOMEM;
+	}
+
+	spin_lock_irqsave(&pChan->Lock, ulFlags);
+
+	if (pChan->pRing == NULL && pNewRing != NULL) {
+		/* Start the ring with empty frames. */
+		pChan->ulRingXinHead = 0;
+		pChan->ulRingSoutTail = 0;
+		pChan->ulXinWritePtr = 0;
+		pChan->ulSoutReadPtr = 0;
+		pChan->fChanReady = 0;
+		pChan->pRing = pNewRing;
+		pNewRing = NULL;
+	}
+	pRing = pChan->pRing;
+
+	spin_unlock_irqrestore(&pChan->Lock, ulFlags);
+
+	/* Someone else was faster. */
+	if (pNewRing != NULL)
+		vfree(pNewRing);
+
+	return remap_vmalloc_range(vma, pRing, 0);
+}
+
 static long octdev_ioctl(struct file *filp, unsigned int cmd , unsigned long arg)
 {
 	tPOCTVQE_CHAN_INSTANCE pChan;
@@ -1038,6 +1196,9 @@ void octdev_seq_stop(struct seq_file *sfile, void *v)
 int octdev_seq_show(struct seq_file *s, void *v)
 {
     int i = 0;
+    int fRing;
+    unsigned int ulXinDropped = 0, ulSoutMissed = 0;
+    unsigned long ulFlags;
 
     tPOCTVQE_CHAN_INSTANCE pChan = (tPOCTVQE_CHAN_INSTANCE)v;
 
@@ -1078,6 +1239,20 @@ int octdev_seq_show(struct seq_file *s, void *v)
 				(int)(BUFFER_SIZE / 8),
 				pChan->iAverageTimeUs,
 				pChan->iMaxTimeUs);
+
+			spin_lock_irqsave(&pChan->Lock, ulFlags);
+			fRing = (pChan->pRing != NULL);
+			if (fRing) {
+				ulXinDropped = pChan->pRing->ulXinDropped;
+				ulSoutMissed = pChan->pRing->ulSoutMissed;
+			}
+			spin_unlock_irqrestore(&pChan->Lock, ulFlags);
+
+			if (fRing)
+				seq_printf(s, "  Shared Ring (%d frames), Xin Dropped (%u), Sout Missed (%u)\n",
+					OCTDEV_RING_FRAMES,
+					ulXinDropped,
+					ulSoutMissed);
 		}
 	}
 
@@ -1114,6 +1289,7 @@ static const struct file_operations octdev_fops = {
 	.release	= octdev_release,
 	.poll		= octdev_poll,
 	.unlocked_ioctl	= octdev_ioctl,
+	.mmap		= octdev_mmap,
 };
 
 static int octvqe_init(void)
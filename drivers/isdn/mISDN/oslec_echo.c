@@ -122,6 +122,7 @@
 
 #include "oslec_bit_operations.h"
 #include "oslec_echo.h"
+#include "oslec_simd.h"
 
 #if !defined(NULL)
 #define NULL (void *) 0
@@ -149,7 +150,8 @@
 
 #ifdef __BLACKFIN_ASM__
 static inline void
-lms_adapt_bg(struct echo_can_state_s *ec, int clean, int shift)
+lms_adapt_bg(struct echo_can_state_s *ec, int clean, int shift,
+	     const struct oslec_kernels *k)
 {
     int i, j;
     int offset1;
@@ -221,116 +223,94 @@ lms_adapt_bg(struct echo_can_state_s *ec, int clean, int shift)
 
 #else
 static inline void
-lms_adapt_bg(struct echo_can_state_s *ec, int clean, int shift)
+lms_adapt_bg(struct echo_can_state_s *ec, int clean, int shift,
+	     const struct oslec_kernels *k)
 {
-    int i;
-
-    int offset1;
-    int offset2;
     int factor;
-    int exp;
 
     if (shift > 0)
 	factor = clean << shift;
     else
 	factor = clean >> -shift;
 
-    /* Update the FIR taps */
-
-    offset2 = ec->curr_pos;
-    offset1 = ec->taps - offset2;
+    /* Update the FIR taps, the history is linear from curr_pos */
 
-    for (i = ec->taps - 1;  i >= offset1;  i--) {
-       exp = (ec->fir_state_bg.history[i - offset1]*factor);
-       ec->fir_taps16[1][i] += (int16_t) ((exp+(1<<14)) >> 15);
-    }
-    for (  ;  i >= 0;  i--) {
-       exp = (ec->fir_state_bg.history[i + offset2]*factor);
-       ec->fir_taps16[1][i] += (int16_t) ((exp+(1<<14)) >> 15);
-    }
+    k->lms16(ec->fir_taps16[1], &ec->fir_state_bg.history[ec->curr_pos],
+	     factor, ec->taps);
 }
 #endif
 
 /*- End of function --------------------------------------------------------*/
 
-struct echo_can_state_s *echo_can_create(int len, int adaption_mode)
+/*
+   The context, the coefficients of both filters, the histories (stored twice,
+   see fir16_create) and the snapshot are allocated as one block, so a context
+   is a single allocation and can be reset for reuse by echo_can_reset.
+*/
+static inline size_t echo_can_size(int len)
 {
-    struct echo_can_state_s *ec;
-    int i;
-    int j;
+    return sizeof(struct echo_can_state_s) + 7*len*sizeof(int16_t);
+}
+/*- End of function --------------------------------------------------------*/
 
-    ec = (struct echo_can_state_s *) malloc(sizeof(*ec));
-    if (ec == NULL)
-	return  NULL;
-    memset(ec, 0, sizeof(*ec));
+static void echo_can_setup(struct echo_can_state_s *ec, int len,
+			   int adaption_mode)
+{
+    int16_t *p = (int16_t *)(ec + 1);
+
+    memset(ec, 0, echo_can_size(len));
 
     ec->taps = len;
     ec->log2taps = top_bit(len);
     ec->curr_pos = ec->taps - 1;
 
-    for (i = 0;  i < 2;  i++) {
-	ec->fir_taps16[i] = (int16_t *)malloc((ec->taps)*sizeof(int16_t));
-	if (ec->fir_taps16 == NULL) {
-	    for (j = 0;  j < i;  j++)
-		free(ec->fir_taps16[j]);
-	    free(ec);
-	    return  NULL;
-	}
-	memset(ec->fir_taps16[i], 0, (ec->taps)*sizeof(int16_t));
-    }
+    ec->fir_taps16[0] = p;
+    p += len;
+    ec->fir_taps16[1] = p;
+    p += len;
 
-    fir16_create(&ec->fir_state,
-		 ec->fir_taps16[0],
-		 ec->taps);
-    fir16_create(&ec->fir_state_bg,
-		 ec->fir_taps16[1],
-		 ec->taps);
-
-    for (i = 0; i < 5; i++) {
-      ec->xvtx[i] = 0;
-      ec->yvtx[i] = 0;
-      ec->xvrx[i] = 0;
-      ec->yvrx[i] = 0;
-    }
+    ec->fir_state.taps = len;
+    ec->fir_state.curr_pos = len - 1;
+    ec->fir_state.coeffs = ec->fir_taps16[0];
+    ec->fir_state.history = p;
+    p += 2*len;
+    ec->fir_state_bg.taps = len;
+    ec->fir_state_bg.curr_pos = len - 1;
+    ec->fir_state_bg.coeffs = ec->fir_taps16[1];
+    ec->fir_state_bg.history = p;
+    p += 2*len;
+
+    ec->snapshot = p;
 
     ec->cng_level = 1000;
     echo_can_adaption_mode(ec, adaption_mode);
 
-    ec->snapshot = (int16_t *)malloc(ec->taps*sizeof(int16_t));
-    memset(ec->snapshot, 0, sizeof(int16_t)*ec->taps);
-
-    ec->cond_met = 0;
-    ec->Pstates = 0;
-    ec->Ltxacc = 0;
-    ec->Lrxacc = 0;
-    ec->Lcleanacc = 0;
-    ec->Lclean_bgacc = 0;
-    ec->Ltx = 0;
-    ec->Lrx = 0;
-    ec->Lclean = 0;
-    ec->Lclean_bg = 0;
-    ec->tx_1 = 0;
-    ec->tx_2 = 0;
-    ec->rx_1 = 0;
-    ec->rx_2 = 0;
-    ec->Lbgn = 0;
-    ec->Lbgn_acc = 0;
     ec->Lbgn_upper = 200;
     ec->Lbgn_upper_acc = ec->Lbgn_upper << 13;
+}
+/*- End of function --------------------------------------------------------*/
+
+struct echo_can_state_s *echo_can_create(int len, int adaption_mode)
+{
+    struct echo_can_state_s *ec;
+
+    ec = (struct echo_can_state_s *) malloc(echo_can_size(len));
+    if (ec == NULL)
+	return  NULL;
+    echo_can_setup(ec, len, adaption_mode);
 
     return  ec;
 }
 /*- End of function --------------------------------------------------------*/
 
-void echo_can_free(struct echo_can_state_s *ec)
+void echo_can_reset(struct echo_can_state_s *ec)
 {
-    int i;
+    echo_can_setup(ec, ec->taps, ec->adaption_mode);
+}
+/*- End of function --------------------------------------------------------*/
 
-    fir16_free(&ec->fir_state);
-    fir16_free(&ec->fir_state_bg);
-    for (i = 0;  i < 2;  i++)
-	free(ec->fir_taps16[i]);
-    free(ec->snapshot);
+void echo_can_free(struct echo_can_state_s *ec)
+{
     free(ec);
 }
 /*- End of function --------------------------------------------------------*/
@@ -385,7 +365,9 @@ void echo_can_snapshot(struct echo_can_state_s *ec)
 
 /* Dual Path Echo Canceller ------------------------------------------------*/
 
-int16_t echo_can_update(struct echo_can_state_s *ec, int16_t tx, int16_t rx)
+static inline int16_t __echo_can_update(struct echo_can_state_s *ec,
+					int16_t tx, int16_t rx,
+					const struct oslec_kernels *k)
 {
     int32_t echo_value;
     int clean_bg;
@@ -448,14 +430,14 @@ int16_t echo_can_update(struct echo_can_state_s *ec, int16_t tx, int16_t rx)
     /* Foreground filter ---------------------------------------------------*/
 
     ec->fir_state.coeffs = ec->fir_taps16[0];
-    echo_value = fir16(&ec->fir_state, tx);
+    echo_value = fir16_dot(&ec->fir_state, tx, k->dot16);
     ec->clean = rx - echo_value;
     ec->Lcleanacc += abs(ec->clean) - ec->Lclean;
     ec->Lclean = (ec->Lcleanacc + (1<<4)) >> 5;
 
     /* Background filter ---------------------------------------------------*/
 
-    echo_value = fir16(&ec->fir_state_bg, tx);
+    echo_value = fir16_dot(&ec->fir_state_bg, tx, k->dot16);
     clean_bg = rx - echo_value;
     ec->Lclean_bgacc += abs(clean_bg) - ec->Lclean_bg;
     ec->Lclean_bg = (ec->Lclean_bgacc + (1<<4)) >> 5;
@@ -509,7 +491,7 @@ int16_t echo_can_update(struct echo_can_state_s *ec, int16_t tx, int16_t rx)
 	shift = 30 - 2 - logP;
 	ec->shift = shift;
 
-	lms_adapt_bg(ec, clean_bg, shift);
+	lms_adapt_bg(ec, clean_bg, shift, k);
     }
 
     /* very simple DTD to make sure we dont try and adapt with strong
@@ -609,6 +591,24 @@ int16_t echo_can_update(struct echo_can_state_s *ec, int16_t tx, int16_t rx)
     return (int16_t) ec->clean_nlp << 1;
 }
 
+int16_t echo_can_update(struct echo_can_state_s *ec, int16_t tx, int16_t rx)
+{
+    return __echo_can_update(ec, tx, rx, &oslec_kernels_generic);
+}
+
+/* process a whole frame, the kernels are chosen once for all samples */
+void echo_can_update_block(struct echo_can_state_s *ec, const int16_t *tx,
+			   int16_t *rx, int len)
+{
+    const struct oslec_kernels *k;
+    int i;
+
+    k = oslec_simd_begin();
+    for (i = 0;  i < len;  i++)
+	rx[i] = __echo_can_update(ec, tx[i], rx[i], k);
+    oslec_simd_end(k);
+}
+
 /*- End of function --------------------------------------------------------*/
 
 /* This function is seperated from the echo canceller is it is usually called
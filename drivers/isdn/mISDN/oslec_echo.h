@@ -191,6 +191,12 @@ struct echo_can_state_s *echo_can_create(int len, int adaption_mode);
 */
 void echo_can_free(struct echo_can_state_s *ec);
 
+/*! Reset a voice echo canceller context to the state after creation, so it
+    can be used for a new call.
+    \param ec The echo canceller context.
+*/
+void echo_can_reset(struct echo_can_state_s *ec);
+
 /*! Flush (reinitialise) a voice echo canceller context.
     \param ec The echo canceller context.
 */
@@ -212,6 +218,15 @@ void echo_can_snapshot(struct echo_can_state_s *ec);
 */
 int16_t echo_can_update(struct echo_can_state_s *ec, int16_t tx, int16_t rx);
 
+/*! Process a frame of samples through a voice echo canceller.
+    \param ec The echo canceller context.
+    \param tx The transmitted audio samples.
+    \param rx The received audio samples, replaced by the clean samples.
+    \param len The number of samples.
+*/
+void echo_can_update_block(struct echo_can_state_s *ec, const int16_t *tx,
+			   int16_t *rx, int len);
+
 /*! Process to high pass filter the tx signal.
     \param ec The echo canceller context.
     \param tx The transmitted auio sample.
@@ -113,26 +113,17 @@ static inline const int16_t *fir16_create(struct fir16_state *fir,
     fir->taps = taps;
     fir->curr_pos = taps - 1;
     fir->coeffs = coeffs;
-#if defined(USE_MMX)  ||  defined(USE_SSE2) || defined(__BLACKFIN_ASM__)
+    /* the history is stored twice, so it can be read linear from curr_pos */
     fir->history = malloc(2*taps*sizeof(int16_t));
     if (fir->history)
 	memset(fir->history, 0, 2*taps*sizeof(int16_t));
-#else
-    fir->history = (int16_t *)malloc(taps*sizeof(int16_t));
-    if (fir->history)
-	memset(fir->history, 0, taps*sizeof(int16_t));
-#endif
     return fir->history;
 }
 /*- End of function --------------------------------------------------------*/
 
 static inline void fir16_flush(struct fir16_state *fir)
 {
-#if defined(USE_MMX)  ||  defined(USE_SSE2) || defined(__BLACKFIN_ASM__)
     memset(fir->history, 0, 2*fir->taps*sizeof(int16_t));
-#else
-    memset(fir->history, 0, fir->taps*sizeof(int16_t));
-#endif
 }
 /*- End of function --------------------------------------------------------*/
 
@@ -250,6 +241,7 @@ static inline int16_t fir16(struct fir16_state *fir, int16_t sample)
     int offset2;
 
     fir->history[fir->curr_pos] = sample;
+    fir->history[fir->curr_pos + fir->taps] = sample;
 
     offset2 = fir->curr_pos;
     offset1 = fir->taps - offset2;
@@ -266,6 +258,22 @@ static inline int16_t fir16(struct fir16_state *fir, int16_t sample)
 }
 /*- End of function --------------------------------------------------------*/
 
+/* same as fir16(), but the dot product is done by the given kernel */
+static inline int16_t fir16_dot(struct fir16_state *fir, int16_t sample,
+	int32_t (*dot16)(const int16_t *coeffs, const int16_t *hist, int taps))
+{
+    int32_t y;
+
+    fir->history[fir->curr_pos] = sample;
+    fir->history[fir->curr_pos + fir->taps] = sample;
+    y = dot16(fir->coeffs, &fir->history[fir->curr_pos], fir->taps);
+    if (fir->curr_pos <= 0)
+	fir->curr_pos = fir->taps;
+    fir->curr_pos--;
+    return (int16_t) (y >> 15);
+}
+/*- End of function --------------------------------------------------------*/
+
 static inline const int16_t *fir32_create(struct fir32_state *fir,
 					      const int32_t *coeffs,
 					      int taps)
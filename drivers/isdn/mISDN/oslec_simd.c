@@ -0,0 +1,303 @@
+/*
+ * oslec_simd.c
+ *
+ * FIR dot product and LMS update kernels of the oslec echo canceller.
+ *
+ * The generic kernels work on any cpu. On x86, SSE2, SSE4.1 and AVX2 kernels
+ * are selected at init, if the cpu supports them. They produce exactly the
+ * same results as the generic ones, the 32 bit sums wrap around the same way.
+ *
+ * The history of the filters is stored twice in a row (see fir16_create), so
+ * all kernels work on linear buffers of any length.
+ *
+ * This is the only vector code of mISDN. Each frame that uses it pays for a
+ * kernel_fpu_begin/end section: saving and restoring the vector registers
+ * takes 200 to 250 cycles (dspbench fpu-section, depending on the cpu and
+ * the enabled state components). A 256 tap oslec frame takes about 35000
+ * cycles, so the section is paid back many times. Code that runs a few
+ * hundred cycles per frame cannot win it back; those places say so with
+ * their own numbers and refer to this comment.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#ifdef CONFIG_X86
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#endif
+#include "oslec_simd.h"
+
+/* generic */
+
+static int32_t
+dot16_generic(const int16_t *coeffs, const int16_t *hist, int taps)
+{
+	int32_t y0 = 0, y1 = 0;
+	int i;
+
+	/* two sums, so the multiplications do not wait for each other */
+	for (i = 0; i + 1 < taps; i += 2) {
+		y0 += coeffs[i] * hist[i];
+		y1 += coeffs[i + 1] * hist[i + 1];
+	}
+	if (i < taps)
+		y0 += coeffs[i] * hist[i];
+
+	return y0 + y1;
+}
+
+static void
+lms16_generic(int16_t *coeffs, const int16_t *hist, int factor, int taps)
+{
+	int i;
+
+	for (i = 0; i < taps; i++)
+		coeffs[i] += (int16_t)((hist[i] * factor + (1 << 14)) >> 15);
+}
+
+const struct oslec_kernels oslec_kernels_generic = {
+	.name = "generic",
+	.dot16 = dot16_generic,
+	.lms16 = lms16_generic,
+};
+
+static const struct oslec_kernels *oslec_kernels = &oslec_kernels_generic;
+
+#ifdef CONFIG_X86
+
+/* SSE2: 8 taps per loop */
+static int32_t
+dot16_sse2(const int16_t *coeffs, const int16_t *hist, int taps)
+{
+	int n = taps & ~7;
+	int32_t y = 0;
+
+	if (n) {
+		asm volatile(
+			"pxor %%xmm0, %%xmm0\n\t"
+			"1:\n\t"
+			"movdqu (%[c]), %%xmm1\n\t"
+			"movdqu (%[h]), %%xmm2\n\t"
+			"pmaddwd %%xmm2, %%xmm1\n\t"
+			"paddd %%xmm1, %%xmm0\n\t"
+			"add $16, %[c]\n\t"
+			"add $16, %[h]\n\t"
+			"sub $8, %[n]\n\t"
+			"jnz 1b\n\t"
+			"pshufd $0x4e, %%xmm0, %%xmm1\n\t"
+			"paddd %%xmm1, %%xmm0\n\t"
+			"pshufd $0xb1, %%xmm0, %%xmm1\n\t"
+			"paddd %%xmm1, %%xmm0\n\t"
+			"movd %%xmm0, %[y]\n\t"
+			: [c] "+r" (coeffs), [h] "+r" (hist), [n] "+r" (n),
+			  [y] "=r" (y)
+			:
+			: "xmm0", "xmm1", "xmm2", "memory", "cc");
+	}
+
+	return y + dot16_generic(coeffs, hist, taps & 7);
+}
+
+/*
+ * SSE4.1: 8 taps per loop
+ * the low 16 bit of (x >> 15) are taken by (x << 1) >> 16, so packssdw
+ * does not saturate and the result is truncated like the generic one.
+ */
+static void
+lms16_sse41(int16_t *coeffs, const int16_t *hist, int factor, int taps)
+{
+	int n = taps & ~7;
+
+	if (n) {
+		asm volatile(
+			"movd %[f], %%xmm3\n\t"
+			"pshufd $0, %%xmm3, %%xmm3\n\t"
+			"movd %[r], %%xmm4\n\t"
+			"pshufd $0, %%xmm4, %%xmm4\n\t"
+			"1:\n\t"
+			"movdqu (%[h]), %%xmm0\n\t"
+			"pmovsxwd %%xmm0, %%xmm1\n\t"
+			"psrldq $8, %%xmm0\n\t"
+			"pmovsxwd %%xmm0, %%xmm2\n\t"
+			"pmulld %%xmm3, %%xmm1\n\t"
+			"pmulld %%xmm3, %%xmm2\n\t"
+			"paddd %%xmm4, %%xmm1\n\t"
+			"paddd %%xmm4, %%xmm2\n\t"
+			"pslld $1, %%xmm1\n\t"
+			"pslld $1, %%xmm2\n\t"
+			"psrad $16, %%xmm1\n\t"
+			"psrad $16, %%xmm2\n\t"
+			"packssdw %%xmm2, %%xmm1\n\t"
+			"movdqu (%[c]), %%xmm0\n\t"
+			"paddw %%xmm1, %%xmm0\n\t"
+			"movdqu %%xmm0, (%[c])\n\t"
+			"add $16, %[c]\n\t"
+			"add $16, %[h]\n\t"
+			"sub $8, %[n]\n\t"
+			"jnz 1b\n\t"
+			: [c] "+r" (coeffs), [h] "+r" (hist), [n] "+r" (n)
+			: [f] "r" (factor), [r] "r" (1 << 14)
+			: "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "memory",
+			  "cc");
+	}
+
+	lms16_generic(coeffs, hist, factor, taps & 7);
+}
+
+static const struct oslec_kernels oslec_kernels_sse2 = {
+	.name = "sse2",
+	.dot16 = dot16_sse2,
+	.lms16 = lms16_generic,
+};
+
+static const struct oslec_kernels oslec_kernels_sse41 = {
+	.name = "sse4.1",
+	.dot16 = dot16_sse2,
+	.lms16 = lms16_sse41,
+};
+
+#ifdef CONFIG_AS_AVX2
+
+/* AVX2: 16 taps per loop */
+static int32_t
+dot16_avx2(const int16_t *coeffs, const int16_t *hist, int taps)
+{
+	int n = taps & ~15;
+	int32_t y = 0;
+
+	if (n) {
+		asm volatile(
+			"vpxor %%ymm0, %%ymm0, %%ymm0\n\t"
+			"1:\n\t"
+			"vmovdqu (%[c]), %%ymm1\n\t"
+			"vpmaddwd (%[h]), %%ymm1, %%ymm1\n\t"
+			"vpaddd %%ymm1, %%ymm0, %%ymm0\n\t"
+			"add $32, %[c]\n\t"
+			"add $32, %[h]\n\t"
+			"sub $16, %[n]\n\t"
+			"jnz 1b\n\t"
+			"vextracti128 $1, %%ymm0, %%xmm1\n\t"
+			"vpaddd %%xmm1, %%xmm0, %%xmm0\n\t"
+			"vpshufd $0x4e, %%xmm0, %%xmm1\n\t"
+			"vpaddd %%xmm1, %%xmm0, %%xmm0\n\t"
+			"vpshufd $0xb1, %%xmm0, %%xmm1\n\t"
+			"vpaddd %%xmm1, %%xmm0, %%xmm0\n\t"
+			"vmovd %%xmm0, %[y]\n\t"
+			"vzeroupper\n\t"
+			: [c] "+r" (coeffs), [h] "+r" (hist), [n] "+r" (n),
+			  [y] "=r" (y)
+			:
+			: "xmm0", "xmm1", "memory", "cc");
+	}
+
+	return y + dot16_generic(coeffs, hist, taps & 15);
+}
+
+/* AVX2: 16 taps per loop, vpackssdw packs per lane, vpermq restores order */
+static void
+lms16_avx2(int16_t *coeffs, const int16_t *hist, int factor, int taps)
+{
+	int n = taps & ~15;
+
+	if (n) {
+		asm volatile(
+			"vmovd %[f], %%xmm3\n\t"
+			"vpbroadcastd %%xmm3, %%ymm3\n\t"
+			"vmovd %[r], %%xmm4\n\t"
+			"vpbroadcastd %%xmm4, %%ymm4\n\t"
+			"1:\n\t"
+			"vpmovsxwd (%[h]), %%ymm1\n\t"
+			"vpmovsxwd 16(%[h]), %%ymm2\n\t"
+			"vpmulld %%ymm3, %%ymm1, %%ymm1\n\t"
+			"vpmulld %%ymm3, %%ymm2, %%ymm2\n\t"
+			"vpaddd %%ymm4, %%ymm1, %%ymm1\n\t"
+			"vpaddd %%ymm4, %%ymm2, %%ymm2\n\t"
+			"vpslld $1, %%ymm1, %%ymm1\n\t"
+			"vpslld $1, %%ymm2, %%ymm2\n\t"
+			"vpsrad $16, %%ymm1, %%ymm1\n\t"
+			"vpsrad $16, %%ymm2, %%ymm2\n\t"
+			"vpackssdw %%ymm2, %%ymm1, %%ymm1\n\t"
+			"vpermq $0xd8, %%ymm1, %%ymm1\n\t"
+			"vpaddw (%[c]), %%ymm1, %%ymm1\n\t"
+			"vmovdqu %%ymm1, (%[c])\n\t"
+			"add $32, %[c]\n\t"
+			"add $32, %[h]\n\t"
+			"sub $16, %[n]\n\t"
+			"jnz 1b\n\t"
+			"vzeroupper\n\t"
+			: [c] "+r" (coeffs), [h] "+r" (hist), [n] "+r" (n)
+			: [f] "r" (factor), [r] "r" (1 << 14)
+			: "xmm1", "xmm2", "xmm3", "xmm4", "memory", "cc");
+	}
+
+	lms16_generic(coeffs, hist, factor, taps & 15);
+}
+
+static const struct oslec_kernels oslec_kernels_avx2 = {
+	.name = "avx2",
+	.dot16 = dot16_avx2,
+	.lms16 = lms16_avx2,
+};
+
+#endif /* CONFIG_AS_AVX2 */
+
+void
+oslec_simd_init(void)
+{
+#ifdef CONFIG_AS_AVX2
+	if (boot_cpu_has(X86_FEATURE_AVX2) && boot_cpu_has(X86_FEATURE_AVX))
+		oslec_kernels = &oslec_kernels_avx2;
+	else
+#endif
+	if (boot_cpu_has(X86_FEATURE_XMM4_1))
+		oslec_kernels = &oslec_kernels_sse41;
+	else if (boot_cpu_has(X86_FEATURE_XMM2))
+		oslec_kernels = &oslec_kernels_sse2;
+	printk(KERN_INFO "oslec: using %s kernels\n", oslec_kernels->name);
+}
+
+/*
+ * the echo canceller runs from the receive path of the card, which may be
+ * interrupt context. if the vector registers cannot be used there, the
+ * generic kernels are used for this frame.
+ */
+const struct oslec_kernels *
+oslec_simd_begin(void)
+{
+	if (oslec_kernels == &oslec_kernels_generic || !irq_fpu_usable())
+		return &oslec_kernels_generic;
+	kernel_fpu_begin();
+	return oslec_kernels;
+}
+
+void
+oslec_simd_end(const struct oslec_kernels *k)
+{
+	if (k != &oslec_kernels_generic)
+		kernel_fpu_end();
+}
+
+#else /* CONFIG_X86 */
+
+void
+oslec_simd_init(void)
+{
+	printk(KERN_INFO "oslec: using %s kernels\n", oslec_kernels->name);
+}
+
+const struct oslec_kernels *
+oslec_simd_begin(void)
+{
+	return oslec_kernels;
+}
+
+void
+oslec_simd_end(const struct oslec_kernels *k)
+{
+}
+
+#endif /* CONFIG_X86 */
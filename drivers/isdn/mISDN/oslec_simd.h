@@ -0,0 +1,35 @@
+/*
+ * oslec_simd.h
+ *
+ * FIR dot product and LMS update kernels of the oslec echo canceller.
+ * The kernels are chosen at init by the features of the cpu.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2, as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __OSLEC_SIMD__
+#define __OSLEC_SIMD__
+
+struct oslec_kernels {
+	const char	*name;
+	/* sum of coeffs[i] * hist[i] */
+	int32_t		(*dot16)(const int16_t *coeffs, const int16_t *hist,
+				 int taps);
+	/* coeffs[i] += (hist[i] * factor + (1 << 14)) >> 15 */
+	void		(*lms16)(int16_t *coeffs, const int16_t *hist,
+				 int factor, int taps);
+};
+
+extern const struct oslec_kernels oslec_kernels_generic;
+
+void oslec_simd_init(void);
+/*
+ * the kernels returned by oslec_simd_begin may use vector registers, so
+ * they must only be used until oslec_simd_end is called.
+ */
+const struct oslec_kernels *oslec_simd_begin(void);
+void oslec_simd_end(const struct oslec_kernels *k);
+
+#endif
@@ -80,6 +80,11 @@ void oslec_echo_can_free(struct echo_can_state *ec)
   free(ec);
 }
 
+void oslec_echo_can_reset(struct echo_can_state *ec)
+{
+  echo_can_reset((struct echo_can_state_s *)(ec->ec));
+}
+
 short oslec_echo_can_update(struct echo_can_state *ec, short iref, short isig)
 {
     short clean;
@@ -97,6 +102,12 @@ short oslec_echo_can_update(struct echo_can_state *ec, short iref, short isig)
     return clean;
 }
 
+void oslec_echo_can_update_block(struct echo_can_state *ec, const short *tx,
+				 short *rx, int len)
+{
+    echo_can_update_block((struct echo_can_state_s *)(ec->ec), tx, rx, len);
+}
+
 int oslec_echo_can_traintap(struct echo_can_state *ec, int pos, short val)
 {
 	return 0;
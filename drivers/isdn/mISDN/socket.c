@@ -18,6 +18,10 @@
 #include <linux/mISDNif.h>
 #include <linux/slab.h>
 #include <linux/export.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/poll.h>
+#include <trace/events/misdn.h>
 #include "core.h"
 
 static u_int	*debug;
@@ -43,6 +47,10 @@ static struct mISDN_sock_list	base_sockets = {
 
 #define L2_HEADER_LEN	4
 
+/* mISDN_sock->rx_flags */
+#define MISDN_SOCK_RX_FULL	0	/* the receive queue overflowed */
+#define MISDN_SOCK_RX_OFF	1	/* rx of the peer is turned off */
+
 static inline struct sk_buff *
 _l2_alloc_skb(unsigned int len, gfp_t gfp_mask)
 {
@@ -69,10 +77,445 @@ static void mISDN_sock_unlink(struct mISDN_sock_list *l, struct sock *sk)
 	write_unlock_bh(&l->lock);
 }
 
+/*
+ * ISDN_P_TRUNK: the socket is the upper end of several B-channels. Each
+ * channel has its own mISDNchannel, frames from all of them go into the
+ * queue of the socket, tagged with the channel number in the id.
+ */
+struct mISDN_trunk_ch {
+	struct mISDNchannel	ch;
+	struct mISDN_sock	*msk;
+};
+
+struct mISDN_trunk {
+	u_int			protocol;
+	u_char			channelmap[MISDN_CHMAP_SIZE];
+	struct mISDN_trunk_ch	*chan[MISDN_MAX_CHANNEL + 1];
+	spinlock_t		lock;	/* active and rx */
+	DECLARE_BITMAP(active, MISDN_MAX_CHANNEL + 1);
+	DECLARE_BITMAP(rx, MISDN_MAX_CHANNEL + 1); /* since the last wakeup */
+};
+
+static struct mISDN_trunk *
+mISDN_trunk_get(struct mISDN_sock *msk)
+{
+	struct mISDN_trunk	*tr = msk->trunk;
+
+	if (tr)
+		return tr;
+	tr = kzalloc(sizeof(*tr), GFP_KERNEL);
+	if (!tr)
+		return NULL;
+	tr->protocol = ISDN_P_B_RAW;
+	memset(tr->channelmap, 0xff, sizeof(tr->channelmap));
+	spin_lock_init(&tr->lock);
+	msk->trunk = tr;
+	return tr;
+}
+
+/* queue a frame, the socket may only be woken once per tick */
+static int
+mISDN_trunk_queue(struct sock *sk, struct sk_buff *skb, bool wake)
+{
+	if (atomic_read(&sk->sk_rmem_alloc) >= sk->sk_rcvbuf) {
+		sk->sk_data_ready(sk);
+		return -ENOMEM;
+	}
+	skb_set_owner_r(skb, sk);
+	skb_queue_tail(&sk->sk_receive_queue, skb);
+	if (wake && !sock_flag(sk, SOCK_DEAD))
+		sk->sk_data_ready(sk);
+	return 0;
+}
+
+static void	mISDN_ring_rx(struct mISDN_sock *, struct mISDN_sock_ring *,
+			      struct sk_buff *);
+
+static int
+mISDN_trunk_recv(struct mISDNchannel *ch, struct sk_buff *skb)
+{
+	struct mISDN_trunk_ch	*tc = container_of(ch, struct mISDN_trunk_ch,
+						   ch);
+	struct mISDN_sock	*msk = tc->msk;
+	struct mISDN_trunk	*tr = msk->trunk;
+	struct mISDN_sock_ring	*r;
+	u_int			nr = ch->nr;
+	u_long			flags;
+	bool			wake = true;
+	int			err;
+
+	if (msk->sk.sk_state == MISDN_CLOSED)
+		return -EUNATCH;
+	__net_timestamp(skb);
+	mISDN_HEAD_ID(skb) = (nr << 16) | (mISDN_HEAD_ID(skb) & 0xffff);
+	r = smp_load_acquire(&msk->ring);
+	if (r) {
+		/* rx_block gives the frames per wakeup here */
+		mISDN_ring_rx(msk, r, skb);
+		return 0;
+	}
+	spin_lock_irqsave(&tr->lock, flags);
+	switch (mISDN_HEAD_PRIM(skb)) {
+	case PH_ACTIVATE_IND:
+	case PH_ACTIVATE_CNF:
+		set_bit(nr, tr->active);
+		break;
+	case PH_DEACTIVATE_IND:
+	case PH_DEACTIVATE_CNF:
+		clear_bit(nr, tr->active);
+		clear_bit(nr, tr->rx);
+		break;
+	case PH_DATA_CNF:
+		/* read with the next data */
+		wake = false;
+		break;
+	case PH_DATA_IND:
+		if (test_bit(nr, tr->rx)) {
+			/* a new tick, before all others got their frame */
+			bitmap_zero(tr->rx, MISDN_MAX_CHANNEL + 1);
+			set_bit(nr, tr->rx);
+			break;
+		}
+		set_bit(nr, tr->rx);
+		wake = bitmap_subset(tr->active, tr->rx,
+				     MISDN_MAX_CHANNEL + 1);
+		if (wake)
+			bitmap_zero(tr->rx, MISDN_MAX_CHANNEL + 1);
+		break;
+	}
+	spin_unlock_irqrestore(&tr->lock, flags);
+	err = mISDN_trunk_queue(&msk->sk, skb, wake);
+	if (err)
+		printk(KERN_WARNING "%s: error %d\n", __func__, err);
+	return err;
+}
+
+static int
+mISDN_trunk_ctrl(struct mISDNchannel *ch, u_int cmd, void *arg)
+{
+	struct mISDN_trunk_ch	*tc = container_of(ch, struct mISDN_trunk_ch,
+						   ch);
+
+	if (*debug & DEBUG_SOCKET)
+		printk(KERN_DEBUG "%s(%p, %x, %p)\n", __func__, ch, cmd, arg);
+	switch (cmd) {
+	case CLOSE_CHANNEL:
+		/* the device goes away */
+		tc->msk->sk.sk_state = MISDN_CLOSED;
+		break;
+	}
+	return 0;
+}
+
+static int
+mISDN_trunk_xmit(struct mISDN_trunk *tr, struct sk_buff *skb)
+{
+	u_int			nr = MISDN_TRUNK_CHANNEL(mISDN_HEAD_ID(skb));
+	struct mISDN_trunk_ch	*tc;
+
+	tc = (nr <= MISDN_MAX_CHANNEL) ? tr->chan[nr] : NULL;
+	if (!tc || !tc->ch.peer)
+		return -ENODEV;
+	mISDN_HEAD_ID(skb) &= 0xffff;
+	return tc->ch.recv(tc->ch.peer, skb);
+}
+
+static void
+mISDN_trunk_close(struct mISDN_trunk *tr)
+{
+	struct mISDN_trunk_ch	*tc;
+	u_int			nr;
+
+	for (nr = 0; nr <= MISDN_MAX_CHANNEL; nr++) {
+		tc = tr->chan[nr];
+		if (!tc)
+			continue;
+		if (tc->ch.peer)
+			tc->ch.peer->ctrl(tc->ch.peer, CLOSE_CHANNEL, NULL);
+		tr->chan[nr] = NULL;
+		kfree(tc);
+	}
+}
+
+static int
+mISDN_trunk_bind(struct mISDN_sock *msk, struct sockaddr_mISDN *maddr)
+{
+	struct sockaddr_mISDN	adr = *maddr;
+	struct mISDN_trunk	*tr;
+	struct mISDN_trunk_ch	*tc;
+	u_int			nr, cnt = 0;
+	int			err = 0;
+
+	tr = mISDN_trunk_get(msk);
+	if (!tr)
+		return -ENOMEM;
+	for (nr = 1; nr <= MISDN_MAX_CHANNEL; nr++) {
+		if (!test_channelmap(nr, tr->channelmap) ||
+		    !test_channelmap(nr, msk->dev->channelmap))
+			continue;
+		tc = kzalloc(sizeof(*tc), GFP_KERNEL);
+		if (!tc) {
+			err = -ENOMEM;
+			break;
+		}
+		tc->msk = msk;
+		tc->ch.send = mISDN_trunk_recv;
+		tc->ch.ctrl = mISDN_trunk_ctrl;
+		adr.channel = nr;
+		err = connect_Bstack(msk->dev, &tc->ch, tr->protocol, &adr);
+		if (err) {
+			kfree(tc);
+			break;
+		}
+		tr->chan[nr] = tc;
+		cnt++;
+	}
+	if (!err && !cnt)
+		err = -ENODEV;
+	if (err)
+		mISDN_trunk_close(tr);
+	return err;
+}
+
+/* give a frame from userspace to the layer below */
+static int
+mISDN_sock_xmit(struct sock *sk, struct sk_buff *skb)
+{
+	if (_pms(sk)->trunk)
+		return mISDN_trunk_xmit(_pms(sk)->trunk, skb);
+	if (!_pms(sk)->ch.peer)
+		return -ENODEV;
+	return _pms(sk)->ch.recv(_pms(sk)->ch.peer, skb);
+}
+
+/*
+ * kernel side of the MISDN_RING rings, the rest is in the mapped area.
+ * the user may write the whole mapped area, so the geometry is kept here
+ * and only the status and the length of a frame are read from there.
+ */
+struct mISDN_sock_ring {
+	struct mISDN_ring_hdr	*hdr;
+	u_int			frame_size;
+	u_int			rx_frames;
+	u_int			tx_frames;
+	u_int			rx_offset;
+	u_int			tx_offset;
+	spinlock_t		lock;	/* rx side */
+	u_int			rx_head;
+	u_int			rx_pending;	/* since the last wakeup */
+	u_int			rx_block;
+	u_int			tx_head;
+};
+
+#define MISDN_RING_MAX_FRAMES	4096
+#define MISDN_RING_MAX_SIZE	(8 << 20)
+
+static inline struct mISDN_ring_frame *
+ring_frame(struct mISDN_sock_ring *r, u_int offset, u_int nr)
+{
+	return (void *)r->hdr + offset + nr * r->frame_size;
+}
+
+static int
+mISDN_ring_create(struct sock *sk, struct mISDN_ring_req *req)
+{
+	struct mISDN_sock_ring	*r;
+	struct mISDN_ring_hdr	*hdr;
+	size_t			size;
+
+	if (_pms(sk)->ring)
+		return -EBUSY;
+	if (req->frame_size <= MISDN_RING_FRAME_HDR || req->frame_size & 15 ||
+	    req->frame_size > MISDN_RING_FRAME_HDR + MAX_DATA_MEM)
+		return -EINVAL;
+	if (!req->rx_frames || req->rx_frames > MISDN_RING_MAX_FRAMES ||
+	    req->tx_frames > MISDN_RING_MAX_FRAMES ||
+	    !req->rx_block || req->rx_block > req->rx_frames)
+		return -EINVAL;
+	size = ALIGN(sizeof(*hdr), 64) +
+		(size_t)(req->rx_frames + req->tx_frames) * req->frame_size;
+	if (size > MISDN_RING_MAX_SIZE)
+		return -EINVAL;
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if (!r)
+		return -ENOMEM;
+	/* zeroed, so all frames belong to the kernel */
+	hdr = vmalloc_user(size);
+	if (!hdr) {
+		kfree(r);
+		return -ENOMEM;
+	}
+	hdr->frame_size = req->frame_size;
+	hdr->rx_frames = req->rx_frames;
+	hdr->tx_frames = req->tx_frames;
+	hdr->rx_offset = ALIGN(sizeof(*hdr), 64);
+	hdr->tx_offset = hdr->rx_offset + req->rx_frames * req->frame_size;
+	r->hdr = hdr;
+	r->frame_size = hdr->frame_size;
+	r->rx_frames = hdr->rx_frames;
+	r->tx_frames = hdr->tx_frames;
+	r->rx_offset = hdr->rx_offset;
+	r->tx_offset = hdr->tx_offset;
+	r->rx_block = req->rx_block;
+	spin_lock_init(&r->lock);
+	/* mISDN_send may look at it from now on */
+	smp_store_release(&_pms(sk)->ring, r);
+	return 0;
+}
+
+static void
+mISDN_ring_free(struct sock *sk)
+{
+	struct mISDN_sock_ring	*r = _pms(sk)->ring;
+
+	if (!r)
+		return;
+	_pms(sk)->ring = NULL;
+	vfree(r->hdr);
+	kfree(r);
+}
+
+/* put a received frame into the rx ring, the skb is consumed */
+static void
+mISDN_ring_rx(struct mISDN_sock *msk, struct mISDN_sock_ring *r,
+	      struct sk_buff *skb)
+{
+	struct mISDN_ring_frame	*f;
+	u_long			flags;
+	bool			wake = false;
+
+	spin_lock_irqsave(&r->lock, flags);
+	f = ring_frame(r, r->rx_offset, r->rx_head);
+	if (READ_ONCE(f->status) != MISDN_RING_KERNEL ||
+	    skb->len > r->frame_size - MISDN_RING_FRAME_HDR) {
+		r->hdr->rx_dropped++;
+		/* the user is behind, let it know */
+		wake = r->rx_pending != 0;
+		r->rx_pending = 0;
+		goto out;
+	}
+	/* the status is read before the frame is written */
+	smp_mb();
+	f->len = skb->len;
+	f->prim = mISDN_HEAD_PRIM(skb);
+	f->id = mISDN_HEAD_ID(skb);
+	f->tstamp = ktime_to_ns(skb->tstamp ? skb->tstamp : ktime_get_real());
+	skb_copy_bits(skb, 0, (void *)f + MISDN_RING_FRAME_HDR, skb->len);
+	/* the frame is written before the user gets it */
+	smp_wmb();
+	WRITE_ONCE(f->status, MISDN_RING_USER);
+	if (++r->rx_head == r->rx_frames)
+		r->rx_head = 0;
+	if (++r->rx_pending >= r->rx_block ||
+	    f->prim != PH_DATA_IND) {
+		r->rx_pending = 0;
+		wake = true;
+	}
+out:
+	spin_unlock_irqrestore(&r->lock, flags);
+	dev_kfree_skb(skb);
+	if (wake)
+		msk->sk.sk_data_ready(&msk->sk);
+}
+
+/*
+ * send the frames the user gave to the kernel, called with the socket lock.
+ * at most one round of the ring is sent per call.
+ */
+static int
+mISDN_ring_tx(struct sock *sk, struct mISDN_sock_ring *r)
+{
+	struct mISDN_ring_frame	*f;
+	struct sk_buff		*skb;
+	u_int			len, i;
+	int			cnt = 0;
+
+	for (i = 0; i < r->tx_frames; i++) {
+		f = ring_frame(r, r->tx_offset, r->tx_head);
+		if (smp_load_acquire(&f->status) != MISDN_RING_USER)
+			break;
+		len = READ_ONCE(f->len);
+		if (len > r->frame_size - MISDN_RING_FRAME_HDR) {
+			r->hdr->tx_errors++;
+			goto next;
+		}
+		skb = _l2_alloc_skb(len, GFP_KERNEL);
+		if (!skb) {
+			if (!cnt)
+				cnt = -ENOMEM;
+			break;
+		}
+		memcpy(skb_put(skb, len), (void *)f + MISDN_RING_FRAME_HDR, len);
+		mISDN_HEAD_PRIM(skb) = READ_ONCE(f->prim);
+		mISDN_HEAD_ID(skb) = READ_ONCE(f->id);
+		if (mISDN_sock_xmit(sk, skb)) {
+			kfree_skb(skb);
+			r->hdr->tx_errors++;
+		} else
+			cnt++;
+next:
+		/* the frame is read before the user gets it back */
+		smp_store_release(&f->status, MISDN_RING_KERNEL);
+		if (++r->tx_head == r->tx_frames)
+			r->tx_head = 0;
+	}
+	return cnt;
+}
+
+/*
+ * A full receive queue of a B-channel socket turns off rx of the peer (the
+ * DSP or the B-channel), instead of dropping every frame, until the user
+ * has read half of it. The peer is not called from mISDN_send, it may hold
+ * the lock of the card there.
+ */
+static void
+mISDN_sock_rx_work(struct work_struct *work)
+{
+	struct mISDN_sock	*msk = container_of(work, struct mISDN_sock,
+						    rx_work);
+	struct mISDN_ctrl_req	cq;
+	int			off;
+
+	lock_sock(&msk->sk);
+	off = test_bit(MISDN_SOCK_RX_FULL, &msk->rx_flags);
+	if (off == test_bit(MISDN_SOCK_RX_OFF, &msk->rx_flags))
+		goto out;
+	if (msk->sk.sk_state != MISDN_BOUND || !msk->ch.peer)
+		goto out;
+	memset(&cq, 0, sizeof(cq));
+	cq.op = MISDN_CTRL_RX_OFF;
+	cq.p1 = off;
+	if (msk->ch.peer->ctrl(msk->ch.peer, CONTROL_CHANNEL, &cq)) {
+		if (*debug & DEBUG_SOCKET)
+			printk(KERN_DEBUG "%s: ch %d no MISDN_CTRL_RX_OFF\n",
+			       __func__, msk->ch.nr);
+		goto out;
+	}
+	change_bit(MISDN_SOCK_RX_OFF, &msk->rx_flags);
+	if (*debug & DEBUG_SOCKET)
+		printk(KERN_DEBUG "%s: ch %d rx %s\n", __func__, msk->ch.nr,
+		       off ? "off" : "on");
+out:
+	release_sock(&msk->sk);
+}
+
+/* called after frames were taken from the queue */
+static void
+mISDN_sock_rx_resume(struct sock *sk)
+{
+	if (!test_bit(MISDN_SOCK_RX_FULL, &_pms(sk)->rx_flags))
+		return;
+	if (atomic_read(&sk->sk_rmem_alloc) > sk->sk_rcvbuf / 2)
+		return;
+	if (test_and_clear_bit(MISDN_SOCK_RX_FULL, &_pms(sk)->rx_flags))
+		schedule_work(&_pms(sk)->rx_work);
+}
+
 static int
 mISDN_send(struct mISDNchannel *ch, struct sk_buff *skb)
 {
 	struct mISDN_sock *msk;
+	struct mISDN_sock_ring *r;
 	int	err;
 
 	msk = container_of(ch, struct mISDN_sock, ch);
@@ -81,8 +524,22 @@ mISDN_send(struct mISDNchannel *ch, struct sk_buff *skb)
 	if (msk->sk.sk_state == MISDN_CLOSED)
 		return -EUNATCH;
 	__net_timestamp(skb);
+	trace_misdn_sock_rx(ch, ch->nr, skb->len,
+			    skb_queue_len(&msk->sk.sk_receive_queue));
+	r = smp_load_acquire(&msk->ring);
+	if (r) {
+		mISDN_ring_rx(msk, r, skb);
+		return 0;
+	}
 	err = sock_queue_rcv_skb(&msk->sk, skb);
-	if (err)
+	if (err == -ENOMEM && msk->sk.sk_protocol >= ISDN_P_B_START) {
+		/* counted in sk_drops, reported with SO_RXQ_OVFL */
+		if (!test_and_set_bit(MISDN_SOCK_RX_FULL, &msk->rx_flags)) {
+			printk(KERN_WARNING "%s: ch %d receive queue full\n",
+			       __func__, ch->nr);
+			schedule_work(&msk->rx_work);
+		}
+	} else if (err)
 		printk(KERN_WARNING "%s: error %d\n", __func__, err);
 	return err;
 }
@@ -112,6 +569,91 @@ mISDN_sock_cmsg(struct sock *sk, struct msghdr *msg, struct sk_buff *skb)
 		skb_get_timestamp(skb, &tv);
 		put_cmsg(msg, SOL_MISDN, MISDN_TIME_STAMP, sizeof(tv), &tv);
 	}
+	if ((_pms(sk)->cmask & MISDN_RX_STAMP) && mISDN_RXSTAMP_P(skb)->time)
+		put_cmsg(msg, SOL_MISDN, MISDN_RX_STAMP,
+			 sizeof(struct mISDN_rxstamp), mISDN_RXSTAMP_P(skb));
+	if (sock_flag(sk, SOCK_RXQ_OVFL) && SOCK_SKB_CB(skb)->dropcount)
+		put_cmsg(msg, SOL_SOCKET, SO_RXQ_OVFL, sizeof(__u32),
+			 &SOCK_SKB_CB(skb)->dropcount);
+}
+
+static inline void
+mISDN_sock_name(struct sock *sk, struct msghdr *msg, struct sk_buff *skb)
+{
+	if (msg->msg_name) {
+		DECLARE_SOCKADDR(struct sockaddr_mISDN *, maddr, msg->msg_name);
+
+		maddr->family = AF_ISDN;
+		maddr->dev = _pms(sk)->dev->id;
+		if ((sk->sk_protocol == ISDN_P_LAPD_TE) ||
+		    (sk->sk_protocol == ISDN_P_LAPD_NT)) {
+			maddr->channel = (mISDN_HEAD_ID(skb) >> 16) & 0xff;
+			maddr->tei =  (mISDN_HEAD_ID(skb) >> 8) & 0xff;
+			maddr->sapi = mISDN_HEAD_ID(skb) & 0xff;
+		} else if (sk->sk_protocol == ISDN_P_TRUNK) {
+			maddr->channel =
+				MISDN_TRUNK_CHANNEL(mISDN_HEAD_ID(skb));
+			maddr->sapi = 0;
+			maddr->tei = 0;
+		} else {
+			maddr->channel = _pms(sk)->ch.nr;
+			maddr->sapi = _pms(sk)->ch.addr & 0xFF;
+			maddr->tei =  (_pms(sk)->ch.addr >> 8) & 0xFF;
+		}
+		msg->msg_namelen = sizeof(*maddr);
+	}
+}
+
+/*
+ * MISDN_BATCH: a read gets all queued frames which fit into the buffer.
+ * Only the first frame is waited for, like with MSG_WAITFORONE, the name
+ * and the time stamp are the ones of the first frame.
+ */
+static int
+mISDN_sock_recvbatch(struct sock *sk, struct msghdr *msg, size_t len,
+		     int flags)
+{
+	static u8		pad[3];	/* zero */
+	struct mISDN_batchhead	bh;
+	struct sk_buff		*skb;
+	size_t			copied = 0, off;
+	int			err;
+
+	skb = skb_recv_datagram(sk, flags, flags & MSG_DONTWAIT, &err);
+	if (!skb)
+		return err;
+	if (MISDN_BATCH_HEAD_LEN + skb->len > len) {
+		skb_queue_head(&sk->sk_receive_queue, skb);
+		return -ENOSPC;
+	}
+	mISDN_sock_name(sk, msg, skb);
+	mISDN_sock_cmsg(sk, msg, skb);
+	do {
+		off = copied ? MISDN_BATCH_ALIGN(copied) - copied : 0;
+		if (copied + off + MISDN_BATCH_HEAD_LEN + skb->len > len) {
+			skb_queue_head(&sk->sk_receive_queue, skb);
+			break;
+		}
+		bh.prim = mISDN_HEAD_PRIM(skb);
+		bh.id = mISDN_HEAD_ID(skb);
+		bh.len = skb->len;
+		trace_misdn_sock_recv(&_pms(sk)->ch, _pms(sk)->ch.nr, skb->len,
+				      skb_queue_len(&sk->sk_receive_queue));
+		err = off ? memcpy_to_msg(msg, pad, off) : 0;
+		if (!err)
+			err = memcpy_to_msg(msg, &bh, MISDN_BATCH_HEAD_LEN);
+		if (!err)
+			err = skb_copy_datagram_msg(skb, 0, msg, skb->len);
+		skb_free_datagram(sk, skb);
+		if (err)
+			break;
+		copied += off + MISDN_BATCH_HEAD_LEN + bh.len;
+	} while ((skb = skb_dequeue(&sk->sk_receive_queue)));
+
+	mISDN_sock_rx_resume(sk);
+	if (err && !copied)
+		return err;
+	return copied;
 }
 
 static int
@@ -133,27 +675,20 @@ mISDN_sock_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 	if (sk->sk_state == MISDN_CLOSED)
 		return 0;
 
+	if (flags & MSG_ERRQUEUE)
+		return sock_recv_errqueue(sk, msg, len, SOL_MISDN,
+					  MISDN_ZEROCOPY);
+
+	if ((_pms(sk)->cmask & MISDN_BATCH) && !(flags & MSG_PEEK))
+		return mISDN_sock_recvbatch(sk, msg, len, flags);
+
 	skb = skb_recv_datagram(sk, flags, flags & MSG_DONTWAIT, &err);
 	if (!skb)
 		return err;
 
-	if (msg->msg_name) {
-		DECLARE_SOCKADDR(struct sockaddr_mISDN *, maddr, msg->msg_name);
-
-		maddr->family = AF_ISDN;
-		maddr->dev = _pms(sk)->dev->id;
-		if ((sk->sk_protocol == ISDN_P_LAPD_TE) ||
-		    (sk->sk_protocol == ISDN_P_LAPD_NT)) {
-			maddr->channel = (mISDN_HEAD_ID(skb) >> 16) & 0xff;
-			maddr->tei =  (mISDN_HEAD_ID(skb) >> 8) & 0xff;
-			maddr->sapi = mISDN_HEAD_ID(skb) & 0xff;
-		} else {
-			maddr->channel = _pms(sk)->ch.nr;
-			maddr->sapi = _pms(sk)->ch.addr & 0xFF;
-			maddr->tei =  (_pms(sk)->ch.addr >> 8) & 0xFF;
-		}
-		msg->msg_namelen = sizeof(*maddr);
-	}
+	mISDN_sock_name(sk, msg, skb);
+	trace_misdn_sock_recv(&_pms(sk)->ch, _pms(sk)->ch.nr, skb->len,
+			      skb_queue_len(&sk->sk_receive_queue));
 
 	copied = skb->len + MISDN_HEADER_LEN;
 	if (len < copied) {
@@ -163,18 +698,150 @@ mISDN_sock_recvmsg(struct socket *sock, struct msghdr *msg, size_t len,
 			skb_queue_head(&sk->sk_receive_queue, skb);
 		return -ENOSPC;
 	}
-	memcpy(skb_push(skb, MISDN_HEADER_LEN), mISDN_HEAD_P(skb),
-	       MISDN_HEADER_LEN);
-
-	err = skb_copy_datagram_msg(skb, 0, msg, copied);
+	/* the data may be shared with other sockets, it is not changed */
+	err = memcpy_to_msg(msg, mISDN_HEAD_P(skb), MISDN_HEADER_LEN);
+	if (!err)
+		err = skb_copy_datagram_msg(skb, 0, msg, skb->len);
 
 	mISDN_sock_cmsg(sk, msg, skb);
 
 	skb_free_datagram(sk, skb);
+	if (!(flags & MSG_PEEK))
+		mISDN_sock_rx_resume(sk);
 
 	return err ? : copied;
 }
 
+static inline u_int
+mISDN_sock_sendid(struct sock *sk, struct msghdr *msg, u_int id)
+{
+	if (msg->msg_namelen >= sizeof(struct sockaddr_mISDN)) {
+		/* if we have a address, we use it */
+		DECLARE_SOCKADDR(struct sockaddr_mISDN *, maddr, msg->msg_name);
+		if (_pms(sk)->trunk)
+			return (maddr->channel << 16) | (id & 0xffff);
+		return maddr->channel;
+	}
+	/* use default for L2 messages */
+	if ((sk->sk_protocol == ISDN_P_LAPD_TE) ||
+	    (sk->sk_protocol == ISDN_P_LAPD_NT))
+		return _pms(sk)->ch.nr;
+	return id;
+}
+
+/*
+ * MISDN_BATCH: send all frames of the message. If a frame fails, the
+ * length of the frames sent before is returned, or the error for the
+ * first one.
+ */
+static int
+mISDN_sock_sendbatch(struct sock *sk, struct msghdr *msg, size_t len)
+{
+	struct mISDN_batchhead	bh;
+	struct sk_buff		*skb;
+	size_t			sent = 0, off;
+	u8			pad[3];
+	int			err = -EINVAL;
+
+	while (sent + MISDN_BATCH_HEAD_LEN <= len) {
+		if (memcpy_from_msg(&bh, msg, MISDN_BATCH_HEAD_LEN)) {
+			err = -EFAULT;
+			break;
+		}
+		if (bh.len > len - sent - MISDN_BATCH_HEAD_LEN) {
+			err = -EINVAL;
+			break;
+		}
+		skb = _l2_alloc_skb(bh.len, GFP_KERNEL);
+		if (!skb) {
+			err = -ENOMEM;
+			break;
+		}
+		if (memcpy_from_msg(skb_put(skb, bh.len), msg, bh.len)) {
+			kfree_skb(skb);
+			err = -EFAULT;
+			break;
+		}
+		mISDN_HEAD_PRIM(skb) = bh.prim;
+		mISDN_HEAD_ID(skb) = mISDN_sock_sendid(sk, msg, bh.id);
+		err = mISDN_sock_xmit(sk, skb);
+		if (err) {
+			kfree_skb(skb);
+			break;
+		}
+		sent += MISDN_BATCH_HEAD_LEN + bh.len;
+		off = MISDN_BATCH_ALIGN(sent) - sent;
+		if (off && sent + off <= len) {
+			if (memcpy_from_msg(pad, msg, off)) {
+				err = -EFAULT;
+				break;
+			}
+			sent += off;
+		}
+	}
+	return sent ? sent : err;
+}
+
+/*
+ * MSG_ZEROCOPY: the user pages of a PH_DATA_REQ are attached to the skb, if
+ * the hardware channel below reads page frags. all others get a copy. the
+ * completion is queued to the error queue, when the driver freed the frame.
+ */
+static int
+mISDN_sock_sendzc(struct sock *sk, struct msghdr *msg, size_t len)
+{
+	struct mISDNchannel	*peer = _pms(sk)->ch.peer;
+	struct ubuf_info	*uarg;
+	struct mISDNhead	hh;
+	struct sk_buff		*skb;
+	int			err;
+
+	uarg = sock_zerocopy_alloc(sk, len);
+	if (!uarg)
+		return -ENOBUFS;
+	if (memcpy_from_msg(&hh, msg, MISDN_HEADER_LEN)) {
+		err = -EFAULT;
+		goto abort;
+	}
+	len -= MISDN_HEADER_LEN;
+	if (hh.prim != PH_DATA_REQ || !peer ||
+	    !test_bit(OPTION_TX_SG, &peer->opt))
+		uarg->zerocopy = 0;
+
+	skb = sock_alloc_send_skb(sk, uarg->zerocopy ? 0 : len,
+				  msg->msg_flags & MSG_DONTWAIT, &err);
+	if (!skb)
+		goto abort;
+	if (uarg->zerocopy) {
+		err = skb_zerocopy_iter_stream(sk, skb, msg, len, uarg);
+		/* more pages than MAX_SKB_FRAGS */
+		if (err >= 0 && err < len)
+			err = -EMSGSIZE;
+	} else if (memcpy_from_msg(skb_put(skb, len), msg, len)) {
+		err = -EFAULT;
+	} else {
+		skb_zcopy_set(skb, uarg);
+		err = 0;
+	}
+	if (err < 0)
+		goto free;
+
+	memcpy(mISDN_HEAD_P(skb), &hh, MISDN_HEADER_LEN);
+	mISDN_HEAD_ID(skb) = mISDN_sock_sendid(sk, msg, hh.id);
+
+	err = mISDN_sock_xmit(sk, skb);
+	if (err)
+		goto free;
+	sock_zerocopy_put(uarg);
+	return len + MISDN_HEADER_LEN;
+
+free:
+	kfree_skb(skb);
+abort:
+	sock_zerocopy_put_abort(uarg);
+	return err;
+}
+
 static int
 mISDN_sock_sendmsg(struct socket *sock, struct msghdr *msg, size_t len)
 {
@@ -190,17 +857,38 @@ mISDN_sock_sendmsg(struct socket *sock, struct msghdr *msg, size_t len)
 	if (msg->msg_flags & MSG_OOB)
 		return -EOPNOTSUPP;
 
-	if (msg->msg_flags & ~(MSG_DONTWAIT | MSG_NOSIGNAL | MSG_ERRQUEUE))
-		return -EINVAL;
-
-	if (len < MISDN_HEADER_LEN)
+	if (msg->msg_flags & ~(MSG_DONTWAIT | MSG_NOSIGNAL | MSG_ERRQUEUE |
+			       MSG_ZEROCOPY))
 		return -EINVAL;
 
 	if (sk->sk_state != MISDN_BOUND)
 		return -EBADFD;
 
+	if (!len && _pms(sk)->ring) {
+		lock_sock(sk);
+		err = mISDN_ring_tx(sk, _pms(sk)->ring);
+		release_sock(sk);
+		return err;
+	}
+
+	if (len < MISDN_HEADER_LEN)
+		return -EINVAL;
+
 	lock_sock(sk);
 
+	if (_pms(sk)->cmask & MISDN_BATCH) {
+		err = mISDN_sock_sendbatch(sk, msg, len);
+		release_sock(sk);
+		return err;
+	}
+
+	if ((msg->msg_flags & MSG_ZEROCOPY) &&
+	    (_pms(sk)->cmask & MISDN_ZEROCOPY) && len > MISDN_HEADER_LEN) {
+		err = mISDN_sock_sendzc(sk, msg, len);
+		release_sock(sk);
+		return err;
+	}
+
 	skb = _l2_alloc_skb(len, GFP_KERNEL);
 	if (!skb)
 		goto done;
@@ -213,24 +901,13 @@ mISDN_sock_sendmsg(struct socket *sock, struct msghdr *msg, size_t len)
 	memcpy(mISDN_HEAD_P(skb), skb->data, MISDN_HEADER_LEN);
 	skb_pull(skb, MISDN_HEADER_LEN);
 
-	if (msg->msg_namelen >= sizeof(struct sockaddr_mISDN)) {
-		/* if we have a address, we use it */
-		DECLARE_SOCKADDR(struct sockaddr_mISDN *, maddr, msg->msg_name);
-		mISDN_HEAD_ID(skb) = maddr->channel;
-	} else { /* use default for L2 messages */
-		if ((sk->sk_protocol == ISDN_P_LAPD_TE) ||
-		    (sk->sk_protocol == ISDN_P_LAPD_NT))
-			mISDN_HEAD_ID(skb) = _pms(sk)->ch.nr;
-	}
+	mISDN_HEAD_ID(skb) = mISDN_sock_sendid(sk, msg, mISDN_HEAD_ID(skb));
 
 	if (*debug & DEBUG_SOCKET)
 		printk(KERN_DEBUG "%s: ID:%x\n",
 		       __func__, mISDN_HEAD_ID(skb));
 
-	err = -ENODEV;
-	if (!_pms(sk)->ch.peer)
-		goto done;
-	err = _pms(sk)->ch.recv(_pms(sk)->ch.peer, skb);
+	err = mISDN_sock_xmit(sk, skb);
 	if (err)
 		goto done;
 	else {
@@ -272,7 +949,21 @@ data_sock_release(struct socket *sock)
 	case ISDN_P_B_L2DTMF:
 	case ISDN_P_B_L2DSP:
 	case ISDN_P_B_L2DSPHDLC:
+		/* the rx work looks at the peer with the socket lock */
+		lock_sock(sk);
 		delete_channel(&_pms(sk)->ch);
+		release_sock(sk);
+		/* the peer is gone, mISDN_send cannot schedule it anymore */
+		cancel_work_sync(&_pms(sk)->rx_work);
+		mISDN_sock_unlink(&data_sockets, sk);
+		break;
+	case ISDN_P_TRUNK:
+		if (_pms(sk)->trunk) {
+			mISDN_trunk_close(_pms(sk)->trunk);
+			kfree(_pms(sk)->trunk);
+			_pms(sk)->trunk = NULL;
+		}
+		cancel_work_sync(&_pms(sk)->rx_work);
 		mISDN_sock_unlink(&data_sockets, sk);
 		break;
 	}
@@ -281,6 +972,13 @@ data_sock_release(struct socket *sock)
 
 	sock_orphan(sk);
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
+	/* no mapping is left, it holds a reference to the file */
+	mISDN_ring_free(sk);
+	if (_pms(sk)->cmask & MISDN_RX_STAMP) {
+		_pms(sk)->cmask &= ~MISDN_RX_STAMP;
+		static_branch_dec(&mISDN_rxstamp_key);
+	}
 
 	release_sock(sk);
 	sock_put(sk);
@@ -306,7 +1004,8 @@ data_sock_ioctl_bound(struct sock *sk, unsigned int cmd, void __user *p)
 			err = -EFAULT;
 			break;
 		}
-		if ((sk->sk_protocol & ~ISDN_P_B_MASK) == ISDN_P_B_START) {
+		if (((sk->sk_protocol & ~ISDN_P_B_MASK) == ISDN_P_B_START) ||
+		    (sk->sk_protocol == ISDN_P_TRUNK)) {
 			list_for_each_entry_safe(bchan, next,
 						 &_pms(sk)->dev->bchannels, list) {
 				if (bchan->nr == cq.channel) {
@@ -337,6 +1036,7 @@ data_sock_ioctl_bound(struct sock *sk, unsigned int cmd, void __user *p)
 						  CONTROL_CHANNEL, val);
 		break;
 	case IMHOLD_L1:
+	case IMWINDOW_L2:
 		if (sk->sk_protocol != ISDN_P_LAPD_NT
 		    && sk->sk_protocol != ISDN_P_LAPD_TE) {
 			err = -EINVAL;
@@ -417,6 +1117,9 @@ static int data_sock_setsockopt(struct socket *sock, int level, int optname,
 				char __user *optval, unsigned int len)
 {
 	struct sock *sk = sock->sk;
+	struct mISDN_ring_req req;
+	struct mISDN_trunk_req treq;
+	struct mISDN_trunk *tr;
 	int err = 0, opt = 0;
 
 	if (*debug & DEBUG_SOCKET)
@@ -437,6 +1140,88 @@ static int data_sock_setsockopt(struct socket *sock, int level, int optname,
 		else
 			_pms(sk)->cmask &= ~MISDN_TIME_STAMP;
 		break;
+	case MISDN_BATCH:
+		if (get_user(opt, (int __user *)optval)) {
+			err = -EFAULT;
+			break;
+		}
+
+		if (opt)
+			_pms(sk)->cmask |= MISDN_BATCH;
+		else
+			_pms(sk)->cmask &= ~MISDN_BATCH;
+		break;
+	case MISDN_RX_STAMP:
+		if (get_user(opt, (int __user *)optval)) {
+			err = -EFAULT;
+			break;
+		}
+
+		/* the drivers only stamp while a socket wants it */
+		if (opt && !(_pms(sk)->cmask & MISDN_RX_STAMP)) {
+			_pms(sk)->cmask |= MISDN_RX_STAMP;
+			static_branch_inc(&mISDN_rxstamp_key);
+		} else if (!opt && (_pms(sk)->cmask & MISDN_RX_STAMP)) {
+			_pms(sk)->cmask &= ~MISDN_RX_STAMP;
+			static_branch_dec(&mISDN_rxstamp_key);
+		}
+		break;
+	case MISDN_ZEROCOPY:
+		if (get_user(opt, (int __user *)optval)) {
+			err = -EFAULT;
+			break;
+		}
+
+		/*
+		 * B-channel sockets only: the frames of D-channel and LAPD
+		 * sockets need L2 headroom, which page fragments do not have
+		 */
+		if (opt &&
+		    (sk->sk_protocol & ~ISDN_P_B_MASK) != ISDN_P_B_START) {
+			err = -EOPNOTSUPP;
+			break;
+		}
+		if (opt) {
+			_pms(sk)->cmask |= MISDN_ZEROCOPY;
+			sock_set_flag(sk, SOCK_ZEROCOPY);
+		} else {
+			_pms(sk)->cmask &= ~MISDN_ZEROCOPY;
+			sock_reset_flag(sk, SOCK_ZEROCOPY);
+		}
+		break;
+	case MISDN_RING:
+		if (len < sizeof(req)) {
+			err = -EINVAL;
+			break;
+		}
+		if (copy_from_user(&req, optval, sizeof(req))) {
+			err = -EFAULT;
+			break;
+		}
+		err = mISDN_ring_create(sk, &req);
+		break;
+	case MISDN_TRUNK:
+		if (sk->sk_protocol != ISDN_P_TRUNK || len < sizeof(treq) ||
+		    sk->sk_state == MISDN_BOUND) {
+			err = -EINVAL;
+			break;
+		}
+		if (copy_from_user(&treq, optval, sizeof(treq))) {
+			err = -EFAULT;
+			break;
+		}
+		if ((treq.protocol & ~ISDN_P_B_MASK) != ISDN_P_B_START) {
+			err = -EPROTONOSUPPORT;
+			break;
+		}
+		tr = mISDN_trunk_get(_pms(sk));
+		if (!tr) {
+			err = -ENOMEM;
+			break;
+		}
+		tr->protocol = treq.protocol;
+		memcpy(tr->channelmap, treq.channelmap, sizeof(tr->channelmap));
+		break;
 	default:
 		err = -ENOPROTOOPT;
 		break;
@@ -445,6 +1230,50 @@ static int data_sock_setsockopt(struct socket *sock, int level, int optname,
 	return err;
 }
 
+static int
+data_sock_mmap(struct file *file, struct socket *sock,
+	       struct vm_area_struct *vma)
+{
+	struct sock *sk = sock->sk;
+	struct mISDN_sock_ring *r;
+	int err = -EINVAL;
+
+	lock_sock(sk);
+	r = _pms(sk)->ring;
+	if (r && !vma->vm_pgoff)
+		err = remap_vmalloc_range(vma, r->hdr, 0);
+	release_sock(sk);
+	return err;
+}
+
+static unsigned int
+data_sock_poll(struct file *file, struct socket *sock, poll_table *wait)
+{
+	struct sock *sk = sock->sk;
+	struct mISDN_sock_ring *r = smp_load_acquire(&_pms(sk)->ring);
+	struct mISDN_ring_frame *f;
+	unsigned int mask;
+	u_int nr;
+
+	mask = datagram_poll(file, sock, wait);
+	if (!r)
+		return mask;
+	/* the last frame given to the user is not back yet */
+	nr = READ_ONCE(r->rx_head);
+	nr = (nr ? nr : r->rx_frames) - 1;
+	f = ring_frame(r, r->rx_offset, nr);
+	if (READ_ONCE(f->status) == MISDN_RING_USER)
+		mask |= POLLIN | POLLRDNORM;
+	/* and there is a free tx frame */
+	if (r->tx_frames) {
+		mask &= ~(POLLOUT | POLLWRNORM | POLLWRBAND);
+		f = ring_frame(r, r->tx_offset, READ_ONCE(r->tx_head));
+		if (READ_ONCE(f->status) == MISDN_RING_KERNEL)
+			mask |= POLLOUT | POLLWRNORM;
+	}
+	return mask;
+}
+
 static int data_sock_getsockopt(struct socket *sock, int level, int optname,
 				char __user *optval, int __user *optlen)
 {
@@ -464,6 +1293,14 @@ static int data_sock_getsockopt(struct socket *sock, int level, int optname,
 		else
 			opt = 0;
 
+		if (put_user(opt, optval))
+			return -EFAULT;
+		break;
+	case MISDN_BATCH:
+	case MISDN_RX_STAMP:
+	case MISDN_ZEROCOPY:
+		opt = (_pms(sk)->cmask & optname) ? 1 : 0;
+
 		if (put_user(opt, optval))
 			return -EFAULT;
 		break;
@@ -548,6 +1385,9 @@ data_sock_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 		err = connect_Bstack(_pms(sk)->dev, &_pms(sk)->ch,
 				     sk->sk_protocol, maddr);
 		break;
+	case ISDN_P_TRUNK:
+		err = mISDN_trunk_bind(_pms(sk), maddr);
+		break;
 	default:
 		err = -EPROTONOSUPPORT;
 	}
@@ -592,7 +1432,7 @@ static const struct proto_ops data_sock_ops = {
 	.getname	= data_sock_getname,
 	.sendmsg	= mISDN_sock_sendmsg,
 	.recvmsg	= mISDN_sock_recvmsg,
-	.poll		= datagram_poll,
+	.poll		= data_sock_poll,
 	.listen		= sock_no_listen,
 	.shutdown	= sock_no_shutdown,
 	.setsockopt	= data_sock_setsockopt,
@@ -600,7 +1440,7 @@ static const struct proto_ops data_sock_ops = {
 	.connect	= sock_no_connect,
 	.socketpair	= sock_no_socketpair,
 	.accept		= sock_no_accept,
-	.mmap		= sock_no_mmap
+	.mmap		= data_sock_mmap
 };
 
 static int
@@ -623,6 +1463,7 @@ data_sock_create(struct net *net, struct socket *sock, int protocol, int kern)
 
 	sk->sk_protocol = protocol;
 	sk->sk_state    = MISDN_OPEN;
+	INIT_WORK(&_pms(sk)->rx_work, mISDN_sock_rx_work);
 	mISDN_sock_link(&data_sockets, sk);
 
 	return 0;
@@ -805,6 +1646,7 @@ mISDN_sock_create(struct net *net, struct socket *sock, int proto, int kern)
 	case ISDN_P_B_L2DTMF:
 	case ISDN_P_B_L2DSP:
 	case ISDN_P_B_L2DSPHDLC:
+	case ISDN_P_TRUNK:
 		err = data_sock_create(net, sock, proto, kern);
 		break;
 	default:
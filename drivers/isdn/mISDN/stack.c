@@ -16,16 +16,151 @@
  */
 
 #include <linux/slab.h>
+#include <linux/module.h>
 #include <linux/mISDNif.h>
 #include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
 #include <linux/sched.h>
 #include <linux/sched/cputime.h>
 #include <linux/signal.h>
+#include <linux/srcu.h>
 
 #include "core.h"
+#include "fsm.h"
 
 static u_int	*debug;
 
+/*
+ * st->l2ids and st->l2cache are read without lmutex for each message. The
+ * send function of the TEI manager may sleep, so the readers use SRCU. A
+ * layer2 is only closed after them, see del_layer2 and free_layer2_rcu.
+ */
+static struct srcu_struct	layer2_srcu;
+
+/*
+ * By default every stack has its own mISDNStackd thread. Stacks with
+ * mISDN_STACK_WORKERS set are served by the per cpu workers of a shared
+ * workqueue instead. The work of a stack takes all queued messages at once
+ * and runs on the cpu that queued them, or on the cpu set for the stack.
+ * New stacks use the mode given by stack_workers, it can be changed for
+ * each device in sysfs.
+ */
+static int	stack_workers;
+module_param(stack_workers, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(stack_workers, "serve new stacks by shared per cpu workers");
+
+/*
+ * The FSM timers of layer2 and the TEI manager are kept on a timer wheel of
+ * the stack and run by the stack thread or work, all timers expired in one
+ * tick as one batch and in order with the messages of the stack.
+ */
+static int	stack_timers = 1;
+module_param(stack_timers, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(stack_timers, "run the layer2 timers of new stacks by the "
+		 "stack (0 = own kernel timers)");
+
+static struct workqueue_struct	*mISDN_wq;
+static DEFINE_MUTEX(stack_mode_lock); /* protects mode and cpu changes */
+
+/*
+ * Direct dispatch: a PH_DATA_REQ for layer 1 is sent to the driver by the
+ * caller, if nothing else is queued for the stack. This saves the wakeup of
+ * the stack thread for each frame of layer 2 and of the layer 1 sockets.
+ * Only the driver's D-channel send is called, which takes the hardware lock
+ * with interrupts off, so any context is fine. Frames for layer 2 take the
+ * mutex of the layer 2 list and stay on the queue.
+ *
+ * While the stack thread or the work sends a burst, it owns the dispatch,
+ * other contexts queue their frames behind it. A frame sent by the owner
+ * itself goes directly, if it is the last of its burst. The owner may sleep
+ * in layer 2 and a direct sender may be preempted, so the thread or the
+ * work sleeps until the dispatch is free, it never spins for it.
+ */
+#define MISDN_DIRECT_PH_DATA	0x1
+
+static u_int	direct_dispatch;
+module_param(direct_dispatch, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(direct_dispatch, "send frames of these classes without "
+		 "the stack queue (1 = PH_DATA_REQ)");
+
+static inline int send_msg_to_layer(struct mISDNstack *, struct sk_buff *);
+
+static inline void
+dispatch_unlock(struct mISDNstack *st)
+{
+	clear_bit_unlock(mISDN_STACK_DISPATCH, &st->status);
+	smp_mb__after_atomic();
+	wake_up_bit(&st->status, mISDN_STACK_DISPATCH);
+}
+
+static inline void
+stack_own(struct mISDNstack *st, struct sk_buff_head *burst)
+{
+	wait_on_bit_lock(&st->status, mISDN_STACK_DISPATCH,
+			 TASK_UNINTERRUPTIBLE);
+	st->owner = current;
+	st->burst = burst;
+}
+
+static inline void
+stack_release(struct mISDNstack *st)
+{
+	st->owner = NULL;
+	st->burst = NULL;
+	dispatch_unlock(st);
+}
+
+static bool
+dispatch_direct(struct mISDNstack *st, struct sk_buff *skb)
+{
+	bool	nested = false;
+	int	err;
+
+	if (unlikely(test_bit(mISDN_STACK_STOPPED, &st->status)) ||
+	    !skb_queue_empty(&st->msgq))
+		return false;
+	if (test_and_set_bit_lock(mISDN_STACK_DISPATCH, &st->status)) {
+		/* sent by the owner while it sends the last of its burst */
+		if (in_interrupt() || READ_ONCE(st->owner) != current ||
+		    !skb_queue_empty(st->burst))
+			return false;
+		nested = true;
+	}
+	if (!skb_queue_empty(&st->msgq)) {
+		if (!nested)
+			dispatch_unlock(st);
+		return false;
+	}
+	err = send_msg_to_layer(st, skb);
+	if (!nested)
+		dispatch_unlock(st);
+	if (unlikely(err)) {
+		if (*debug & DEBUG_SEND_ERR)
+			printk(KERN_DEBUG "%s: %s prim(%x) id(%x) "
+			       "send call(%d)\n", __func__,
+			       dev_name(&st->dev->dev), mISDN_HEAD_PRIM(skb),
+			       mISDN_HEAD_ID(skb), err);
+		dev_kfree_skb(skb);
+		this_cpu_inc(st->stats->errors);
+	}
+	this_cpu_inc(st->stats->direct);
+	return true;
+}
+
+static inline void
+queue_stack_work(struct mISDNstack *st)
+{
+	int	cpu = READ_ONCE(st->cpu);
+
+	if (cpu >= 0 && cpu_online(cpu))
+		queue_work_on(cpu, mISDN_wq, &st->work);
+	else
+		queue_work(mISDN_wq, &st->work);
+}
+
 static inline void
 _queue_message(struct mISDNstack *st, struct sk_buff *skb)
 {
@@ -34,8 +169,15 @@ _queue_message(struct mISDNstack *st, struct sk_buff *skb)
 	if (*debug & DEBUG_QUEUE_FUNC)
 		printk(KERN_DEBUG "%s prim(%x) id(%x) %p\n",
 		       __func__, hh->prim, hh->id, skb);
+	if ((direct_dispatch & MISDN_DIRECT_PH_DATA) &&
+	    hh->prim == PH_DATA_REQ && dispatch_direct(st, skb))
+		return;
 	skb_queue_tail(&st->msgq, skb);
 	if (likely(!test_bit(mISDN_STACK_STOPPED, &st->status))) {
+		if (test_bit(mISDN_STACK_WORKERS, &st->status)) {
+			queue_stack_work(st);
+			return;
+		}
 		test_and_set_bit(mISDN_STACK_WORK, &st->status);
 		wake_up_interruptible(&st->workq);
 	}
@@ -48,44 +190,90 @@ mISDN_queue_message(struct mISDNchannel *ch, struct sk_buff *skb)
 	return 0;
 }
 
+/* called under srcu_read_lock(&layer2_srcu) or with lmutex held */
 static struct mISDNchannel *
 get_channel4id(struct mISDNstack *st, u_int id)
 {
+	if (id >= MISDN_L2_IDS)
+		return NULL;
+	return srcu_dereference_check(st->l2ids[id], &layer2_srcu,
+				      lockdep_is_held(&st->lmutex));
+}
+
+static int
+send_channel4id(struct mISDNstack *st, struct sk_buff *skb)
+{
+	struct mISDNhead	*hh = mISDN_HEAD_P(skb);
 	struct mISDNchannel	*ch;
+	int			idx, ret = -ESRCH;
 
-	mutex_lock(&st->lmutex);
-	list_for_each_entry(ch, &st->layer2, list) {
-		if (id == ch->nr)
-			goto unlock;
-	}
-	ch = NULL;
-unlock:
-	mutex_unlock(&st->lmutex);
-	return ch;
+	idx = srcu_read_lock(&layer2_srcu);
+	ch = get_channel4id(st, hh->id);
+	if (ch)
+		ret = ch->send(ch, skb);
+	srcu_read_unlock(&layer2_srcu, idx);
+	if (!ch)
+		printk(KERN_WARNING "%s: dev(%s) prim(%x) id(%x) no channel\n",
+		       __func__, dev_name(&st->dev->dev), hh->prim, hh->id);
+	return ret;
 }
 
+/*
+ * the sockets only read the frame, so each gets a clone sharing its data.
+ * whoever writes to the frame later must not do so while it is cloned.
+ * frames a socket cannot take are counted in sk_drops (SO_RXQ_OVFL).
+ */
 static void
 send_socklist(struct mISDN_sock_list *sl, struct sk_buff *skb)
 {
 	struct sock		*sk;
-	struct sk_buff		*cskb = NULL;
+	struct sk_buff		*cskb;
 
 	read_lock(&sl->lock);
 	sk_for_each(sk, &sl->head) {
 		if (sk->sk_state != MISDN_BOUND)
 			continue;
-		if (!cskb)
-			cskb = skb_copy(skb, GFP_ATOMIC);
+		cskb = skb_clone(skb, GFP_ATOMIC);
 		if (!cskb) {
-			printk(KERN_WARNING "%s no skb\n", __func__);
-			break;
+			atomic_inc(&sk->sk_drops);
+			continue;
 		}
-		if (!sock_queue_rcv_skb(sk, cskb))
-			cskb = NULL;
+		if (sock_queue_rcv_skb(sk, cskb))
+			kfree_skb(cskb);
 	}
 	read_unlock(&sl->lock);
-	if (cskb)
-		dev_kfree_skb(cskb);
+}
+
+/* collision free for the TEIs of one SAPI */
+static inline u_int
+l2cache_hash(u_int addr)
+{
+	return ((addr >> 8) ^ (addr << 3)) & (MISDN_L2_CACHE - 1);
+}
+
+/*
+ * the address of a layer2 changes with TEI assignment, so the cache is not
+ * updated then, but the entry is checked against ch->addr on each lookup.
+ * the cache is only filled here, with lmutex held, so it never gets a
+ * layer2 back, which __del_layer2 has already removed.
+ */
+static struct mISDNchannel *
+find_layer2(struct mISDNstack *st, u_int addr)
+{
+	struct mISDNchannel	*ch;
+	u_int			h = l2cache_hash(addr);
+
+	ch = rcu_dereference_protected(st->l2cache[h],
+				       lockdep_is_held(&st->lmutex));
+	if (ch && ch->addr == addr)
+		return ch;
+	list_for_each_entry(ch, &st->layer2, list) {
+		if (addr == ch->addr) {
+			rcu_assign_pointer(st->l2cache[h], ch);
+			return ch;
+		}
+	}
+	return NULL;
 }
 
 static void
@@ -94,12 +282,27 @@ send_layer2(struct mISDNstack *st, struct sk_buff *skb)
 	struct sk_buff		*cskb;
 	struct mISDNhead	*hh = mISDN_HEAD_P(skb);
 	struct mISDNchannel	*ch;
-	int			ret;
+	u_int			addr = hh->id & MISDN_ID_ADDR_MASK;
+	int			idx, ret;
 
 	if (!st)
 		return;
+	if (addr != MISDN_ID_ANY) {
+		/* a cache hit needs no lmutex */
+		idx = srcu_read_lock(&layer2_srcu);
+		ch = srcu_dereference(st->l2cache[l2cache_hash(addr)],
+				      &layer2_srcu);
+		if (ch && ch->addr == addr) {
+			ret = ch->send(ch, skb);
+			srcu_read_unlock(&layer2_srcu, idx);
+			if (ret)
+				dev_kfree_skb(skb);
+			return;
+		}
+		srcu_read_unlock(&layer2_srcu, idx);
+	}
 	mutex_lock(&st->lmutex);
-	if ((hh->id & MISDN_ID_ADDR_MASK) == MISDN_ID_ANY) { /* L2 for all */
+	if (addr == MISDN_ID_ANY) { /* L2 for all */
 		list_for_each_entry(ch, &st->layer2, list) {
 			if (list_is_last(&ch->list, &st->layer2)) {
 				cskb = skb;
@@ -125,13 +328,12 @@ send_layer2(struct mISDNstack *st, struct sk_buff *skb)
 			}
 		}
 	} else {
-		list_for_each_entry(ch, &st->layer2, list) {
-			if ((hh->id & MISDN_ID_ADDR_MASK) == ch->addr) {
-				ret = ch->send(ch, skb);
-				if (!ret)
-					skb = NULL;
-				goto out;
-			}
+		ch = find_layer2(st, addr);
+		if (ch) {
+			ret = ch->send(ch, skb);
+			if (!ret)
+				skb = NULL;
+			goto out;
 		}
 		ret = st->dev->teimgr->ctrl(st->dev->teimgr, CHECK_DATA, skb);
 		if (!ret)
@@ -151,7 +353,6 @@ static inline int
 send_msg_to_layer(struct mISDNstack *st, struct sk_buff *skb)
 {
 	struct mISDNhead	*hh = mISDN_HEAD_P(skb);
-	struct mISDNchannel	*ch;
 	int	lm;
 
 	lm = hh->prim & MISDN_LAYERMASK;
@@ -170,24 +371,10 @@ send_msg_to_layer(struct mISDNstack *st, struct sk_buff *skb)
 		send_layer2(st, skb);
 		return 0;
 	} else if (lm == 0x4) {
-		ch = get_channel4id(st, hh->id);
-		if (ch)
-			return ch->send(ch, skb);
-		else
-			printk(KERN_WARNING
-			       "%s: dev(%s) prim(%x) id(%x) no channel\n",
-			       __func__, dev_name(&st->dev->dev), hh->prim,
-			       hh->id);
+		return send_channel4id(st, skb);
 	} else if (lm == 0x8) {
 		WARN_ON(lm == 0x8);
-		ch = get_channel4id(st, hh->id);
-		if (ch)
-			return ch->send(ch, skb);
-		else
-			printk(KERN_WARNING
-			       "%s: dev(%s) prim(%x) id(%x) no channel\n",
-			       __func__, dev_name(&st->dev->dev), hh->prim,
-			       hh->id);
+		return send_channel4id(st, skb);
 	} else {
 		/* broadcast not handled yet */
 		printk(KERN_WARNING "%s: dev(%s) prim %x not delivered\n",
@@ -201,14 +388,101 @@ do_clear_stack(struct mISDNstack *st)
 {
 }
 
+/* the counters of the stack are per cpu, so counting needs no locks */
+void
+mISDN_stack_get_stats(struct mISDNstack *st, struct mISDNstack_stats *sum)
+{
+	struct mISDNstack_stats	*s;
+	int			cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		s = per_cpu_ptr(st->stats, cpu);
+		sum->msgs += s->msgs;
+		sum->bursts += s->bursts;
+		sum->errors += s->errors;
+		sum->direct += s->direct;
+		sum->sleeps += s->sleeps;
+		sum->stopped += s->stopped;
+		if (s->max_burst > sum->max_burst)
+			sum->max_burst = s->max_burst;
+		for (i = 0; i < MISDN_STACK_TIME_BUCKETS; i++)
+			sum->burst_time[i] += s->burst_time[i];
+	}
+}
+
+/*
+ * Take all queued messages with one lock and send them to the layers. If
+ * the stack is stopped, or the workers lose the stack, the rest is put back
+ * in front of the queue and false is returned.
+ */
+static bool
+run_burst(struct mISDNstack *st, struct sk_buff_head *burst, bool workers)
+{
+	struct mISDNstack_stats	*stats;
+	struct sk_buff		*skb;
+	u_long			flags;
+	u_int			cnt = 0, errors = 0;
+	bool			done = true;
+	int			err, t;
+	u64			start;
+
+	stack_own(st, burst);
+	start = ktime_get_ns();
+	spin_lock_irqsave(&st->msgq.lock, flags);
+	skb_queue_splice_init(&st->msgq, burst);
+	spin_unlock_irqrestore(&st->msgq.lock, flags);
+	while ((skb = __skb_dequeue(burst))) {
+		cnt++;
+		err = send_msg_to_layer(st, skb);
+		if (unlikely(err)) {
+			if (*debug & DEBUG_SEND_ERR)
+				printk(KERN_DEBUG
+				       "%s: %s prim(%x) id(%x) "
+				       "send call(%d)\n",
+				       __func__, dev_name(&st->dev->dev),
+				       mISDN_HEAD_PRIM(skb),
+				       mISDN_HEAD_ID(skb), err);
+			dev_kfree_skb(skb);
+			errors++;
+		}
+		if (unlikely(test_bit(mISDN_STACK_STOPPED, &st->status) ||
+			     (workers && !test_bit(mISDN_STACK_WORKERS,
+						   &st->status)))) {
+			if (!skb_queue_empty(burst)) {
+				spin_lock_irqsave(&st->msgq.lock, flags);
+				skb_queue_splice(burst, &st->msgq);
+				spin_unlock_irqrestore(&st->msgq.lock, flags);
+				__skb_queue_head_init(burst);
+			}
+			done = false;
+			break;
+		}
+	}
+	stack_release(st);
+	if (!cnt)
+		return done;
+	t = fls(div_u64(ktime_get_ns() - start, NSEC_PER_USEC));
+	if (t >= MISDN_STACK_TIME_BUCKETS)
+		t = MISDN_STACK_TIME_BUCKETS - 1;
+	stats = get_cpu_ptr(st->stats);
+	stats->burst_time[t]++;
+	stats->msgs += cnt;
+	stats->bursts++;
+	stats->errors += errors;
+	if (cnt > stats->max_burst)
+		stats->max_burst = cnt;
+	put_cpu_ptr(st->stats);
+	return done;
+}
+
 static int
 mISDNStackd(void *data)
 {
 	struct mISDNstack *st = data;
-#ifdef MISDN_MSG_STATS
+	struct mISDNstack_stats stats;
+	struct sk_buff_head burst;
 	u64 utime, stime;
-#endif
-	int err = 0;
 
 	sigfillset(&current->blocked);
 	if (*debug & DEBUG_MSG_THREAD)
@@ -220,43 +494,21 @@ mISDNStackd(void *data)
 		st->notify = NULL;
 	}
 
+	__skb_queue_head_init(&burst);
 	for (;;) {
-		struct sk_buff	*skb;
-
 		if (unlikely(test_bit(mISDN_STACK_STOPPED, &st->status))) {
 			test_and_clear_bit(mISDN_STACK_WORK, &st->status);
 			test_and_clear_bit(mISDN_STACK_RUNNING, &st->status);
 		} else
 			test_and_set_bit(mISDN_STACK_RUNNING, &st->status);
-		while (test_bit(mISDN_STACK_WORK, &st->status)) {
-			skb = skb_dequeue(&st->msgq);
-			if (!skb) {
-				test_and_clear_bit(mISDN_STACK_WORK,
-						   &st->status);
-				/* test if a race happens */
-				skb = skb_dequeue(&st->msgq);
-				if (!skb)
-					continue;
-				test_and_set_bit(mISDN_STACK_WORK,
-						 &st->status);
-			}
-#ifdef MISDN_MSG_STATS
-			st->msg_cnt++;
-#endif
-			err = send_msg_to_layer(st, skb);
-			if (unlikely(err)) {
-				if (*debug & DEBUG_SEND_ERR)
-					printk(KERN_DEBUG
-					       "%s: %s prim(%x) id(%x) "
-					       "send call(%d)\n",
-					       __func__, dev_name(&st->dev->dev),
-					       mISDN_HEAD_PRIM(skb),
-					       mISDN_HEAD_ID(skb), err);
-				dev_kfree_skb(skb);
-				continue;
-			}
-			if (unlikely(test_bit(mISDN_STACK_STOPPED,
-					      &st->status))) {
+		/*
+		 * WORK is cleared before the queue is taken, a message queued
+		 * after that sets it again and gets its own burst.
+		 */
+		if (test_and_clear_bit(mISDN_STACK_TIMER, &st->status))
+			mISDN_FsmRunTimers(st->timers);
+		while (test_and_clear_bit(mISDN_STACK_WORK, &st->status)) {
+			if (!run_burst(st, &burst, false)) {
 				test_and_clear_bit(mISDN_STACK_WORK,
 						   &st->status);
 				test_and_clear_bit(mISDN_STACK_RUNNING,
@@ -284,9 +536,7 @@ mISDNStackd(void *data)
 			complete(st->notify);
 			st->notify = NULL;
 		}
-#ifdef MISDN_MSG_STATS
-		st->sleep_cnt++;
-#endif
+		this_cpu_inc(st->stats->sleeps);
 		test_and_clear_bit(mISDN_STACK_ACTIVE, &st->status);
 		wait_event_interruptible(st->workq, (st->status &
 						     mISDN_STACK_ACTION_MASK));
@@ -299,31 +549,35 @@ mISDNStackd(void *data)
 
 		if (test_bit(mISDN_STACK_STOPPED, &st->status)) {
 			test_and_clear_bit(mISDN_STACK_RUNNING, &st->status);
-#ifdef MISDN_MSG_STATS
-			st->stopped_cnt++;
-#endif
+			this_cpu_inc(st->stats->stopped);
 		}
 	}
-#ifdef MISDN_MSG_STATS
-	printk(KERN_DEBUG "mISDNStackd daemon for %s proceed %d "
-	       "msg %d sleep %d stopped\n",
-	       dev_name(&st->dev->dev), st->msg_cnt, st->sleep_cnt,
-	       st->stopped_cnt);
-	task_cputime(st->thread, &utime, &stime);
-	printk(KERN_DEBUG
-	       "mISDNStackd daemon for %s utime(%llu) stime(%llu)\n",
-	       dev_name(&st->dev->dev), utime, stime);
-	printk(KERN_DEBUG
-	       "mISDNStackd daemon for %s nvcsw(%ld) nivcsw(%ld)\n",
-	       dev_name(&st->dev->dev), st->thread->nvcsw, st->thread->nivcsw);
-	printk(KERN_DEBUG "mISDNStackd daemon for %s killed now\n",
-	       dev_name(&st->dev->dev));
-#endif
+	if (*debug & DEBUG_MSG_THREAD) {
+		mISDN_stack_get_stats(st, &stats);
+		printk(KERN_DEBUG "mISDNStackd daemon for %s proceed %llu "
+		       "msg in %llu bursts (max %u) %llu direct %llu errors "
+		       "%llu sleep %llu stopped\n",
+		       dev_name(&st->dev->dev), stats.msgs, stats.bursts,
+		       stats.max_burst, stats.direct, stats.errors,
+		       stats.sleeps, stats.stopped);
+		task_cputime(st->thread, &utime, &stime);
+		printk(KERN_DEBUG
+		       "mISDNStackd daemon for %s utime(%llu) stime(%llu)\n",
+		       dev_name(&st->dev->dev), utime, stime);
+		printk(KERN_DEBUG
+		       "mISDNStackd daemon for %s nvcsw(%ld) nivcsw(%ld)\n",
+		       dev_name(&st->dev->dev), st->thread->nvcsw,
+		       st->thread->nivcsw);
+		printk(KERN_DEBUG "mISDNStackd daemon for %s killed now\n",
+		       dev_name(&st->dev->dev));
+	}
 	test_and_set_bit(mISDN_STACK_KILLED, &st->status);
 	test_and_clear_bit(mISDN_STACK_RUNNING, &st->status);
 	test_and_clear_bit(mISDN_STACK_ACTIVE, &st->status);
 	test_and_clear_bit(mISDN_STACK_ABORT, &st->status);
-	skb_queue_purge(&st->msgq);
+	/* on a switch to the workers, they take over the queue */
+	if (!test_bit(mISDN_STACK_SWITCH, &st->status))
+		skb_queue_purge(&st->msgq);
 	st->thread = NULL;
 	if (st->notify != NULL) {
 		complete(st->notify);
@@ -332,6 +586,144 @@ mISDNStackd(void *data)
 	return 0;
 }
 
+static void
+mISDN_stack_work(struct work_struct *work)
+{
+	struct mISDNstack	*st = container_of(work, struct mISDNstack, work);
+	struct sk_buff_head	burst;
+
+	/* messages queued while this runs queue the work again */
+	__skb_queue_head_init(&burst);
+	if (test_and_clear_bit(mISDN_STACK_TIMER, &st->status))
+		mISDN_FsmRunTimers(st->timers);
+	run_burst(st, &burst, true);
+}
+
+/* called by the timer wheel, if some timers expired */
+static void
+stack_timer_kick(void *data)
+{
+	struct mISDNstack	*st = data;
+
+	test_and_set_bit(mISDN_STACK_TIMER, &st->status);
+	if (test_bit(mISDN_STACK_WORKERS, &st->status))
+		queue_stack_work(st);
+	else
+		wake_up_interruptible(&st->workq);
+}
+
+/*
+ * the cpus of the stack thread, the cpu set for the stack or, without one,
+ * the cpus of the node of the card, where its interrupts are handled
+ */
+static const struct cpumask *
+stack_cpumask(struct mISDNstack *st)
+{
+	int	node = dev_to_node(&st->dev->dev);
+
+	if (st->cpu >= 0)
+		return cpumask_of(st->cpu);
+	if (node != NUMA_NO_NODE &&
+	    cpumask_intersects(cpumask_of_node(node), cpu_online_mask))
+		return cpumask_of_node(node);
+	return cpu_possible_mask;
+}
+
+static int
+start_stack_thread(struct mISDNstack *st)
+{
+	int	err;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	test_and_clear_bit(mISDN_STACK_KILLED, &st->status);
+	if (!skb_queue_empty(&st->msgq))
+		test_and_set_bit(mISDN_STACK_WORK, &st->status);
+	st->notify = &done;
+	st->thread = kthread_create_on_node(mISDNStackd, (void *)st,
+					    dev_to_node(&st->dev->dev),
+					    "mISDN_%s",
+					    dev_name(&st->dev->dev));
+	if (IS_ERR(st->thread)) {
+		err = PTR_ERR(st->thread);
+		printk(KERN_ERR
+		       "mISDN:cannot create kernel thread for %s (%d)\n",
+		       dev_name(&st->dev->dev), err);
+		st->thread = NULL;
+		st->notify = NULL;
+		return err;
+	}
+	set_cpus_allowed_ptr(st->thread, stack_cpumask(st));
+	wake_up_process(st->thread);
+	wait_for_completion(&done);
+	return 0;
+}
+
+static void
+stop_stack_thread(struct mISDNstack *st)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	if (!st->thread)
+		return;
+	if (st->notify) {
+		printk(KERN_WARNING "%s: notifier in use\n",
+		       __func__);
+		complete(st->notify);
+	}
+	st->notify = &done;
+	test_and_set_bit(mISDN_STACK_ABORT, &st->status);
+	test_and_set_bit(mISDN_STACK_WAKEUP, &st->status);
+	wake_up_interruptible(&st->workq);
+	wait_for_completion(&done);
+}
+
+/* switch a stack between its own thread and the shared workers */
+int
+mISDN_stack_set_workers(struct mISDNstack *st, int on)
+{
+	int	err = 0;
+
+	mutex_lock(&stack_mode_lock);
+	if (on && !test_bit(mISDN_STACK_WORKERS, &st->status)) {
+		test_and_set_bit(mISDN_STACK_SWITCH, &st->status);
+		stop_stack_thread(st);
+		test_and_clear_bit(mISDN_STACK_SWITCH, &st->status);
+		test_and_set_bit(mISDN_STACK_WORKERS, &st->status);
+		smp_mb__after_atomic();
+		/* messages and timers left by the thread */
+		if (!skb_queue_empty(&st->msgq) ||
+		    test_bit(mISDN_STACK_TIMER, &st->status))
+			queue_stack_work(st);
+	} else if (!on && test_bit(mISDN_STACK_WORKERS, &st->status)) {
+		test_and_clear_bit(mISDN_STACK_WORKERS, &st->status);
+		cancel_work_sync(&st->work);
+		err = start_stack_thread(st);
+		if (err) {
+			test_and_set_bit(mISDN_STACK_WORKERS, &st->status);
+			if (!skb_queue_empty(&st->msgq) ||
+			    test_bit(mISDN_STACK_TIMER, &st->status))
+				queue_stack_work(st);
+		}
+	}
+	mutex_unlock(&stack_mode_lock);
+	return err;
+}
+
+/* bind a stack to a cpu, -1 lets it run anywhere on the node of the card */
+int
+mISDN_stack_set_cpu(struct mISDNstack *st, int cpu)
+{
+	if (cpu < -1 || cpu >= (int)nr_cpu_ids ||
+	    (cpu >= 0 && !cpu_online(cpu)))
+		return -EINVAL;
+	mutex_lock(&stack_mode_lock);
+	WRITE_ONCE(st->cpu, cpu);
+	if (st->thread)
+		set_cpus_allowed_ptr(st->thread, stack_cpumask(st));
+	mutex_unlock(&stack_mode_lock);
+	return 0;
+}
+
 static int
 l1_receive(struct mISDNchannel *ch, struct sk_buff *skb)
 {
@@ -348,10 +740,59 @@ set_channel_address(struct mISDNchannel *ch, u_int sapi, u_int tei)
 	ch->addr = sapi | (tei << 8);
 }
 
+/* the first layer2 of a channel nr is found by it, like on the list */
 void
 __add_layer2(struct mISDNchannel *ch, struct mISDNstack *st)
 {
 	list_add_tail(&ch->list, &st->layer2);
+	if (ch->nr < MISDN_L2_IDS && !rcu_access_pointer(st->l2ids[ch->nr]))
+		rcu_assign_pointer(st->l2ids[ch->nr], ch);
+}
+
+/*
+ * lmutex must be held, if the stack is running. the lockless readers may
+ * still use the channel afterwards, see del_layer2.
+ */
+void
+__del_layer2(struct mISDNchannel *ch, struct mISDNstack *st)
+{
+	struct mISDNchannel	*next = NULL, *pch;
+	int			i;
+
+	list_del(&ch->list);
+	for (i = 0; i < MISDN_L2_CACHE; i++)
+		if (rcu_access_pointer(st->l2cache[i]) == ch)
+			RCU_INIT_POINTER(st->l2cache[i], NULL);
+	if (ch->nr >= MISDN_L2_IDS ||
+	    rcu_access_pointer(st->l2ids[ch->nr]) != ch)
+		return;
+	list_for_each_entry(pch, &st->layer2, list) {
+		if (pch->nr == ch->nr) {
+			next = pch;
+			break;
+		}
+	}
+	rcu_assign_pointer(st->l2ids[ch->nr], next);
+}
+
+/* removes the layer2 and waits until no message is sent to it anymore */
+void
+del_layer2(struct mISDNchannel *ch, struct mISDNstack *st)
+{
+	mutex_lock(&st->lmutex);
+	__del_layer2(ch, st);
+	mutex_unlock(&st->lmutex);
+	synchronize_srcu(&layer2_srcu);
+}
+
+/*
+ * for a layer2 removed in the dispatch itself, which cannot wait for the
+ * readers, the memory is freed after them
+ */
+void
+free_layer2_rcu(struct rcu_head *head, rcu_callback_t func)
+{
+	call_srcu(&layer2_srcu, head, func);
 }
 
 void
@@ -375,9 +816,9 @@ create_stack(struct mISDNdevice *dev)
 {
 	struct mISDNstack	*newst;
 	int			err;
-	DECLARE_COMPLETION_ONSTACK(done);
 
-	newst = kzalloc(sizeof(struct mISDNstack), GFP_KERNEL);
+	newst = kzalloc_node(sizeof(struct mISDNstack), GFP_KERNEL,
+			     dev_to_node(&dev->dev));
 	if (!newst) {
 		printk(KERN_ERR "kmalloc mISDN_stack failed\n");
 		return -ENOMEM;
@@ -389,10 +830,29 @@ create_stack(struct mISDNdevice *dev)
 	init_waitqueue_head(&newst->workq);
 	skb_queue_head_init(&newst->msgq);
 	mutex_init(&newst->lmutex);
+	INIT_WORK(&newst->work, mISDN_stack_work);
+	newst->cpu = -1;
+	newst->stats = alloc_percpu(struct mISDNstack_stats);
+	if (!newst->stats) {
+		printk(KERN_ERR "alloc mISDN_stack stats failed\n");
+		kfree(newst);
+		return -ENOMEM;
+	}
+	if (stack_timers) {
+		newst->timers = mISDN_FsmNewTimerBase(stack_timer_kick, newst);
+		if (!newst->timers) {
+			printk(KERN_ERR "alloc mISDN_stack timers failed\n");
+			free_percpu(newst->stats);
+			kfree(newst);
+			return -ENOMEM;
+		}
+	}
 	dev->D.st = newst;
 	err = create_teimanager(dev);
 	if (err) {
 		printk(KERN_ERR "kmalloc teimanager failed\n");
+		mISDN_FsmFreeTimerBase(newst->timers);
+		free_percpu(newst->stats);
 		kfree(newst);
 		return err;
 	}
@@ -409,18 +869,17 @@ create_stack(struct mISDNdevice *dev)
 	if (*debug & DEBUG_CORE_FUNC)
 		printk(KERN_DEBUG "%s: st(%s)\n", __func__,
 		       dev_name(&newst->dev->dev));
-	newst->notify = &done;
-	newst->thread = kthread_run(mISDNStackd, (void *)newst, "mISDN_%s",
-				    dev_name(&newst->dev->dev));
-	if (IS_ERR(newst->thread)) {
-		err = PTR_ERR(newst->thread);
-		printk(KERN_ERR
-		       "mISDN:cannot create kernel thread for %s (%d)\n",
-		       dev_name(&newst->dev->dev), err);
+	if (stack_workers) {
+		test_and_set_bit(mISDN_STACK_WORKERS, &newst->status);
+		return 0;
+	}
+	err = start_stack_thread(newst);
+	if (err) {
 		delete_teimanager(dev->teimgr);
+		mISDN_FsmFreeTimerBase(newst->timers);
+		free_percpu(newst->stats);
 		kfree(newst);
-	} else
-		wait_for_completion(&done);
+	}
 	return err;
 }
 
@@ -496,6 +955,7 @@ connect_Bstack(struct mISDNdevice *dev, struct mISDNchannel *ch,
 		rq2.adr = *adr;
 		rq2.ch = ch;
 		err = bp->create(&rq2);
+		put_Bprotocol(bp);
 		if (err)
 			return err;
 		ch->recv = rq2.ch->send;
@@ -599,11 +1059,11 @@ delete_channel(struct mISDNchannel *ch)
 		ch->st->dev->D.ctrl(&ch->st->dev->D, CLOSE_CHANNEL, NULL);
 		break;
 	case ISDN_P_LAPD_TE:
+		mutex_lock(&ch->st->lmutex);
 		pch = get_channel4id(ch->st, ch->nr);
+		mutex_unlock(&ch->st->lmutex);
 		if (pch) {
-			mutex_lock(&ch->st->lmutex);
-			list_del(&pch->list);
-			mutex_unlock(&ch->st->lmutex);
+			del_layer2(pch, ch->st);
 			pch->ctrl(pch, CLOSE_CHANNEL, NULL);
 			pch = ch->st->dev->teimgr;
 			pch->ctrl(pch, CLOSE_CHANNEL, NULL);
@@ -629,36 +1089,53 @@ void
 delete_stack(struct mISDNdevice *dev)
 {
 	struct mISDNstack	*st = dev->D.st;
-	DECLARE_COMPLETION_ONSTACK(done);
 
 	if (*debug & DEBUG_CORE_FUNC)
 		printk(KERN_DEBUG "%s: st(%s)\n", __func__,
 		       dev_name(&st->dev->dev));
 	if (dev->teimgr)
 		delete_teimanager(dev->teimgr);
-	if (st->thread) {
-		if (st->notify) {
-			printk(KERN_WARNING "%s: notifier in use\n",
-			       __func__);
-			complete(st->notify);
-		}
-		st->notify = &done;
-		test_and_set_bit(mISDN_STACK_ABORT, &st->status);
-		test_and_set_bit(mISDN_STACK_WAKEUP, &st->status);
-		wake_up_interruptible(&st->workq);
-		wait_for_completion(&done);
-	}
+	mutex_lock(&stack_mode_lock);
+	if (test_bit(mISDN_STACK_WORKERS, &st->status)) {
+		/* no new work after this */
+		test_and_set_bit(mISDN_STACK_STOPPED, &st->status);
+		cancel_work_sync(&st->work);
+		skb_queue_purge(&st->msgq);
+	} else
+		stop_stack_thread(st);
+	mutex_unlock(&stack_mode_lock);
 	if (!list_empty(&st->layer2))
 		printk(KERN_WARNING "%s: layer2 list not empty\n",
 		       __func__);
 	if (!hlist_empty(&st->l1sock.head))
 		printk(KERN_WARNING "%s: layer1 list not empty\n",
 		       __func__);
+	mISDN_FsmFreeTimerBase(st->timers);
+	free_percpu(st->stats);
 	kfree(st);
 }
 
-void
+int
 mISDN_initstack(u_int *dp)
 {
+	int	err;
+
 	debug = dp;
+	err = init_srcu_struct(&layer2_srcu);
+	if (err)
+		return err;
+	mISDN_wq = alloc_workqueue("mISDN_stack", WQ_HIGHPRI, 0);
+	if (!mISDN_wq) {
+		cleanup_srcu_struct(&layer2_srcu);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void
+mISDN_stack_cleanup(void)
+{
+	destroy_workqueue(mISDN_wq);
+	srcu_barrier(&layer2_srcu);
+	cleanup_srcu_struct(&layer2_srcu);
 }
@@ -271,27 +271,14 @@ get_free_id(struct manager *mgr)
 	return -EBUSY;
 }
 
+/* dynamic TEIs 64 - 126, taken in create_new_tei, free in TEIrelease */
 static int
 get_free_tei(struct manager *mgr)
 {
-	DECLARE_BITMAP(ids, 64) = { [0 ... BITS_TO_LONGS(64) - 1] = 0 };
 	int		i;
-	struct layer2	*l2;
 
-	list_for_each_entry(l2, &mgr->layer2, list) {
-		if (l2->ch.nr == 0)
-			continue;
-		if ((l2->ch.addr & 0xff) != 0)
-			continue;
-		i = l2->ch.addr >> 8;
-		if (i < 64)
-			continue;
-		i -= 64;
-
-		__set_bit(i, ids);
-	}
-	i = find_first_zero_bit(ids, 64);
-	if (i < 64)
+	i = find_first_zero_bit(mgr->teimap, MAX_DYN_TEI);
+	if (i < MAX_DYN_TEI)
 		return i + 64;
 	printk(KERN_WARNING "%s: more as 63 dynamic tei for one device\n",
 	       __func__);
@@ -425,11 +412,18 @@ findtei(struct manager *mgr, int tei)
 	struct layer2	*l2;
 	u_long		flags;
 
+	if ((tei <= 0) || (tei >= GROUP_TEI))
+		return NULL;
 	read_lock_irqsave(&mgr->lock, flags);
+	/* the tei of a layer2 may change, so the hint is checked */
+	l2 = READ_ONCE(mgr->teicache[tei]);
+	if (l2 && (l2->sapi == 0) && (l2->tei == tei))
+		goto done;
 	list_for_each_entry(l2, &mgr->layer2, list) {
-		if ((l2->sapi == 0) && (l2->tei > 0) &&
-		    (l2->tei != GROUP_TEI) && (l2->tei == tei))
+		if ((l2->sapi == 0) && (l2->tei == tei)) {
+			WRITE_ONCE(mgr->teicache[tei], l2);
 			goto done;
+		}
 	}
 	l2 = NULL;
 done:
@@ -661,7 +655,7 @@ tei_l2remove(struct layer2 *l2)
 {
 	put_tei_msg(l2->tm->mgr, ID_REMOVE, 0, l2->tei);
 	tei_l2(l2, MDL_REMOVE_REQ, 0);
-	list_del(&l2->ch.list);
+	__del_layer2(&l2->ch, l2->ch.st);
 	l2->ch.ctrl(&l2->ch, CLOSE_CHANNEL, NULL);
 }
 
@@ -807,6 +801,7 @@ create_new_tei(struct manager *mgr, int tei, int sapi)
 	} else {
 		rq.protocol = ISDN_P_NT_S0;
 	}
+	opt |= (u_long)mgr->window << OPTION_L2_WINDOW_SHIFT;
 	l2 = create_l2(mgr->up, ISDN_P_LAPD_NT, opt, tei, sapi);
 	if (!l2) {
 		printk(KERN_WARNING "%s:no memory for layer2\n", __func__);
@@ -814,6 +809,7 @@ create_new_tei(struct manager *mgr, int tei, int sapi)
 	}
 	l2->tm = kzalloc(sizeof(struct teimgr), GFP_KERNEL);
 	if (!l2->tm) {
+		kfree(l2->windowar);
 		kfree(l2);
 		printk(KERN_WARNING "%s:no memory for teimgr\n", __func__);
 		return NULL;
@@ -826,10 +822,14 @@ create_new_tei(struct manager *mgr, int tei, int sapi)
 	l2->tm->tei_m.fsm = &teifsmn;
 	l2->tm->tei_m.state = ST_TEI_NOP;
 	l2->tm->tval = 2000; /* T202  2 sec */
+	l2->tm->tei_m.timers = l2->l2m.timers;
 	mISDN_FsmInitTimer(&l2->tm->tei_m, &l2->tm->timer);
 	write_lock_irqsave(&mgr->lock, flags);
 	id = get_free_id(mgr);
 	list_add_tail(&l2->list, &mgr->layer2);
+	if ((tei >= 64) && (tei < GROUP_TEI) &&
+	    !test_and_set_bit(tei - 64, mgr->teimap))
+		l2->tm->dyn_tei = tei;
 	write_unlock_irqrestore(&mgr->lock, flags);
 	if (id < 0) {
 		l2->ch.ctrl(&l2->ch, CLOSE_CHANNEL, NULL);
@@ -979,10 +979,16 @@ TEIrelease(struct layer2 *l2)
 {
 	struct teimgr	*tm = l2->tm;
 	u_long		flags;
+	int		i;
 
 	mISDN_FsmDelTimer(&tm->timer, 1);
 	write_lock_irqsave(&tm->mgr->lock, flags);
 	list_del(&l2->list);
+	if (tm->dyn_tei)
+		clear_bit(tm->dyn_tei - 64, tm->mgr->teimap);
+	for (i = 0; i < GROUP_TEI; i++)
+		if (tm->mgr->teicache[i] == l2)
+			tm->mgr->teicache[i] = NULL;
 	write_unlock_irqrestore(&tm->mgr->lock, flags);
 	l2->tm = NULL;
 	kfree(tm);
@@ -1051,12 +1057,14 @@ create_teimgr(struct manager *mgr, struct channel_req *crq)
 		}
 		return 0;
 	}
+	opt |= (u_long)mgr->window << OPTION_L2_WINDOW_SHIFT;
 	l2 = create_l2(crq->ch, crq->protocol, opt,
 		       crq->adr.tei, crq->adr.sapi);
 	if (!l2)
 		return -ENOMEM;
 	l2->tm = kzalloc(sizeof(struct teimgr), GFP_KERNEL);
 	if (!l2->tm) {
+		kfree(l2->windowar);
 		kfree(l2);
 		printk(KERN_ERR "kmalloc teimgr failed\n");
 		return -ENOMEM;
@@ -1083,6 +1091,7 @@ create_teimgr(struct manager *mgr, struct channel_req *crq)
 		else
 			l1rq.protocol = ISDN_P_NT_S0;
 	}
+	l2->tm->tei_m.timers = l2->l2m.timers;
 	mISDN_FsmInitTimer(&l2->tm->tei_m, &l2->tm->timer);
 	write_lock_irqsave(&mgr->lock, flags);
 	id = get_free_id(mgr);
@@ -1156,9 +1165,7 @@ free_teimanager(struct manager *mgr)
 		if (test_bit(OPTION_L2_CLEANUP, &mgr->options)) {
 			list_for_each_entry_safe(l2, nl2, &mgr->layer2, list) {
 				put_tei_msg(mgr, ID_REMOVE, 0, l2->tei);
-				mutex_lock(&mgr->ch.st->lmutex);
-				list_del(&l2->ch.list);
-				mutex_unlock(&mgr->ch.st->lmutex);
+				del_layer2(&l2->ch, mgr->ch.st);
 				l2->ch.ctrl(&l2->ch, CLOSE_CHANNEL, NULL);
 			}
 			test_and_clear_bit(MGR_OPT_NETWORK, &mgr->options);
@@ -1179,7 +1186,6 @@ free_teimanager(struct manager *mgr)
 static int
 ctrl_teimanager(struct manager *mgr, void *arg)
 {
-	/* currently we only have one option */
 	int	*val = (int *)arg;
 	int	ret = 0;
 
@@ -1196,6 +1202,13 @@ ctrl_teimanager(struct manager *mgr, void *arg)
 		else
 			test_and_clear_bit(OPTION_L1_HOLD, &mgr->options);
 		break;
+	case IMWINDOW_L2:
+		/* for the links created from now on */
+		if (val[1] < 0 || val[1] > MAX_WINDOW_EXT)
+			ret = -EINVAL;
+		else
+			mgr->window = val[1];
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -1253,13 +1266,11 @@ delete_teimanager(struct mISDNchannel *ch)
 	mgr = container_of(ch, struct manager, ch);
 	/* not locked lock is taken in release tei */
 	list_for_each_entry_safe(l2, nl2, &mgr->layer2, list) {
-		mutex_lock(&mgr->ch.st->lmutex);
-		list_del(&l2->ch.list);
-		mutex_unlock(&mgr->ch.st->lmutex);
+		del_layer2(&l2->ch, mgr->ch.st);
 		l2->ch.ctrl(&l2->ch, CLOSE_CHANNEL, NULL);
 	}
-	list_del(&mgr->ch.list);
-	list_del(&mgr->bcast.list);
+	del_layer2(&mgr->ch, mgr->ch.st);
+	del_layer2(&mgr->bcast, mgr->ch.st);
 	skb_queue_purge(&mgr->sendq);
 	kfree(mgr);
 }
@@ -1380,6 +1391,7 @@ create_teimanager(struct mISDNdevice *dev)
 	mgr->deact.printdebug = da_debug;
 	mgr->deact.fsm = &deactfsm;
 	mgr->deact.state = ST_L1_DEACT;
+	mgr->deact.timers = dev->D.st->timers;
 	mISDN_FsmInitTimer(&mgr->deact, &mgr->datimer);
 	dev->teimgr = &mgr->ch;
 	return 0;
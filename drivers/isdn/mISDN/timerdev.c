@@ -25,21 +25,29 @@
 #include <linux/module.h>
 #include <linux/mISDNif.h>
 #include <linux/mutex.h>
+#include <linux/log2.h>
 #include <linux/sched/signal.h>
 
 #include "core.h"
 
 static DEFINE_MUTEX(mISDN_mutex);
 static u_int	*debug;
+static struct kmem_cache	*timer_cache;
 
+/* ids taken by one copy of a read */
+#define TIMER_READ_BATCH	64
 
 struct mISDNtimerdev {
 	int			next_id;
 	struct list_head	pending;
 	struct list_head	expired;
+	struct list_head	done;	/* given to the ring, for reuse */
 	wait_queue_head_t	wait;
 	u_int			work;
 	spinlock_t		lock; /* protect lists */
+	struct mISDN_timer_ring	*ring;	/* IMTIMERRING */
+	u_int			ring_size; /* the mapped size may be changed */
+	u_int			ring_head;
 };
 
 struct mISDNtimer {
@@ -56,14 +64,14 @@ mISDN_open(struct inode *ino, struct file *filep)
 
 	if (*debug & DEBUG_TIMER)
 		printk(KERN_DEBUG "%s(%p,%p)\n", __func__, ino, filep);
-	dev = kmalloc(sizeof(struct mISDNtimerdev) , GFP_KERNEL);
+	dev = kzalloc(sizeof(struct mISDNtimerdev) , GFP_KERNEL);
 	if (!dev)
 		return -ENOMEM;
 	dev->next_id = 1;
 	INIT_LIST_HEAD(&dev->pending);
 	INIT_LIST_HEAD(&dev->expired);
+	INIT_LIST_HEAD(&dev->done);
 	spin_lock_init(&dev->lock);
-	dev->work = 0;
 	init_waitqueue_head(&dev->wait);
 	filep->private_data = dev;
 	return nonseekable_open(ino, filep);
@@ -85,15 +93,19 @@ mISDN_close(struct inode *ino, struct file *filep)
 		spin_unlock_irq(&dev->lock);
 		del_timer_sync(&timer->tl);
 		spin_lock_irq(&dev->lock);
-		/* it might have been moved to ->expired */
+		/* it might have been moved to ->expired or ->done */
 		list_del(&timer->list);
-		kfree(timer);
+		kmem_cache_free(timer_cache, timer);
 	}
 	spin_unlock_irq(&dev->lock);
 
 	list_for_each_entry_safe(timer, next, &dev->expired, list) {
-		kfree(timer);
+		kmem_cache_free(timer_cache, timer);
 	}
+	list_for_each_entry_safe(timer, next, &dev->done, list) {
+		kmem_cache_free(timer_cache, timer);
+	}
+	vfree(dev->ring);
 	kfree(dev);
 	return 0;
 }
@@ -103,8 +115,10 @@ mISDN_read(struct file *filep, char __user *buf, size_t count, loff_t *off)
 {
 	struct mISDNtimerdev	*dev = filep->private_data;
 	struct list_head *list = &dev->expired;
-	struct mISDNtimer	*timer;
-	int	ret = 0;
+	struct mISDNtimer	*timer, *next;
+	int	ids[TIMER_READ_BATCH];
+	LIST_HEAD(taken);
+	int	i, n, ret = 0;
 
 	if (*debug & DEBUG_TIMER)
 		printk(KERN_DEBUG "%s(%p, %p, %d, %p)\n", __func__,
@@ -126,18 +140,25 @@ mISDN_read(struct file *filep, char __user *buf, size_t count, loff_t *off)
 	}
 	if (dev->work)
 		dev->work = 0;
-	if (!list_empty(list)) {
-		timer = list_first_entry(list, struct mISDNtimer, list);
-		list_del(&timer->list);
-		spin_unlock_irq(&dev->lock);
-		if (put_user(timer->id, (int __user *)buf))
-			ret = -EFAULT;
-		else
-			ret = sizeof(int);
-		kfree(timer);
-	} else {
+	/* all expired ids, which fit into the buffer */
+	while (count >= sizeof(int) && !list_empty(list)) {
+		n = min_t(size_t, count / sizeof(int), TIMER_READ_BATCH);
+		for (i = 0; i < n && !list_empty(list); i++) {
+			timer = list_first_entry(list, struct mISDNtimer, list);
+			ids[i] = timer->id;
+			list_move_tail(&timer->list, &taken);
+		}
 		spin_unlock_irq(&dev->lock);
+		list_for_each_entry_safe(timer, next, &taken, list)
+			kmem_cache_free(timer_cache, timer);
+		INIT_LIST_HEAD(&taken);
+		if (copy_to_user(buf + ret, ids, i * sizeof(int)))
+			return ret ? ret : -EFAULT;
+		ret += i * sizeof(int);
+		count -= i * sizeof(int);
+		spin_lock_irq(&dev->lock);
 	}
+	spin_unlock_irq(&dev->lock);
 	return ret;
 }
 
@@ -154,6 +175,9 @@ mISDN_poll(struct file *filep, poll_table *wait)
 		mask = 0;
 		if (dev->work || !list_empty(&dev->expired))
 			mask |= (POLLIN | POLLRDNORM);
+		else if (dev->ring &&
+			 READ_ONCE(dev->ring->tail) != dev->ring_head)
+			mask |= (POLLIN | POLLRDNORM);
 		if (*debug & DEBUG_TIMER)
 			printk(KERN_DEBUG "%s work(%d) empty(%d)\n", __func__,
 			       dev->work, list_empty(&dev->expired));
@@ -165,13 +189,26 @@ static void
 dev_expire_timer(unsigned long data)
 {
 	struct mISDNtimer *timer = (void *)data;
+	struct mISDNtimerdev	*dev = timer->dev;
+	struct mISDN_timer_ring	*r;
 	u_long			flags;
 
-	spin_lock_irqsave(&timer->dev->lock, flags);
-	if (timer->id >= 0)
-		list_move_tail(&timer->list, &timer->dev->expired);
-	spin_unlock_irqrestore(&timer->dev->lock, flags);
-	wake_up_interruptible(&timer->dev->wait);
+	spin_lock_irqsave(&dev->lock, flags);
+	r = dev->ring;
+	if (timer->id >= 0) {
+		/* while ids wait for read, the next ones queue behind them */
+		if (r && list_empty(&dev->expired) &&
+		    dev->ring_head - READ_ONCE(r->tail) < dev->ring_size) {
+			r->id[dev->ring_head & (dev->ring_size - 1)] =
+				timer->id;
+			/* the id must be visible before the head */
+			smp_store_release(&r->head, ++dev->ring_head);
+			list_move(&timer->list, &dev->done);
+		} else
+			list_move_tail(&timer->list, &dev->expired);
+	}
+	spin_unlock_irqrestore(&dev->lock, flags);
+	wake_up_interruptible(&dev->wait);
 }
 
 static int
@@ -185,11 +222,21 @@ misdn_add_timer(struct mISDNtimerdev *dev, int timeout)
 		wake_up_interruptible(&dev->wait);
 		id = 0;
 	} else {
-		timer = kzalloc(sizeof(struct mISDNtimer), GFP_KERNEL);
-		if (!timer)
-			return -ENOMEM;
-		timer->dev = dev;
-		setup_timer(&timer->tl, dev_expire_timer, (long)timer);
+		/* timers given to the ring are used again */
+		spin_lock_irq(&dev->lock);
+		timer = list_first_entry_or_null(&dev->done,
+						 struct mISDNtimer, list);
+		if (timer)
+			list_del(&timer->list);
+		spin_unlock_irq(&dev->lock);
+		if (!timer) {
+			timer = kmem_cache_zalloc(timer_cache, GFP_KERNEL);
+			if (!timer)
+				return -ENOMEM;
+			timer->dev = dev;
+			setup_timer(&timer->tl, dev_expire_timer,
+				    (long)timer);
+		}
 		spin_lock_irq(&dev->lock);
 		id = timer->id = dev->next_id++;
 		if (dev->next_id < 0)
@@ -214,7 +261,7 @@ misdn_del_timer(struct mISDNtimerdev *dev, int id)
 			timer->id = -1;
 			spin_unlock_irq(&dev->lock);
 			del_timer_sync(&timer->tl);
-			kfree(timer);
+			kmem_cache_free(timer_cache, timer);
 			return id;
 		}
 	}
@@ -222,6 +269,39 @@ misdn_del_timer(struct mISDNtimerdev *dev, int id)
 	return 0;
 }
 
+static int
+misdn_timer_ring(struct mISDNtimerdev *dev, int size)
+{
+	struct mISDN_timer_ring	*r;
+
+	if (dev->ring)
+		return -EBUSY;
+	if (size <= 0 || size > MISDN_TIMER_RING_MAX || !is_power_of_2(size))
+		return -EINVAL;
+	r = vmalloc_user(sizeof(*r) + size * sizeof(int));
+	if (!r)
+		return -ENOMEM;
+	r->size = size;
+	spin_lock_irq(&dev->lock);
+	dev->ring_size = size;
+	dev->ring = r;
+	spin_unlock_irq(&dev->lock);
+	return 0;
+}
+
+static int
+mISDN_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+	struct mISDNtimerdev	*dev = filep->private_data;
+	int			err = -EINVAL;
+
+	mutex_lock(&mISDN_mutex);
+	if (dev->ring && !vma->vm_pgoff)
+		err = remap_vmalloc_range(vma, dev->ring, 0);
+	mutex_unlock(&mISDN_mutex);
+	return err;
+}
+
 static long
 mISDN_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 {
@@ -261,6 +341,13 @@ mISDN_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 		if (put_user(id, (int __user *)arg))
 			ret = -EFAULT;
 		break;
+	case IMTIMERRING:
+		if (get_user(tout, (int __user *)arg)) {
+			ret = -EFAULT;
+			break;
+		}
+		ret = misdn_timer_ring(dev, tout);
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -273,6 +360,7 @@ static const struct file_operations mISDN_fops = {
 	.read		= mISDN_read,
 	.poll		= mISDN_poll,
 	.unlocked_ioctl	= mISDN_ioctl,
+	.mmap		= mISDN_mmap,
 	.open		= mISDN_open,
 	.release	= mISDN_close,
 	.llseek		= no_llseek,
@@ -290,13 +378,20 @@ mISDN_inittimer(u_int *deb)
 	int	err;
 
 	debug = deb;
+	timer_cache = kmem_cache_create("mISDN_timer",
+					sizeof(struct mISDNtimer), 0, 0, NULL);
+	if (!timer_cache)
+		return -ENOMEM;
 	err = misc_register(&mISDNtimer);
-	if (err)
+	if (err) {
 		printk(KERN_WARNING "mISDN: Could not register timer device\n");
+		kmem_cache_destroy(timer_cache);
+	}
 	return err;
 }
 
 void mISDN_timer_cleanup(void)
 {
 	misc_deregister(&mISDNtimer);
+	kmem_cache_destroy(timer_cache);
 }
@@ -0,0 +1,775 @@
+/*
+ * dspbench.c
+ *
+ * user space micro benchmarks of the DSP kernels of mISDN
+ *
+ * The kernels are built from the sources of the tree, see the Makefile.
+ * Each benchmark processes frames of audio for some time and reports
+ * ns/sample and cycles/frame. Benchmarks of a group compute the same
+ * result in different ways (lookup tables, scalar and vector code), the
+ * first is the reference, the others are reported with their speedup.
+ *
+ * usage: dspbench [-l] [-s seconds] [-f samples] [-m members] [-t taps]
+ *		   [name ...]
+ *	-l	list the benchmarks
+ *	-s	time per benchmark, default 0.5 s
+ *	-f	samples per frame, default 160 (20 ms)
+ *	-m	members of the mixed conference, default 8
+ *	-t	taps of the echo cancellers, default 256 (32 ms)
+ *	name	run only benchmarks or groups with names starting with it
+ *
+ * cycles are counted by the TSC on x86, elsewhere only ns are reported.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/mISDNif.h>
+#include <linux/mISDNdsp.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#ifdef CONFIG_X86
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#include "core.h"
+#include "dsp.h"
+#include "dsp_goertzel.h"
+#include "dsp_cmx_mix.h"
+#include "l1oip.h"
+#include "oslec_echo.h"
+#include "oslec_simd.h"
+#include "dspbench.h"
+
+/* globals of dsp_core.c, which is not built */
+int dsp_options;
+int dsp_debug;
+int dsp_poll = 128, dsp_tics;
+int dsp_buff_size = CMX_BUFF_MIN;
+spinlock_t dsp_lock;
+unsigned long jiffies;
+
+#define SIGNAL_LEN	8000	/* one second of test signal */
+#define MAX_FRAME	1024
+#define MAX_MEMBERS	64
+
+static int frame = 160;
+static int members = 8;
+static int taps = 256;
+static double seconds = 0.5;
+
+/* test signal, speech like tones with noise, and its echo */
+static s16 sig[SIGNAL_LEN + MAX_FRAME];
+static s16 echo[SIGNAL_LEN + MAX_FRAME];
+static u8 law[SIGNAL_LEN + MAX_FRAME];
+static int pos;
+
+static u8 out[MAX_FRAME];
+static s16 out16[MAX_FRAME];
+static s32 buf32[MAX_FRAME];
+static struct dsp dsp;
+
+static inline void
+next_frame(void)
+{
+	pos += frame;
+	if (pos >= SIGNAL_LEN)
+		pos = 0;
+}
+
+static void
+make_signal(void)
+{
+	double t;
+	int i, v;
+
+	srand(1);
+	for (i = 0; i < SIGNAL_LEN + MAX_FRAME; i++) {
+		t = (double)(i % SIGNAL_LEN) / 8000;
+		v = 6000 * sin(2 * M_PI * 440 * t) +
+			3000 * sin(2 * M_PI * 1209 * t) +
+			(rand() % 2001) - 1000;
+		sig[i] = v;
+		law[i] = dsp_audio_s16_law(v);
+	}
+	/* 8 ms behind, 12 dB down, with its own noise */
+	for (i = 0; i < SIGNAL_LEN + MAX_FRAME; i++)
+		echo[i] = (i >= 64 ? sig[i - 64] / 4 : 0) +
+			(rand() % 201) - 100;
+}
+
+/*
+ * law encoder, full table and compact table (CONFIG_MISDN_DSP_COMPACT)
+ */
+static void
+encode_run(void)
+{
+	const s16 *s = sig + pos;
+	int i;
+
+	for (i = 0; i < frame; i++)
+		out[i] = dsp_audio_s16_law(s[i]);
+}
+
+static void
+encode_compact_run(void)
+{
+	const s16 *s = sig + pos;
+	int i;
+
+	for (i = 0; i < frame; i++)
+		out[i] = dsp_audio_s16_law_compact(s[i]);
+}
+
+static void
+decode_run(void)
+{
+	const u8 *s = law + pos;
+	int i;
+
+	for (i = 0; i < frame; i++)
+		buf32[i] = dsp_audio_law_to_s32[s[i]];
+}
+
+/*
+ * conference of members, mixed by the kernels of dsp_cmx
+ */
+static u8 *rings[MAX_MEMBERS];
+
+static int
+mix_setup(void)
+{
+	int m, i;
+
+	for (m = 0; m < members; m++) {
+		rings[m] = malloc(CMX_BUFF_SIZE);
+		if (!rings[m])
+			return -1;
+		for (i = 0; i < CMX_BUFF_SIZE; i++)
+			rings[m][i] = law[(i * (m + 1)) % SIGNAL_LEN];
+	}
+	return 0;
+}
+
+static void
+mix_cleanup(void)
+{
+	int m;
+
+	for (m = 0; m < members; m++) {
+		free(rings[m]);
+		rings[m] = NULL;
+	}
+}
+
+static void
+mix_run(void)
+{
+	int r = pos & CMX_BUFF_MASK;
+	int m;
+
+	memset(buf32, 0, frame * sizeof(s32));
+	for (m = 0; m < members; m++)
+		dsp_cmx_mix_add(buf32, rings[m], r, frame);
+	for (m = 0; m < members; m++)
+		dsp_cmx_mix_sub(out, buf32, rings[m], r, frame);
+}
+
+static void
+mix_compact_run(void)
+{
+	int r = pos & CMX_BUFF_MASK;
+	int m;
+
+	memset(buf32, 0, frame * sizeof(s32));
+	for (m = 0; m < members; m++)
+		mix_compact_add(buf32, rings[m], r, frame);
+	for (m = 0; m < members; m++)
+		mix_compact_sub(out, buf32, rings[m], r, frame);
+}
+
+/* two members only exchange their data, with tx-data this is a mix of two */
+static void
+mix2_run(void)
+{
+	const u8 *a = law + pos, *b = law + SIGNAL_LEN - pos;
+	int i;
+
+	for (i = 0; i < frame; i++)
+		out[i] = dsp_audio_mix(a[i], b[i]);
+}
+
+static void
+mix2_compact_run(void)
+{
+	const u8 *a = law + pos, *b = law + SIGNAL_LEN - pos;
+	int i;
+
+	for (i = 0; i < frame; i++)
+		out[i] = dsp_audio_mix_compact(a[i], b[i]);
+}
+
+/*
+ * volume and gain
+ */
+static struct sk_buff *frame_skb;
+
+static int
+skb_setup(void)
+{
+	frame_skb = mI_alloc_skb(MAX_FRAME, GFP_KERNEL);
+	if (!frame_skb)
+		return -1;
+	skb_put(frame_skb, frame);
+	return 0;
+}
+
+static void
+skb_cleanup(void)
+{
+	dev_kfree_skb(frame_skb);
+	frame_skb = NULL;
+}
+
+static void
+volume_run(void)
+{
+	memcpy(frame_skb->data, law + pos, frame);
+	dsp_change_volume(frame_skb, 3);
+}
+
+static u8 gain_table[256];
+
+static int
+gain_setup(void)
+{
+	dsp_audio_generate_gain(gain_table, 9);
+	return skb_setup();
+}
+
+static void
+gain_run(void)
+{
+	memcpy(frame_skb->data, law + pos, frame);
+	dsp_change_gain(frame_skb, gain_table);
+}
+
+/*
+ * goertzel filters of the DTMF frequencies
+ */
+static const int dtmf_freq[GOERTZEL_NCOEFF] = {
+	697, 770, 852, 941, 1209, 1336, 1477, 1633
+};
+static s32 dtmf_coeff[GOERTZEL_NCOEFF];
+static s32 sk[GOERTZEL_NCOEFF], sk2[GOERTZEL_NCOEFF];
+
+static int
+goertzel_setup(void)
+{
+	int k;
+
+	for (k = 0; k < GOERTZEL_NCOEFF; k++)
+		dtmf_coeff[k] = 2 * cos(2 * M_PI * dtmf_freq[k] / 8000) *
+			32768;
+	return 0;
+}
+
+/* one filter after the other, as it was done before goertzel_bank */
+static void
+goertzel_scalar_run(void)
+{
+	const s16 *s = sig + pos;
+	s32 s0, s1, s2;
+	int i, k;
+
+	for (k = 0; k < GOERTZEL_NCOEFF; k++) {
+		s1 = 0;
+		s2 = 0;
+		for (i = 0; i < frame; i++) {
+			s0 = (s32)(((s64)dtmf_coeff[k] * s1) >> 15) - s2 +
+				s[i];
+			s2 = s1;
+			s1 = s0;
+		}
+		sk[k] = s1;
+		sk2[k] = s2;
+	}
+}
+
+static void
+goertzel_bank_run(void)
+{
+	const s16 *s = sig + pos;
+	int i;
+
+	for (i = 0; i < frame; i++)
+		buf32[i] = s[i];
+	goertzel_bank(dtmf_coeff, buf32, frame, sk, sk2);
+}
+
+static int
+dtmf_setup(void)
+{
+	memset(&dsp, 0, sizeof(dsp));
+	dsp.dtmf.enable = 1;
+	dsp.dtmf.software = 1;
+	dsp.dtmf.treshold = 100 * 10000;
+	dsp_dtmf_goertzel_init(&dsp);
+	return 0;
+}
+
+static void
+dtmf_run(void)
+{
+	dsp_dtmf_goertzel_decode(&dsp, law + pos, frame, 0);
+}
+
+/*
+ * blowfish
+ */
+static int
+bf_setup(void)
+{
+	static const u8 key[] = "dspbench key 123";
+
+	memset(&dsp, 0, sizeof(dsp));
+	return dsp_bf_init(&dsp, key, sizeof(key) - 1) ? -1 : 0;
+}
+
+static void
+bf_encrypt_run(void)
+{
+	memcpy(out, law + pos, frame);
+	dsp_bf_encrypt(&dsp, out, frame);
+}
+
+static void
+bf_decrypt_run(void)
+{
+	memcpy(out, law + pos, frame);
+	dsp_bf_decrypt(&dsp, out, frame);
+}
+
+/*
+ * tones, copied from the pattern or cloned from the shared stream
+ */
+static int
+tone_setup(void)
+{
+	memset(&dsp, 0, sizeof(dsp));
+	return dsp_tone(&dsp, TONE_GERMAN_RINGING) ? -1 : 0;
+}
+
+static int
+tone_clone_setup(void)
+{
+	struct sk_buff *skb;
+
+	if (tone_setup())
+		return -1;
+	skb = dsp_tone_clone(&dsp, frame);
+	if (!skb)
+		return -1;
+	dev_kfree_skb(skb);
+	return 0;
+}
+
+static void
+tone_copy_run(void)
+{
+	dsp_tone_copy(&dsp, out, frame);
+}
+
+static void
+tone_clone_run(void)
+{
+	struct sk_buff *skb = dsp_tone_clone(&dsp, frame);
+
+	dsp_tone_clock(&dsp, frame);
+	dev_kfree_skb(skb);
+}
+
+/*
+ * l1oip codecs
+ */
+static u32 l1oip_state;
+
+static int
+l1oip_setup(void)
+{
+	return l1oip_4bit_alloc(0) ? -1 : 0;
+}
+
+static void
+l1oip_cleanup(void)
+{
+	l1oip_4bit_free();
+}
+
+static void
+law_to_4bit_run(void)
+{
+	l1oip_law_to_4bit(law + pos, frame, out, &l1oip_state);
+}
+
+static void
+four_bit_to_law_run(void)
+{
+	l1oip_4bit_to_law(law + pos, frame / 2, out);
+}
+
+static void
+alaw_to_ulaw_run(void)
+{
+	l1oip_alaw_to_ulaw(law + pos, frame, out);
+}
+
+/*
+ * oslec, sample by sample with the generic kernels and by block with the
+ * kernels selected for the cpu
+ */
+static struct echo_can_state_s *oslec;
+
+static int
+oslec_setup(void)
+{
+	oslec = echo_can_create(taps, ECHO_CAN_USE_ADAPTION |
+		ECHO_CAN_USE_NLP | ECHO_CAN_USE_CLIP | ECHO_CAN_USE_TX_HPF |
+		ECHO_CAN_USE_RX_HPF);
+	return oslec ? 0 : -1;
+}
+
+static void
+oslec_cleanup(void)
+{
+	echo_can_free(oslec);
+	oslec = NULL;
+}
+
+static void
+oslec_sample_run(void)
+{
+	int i;
+
+	for (i = 0; i < frame; i++)
+		out16[i] = echo_can_update(oslec, sig[pos + i],
+					   echo[pos + i]);
+}
+
+static void
+oslec_block_run(void)
+{
+	memcpy(out16, echo + pos, frame * sizeof(s16));
+	echo_can_update_block(oslec, sig + pos, out16, frame);
+}
+
+/* the FIR and LMS kernels alone, over the taps for each sample */
+static const struct oslec_kernels *kernels;
+static s16 coeffs[2048];
+
+static int
+kernels_generic_setup(void)
+{
+	kernels = &oslec_kernels_generic;
+	return taps <= 2048 ? 0 : -1;
+}
+
+static int
+kernels_cpu_setup(void)
+{
+	kernels = oslec_simd_begin();
+	oslec_simd_end(kernels);
+	if (kernels == &oslec_kernels_generic)
+		return -1;
+	return taps <= 2048 ? 0 : -1;
+}
+
+static void
+dot16_run(void)
+{
+	int i;
+
+	for (i = 0; i < frame; i++)
+		buf32[i] = kernels->dot16(coeffs, sig + i, taps);
+}
+
+static void
+lms16_run(void)
+{
+	int i;
+
+	for (i = 0; i < frame; i++)
+		kernels->lms16(coeffs, sig + i, 7, taps);
+}
+
+/*
+ * the line echo cancellers of the pipeline, with the generic loops over the
+ * taps and with the variant for a fixed number of taps (128, 256, 512 and
+ * 1024), which is the same as the generic one for other numbers.
+ */
+#define EC_BENCH(n)							\
+static void *n##_state;							\
+static int								\
+n##_setup(void)								\
+{									\
+	n##_state = ec_##n##_create(taps, 0);				\
+	return n##_state ? 0 : -1;					\
+}									\
+static int								\
+n##_fixed_setup(void)							\
+{									\
+	n##_state = ec_##n##_create(taps, 1);				\
+	return n##_state ? 0 : -1;					\
+}									\
+static void								\
+n##_cleanup(void)							\
+{									\
+	ec_##n##_free(n##_state);					\
+}									\
+static void								\
+n##_run(void)								\
+{									\
+	ec_##n##_run(n##_state, sig + pos, echo + pos, out16, frame);	\
+}
+
+EC_BENCH(mg2ec)
+EC_BENCH(kb1ec)
+EC_BENCH(mec2)
+
+/*
+ * what kernel_fpu_begin/end cost, if the task has used the vector unit:
+ * the registers are saved with xsaveopt and restored with xrstor, like the
+ * kernel does. this is the price of running vector code once per frame.
+ */
+#ifdef CONFIG_X86
+static u8 xstate[16384] __attribute__((aligned(64)));
+static u64 xmask;
+static int xopt;
+
+static int __attribute__((target("xsave")))
+fpu_setup(void)
+{
+	u_int a, b, c, d;
+
+	if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_OSXSAVE))
+		return -1;
+	xmask = _xgetbv(0);
+	__get_cpuid_count(0xd, 1, &a, &b, &c, &d);
+	xopt = a & 1;
+	__get_cpuid_count(0xd, 0, &a, &b, &c, &d);
+	return b <= sizeof(xstate) ? 0 : -1;
+}
+
+static void __attribute__((target("xsave,xsaveopt")))
+fpu_run(void)
+{
+	if (xopt)
+		_xsaveopt(xstate, xmask);
+	else
+		_xsave(xstate, xmask);
+	_xrstor(xstate, xmask);
+}
+#else
+#define fpu_setup	NULL
+#define fpu_run		NULL
+#endif
+
+struct bench {
+	const char	*group;
+	const char	*name;
+	int		(*setup)(void);	/* -1: not available */
+	void		(*run)(void);	/* one frame */
+	void		(*cleanup)(void);
+};
+
+static const struct bench benches[] = {
+	{"encode", "encode-table", NULL, encode_run, NULL},
+	{"encode", "encode-compact", NULL, encode_compact_run, NULL},
+	{"decode", "decode", NULL, decode_run, NULL},
+	{"mix", "mix-table", mix_setup, mix_run, mix_cleanup},
+	{"mix", "mix-compact", mix_setup, mix_compact_run, mix_cleanup},
+	{"mix2", "mix2-table", NULL, mix2_run, NULL},
+	{"mix2", "mix2-compact", NULL, mix2_compact_run, NULL},
+	{"volume", "volume", skb_setup, volume_run, skb_cleanup},
+	{"gain", "gain", gain_setup, gain_run, skb_cleanup},
+	{"goertzel", "goertzel-scalar", goertzel_setup, goertzel_scalar_run,
+	 NULL},
+	{"goertzel", "goertzel-bank", goertzel_setup, goertzel_bank_run,
+	 NULL},
+	{"dtmf", "dtmf-decode", dtmf_setup, dtmf_run, NULL},
+	{"blowfish", "bf-encrypt", bf_setup, bf_encrypt_run, NULL},
+	{"blowfish-dec", "bf-decrypt", bf_setup, bf_decrypt_run, NULL},
+	{"tone", "tone-copy", tone_setup, tone_copy_run, NULL},
+	{"tone", "tone-clone", tone_clone_setup, tone_clone_run, NULL},
+	{"l1oip-enc", "law-to-4bit", l1oip_setup, law_to_4bit_run,
+	 l1oip_cleanup},
+	{"l1oip-dec", "4bit-to-law", l1oip_setup, four_bit_to_law_run,
+	 l1oip_cleanup},
+	{"l1oip-conv", "alaw-to-ulaw", NULL, alaw_to_ulaw_run, NULL},
+	{"oslec", "oslec-sample", oslec_setup, oslec_sample_run,
+	 oslec_cleanup},
+	{"oslec", "oslec-block", oslec_setup, oslec_block_run, oslec_cleanup},
+	{"dot16", "dot16-generic", kernels_generic_setup, dot16_run, NULL},
+	{"dot16", "dot16-cpu", kernels_cpu_setup, dot16_run, NULL},
+	{"lms16", "lms16-generic", kernels_generic_setup, lms16_run, NULL},
+	{"lms16", "lms16-cpu", kernels_cpu_setup, lms16_run, NULL},
+	{"mg2ec", "mg2ec-generic", mg2ec_setup, mg2ec_run, mg2ec_cleanup},
+	{"mg2ec", "mg2ec-fixed", mg2ec_fixed_setup, mg2ec_run,
+	 mg2ec_cleanup},
+	{"kb1ec", "kb1ec-generic", kb1ec_setup, kb1ec_run, kb1ec_cleanup},
+	{"kb1ec", "kb1ec-fixed", kb1ec_fixed_setup, kb1ec_run,
+	 kb1ec_cleanup},
+	{"mec2", "mec2-generic", mec2_setup, mec2_run, mec2_cleanup},
+	{"mec2", "mec2-fixed", mec2_fixed_setup, mec2_run, mec2_cleanup},
+	{"fpu", "fpu-section", fpu_setup, fpu_run, NULL},
+};
+
+static inline u64
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline u64
+cycles(void)
+{
+#ifdef CONFIG_X86
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* returns ns per sample, or 0 if the benchmark is not available */
+static double
+run_bench(const struct bench *b)
+{
+	u64 start, end, c0, c1, limit, n = 0;
+	double ns;
+	int i;
+
+	if ((b->setup && b->setup()) || !b->run) {
+		printf("%-16s not available", b->name);
+		return 0;
+	}
+	pos = 0;
+	/* warm up the caches and the tables */
+	for (i = 0; i < 16; i++) {
+		b->run();
+		next_frame();
+	}
+	limit = seconds * 1e9;
+	start = now_ns();
+	c0 = cycles();
+	do {
+		for (i = 0; i < 64; i++) {
+			b->run();
+			next_frame();
+		}
+		n += 64;
+		end = now_ns();
+	} while (end - start < limit);
+	c1 = cycles();
+	if (b->cleanup)
+		b->cleanup();
+
+	ns = (double)(end - start) / (n * frame);
+	printf("%-16s %10.2f ns/sample", b->name, ns);
+	if (c1 != c0)
+		printf(" %12.0f cycles/frame", (double)(c1 - c0) / n);
+	return ns;
+}
+
+static int
+selected(const struct bench *b, int argc, char **argv)
+{
+	int i;
+
+	if (!argc)
+		return 1;
+	for (i = 0; i < argc; i++)
+		if (!strncmp(b->name, argv[i], strlen(argv[i])) ||
+		    !strncmp(b->group, argv[i], strlen(argv[i])))
+			return 1;
+	return 0;
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: dspbench [-l] [-s seconds] [-f samples] "
+		"[-m members] [-t taps] [name ...]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	const struct bench *b, *ref = NULL;
+	double ns, ref_ns = 0;
+	int c, i, list = 0;
+
+	while ((c = getopt(argc, argv, "ls:f:m:t:")) != -1) {
+		switch (c) {
+		case 'l':
+			list = 1;
+			break;
+		case 's':
+			seconds = atof(optarg);
+			break;
+		case 'f':
+			frame = atoi(optarg);
+			break;
+		case 'm':
+			members = atoi(optarg);
+			break;
+		case 't':
+			taps = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (frame < 2 || frame > MAX_FRAME || members < 1 ||
+	    members > MAX_MEMBERS || taps < 16 || seconds <= 0)
+		usage();
+	frame &= ~1;	/* 4 bit codec: two samples per byte */
+
+	if (list) {
+		for (i = 0; i < ARRAY_SIZE(benches); i++)
+			printf("%-16s %s\n", benches[i].group,
+			       benches[i].name);
+		return 0;
+	}
+
+	/* the tables, as dsp_core.c selects them */
+	dsp_audio_select_law(0);
+	dsp_tone_stream_init();
+	oslec_simd_init();
+	make_signal();
+
+	printf("frame %d samples, %d members, %d taps\n", frame, members,
+	       taps);
+	for (i = 0; i < ARRAY_SIZE(benches); i++) {
+		b = &benches[i];
+		if (!selected(b, argc, argv))
+			continue;
+		ns = run_bench(b);
+		if (ref && ref_ns && ns && !strcmp(ref->group, b->group))
+			printf("  x%.2f", ref_ns / ns);
+		if (!ref || strcmp(ref->group, b->group)) {
+			ref = b;
+			ref_ns = ns;
+		}
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * dspbench.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef DSPBENCH_H
+#define DSPBENCH_H
+
+/* the line echo cancellers, see ec.c */
+#define EC_DECLARE(n)							\
+	void *ec_##n##_create(int taps, int fixed);			\
+	void ec_##n##_run(void *ec, const s16 *ref, const s16 *sig,	\
+			  s16 *out, int n);				\
+	void ec_##n##_free(void *ec)
+
+EC_DECLARE(mg2ec);
+EC_DECLARE(kb1ec);
+EC_DECLARE(mec2);
+
+/* the mixing kernels with the compact law encoder, see mix_compact.c */
+void mix_compact_add(s32 *c, const u8 *q, int r, int len);
+void mix_compact_sub(u8 *d, const s32 *c, const u8 *q, int r, int len);
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * ec.c
+ *
+ * one of the line echo cancellers, which are implemented in headers. the
+ * Makefile builds this file once for each, with EC_HEADER and EC_NAME.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include EC_HEADER
+#include "dspbench.h"
+
+#define __EC_FN(n, f)	ec_##n##_##f
+#define EC_FN(n, f)	__EC_FN(n, f)
+
+/* fixed: the variant for the number of taps, if there is one */
+void *
+EC_FN(EC_NAME, create)(int taps, int fixed)
+{
+	struct echo_can_state *ec = echo_can_create(taps, 0);
+
+	if (ec && !fixed)
+		ec->update_block = echo_can_block_any;
+	return ec;
+}
+
+void
+EC_FN(EC_NAME, run)(void *p, const s16 *ref, const s16 *sig, s16 *out, int n)
+{
+	struct echo_can_state *ec = p;
+
+	memcpy(out, sig, n * sizeof(*out));
+	echo_can_update_block(ec, ref, out, n);
+}
+
+void
+EC_FN(EC_NAME, free)(void *p)
+{
+	echo_can_free(p);
+}
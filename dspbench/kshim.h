@@ -0,0 +1,259 @@
+/*
+ * kshim.h
+ *
+ * Just enough of the kernel API to build the DSP sources of mISDN in user
+ * space for dspbench. The Makefile replaces every kernel header, which the
+ * sources include, by this file.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef KSHIM_H
+#define KSHIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+typedef uint8_t		u8;
+typedef uint16_t	u16;
+typedef uint32_t	u32;
+typedef uint64_t	u64;
+typedef int8_t		s8;
+typedef int16_t		s16;
+typedef int32_t		s32;
+typedef int64_t		s64;
+typedef uint8_t		__u8;
+typedef uint16_t	__u16;
+typedef uint32_t	__u32;
+typedef uint64_t	__u64;
+typedef int8_t		__s8;
+typedef int16_t		__s16;
+typedef int32_t		__s32;
+typedef int64_t		__s64;
+typedef unsigned int	gfp_t;
+typedef s64		ktime_t;
+
+#define GFP_ATOMIC	0
+#define GFP_KERNEL	0
+#define __percpu
+#define __init
+#define __exit
+#define __initdata
+#define __read_mostly
+#define __rcu
+#ifndef __always_inline
+#define __always_inline		inline
+#endif
+#define __packed		__attribute__((packed))
+
+#define EXPORT_SYMBOL(x)
+#define EXPORT_SYMBOL_GPL(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DESCRIPTION(x)
+#define module_param(n, t, p)
+#define MODULE_PARM_DESC(n, d)
+#define module_init(f)
+#define module_exit(f)
+#define THIS_MODULE		NULL
+
+#define KERN_EMERG	""
+#define KERN_ERR	""
+#define KERN_WARNING	""
+#define KERN_NOTICE	""
+#define KERN_INFO	""
+#define KERN_DEBUG	""
+#define printk		printf
+#define pr_info		printf
+#define pr_warn		printf
+#define pr_err		printf
+
+#define likely(x)	__builtin_expect(!!(x), 1)
+#define unlikely(x)	__builtin_expect(!!(x), 0)
+#define BUG_ON(x)	do { if (x) abort(); } while (0)
+#define WARN_ON(x)	(!!(x))
+
+#define ARRAY_SIZE(a)	(sizeof(a) / sizeof((a)[0]))
+#define container_of(p, t, m)	((t *)((char *)(p) - offsetof(t, m)))
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#define max(a, b)	((a) > (b) ? (a) : (b))
+#define min_t(t, a, b)	((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b)	((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp_t(t, v, l, h)	min_t(t, max_t(t, v, l), h)
+
+#define READ_ONCE(x)		(*(volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, v)	(*(volatile __typeof__(x) *)&(x) = (v))
+#define smp_load_acquire(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+/* the benchmark is single threaded, locks do nothing */
+typedef struct { int x; } spinlock_t;
+typedef struct { int x; } rwlock_t;
+#define DEFINE_SPINLOCK(l)		spinlock_t l
+#define spin_lock_init(l)		do { } while (0)
+#define spin_lock(l)			do { } while (0)
+#define spin_unlock(l)			do { } while (0)
+#define spin_lock_bh(l)			do { } while (0)
+#define spin_unlock_bh(l)		do { } while (0)
+#define spin_lock_irqsave(l, f)		do { (void)(f); } while (0)
+#define spin_unlock_irqrestore(l, f)	do { (void)(f); } while (0)
+#define rcu_read_lock()			do { } while (0)
+#define rcu_read_unlock()		do { } while (0)
+
+struct list_head {
+	struct list_head *next, *prev;
+};
+#define LIST_HEAD(n)	struct list_head n = { &(n), &(n) }
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+struct hlist_head {
+	struct hlist_node *first;
+};
+#define DECLARE_HASHTABLE(n, bits)	struct hlist_head n[1 << (bits)]
+#define DECLARE_BITMAP(n, bits)	\
+	unsigned long n[((bits) + 8 * sizeof(long) - 1) / (8 * sizeof(long))]
+
+/* only used as members of structures, which the benchmark does not use */
+struct rcu_head { void *p; };
+typedef void (*rcu_callback_t)(struct rcu_head *);
+struct timer_list { void *p; };
+struct work_struct { void *p; };
+struct completion { void *p; };
+struct tasklet_struct { void *p; };
+struct hrtimer { void *p; };
+struct mutex { void *p; };
+struct device { void *p; };
+struct sock { void *p; };
+struct socket;
+struct task_struct;
+typedef struct { void *p; } wait_queue_head_t;
+struct static_key_false { int enabled; };
+#define static_branch_unlikely(k)	unlikely((k)->enabled)
+
+extern unsigned long jiffies;
+#define HZ		1000
+
+/* linear skbs on the heap */
+struct sk_buff {
+	unsigned char	*head;
+	unsigned char	*data;
+	unsigned int	len;
+	unsigned int	size;
+	char		cb[48];
+};
+struct sk_buff_head {
+	int	qlen;
+};
+
+static inline struct sk_buff *
+alloc_skb(unsigned int size, gfp_t gfp)
+{
+	struct sk_buff *skb = calloc(1, sizeof(*skb) + size);
+
+	if (skb) {
+		skb->head = (unsigned char *)(skb + 1);
+		skb->data = skb->head;
+		skb->size = size;
+	}
+	return skb;
+}
+
+static inline void
+skb_reserve(struct sk_buff *skb, int len)
+{
+	skb->data += len;
+}
+
+static inline void *
+skb_put(struct sk_buff *skb, unsigned int len)
+{
+	void *p = skb->data + skb->len;
+
+	skb->len += len;
+	return p;
+}
+
+static inline void *
+skb_put_data(struct sk_buff *skb, const void *data, unsigned int len)
+{
+	return memcpy(skb_put(skb, len), data, len);
+}
+
+static inline void *
+skb_pull(struct sk_buff *skb, unsigned int len)
+{
+	skb->len -= len;
+	return skb->data += len;
+}
+
+static inline void
+skb_trim(struct sk_buff *skb, unsigned int len)
+{
+	if (skb->len > len)
+		skb->len = len;
+}
+
+/*
+ * a clone shares the data, freeing it only frees the head. there is no
+ * reference count, the original must be kept until all clones are freed.
+ */
+static inline struct sk_buff *
+skb_clone(struct sk_buff *skb, gfp_t gfp)
+{
+	struct sk_buff *n = malloc(sizeof(*n));
+
+	if (n)
+		*n = *skb;
+	return n;
+}
+
+#define kfree_skb(s)		free(s)
+#define dev_kfree_skb(s)	free(s)
+#define dev_kfree_skb_any(s)	free(s)
+
+#define kmalloc(s, f)		malloc(s)
+#define kzalloc(s, f)		calloc(1, s)
+#define kcalloc(n, s, f)	calloc(n, s)
+#define kfree(p)		free(p)
+#define vmalloc(s)		malloc(s)
+#define vfree(p)		free(p)
+
+#define udelay(n)		do { } while (0)
+#define mdelay(n)		do { } while (0)
+
+static inline void *
+dev_get_drvdata(const struct device *dev)
+{
+	return dev->p;
+}
+
+/* the vector registers of user space are always usable */
+#define X86_FEATURE_XMM2	"sse2"
+#define X86_FEATURE_XMM4_1	"sse4.1"
+#define X86_FEATURE_AVX		"avx"
+#define X86_FEATURE_AVX2	"avx2"
+#define boot_cpu_has(f)		__builtin_cpu_supports(f)
+#define irq_fpu_usable()	1
+#define kernel_fpu_begin()	do { } while (0)
+#define kernel_fpu_end()	do { } while (0)
+
+static inline u8
+bitrev8(u8 b)
+{
+	b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+	b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+	return (b & 0xaa) >> 1 | (b & 0x55) << 1;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ * mix_compact.c
+ *
+ * the mixing kernels of dsp_cmx, built with the compact law encoder
+ * (CONFIG_MISDN_DSP_COMPACT), so dspbench can compare both encoders.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define CONFIG_MISDN_DSP_COMPACT
+#include <linux/kernel.h>
+#include <linux/mISDNif.h>
+#include <linux/mISDNdsp.h>
+#include "core.h"
+#include "dsp.h"
+#include "dsp_cmx_mix.h"
+#include "dspbench.h"
+
+void
+mix_compact_add(s32 *c, const u8 *q, int r, int len)
+{
+	dsp_cmx_mix_add(c, q, r, len);
+}
+
+void
+mix_compact_sub(u8 *d, const s32 *c, const u8 *q, int r, int len)
+{
+	dsp_cmx_mix_sub(d, c, q, r, len);
+}
@@ -17,8 +17,13 @@ struct mISDN_dsp_element {
 	int	num_args;
 	struct mISDN_dsp_element_arg
 		*args;
+	int	flags;
 };
 
+/* flags of mISDN_dsp_element */
+#define MISDN_DSP_ELEM_ECHOCAN	0x0001	/* element is an echo canceller, */
+					/* the hardware may do it instead */
+
 extern int  mISDN_dsp_element_register(struct mISDN_dsp_element *elem);
 extern void mISDN_dsp_element_unregister(struct mISDN_dsp_element *elem);
 
@@ -21,6 +21,7 @@
 #define MISDNHW_H
 #include <linux/mISDNif.h>
 #include <linux/timer.h>
+#include <linux/percpu.h>
 
 /*
  * HW DEBUG 0xHHHHGGGG
@@ -40,6 +41,14 @@
 #define MAX_LOG_SPACE		2048
 #define MISDN_COPY_SIZE		32
 
+/* count in the per cpu statistics of a hardware channel */
+#define mISDN_stat_add(ch, field, n)				\
+	do {							\
+		if ((ch)->stats)				\
+			this_cpu_add((ch)->stats->field, n);	\
+	} while (0)
+#define mISDN_stat_inc(ch, field)	mISDN_stat_add(ch, field, 1)
+
 /* channel->Flags bit field */
 #define FLG_TX_BUSY		0	/* tx_buf in use */
 #define FLG_TX_NEXT		1	/* next_skb in use */
@@ -75,6 +84,8 @@
 #define FLG_TX_EMPTY		27
 /* stop sending received data upstream */
 #define FLG_RX_OFF		28
+/* transparent receive data goes to rx_ring */
+#define FLG_RX_RING		29
 /* workq events */
 #define FLG_RECVQUEUE		30
 #define	FLG_PHCHANGE		31
@@ -158,12 +169,16 @@ struct bchannel {
 	/* receive data */
 	u8			fill[MISDN_BCH_FILL_SIZE];
 	struct sk_buff		*rx_skb;
+	struct mISDN_rx_ring	*rx_ring; /* mISDN_bchannel_rx_ring */
 	unsigned short		maxlen;
 	unsigned short		init_maxlen; /* initial value */
 	unsigned short		next_maxlen; /* pending value */
 	unsigned short		minlen; /* for transparent data */
 	unsigned short		init_minlen; /* initial value */
 	unsigned short		next_minlen; /* pending value */
+	unsigned short		rx_flush_ms; /* deliver short frames after */
+	unsigned long		rx_flush; /* rx_flush_ms in jiffies */
+	unsigned long		rx_first; /* jiffies of the rx_skb */
 	/* send data */
 	struct sk_buff		*next_skb;
 	struct sk_buff		*tx_skb;
@@ -178,6 +193,73 @@ struct bchannel {
 	int			dropcnt;
 };
 
+/*
+ * interrupt mitigation of a card, see hwchannel.c
+ * the card is polled from a timer while it interrupts more than limit times
+ * per jiffy and goes back to interrupts after MISDN_IRQPOLL_IDLE idle polls.
+ */
+#define MISDN_IRQPOLL_IDLE	2
+
+#define FLG_IRQPOLL_ON		0	/* card is polled */
+#define FLG_IRQPOLL_STOP	1	/* card goes away */
+
+struct mISDN_irqpoll {
+	struct timer_list	timer;
+	/* handle up to budget events, returns the number of events */
+	int			(*poll)(struct mISDN_irqpoll *, int);
+	/* enable the interrupts of the card again */
+	void			(*rearm)(struct mISDN_irqpoll *);
+	u_long			Flags;
+	u_int			limit;	/* irqs per jiffy, 0 never poll */
+	int			budget;	/* events per poll */
+	u_int			count;	/* irqs in this jiffy */
+	u_long			stamp;	/* jiffy of count */
+	u_int			idle;	/* polls without events */
+	u_long			polls;	/* statistics */
+	u_long			switches;
+};
+
+extern void	mISDN_irqpoll_init(struct mISDN_irqpoll *,
+				   int (*)(struct mISDN_irqpoll *, int),
+				   void (*)(struct mISDN_irqpoll *),
+				   u_int, int);
+extern bool	mISDN_irqpoll_irq(struct mISDN_irqpoll *);
+extern void	mISDN_irqpoll_kill(struct mISDN_irqpoll *);
+
+/*
+ * HDLC in software for cards without HDLC controller, see hdlc.c
+ * the decode and encode calls work like the isdnhdlc ones.
+ */
+#define MISDN_HDLC_FRAMING_ERROR	1
+#define MISDN_HDLC_CRC_ERROR		2
+#define MISDN_HDLC_LENGTH_ERROR		3
+
+struct mISDN_hdlc_rx {
+	u32	acc;	/* received bits, not yet a byte */
+	int	len;	/* bytes of the frame in dst */
+	u16	crc;
+	u8	nbits;	/* bits in acc */
+	u8	ones;	/* ones in a row, not yet in acc */
+	u8	hunt;	/* no frame, wait for a flag */
+	u8	cbin;	/* rest of the last input byte */
+	u8	cbits;	/* bits in cbin */
+};
+
+struct mISDN_hdlc_tx {
+	u32	acc;	/* bits to send */
+	u16	crc;
+	u8	nbits;	/* bits in acc */
+	u8	ones;	/* ones in a row sent */
+	u8	state;
+};
+
+extern void	mISDN_hdlc_rx_init(struct mISDN_hdlc_rx *);
+extern void	mISDN_hdlc_tx_init(struct mISDN_hdlc_tx *);
+extern int	mISDN_hdlc_decode(struct mISDN_hdlc_rx *, const u8 *, int,
+				  int *, u8 *, int);
+extern int	mISDN_hdlc_encode(struct mISDN_hdlc_tx *, const u8 *, int,
+				  int *, u8 *, int);
+
 extern int	mISDN_initdchannel(struct dchannel *, int, void *);
 extern int	mISDN_initbchannel(struct bchannel *, unsigned short,
 				   unsigned short);
@@ -195,6 +277,7 @@ extern void	recv_Echannel(struct dchannel *, struct dchannel *);
 extern void	recv_Bchannel(struct bchannel *, unsigned int, bool);
 extern void	recv_Dchannel_skb(struct dchannel *, struct sk_buff *);
 extern void	recv_Bchannel_skb(struct bchannel *, struct sk_buff *);
+extern int	recv_Bchannel_ring(struct bchannel *, const u8 *, int);
 extern int	get_next_bframe(struct bchannel *);
 extern int	get_next_dframe(struct dchannel *);
 
@@ -118,6 +118,7 @@
 /* intern layer 2 */
 #define DL_TIMER200_IND		0x7004
 #define DL_TIMER203_IND		0x7304
+#define DL_TIMERACK_IND		0x7504
 #define DL_INTERN_MSG		0x7804
 
 /* DL_INFORMATION_IND types */
@@ -154,6 +155,11 @@
 #define DSP_BF_ACCEPT		0x2416
 #define DSP_BF_REJECT		0x2417
 #define DSP_PIPELINE_CFG	0x2418
+#define DSP_GAIN_TX		0x2419	/* int, gain in 0.5 dB steps */
+#define DSP_GAIN_RX		0x241a	/* int, gain in 0.5 dB steps */
+#define DSP_RX_FRAME		0x241b	/* int, rx frame duration in ms */
+#define DSP_RECORD_ON		0x241c	/* int, id for IMDSPRECORD */
+#define DSP_RECORD_OFF		0x241d
 #define HFC_VOL_CHANGE_TX	0x2601
 #define HFC_VOL_CHANGE_RX	0x2602
 #define HFC_SPL_LOOP_ON		0x2603
@@ -244,11 +250,21 @@
 #define ISDN_P_B_T30_FAX	0x27
 #define ISDN_P_B_MODEM_ASYNC	0x28
 
+/* all B-channels of a device on one socket, see MISDN_TRUNK */
+#define ISDN_P_TRUNK		0x40
+
 #define OPTION_L2_PMX		1
 #define OPTION_L2_PTP		2
 #define OPTION_L2_FIXEDTEI	3
 #define OPTION_L2_CLEANUP	4
 #define OPTION_L1_HOLD		5
+#define OPTION_TX_SG		6	/* hw channel reads tx page frags */
+#define OPTION_L2_MOD128	7	/* extended mode for LAPB */
+#define OPTION_L2_SREJ		8	/* selective reject for LAPB */
+#define OPTION_RX_RING		9	/* see mISDN_bchannel_rx_ring */
+/* window size k for create_l2, 0 is the default of the protocol */
+#define OPTION_L2_WINDOW_SHIFT	16
+#define OPTION_L2_WINDOW_MASK	0x7f
 
 /* should be in sync with linux/kobject.h:KOBJ_NAME_LEN */
 #define MISDN_MAX_IDLEN		20
@@ -259,6 +275,19 @@ struct mISDNhead {
 }  __packed;
 
 #define MISDN_HEADER_LEN	sizeof(struct mISDNhead)
+
+/*
+ * with the MISDN_BATCH socket option, a message holds several frames, each
+ * with this head, at offsets aligned to 4 bytes
+ */
+struct mISDN_batchhead {
+	unsigned int	prim;
+	unsigned int	id;
+	unsigned int	len;	/* of the data behind the head */
+}  __packed;
+
+#define MISDN_BATCH_HEAD_LEN	sizeof(struct mISDN_batchhead)
+#define MISDN_BATCH_ALIGN(l)	(((l) + 3) & ~3)
 #define MAX_DATA_SIZE		2048
 #define MAX_DATA_MEM		(MAX_DATA_SIZE + MISDN_HEADER_LEN)
 #define MAX_DFRAME_LEN		260
@@ -329,6 +358,74 @@ struct ph_info {
 /* timer device ioctl */
 #define IMADDTIMER	_IOR('I', 64, int)
 #define IMDELTIMER	_IOR('I', 65, int)
+#define IMTIMERRING	_IOR('I', 74, int)
+
+/*
+ * IMTIMERRING: shared memory ring for the ids of expired timers
+ *
+ * The ioctl takes the number of ids, a power of 2, once per file. Then the
+ * ring is mapped with mmap at offset 0. The kernel puts the ids at head,
+ * the user takes them at tail. If the ring is full, the ids are returned
+ * by read as before, until read took all of them.
+ * A read returns as many ids as fit into its buffer.
+ */
+struct mISDN_timer_ring {
+	unsigned int	size;		/* number of ids */
+	unsigned int	head;		/* written by the kernel */
+	unsigned int	tail;		/* written by the user */
+	unsigned int	reserved;
+	int		id[];
+};
+
+#define MISDN_TIMER_RING_MAX	4096
+
+/*
+ * IMDSPATTACH: audio of a dsp pipeline element "uspace" done in user space
+ *
+ * A file of /dev/mISDNdsp serves the instance "uspace(id=...)" with the
+ * same id. The ioctl takes a struct mISDN_dsp_attach, once per file. Then
+ * the rings are mapped with mmap at offset 0, they use the layout and the
+ * ownership of the MISDN_RING rings, with frames in each direction.
+ *
+ * rx: the kernel gives each frame of the instance to the user, prim is
+ * PH_DATA_REQ for audio to the line (process_tx) and PH_DATA_IND for audio
+ * from the line (process_rx), with txlen in id. The file gets readable.
+ * tx: the user gives the processed audio back with the same prim. The
+ * kernel takes it in the next frame of that direction, so the processing
+ * delays the audio by one frame. Until it is back, the audio is passed
+ * unprocessed, as it is without a file.
+ */
+#define IMDSPATTACH	_IOR('I', 75, struct mISDN_dsp_attach)
+
+struct mISDN_dsp_attach {
+	unsigned int	id;
+	unsigned int	frame_size;	/* multiple of 16, with the frame head */
+	unsigned int	frames;		/* in each direction */
+	unsigned int	reserved;
+};
+
+/*
+ * IMDSPRECORD: recording tap of a dsp instance
+ *
+ * A file of /dev/mISDNrecord records the instance which got the same id
+ * with DSP_RECORD_ON. The ioctl takes a struct mISDN_dsp_record, once per
+ * file. Then the ring is mapped with mmap at offset 0, it uses the layout
+ * and the ownership of the MISDN_RING rx ring, there are no tx frames.
+ *
+ * The kernel gives each frame of the instance to the user, prim is
+ * PH_DATA_IND for audio from the line and PH_DATA_REQ for audio to the
+ * line, id is mISDN_clock_get() at the copy, so both directions can be
+ * lined up or mixed. The file gets readable after block frames. A dsp in
+ * recording does not bridge in hardware, so both directions pass it.
+ */
+#define IMDSPRECORD	_IOR('I', 76, struct mISDN_dsp_record)
+
+struct mISDN_dsp_record {
+	unsigned int	id;
+	unsigned int	frame_size;	/* multiple of 16, with the frame head */
+	unsigned int	frames;
+	unsigned int	block;		/* frames per wakeup, 0 = 1 */
+};
 
 /* socket ioctls */
 #define	IMGETVERSION	_IOR('I', 66, int)
@@ -338,6 +435,7 @@ struct ph_info {
 #define IMCLEAR_L2	_IOR('I', 70, int)
 #define IMSETDEVNAME	_IOR('I', 71, struct mISDN_devrename)
 #define IMHOLD_L1	_IOR('I', 72, int)
+#define IMWINDOW_L2	_IOR('I', 73, int)
 
 static inline int
 test_channelmap(u_int nr, u_char *map)
@@ -374,6 +472,7 @@ clear_channelmap(u_int nr, u_char *map)
 #define MISDN_CTRL_FILL_EMPTY		0x0200
 #define MISDN_CTRL_GETPEER		0x0400
 #define MISDN_CTRL_L1_TIMER3		0x0800
+#define MISDN_CTRL_JB_STATS		0x1000
 #define MISDN_CTRL_HW_FEATURES_OP	0x2000
 #define MISDN_CTRL_HW_FEATURES		0x2001
 #define MISDN_CTRL_HFC_OP		0x4000
@@ -387,6 +486,8 @@ clear_channelmap(u_int nr, u_char *map)
 #define MISDN_CTRL_HFC_ECHOCAN_OFF 	0x4008
 #define MISDN_CTRL_HFC_WD_INIT		0x4009
 #define MISDN_CTRL_HFC_WD_RESET		0x400A
+#define MISDN_CTRL_HFC_POLL		0x400B
+#define MISDN_CTRL_RX_COALESCE		0x10000
 
 /* special RX buffer value for MISDN_CTRL_RX_BUFFER request.p1 is the minimum
  * buffer size request.p2 the maximum. Using  MISDN_CTRL_RX_SIZE_IGNORE will
@@ -394,8 +495,90 @@ clear_channelmap(u_int nr, u_char *map)
  */
 #define MISDN_CTRL_RX_SIZE_IGNORE	-1
 
+/* MISDN_CTRL_RX_COALESCE request.p1 is the duration of transparent receive
+ * frames in ms (0 is the default of the driver), request.p2 the time in ms
+ * after which a shorter frame is delivered anyway (0 never). Using
+ * MISDN_CTRL_RX_SIZE_IGNORE will not change the value, the old values are
+ * read back.
+ */
+
 /* socket options */
 #define MISDN_TIME_STAMP		0x0001
+#define MISDN_BATCH			0x0002
+#define MISDN_RING			0x0004
+#define MISDN_TRUNK			0x0008
+#define MISDN_RX_STAMP			0x0010
+#define MISDN_ZEROCOPY			0x0020
+
+/*
+ * MISDN_RX_STAMP: cmsg with the time the driver read the frame from the
+ * FIFO, as mISDN clock and as CLOCK_MONOTONIC
+ */
+struct mISDN_rxstamp {
+	__u64		clock;		/* samples, see mISDN_clock_get64 */
+	__s64		time;		/* ns */
+};
+
+/*
+ * MISDN_RING: shared memory rings for the frames of a data socket
+ *
+ * The option takes a struct mISDN_ring_req, once per socket. Then the rings
+ * are mapped with mmap at offset 0. The area starts with struct
+ * mISDN_ring_hdr, followed by the rx and the tx frames. Each frame starts
+ * with struct mISDN_ring_frame, its status tells who owns it.
+ *
+ * rx: the kernel fills the frames in order and gives them to the user.
+ * The user gives them back by setting MISDN_RING_KERNEL. The socket gets
+ * readable after rx_block frames, or for a frame that is not data.
+ * tx: the user fills the frames in order and gives them to the kernel,
+ * a send of length 0 then sends all of them and returns the count.
+ * The header is for information only, the kernel keeps its own copy of
+ * the geometry.
+ */
+struct mISDN_ring_req {
+	unsigned int	frame_size;	/* multiple of 16, with the frame head */
+	unsigned int	rx_frames;
+	unsigned int	tx_frames;
+	unsigned int	rx_block;	/* frames per wakeup */
+};
+
+struct mISDN_ring_hdr {
+	unsigned int	frame_size;
+	unsigned int	rx_frames;
+	unsigned int	tx_frames;
+	unsigned int	rx_offset;	/* of the first rx frame */
+	unsigned int	tx_offset;	/* of the first tx frame */
+	unsigned int	rx_dropped;	/* no free or too small frame */
+	unsigned int	tx_errors;
+	unsigned int	reserved;
+};
+
+#define MISDN_RING_KERNEL	0
+#define MISDN_RING_USER		1
+
+struct mISDN_ring_frame {
+	unsigned int	status;
+	unsigned int	len;		/* of the data behind the head */
+	unsigned int	prim;
+	unsigned int	id;
+	__u64		tstamp;		/* rx, ns since the epoch */
+};
+
+#define MISDN_RING_FRAME_HDR	sizeof(struct mISDN_ring_frame)
+
+/*
+ * MISDN_TRUNK: the B-channels and their protocol for a ISDN_P_TRUNK socket,
+ * set before bind. Without it, all B-channels of the device are opened
+ * with ISDN_P_B_RAW. The frames of the channels carry the channel number
+ * in bits 16-23 of their id, in both directions. The socket is woken once
+ * all active channels have received a frame, so once per tick.
+ */
+struct mISDN_trunk_req {
+	unsigned int	protocol;
+	unsigned char	channelmap[MISDN_CHMAP_SIZE];
+};
+
+#define MISDN_TRUNK_CHANNEL(id)		(((id) >> 16) & 0xff)
 
 struct mISDN_ctrl_req {
 	int		op;
@@ -414,6 +597,8 @@ struct mISDN_ctrl_req {
 #include <linux/net.h>
 #include <net/sock.h>
 #include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/jump_label.h>
 
 #define DEBUG_CORE		0x000000ff
 #define DEBUG_CORE_FUNC		0x00000002
@@ -436,6 +621,8 @@ struct mISDN_ctrl_req {
 #define mISDN_HEAD_P(s)		((struct mISDNhead *)&s->cb[0])
 #define mISDN_HEAD_PRIM(s)	(((struct mISDNhead *)&s->cb[0])->prim)
 #define mISDN_HEAD_ID(s)	(((struct mISDNhead *)&s->cb[0])->id)
+/* behind the head, zero if the frame has no stamp */
+#define mISDN_RXSTAMP_P(s)	((struct mISDN_rxstamp *)&s->cb[MISDN_HEADER_LEN])
 
 /* socket states */
 #define MISDN_OPEN	1
@@ -462,6 +649,69 @@ struct Bprotocol {
 	char			*name;
 	u_int			Bprotocols;
 	create_func_t		*create;
+	struct module		*owner;
+};
+
+/*
+ * transparent receive samples of a bchannel (mISDN_bchannel_rx_ring)
+ * one producer, the driver, and one consumer, which reads at its own clock.
+ * the indices only grow, each is written by one side only.
+ */
+#define MISDN_RX_RING_SIZE	1024	/* samples, power of 2 */
+
+struct mISDN_rx_ring {
+	u32			head;	/* written by the producer */
+	u32			tail;	/* written by the consumer */
+	u32			overrun; /* samples dropped, ring was full */
+	u8			buf[MISDN_RX_RING_SIZE];
+};
+
+static inline int
+mISDN_rx_ring_put(struct mISDN_rx_ring *r, const u8 *data, int len)
+{
+	u32	head = r->head, off, n;
+	int	space = MISDN_RX_RING_SIZE - (head - smp_load_acquire(&r->tail));
+
+	if (len > space) {
+		r->overrun += len - space;
+		len = space;
+	}
+	off = head & (MISDN_RX_RING_SIZE - 1);
+	n = min_t(u32, len, MISDN_RX_RING_SIZE - off);
+	memcpy(r->buf + off, data, n);
+	memcpy(r->buf, data + n, len - n);
+	/* the samples must be visible before the index */
+	smp_store_release(&r->head, head + len);
+	return len;
+}
+
+static inline int
+mISDN_rx_ring_get(struct mISDN_rx_ring *r, u8 *data, int len)
+{
+	u32	tail = r->tail, off, n;
+	int	avail = smp_load_acquire(&r->head) - tail;
+
+	if (len > avail)
+		len = avail;
+	off = tail & (MISDN_RX_RING_SIZE - 1);
+	n = min_t(u32, len, MISDN_RX_RING_SIZE - off);
+	memcpy(data, r->buf + off, n);
+	memcpy(data + n, r->buf, len - n);
+	/* the samples are read before they are given back */
+	smp_store_release(&r->tail, tail + len);
+	return len;
+}
+
+/* frame counters of a hardware channel, kept per cpu */
+struct mISDNchannel_stats {
+	u64			rx_frames;
+	u64			rx_bytes;
+	u64			tx_frames;
+	u64			tx_bytes;
+	u64			rx_dropped;
+	u64			tx_dropped;
+	u64			fifo_overrun;
+	u64			fifo_underrun;
 };
 
 struct mISDNchannel {
@@ -475,6 +725,7 @@ struct mISDNchannel {
 	send_func_t		*send;
 	send_func_t		*recv;
 	ctrl_func_t		*ctrl;
+	struct mISDNchannel_stats __percpu *stats; /* hardware channels */
 };
 
 struct mISDN_sock_list {
@@ -482,11 +733,18 @@ struct mISDN_sock_list {
 	rwlock_t		lock;
 };
 
+struct mISDN_sock_ring;
+struct mISDN_trunk;
+
 struct mISDN_sock {
 	struct sock		sk;
 	struct mISDNchannel	ch;
 	u_int			cmask;
 	struct mISDNdevice	*dev;
+	struct mISDN_sock_ring	*ring;	/* MISDN_RING */
+	struct mISDN_trunk	*trunk;	/* ISDN_P_TRUNK */
+	u_long			rx_flags; /* receive backpressure */
+	struct work_struct	rx_work;
 };
 
 
@@ -503,6 +761,26 @@ struct mISDNdevice {
 	struct device		dev;
 };
 
+/* processing time of the bursts, in buckets of 1 << n us */
+#define MISDN_STACK_TIME_BUCKETS	10
+
+/* message counters of a stack, kept per cpu */
+struct mISDNstack_stats {
+	u64			msgs;
+	u64			bursts;	/* queue takes with messages */
+	u64			errors;	/* messages not taken by a layer */
+	u64			direct;	/* sent without the queue */
+	u64			sleeps;
+	u64			stopped;
+	u_int			max_burst;	/* queue high-water mark */
+	u64			burst_time[MISDN_STACK_TIME_BUCKETS];
+};
+
+#define MISDN_L2_CACHE		128	/* a whole TEI range of one SAPI */
+#define MISDN_L2_IDS		64	/* channel nr of layer2 */
+
+struct FsmTimerBase;
+
 struct mISDNstack {
 	u_long			status;
 	struct mISDNdevice	*dev;
@@ -515,11 +793,16 @@ struct mISDNstack {
 	struct mISDNchannel	own;
 	struct mutex		lmutex; /* protect lists */
 	struct mISDN_sock_list	l1sock;
-#ifdef MISDN_MSG_STATS
-	u_int			msg_cnt;
-	u_int			sleep_cnt;
-	u_int			stopped_cnt;
-#endif
+	struct work_struct	work;	/* used instead of thread by workers */
+	int			cpu;	/* preferred cpu or -1 */
+	struct mISDNstack_stats	__percpu *stats;
+	struct task_struct	*owner;	/* of the dispatch */
+	struct sk_buff_head	*burst;	/* left to send by the owner */
+	/* layer2 by address, checked against ch->addr, see send_layer2 */
+	struct mISDNchannel __rcu *l2cache[MISDN_L2_CACHE];
+	/* layer2 by channel nr, see get_channel4id */
+	struct mISDNchannel __rcu *l2ids[MISDN_L2_IDS];
+	struct FsmTimerBase	*timers;	/* of the layer2 FSMs */
 };
 
 typedef	int	(clockctl_func_t)(void *, int);
@@ -530,10 +813,25 @@ struct	mISDNclock {
 	int			pri;
 	clockctl_func_t		*ctl;
 	void			*priv;
+	/* quality, measured by clock.c */
+	ktime_t			last;	/* time of last update */
+	s64			drift;	/* average drift in ppm */
+	s64			jitter;	/* average jitter in ns */
+	u_int			updates; /* number of updates measured */
 };
 
 /* global alloc/queue functions */
 
+/*
+ * transparent audio frames are taken from a recycled per cpu pool, see
+ * mI_alloc_audio_skb(). its frames hold at least this size, more if the
+ * B-channels receive larger frames.
+ */
+#define MISDN_AUDIO_SKB_LEN	512
+
+extern struct sk_buff	*mI_alloc_audio_skb(unsigned int, gfp_t);
+extern void		mI_free_audio_skb(struct sk_buff *);
+
 static inline struct sk_buff *
 mI_alloc_skb(unsigned int len, gfp_t gfp_mask)
 {
@@ -598,7 +896,21 @@ static inline struct mISDNdevice *dev_to_mISDN(struct device *dev)
 extern void	set_channel_address(struct mISDNchannel *, u_int, u_int);
 extern void	mISDN_clock_update(struct mISDNclock *, int, ktime_t *);
 extern unsigned short mISDN_clock_get(void);
+extern u64	mISDN_clock_get64(void);
 extern const char *mISDNDevName4ch(struct mISDNchannel *);
+extern struct mISDN_rx_ring *mISDN_bchannel_rx_ring(struct mISDNchannel *,
+						    int);
+
+/* only on while a socket asks for MISDN_RX_STAMP */
+extern struct static_key_false	mISDN_rxstamp_key;
+extern void	__mISDN_rx_stamp(struct sk_buff *);
+
+static inline void
+mISDN_rx_stamp(struct sk_buff *skb)
+{
+	if (static_branch_unlikely(&mISDN_rxstamp_key))
+		__mISDN_rx_stamp(skb);
+}
 
 #endif /* __KERNEL__ */
 #endif /* mISDNIF_H */
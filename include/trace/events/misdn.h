@@ -0,0 +1,107 @@
+/*
+ * misdn.h  tracepoints of the mISDN audio path
+ *
+ * Every hop of a B-channel frame records the device and channel, the
+ * length, a fill level of the hop and the mISDN sample clock, so the
+ * delay between two hops of the same channel can be taken from the
+ * trace, e.g.
+ *
+ *	perf record -e 'misdn:*'
+ *
+ * The hops of received audio are misdn_fifo_rx (driver reads the FIFO),
+ * misdn_bch_rx (frame queued by recv_Bchannel), misdn_dsp_rx
+ * (dsp_function), misdn_cmx_rx (written into the cmx buffer), misdn_cmx_tx
+ * (the cmx tick sends it on), misdn_sock_rx (queued to the socket) and
+ * misdn_sock_recv (read by user space). misdn_fifo_tx is the driver
+ * writing audio to the FIFO.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM misdn
+
+#if !defined(_TRACE_MISDN_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_MISDN_H
+
+#include <linux/tracepoint.h>
+#include <linux/mISDNif.h>
+
+DECLARE_EVENT_CLASS(misdn_audio,
+
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+
+	TP_ARGS(ch, nr, len, fill),
+
+	TP_STRUCT__entry(
+		__field(int,	dev)
+		__field(u_int,	nr)
+		__field(int,	len)
+		__field(int,	fill)
+		__field(u64,	clock)
+	),
+
+	TP_fast_assign(
+		__entry->dev = (ch->st && ch->st->dev) ? ch->st->dev->id : -1;
+		__entry->nr = nr;
+		__entry->len = len;
+		__entry->fill = fill;
+		__entry->clock = mISDN_clock_get64();
+	),
+
+	TP_printk("dev=%d ch=%u len=%d fill=%d clock=%llu",
+		  __entry->dev, __entry->nr, __entry->len, __entry->fill,
+		  (unsigned long long)__entry->clock)
+);
+
+/* fill is the number of bytes in the TX FIFO */
+DEFINE_EVENT(misdn_audio, misdn_fifo_rx,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+DEFINE_EVENT(misdn_audio, misdn_fifo_tx,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+/* fill is the number of frames in the receive queue */
+DEFINE_EVENT(misdn_audio, misdn_bch_rx,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+/* fill is the id of the frame, the FIFO fill or time code */
+DEFINE_EVENT(misdn_audio, misdn_dsp_rx,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+/* fill is the delay in the cmx receive buffer in samples */
+DEFINE_EVENT(misdn_audio, misdn_cmx_rx,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+DEFINE_EVENT(misdn_audio, misdn_cmx_tx,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+/* fill is the number of frames queued on the socket */
+DEFINE_EVENT(misdn_audio, misdn_sock_rx,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+DEFINE_EVENT(misdn_audio, misdn_sock_recv,
+	TP_PROTO(struct mISDNchannel *ch, u_int nr, int len, int fill),
+	TP_ARGS(ch, nr, len, fill)
+);
+
+#endif /* _TRACE_MISDN_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>